@@ -1,43 +1,155 @@
 #include "accelerator.h"
 
 #include "ogl/image/image_mixer.h"
+#include "ogl/image/tiled_image_mixer.h"
 #include "ogl/util/device.h"
 
 #include <boost/property_tree/ptree.hpp>
 
 #include <common/bit_depth.h>
+#include <common/env.h>
+#include <common/except.h>
 
 #include <core/mixer/image/image_mixer.h>
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace accelerator {
 
+// Presents every OpenGL device as one, for INFO GL and GL GC
+class device_group : public accelerator_device
+{
+    std::vector<std::shared_ptr<ogl::device>> devices_;
+
+  public:
+    explicit device_group(std::vector<std::shared_ptr<ogl::device>> devices)
+        : devices_(std::move(devices))
+    {
+    }
+
+    boost::property_tree::wptree info() const override
+    {
+        if (devices_.size() == 1) {
+            return devices_.front()->info();
+        }
+
+        boost::property_tree::wptree info;
+        for (auto& device : devices_) {
+            info.add_child(L"devices.device", device->info());
+        }
+        return info;
+    }
+
+    std::future<void> gc() override
+    {
+        std::vector<std::shared_future<void>> futures;
+        for (auto& device : devices_) {
+            futures.push_back(device->gc().share());
+        }
+        return std::async(std::launch::deferred, [futures] {
+            for (auto& future : futures) {
+                future.get();
+            }
+        });
+    }
+};
+
 struct accelerator::impl
 {
-    std::shared_ptr<ogl::device>        ogl_device_;
     const core::video_format_repository format_repository_;
+    const int                           device_count_;
+
+    std::mutex                                mutex_;
+    std::vector<std::shared_ptr<ogl::device>> ogl_devices_;
+    std::vector<int>                          channel_counts_;
 
     impl(const core::video_format_repository format_repository)
         : format_repository_(format_repository)
+        , device_count_(std::max(1, env::properties().get(L"configuration.accelerator.devices", 1)))
+        , ogl_devices_(device_count_)
+        , channel_counts_(device_count_)
     {
+        // OpenGL is the only backend so far. Other values are rejected rather than silently mixed with OpenGL.
+        auto backend = env::properties().get(L"configuration.accelerator.backend", std::wstring(L"ogl"));
+        if (backend != L"ogl") {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unsupported accelerator backend: " + backend +
+                                                            L", only ogl is available"));
+        }
     }
 
-    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id, common::bit_depth depth)
+    std::unique_ptr<core::image_mixer> create_image_mixer(int                  channel_id,
+                                                          common::bit_depth    depth,
+                                                          core::color_transfer transfer,
+                                                          int                  device_index,
+                                                          int                  columns,
+                                                          int                  rows)
     {
-        return std::make_unique<ogl::image_mixer>(
-            spl::make_shared_ptr(get_device()), channel_id, format_repository_.get_max_video_format_size(), depth);
+        if (columns * rows == 1) {
+            return create_ogl_image_mixer(channel_id, depth, transfer, device_index);
+        }
+
+        // Tiles go to the devices in turn from device_index, or each to the device serving the fewest channels
+        std::vector<std::unique_ptr<ogl::image_mixer>> mixers;
+        for (int n = 0; n < columns * rows; ++n) {
+            auto tile_device = device_index < 0 ? -1 : (device_index + n) % device_count_;
+            mixers.push_back(create_ogl_image_mixer(channel_id, depth, transfer, tile_device));
+        }
+        return std::make_unique<ogl::tiled_image_mixer>(std::move(mixers), columns, rows);
     }
 
-    std::shared_ptr<ogl::device> get_device()
+    std::unique_ptr<ogl::image_mixer>
+    create_ogl_image_mixer(int channel_id, common::bit_depth depth, core::color_transfer transfer, int device_index)
     {
-        if (!ogl_device_) {
-            ogl_device_ = std::make_shared<ogl::device>();
+        return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(assign_device(device_index)),
+                                                  channel_id,
+                                                  format_repository_.get_max_video_format_size(),
+                                                  depth,
+                                                  transfer);
+    }
+
+    std::shared_ptr<ogl::device> assign_device(int device_index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (device_index >= device_count_) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid accelerator device: " +
+                                                            std::to_wstring(device_index) + L", only " +
+                                                            std::to_wstring(device_count_) + L" configured"));
         }
 
-        return ogl_device_;
+        // Without an explicit device, channels go to the device serving the fewest channels
+        if (device_index < 0) {
+            device_index = static_cast<int>(std::min_element(channel_counts_.begin(), channel_counts_.end()) -
+                                            channel_counts_.begin());
+        }
+
+        channel_counts_[device_index] += 1;
+        return get_device(device_index);
+    }
+
+    std::shared_ptr<ogl::device> get_device(int device_index)
+    {
+        auto& device = ogl_devices_.at(device_index);
+        if (!device) {
+            device = std::make_shared<ogl::device>(device_index);
+        }
+
+        return device;
+    }
+
+    std::shared_ptr<accelerator_device> get_devices()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<std::shared_ptr<ogl::device>> devices;
+        for (int n = 0; n < device_count_; ++n) {
+            devices.push_back(get_device(n));
+        }
+        return std::make_shared<device_group>(std::move(devices));
     }
 };
 
@@ -48,14 +160,16 @@ accelerator::accelerator(const core::video_format_repository format_repository)
 
 accelerator::~accelerator() {}
 
-std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(const int channel_id, common::bit_depth depth)
+std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(const int            channel_id,
+                                                                   common::bit_depth    depth,
+                                                                   core::color_transfer transfer,
+                                                                   int                  device_index,
+                                                                   int                  columns,
+                                                                   int                  rows)
 {
-    return impl_->create_image_mixer(channel_id, depth);
+    return impl_->create_image_mixer(channel_id, depth, transfer, device_index, columns, rows);
 }
 
-std::shared_ptr<accelerator_device> accelerator::get_device() const
-{
-    return std::dynamic_pointer_cast<accelerator_device>(impl_->get_device());
-}
+std::shared_ptr<accelerator_device> accelerator::get_device() const { return impl_->get_devices(); }
 
 }} // namespace caspar::accelerator
@@ -30,8 +30,18 @@ class accelerator
 
     accelerator& operator=(accelerator&) = delete;
 
-    std::unique_ptr<caspar::core::image_mixer> create_image_mixer(int channel_id, common::bit_depth depth);
-
+    // device_index selects one of the configured OpenGL devices, -1 picks the one serving the fewest channels. A
+    // channel of more than one column or row is mixed as tiles, on the devices in turn from device_index. A transfer
+    // other than bt709 is mixed in linear light.
+    std::unique_ptr<caspar::core::image_mixer>
+    create_image_mixer(int                  channel_id,
+                       common::bit_depth    depth,
+                       core::color_transfer transfer     = core::color_transfer::bt709,
+                       int                  device_index = -1,
+                       int                  columns      = 1,
+                       int                  rows         = 1);
+
+    // All devices, presented as one
     std::shared_ptr<accelerator_device> get_device() const;
 
   private:
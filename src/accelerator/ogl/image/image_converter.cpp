@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image_converter.h"
+#include "image_kernel.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+#include "ogl_converter_compute.h"
+
+#include <string>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+struct image_converter::impl
+{
+    spl::shared_ptr<device> ogl_;
+    std::unique_ptr<shader> shader_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+    {
+        ogl_->dispatch_sync([&] { shader_ = std::make_unique<shader>(std::string(converter_compute_shader)); });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] { shader_.reset(); });
+    }
+
+    std::shared_ptr<texture> convert(const std::vector<std::shared_ptr<texture>>& planes,
+                                     const core::pixel_format_desc&               desc)
+    {
+        auto target_desc = converted_desc(desc);
+        auto width       = target_desc.planes[0].width;
+        auto height      = target_desc.planes[0].height;
+        auto depth       = target_desc.planes[0].depth;
+        auto target      = ogl_->create_texture(width, height, 4, depth, false);
+
+        // Standard definition is always bt.601, as in image_kernel
+        auto color_space = height > 700 ? desc.color_space : core::color_space::bt601;
+
+        const float color_matrices[3][9] = {
+            {1.0, 0.0, 1.402, 1.0, -0.344, -0.509, 1.0, 1.772, 0.0},                          // bt.601
+            {1.0, 0.0, 1.5748, 1.0, -0.1873, -0.4681, 1.0, 1.8556, 0.0},                      // bt.709
+            {1.0, 0.0, 1.4746, 1.0, -0.16455312684366, -0.57135312684366, 1.0, 1.8814, 0.0}}; // bt.2020
+
+        float precision_factor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        for (int n = 0; n < static_cast<int>(planes.size()); ++n) {
+            planes[n]->bind(n);
+            precision_factor[n] = static_cast<float>(get_precision_factor(planes[n]->depth()));
+        }
+
+        shader_->use();
+        shader_->set_matrix3("color_matrix", color_matrices[static_cast<int>(color_space)]);
+        GL(glUniform4fv(glGetUniformLocation(shader_->id(), "precision_factor"), 1, precision_factor));
+        shader_->set("has_alpha", planes.size() > 3);
+
+        GL(glBindImageTexture(0,
+                              target->id(),
+                              0,
+                              GL_FALSE,
+                              0,
+                              GL_WRITE_ONLY,
+                              depth == common::bit_depth::bit8 ? GL_RGBA8 : GL_RGBA16));
+        GL(glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1));
+        GL(glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8));
+
+        // Draws sample the result through texture fetches
+        GL(glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT));
+
+        return target;
+    }
+};
+
+image_converter::image_converter(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+image_converter::~image_converter() {}
+
+bool image_converter::supports(const core::pixel_format_desc& desc)
+{
+    return (desc.format == core::pixel_format::ycbcr && desc.planes.size() == 3) ||
+           (desc.format == core::pixel_format::ycbcra && desc.planes.size() == 4);
+}
+
+core::pixel_format_desc image_converter::converted_desc(const core::pixel_format_desc& desc)
+{
+    auto depth = common::bit_depth::bit8;
+    for (auto& plane : desc.planes) {
+        if (plane.depth != common::bit_depth::bit8) {
+            depth = common::bit_depth::bit16;
+        }
+    }
+
+    core::pixel_format_desc result(core::pixel_format::bgra, desc.color_space);
+    result.is_straight_alpha = desc.is_straight_alpha;
+    result.transfer          = desc.transfer;
+    result.planes.emplace_back(desc.planes[0].width, desc.planes[0].height, 4, depth);
+    return result;
+}
+
+std::shared_ptr<texture> image_converter::convert(const std::vector<std::shared_ptr<texture>>& planes,
+                                                  const core::pixel_format_desc&               desc)
+{
+    return impl_->convert(planes, desc);
+}
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Converts the planes of a ycbcr or ycbcra frame into a single texture with a compute shader, so that every draw of
+// the frame samples one texture instead of converting again. The result is drawn as bgra. Must be called on the
+// device thread.
+class image_converter final
+{
+    image_converter(const image_converter&);
+    image_converter& operator=(const image_converter&);
+
+  public:
+    explicit image_converter(const spl::shared_ptr<class device>& ogl);
+    ~image_converter();
+
+    // Whether frames of the given layout are converted
+    static bool supports(const core::pixel_format_desc& desc);
+
+    // The layout of the converted texture of a frame of the given layout
+    static core::pixel_format_desc converted_desc(const core::pixel_format_desc& desc);
+
+    std::shared_ptr<class texture> convert(const std::vector<std::shared_ptr<class texture>>& planes,
+                                           const core::pixel_format_desc&                     desc);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -37,8 +37,13 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
 
 namespace caspar::accelerator::ogl {
 
@@ -80,20 +85,336 @@ bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
 
 static const double epsilon = 0.001;
 
+// Mirrors the std140 draw_block uniform block in shader.frag
+struct draw_block
+{
+    float        color_matrix[3][4]; // Columns, each padded to a vec4
+    float        precision_factor[4];
+    float        luma_coeff[3];
+    float        opacity;
+    float        min_input;
+    float        max_input;
+    float        gamma;
+    float        min_output;
+    float        max_output;
+    float        brt;
+    float        sat;
+    float        con;
+    float        chroma_target_hue;
+    float        chroma_hue_width;
+    float        chroma_min_saturation;
+    float        chroma_min_brightness;
+    float        chroma_softness;
+    float        chroma_spill_suppress;
+    float        chroma_spill_suppress_saturation;
+    std::int32_t blend_mode;
+    std::int32_t keyer;
+    std::int32_t pixel_format;
+    std::int32_t is_straight_alpha;
+    std::int32_t has_local_key;
+    std::int32_t has_layer_key;
+    std::int32_t invert;
+    std::int32_t levels;
+    std::int32_t csb;
+    std::int32_t chroma;
+    std::int32_t chroma_show_mask;
+    std::int32_t field;
+    std::int32_t transition;
+    std::int32_t transition_format;
+    std::int32_t transition_straight_alpha;
+    float        transition_opacity;
+    float        transition_precision;
+    std::int32_t mask_format;
+    std::int32_t mask_straight_alpha;
+    float        mask_precision;
+    std::int32_t target_field;
+    std::int32_t transfer;
+    std::int32_t transition_transfer;
+};
+
+static_assert(sizeof(draw_block) == 232, "draw_block must match the std140 layout of the shader");
+
+// A persistently mapped buffer that draws append their data to, instead of respecifying a buffer per draw. A fence is
+// placed when writing moves on from one half to the other, and waited on before that half is written again, so data
+// is never overwritten while the GPU may still read it.
+class stream_buffer
+{
+    GLuint                id_ = 0;
+    GLsizeiptr            size_;
+    std::uint8_t*         data_   = nullptr;
+    GLsizeiptr            offset_ = 0;
+    std::array<GLsync, 2> fences_{};
+
+  public:
+    explicit stream_buffer(GLsizeiptr size)
+        : size_(size)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        GL(glCreateBuffers(1, &id_));
+        GL(glNamedBufferStorage(id_, size_, nullptr, flags));
+        data_ = static_cast<std::uint8_t*>(GL2(glMapNamedBufferRange(id_, 0, size_, flags)));
+    }
+
+    stream_buffer(const stream_buffer&)            = delete;
+    stream_buffer& operator=(const stream_buffer&) = delete;
+
+    ~stream_buffer()
+    {
+        for (auto fence : fences_) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        glUnmapNamedBuffer(id_);
+        glDeleteBuffers(1, &id_);
+    }
+
+    GLuint id() const { return id_; }
+
+    // Copies the data to an offset that is a multiple of alignment, and returns that offset
+    GLintptr write(const void* data, GLsizeiptr size, GLsizeiptr alignment)
+    {
+        const auto half = size_ / 2;
+        CASPAR_VERIFY(size <= half);
+
+        auto align = [&](GLsizeiptr offset) { return (offset + alignment - 1) / alignment * alignment; };
+
+        auto begin = align(offset_);
+        if (begin < half && begin + size > half) {
+            begin = align(half);
+        }
+        if (begin + size > size_) {
+            begin = 0;
+        }
+
+        const auto from = offset_ <= half ? 0 : 1;
+        const auto to   = begin < half ? 0 : 1;
+        if (from != to) {
+            fences_[from] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            if (fences_[to]) {
+                glClientWaitSync(fences_[to], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fences_[to]);
+                fences_[to] = nullptr;
+            }
+        }
+
+        std::memcpy(data_ + begin, data, static_cast<size_t>(size));
+        offset_ = begin + size;
+        return begin;
+    }
+};
+
+// The transforms of a draw with the scale mode of its geometry applied
+draw_transforms get_fitted_transforms(const draw_params& params)
+{
+    auto transforms = params.transforms;
+
+    auto const first_plane = params.pix_desc.planes.at(0);
+    if (params.geometry.mode() != core::frame_geometry::scale_mode::stretch && first_plane.width > 0 &&
+        first_plane.height > 0) {
+        auto width_scale  = static_cast<double>(params.target_width) / static_cast<double>(first_plane.width);
+        auto height_scale = static_cast<double>(params.target_height) / static_cast<double>(first_plane.height);
+
+        core::image_transform transform;
+        double                target_scale;
+        switch (params.geometry.mode()) {
+            case core::frame_geometry::scale_mode::fit:
+                target_scale = std::min(width_scale, height_scale);
+
+                transform.fill_scale[0] *= target_scale / width_scale;
+                transform.fill_scale[1] *= target_scale / height_scale;
+                break;
+
+            case core::frame_geometry::scale_mode::fill:
+                target_scale = std::max(width_scale, height_scale);
+                transform.fill_scale[0] *= target_scale / width_scale;
+                transform.fill_scale[1] *= target_scale / height_scale;
+                break;
+
+            case core::frame_geometry::scale_mode::original:
+                transform.fill_scale[0] /= width_scale;
+                transform.fill_scale[1] /= height_scale;
+                break;
+
+            case core::frame_geometry::scale_mode::hfill:
+                transform.fill_scale[1] *= width_scale / height_scale;
+                break;
+
+            case core::frame_geometry::scale_mode::vfill:
+                transform.fill_scale[0] *= height_scale / width_scale;
+                break;
+
+            default:;
+        }
+
+        transforms = transforms.combine_transform(transform, params.aspect_ratio);
+    }
+
+    return transforms;
+}
+
+std::vector<core::frame_geometry::coord> get_draw_coords(const draw_params& params)
+{
+    if (params.transforms.image_transform.opacity < epsilon) {
+        return {};
+    }
+
+    auto coords = params.geometry.data();
+    if (coords.empty()) {
+        return {};
+    }
+
+    coords = get_fitted_transforms(params).transform_coords(coords);
+
+    // Skip drawing if all the coordinates will be outside the screen.
+    if (coords.size() < 3 || is_outside_screen(coords)) {
+        return {};
+    }
+
+    return coords;
+}
+
+bool is_transition_format(const core::pixel_format_desc& desc)
+{
+    switch (desc.format) {
+        case core::pixel_format::bgra:
+        case core::pixel_format::rgba:
+        case core::pixel_format::argb:
+        case core::pixel_format::abgr:
+            return desc.planes.size() == 1;
+        default:
+            return false;
+    }
+}
+
+// Whether the draw shows its source at less than half its size on both axes. Sampling it bilinearly at full
+// resolution then skips texels, and aliases, as with the small sources of a multiviewer grid.
+bool is_minified(const std::vector<core::frame_geometry::coord>& coords, const draw_params& params)
+{
+    // Fields are sampled line by line, and packed formats hold more than one pixel per texel
+    if (params.field != core::video_field::progressive || params.pix_desc.format == core::pixel_format::uyvy) {
+        return false;
+    }
+
+    auto min_vertex  = std::array<double, 2>{1.0, 1.0};
+    auto max_vertex  = std::array<double, 2>{0.0, 0.0};
+    auto min_texture = std::array<double, 2>{1.0, 1.0};
+    auto max_texture = std::array<double, 2>{0.0, 0.0};
+    for (auto& coord : coords) {
+        const double vertex[]  = {coord.vertex_x, coord.vertex_y};
+        const double texture[] = {coord.texture_x / coord.texture_q, coord.texture_y / coord.texture_q};
+        for (int n = 0; n < 2; ++n) {
+            min_vertex[n]  = std::min(min_vertex[n], vertex[n]);
+            max_vertex[n]  = std::max(max_vertex[n], vertex[n]);
+            min_texture[n] = std::min(min_texture[n], texture[n]);
+            max_texture[n] = std::max(max_texture[n], texture[n]);
+        }
+    }
+
+    const double target_size[] = {static_cast<double>(params.background->width()),
+                                  static_cast<double>(params.background->height())};
+    const double source_size[] = {static_cast<double>(params.textures.at(0)->width()),
+                                  static_cast<double>(params.textures.at(0)->height())};
+    for (int n = 0; n < 2; ++n) {
+        auto drawn  = (max_vertex[n] - min_vertex[n]) * target_size[n];
+        auto sample = (max_texture[n] - min_texture[n]) * source_size[n];
+        if (drawn * 2.0 >= sample) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A vertex of a triangle fan, in single precision, which every GPU reads natively
+struct vertex
+{
+    float position[2];
+    float texture[4];
+};
+
+// An axis aligned rectangle with a texture that maps to it along its axes, which most draws are. It is drawn as an
+// instance of a strip of four vertices, that the vertex shader places at its corners.
+struct quad
+{
+    float position[4]; // Left, top, right and bottom, or the other way around
+    float texture[4];
+    float texture_rq[2];
+};
+
+std::optional<quad> get_quad(const std::vector<core::frame_geometry::coord>& coords)
+{
+    if (coords.size() != 4) {
+        return {};
+    }
+
+    auto& first    = coords[0];
+    auto& opposite = coords[2];
+
+    auto near = [](double lhs, double rhs) { return std::abs(lhs - rhs) < 1e-9; };
+
+    // Whether corner takes its x from one of the diagonal corners and its y from the other
+    auto is_corner = [&](const core::frame_geometry::coord& corner,
+                         const core::frame_geometry::coord& x,
+                         const core::frame_geometry::coord& y) {
+        return near(corner.vertex_x, x.vertex_x) && near(corner.texture_x, x.texture_x) &&
+               near(corner.vertex_y, y.vertex_y) && near(corner.texture_y, y.texture_y) &&
+               near(corner.texture_r, first.texture_r) && near(corner.texture_q, first.texture_q);
+    };
+
+    if (!near(opposite.texture_r, first.texture_r) || !near(opposite.texture_q, first.texture_q)) {
+        return {};
+    }
+    if (!(is_corner(coords[1], first, opposite) && is_corner(coords[3], opposite, first)) &&
+        !(is_corner(coords[1], opposite, first) && is_corner(coords[3], first, opposite))) {
+        return {};
+    }
+
+    return quad{{static_cast<float>(first.vertex_x),
+                 static_cast<float>(first.vertex_y),
+                 static_cast<float>(opposite.vertex_x),
+                 static_cast<float>(opposite.vertex_y)},
+                {static_cast<float>(first.texture_x),
+                 static_cast<float>(first.texture_y),
+                 static_cast<float>(opposite.texture_x),
+                 static_cast<float>(opposite.texture_y)},
+                {static_cast<float>(first.texture_r), static_cast<float>(first.texture_q)}};
+}
+
 struct image_kernel::impl
 {
-    spl::shared_ptr<device> ogl_;
-    spl::shared_ptr<shader> shader_;
-    GLuint                  vao_;
-    GLuint                  vbo_;
+    spl::shared_ptr<device>        ogl_;
+    spl::shared_ptr<image_shaders> shaders_;
+    GLuint                         vao_;
+    std::unique_ptr<stream_buffer> vertices_;
+    std::unique_ptr<stream_buffer> uniforms_;
+    GLint                          uniform_alignment_ = 256;
 
     explicit impl(const spl::shared_ptr<device>& ogl)
         : ogl_(ogl)
-        , shader_(ogl_->dispatch_sync([&] { return get_image_shader(ogl); }))
+        , shaders_(ogl_->dispatch_sync([&] { return get_image_shaders(ogl); }))
     {
         ogl_->dispatch_sync([&] {
-            GL(glGenVertexArrays(1, &vao_));
-            GL(glGenBuffers(1, &vbo_));
+            vertices_ = std::make_unique<stream_buffer>(1 << 20);
+            uniforms_ = std::make_unique<stream_buffer>(1 << 20);
+            GL(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment_));
+
+            // Every shader variant shares the vertex shader and its attribute locations. Vertices of fans and
+            // instances of quads are read from the same buffer, through bindings with their own strides.
+            GL(glCreateVertexArrays(1, &vao_));
+            GL(glVertexArrayVertexBuffer(vao_, 0, vertices_->id(), 0, sizeof(vertex)));
+            GL(glVertexArrayVertexBuffer(vao_, 1, vertices_->id(), 0, sizeof(quad)));
+            GL(glVertexArrayBindingDivisor(vao_, 1, 1));
+
+            auto attrib = [&](GLuint location, GLuint binding, GLint size, GLuint offset) {
+                GL(glEnableVertexArrayAttrib(vao_, location));
+                GL(glVertexArrayAttribFormat(vao_, location, size, GL_FLOAT, GL_FALSE, offset));
+                GL(glVertexArrayAttribBinding(vao_, location, binding));
+            };
+            attrib(0, 0, 2, offsetof(vertex, position));
+            attrib(1, 0, 4, offsetof(vertex, texture));
+            attrib(2, 1, 4, offsetof(quad, position));
+            attrib(3, 1, 4, offsetof(quad, texture));
+            attrib(4, 1, 2, offsetof(quad, texture_rq));
         });
     }
 
@@ -101,7 +422,8 @@ struct image_kernel::impl
     {
         ogl_->dispatch_sync([&] {
             GL(glDeleteVertexArrays(1, &vao_));
-            GL(glDeleteBuffers(1, &vbo_));
+            vertices_.reset();
+            uniforms_.reset();
         });
     }
 
@@ -113,72 +435,63 @@ struct image_kernel::impl
             return;
         }
 
-        if (params.transforms.image_transform.opacity < epsilon) {
-            return;
-        }
-
-        auto coords = params.geometry.data();
+        auto coords = get_draw_coords(params);
         if (coords.empty()) {
             return;
         }
 
-        auto transforms = params.transforms;
-
-        auto const first_plane = params.pix_desc.planes.at(0);
-        if (params.geometry.mode() != core::frame_geometry::scale_mode::stretch && first_plane.width > 0 &&
-            first_plane.height > 0) {
-            auto width_scale  = static_cast<double>(params.target_width) / static_cast<double>(first_plane.width);
-            auto height_scale = static_cast<double>(params.target_height) / static_cast<double>(first_plane.height);
-
-            core::image_transform transform;
-            double                target_scale;
-            switch (params.geometry.mode()) {
-                case core::frame_geometry::scale_mode::fit:
-                    target_scale = std::min(width_scale, height_scale);
-
-                    transform.fill_scale[0] *= target_scale / width_scale;
-                    transform.fill_scale[1] *= target_scale / height_scale;
-                    break;
-
-                case core::frame_geometry::scale_mode::fill:
-                    target_scale = std::max(width_scale, height_scale);
-                    transform.fill_scale[0] *= target_scale / width_scale;
-                    transform.fill_scale[1] *= target_scale / height_scale;
-                    break;
-
-                case core::frame_geometry::scale_mode::original:
-                    transform.fill_scale[0] /= width_scale;
-                    transform.fill_scale[1] /= height_scale;
-                    break;
-
-                case core::frame_geometry::scale_mode::hfill:
-                    transform.fill_scale[1] *= width_scale / height_scale;
-                    break;
-
-                case core::frame_geometry::scale_mode::vfill:
-                    transform.fill_scale[0] *= height_scale / width_scale;
-                    break;
-
-                default:;
+        auto transforms = get_fitted_transforms(params);
+
+        // Minified sources are sampled from a copy at half their size with mipmaps, which filter them down to the
+        // size they are drawn at instead. Those that carry their own mip levels, as block compressed ones do, are
+        // sampled as they are.
+        if (is_minified(coords, params)) {
+            auto mipmap = [&](const std::shared_ptr<texture>& texture) {
+                if (texture->mipmapped()) {
+                    return texture;
+                }
+                auto mipmapped = ogl_->create_texture(std::max(1, texture->width() / 2),
+                                                      std::max(1, texture->height() / 2),
+                                                      texture->stride(),
+                                                      texture->depth(),
+                                                      false,
+                                                      true);
+                mipmapped->downscale_from(*texture);
+                return mipmapped;
+            };
+
+            for (auto& texture : params.textures) {
+                texture = spl::make_shared_ptr(mipmap(texture));
+            }
+            if (params.transition.texture) {
+                params.transition.texture = mipmap(params.transition.texture);
+            }
+            if (params.transition.mask) {
+                params.transition.mask = mipmap(params.transition.mask);
             }
-
-            transforms = transforms.combine_transform(transform, params.aspect_ratio);
         }
 
-        coords = transforms.transform_coords(coords);
+        draw_block block{};
 
-        // Skip drawing if all the coordinates will be outside the screen.
-        if (coords.size() < 3 || is_outside_screen(coords)) {
-            return;
+        for (int n = 0; n < 4; ++n) {
+            block.precision_factor[n] = 1.0f;
         }
 
-        double precision_factor[4] = {1, 1, 1, 1};
+        // Sources drawn to a half float target are decoded to linear light with their transfer, except for the
+        // intermediates of the target, which already are, and keys, which are not light
+        const auto linear      = params.background->depth() == common::bit_depth::float16;
+        auto       transfer_of = [&](const texture& source, core::color_transfer transfer) {
+            return linear && source.depth() != common::bit_depth::float16 ? static_cast<std::int32_t>(transfer) : -1;
+        };
+
+        block.transfer =
+            transforms.image_transform.is_key ? -1 : transfer_of(*params.textures.at(0), params.pix_desc.transfer);
 
         // Bind textures
 
         for (int n = 0; n < params.textures.size(); ++n) {
             params.textures[n]->bind(n);
-            precision_factor[n] = get_precision_factor(params.textures[n]->depth());
+            block.precision_factor[n] = static_cast<float>(get_precision_factor(params.textures[n]->depth()));
         }
 
         if (params.local_key) {
@@ -189,6 +502,33 @@ struct image_kernel::impl
             params.layer_key->bind(static_cast<int>(texture_id::layer_key));
         }
 
+        // The second source and the mask of a transition are sampled in this same pass
+        block.transition_transfer = -1;
+
+        auto& transition = params.transition;
+        if (transition.mode != transition_mode::none && (transition.texture || transition.mask)) {
+            block.transition = static_cast<std::int32_t>(transition.mode);
+
+            if (transition.texture) {
+                transition.texture->bind(static_cast<int>(texture_id::transition_source));
+
+                block.transition_format         = static_cast<std::int32_t>(transition.pix_desc.format);
+                block.transition_straight_alpha = transition.pix_desc.is_straight_alpha;
+                block.transition_opacity        = static_cast<float>(transition.opacity);
+                block.transition_precision =
+                    static_cast<float>(get_precision_factor(transition.texture->depth()));
+                block.transition_transfer = transfer_of(*transition.texture, transition.pix_desc.transfer);
+            }
+
+            if (transition.mask) {
+                transition.mask->bind(static_cast<int>(texture_id::transition_mask));
+
+                block.mask_format         = static_cast<std::int32_t>(transition.mask_desc.format);
+                block.mask_straight_alpha = transition.mask_desc.is_straight_alpha;
+                block.mask_precision      = static_cast<float>(get_precision_factor(transition.mask->depth()));
+            }
+        }
+
         const auto is_hd       = params.pix_desc.planes.at(0).height > 700;
         const auto color_space = is_hd ? params.pix_desc.color_space : core::color_space::bt601;
 
@@ -203,40 +543,37 @@ struct image_kernel::impl
                                                {0.2627, 0.6780, 0.0593}}; // bt.2020
         const auto  luma_coeff              = luma_coefficients[static_cast<int>(color_space)];
 
-        // Setup shader
-        shader_->use();
-
-        shader_->set("is_straight_alpha", params.pix_desc.is_straight_alpha);
-        shader_->set("plane[0]", texture_id::plane0);
-        shader_->set("plane[1]", texture_id::plane1);
-        shader_->set("plane[2]", texture_id::plane2);
-        shader_->set("plane[3]", texture_id::plane3);
-        shader_->set("precision_factor[0]", precision_factor[0]);
-        shader_->set("precision_factor[1]", precision_factor[1]);
-        shader_->set("precision_factor[2]", precision_factor[2]);
-        shader_->set("precision_factor[3]", precision_factor[3]);
-        shader_->set("local_key", texture_id::local_key);
-        shader_->set("layer_key", texture_id::layer_key);
-        shader_->set_matrix3("color_matrix", color_matrix);
-        shader_->set("luma_coeff", luma_coeff[0], luma_coeff[1], luma_coeff[2]);
-        shader_->set("has_local_key", static_cast<bool>(params.local_key));
-        shader_->set("has_layer_key", static_cast<bool>(params.layer_key));
-        shader_->set("pixel_format", params.pix_desc.format);
-        shader_->set("opacity", transforms.image_transform.is_key ? 1.0 : transforms.image_transform.opacity);
+        // The matrices above are row major
+        for (int col = 0; col < 3; ++col) {
+            for (int row = 0; row < 3; ++row) {
+                block.color_matrix[col][row] = color_matrix[row * 3 + col];
+            }
+        }
+
+        block.luma_coeff[0] = luma_coeff[0];
+        block.luma_coeff[1] = luma_coeff[1];
+        block.luma_coeff[2] = luma_coeff[2];
+
+        block.is_straight_alpha = params.pix_desc.is_straight_alpha;
+        block.has_local_key     = static_cast<bool>(params.local_key);
+        block.has_layer_key     = static_cast<bool>(params.layer_key);
+        block.pixel_format      = static_cast<std::int32_t>(params.pix_desc.format);
+        block.field             = static_cast<std::int32_t>(params.field);
+        block.target_field      = static_cast<std::int32_t>(params.target_field);
+        block.opacity =
+            static_cast<float>(transforms.image_transform.is_key ? 1.0 : transforms.image_transform.opacity);
 
         if (transforms.image_transform.chroma.enable) {
-            shader_->set("chroma", true);
-            shader_->set("chroma_show_mask", transforms.image_transform.chroma.show_mask);
-            shader_->set("chroma_target_hue", transforms.image_transform.chroma.target_hue / 360.0);
-            shader_->set("chroma_hue_width", transforms.image_transform.chroma.hue_width);
-            shader_->set("chroma_min_saturation", transforms.image_transform.chroma.min_saturation);
-            shader_->set("chroma_min_brightness", transforms.image_transform.chroma.min_brightness);
-            shader_->set("chroma_softness", 1.0 + transforms.image_transform.chroma.softness);
-            shader_->set("chroma_spill_suppress", transforms.image_transform.chroma.spill_suppress / 360.0);
-            shader_->set("chroma_spill_suppress_saturation",
-                         transforms.image_transform.chroma.spill_suppress_saturation);
-        } else {
-            shader_->set("chroma", false);
+            auto& chroma                           = transforms.image_transform.chroma;
+            block.chroma                           = true;
+            block.chroma_show_mask                 = chroma.show_mask;
+            block.chroma_target_hue                = static_cast<float>(chroma.target_hue / 360.0);
+            block.chroma_hue_width                 = static_cast<float>(chroma.hue_width);
+            block.chroma_min_saturation            = static_cast<float>(chroma.min_saturation);
+            block.chroma_min_brightness            = static_cast<float>(chroma.min_brightness);
+            block.chroma_softness                  = static_cast<float>(1.0 + chroma.softness);
+            block.chroma_spill_suppress            = static_cast<float>(chroma.spill_suppress / 360.0);
+            block.chroma_spill_suppress_saturation = static_cast<float>(chroma.spill_suppress_saturation);
         }
 
         // Setup blend_func
@@ -245,41 +582,86 @@ struct image_kernel::impl
             params.blend_mode = core::blend_mode::normal;
         }
 
-        params.background->bind(static_cast<int>(texture_id::background));
-        shader_->set("background", texture_id::background);
-        shader_->set("blend_mode", params.blend_mode);
-        shader_->set("keyer", params.keyer);
+        // Normal blending is left to the fixed function blender, so the shader does not sample the target and no
+        // texture barrier is needed. Other modes read the background in the shader.
+        const auto reads_background = params.blend_mode != core::blend_mode::normal;
+
+        block.blend_mode = reads_background ? static_cast<std::int32_t>(params.blend_mode) : -1;
+        block.keyer      = static_cast<std::int32_t>(params.keyer);
+
+        if (reads_background) {
+            params.background->bind(static_cast<int>(texture_id::background));
+        } else {
+            GL(glEnable(GL_BLEND));
+            GL(glBlendFunc(GL_ONE, params.keyer == keyer::additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA));
+        }
 
         // Setup image-adjustments
-        shader_->set("invert", transforms.image_transform.invert);
+        block.invert = transforms.image_transform.invert;
 
         if (transforms.image_transform.levels.min_input > epsilon ||
             transforms.image_transform.levels.max_input < 1.0 - epsilon ||
             transforms.image_transform.levels.min_output > epsilon ||
             transforms.image_transform.levels.max_output < 1.0 - epsilon ||
             std::abs(transforms.image_transform.levels.gamma - 1.0) > epsilon) {
-            shader_->set("levels", true);
-            shader_->set("min_input", transforms.image_transform.levels.min_input);
-            shader_->set("max_input", transforms.image_transform.levels.max_input);
-            shader_->set("min_output", transforms.image_transform.levels.min_output);
-            shader_->set("max_output", transforms.image_transform.levels.max_output);
-            shader_->set("gamma", transforms.image_transform.levels.gamma);
-        } else {
-            shader_->set("levels", false);
+            block.levels     = true;
+            block.min_input  = static_cast<float>(transforms.image_transform.levels.min_input);
+            block.max_input  = static_cast<float>(transforms.image_transform.levels.max_input);
+            block.min_output = static_cast<float>(transforms.image_transform.levels.min_output);
+            block.max_output = static_cast<float>(transforms.image_transform.levels.max_output);
+            block.gamma      = static_cast<float>(transforms.image_transform.levels.gamma);
         }
 
         if (std::abs(transforms.image_transform.brightness - 1.0) > epsilon ||
             std::abs(transforms.image_transform.saturation - 1.0) > epsilon ||
             std::abs(transforms.image_transform.contrast - 1.0) > epsilon) {
-            shader_->set("csb", true);
+            block.csb = true;
+            block.brt = static_cast<float>(transforms.image_transform.brightness);
+            block.sat = static_cast<float>(transforms.image_transform.saturation);
+            block.con = static_cast<float>(transforms.image_transform.contrast);
+        }
 
-            shader_->set("brt", transforms.image_transform.brightness);
-            shader_->set("sat", transforms.image_transform.saturation);
-            shader_->set("con", transforms.image_transform.contrast);
+        // Upload the parameters and geometry into the stream buffers
+
+        auto block_offset = uniforms_->write(&block, sizeof(block), uniform_alignment_);
+
+        auto     rect = get_quad(coords);
+        GLintptr geometry_offset;
+        if (rect) {
+            geometry_offset = vertices_->write(&*rect, sizeof(quad), sizeof(quad));
         } else {
-            shader_->set("csb", false);
+            std::vector<vertex> vertices;
+            vertices.reserve(coords.size());
+            for (auto& coord : coords) {
+                vertices.push_back(vertex{{static_cast<float>(coord.vertex_x), static_cast<float>(coord.vertex_y)},
+                                          {static_cast<float>(coord.texture_x),
+                                           static_cast<float>(coord.texture_y),
+                                           static_cast<float>(coord.texture_r),
+                                           static_cast<float>(coord.texture_q)}});
+            }
+            geometry_offset = vertices_->write(
+                vertices.data(), static_cast<GLsizeiptr>(sizeof(vertex) * vertices.size()), sizeof(vertex));
         }
 
+        // Use the variant compiled for exactly this feature set, so the shader does not branch on the uniforms
+        image_shader_key key;
+        key.pixel_format      = block.pixel_format;
+        key.blend_mode        = block.blend_mode;
+        key.keyer             = block.keyer;
+        key.is_straight_alpha = block.is_straight_alpha != 0;
+        key.has_local_key     = block.has_local_key != 0;
+        key.has_layer_key     = block.has_layer_key != 0;
+        key.invert            = block.invert != 0;
+        key.levels            = block.levels != 0;
+        key.csb               = block.csb != 0;
+        key.chroma            = block.chroma != 0;
+        key.transition        = block.transition;
+
+        auto& shader = shaders_->get(key);
+        shader.use();
+        shader.set("quad", static_cast<bool>(rect));
+        GL(glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniforms_->id(), block_offset, sizeof(block)));
+
         // Setup drawing area
 
         GL(glViewport(0, 0, params.background->width(), params.background->height()));
@@ -288,37 +670,24 @@ struct image_kernel::impl
         // Set render target
         params.background->attach();
 
+        // Make earlier draws to the target visible to the shader
+        if (reads_background) {
+            GL(glTextureBarrier());
+        }
+
         // Draw
         GL(glBindVertexArray(vao_));
-        GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
-
-        GL(glBufferData(GL_ARRAY_BUFFER,
-                        static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords.size(),
-                        coords.data(),
-                        GL_STATIC_DRAW));
-
-        auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
-
-        auto vtx_loc = shader_->get_attrib_location("Position");
-        auto tex_loc = shader_->get_attrib_location("TexCoordIn");
-
-        GL(glEnableVertexAttribArray(vtx_loc));
-        GL(glEnableVertexAttribArray(tex_loc));
-
-        GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-        GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
-
-        GL(glDrawArrays(GL_TRIANGLE_FAN, 0, static_cast<GLsizei>(coords.size())));
-        GL(glTextureBarrier());
-
-        GL(glDisableVertexAttribArray(vtx_loc));
-        GL(glDisableVertexAttribArray(tex_loc));
-
+        if (rect) {
+            GL(glDrawArraysInstancedBaseInstance(
+                GL_TRIANGLE_STRIP, 0, 4, 1, static_cast<GLuint>(geometry_offset / sizeof(quad))));
+        } else {
+            GL(glDrawArrays(GL_TRIANGLE_FAN,
+                            static_cast<GLint>(geometry_offset / sizeof(vertex)),
+                            static_cast<GLsizei>(coords.size())));
+        }
         GL(glBindVertexArray(0));
-        GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
 
-        // Cleanup
-        GL(glDisable(GL_SCISSOR_TEST));
+        // Cleanup, the scissor is left to the caller so that it can restrict a whole frame
         GL(glDisable(GL_BLEND));
     }
 };
@@ -23,13 +23,16 @@
 
 #include <core/mixer/image/blend_modes.h>
 
+#include <common/bit_depth.h>
 #include <common/memory.h>
 
 #include <core/frame/frame_transform.h>
 #include <core/frame/geometry.h>
 #include <core/frame/pixel_format.h>
+#include <core/video_format.h>
 
 #include <utility>
+#include <vector>
 
 #include "../util/matrix.h"
 #include "../util/transforms.h"
@@ -42,6 +45,27 @@ enum class keyer
     additive,
 };
 
+// How the second source of a transition drawn in one pass combines with the first
+enum class transition_mode
+{
+    none = 0,
+    mix,  // Both sources at their opacity added up, as two mixed draws
+    mask, // The second over the first, each keyed by the mask or its inverse, as the keyed draws of a sting
+    key,  // The first keyed by the mask alone, as the fill and key clips of a separated producer
+};
+
+// The second source and the mask of a transition, which are drawn with the same geometry and adjustments as the first
+// source and hold a single plane each. A key has no second source.
+struct draw_transition final
+{
+    ogl::transition_mode           mode     = ogl::transition_mode::none;
+    core::pixel_format_desc        pix_desc = core::pixel_format_desc(core::pixel_format::invalid);
+    std::shared_ptr<class texture> texture;
+    double                         opacity   = 1.0;
+    core::pixel_format_desc        mask_desc = core::pixel_format_desc(core::pixel_format::invalid);
+    std::shared_ptr<class texture> mask;
+};
+
 struct draw_params final
 {
     core::pixel_format_desc                     pix_desc = core::pixel_format_desc(core::pixel_format::invalid);
@@ -54,10 +78,22 @@ struct draw_params final
     std::shared_ptr<class texture>              local_key;
     std::shared_ptr<class texture>              layer_key;
     double                                      aspect_ratio = 1.0;
+    core::video_field                           field        = core::video_field::progressive;
+    core::video_field                           target_field = core::video_field::progressive; // The lines written
     int                                         target_width;
     int                                         target_height;
+    draw_transition                             transition;
 };
 
+// Whether a transition can sample a source of this format
+bool is_transition_format(const core::pixel_format_desc& desc);
+
+// The factor that scales a sample of a texture of the given depth to the unit range
+double get_precision_factor(common::bit_depth depth);
+
+// The coordinates of a draw in target space, or nothing if no part of it would be visible
+std::vector<core::frame_geometry::coord> get_draw_coords(const draw_params& params);
+
 class image_kernel final
 {
     image_kernel(const image_kernel&);
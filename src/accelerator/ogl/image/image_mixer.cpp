@@ -20,15 +20,20 @@
  */
 #include "image_mixer.h"
 
+#include "image_converter.h"
 #include "image_kernel.h"
+#include "image_packer.h"
 
 #include "../util/buffer.h"
 #include "../util/device.h"
+#include "../util/gpu_timer.h"
 #include "../util/texture.h"
 
 #include <common/array.h>
 #include <common/bit_depth.h>
+#include <common/except.h>
 #include <common/future.h>
+#include <common/gl/gl_check.h>
 #include <common/log.h>
 
 #include <core/frame/frame.h>
@@ -39,19 +44,130 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <any>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 using future_texture = std::shared_future<std::shared_ptr<texture>>;
 
+// Stored in the opaque field of frames created by an image mixer. Textures are only valid on their own device.
+struct frame_textures
+{
+    const device*               owner;
+    std::vector<future_texture> textures;
+    core::pixel_format_desc     desc; // The layout of the textures, which differs from the frame's once converted
+
+    // A fence past the draws of the textures, for contexts other than that of the device. Only set on the output.
+    std::shared_future<std::shared_ptr<void>> drawn;
+};
+
+// Block compressed textures are sampled as bgra ones
+core::pixel_format_desc sampled_desc(const core::pixel_format_desc& desc)
+{
+    if (!core::is_block_compressed(desc.format)) {
+        return desc;
+    }
+
+    core::pixel_format_desc result(core::pixel_format::bgra, desc.color_space);
+    result.is_straight_alpha = desc.is_straight_alpha;
+    result.planes.emplace_back(desc.planes.at(0).width, desc.planes.at(0).height, 4);
+    return result;
+}
+
+// A rectangle of pixels of the channel canvas
+struct region
+{
+    int left   = 0;
+    int top    = 0;
+    int right  = 0;
+    int bottom = 0;
+
+    bool empty() const { return right <= left || bottom <= top; }
+};
+
+region intersected(const region& a, const region& b)
+{
+    return region{std::max(a.left, b.left),
+                  std::max(a.top, b.top),
+                  std::min(a.right, b.right),
+                  std::min(a.bottom, b.bottom)};
+}
+
+region united(const region& a, const region& b)
+{
+    if (a.empty())
+        return b;
+    if (b.empty())
+        return a;
+    return region{std::min(a.left, b.left),
+                  std::min(a.top, b.top),
+                  std::max(a.right, b.right),
+                  std::max(a.bottom, b.bottom)};
+}
+
 struct item
 {
     core::pixel_format_desc     pix_desc = core::pixel_format_desc(core::pixel_format::invalid);
     std::vector<future_texture> textures;
     draw_transforms             transforms;
     core::frame_geometry        geometry = core::frame_geometry::get_default();
+    core::const_frame           frame;
+    core::video_field           field  = core::video_field::progressive;
+    bool                        culled = false;
+
+    // The colour of every pixel of a frame of one colour, in BGRA order
+    std::optional<std::array<float, 4>> solid;
+
+    // Where the item is drawn on the canvas, set when culling
+    std::vector<core::frame_geometry::coord> coords;
+    region                                   bounds;
+};
+
+// The colour of a frame whose pixels are all the same, such as those of the color producer. Only small frames are
+// looked at, as it takes reading every pixel.
+std::optional<std::array<float, 4>> solid_color(const core::const_frame& frame, const core::pixel_format_desc& desc)
+{
+    if (desc.format != core::pixel_format::bgra || desc.planes.size() != 1 ||
+        desc.planes[0].depth != common::bit_depth::bit8 || desc.planes[0].width * desc.planes[0].height > 64) {
+        return {};
+    }
+
+    const auto& data = frame.image_data(0);
+    const auto  size = static_cast<std::size_t>(desc.planes[0].width * desc.planes[0].height * 4);
+    if (size == 0 || data.size() < size) {
+        return {};
+    }
+    for (std::size_t n = 4; n < size; n += 4) {
+        if (std::memcmp(data.data(), data.data() + n, 4) != 0) {
+            return {};
+        }
+    }
+    return std::array<float, 4>{data.data()[0] / 255.0f,
+                                data.data()[1] / 255.0f,
+                                data.data()[2] / 255.0f,
+                                data.data()[3] / 255.0f};
+}
+
+// What a render drew, in draw order, to find what changed in the next one
+struct scene_entry
+{
+    bool                                     is_layer   = false; // Marks the start or the end of a layer
+    core::blend_mode                         blend_mode = core::blend_mode::normal;
+    core::const_frame                        frame;
+    core::image_transform                    transform;
+    std::vector<core::frame_geometry::coord> coords;
+    region                                   bounds;
+    bool                                     culled = false;
 };
 
 struct layer
@@ -59,50 +175,816 @@ struct layer
     std::vector<layer> sublayers;
     std::vector<item>  items;
     core::blend_mode   blend_mode;
+    core::layer_cache  cache;
 
-    explicit layer(core::blend_mode blend_mode)
+    explicit layer(core::blend_mode blend_mode, core::layer_cache cache = core::layer_cache::automatic)
         : blend_mode(blend_mode)
+        , cache(cache)
     {
     }
 };
 
+// What a top level layer drew and the composite of it, kept while the layer draws the same
+struct cached_layer
+{
+    std::vector<scene_entry> scene;
+    std::shared_ptr<texture> composite; // Drawn once the layer is unchanged for a tick, or right away when forced
+};
+
+// An interlaced frame whose fields are drawn into one target, each to its own lines
+struct woven_frame
+{
+    std::shared_ptr<texture> target; // Once the upper field is drawn, only used on the device
+
+    // Set once the lower field is drawn, and also the result of the render of the upper one
+    std::promise<std::shared_future<std::vector<array<const std::uint8_t>>>> result;
+};
+
 class image_renderer
 {
     spl::shared_ptr<device> ogl_;
+    const int               channel_id_;
     image_kernel            kernel_;
+    image_packer            packer_;
+    gpu_timer               timer_;
     const size_t            max_frame_size_;
-    common::bit_depth       depth_;
+    common::bit_depth       depth_;        // Of the output
+    core::color_transfer    transfer_;     // Of the output, which is mixed in linear light unless it is bt709
+    common::bit_depth       target_depth_; // Of what is drawn, half float in linear light
+    int                     visited_items_ = 0;
+    int                     culled_items_  = 0;
+
+    // The intermediate textures of the frame being drawn, and the area of each that has been cleared so far
+    std::vector<std::pair<const texture*, region>> intermediates_;
+
+    // The area of the target that the frame being drawn may change, and the lines of it that draws write
+    region            draw_area_;
+    core::video_field target_field_ = core::video_field::progressive;
+
+    // The upper field of an interlaced frame, until the lower one is rendered, only used from the mixer thread
+    std::shared_ptr<woven_frame> woven_;
+
+    // What the previous render drew and the damage of the last one, only used from the mixer thread
+    std::vector<scene_entry>       scene_;
+    core::output_request           scene_request_;
+    int                            scene_width_  = 0;
+    int                            scene_height_ = 0;
+    std::vector<core::damage_rect> damage_;
+
+    // The output of the previous render, drawn over when only parts of the next one change, only used on the device
+    std::shared_ptr<texture>                                   previous_target_;
+    std::shared_future<std::vector<array<const std::uint8_t>>> previous_result_;
+
+    // The composites of the top level layers, by their index, only used on the device
+    std::vector<cached_layer> layer_cache_;
+
+    // The target of the last render, when requested for other channels to draw, only used from the mixer thread
+    std::any rendered_;
 
   public:
-    explicit image_renderer(const spl::shared_ptr<device>& ogl, const size_t max_frame_size, common::bit_depth depth)
+    image_renderer(const spl::shared_ptr<device>& ogl,
+                   const int                      channel_id,
+                   const size_t                   max_frame_size,
+                   common::bit_depth              depth,
+                   core::color_transfer           transfer)
         : ogl_(ogl)
+        , channel_id_(channel_id)
         , kernel_(ogl_)
+        , packer_(ogl_)
+        , timer_(ogl_)
         , max_frame_size_(max_frame_size)
         , depth_(depth)
+        , transfer_(transfer)
+        , target_depth_(transfer == core::color_transfer::bt709 ? depth : common::bit_depth::float16)
     {
     }
 
-    std::future<array<const std::uint8_t>> operator()(std::vector<layer>             layers,
-                                                      const core::video_format_desc& format_desc)
+    // A field is drawn to its own lines of a target shared with the other field of the frame, which is read back once,
+    // when the lower field is drawn. Both renders then complete with that image.
+    std::future<std::vector<array<const std::uint8_t>>> operator()(std::vector<layer>             layers,
+                                                                   const core::video_format_desc& format_desc,
+                                                                   const core::output_request&    request,
+                                                                   core::video_field              field)
     {
-        if (layers.empty()) { // Bypass GPU with empty frame.
+        // The lines of a field are those of the channel format, so fields are always drawn at its resolution
+        const auto draw_desc = scaled(format_desc, field == core::video_field::progressive ? request.scale : 1.0);
+
+        // An opaque item covering the whole frame overwrites every pixel, so the target need not be cleared first
+        const auto covered = cull(layers, draw_desc);
+
+        // Nothing when the whole frame is drawn, otherwise the area to draw over the previous output
+        const auto redraw = track_damage(layers, draw_desc, request);
+
+        // The damage is of the output, and a changed pixel of the target changes its neighbours once scaled up
+        if (draw_desc.width != format_desc.width || draw_desc.height != format_desc.height) {
+            for (auto& rect : damage_) {
+                if (rect.width > 0 && rect.height > 0) {
+                    auto area = to_region(static_cast<double>(rect.x) / draw_desc.width,
+                                          static_cast<double>(rect.y) / draw_desc.height,
+                                          static_cast<double>(rect.x + rect.width) / draw_desc.width,
+                                          static_cast<double>(rect.y + rect.height) / draw_desc.height,
+                                          format_desc);
+                    rect = core::damage_rect{area.left, area.top, area.right - area.left, area.bottom - area.top};
+                }
+            }
+        }
+
+        auto woven = field == core::video_field::b ? std::move(woven_) : nullptr;
+        woven_.reset();
+
+        // Bypass GPU with empty frame.
+        if (layers.empty() && request.packings.empty() && request.sizes.empty() && !woven) {
             static const std::vector<uint8_t> buffer(max_frame_size_, 0);
-            return make_ready_future(array<const std::uint8_t>(buffer.data(), format_desc.size, true));
+            std::vector<array<const std::uint8_t>> buffers;
+            buffers.emplace_back(buffer.data(), format_desc.size, true);
+            rendered_.reset();
+            return make_ready_future(std::move(buffers));
         }
 
-        return flatten(ogl_->dispatch_async(
-            [=, layers = std::move(layers)]() mutable -> std::shared_future<array<const std::uint8_t>> {
-                auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4, depth_);
+        // Set once the target is drawn, which is before the render completes, so before any frame holding it is out
+        std::shared_ptr<std::promise<std::shared_ptr<texture>>> rendered;
+        std::shared_ptr<std::promise<std::shared_ptr<void>>>    drawn;
+        if (request.texture) {
+            auto desc = core::pixel_format_desc(core::pixel_format::bgra);
+            desc.planes.emplace_back(format_desc.width, format_desc.height, 4, depth_);
+            desc.transfer = transfer_;
+
+            rendered  = std::make_shared<std::promise<std::shared_ptr<texture>>>();
+            drawn     = std::make_shared<std::promise<std::shared_ptr<void>>>();
+            rendered_ = std::make_shared<frame_textures>(frame_textures{
+                ogl_.get(), {rendered->get_future().share()}, desc, drawn->get_future().share()});
+        } else {
+            rendered_.reset();
+        }
+
+        if (field == core::video_field::a) {
+            woven_     = std::make_shared<woven_frame>();
+            auto upper = woven_->result.get_future().share();
+
+            ogl_->dispatch_async([=, woven = woven_, layers = std::move(layers)]() mutable {
+                // Cleared whole, as only the lines of one field are drawn at a time
+                auto target_texture =
+                    ogl_->create_texture(format_desc.width, format_desc.height, 4, target_depth_, true);
+                draw_area_    = region{0, 0, format_desc.width, format_desc.height};
+                target_field_ = field;
+                draw_layers(target_texture, std::move(layers), format_desc);
+                intermediates_.clear();
+                timer_.end_frame();
+
+                woven->target = std::move(target_texture);
+            });
 
-                draw(target_texture, std::move(layers), format_desc);
+            return std::async(std::launch::deferred, [upper] { return upper.get().get(); });
+        }
 
-                return ogl_->copy_async(target_texture);
+        return flatten(ogl_->dispatch_async(
+            [=, layers = std::move(layers)]() mutable -> std::shared_future<std::vector<array<const std::uint8_t>>> {
+                std::shared_ptr<texture> target_texture;
+                target_field_ = field;
+
+                // A target other channels draw is never drawn over again, so it is rendered whole
+                if (redraw && previous_target_ && !rendered) {
+                    if (redraw->empty()) {
+                        timer_.end_frame();
+                        return previous_result_;
+                    }
+
+                    const auto width  = redraw->right - redraw->left;
+                    const auto height = redraw->bottom - redraw->top;
+
+                    // Its readback may still be batched with those of other channels
+                    ogl_->flush_readbacks(channel_id_);
+
+                    target_texture = previous_target_;
+                    target_texture->clear(redraw->left, redraw->top, width, height);
+
+                    GL(glEnable(GL_SCISSOR_TEST));
+                    GL(glScissor(redraw->left, redraw->top, width, height));
+                    draw_area_ = *redraw;
+                    draw_layers(target_texture, std::move(layers), draw_desc);
+                    GL(glDisable(GL_SCISSOR_TEST));
+                } else if (woven && woven->target) {
+                    target_texture = woven->target;
+                    draw_area_     = region{0, 0, draw_desc.width, draw_desc.height};
+                    draw_layers(target_texture, std::move(layers), draw_desc);
+                } else {
+                    // A field only draws its own lines, so the others are cleared even when it covers the frame
+                    const auto clear = !covered || field != core::video_field::progressive;
+                    target_texture   = ogl_->create_texture(draw_desc.width, draw_desc.height, 4, target_depth_, clear);
+                    draw_area_       = region{0, 0, draw_desc.width, draw_desc.height};
+                    draw_layers(target_texture, std::move(layers), draw_desc);
+                }
+                intermediates_.clear();
+
+                // What the consumers get, the target scaled up to the channel resolution if it was drawn at less
+                auto output_texture = target_texture;
+                if (draw_desc.width != format_desc.width || draw_desc.height != format_desc.height) {
+                    timer_.begin("scale");
+                    output_texture =
+                        ogl_->create_texture(format_desc.width, format_desc.height, 4, target_depth_, false);
+                    draw(output_texture, std::shared_ptr<texture>(target_texture), format_desc);
+                    timer_.end();
+                }
+
+                // Consumers and other channels get an image mixed in linear light encoded with the transfer of the
+                // channel, while packings encode it as they pack it
+                auto encoded = output_texture;
+                if (linear() && (request.image || rendered)) {
+                    timer_.begin("encode");
+                    encoded = packer_.encode(output_texture, transfer_, depth_);
+                    timer_.end();
+                }
+
+                // Every readback is issued before any of them is waited on
+                const auto readback = readback_options{channel_id_, request.clocked};
+                std::vector<std::future<array<const std::uint8_t>>> readbacks;
+                if (request.image) {
+                    timer_.begin("readback");
+                    readbacks.push_back(ogl_->copy_async(encoded, readback));
+                    timer_.end();
+                }
+                for (auto packing : request.packings) {
+                    timer_.begin("pack");
+                    auto packed = packer_.pack(output_texture, packing, request.color_space, transfer_);
+                    timer_.end();
+
+                    timer_.begin("readback");
+                    readbacks.push_back(ogl_->copy_async(packed, readback));
+                    timer_.end();
+                }
+                for (auto size : request.sizes) {
+                    timer_.begin("scale");
+                    auto scaled = ogl_->create_texture(size.width, size.height, 4, target_depth_, false);
+                    draw(scaled, std::shared_ptr<texture>(output_texture), format_desc);
+                    if (linear()) {
+                        scaled = packer_.encode(scaled, transfer_, depth_);
+                    }
+                    timer_.end();
+
+                    timer_.begin("readback");
+                    readbacks.push_back(ogl_->copy_async(scaled, readback));
+                    timer_.end();
+                }
+                timer_.end_frame();
+
+                auto result = std::async(std::launch::deferred,
+                                         [readbacks = std::move(readbacks), image = request.image]() mutable {
+                                             std::vector<array<const std::uint8_t>> buffers;
+                                             if (!image) {
+                                                 buffers.emplace_back();
+                                             }
+                                             for (auto& readback : readbacks) {
+                                                 buffers.push_back(readback.get());
+                                             }
+                                             return buffers;
+                                         })
+                                  .share();
+
+                if (rendered) {
+                    // Deleted on the device, as the last frame holding it may be released on any thread
+                    auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    GL(glFlush());
+                    drawn->set_value(std::shared_ptr<void>(fence, [ogl = ogl_](void* fence) {
+                        ogl->post([=] { glDeleteSync(static_cast<GLsync>(fence)); });
+                    }));
+                    rendered->set_value(encoded);
+                }
+
+                if (woven) {
+                    woven->result.set_value(result);
+                }
+
+                if (request.damage_tracking && !rendered) {
+                    previous_target_ = target_texture;
+                    previous_result_ = result;
+                } else {
+                    previous_target_.reset();
+                    previous_result_ = {};
+                }
+
+                return result;
             }));
     }
 
-    common::bit_depth depth() const { return depth_; }
+    common::bit_depth    depth() const { return depth_; }
+    core::color_transfer transfer() const { return transfer_; }
+    bool                 linear() const { return target_depth_ == common::bit_depth::float16; }
+    int                  visited_items() const { return visited_items_; }
+    int                  culled_items() const { return culled_items_; }
+
+    std::map<std::string, double> gpu_times() const { return timer_.averages(); }
+
+    const std::vector<core::damage_rect>& damage() const { return damage_; }
+
+    const std::any& rendered() const { return rendered_; }
+
+    std::function<array<const std::uint8_t>()> readback() const
+    {
+        auto textures = std::any_cast<std::shared_ptr<frame_textures>>(&rendered_);
+        if (!textures || !*textures) {
+            return nullptr;
+        }
+
+        // Blocks the calling thread, which is never the device thread, until the GPU has finished the render
+        return [ogl = ogl_, texture = (*textures)->textures.at(0)] { return ogl->copy_async(texture.get()).get(); };
+    }
 
   private:
+    // The format of the target that layers are drawn to, with a scale of the pixels of the channel format. The square
+    // size is kept, as that is the canvas the geometry of frames refers to.
+    static core::video_format_desc scaled(core::video_format_desc format_desc, double scale)
+    {
+        if (scale > 0.0 && scale < 1.0) {
+            format_desc.width  = std::max(1, static_cast<int>(std::lround(format_desc.width * scale)));
+            format_desc.height = std::max(1, static_cast<int>(std::lround(format_desc.height * scale)));
+            format_desc.size   = static_cast<std::size_t>(format_desc.width) * format_desc.height * 4;
+        }
+        return format_desc;
+    }
+
+    // An item drawn to the channel target, directly or through the texture of its blend mode layer, along with the
+    // index of that draw
+    struct target_draw
+    {
+        item* drawn;
+        int   index;
+    };
+
+    static bool is_opaque(core::pixel_format format)
+    {
+        switch (format) {
+            case core::pixel_format::gray:
+            case core::pixel_format::ycbcr:
+            case core::pixel_format::luma:
+            case core::pixel_format::bgr:
+            case core::pixel_format::rgb:
+            case core::pixel_format::uyvy:
+            case core::pixel_format::gbrp:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Whether the convex polygon drawn from coords contains the whole target
+    static bool covers_screen(const std::vector<core::frame_geometry::coord>& coords)
+    {
+        static const double corners[4][2] = {{0.0, 0.0}, {1.0, 0.0}, {1.0, 1.0}, {0.0, 1.0}};
+
+        for (auto& corner : corners) {
+            int sign = 0;
+            for (size_t n = 0; n < coords.size(); ++n) {
+                auto& a     = coords[n];
+                auto& b     = coords[(n + 1) % coords.size()];
+                auto  cross = (b.vertex_x - a.vertex_x) * (corner[1] - a.vertex_y) -
+                             (b.vertex_y - a.vertex_y) * (corner[0] - a.vertex_x);
+
+                if (std::abs(cross) < 1e-9) {
+                    continue;
+                }
+                if (sign == 0) {
+                    sign = cross > 0.0 ? 1 : -1;
+                } else if ((cross > 0.0 ? 1 : -1) != sign) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Marks the items that would leave no trace in the frame: those that are transparent, clipped away or outside the
+    // target, and those drawn to the target before an opaque item that covers all of it. Keys are never culled, as
+    // the items they mask depend on them even when they are empty.
+    bool cull(std::vector<layer>& layers, const core::video_format_desc& format_desc)
+    {
+        std::vector<target_draw> draws;
+        int                      next_index = 0;
+        int                      occluder   = -1;
+
+        visited_items_ = 0;
+        culled_items_  = 0;
+
+        cull(layers, format_desc, draws, next_index, occluder);
+
+        for (auto& draw : draws) {
+            if (draw.index < occluder && !draw.drawn->culled) {
+                draw.drawn->culled = true;
+                culled_items_ += 1;
+            }
+        }
+
+        return occluder >= 0;
+    }
+
+    void cull(std::vector<layer>&            layers,
+              const core::video_format_desc& format_desc,
+              std::vector<target_draw>&      draws,
+              int&                           next_index,
+              int&                           occluder)
+    {
+        // Mirrors the order of draw() and how it passes keys on from one item and layer to the next
+        bool layer_key = false;
+
+        for (auto& layer : layers) {
+            cull(layer.sublayers, format_desc, draws, next_index, occluder);
+
+            if (layer.items.empty())
+                continue;
+
+            // The items of a blend mode layer reach the target together, when the layer texture is drawn
+            const auto blended   = layer.blend_mode != core::blend_mode::normal;
+            const auto first     = draws.size();
+            bool       local_key = false;
+
+            for (auto& item : layer.items) {
+                visited_items_ += 1;
+
+                draw_params params;
+                params.target_width  = format_desc.square_width;
+                params.target_height = format_desc.square_height;
+                params.pix_desc      = item.pix_desc;
+                params.transforms    = item.transforms;
+                params.geometry      = item.geometry;
+                params.aspect_ratio =
+                    static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+
+                auto coords = get_draw_coords(params);
+                item.coords = coords;
+                item.bounds = to_region(coords, format_desc);
+
+                const auto& image_transform = item.transforms.image_transform;
+                if (image_transform.is_key) {
+                    local_key = true;
+                    continue;
+                }
+
+                if (coords.empty()) {
+                    item.culled = true;
+                    culled_items_ += 1;
+                } else {
+                    const auto index = blended ? next_index : next_index++;
+                    draws.push_back(target_draw{&item, index});
+
+                    const auto opaque =
+                        is_opaque(item.pix_desc.format) || (item.solid && (*item.solid)[3] > 1.0f - 0.001f);
+                    if (!blended && !image_transform.is_mix && !local_key && !layer_key &&
+                        image_transform.opacity > 1.0 - 0.001 && !image_transform.invert &&
+                        !image_transform.chroma.enable && opaque && covers_screen(coords)) {
+                        occluder = index;
+                    }
+                }
+
+                local_key = false;
+            }
+
+            if (blended && draws.size() > first) {
+                next_index += 1;
+            }
+
+            layer_key = local_key;
+        }
+    }
+
+    // The pixels within a rectangle of the canvas, with a margin for filtering
+    static region
+    to_region(double left, double top, double right, double bottom, const core::video_format_desc& format_desc)
+    {
+        auto to_pixel = [](double value, int size, int margin) {
+            return std::clamp(static_cast<int>(std::floor(value * size)) + margin, 0, size);
+        };
+
+        return region{to_pixel(left, format_desc.width, -1),
+                      to_pixel(top, format_desc.height, -1),
+                      to_pixel(right, format_desc.width, 2),
+                      to_pixel(bottom, format_desc.height, 2)};
+    }
+
+    // The pixels covered by the coordinates of a draw
+    static region to_region(const std::vector<core::frame_geometry::coord>& coords,
+                            const core::video_format_desc&                  format_desc)
+    {
+        if (coords.empty()) {
+            return region{};
+        }
+
+        auto min_x = coords[0].vertex_x;
+        auto max_x = coords[0].vertex_x;
+        auto min_y = coords[0].vertex_y;
+        auto max_y = coords[0].vertex_y;
+        for (auto& coord : coords) {
+            min_x = std::min(min_x, coord.vertex_x);
+            max_x = std::max(max_x, coord.vertex_x);
+            min_y = std::min(min_y, coord.vertex_y);
+            max_y = std::max(max_y, coord.vertex_y);
+        }
+
+        return to_region(min_x, min_y, max_x, max_y, format_desc);
+    }
+
+    static void collect(const std::vector<layer>& layers, std::vector<scene_entry>& scene)
+    {
+        for (auto& layer : layers) {
+            collect(layer, scene);
+        }
+    }
+
+    static void collect(const layer& layer, std::vector<scene_entry>& scene)
+    {
+        scene_entry marker;
+        marker.is_layer   = true;
+        marker.blend_mode = layer.blend_mode;
+
+        scene.push_back(marker);
+        collect(layer.sublayers, scene);
+        for (auto& item : layer.items) {
+            scene_entry entry;
+            entry.frame     = item.frame;
+            entry.transform = item.transforms.image_transform;
+            entry.coords    = item.coords;
+            entry.bounds    = item.bounds;
+            entry.culled    = item.culled;
+            scene.push_back(std::move(entry));
+        }
+        scene.push_back(marker);
+    }
+
+    // The canvas area that a new frame of an item's source changes. The damage of the frame can only be mapped onto
+    // the canvas when the item is drawn as an upright, unrotated rectangle, otherwise the whole item is changed.
+    static region frame_damage(const scene_entry& entry, const core::video_format_desc& format_desc)
+    {
+        const auto& rects = entry.frame.damage();
+        if (rects.empty() || entry.coords.empty() || entry.frame.width() == 0 || entry.frame.height() == 0) {
+            return entry.bounds;
+        }
+
+        auto vx0 = entry.coords[0].vertex_x, vx1 = vx0, vy0 = entry.coords[0].vertex_y, vy1 = vy0;
+        auto tx0 = entry.coords[0].texture_x, tx1 = tx0, ty0 = entry.coords[0].texture_y, ty1 = ty0;
+        for (auto& coord : entry.coords) {
+            vx0 = std::min(vx0, coord.vertex_x);
+            vx1 = std::max(vx1, coord.vertex_x);
+            vy0 = std::min(vy0, coord.vertex_y);
+            vy1 = std::max(vy1, coord.vertex_y);
+            tx0 = std::min(tx0, coord.texture_x);
+            tx1 = std::max(tx1, coord.texture_x);
+            ty0 = std::min(ty0, coord.texture_y);
+            ty1 = std::max(ty1, coord.texture_y);
+        }
+
+        if (vx1 - vx0 < 1e-9 || vy1 - vy0 < 1e-9 || tx1 - tx0 < 1e-9 || ty1 - ty0 < 1e-9) {
+            return entry.bounds;
+        }
+
+        for (auto& coord : entry.coords) {
+            if (std::abs(coord.texture_q - 1.0) > 1e-9 ||
+                std::abs((coord.vertex_x - vx0) * (tx1 - tx0) - (coord.texture_x - tx0) * (vx1 - vx0)) > 1e-9 ||
+                std::abs((coord.vertex_y - vy0) * (ty1 - ty0) - (coord.texture_y - ty0) * (vy1 - vy0)) > 1e-9) {
+                return entry.bounds;
+            }
+        }
+
+        const auto width  = static_cast<double>(entry.frame.width());
+        const auto height = static_cast<double>(entry.frame.height());
+
+        auto to_canvas_x = [&](double x) { return vx0 + (x / width - tx0) / (tx1 - tx0) * (vx1 - vx0); };
+        auto to_canvas_y = [&](double y) { return vy0 + (y / height - ty0) / (ty1 - ty0) * (vy1 - vy0); };
+
+        region result;
+        for (auto& rect : rects) {
+            if (rect.width <= 0 || rect.height <= 0) {
+                continue;
+            }
+
+            // A changed pixel also changes its neighbours when the frame is scaled with filtering
+            result = united(result,
+                            to_region(to_canvas_x(rect.x - 1.0),
+                                      to_canvas_y(rect.y - 1.0),
+                                      to_canvas_x(rect.x + rect.width + 1.0),
+                                      to_canvas_y(rect.y + rect.height + 1.0),
+                                      format_desc));
+        }
+
+        return intersected(result, entry.bounds);
+    }
+
+    // Compares what is about to be drawn with what the previous render drew. Returns nothing when the whole frame has
+    // to be drawn, and otherwise the area that changed, which is empty when the previous output can be reused as is.
+    std::optional<region> track_damage(const std::vector<layer>&      layers,
+                                       const core::video_format_desc& format_desc,
+                                       const core::output_request&    request)
+    {
+        damage_.clear();
+
+        if (!request.damage_tracking) {
+            scene_.clear();
+            return std::nullopt;
+        }
+
+        std::vector<scene_entry> scene;
+        collect(layers, scene);
+
+        auto full = layers.empty() || scene.size() != scene_.size() || scene_width_ != format_desc.width ||
+                    scene_height_ != format_desc.height || scene_request_.image != request.image ||
+                    scene_request_.packings != request.packings || scene_request_.sizes != request.sizes ||
+                    scene_request_.color_space != request.color_space;
+
+        region changed;
+        for (size_t n = 0; !full && n < scene.size(); ++n) {
+            auto& previous = scene_[n];
+            auto& current  = scene[n];
+
+            if (previous.is_layer != current.is_layer || previous.blend_mode != current.blend_mode) {
+                full = true;
+            } else if (current.is_layer || previous.frame == current.frame) {
+                if (!(previous.transform == current.transform) || previous.coords != current.coords) {
+                    changed = united(changed, united(previous.bounds, current.bounds));
+                }
+            } else if (previous.frame.stream_tag() == current.frame.stream_tag() &&
+                       previous.frame.width() == current.frame.width() &&
+                       previous.frame.height() == current.frame.height() &&
+                       previous.transform == current.transform && previous.coords == current.coords) {
+                changed = united(changed, frame_damage(current, format_desc));
+            } else {
+                changed = united(changed, united(previous.bounds, current.bounds));
+            }
+        }
+
+        scene_         = std::move(scene);
+        scene_request_ = request;
+        scene_width_   = format_desc.width;
+        scene_height_  = format_desc.height;
+
+        if (full) {
+            return std::nullopt;
+        }
+
+        if (changed.empty()) {
+            damage_.emplace_back();
+        } else {
+            damage_.push_back(core::damage_rect{
+                changed.left, changed.top, changed.right - changed.left, changed.bottom - changed.top});
+        }
+
+        return changed;
+    }
+
+    // Intermediate textures come uncleared from the pool, and are only cleared where they are drawn to or read from.
+    // Textures released earlier in the frame are handed out again by the pool, so intermediates whose lifetimes do not
+    // overlap share the same texture.
+    std::shared_ptr<texture> create_intermediate(const std::shared_ptr<texture>& target_texture, int stride)
+    {
+        auto tex =
+            ogl_->create_texture(target_texture->width(), target_texture->height(), stride, target_depth_, false);
+
+        auto it = std::find_if(intermediates_.begin(), intermediates_.end(), [&](const auto& entry) {
+            return entry.first == tex.get();
+        });
+        if (it != intermediates_.end()) {
+            it->second = region{};
+        } else {
+            intermediates_.emplace_back(tex.get(), region{});
+        }
+
+        return tex;
+    }
+
+    // The area of a texture that holds defined content, the whole texture unless it is an intermediate
+    region valid_region(const std::shared_ptr<texture>& tex) const
+    {
+        for (auto& entry : intermediates_) {
+            if (entry.first == tex.get()) {
+                return entry.second;
+            }
+        }
+        return region{0, 0, tex->width(), tex->height()};
+    }
+
+    // Clears the part of area that has not been cleared yet, if tex is an intermediate
+    void prepare(const std::shared_ptr<texture>& tex, const region& area)
+    {
+        if (!tex || area.empty()) {
+            return;
+        }
+
+        auto it = std::find_if(intermediates_.begin(), intermediates_.end(), [&](const auto& entry) {
+            return entry.first == tex.get();
+        });
+        if (it == intermediates_.end()) {
+            return;
+        }
+
+        auto  cleared = it->second;
+        auto  total   = united(cleared, area);
+        auto& result  = it->second;
+
+        if (cleared.empty()) {
+            tex->clear(total.left, total.top, total.right - total.left, total.bottom - total.top);
+        } else {
+            // What is left of total around the cleared rectangle, as bands above, below, left and right of it
+            const region bands[] = {{total.left, total.top, total.right, cleared.top},
+                                    {total.left, cleared.bottom, total.right, total.bottom},
+                                    {total.left, cleared.top, cleared.left, cleared.bottom},
+                                    {cleared.right, cleared.top, total.right, cleared.bottom}};
+            for (auto& band : bands) {
+                if (!band.empty()) {
+                    tex->clear(band.left, band.top, band.right - band.left, band.bottom - band.top);
+                }
+            }
+        }
+
+        result = total;
+    }
+
+    // Draws the top level layers, timing each of them on the GPU
+    void draw_layers(std::shared_ptr<texture>&      target_texture,
+                     std::vector<layer>             layers,
+                     const core::video_format_desc& format_desc)
+    {
+        std::shared_ptr<texture> layer_key_texture;
+
+        layer_cache_.resize(layers.size());
+
+        for (size_t n = 0; n < layers.size(); ++n) {
+            timer_.begin("layer/" + std::to_string(n));
+            if (!draw_cached(target_texture, layers[n], layer_key_texture, layer_cache_[n], format_desc)) {
+                draw(target_texture, layers[n].sublayers, format_desc);
+                draw(target_texture, std::move(layers[n]), layer_key_texture, format_desc);
+            }
+            timer_.end();
+        }
+    }
+
+    // Whether the composite of a layer can stand in for its draws. Those of a field only cover its own lines, and a
+    // layer that is keyed by the one before it, or that keys the one after it, is drawn together with that layer.
+    bool is_cacheable(const layer& layer, const std::shared_ptr<texture>& layer_key_texture) const
+    {
+        if (layer.cache == core::layer_cache::disabled || target_field_ != core::video_field::progressive ||
+            layer_key_texture || !layer.sublayers.empty() || layer.items.empty() ||
+            layer.items.back().transforms.image_transform.is_key) {
+            return false;
+        }
+
+        // The composite of a single item is drawn at the cost of the item itself
+        const auto drawn = std::count_if(
+            layer.items.begin(), layer.items.end(), [](const item& item) { return !item.culled; });
+        return layer.cache == core::layer_cache::enabled || drawn > 1;
+    }
+
+    static bool same_scene(const std::vector<scene_entry>& lhs, const std::vector<scene_entry>& rhs)
+    {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const auto& a, const auto& b) {
+            return a.is_layer == b.is_layer && a.blend_mode == b.blend_mode && a.frame == b.frame &&
+                   a.transform == b.transform && a.coords == b.coords && a.culled == b.culled;
+        });
+    }
+
+    // Draws the composite of a layer that draws what it did on the previous tick, drawing the layer into it first if
+    // that has not been done yet. Returns false when the layer is to be drawn as usual.
+    bool draw_cached(std::shared_ptr<texture>&      target_texture,
+                     layer&                         layer,
+                     std::shared_ptr<texture>&      layer_key_texture,
+                     cached_layer&                  cached,
+                     const core::video_format_desc& format_desc)
+    {
+        if (!is_cacheable(layer, layer_key_texture)) {
+            cached = cached_layer{};
+            return false;
+        }
+
+        std::vector<scene_entry> scene;
+        collect(layer, scene);
+
+        const auto unchanged = same_scene(cached.scene, scene);
+        if (!unchanged || (cached.composite && (cached.composite->width() != target_texture->width() ||
+                                                cached.composite->height() != target_texture->height()))) {
+            cached.scene = std::move(scene);
+            cached.composite.reset();
+        }
+
+        // Only a whole frame draw leaves all of the layer in the composite
+        const auto whole = draw_area_.left == 0 && draw_area_.top == 0 &&
+                           draw_area_.right == target_texture->width() &&
+                           draw_area_.bottom == target_texture->height();
+
+        // The blend mode applies to the composite as a whole
+        const auto blend_mode = layer.blend_mode;
+
+        if (!cached.composite && whole && (unchanged || layer.cache == core::layer_cache::enabled)) {
+            cached.composite =
+                ogl_->create_texture(target_texture->width(), target_texture->height(), 4, target_depth_, true);
+
+            std::shared_ptr<texture> no_key;
+            layer.blend_mode = core::blend_mode::normal;
+            draw(cached.composite, std::move(layer), no_key, format_desc);
+        }
+
+        if (!cached.composite) {
+            return false;
+        }
+
+        draw(target_texture, std::shared_ptr<texture>(cached.composite), format_desc, blend_mode);
+        return true;
+    }
+
     void draw(std::shared_ptr<texture>&      target_texture,
               std::vector<layer>             layers,
               const core::video_format_desc& format_desc)
@@ -126,28 +1008,21 @@ class image_renderer
         std::shared_ptr<texture> local_key_texture;
         std::shared_ptr<texture> local_mix_texture;
 
-        if (layer.blend_mode != core::blend_mode::normal) {
-            auto layer_texture = ogl_->create_texture(target_texture->width(), target_texture->height(), 4, depth_);
+        // A blend mode layer with nothing visible in it only has keys left to draw, which do not need a layer texture
+        const auto visible = std::any_of(layer.items.begin(), layer.items.end(), [](const item& item) {
+            return !item.culled && !item.transforms.image_transform.is_key;
+        });
 
-            for (auto& item : layer.items)
-                draw(layer_texture,
-                     std::move(item),
-                     layer_key_texture,
-                     local_key_texture,
-                     local_mix_texture,
-                     format_desc);
+        if (layer.blend_mode != core::blend_mode::normal && visible) {
+            auto layer_texture = create_intermediate(target_texture, 4);
+
+            draw(layer_texture, layer.items, layer_key_texture, local_key_texture, local_mix_texture, format_desc);
 
             draw(layer_texture, std::move(local_mix_texture), format_desc, core::blend_mode::normal);
             draw(target_texture, std::move(layer_texture), format_desc, layer.blend_mode);
         } else // fast path
         {
-            for (auto& item : layer.items)
-                draw(target_texture,
-                     std::move(item),
-                     layer_key_texture,
-                     local_key_texture,
-                     local_mix_texture,
-                     format_desc);
+            draw(target_texture, layer.items, layer_key_texture, local_key_texture, local_mix_texture, format_desc);
 
             draw(target_texture, std::move(local_mix_texture), format_desc, core::blend_mode::normal);
         }
@@ -155,21 +1030,42 @@ class image_renderer
         layer_key_texture = std::move(local_key_texture);
     }
 
+    // Draws the items of a layer in order, those of a transition together when they match one of its shapes
     void draw(std::shared_ptr<texture>&      target_texture,
-              item                           item,
+              std::vector<item>&             items,
               std::shared_ptr<texture>&      layer_key_texture,
               std::shared_ptr<texture>&      local_key_texture,
               std::shared_ptr<texture>&      local_mix_texture,
               const core::video_format_desc& format_desc)
+    {
+        for (size_t n = 0; n < items.size(); ++n) {
+            if (auto count = draw_transition(
+                    target_texture, items, n, layer_key_texture, local_key_texture, local_mix_texture, format_desc)) {
+                n += count - 1;
+                continue;
+            }
+
+            draw(target_texture,
+                 std::move(items[n]),
+                 layer_key_texture,
+                 local_key_texture,
+                 local_mix_texture,
+                 format_desc);
+        }
+    }
+
+    draw_params to_draw_params(item&& item, const core::video_format_desc& format_desc) const
     {
         draw_params draw_params;
         draw_params.target_width  = format_desc.square_width;
         draw_params.target_height = format_desc.square_height;
         // TODO: Pass the target color_space
 
-        draw_params.pix_desc   = std::move(item.pix_desc);
-        draw_params.transforms = std::move(item.transforms);
-        draw_params.geometry   = std::move(item.geometry);
+        draw_params.pix_desc     = std::move(item.pix_desc);
+        draw_params.transforms   = std::move(item.transforms);
+        draw_params.geometry     = std::move(item.geometry);
+        draw_params.field        = item.field;
+        draw_params.target_field = target_field_;
         draw_params.aspect_ratio =
             static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
 
@@ -177,22 +1073,203 @@ class image_renderer
             draw_params.textures.push_back(spl::make_shared_ptr(future_texture.get()));
         }
 
+        return draw_params;
+    }
+
+    // Whether two draws apply the same adjustments to their pixels, apart from their opacity
+    static bool same_adjustments(const core::image_transform& lhs, const core::image_transform& rhs)
+    {
+        auto adjustments = [](const core::image_transform& transform) {
+            auto& levels = transform.levels;
+            auto& chroma = transform.chroma;
+            return std::tie(transform.contrast,
+                            transform.brightness,
+                            transform.saturation,
+                            transform.invert,
+                            levels.min_input,
+                            levels.max_input,
+                            levels.gamma,
+                            levels.min_output,
+                            levels.max_output,
+                            chroma.enable,
+                            chroma.show_mask,
+                            chroma.target_hue,
+                            chroma.hue_width,
+                            chroma.min_saturation,
+                            chroma.min_brightness,
+                            chroma.softness,
+                            chroma.spill_suppress,
+                            chroma.spill_suppress_saturation);
+        };
+        return adjustments(lhs) == adjustments(rhs);
+    }
+
+    // Whether an item is of one opaque colour and drawn as is over the whole of a target that is not an intermediate
+    bool fills_target(const item& item, const std::shared_ptr<texture>& target_texture) const
+    {
+        const auto& transform = item.transforms.image_transform;
+        if (target_field_ != core::video_field::progressive || !item.solid || (*item.solid)[3] < 1.0f - 0.001f ||
+            item.field != core::video_field::progressive || transform.is_key || transform.is_mix ||
+            transform.opacity < 1.0 - 0.001 || !same_adjustments(transform, core::image_transform{}) ||
+            !covers_screen(item.coords)) {
+            return false;
+        }
+        return std::none_of(intermediates_.begin(), intermediates_.end(), [&](const auto& entry) {
+            return entry.first == target_texture.get();
+        });
+    }
+
+    // Whether an item can be sampled as a source or mask of a transition drawn in one pass with the first source
+    static bool is_transition_source(const item& item, const item& first)
+    {
+        return !item.culled && item.field == first.field && item.coords == first.coords &&
+               item.textures.size() == 1 && is_transition_format(item.pix_desc);
+    }
+
+    // The draws of transitions that mix or key their sources over each other fill the canvas once per source, mask
+    // and intermediate. Those that match one of these shapes are drawn in a single pass that samples every source:
+    //
+    //  mix:  two mixed items, drawn into a mix texture that is then drawn to the target
+    //  mask: an inverted key, the first source, the key and the second source, as the luma matte of a sting
+    //  key:  a key and the source it keys, as the fill and key clips of a separated producer
+    //
+    // Returns the number of items drawn, or 0 if they did not match.
+    size_t draw_transition(std::shared_ptr<texture>&      target_texture,
+                           std::vector<item>&             items,
+                           size_t                         n,
+                           std::shared_ptr<texture>&      layer_key_texture,
+                           std::shared_ptr<texture>&      local_key_texture,
+                           std::shared_ptr<texture>&      local_mix_texture,
+                           const core::video_format_desc& format_desc)
+    {
+        // A key drawn before the items would be combined with their own
+        if (local_key_texture) {
+            return 0;
+        }
+
+        auto is_mix = [&](size_t index) {
+            return index < items.size() && items[index].transforms.image_transform.is_mix &&
+                   !items[index].transforms.image_transform.is_key;
+        };
+        auto is_key = [&](size_t index, bool invert) {
+            return index < items.size() && items[index].transforms.image_transform.is_key &&
+                   items[index].transforms.image_transform.invert == invert;
+        };
+        auto is_plain = [&](size_t index) {
+            return index < items.size() && !items[index].transforms.image_transform.is_mix &&
+                   !items[index].transforms.image_transform.is_key;
+        };
+
+        item* source = nullptr;
+        item* second = nullptr;
+        item* mask   = nullptr;
+        auto  mode   = transition_mode::none;
+        if (is_mix(n) && is_mix(n + 1) && !is_mix(n + 2) && !local_mix_texture) {
+            mode   = transition_mode::mix;
+            source = &items[n];
+            second = &items[n + 1];
+        } else if (is_key(n, true) && is_plain(n + 1) && is_key(n + 2, false) && is_plain(n + 3) &&
+                   items[n].frame == items[n + 2].frame) {
+            mode   = transition_mode::mask;
+            mask   = &items[n];
+            source = &items[n + 1];
+            second = &items[n + 3];
+        } else if (is_key(n, false) && is_plain(n + 1)) {
+            mode   = transition_mode::key;
+            mask   = &items[n];
+            source = &items[n + 1];
+        } else {
+            return 0;
+        }
+
+        // A layer key scales what is drawn, which only carries over to a single keyed source
+        if (layer_key_texture && mode != transition_mode::key) {
+            return 0;
+        }
+
+        // The sources only differ in their opacity, and the mask is used as is
+        core::image_transform plain_mask;
+        plain_mask.invert = mode == transition_mode::mask;
+        if (source->culled || source->transforms.image_transform.invert ||
+            (second && (!is_transition_source(*second, *source) ||
+                        !same_adjustments(source->transforms.image_transform, second->transforms.image_transform))) ||
+            (mask && (!is_transition_source(*mask, *source) ||
+                      !same_adjustments(mask->transforms.image_transform, plain_mask)))) {
+            return 0;
+        }
+
+        // A keyed source ends any mix before it, as it would when drawn on its own
+        draw(target_texture, std::move(local_mix_texture), format_desc, core::blend_mode::normal);
+
+        const auto bounds = source->bounds;
+
+        auto draw_params            = to_draw_params(std::move(*source), format_desc);
+        draw_params.background      = target_texture;
+        draw_params.layer_key       = layer_key_texture;
+        draw_params.transition.mode = mode;
+        if (second) {
+            draw_params.transition.pix_desc = second->pix_desc;
+            draw_params.transition.texture  = second->textures[0].get();
+            draw_params.transition.opacity  = second->transforms.image_transform.opacity;
+        }
+        if (mask) {
+            draw_params.transition.mask_desc = mask->pix_desc;
+            draw_params.transition.mask      = mask->textures[0].get();
+        }
+
+        prepare(target_texture, bounds);
+        prepare(draw_params.layer_key, bounds);
+
+        kernel_.draw(std::move(draw_params));
+
+        return mode == transition_mode::mask ? 4 : 2;
+    }
+
+    void draw(std::shared_ptr<texture>&      target_texture,
+              item                           item,
+              std::shared_ptr<texture>&      layer_key_texture,
+              std::shared_ptr<texture>&      local_key_texture,
+              std::shared_ptr<texture>&      local_mix_texture,
+              const core::video_format_desc& format_desc)
+    {
+        if (item.culled) {
+            // Nothing of the item is drawn, but it ends a mix and spends the key all the same
+            if (!item.transforms.image_transform.is_mix) {
+                draw(target_texture, std::move(local_mix_texture), format_desc, core::blend_mode::normal);
+            }
+            local_key_texture.reset();
+            return;
+        }
+
+        // A frame of one opaque colour over the whole target replaces what is under it, which a clear does without
+        // waiting for its upload or sampling it
+        if (!local_key_texture && !layer_key_texture && fills_target(item, target_texture)) {
+            draw(target_texture, std::move(local_mix_texture), format_desc, core::blend_mode::normal);
+
+            target_texture->clear(draw_area_.left,
+                                  draw_area_.top,
+                                  draw_area_.right - draw_area_.left,
+                                  draw_area_.bottom - draw_area_.top,
+                                  *item.solid);
+            return;
+        }
+
+        auto draw_params = to_draw_params(std::move(item), format_desc);
+
         if (draw_params.transforms.image_transform
                 .is_key) { // A key means we will use it for the next non-key item as a mask
-            local_key_texture =
-                local_key_texture ? local_key_texture
-                                  : ogl_->create_texture(target_texture->width(), target_texture->height(), 1, depth_);
+            local_key_texture = local_key_texture ? local_key_texture : create_intermediate(target_texture, 1);
 
             draw_params.background = local_key_texture;
             draw_params.local_key  = nullptr;
             draw_params.layer_key  = nullptr;
 
+            prepare(local_key_texture, item.bounds);
+
             kernel_.draw(std::move(draw_params));
         } else if (draw_params.transforms.image_transform
                        .is_mix) { // A mix means precomp the items to a texture, before drawing to the channel
-            local_mix_texture =
-                local_mix_texture ? local_mix_texture
-                                  : ogl_->create_texture(target_texture->width(), target_texture->height(), 4, depth_);
+            local_mix_texture = local_mix_texture ? local_mix_texture : create_intermediate(target_texture, 4);
 
             draw_params.background = local_mix_texture;
             draw_params.local_key  = std::move(local_key_texture); // Use and reset the key
@@ -200,6 +1277,10 @@ class image_renderer
 
             draw_params.keyer = keyer::additive;
 
+            prepare(local_mix_texture, item.bounds);
+            prepare(draw_params.local_key, item.bounds);
+            prepare(draw_params.layer_key, item.bounds);
+
             kernel_.draw(std::move(draw_params));
         } else {
             // If there is a mix, this is the end so draw it and reset
@@ -209,6 +1290,10 @@ class image_renderer
             draw_params.local_key  = std::move(local_key_texture);
             draw_params.layer_key  = layer_key_texture;
 
+            prepare(target_texture, item.bounds);
+            prepare(draw_params.local_key, item.bounds);
+            prepare(draw_params.layer_key, item.bounds);
+
             kernel_.draw(std::move(draw_params));
         }
     }
@@ -221,6 +1306,20 @@ class image_renderer
         if (!source_texture)
             return;
 
+        // Only the part of an intermediate that was drawn to is composited, the rest of it is transparent
+        const auto area = valid_region(source_texture);
+        if (area.empty())
+            return;
+
+        prepare(target_texture, area);
+
+        const auto width  = static_cast<double>(source_texture->width());
+        const auto height = static_cast<double>(source_texture->height());
+        const auto left   = area.left / width;
+        const auto top    = area.top / height;
+        const auto right  = area.right / width;
+        const auto bottom = area.bottom / height;
+
         draw_params draw_params;
         draw_params.target_width    = format_desc.square_width;
         draw_params.target_height   = format_desc.square_height;
@@ -230,7 +1329,13 @@ class image_renderer
         draw_params.textures        = {spl::make_shared_ptr(source_texture)};
         draw_params.blend_mode      = blend_mode;
         draw_params.background      = target_texture;
-        draw_params.geometry        = core::frame_geometry::get_default();
+        draw_params.target_field    = target_field_;
+        draw_params.geometry        = core::frame_geometry(core::frame_geometry::geometry_type::quad,
+                                                    core::frame_geometry::scale_mode::stretch,
+                                                    {{left, top, left, top},
+                                                     {right, top, right, top},
+                                                     {right, bottom, right, bottom},
+                                                     {left, bottom, left, bottom}});
 
         kernel_.draw(std::move(draw_params));
     }
@@ -240,18 +1345,24 @@ struct image_mixer::impl
     : public core::frame_factory
     , public std::enable_shared_from_this<impl>
 {
-    spl::shared_ptr<device>      ogl_;
-    image_renderer               renderer_;
-    std::vector<draw_transforms> transform_stack_;
-    std::vector<layer>           layers_; // layer/stream/items
-    std::vector<layer*>          layer_stack_;
+    spl::shared_ptr<device>          ogl_;
+    image_renderer                   renderer_;
+    std::shared_ptr<image_converter> converter_;
+    std::vector<draw_transforms>     transform_stack_;
+    std::vector<layer>               layers_; // layer/stream/items
+    std::vector<layer*>              layer_stack_;
 
     double aspect_ratio_ = 1.0;
 
   public:
-    impl(const spl::shared_ptr<device>& ogl, const int channel_id, const size_t max_frame_size, common::bit_depth depth)
+    impl(const spl::shared_ptr<device>& ogl,
+         const int                      channel_id,
+         const size_t                   max_frame_size,
+         common::bit_depth              depth,
+         core::color_transfer           transfer)
         : ogl_(ogl)
-        , renderer_(ogl, max_frame_size, depth)
+        , renderer_(ogl, channel_id, max_frame_size, depth, transfer)
+        , converter_(std::make_shared<image_converter>(ogl))
         , transform_stack_(1)
     {
         CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id;
@@ -259,6 +1370,15 @@ struct image_mixer::impl
 
     void update_aspect_ratio(double aspect_ratio) { aspect_ratio_ = aspect_ratio; }
 
+    void set_tile(double left, double top, double right, double bottom)
+    {
+        // Stretches the tile over the target, so that what lies outside it is culled
+        core::image_transform tile;
+        tile.fill_scale       = {1.0 / (right - left), 1.0 / (bottom - top)};
+        tile.fill_translation = {-left / (right - left), -top / (bottom - top)};
+        transform_stack_      = {draw_transforms().combine_transform(tile, 1.0)};
+    }
+
     void push(const core::frame_transform& transform)
     {
         auto previous_layer_depth = transform_stack_.back().image_transform.layer_depth;
@@ -268,7 +1388,8 @@ struct image_mixer::impl
         auto new_layer_depth = transform_stack_.back().image_transform.layer_depth;
 
         if (previous_layer_depth < new_layer_depth) {
-            layer new_layer(transform_stack_.back().image_transform.blend_mode);
+            layer new_layer(transform_stack_.back().image_transform.blend_mode,
+                            transform_stack_.back().image_transform.layer_cache);
 
             if (layer_stack_.empty()) {
                 layers_.push_back(std::move(new_layer));
@@ -291,19 +1412,41 @@ struct image_mixer::impl
         item item;
         item.pix_desc   = frame.pixel_format_desc();
         item.transforms = transform_stack_.back();
+        item.frame      = frame;
         item.geometry   = frame.geometry();
+        item.field      = frame.field();
+        item.solid      = solid_color(frame, item.pix_desc);
 
-        auto textures_ptr = std::any_cast<std::shared_ptr<std::vector<future_texture>>>(frame.opaque());
+        auto textures_ptr = std::any_cast<std::shared_ptr<frame_textures>>(&frame.opaque());
 
-        if (textures_ptr) {
-            item.textures = *textures_ptr;
+        if (textures_ptr && *textures_ptr && (*textures_ptr)->owner == ogl_.get()) {
+            item.textures = (*textures_ptr)->textures;
+            item.pix_desc = (*textures_ptr)->desc;
+        } else if (frame.image_data(0).size() == 0) {
+            // Imported from a shared texture of another device, with nothing in host memory to upload
+            return;
+        } else if (item.transforms.image_transform.opacity < 0.001 && !item.transforms.image_transform.is_key) {
+            // Transparent items are culled before anything is drawn, so those of hidden layers are never uploaded. The
+            // item is kept without textures, as it still ends the mix or key before it.
         } else {
-            for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
-                item.textures.emplace_back(ogl_->copy_async(frame.image_data(n),
-                                                            item.pix_desc.planes[n].width,
-                                                            item.pix_desc.planes[n].height,
-                                                            item.pix_desc.planes[n].stride,
-                                                            item.pix_desc.planes[n].depth));
+            // Frames that carry no textures for this device, either because they were not created by an image mixer
+            // or because they were routed from a channel on another device, are uploaded from their host copy. They
+            // are commonly visited again on later ticks or by other channels, so the upload is shared for as long as
+            // the frame's buffers live.
+            if (core::is_block_compressed(item.pix_desc.format)) {
+                item.textures.emplace_back(ogl_->copy_async_cached(frame.image_data(0),
+                                                                   item.pix_desc.planes[0].width,
+                                                                   item.pix_desc.planes[0].height,
+                                                                   item.pix_desc.format));
+                item.pix_desc = sampled_desc(item.pix_desc);
+            } else {
+                for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
+                    item.textures.emplace_back(ogl_->copy_async_cached(frame.image_data(n),
+                                                                       item.pix_desc.planes[n].width,
+                                                                       item.pix_desc.planes[n].height,
+                                                                       item.pix_desc.planes[n].stride,
+                                                                       item.pix_desc.planes[n].depth));
+                }
             }
         }
 
@@ -316,11 +1459,17 @@ struct image_mixer::impl
         layer_stack_.resize(transform_stack_.back().image_transform.layer_depth);
     }
 
-    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
+    std::future<std::vector<array<const std::uint8_t>>> render(const core::video_format_desc& format_desc,
+                                                               const core::output_request&    request,
+                                                               core::video_field              field)
     {
-        return renderer_(std::move(layers_), format_desc);
+        return renderer_(std::move(layers_), format_desc, request, field);
     }
 
+    std::any rendered() const { return renderer_.rendered(); }
+
+    std::function<array<const std::uint8_t>()> readback() const { return renderer_.readback(); }
+
     core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
     {
         return create_frame(tag, desc, common::bit_depth::bit8);
@@ -346,6 +1495,15 @@ struct image_mixer::impl
                                            return std::any{};
                                        }
                                        std::vector<future_texture> textures;
+                                       if (core::is_block_compressed(desc.format)) {
+                                           textures.emplace_back(self->ogl_->copy_async(image_data[0],
+                                                                                        desc.planes[0].width,
+                                                                                        desc.planes[0].height,
+                                                                                        desc.format));
+                                           auto sampled = sampled_desc(desc);
+                                           return std::make_shared<frame_textures>(
+                                               frame_textures{self->ogl_.get(), std::move(textures), sampled});
+                                       }
                                        for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
                                            textures.emplace_back(self->ogl_->copy_async(image_data[n],
                                                                                         desc.planes[n].width,
@@ -353,18 +1511,103 @@ struct image_mixer::impl
                                                                                         desc.planes[n].stride,
                                                                                         desc.planes[n].depth));
                                        }
-                                       return std::make_shared<decltype(textures)>(std::move(textures));
+                                       if (!image_converter::supports(desc)) {
+                                           return std::make_shared<frame_textures>(
+                                               frame_textures{self->ogl_.get(), std::move(textures), desc});
+                                       }
+                                       // Convert once after upload rather than on every draw, field and channel
+                                       // the frame is drawn in
+                                       auto converter = self->converter_;
+                                       auto converted = self->ogl_->dispatch_async([converter, textures, desc] {
+                                           std::vector<std::shared_ptr<texture>> planes;
+                                           for (auto& plane : textures) {
+                                               planes.push_back(plane.get());
+                                           }
+                                           return converter->convert(planes, desc);
+                                       });
+                                       return std::make_shared<frame_textures>(
+                                           frame_textures{self->ogl_.get(),
+                                                          {converted.share()},
+                                                          image_converter::converted_desc(desc)});
                                    });
     }
 
-    common::bit_depth depth() const { return renderer_.depth(); }
+    bool supports_shared_textures() const override { return ogl_->supports_shared_textures(); }
+
+    core::mutable_frame import_frame(const void* tag, const core::shared_texture& source) override
+    {
+        auto desc = core::pixel_format_desc(core::pixel_format::bgra);
+        desc.planes.emplace_back(source.width, source.height, 4);
+
+        auto tex = ogl_->copy_shared(source);
+        if (!tex) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Failed to import shared texture."));
+        }
+
+        auto textures = std::make_shared<frame_textures>(
+            frame_textures{ogl_.get(), {make_ready_future(std::move(tex)).share()}, desc});
+        return core::mutable_frame(tag,
+                                   {array<std::uint8_t>{}},
+                                   array<int32_t>{},
+                                   desc,
+                                   [textures](std::vector<array<const std::uint8_t>>) -> std::any { return textures; });
+    }
+
+    core::mutable_frame update_frame(const void*                           tag,
+                                     const core::const_frame&              previous,
+                                     const core::pixel_format_desc&        desc,
+                                     const array<const std::uint8_t>&      image,
+                                     const std::vector<core::damage_rect>& damage) override
+    {
+        auto& plane = desc.planes.at(0);
+
+        // The previous texture is copied on the GPU rather than uploaded again when it is of this device
+        std::shared_ptr<frame_textures> base;
+        if (previous && !damage.empty()) {
+            auto textures_ptr = std::any_cast<std::shared_ptr<frame_textures>>(&previous.opaque());
+            if (textures_ptr && *textures_ptr && (*textures_ptr)->owner == ogl_.get() &&
+                (*textures_ptr)->textures.size() == 1) {
+                auto& base_plane = (*textures_ptr)->desc.planes.at(0);
+                if (base_plane.width == plane.width && base_plane.height == plane.height &&
+                    base_plane.stride == plane.stride && base_plane.depth == plane.depth) {
+                    base = *textures_ptr;
+                }
+            }
+        }
+
+        future_texture tex;
+        if (base) {
+            tex = ogl_->copy_async(
+                          image, plane.width, plane.height, plane.stride, plane.depth, base->textures[0], damage)
+                      .share();
+        } else {
+            tex = ogl_->copy_async(image, plane.width, plane.height, plane.stride, plane.depth).share();
+        }
+
+        auto textures = std::make_shared<frame_textures>(frame_textures{ogl_.get(), {std::move(tex)}, desc});
+        return core::mutable_frame(tag,
+                                   {array<std::uint8_t>{}},
+                                   array<int32_t>{},
+                                   desc,
+                                   [textures](std::vector<array<const std::uint8_t>>) -> std::any { return textures; });
+    }
+
+    common::bit_depth    depth() const { return renderer_.depth(); }
+    core::color_transfer transfer() const { return renderer_.transfer(); }
+    int                  visited_items() const { return renderer_.visited_items(); }
+    int                  culled_items() const { return renderer_.culled_items(); }
+
+    std::map<std::string, double> gpu_times() const { return renderer_.gpu_times(); }
+
+    std::vector<core::damage_rect> damage() const { return renderer_.damage(); }
 };
 
 image_mixer::image_mixer(const spl::shared_ptr<device>& ogl,
                          const int                      channel_id,
                          const size_t                   max_frame_size,
-                         common::bit_depth              depth)
-    : impl_(std::make_unique<impl>(ogl, channel_id, max_frame_size, depth))
+                         common::bit_depth              depth,
+                         core::color_transfer           transfer)
+    : impl_(std::make_unique<impl>(ogl, channel_id, max_frame_size, depth, transfer))
 {
 }
 image_mixer::~image_mixer() {}
@@ -372,9 +1615,15 @@ void image_mixer::push(const core::frame_transform& transform) { impl_->push(tra
 void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
 void image_mixer::pop() { impl_->pop(); }
 void image_mixer::update_aspect_ratio(double aspect_ratio) { impl_->update_aspect_ratio(aspect_ratio); }
-std::future<array<const std::uint8_t>> image_mixer::render(const core::video_format_desc& format_desc)
+void image_mixer::set_tile(double left, double top, double right, double bottom)
 {
-    return impl_->render(format_desc);
+    impl_->set_tile(left, top, right, bottom);
+}
+std::future<std::vector<array<const std::uint8_t>>> image_mixer::render(const core::video_format_desc& format_desc,
+                                                                         const core::output_request&    request,
+                                                                         core::video_field              field)
+{
+    return impl_->render(format_desc, request, field);
 }
 core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
 {
@@ -386,6 +1635,53 @@ image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc,
     return impl_->create_frame(tag, desc, depth);
 }
 
-common::bit_depth image_mixer::depth() const { return impl_->depth(); }
+bool image_mixer::supports_shared_textures() const { return impl_->supports_shared_textures(); }
+core::mutable_frame image_mixer::import_frame(const void* tag, const core::shared_texture& texture)
+{
+    return impl_->import_frame(tag, texture);
+}
+
+core::mutable_frame image_mixer::update_frame(const void*                           tag,
+                                              const core::const_frame&              previous,
+                                              const core::pixel_format_desc&        desc,
+                                              const array<const std::uint8_t>&      image,
+                                              const std::vector<core::damage_rect>& damage)
+{
+    return impl_->update_frame(tag, previous, desc, image, damage);
+}
+
+// Frames hold textures of the device, which every channel on it can draw
+const void* image_mixer::frame_scope() const { return impl_->ogl_.get(); }
+
+common::bit_depth    image_mixer::depth() const { return impl_->depth(); }
+core::color_transfer image_mixer::transfer() const { return impl_->transfer(); }
+int                  image_mixer::visited_items() const { return impl_->visited_items(); }
+int                  image_mixer::culled_items() const { return impl_->culled_items(); }
+
+std::any                       image_mixer::rendered() const { return impl_->rendered(); }
+std::vector<core::damage_rect> image_mixer::damage() const { return impl_->damage(); }
+std::map<std::string, double>  image_mixer::gpu_times() const { return impl_->gpu_times(); }
+
+std::function<array<const std::uint8_t>()> image_mixer::readback() const { return impl_->readback(); }
+
+bool bind_rendered_texture(const core::const_frame& frame, int index)
+{
+    auto textures_ptr = std::any_cast<std::shared_ptr<frame_textures>>(&frame.opaque());
+    if (!textures_ptr || !*textures_ptr || !(*textures_ptr)->drawn.valid()) {
+        return false;
+    }
+
+    auto& textures = **textures_ptr;
+    auto  texture  = textures.textures.at(0).get();
+    auto  drawn    = textures.drawn.get();
+    if (!texture || !drawn) {
+        return false;
+    }
+
+    // Waits on the GPU rather than on the CPU, before the draws that follow in this context
+    GL(glWaitSync(static_cast<GLsync>(drawn.get()), 0, GL_TIMEOUT_IGNORED));
+    texture->bind(index);
+    return true;
+}
 
 }}} // namespace caspar::accelerator::ogl
@@ -37,33 +37,65 @@ namespace caspar { namespace accelerator { namespace ogl {
 class image_mixer final : public core::image_mixer
 {
   public:
+    // Channels of a transfer other than bt709 are mixed in linear light, on half float targets, and encoded with it
     image_mixer(const spl::shared_ptr<class device>& ogl,
                 int                                  channel_id,
                 const size_t                         max_frame_size,
-                common::bit_depth                    depth);
+                common::bit_depth                    depth,
+                core::color_transfer                 transfer = core::color_transfer::bt709);
     image_mixer(const image_mixer&) = delete;
 
     ~image_mixer();
 
     image_mixer& operator=(const image_mixer&) = delete;
 
-    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc) override;
-    core::mutable_frame                    create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    std::future<std::vector<array<const std::uint8_t>>> render(const core::video_format_desc& format_desc,
+                                                               const core::output_request&    request,
+                                                               core::video_field              field) override;
+    std::any            rendered() const override;
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override;
     core::mutable_frame
     create_frame(const void* video_stream_tag, const core::pixel_format_desc& desc, common::bit_depth depth) override;
+    bool                supports_shared_textures() const override;
+    core::mutable_frame import_frame(const void* video_stream_tag, const core::shared_texture& texture) override;
+    core::mutable_frame update_frame(const void*                           video_stream_tag,
+                                     const core::const_frame&              previous,
+                                     const core::pixel_format_desc&        desc,
+                                     const array<const std::uint8_t>&      image,
+                                     const std::vector<core::damage_rect>& damage) override;
+    const void* frame_scope() const override;
+
+    std::function<array<const std::uint8_t>()> readback() const override;
 
     void update_aspect_ratio(double aspect_ratio) override;
 
+    // Draws only the part of the channel between left and right, and top and bottom, as fractions of its width and
+    // height, over the whole of the formats rendered, from the next push on. The format keeps the square size of the
+    // channel, for scale modes and aspect ratios to be those of the channel.
+    void set_tile(double left, double top, double right, double bottom);
+
     // core::image_mixer
 
-    void              push(const core::frame_transform& frame) override;
-    void              visit(const core::const_frame& frame) override;
-    void              pop() override;
-    common::bit_depth depth() const override;
+    void                 push(const core::frame_transform& frame) override;
+    void                 visit(const core::const_frame& frame) override;
+    void                 pop() override;
+    common::bit_depth    depth() const override;
+    core::color_transfer transfer() const override;
+    int                  visited_items() const override;
+    int                  culled_items() const override;
+
+    std::vector<core::damage_rect> damage() const override;
+    std::map<std::string, double>  gpu_times() const override;
 
   private:
     struct impl;
     std::shared_ptr<impl> impl_;
 };
 
+// Binds the mixed image that a frame of an image mixer carries on the GPU, see core::output_request::texture, to a
+// texture unit of the current context, once the GPU has drawn it. The context must share its objects with the device,
+// see device_context::shares_with_windows, and the frame must be held until the GPU is done with the texture. Returns
+// false if the frame carries no such image.
+bool bind_rendered_texture(const core::const_frame& frame, int index);
+
 }}} // namespace caspar::accelerator::ogl
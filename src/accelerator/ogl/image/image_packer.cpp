@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image_packer.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+#include "ogl_packer_fragment.h"
+#include "ogl_packer_vertex.h"
+
+#include <string>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+struct image_packer::impl
+{
+    spl::shared_ptr<device> ogl_;
+    std::unique_ptr<shader> shader_;
+    GLuint                  vao_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+    {
+        ogl_->dispatch_sync([&] {
+            shader_ = std::make_unique<shader>(std::string(packer_vertex_shader), std::string(packer_fragment_shader));
+            GL(glGenVertexArrays(1, &vao_));
+        });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            shader_.reset();
+            GL(glDeleteVertexArrays(1, &vao_));
+        });
+    }
+
+    std::shared_ptr<texture> pack(const std::shared_ptr<texture>& source,
+                                  core::output_packing            packing,
+                                  core::color_space               color_space,
+                                  core::color_transfer            transfer)
+    {
+        auto width  = core::packed_row_bytes(packing, source->width()) / 4;
+        auto target = ogl_->create_texture(width, source->height(), 4, common::bit_depth::bit8);
+
+        // Standard definition is always bt.601, as in image_kernel
+        if (source->height() <= 700) {
+            color_space = core::color_space::bt601;
+        }
+
+        draw(source, target, static_cast<int>(packing), color_space, transfer);
+        return target;
+    }
+
+    std::shared_ptr<texture>
+    encode(const std::shared_ptr<texture>& source, core::color_transfer transfer, common::bit_depth depth)
+    {
+        auto target = ogl_->create_texture(source->width(), source->height(), 4, depth);
+        draw(source, target, -1, core::color_space::bt709, transfer);
+        return target;
+    }
+
+    void draw(const std::shared_ptr<texture>& source,
+              const std::shared_ptr<texture>& target,
+              int                             packing,
+              core::color_space               color_space,
+              core::color_transfer            transfer)
+    {
+        const float luma_coefficients[3][3] = {{0.299, 0.587, 0.114},     // bt.601
+                                               {0.2126, 0.7152, 0.0722},  // bt.709
+                                               {0.2627, 0.6780, 0.0593}}; // bt.2020
+        const auto  luma_coeff              = luma_coefficients[static_cast<int>(color_space)];
+
+        source->bind(0);
+
+        shader_->use();
+        shader_->set("source", 0);
+        shader_->set("source_width", source->width());
+        shader_->set("packing", packing);
+        shader_->set("luma_coeff", luma_coeff[0], luma_coeff[1], luma_coeff[2]);
+        shader_->set("transfer", source->depth() == common::bit_depth::float16 ? static_cast<int>(transfer) : -1);
+
+        GL(glViewport(0, 0, target->width(), target->height()));
+        GL(glDisable(GL_BLEND));
+        GL(glDisable(GL_SCISSOR_TEST));
+
+        target->attach();
+
+        GL(glBindVertexArray(vao_));
+        GL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        GL(glBindVertexArray(0));
+    }
+};
+
+image_packer::image_packer(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+image_packer::~image_packer() {}
+std::shared_ptr<texture> image_packer::pack(const std::shared_ptr<texture>& source,
+                                            core::output_packing            packing,
+                                            core::color_space               color_space,
+                                            core::color_transfer            transfer)
+{
+    return impl_->pack(source, packing, color_space, transfer);
+}
+std::shared_ptr<texture>
+image_packer::encode(const std::shared_ptr<texture>& source, core::color_transfer transfer, common::bit_depth depth)
+{
+    return impl_->encode(source, transfer, depth);
+}
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/bit_depth.h>
+#include <common/memory.h>
+
+#include <core/frame/pixel_format.h>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Packs a mixed image into one of the output layouts on the GPU. The result is a four byte per texel texture that
+// reads back as the packed rows. Images in linear light, those of half float textures, are encoded with the transfer
+// in the same pass. Must be called on the device thread.
+class image_packer final
+{
+    image_packer(const image_packer&);
+    image_packer& operator=(const image_packer&);
+
+  public:
+    explicit image_packer(const spl::shared_ptr<class device>& ogl);
+    ~image_packer();
+
+    std::shared_ptr<class texture> pack(const std::shared_ptr<class texture>& source,
+                                        core::output_packing                  packing,
+                                        core::color_space                     color_space,
+                                        core::color_transfer                  transfer);
+
+    // The image of a half float texture encoded with the transfer into a texture of the depth
+    std::shared_ptr<class texture>
+    encode(const std::shared_ptr<class texture>& source, core::color_transfer transfer, common::bit_depth depth);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
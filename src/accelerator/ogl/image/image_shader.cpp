@@ -26,25 +26,163 @@
 #include "ogl_image_fragment.h"
 #include "ogl_image_vertex.h"
 
+#include <common/log.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
-std::weak_ptr<shader> g_shader;
-std::mutex            g_shader_mutex;
+bool image_shader_key::operator<(const image_shader_key& other) const
+{
+    return std::tie(pixel_format,
+                    blend_mode,
+                    keyer,
+                    is_straight_alpha,
+                    has_local_key,
+                    has_layer_key,
+                    invert,
+                    levels,
+                    csb,
+                    chroma,
+                    transition) < std::tie(other.pixel_format,
+                                       other.blend_mode,
+                                       other.keyer,
+                                       other.is_straight_alpha,
+                                       other.has_local_key,
+                                       other.has_layer_key,
+                                       other.invert,
+                                       other.levels,
+                                       other.csb,
+                                       other.chroma,
+                                       other.transition);
+}
+
+namespace {
+
+std::string to_define(const char* name, int value)
+{
+    return std::string("#define ") + name + " " + boost::lexical_cast<std::string>(value) + "\n";
+}
+
+std::string to_define(const char* name, bool value)
+{
+    return std::string("#define ") + name + (value ? " true\n" : " false\n");
+}
+
+// The variant sources are the generic source with its run-time switches replaced by constants, which lets the
+// compiler drop every branch the draw does not take
+std::string variant_source(const image_shader_key& key)
+{
+    std::string source = fragment_shader;
+    std::string defines;
+
+    defines += to_define("PIXEL_FORMAT", key.pixel_format);
+    defines += to_define("BLEND_MODE", key.blend_mode);
+    defines += to_define("KEYER", key.keyer);
+    defines += to_define("IS_STRAIGHT_ALPHA", key.is_straight_alpha);
+    defines += to_define("HAS_LOCAL_KEY", key.has_local_key);
+    defines += to_define("HAS_LAYER_KEY", key.has_layer_key);
+    defines += to_define("INVERT", key.invert);
+    defines += to_define("LEVELS", key.levels);
+    defines += to_define("CSB", key.csb);
+    defines += to_define("CHROMA", key.chroma);
+    defines += to_define("TRANSITION", key.transition);
+
+    // The defines have to follow the version directive
+    auto pos = source.find('\n', source.find("#version"));
+    source.insert(pos == std::string::npos ? 0 : pos + 1, defines);
+
+    return source;
+}
+
+std::unique_ptr<shader> compile(const std::string& fragment_source)
+{
+    auto result = std::make_unique<shader>(std::string(vertex_shader), fragment_source);
+
+    // Texture units never change, so only the uniform block is updated per draw
+    result->use();
+    result->set("plane[0]", texture_id::plane0);
+    result->set("plane[1]", texture_id::plane1);
+    result->set("plane[2]", texture_id::plane2);
+    result->set("plane[3]", texture_id::plane3);
+    result->set("local_key", texture_id::local_key);
+    result->set("layer_key", texture_id::layer_key);
+    result->set("background", texture_id::background);
+    result->set("transition_source", texture_id::transition_source);
+    result->set("transition_mask", texture_id::transition_mask);
+
+    return result;
+}
+
+} // namespace
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
+struct image_shaders::impl
+{
+    std::unique_ptr<shader>                             generic_;
+    std::map<image_shader_key, std::unique_ptr<shader>> variants_;
+    std::set<image_shader_key>                          failed_;
+
+    impl()
+        : generic_(compile(fragment_shader))
+    {
+    }
+
+    shader& get(const image_shader_key& key)
+    {
+        auto it = variants_.find(key);
+        if (it != variants_.end()) {
+            return *it->second;
+        }
+
+        if (failed_.count(key) > 0) {
+            return *generic_;
+        }
+
+        try {
+            return *variants_.emplace(key, compile(variant_source(key))).first->second;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << L"[image_shaders] Failed to compile shader variant, using the generic shader.";
+            failed_.insert(key);
+            return *generic_;
+        }
+    }
+};
+
+image_shaders::image_shaders()
+    : impl_(new impl())
+{
+}
+image_shaders::~image_shaders() {}
+shader& image_shaders::generic() { return *impl_->generic_; }
+shader& image_shaders::get(const image_shader_key& key) { return impl_->get(key); }
+
+// Programs are not shared between the contexts of different devices, so each device compiles its own
+std::map<const device*, std::weak_ptr<image_shaders>> g_shaders;
+std::mutex                                            g_shader_mutex;
+
+std::shared_ptr<image_shaders> get_image_shaders(const spl::shared_ptr<device>& ogl)
 {
     std::lock_guard<std::mutex> lock(g_shader_mutex);
-    auto                        existing_shader = g_shader.lock();
+    auto&                       weak_shaders     = g_shaders[ogl.get()];
+    auto                        existing_shaders = weak_shaders.lock();
 
-    if (existing_shader) {
-        return existing_shader;
+    if (existing_shaders) {
+        return existing_shaders;
     }
 
     // The deleter is alive until the weak pointer is destroyed, so we have
     // to weakly reference ogl, to not keep it alive until atexit
     std::weak_ptr<device> weak_ogl = ogl;
 
-    auto deleter = [weak_ogl](shader* p) {
+    auto deleter = [weak_ogl](image_shaders* p) {
         auto ogl = weak_ogl.lock();
 
         if (ogl) {
@@ -52,11 +190,30 @@ std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
         }
     };
 
-    existing_shader.reset(new shader(std::string(vertex_shader), std::string(fragment_shader)), deleter);
+    existing_shaders.reset(new image_shaders(), deleter);
 
-    g_shader = existing_shader;
+    weak_shaders = existing_shaders;
+
+    // Plain draws of the common formats are compiled ahead of use, one per task so that channels starting up and
+    // frames already being drawn are not held up by them. Draws needing a variant before then compile it on the spot.
+    std::weak_ptr<image_shaders> weak_existing = existing_shaders;
+    for (auto format : {core::pixel_format::bgra,
+                        core::pixel_format::rgba,
+                        core::pixel_format::ycbcr,
+                        core::pixel_format::ycbcra,
+                        core::pixel_format::uyvy,
+                        core::pixel_format::gbrp}) {
+        ogl->post([weak_existing, format] {
+            auto shaders = weak_existing.lock();
+            if (shaders) {
+                image_shader_key key;
+                key.pixel_format = static_cast<int>(format);
+                shaders->get(key);
+            }
+        });
+    }
 
-    return existing_shader;
+    return existing_shaders;
 }
 
 }}} // namespace caspar::accelerator::ogl
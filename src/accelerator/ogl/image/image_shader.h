@@ -23,6 +23,8 @@
 
 #include <common/memory.h>
 
+#include <memory>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 class shader;
@@ -36,9 +38,50 @@ enum class texture_id
     plane3,
     local_key,
     layer_key,
-    background
+    background,
+    transition_source,
+    transition_mask
+};
+
+// The features of a draw that are fixed at compile time in a shader variant
+struct image_shader_key
+{
+    int  pixel_format      = 0;
+    int  blend_mode        = -1; // -1 when blending is left to the fixed function blender
+    int  keyer             = 0;
+    bool is_straight_alpha = false;
+    bool has_local_key     = false;
+    bool has_layer_key     = false;
+    bool invert            = false;
+    bool levels            = false;
+    bool csb               = false;
+    bool chroma            = false;
+    int  transition        = 0;
+
+    bool operator<(const image_shader_key& other) const;
+};
+
+// The image shaders of a device: a generic one that reads every feature from its uniforms, and variants specialised
+// for one feature set each. Only used from the device thread.
+class image_shaders final
+{
+    image_shaders(const image_shaders&);
+    image_shaders& operator=(const image_shaders&);
+
+  public:
+    image_shaders();
+    ~image_shaders();
+
+    shader& generic();
+
+    // Compiles the variant on first use. Falls back to the generic shader if it fails to compile.
+    shader& get(const image_shader_key& key);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
 };
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl);
+std::shared_ptr<image_shaders> get_image_shaders(const spl::shared_ptr<device>& ogl);
 
 }}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,141 @@
+#version 450
+out vec4 fragColor;
+
+uniform sampler2D   source;
+uniform int         source_width;
+uniform int         packing;
+uniform vec3        luma_coeff;
+uniform int         transfer; // Matches core::color_transfer, -1 for a source that is not in linear light
+
+// Matches core::output_packing, and ENCODED for the image itself, only encoded with the transfer
+const int ENCODED = -1;
+const int RGB10   = 0;
+const int UYVY    = 1;
+const int V210    = 2;
+
+// The inverses of the transfer functions of shader.frag, with the reference white of each at 1.0
+const float PQ_M1     = 0.1593017578125;
+const float PQ_M2     = 78.84375;
+const float PQ_C1     = 0.8359375;
+const float PQ_C2     = 18.8515625;
+const float PQ_C3     = 18.6875;
+const float HLG_A     = 0.17883277;
+const float HLG_B     = 0.28466892;
+const float HLG_C     = 0.55991073;
+const float HLG_WHITE = 0.26496256;
+
+vec3 from_linear(vec3 c)
+{
+    c = max(c, 0.0);
+    switch(transfer)
+    {
+    case 0: // bt709
+        return pow(min(c, 1.0), vec3(1.0 / 2.4));
+    case 1: // pq
+        {
+            vec3 y = pow(min(c * (203.0 / 10000.0), 1.0), vec3(PQ_M1));
+            return pow((PQ_C1 + PQ_C2 * y) / (1.0 + PQ_C3 * y), vec3(PQ_M2));
+        }
+    case 2: // hlg
+        c = min(c * HLG_WHITE, 1.0);
+        return mix(sqrt(3.0 * c), HLG_A * log(max(12.0 * c - HLG_B, 1e-6)) + HLG_C, step(1.0 / 12.0, c));
+    }
+    return c;
+}
+
+// Linear light sources are premultiplied, and their color is encoded before it is multiplied by the alpha again
+vec4 texel_at(int x, int y)
+{
+    vec4 texel = texelFetch(source, ivec2(clamp(x, 0, source_width - 1), y), 0);
+    if (transfer < 0)
+        return texel;
+    if (texel.a <= 0.0)
+        return vec4(from_linear(texel.rgb), texel.a);
+    return vec4(from_linear(texel.rgb / texel.a) * texel.a, texel.a);
+}
+
+vec3 rgb_at(int x, int y)
+{
+    return texel_at(x, y).rgb;
+}
+
+// Limited range Y, Cb and Cr on the 8-bit scale
+vec3 ycbcr_at(int x, int y)
+{
+    vec3  rgb = rgb_at(x, y);
+    float luma = dot(rgb, luma_coeff);
+    float cb = (rgb.b - luma) / (2.0 * (1.0 - luma_coeff.b));
+    float cr = (rgb.r - luma) / (2.0 * (1.0 - luma_coeff.r));
+    return vec3(16.0 + 219.0 * luma, 128.0 + 224.0 * cb, 128.0 + 224.0 * cr);
+}
+
+// Codes 0 and 255, and 0-3 and 1020-1023, are reserved for timing references
+uint q8(float value) { return uint(clamp(round(value), 1.0, 254.0)); }
+uint q10(float value) { return uint(clamp(round(value * 4.0), 4.0, 1019.0)); }
+
+// The target is read back as BGRA, so its blue channel holds the lowest byte of the word
+vec4 word_to_texel(uint word)
+{
+    return vec4((word >> 16) & 0xFFu, (word >> 8) & 0xFFu, word & 0xFFu, word >> 24) / 255.0;
+}
+
+uint pack_rgb10(int x, int y)
+{
+    if (x >= source_width)
+        return 0u;
+
+    uvec3 c = uvec3(round(clamp(rgb_at(x, y), 0.0, 1.0) * 1023.0));
+    return c.r << 22 | c.g << 12 | c.b << 2;
+}
+
+uint pack_uyvy(int x, int y)
+{
+    vec3 a = ycbcr_at(x * 2, y);
+    vec3 b = ycbcr_at(x * 2 + 1, y);
+    vec2 c = (a.yz + b.yz) * 0.5;
+    return q8(c.x) | q8(a.x) << 8 | q8(c.y) << 16 | q8(b.x) << 24;
+}
+
+// Four words hold six pixels: Cb0 Y0 Cr0, Y1 Cb2 Y2, Cr2 Y3 Cb4, Y4 Cr4 Y5
+uint pack_v210(int x, int y)
+{
+    int word  = x % 4;
+    int pixel = x / 4 * 6;
+
+    vec3 p[6];
+    for (int n = 0; n < 6; ++n)
+        p[n] = ycbcr_at(pixel + n, y);
+
+    // Each pair of pixels shares its chroma
+    vec2 c0 = (p[0].yz + p[1].yz) * 0.5;
+    vec2 c2 = (p[2].yz + p[3].yz) * 0.5;
+    vec2 c4 = (p[4].yz + p[5].yz) * 0.5;
+
+    if (word == 0)
+        return q10(c0.x) | q10(p[0].x) << 10 | q10(c0.y) << 20;
+    if (word == 1)
+        return q10(p[1].x) | q10(c2.x) << 10 | q10(p[2].x) << 20;
+    if (word == 2)
+        return q10(c2.y) | q10(p[3].x) << 10 | q10(c4.x) << 20;
+    return q10(p[4].x) | q10(c4.y) << 10 | q10(p[5].x) << 20;
+}
+
+void main()
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+
+    if (packing == ENCODED) {
+        fragColor = texel_at(pos.x, pos.y);
+        return;
+    }
+
+    uint word = 0u;
+    if (packing == RGB10)
+        word = pack_rgb10(pos.x, pos.y);
+    else if (packing == UYVY)
+        word = pack_uyvy(pos.x, pos.y);
+    else if (packing == V210)
+        word = pack_v210(pos.x, pos.y);
+
+    fragColor = word_to_texel(word);
+}
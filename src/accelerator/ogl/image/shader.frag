@@ -7,41 +7,71 @@ uniform sampler2D	background;
 uniform sampler2D	plane[4];
 uniform sampler2D	local_key;
 uniform sampler2D	layer_key;
+uniform sampler2D	transition_source;
+uniform sampler2D	transition_mask;
 
-uniform bool        is_straight_alpha;
-
-uniform mat3		color_matrix;
-uniform vec3		luma_coeff;
-uniform bool		has_local_key;
-uniform bool		has_layer_key;
-uniform int			blend_mode;
-uniform int			keyer;
-uniform int			pixel_format;
-
-uniform bool        invert;
-uniform float		opacity;
-uniform bool		levels;
-uniform float		min_input;
-uniform float		max_input;
-uniform float		gamma;
-uniform float		min_output;
-uniform float		max_output;
-uniform float	    precision_factor[4];
-
-uniform bool		csb;
-uniform float		brt;
-uniform float		sat;
-uniform float		con;
-
-uniform bool		chroma;
-uniform bool		chroma_show_mask;
-uniform float		chroma_target_hue;
-uniform float		chroma_hue_width;
-uniform float		chroma_min_saturation;
-uniform float		chroma_min_brightness;
-uniform float		chroma_softness;
-uniform float		chroma_spill_suppress;
-uniform float		chroma_spill_suppress_saturation;
+// Per draw parameters, uploaded once per item. Laid out as std140 to match draw_block in image_kernel.cpp.
+layout(std140, binding = 0) uniform draw_block
+{
+    mat3    color_matrix;
+    vec4    precision_factor;
+    vec3    luma_coeff;
+    float   opacity;
+    float   min_input;
+    float   max_input;
+    float   gamma;
+    float   min_output;
+    float   max_output;
+    float   brt;
+    float   sat;
+    float   con;
+    float   chroma_target_hue;
+    float   chroma_hue_width;
+    float   chroma_min_saturation;
+    float   chroma_min_brightness;
+    float   chroma_softness;
+    float   chroma_spill_suppress;
+    float   chroma_spill_suppress_saturation;
+    int     blend_mode;
+    int     keyer;
+    int     pixel_format;
+    bool    is_straight_alpha;
+    bool    has_local_key;
+    bool    has_layer_key;
+    bool    invert;
+    bool    levels;
+    bool    csb;
+    bool    chroma;
+    bool    chroma_show_mask;
+    int     field;
+    int     transition;
+    int     transition_format;
+    bool    transition_straight_alpha;
+    float   transition_opacity;
+    float   transition_precision;
+    int     mask_format;
+    bool    mask_straight_alpha;
+    float   mask_precision;
+    int     target_field;
+    int     transfer;
+    int     transition_transfer;
+};
+
+// A variant defines these to constants, so that the branches on them are resolved when it is compiled. The generic
+// shader reads them from the uniform block.
+#ifndef PIXEL_FORMAT
+#define PIXEL_FORMAT        pixel_format
+#define BLEND_MODE          blend_mode
+#define KEYER               keyer
+#define IS_STRAIGHT_ALPHA   is_straight_alpha
+#define HAS_LOCAL_KEY       has_local_key
+#define HAS_LAYER_KEY       has_layer_key
+#define INVERT              invert
+#define LEVELS              levels
+#define CSB                 csb
+#define CHROMA              chroma
+#define TRANSITION          transition
+#endif
 
 /*
 ** Contrast, saturation, brightness
@@ -386,7 +416,7 @@ vec4 ChromaOnCustomColor(vec4 c)
 
 vec3 get_blend_color(vec3 back, vec3 fore)
 {
-    switch(blend_mode)
+    switch(BLEND_MODE)
     {
     case  0: return BlendNormal(back, fore);
     case  1: return BlendLighten(back, fore);
@@ -424,9 +454,9 @@ vec3 get_blend_color(vec3 back, vec3 fore)
 vec4 blend(vec4 fore)
 {
     vec4 back = texture(background, TexCoord2.st).bgra;
-    if(blend_mode != 0)
+    if(BLEND_MODE != 0)
         fore.rgb = get_blend_color(back.rgb/(back.a+0.0000001), fore.rgb/(fore.a+0.0000001))*fore.a;
-    switch(keyer)
+    switch(KEYER)
     {
         case 1:  return fore + back; // additive
         default: return fore + (1.0-fore.a)*back; // linear
@@ -450,14 +480,72 @@ vec4 ycbcra_to_rgba(float Y, float Cb, float Cr, float A)
     return vec4(color_matrix * YCbCr / 255, A).bgra;
 }
 
+// The transfer functions of core::color_transfer, from a signal to linear light with the reference white of each at
+// 1.0, which is 203 cd/m2 for pq and a signal of 0.75 for hlg
+const float PQ_M1     = 0.1593017578125;
+const float PQ_M2     = 78.84375;
+const float PQ_C1     = 0.8359375;
+const float PQ_C2     = 18.8515625;
+const float PQ_C3     = 18.6875;
+const float HLG_A     = 0.17883277;
+const float HLG_B     = 0.28466892;
+const float HLG_C     = 0.55991073;
+const float HLG_WHITE = 0.26496256;
+
+vec3 to_linear(vec3 c, int transfer)
+{
+    c = clamp(c, 0.0, 1.0);
+    switch(transfer)
+    {
+    case 0: // bt709
+        return pow(c, vec3(2.4));
+    case 1: // pq
+        {
+            vec3 p = pow(c, vec3(1.0 / PQ_M2));
+            return pow(max(p - PQ_C1, 0.0) / (PQ_C2 - PQ_C3 * p), vec3(1.0 / PQ_M1)) * (10000.0 / 203.0);
+        }
+    case 2: // hlg
+        return mix(c * c / 3.0, (exp((c - HLG_C) / HLG_A) + HLG_B) / 12.0, step(0.5, c)) / HLG_WHITE;
+    }
+    return c;
+}
+
+// Sources drawn to a linear light target are decoded with their transfer, -1 leaving those that already are as they
+// are. Read from the uniform block in every variant, as field is.
+vec4 to_linear_light(vec4 color, int transfer)
+{
+    if (transfer < 0)
+        return color;
+    if (color.a <= 0.0)
+        return vec4(to_linear(color.rgb, transfer), color.a);
+    return vec4(to_linear(color.rgb / color.a, transfer) * color.a, color.a);
+}
+
+// Interlaced frames are drawn as the field they show, 1 being the upper field and 2 the lower one, with the lines of
+// the other field interpolated from those above and below. Read from the uniform block in every variant, as it changes
+// from one frame of a source to the next.
 vec4 get_sample(sampler2D sampler, vec2 coords)
 {
-    return texture(sampler, coords);
+    if (field == 0)
+        return texture(sampler, coords);
+
+    float height = float(textureSize(sampler, 0).y);
+    float parity = float(field - 1);
+
+    // The position between the lines of the field, which lie at 2 * n + parity
+    float pos   = (coords.y * height - 0.5 - parity) * 0.5;
+    float first = floor(pos);
+    float last  = floor((height - 1.0 - parity) * 0.5);
+
+    float y0 = (2.0 * clamp(first, 0.0, last) + parity + 0.5) / height;
+    float y1 = (2.0 * clamp(first + 1.0, 0.0, last) + parity + 0.5) / height;
+
+    return mix(texture(sampler, vec2(coords.x, y0)), texture(sampler, vec2(coords.x, y1)), pos - first);
 }
 
 vec4 get_rgba_color()
 {
-    switch(pixel_format)
+    switch(PIXEL_FORMAT)
     {
     case 0:		//gray
         return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rrr * precision_factor[0], 1.0);
@@ -519,25 +607,88 @@ vec4 get_rgba_color()
     return vec4(0.0, 0.0, 0.0, 0.0);
 }
 
-void main()
+// The single plane sources of a transition, in the order get_rgba_color returns
+vec4 get_plane_color(sampler2D sampler, int format, float factor)
 {
-    vec4 color = get_rgba_color();
-    if (is_straight_alpha)
-        color.rgb *= color.a;
-    if (chroma)
+    vec4 color = get_sample(sampler, TexCoord.st / TexCoord.q) * factor;
+    switch(format)
+    {
+    case 1: return color.bgra;
+    case 2: return color.rgba;
+    case 3: return color.argb;
+    case 4: return color.gbar;
+    }
+    return vec4(0.0, 0.0, 0.0, 0.0);
+}
+
+vec4 adjust(vec4 color)
+{
+    if (CHROMA)
         color = chroma_key(color);
-    if(levels)
+    if(LEVELS)
         color.rgb = LevelsControl(color.rgb, min_input, gamma, max_input, min_output, max_output);
-    if(csb)
+    if(CSB)
         color.rgb = ContrastSaturationBrightness(color, brt, sat, con);
-    if(has_local_key)
+    return color;
+}
+
+// The mask is written to a key as the channel that ends up in red, which is blue here
+float get_transition_mask()
+{
+    vec4 key = get_plane_color(transition_mask, mask_format, mask_precision);
+    return mask_straight_alpha ? key.b * key.a : key.b;
+}
+
+// Combines the first source of a transition with the second, as the draws it replaces would have
+vec4 transition_color(vec4 color)
+{
+    if (TRANSITION == 3) // key
+        return color * get_transition_mask() * opacity;
+
+    vec4 second = get_plane_color(transition_source, transition_format, transition_precision);
+    if (transition_straight_alpha)
+        second.rgb *= second.a;
+    second = to_linear_light(second, transition_transfer);
+    second = adjust(second) * transition_opacity;
+    color *= opacity;
+
+    switch(TRANSITION)
+    {
+    case 1: // mix
+        return color + second;
+    case 2: // mask
+        {
+            float mask = get_transition_mask();
+            color  *= 1.0 - mask;
+            second *= mask;
+            return second + (1.0 - second.a) * color;
+        }
+    }
+    return color;
+}
+
+void main()
+{
+    // Draws of one field of an interlaced target only write its lines, 1 being the upper field and 2 the lower one
+    if (target_field != 0 && int(gl_FragCoord.y) % 2 != target_field - 1)
+        discard;
+
+    vec4 color = get_rgba_color();
+    if (IS_STRAIGHT_ALPHA)
+        color.rgb *= color.a;
+    color = to_linear_light(color, transfer);
+    color = adjust(color);
+    if(HAS_LOCAL_KEY)
         color *= texture(local_key, TexCoord2.st).r;
-    if(has_layer_key)
+    if(HAS_LAYER_KEY)
         color *= texture(layer_key, TexCoord2.st).r;
-    color *= opacity;
-    if (invert)
+    if (TRANSITION != 0)
+        color = transition_color(color);
+    else
+        color *= opacity;
+    if (INVERT)
         color = 1.0 - color;
-    if (blend_mode >= 0)
+    if (BLEND_MODE >= 0)
         color = blend(color);
     fragColor = color.bgra;
 }
@@ -1,14 +1,28 @@
 #version 450
-in vec4 TexCoordIn;
-in vec2 Position;
+// Fixed locations, so that every shader variant fits the same vertex array
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec4 TexCoordIn;
+
+// A rectangle per instance, as two opposite corners, of which the four vertices of a strip take the coordinates
+layout(location = 2) in vec4 QuadPosition;
+layout(location = 3) in vec4 QuadTexCoord;
+layout(location = 4) in vec2 QuadTexCoordRQ;
+
+uniform bool quad;
 
 out vec4 TexCoord;
 out vec4 TexCoord2;
 
 void main()
 {
+    vec2 position = Position;
     TexCoord = TexCoordIn;
-    vec4 pos = vec4(Position, 0, 1);
+    if (quad) {
+        vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+        position = mix(QuadPosition.xy, QuadPosition.zw, corner);
+        TexCoord = vec4(mix(QuadTexCoord.xy, QuadTexCoord.zw, corner), QuadTexCoordRQ);
+    }
+    vec4 pos = vec4(position, 0, 1);
     TexCoord2 = vec4(pos.xy, 0.0, 0.0);
     pos.x = pos.x*2.0 - 1.0;
     pos.y = pos.y*2.0 - 1.0;
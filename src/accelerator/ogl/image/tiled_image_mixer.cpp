@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tiled_image_mixer.h"
+
+#include <common/except.h>
+#include <common/task_arena.h>
+
+#include <core/frame/frame_transform.h>
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+// Columns start on multiples of the pixels that v210 packs into 48 and rgb10 into 64, so that the padded rows of the
+// packed tiles join into the padded rows of the channel
+const int COLUMN_ALIGNMENT = 192;
+
+// Rows start on even lines, for the lines of each field of a tile to be those of the field of the channel
+const int ROW_ALIGNMENT = 2;
+
+// Where count parts of size start, on multiples of alignment, followed by size. Parts are left empty rather than made
+// smaller than alignment.
+std::vector<int> split(int size, int count, int alignment)
+{
+    std::vector<int> bounds(count + 1, size);
+    bounds[0] = 0;
+    for (int n = 1; n < count; ++n) {
+        auto bound = static_cast<int>(std::lround(static_cast<double>(size) * n / count / alignment)) * alignment;
+        bounds[n]  = std::min(std::max(bound, bounds[n - 1] + alignment), size);
+    }
+    return bounds;
+}
+
+// The bounds of parts of from scaled to a size of to
+std::vector<int> scale(const std::vector<int>& bounds, int from, int to)
+{
+    std::vector<int> result;
+    for (auto bound : bounds) {
+        result.push_back(static_cast<int>(std::lround(static_cast<double>(bound) * to / from)));
+    }
+    return result;
+}
+
+std::vector<int> sizes(const std::vector<int>& bounds)
+{
+    std::vector<int> result;
+    for (std::size_t n = 1; n < bounds.size(); ++n) {
+        result.push_back(bounds[n] - bounds[n - 1]);
+    }
+    return result;
+}
+
+using buffers = std::vector<array<const std::uint8_t>>;
+
+// Lays the lines of the buffer at index of each tile side by side, and the rows of tiles one below the other. Tiles
+// that were not rendered, having no area, are left out. The result is empty if the buffer of any tile is, as the image
+// is when only packings were asked for.
+array<const std::uint8_t>
+join(const std::vector<buffers>& tiles, std::size_t index, const std::vector<int>& heights, int columns)
+{
+    const auto rows = static_cast<int>(heights.size());
+
+    std::vector<std::size_t> pitches(tiles.size());  // Bytes per line of each tile
+    std::vector<std::size_t> row_pitches(rows);      // Bytes per line of each row of tiles
+    std::vector<int>         first_lines(rows + 1);  // Line each row of tiles starts on
+    for (int row = 0; row < rows; ++row) {
+        first_lines[row + 1] = first_lines[row] + heights[row];
+        for (int column = 0; column < columns; ++column) {
+            const auto& tile = tiles[row * columns + column];
+            if (tile.empty()) {
+                continue;
+            }
+            if (tile.at(index).size() == 0) {
+                return {};
+            }
+            pitches[row * columns + column] = tile.at(index).size() / heights[row];
+            row_pitches[row] += pitches[row * columns + column];
+        }
+    }
+
+    std::vector<std::size_t> offsets(rows + 1); // Byte each row of tiles starts on
+    for (int row = 0; row < rows; ++row) {
+        offsets[row + 1] = offsets[row] + row_pitches[row] * heights[row];
+    }
+    if (offsets[rows] == 0) {
+        return {};
+    }
+
+    array<std::uint8_t> result(offsets[rows]);
+    run_in_arena(task_kind::realtime, [&] {
+        tbb::parallel_for(0, first_lines[rows], [&](int line) {
+            const auto row = static_cast<int>(std::upper_bound(first_lines.begin(), first_lines.end(), line) -
+                                              first_lines.begin()) -
+                             1;
+            const auto tile_line = static_cast<std::size_t>(line - first_lines[row]);
+
+            auto dest = result.data() + offsets[row] + tile_line * row_pitches[row];
+            for (int column = 0; column < columns; ++column) {
+                const auto  n    = row * columns + column;
+                const auto& tile = tiles[n];
+                if (tile.empty()) {
+                    continue;
+                }
+                std::memcpy(dest, tile.at(index).data() + tile_line * pitches[n], pitches[n]);
+                dest += pitches[n];
+            }
+        });
+    });
+    return std::move(result);
+}
+
+} // namespace
+
+struct tiled_image_mixer::impl
+{
+    struct visit_op
+    {
+        enum class kind
+        {
+            push,
+            visit,
+            pop
+        };
+
+        kind                  type;
+        core::frame_transform transform;
+        core::const_frame     frame;
+    };
+
+    std::vector<std::unique_ptr<ogl::image_mixer>> mixers_;
+    const int                                      columns_;
+    const int                                      rows_;
+
+    // What to draw is only known to fit a tile once the format of the render is, so visits are replayed to the tiles
+    std::vector<visit_op> visits_;
+
+    // Of the last render
+    std::vector<bool>              rendered_;
+    std::vector<core::damage_rect> damage_;
+
+    impl(std::vector<std::unique_ptr<ogl::image_mixer>> mixers, int columns, int rows)
+        : mixers_(std::move(mixers))
+        , columns_(columns)
+        , rows_(rows)
+        , rendered_(mixers_.size())
+    {
+        if (mixers_.empty() || static_cast<int>(mixers_.size()) != columns * rows) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("tiled_image_mixer: One mixer per tile is needed"));
+        }
+    }
+
+    void update_aspect_ratio(double aspect_ratio)
+    {
+        for (auto& mixer : mixers_) {
+            mixer->update_aspect_ratio(aspect_ratio);
+        }
+    }
+
+    void push(const core::frame_transform& transform)
+    {
+        visits_.push_back(visit_op{visit_op::kind::push, transform, {}});
+    }
+
+    void visit(const core::const_frame& frame)
+    {
+        visits_.push_back(visit_op{visit_op::kind::visit, {}, frame});
+    }
+
+    void pop() { visits_.push_back(visit_op{visit_op::kind::pop, {}, {}}); }
+
+    std::future<buffers>
+    render(const core::video_format_desc& format_desc, const core::output_request& request, core::video_field field)
+    {
+        const auto xs = split(format_desc.width, columns_, COLUMN_ALIGNMENT);
+        const auto ys = split(format_desc.height, rows_, ROW_ALIGNMENT);
+
+        // The tiles are joined on the host, so the image of a tile is kept there rather than on its device
+        auto tile_request    = request;
+        tile_request.image   = request.image || request.texture;
+        tile_request.texture = false;
+
+        // The lines of each row of tiles in every buffer: the image, its packings and the sizes it is scaled to
+        std::vector<std::vector<int>> heights(1 + request.packings.size(), sizes(ys));
+        std::vector<std::vector<int>> size_xs;
+        std::vector<std::vector<int>> size_ys;
+        for (auto& size : request.sizes) {
+            size_xs.push_back(scale(xs, format_desc.width, size.width));
+            size_ys.push_back(scale(ys, format_desc.height, size.height));
+            heights.push_back(sizes(size_ys.back()));
+        }
+
+        std::vector<std::future<buffers>> renders(mixers_.size());
+        auto                              visits = std::move(visits_);
+        visits_.clear();
+
+        run_in_arena(task_kind::realtime, [&] {
+            tbb::parallel_for(0, static_cast<int>(mixers_.size()), [&](int n) {
+                const auto column = n % columns_;
+                const auto row    = n / columns_;
+
+                rendered_[n] = xs[column + 1] > xs[column] && ys[row + 1] > ys[row];
+                if (!rendered_[n]) {
+                    return;
+                }
+
+                auto& mixer = *mixers_[n];
+                mixer.set_tile(static_cast<double>(xs[column]) / format_desc.width,
+                               static_cast<double>(ys[row]) / format_desc.height,
+                               static_cast<double>(xs[column + 1]) / format_desc.width,
+                               static_cast<double>(ys[row + 1]) / format_desc.height);
+
+                for (auto& visit : visits) {
+                    switch (visit.type) {
+                        case visit_op::kind::push:
+                            mixer.push(visit.transform);
+                            break;
+                        case visit_op::kind::visit:
+                            mixer.visit(visit.frame);
+                            break;
+                        case visit_op::kind::pop:
+                            mixer.pop();
+                            break;
+                    }
+                }
+
+                // The format keeps the square size of the channel, see image_mixer::set_tile
+                auto tile_desc   = format_desc;
+                tile_desc.width  = xs[column + 1] - xs[column];
+                tile_desc.height = ys[row + 1] - ys[row];
+                tile_desc.size   = static_cast<std::size_t>(tile_desc.width) * tile_desc.height * 4;
+
+                auto request = tile_request;
+                for (std::size_t s = 0; s < request.sizes.size(); ++s) {
+                    request.sizes[s].width  = size_xs[s][column + 1] - size_xs[s][column];
+                    request.sizes[s].height = size_ys[s][row + 1] - size_ys[s][row];
+                }
+
+                renders[n] = mixer.render(tile_desc, request, field);
+            });
+        });
+
+        damage_ = join_damage(xs, ys);
+
+        return std::async(std::launch::deferred,
+                          [renders = std::move(renders), heights = std::move(heights), columns = columns_]() mutable {
+                              std::vector<buffers> tiles;
+                              for (auto& render : renders) {
+                                  tiles.push_back(render.valid() ? render.get() : buffers{});
+                              }
+
+                              buffers result;
+                              for (std::size_t index = 0; index < heights.size(); ++index) {
+                                  result.push_back(join(tiles, index, heights[index], columns));
+                              }
+                              return result;
+                          });
+    }
+
+    std::vector<core::damage_rect> join_damage(const std::vector<int>& xs, const std::vector<int>& ys) const
+    {
+        std::vector<core::damage_rect> result;
+        for (std::size_t n = 0; n < mixers_.size(); ++n) {
+            if (!rendered_[n]) {
+                continue;
+            }
+
+            auto damage = mixers_[n]->damage();
+            if (damage.empty()) {
+                return {};
+            }
+
+            for (auto rect : damage) {
+                if (rect.width > 0 && rect.height > 0) {
+                    rect.x += xs[n % columns_];
+                    rect.y += ys[n / columns_];
+                    result.push_back(rect);
+                }
+            }
+        }
+
+        // Nothing changed, as opposed to everything
+        if (result.empty()) {
+            result.push_back(core::damage_rect{});
+        }
+        return result;
+    }
+
+    core::mutable_frame update_frame(const void*                      tag,
+                                     const core::pixel_format_desc&   desc,
+                                     const array<const std::uint8_t>& image)
+    {
+        // Each tile draws the frame from a device of its own, so the frame is a new one with the whole image on the
+        // host rather than an update of the texture on one of them
+        auto frame = mixers_.front()->create_frame(tag, desc);
+        auto& data = frame.image_data(0);
+        std::memcpy(data.data(), image.data(), std::min(data.size(), image.size()));
+        return frame;
+    }
+
+    std::map<std::string, double> gpu_times() const
+    {
+        // The tiles of a device are drawn one after the other and the devices at the same time
+        std::map<const void*, std::map<std::string, double>> devices;
+        for (auto& mixer : mixers_) {
+            auto& times = devices[mixer->frame_scope()];
+            for (auto& [pass, time] : mixer->gpu_times()) {
+                times[pass] += time;
+            }
+        }
+
+        std::map<std::string, double> result;
+        for (auto& [device, times] : devices) {
+            for (auto& [pass, time] : times) {
+                result[pass] = std::max(result[pass], time);
+            }
+        }
+        return result;
+    }
+
+    int visited_items() const
+    {
+        int result = 0;
+        for (auto& mixer : mixers_) {
+            result += mixer->visited_items();
+        }
+        return result;
+    }
+
+    int culled_items() const
+    {
+        int result = 0;
+        for (auto& mixer : mixers_) {
+            result += mixer->culled_items();
+        }
+        return result;
+    }
+};
+
+tiled_image_mixer::tiled_image_mixer(std::vector<std::unique_ptr<ogl::image_mixer>> mixers, int columns, int rows)
+    : impl_(std::make_unique<impl>(std::move(mixers), columns, rows))
+{
+}
+tiled_image_mixer::~tiled_image_mixer() {}
+void tiled_image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
+void tiled_image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
+void tiled_image_mixer::pop() { impl_->pop(); }
+void tiled_image_mixer::update_aspect_ratio(double aspect_ratio) { impl_->update_aspect_ratio(aspect_ratio); }
+std::future<std::vector<array<const std::uint8_t>>>
+tiled_image_mixer::render(const core::video_format_desc& format_desc,
+                          const core::output_request&    request,
+                          core::video_field              field)
+{
+    return impl_->render(format_desc, request, field);
+}
+std::any tiled_image_mixer::rendered() const { return {}; }
+std::function<array<const std::uint8_t>()> tiled_image_mixer::readback() const { return nullptr; }
+
+// Frames are created on the device of the first tile, and uploaded from the host by the others
+core::mutable_frame tiled_image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
+{
+    return impl_->mixers_.front()->create_frame(tag, desc);
+}
+core::mutable_frame
+tiled_image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc, common::bit_depth depth)
+{
+    return impl_->mixers_.front()->create_frame(tag, desc, depth);
+}
+
+bool                tiled_image_mixer::supports_shared_textures() const { return false; }
+core::mutable_frame tiled_image_mixer::import_frame(const void* tag, const core::shared_texture& texture)
+{
+    CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Shared textures are not supported by tiled channels"));
+}
+core::mutable_frame tiled_image_mixer::update_frame(const void*                      tag,
+                                                    const core::const_frame&         previous,
+                                                    const core::pixel_format_desc&   desc,
+                                                    const array<const std::uint8_t>& image,
+                                                    const std::vector<core::damage_rect>&)
+{
+    return impl_->update_frame(tag, desc, image);
+}
+
+common::bit_depth              tiled_image_mixer::depth() const { return impl_->mixers_.front()->depth(); }
+core::color_transfer           tiled_image_mixer::transfer() const { return impl_->mixers_.front()->transfer(); }
+int                            tiled_image_mixer::visited_items() const { return impl_->visited_items(); }
+int                            tiled_image_mixer::culled_items() const { return impl_->culled_items(); }
+std::vector<core::damage_rect> tiled_image_mixer::damage() const { return impl_->damage_; }
+std::map<std::string, double>  tiled_image_mixer::gpu_times() const { return impl_->gpu_times(); }
+
+}}} // namespace caspar::accelerator::ogl
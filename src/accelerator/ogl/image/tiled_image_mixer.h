@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "image_mixer.h"
+
+#include <common/array.h>
+#include <common/bit_depth.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/video_format.h>
+
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Mixes a channel as a grid of tiles, each drawn by an image mixer of its own, on whichever device it was created for,
+// and joins the tiles into the buffers of one render. Columns start on multiples of 192 pixels, for the rows of every
+// packing to join, and rows on even lines, for fields to keep their lines.
+class tiled_image_mixer final : public core::image_mixer
+{
+  public:
+    // The mixers of the tiles row by row from the top, each from the left
+    tiled_image_mixer(std::vector<std::unique_ptr<ogl::image_mixer>> mixers, int columns, int rows);
+    tiled_image_mixer(const tiled_image_mixer&) = delete;
+
+    ~tiled_image_mixer();
+
+    tiled_image_mixer& operator=(const tiled_image_mixer&) = delete;
+
+    std::future<std::vector<array<const std::uint8_t>>> render(const core::video_format_desc& format_desc,
+                                                               const core::output_request&    request,
+                                                               core::video_field              field) override;
+    std::any            rendered() const override;
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    core::mutable_frame
+    create_frame(const void* video_stream_tag, const core::pixel_format_desc& desc, common::bit_depth depth) override;
+    bool                supports_shared_textures() const override;
+    core::mutable_frame import_frame(const void* video_stream_tag, const core::shared_texture& texture) override;
+    core::mutable_frame update_frame(const void*                           video_stream_tag,
+                                     const core::const_frame&              previous,
+                                     const core::pixel_format_desc&        desc,
+                                     const array<const std::uint8_t>&      image,
+                                     const std::vector<core::damage_rect>& damage) override;
+
+    std::function<array<const std::uint8_t>()> readback() const override;
+
+    void update_aspect_ratio(double aspect_ratio) override;
+
+    // core::image_mixer
+
+    void                 push(const core::frame_transform& frame) override;
+    void                 visit(const core::const_frame& frame) override;
+    void                 pop() override;
+    common::bit_depth    depth() const override;
+    core::color_transfer transfer() const override;
+    int                  visited_items() const override;
+    int                  culled_items() const override;
+
+    std::vector<core::damage_rect> damage() const override;
+    std::map<std::string, double>  gpu_times() const override;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <core/frame/frame_factory.h>
+
+#include <functional>
 #include <memory>
 
 namespace caspar::accelerator::ogl {
@@ -8,6 +11,8 @@ class device_context final
 {
   public:
     device_context();
+    // Creates a context that shares objects such as buffers and sync objects with share, for use on another thread
+    explicit device_context(device_context& share);
     ~device_context();
 
     device_context(const device_context&) = delete;
@@ -17,6 +22,16 @@ class device_context final
     void bind();
     void unbind();
 
+    // Whether the contexts of the device share their objects with the GL contexts of windows in the process, so that
+    // those can draw its textures
+    static bool shares_with_windows();
+
+    // Whether import_texture is supported by the platform and driver, to be called with the context bound
+    bool supports_shared_textures();
+    // Imports a texture that another graphics API shares with this process and calls func with its id, for as long as
+    // it is valid. Returns false when it cannot be imported.
+    bool import_texture(const core::shared_texture& source, const std::function<void(unsigned int)>& func);
+
   private:
     struct impl;
     std::shared_ptr<impl> impl_;
@@ -4,17 +4,29 @@
 #include <common/gl/gl_check.h>
 #include <common/log.h>
 
+#include <GL/glew.h>
+
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
 
 namespace caspar::accelerator::ogl {
 
 struct device_context::impl
 {
     EGLDisplay eglDisplay_;
+    EGLConfig  eglConfig_;
     EGLContext eglContext_;
 
+    // Set on shared contexts, which keep the display of the context they share with alive
+    std::shared_ptr<impl> share_;
+
     impl()
         : eglDisplay_(EGL_NO_DISPLAY)
+        , eglConfig_(nullptr)
         , eglContext_(EGL_NO_CONTEXT)
     {
         CASPAR_LOG(info) << L"Initializing OpenGL Device.";
@@ -36,9 +48,8 @@ struct device_context::impl
                                         EGL_OPENGL_BIT,
                                         EGL_NONE};
 
-        EGLint    numConfigs;
-        EGLConfig eglConfig;
-        if (!eglChooseConfig(eglDisplay_, configAttribs, &eglConfig, 1, &numConfigs)) {
+        EGLint numConfigs;
+        if (!eglChooseConfig(eglDisplay_, configAttribs, &eglConfig_, 1, &numConfigs)) {
             CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize OpenGL: eglChooseConfig"));
         }
 
@@ -46,7 +57,7 @@ struct device_context::impl
             CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize OpenGL: eglBindAPI"));
         }
 
-        eglContext_ = eglCreateContext(eglDisplay_, eglConfig, EGL_NO_CONTEXT, NULL);
+        eglContext_ = eglCreateContext(eglDisplay_, eglConfig_, EGL_NO_CONTEXT, NULL);
         if (eglContext_ == EGL_NO_CONTEXT) {
             CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize OpenGL: eglCreateContext"));
         }
@@ -56,6 +67,19 @@ struct device_context::impl
         }
     }
 
+    explicit impl(const std::shared_ptr<impl>& share)
+        : eglDisplay_(share->eglDisplay_)
+        , eglConfig_(share->eglConfig_)
+        , eglContext_(EGL_NO_CONTEXT)
+        , share_(share)
+    {
+        eglContext_ = eglCreateContext(eglDisplay_, eglConfig_, share->eglContext_, NULL);
+        if (eglContext_ == EGL_NO_CONTEXT) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception()
+                                   << msg_info("Failed to initialize shared OpenGL context: eglCreateContext"));
+        }
+    }
+
     ~impl()
     {
         eglMakeCurrent(eglDisplay_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
@@ -64,7 +88,9 @@ struct device_context::impl
             eglDestroyContext(eglDisplay_, eglContext_);
         }
 
-        eglTerminate(eglDisplay_);
+        if (!share_) {
+            eglTerminate(eglDisplay_);
+        }
     }
 };
 
@@ -72,8 +98,132 @@ device_context::device_context()
     : impl_(new impl())
 {
 }
+device_context::device_context(device_context& share)
+    : impl_(new impl(share.impl_))
+{
+}
 device_context::~device_context() {}
 
+namespace {
+
+const EGLint drm_format_argb8888 = 0x34325241; // DRM_FORMAT_ARGB8888, i.e. BGRA in memory
+
+const std::uint64_t drm_format_mod_invalid = 0x00ffffffffffffffULL;
+
+using image_target_texture_t = void (*)(GLenum target, void* image);
+
+struct dma_buf_import
+{
+    PFNEGLCREATEIMAGEKHRPROC  create_image  = nullptr;
+    PFNEGLDESTROYIMAGEKHRPROC destroy_image = nullptr;
+    image_target_texture_t    image_target  = nullptr;
+};
+
+dma_buf_import get_dma_buf_import(EGLDisplay display)
+{
+    dma_buf_import import;
+
+    auto extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !std::strstr(extensions, "EGL_EXT_image_dma_buf_import")) {
+        return import;
+    }
+
+    import.create_image  = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(eglGetProcAddress("eglCreateImageKHR"));
+    import.destroy_image = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(eglGetProcAddress("eglDestroyImageKHR"));
+    import.image_target  = reinterpret_cast<image_target_texture_t>(eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+    return import;
+}
+
+} // namespace
+
+// The contexts of windows are created through GLX, which cannot share with those of EGL
+bool device_context::shares_with_windows() { return false; }
+
+bool device_context::supports_shared_textures()
+{
+    auto import = get_dma_buf_import(impl_->eglDisplay_);
+    return import.create_image && import.destroy_image && import.image_target;
+}
+
+bool device_context::import_texture(const core::shared_texture&                source,
+                                    const std::function<void(unsigned int)>& func)
+{
+    static const auto import = get_dma_buf_import(impl_->eglDisplay_);
+    if (!import.create_image || !import.destroy_image || !import.image_target || source.planes.empty() ||
+        source.planes.size() > 4) {
+        return false;
+    }
+
+    static const EGLint plane_attributes[4][5] = {
+        {EGL_DMA_BUF_PLANE0_FD_EXT,
+         EGL_DMA_BUF_PLANE0_OFFSET_EXT,
+         EGL_DMA_BUF_PLANE0_PITCH_EXT,
+         EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT,
+         EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT},
+        {EGL_DMA_BUF_PLANE1_FD_EXT,
+         EGL_DMA_BUF_PLANE1_OFFSET_EXT,
+         EGL_DMA_BUF_PLANE1_PITCH_EXT,
+         EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT,
+         EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT},
+        {EGL_DMA_BUF_PLANE2_FD_EXT,
+         EGL_DMA_BUF_PLANE2_OFFSET_EXT,
+         EGL_DMA_BUF_PLANE2_PITCH_EXT,
+         EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT,
+         EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT},
+        {EGL_DMA_BUF_PLANE3_FD_EXT,
+         EGL_DMA_BUF_PLANE3_OFFSET_EXT,
+         EGL_DMA_BUF_PLANE3_PITCH_EXT,
+         EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT,
+         EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT},
+    };
+
+    std::vector<EGLint> attributes{
+        EGL_WIDTH, source.width, EGL_HEIGHT, source.height, EGL_LINUX_DRM_FOURCC_EXT, drm_format_argb8888};
+    for (size_t n = 0; n < source.planes.size(); ++n) {
+        auto& plane = source.planes[n];
+        attributes.insert(attributes.end(),
+                          {plane_attributes[n][0],
+                           plane.fd,
+                           plane_attributes[n][1],
+                           static_cast<EGLint>(plane.offset),
+                           plane_attributes[n][2],
+                           static_cast<EGLint>(plane.stride)});
+        if (source.modifier != drm_format_mod_invalid) {
+            attributes.insert(attributes.end(),
+                              {plane_attributes[n][3],
+                               static_cast<EGLint>(source.modifier & 0xffffffff),
+                               plane_attributes[n][4],
+                               static_cast<EGLint>(source.modifier >> 32)});
+        }
+    }
+    attributes.push_back(EGL_NONE);
+
+    auto image =
+        import.create_image(impl_->eglDisplay_, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attributes.data());
+    if (image == EGL_NO_IMAGE_KHR) {
+        return false;
+    }
+
+    // Errors are checked for once the texture is imported, so none may be left over
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    GLuint id = 0;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    import.image_target(GL_TEXTURE_2D, image);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    auto imported = glGetError() == GL_NO_ERROR;
+    if (imported) {
+        func(id);
+    }
+
+    glDeleteTextures(1, &id);
+    import.destroy_image(impl_->eglDisplay_, image);
+    return imported;
+}
+
 void device_context::bind() { eglMakeCurrent(impl_->eglDisplay_, EGL_NO_SURFACE, EGL_NO_SURFACE, impl_->eglContext_); }
 void device_context::unbind() { eglMakeCurrent(impl_->eglDisplay_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT); }
 
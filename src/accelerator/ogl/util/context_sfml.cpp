@@ -3,6 +3,8 @@
 
 #include <common/log.h>
 
+#include <GL/glew.h>
+
 #include <SFML/Window/Context.hpp>
 
 namespace caspar::accelerator::ogl {
@@ -16,14 +18,68 @@ struct device_context::impl
     {
         CASPAR_LOG(info) << L"Initializing OpenGL Device.";
     }
+
+    // SFML contexts always share their objects with each other
+    explicit impl(impl&)
+        : device_(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1)
+    {
+        device_.setActive(false);
+    }
 };
 
 device_context::device_context()
     : impl_(new impl())
 {
 }
+device_context::device_context(device_context& share)
+    : impl_(new impl(*share.impl_))
+{
+}
 device_context::~device_context() {}
 
+bool device_context::shares_with_windows() { return true; }
+
+bool device_context::supports_shared_textures()
+{
+    return GLEW_EXT_memory_object && GLEW_EXT_memory_object_win32;
+}
+
+bool device_context::import_texture(const core::shared_texture&                source,
+                                    const std::function<void(unsigned int)>& func)
+{
+    if (!source.handle || !supports_shared_textures()) {
+        return false;
+    }
+
+    // Errors are checked for once the texture is imported, so none may be left over
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    GLuint memory = 0;
+    glCreateMemoryObjectsEXT(1, &memory);
+
+    // D3D11 textures are dedicated allocations, which the import has to be told
+    GLint dedicated = GL_TRUE;
+    glMemoryObjectParameterivEXT(memory, GL_DEDICATED_MEMORY_OBJECT_EXT, &dedicated);
+    glImportMemoryWin32HandleEXT(memory,
+                                 static_cast<GLuint64>(source.width) * source.height * 4,
+                                 GL_HANDLE_TYPE_D3D11_IMAGE_EXT,
+                                 source.handle);
+
+    GLuint id = 0;
+    glCreateTextures(GL_TEXTURE_2D, 1, &id);
+    glTextureStorageMem2DEXT(id, 1, GL_RGBA8, source.width, source.height, memory, 0);
+
+    auto imported = glGetError() == GL_NO_ERROR;
+    if (imported) {
+        func(id);
+    }
+
+    glDeleteTextures(1, &id);
+    glDeleteMemoryObjectsEXT(1, &memory);
+    return imported;
+}
+
 void device_context::bind() { impl_->device_.setActive(true); }
 void device_context::unbind() { impl_->device_.setActive(false); }
 
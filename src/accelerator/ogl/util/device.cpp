@@ -30,7 +30,9 @@
 #include <common/env.h>
 #include <common/except.h>
 #include <common/gl/gl_check.h>
+#include <common/memory_governor.h>
 #include <common/os/thread.h>
+#include <common/task_arena.h>
 
 #include <GL/glew.h>
 
@@ -38,17 +40,32 @@
 #include <GL/wglew.h>
 #endif
 
-#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/spawn.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
 
+#include <tbb/blocked_range.h>
 #include <tbb/concurrent_queue.h>
 #include <tbb/concurrent_unordered_map.h>
+#include <tbb/parallel_for.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <future>
+#include <map>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -56,25 +73,124 @@ using namespace boost::asio;
 
 struct device::impl : public std::enable_shared_from_this<impl>
 {
-    using texture_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<texture>>;
-    using buffer_queue_t  = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
+    // Idle resources of one size class, with counts of allocations served from the pool and of those that missed
+    template <typename T>
+    struct resource_pool
+    {
+        tbb::concurrent_bounded_queue<std::shared_ptr<T>> idle;
+        std::atomic<uint64_t>                             hits{0};
+        std::atomic<uint64_t>                             misses{0};
+        std::atomic<int64_t>                              last_used{0};
+        std::atomic<int>                                  in_use{0};
+        std::atomic<int>                                  peak{0};    // Most resources in use at once
+        int                                               warmed = 0; // Allocated at startup from the pool profile
+    };
+
+    using texture_pool_t = resource_pool<texture>;
+    using buffer_pool_t  = resource_pool<buffer>;
+
+    // Pools that have not been used for this long are released
+    static constexpr int64_t pool_idle_timeout_ms = 30000;
+
+    // Pools allocated from the profile are kept this long before the idle timeout applies, so that they are still
+    // there when the rundown gets to the clips that need them
+    static constexpr int64_t pool_warm_grace_ms = 300000;
+
+    const int index_;
 
     std::unique_ptr<device_context> context_;
 
-    std::array<std::array<tbb::concurrent_unordered_map<size_t, texture_queue_t>, 4>, 2> device_pools_;
-    std::array<tbb::concurrent_unordered_map<size_t, buffer_queue_t>, 2>                 host_pools_;
+    // Textures are pooled on their exact dimensions, since they are sampled as such, by 8-bit, 16-bit and half float
+    // depth, with mipmapped ones in the pools after the four strides, followed by bc1 and bc3 ones. Host buffers are
+    // pooled on size classes, so buffers of nearby sizes are shared.
+    std::array<std::array<tbb::concurrent_unordered_map<size_t, texture_pool_t>, 10>, 3> device_pools_;
+    std::array<tbb::concurrent_unordered_map<size_t, buffer_pool_t>, 2>                 host_pools_;
+
+    // Bytes held by idle pooled resources, and the budgets trimming keeps them under (0 is unlimited)
+    std::atomic<int64_t> pooled_device_bytes_{0};
+    std::atomic<int64_t> pooled_host_bytes_{0};
+    const int64_t        device_pool_budget_;
+    const int64_t        host_pool_budget_;
 
     GLuint fbo_;
 
     std::wstring version_;
+    bool         shared_textures_ = false;
 
     io_context                          service_;
     decltype(make_work_guard(service_)) work_;
     std::thread                         thread_;
 
-    impl()
-        : context_(new device_context())
+    steady_timer trim_timer_;
+    bool         trimming_ = true;
+
+    // Idle pooled bytes, which the memory governor has trimmed back to the least recently used first
+    std::unique_ptr<memory_account> device_pool_account_;
+    std::unique_ptr<memory_account> host_pool_account_;
+
+    struct pending_readback
+    {
+        std::shared_ptr<texture>              source; // Until it is issued
+        readback_options                      options;
+        GLsync                                fence = nullptr;
+        std::shared_ptr<buffer>               buf;
+        std::promise<array<const uint8_t>>    promise;
+        std::chrono::steady_clock::time_point requested;
+        int                                   size = 0;
+    };
+
+    // Requested and not yet issued, only used on the device thread
+    std::vector<std::shared_ptr<pending_readback>> readback_batch_;
+
+    // Readbacks are completed by a thread with its own shared context, which blocks on each fence in turn so that
+    // a future is ready as soon as the GPU has finished, without waking the device thread
+    std::unique_ptr<device_context>                                  fence_context_;
+    tbb::concurrent_bounded_queue<std::shared_ptr<pending_readback>> fence_queue_;
+    std::thread                                                      fence_thread_;
+
+    // Uploads are done by a thread with its own shared context, so that transferring a large frame does not hold up
+    // drawing. Each texture carries a fence that the device thread waits on the GPU before using it.
+    std::unique_ptr<device_context>                      upload_context_;
+    tbb::concurrent_bounded_queue<std::function<void()>> upload_queue_;
+    std::thread                                          upload_thread_;
+
+    // Counts of readbacks completing within 1, 2, 4, 8 and 16 ms of being requested, and the rest
+    std::array<std::atomic<uint64_t>, 6> readback_latency_{};
+
+    struct channel_readbacks
+    {
+        std::array<uint64_t, 6> latency{}; // As readback_latency_
+        uint64_t                count = 0;
+        double                  total = 0.0; // In ms
+        double                  last  = 0.0;
+    };
+    mutable std::mutex               channel_readbacks_mutex_;
+    std::map<int, channel_readbacks> channel_readbacks_;
+
+    struct cached_texture
+    {
+        weak_array_owner                             owner;
+        size_t                                       size;
+        int                                          width;
+        int                                          height;
+        int                                          stride;
+        common::bit_depth                            depth;
+        core::pixel_format                           format; // Of a block compressed upload, invalid otherwise
+        std::shared_future<std::shared_ptr<texture>> future;
+    };
+
+    // Uploads keyed on the source buffer. An entry is dropped once every copy of its buffer has been released.
+    std::mutex                                         texture_cache_mutex_;
+    std::unordered_map<const uint8_t*, cached_texture> texture_cache_;
+    size_t                                             texture_cache_sweep_ = 64;
+
+    explicit impl(int index)
+        : index_(index)
+        , context_(new device_context())
+        , device_pool_budget_(env::properties().get(L"configuration.accelerator.device-pool-budget", 0) * 1024LL * 1024LL)
+        , host_pool_budget_(env::properties().get(L"configuration.accelerator.host-pool-budget", 0) * 1024LL * 1024LL)
         , work_(make_work_guard(service_))
+        , trim_timer_(service_)
     {
         CASPAR_LOG(info) << L"Initializing OpenGL Device.";
 
@@ -108,21 +224,99 @@ struct device::impl : public std::enable_shared_from_this<impl>
         GL(glCreateFramebuffers(1, &fbo_));
         GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo_));
 
+        shared_textures_ = context_->supports_shared_textures();
+
         context_->unbind();
 
+        fence_context_  = std::make_unique<device_context>(*context_);
+        upload_context_ = std::make_unique<device_context>(*context_);
+
+        schedule_trim();
+
+        // Ahead of any work of the channels, which is queued behind it
+        boost::asio::post(service_, [this] {
+            try {
+                warm_pools();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+
+        device_pool_account_ = std::make_unique<memory_account>(
+            "gl-device-pools",
+            memory_reclaim::pool,
+            [this] { return pooled_device_bytes_.load(); },
+            [this](int64_t bytes) { release(bytes, 0); });
+        host_pool_account_ = std::make_unique<memory_account>(
+            "gl-host-pools",
+            memory_reclaim::pool,
+            [this] { return pooled_host_bytes_.load(); },
+            [this](int64_t bytes) { release(0, bytes); });
+
         thread_ = std::thread([&] {
             context_->bind();
             set_thread_name(L"OpenGL Device");
             service_.run();
             context_->unbind();
         });
+
+        fence_thread_ = std::thread([&] {
+            fence_context_->bind();
+            set_thread_name(L"OpenGL Readback");
+            while (true) {
+                std::shared_ptr<pending_readback> readback;
+                fence_queue_.pop(readback);
+                if (!readback) {
+                    break;
+                }
+                complete_readback(*readback);
+            }
+            fence_context_->unbind();
+        });
+
+        upload_thread_ = std::thread([&] {
+            upload_context_->bind();
+            set_thread_name(L"OpenGL Upload");
+            while (true) {
+                std::function<void()> task;
+                upload_queue_.pop(task);
+                if (!task) {
+                    break;
+                }
+                task();
+            }
+            upload_context_->unbind();
+        });
     }
 
     ~impl()
     {
+        device_pool_account_.reset();
+        host_pool_account_.reset();
+
+        // Stopped first, since the textures it releases are returned through the device thread
+        upload_queue_.push(nullptr);
+        upload_thread_.join();
+        upload_context_.reset();
+
+        boost::asio::post(service_, [this] {
+            trimming_ = false;
+            trim_timer_.cancel();
+        });
         work_.reset();
         thread_.join();
 
+        try {
+            save_pool_profile();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+
+        // Every readback issued by the device thread is queued before this, so they all complete first
+        fence_queue_.push(nullptr);
+        fence_thread_.join();
+        fence_context_.reset();
+
         context_->bind();
 
         for (auto& pool : host_pools_)
@@ -176,106 +370,652 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
     std::wstring version() { return version_; }
 
-    std::shared_ptr<texture> create_texture(int width, int height, int stride, common::bit_depth depth, bool clear)
+    std::shared_ptr<texture>
+    create_texture(int width, int height, int stride, common::bit_depth depth, bool clear, bool mipmapped = false)
     {
         CASPAR_VERIFY(stride > 0 && stride < 5);
         CASPAR_VERIFY(width > 0 && height > 0);
 
-        auto depth_pool_index = depth == common::bit_depth::bit8 ? 0 : 1;
+        auto tex = pooled_texture(depth_pool_index(depth), stride - 1 + (mipmapped ? 4 : 0), width, height, [&] {
+            return std::make_shared<texture>(width, height, stride, depth, mipmapped);
+        });
 
-        // TODO (perf) Shared pool.
-        auto pool = &device_pools_[depth_pool_index][stride - 1][(width << 16 & 0xFFFF0000) | (height & 0x0000FFFF)];
+        if (clear) {
+            tex->clear();
+        }
 
-        std::shared_ptr<texture> tex;
-        if (!pool->try_pop(tex)) {
-            tex = std::make_shared<texture>(width, height, stride, depth);
+        return tex;
+    }
+
+    std::shared_ptr<texture> create_texture(int width, int height, core::pixel_format format)
+    {
+        CASPAR_VERIFY(core::is_block_compressed(format));
+        CASPAR_VERIFY(width > 0 && height > 0);
+
+        return pooled_texture(0, format == core::pixel_format::bc1 ? 8 : 9, width, height, [&] {
+            return std::make_shared<texture>(width, height, format);
+        });
+    }
+
+    static int depth_pool_index(common::bit_depth depth)
+    {
+        return depth == common::bit_depth::bit8 ? 0 : depth == common::bit_depth::float16 ? 2 : 1;
+    }
+
+    texture_pool_t& texture_pool(int depth_pool_index, int format_pool_index, int width, int height)
+    {
+        return device_pools_[depth_pool_index][format_pool_index][(width << 16 & 0xFFFF0000) | (height & 0x0000FFFF)];
+    }
+
+    template <typename T>
+    static void acquired(resource_pool<T>& pool)
+    {
+        auto in_use = ++pool.in_use;
+        auto peak   = pool.peak.load();
+        while (in_use > peak && !pool.peak.compare_exchange_weak(peak, in_use)) {
         }
+    }
 
-        if (clear) {
-            tex->clear();
+    template <typename Func>
+    std::shared_ptr<texture>
+    pooled_texture(int depth_pool_index, int format_pool_index, int width, int height, Func create)
+    {
+        auto pool = &texture_pool(depth_pool_index, format_pool_index, width, height);
+
+        std::shared_ptr<texture> tex;
+        if (pool->idle.try_pop(tex)) {
+            pool->hits++;
+            pooled_device_bytes_ -= tex->size();
+        } else {
+            pool->misses++;
+            tex = create();
         }
+        acquired(*pool);
 
         auto ptr = tex.get();
-        return std::shared_ptr<texture>(
-            ptr, [tex = std::move(tex), pool, self = shared_from_this()](texture*) mutable { pool->push(tex); });
+        return std::shared_ptr<texture>(ptr, [tex = std::move(tex), pool, self = shared_from_this()](texture*) mutable {
+            pool->in_use--;
+            self->pooled_device_bytes_ += tex->size();
+            pool->last_used = now_ms();
+            pool->idle.push(std::move(tex));
+        });
     }
 
     std::shared_ptr<buffer> create_buffer(int size, bool write)
     {
         CASPAR_VERIFY(size > 0);
 
-        // TODO (perf) Shared pool.
-        auto pool = &host_pools_[static_cast<int>(write ? 1 : 0)][size];
+        // Buffers may be larger than requested, so callers must use the size they asked for
+        auto class_size = size_class(size);
+        auto pool       = &host_pools_[static_cast<int>(write ? 1 : 0)][class_size];
 
         std::shared_ptr<buffer> buf;
-        if (!pool->try_pop(buf)) {
+        if (pool->idle.try_pop(buf)) {
+            pool->hits++;
+            pooled_host_bytes_ -= buf->size();
+        } else {
+            pool->misses++;
             // TODO (perf) Avoid blocking in create_array.
-            dispatch_sync([&] { buf = std::make_shared<buffer>(size, write); });
+            dispatch_sync([&] { buf = std::make_shared<buffer>(static_cast<int>(class_size), write); });
         }
+        acquired(*pool);
 
         auto ptr = buf.get();
-        return std::shared_ptr<buffer>(ptr, [buf = std::move(buf), self = shared_from_this()](buffer*) mutable {
-            auto pool = &self->host_pools_[static_cast<int>(buf->write() ? 1 : 0)][buf->size()];
-            pool->push(std::move(buf));
+        return std::shared_ptr<buffer>(ptr, [buf = std::move(buf), pool, self = shared_from_this()](buffer*) mutable {
+            pool->in_use--;
+            self->pooled_host_bytes_ += buf->size();
+            pool->last_used = now_ms();
+            pool->idle.push(std::move(buf));
         });
     }
 
+    // Rounds up to a multiple of 1/16 of the highest power of two in size, wasting at most 6.25%
+    static size_t size_class(size_t size)
+    {
+        size_t step = 1;
+        while (step << 4 <= size) {
+            step <<= 1;
+        }
+        return (size + step - 1) / step * step;
+    }
+
+    static int64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Releases the idle resources of a pool and returns their size in bytes
+    template <typename T>
+    static int64_t drain(resource_pool<T>& pool)
+    {
+        int64_t            bytes = 0;
+        std::shared_ptr<T> item;
+        while (pool.idle.try_pop(item)) {
+            bytes += item->size();
+            item.reset();
+        }
+        return bytes;
+    }
+
+    // Drains pools that have been idle for too long, then the least recently used ones while over budget or until
+    // release bytes have been drained
+    template <typename T>
+    static void trim(std::vector<std::pair<int64_t, resource_pool<T>*>> pools,
+                     std::atomic<int64_t>&                              pooled_bytes,
+                     int64_t                                            budget,
+                     int64_t                                            release,
+                     int64_t                                            now)
+    {
+        std::sort(pools.begin(), pools.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        for (auto& pool : pools) {
+            auto expired     = now - pool.first > pool_idle_timeout_ms;
+            auto over_budget = (budget > 0 && pooled_bytes > budget) || release > 0;
+            if (!expired && !over_budget) {
+                break;
+            }
+            auto drained = drain(*pool.second);
+            pooled_bytes -= drained;
+            release -= drained;
+        }
+    }
+
+    // Also releases the given bytes of the pools, when the memory governor asks for them
+    void trim(int64_t release_device = 0, int64_t release_host = 0)
+    {
+        auto now = now_ms();
+
+        std::vector<std::pair<int64_t, texture_pool_t*>> textures;
+        for (auto& depth_pools : device_pools_) {
+            for (auto& pools : depth_pools) {
+                for (auto& pool : pools) {
+                    if (!pool.second.idle.empty())
+                        textures.emplace_back(pool.second.last_used, &pool.second);
+                }
+            }
+        }
+        trim(std::move(textures), pooled_device_bytes_, device_pool_budget_, release_device, now);
+
+        std::vector<std::pair<int64_t, buffer_pool_t*>> buffers;
+        for (auto& pools : host_pools_) {
+            for (auto& pool : pools) {
+                if (!pool.second.idle.empty())
+                    buffers.emplace_back(pool.second.last_used, &pool.second);
+            }
+        }
+        trim(std::move(buffers), pooled_host_bytes_, host_pool_budget_, release_host, now);
+    }
+
+    // Called by the memory governor, on its thread
+    void release(int64_t device_bytes, int64_t host_bytes)
+    {
+        boost::asio::post(service_, [this, device_bytes, host_bytes] {
+            try {
+                trim(device_bytes, host_bytes);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    // Runs on the device thread, since releasing textures and buffers needs the context
+    void schedule_trim()
+    {
+        trim_timer_.expires_after(std::chrono::seconds(1));
+        trim_timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (ec || !trimming_) {
+                return;
+            }
+            try {
+                trim();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            schedule_trim();
+        });
+    }
+
+    // The profile is kept per device, as channels are assigned to devices the same way on every start
+    boost::filesystem::path pool_profile_file() const
+    {
+        boost::filesystem::path folder =
+            env::properties().get(L"configuration.accelerator.pool-profile-path", std::wstring(L"pool-profile/"));
+        if (folder.empty()) {
+            return {};
+        }
+        if (folder.is_relative()) {
+            folder = boost::filesystem::path(env::initial_folder()) / folder;
+        }
+        return folder / (L"device-" + std::to_wstring(index_) + L".xml");
+    }
+
+    // Allocates the pools of the profile saved at the previous shutdown, up to the budgets, so that the first minutes
+    // on air do not miss them. Runs on the device thread before any work of the channels.
+    void warm_pools()
+    {
+        auto                      file = pool_profile_file();
+        boost::system::error_code ec;
+        if (file.empty() || !boost::filesystem::exists(file, ec)) {
+            return;
+        }
+
+        boost::property_tree::wptree profile;
+        boost::filesystem::wifstream stream(file);
+        boost::property_tree::read_xml(stream, profile, boost::property_tree::xml_parser::trim_whitespace);
+
+        auto warm_until = now_ms() + pool_warm_grace_ms - pool_idle_timeout_ms;
+        auto textures   = 0;
+        auto buffers    = 0;
+
+        for (auto& entry : profile.get_child(L"pool-profile", {})) {
+            if (entry.first == L"texture") {
+                auto width  = entry.second.get<int>(L"width");
+                auto height = entry.second.get<int>(L"height");
+                auto format = entry.second.get(L"format", std::wstring());
+                auto count  = entry.second.get<int>(L"count");
+                if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF) {
+                    continue;
+                }
+
+                texture_pool_t*                           pool;
+                std::function<std::shared_ptr<texture>()> create;
+                if (format == L"bc1" || format == L"bc3") {
+                    auto pixel_format = format == L"bc1" ? core::pixel_format::bc1 : core::pixel_format::bc3;
+                    pool              = &texture_pool(0, format == L"bc1" ? 8 : 9, width, height);
+                    create            = [=] { return std::make_shared<texture>(width, height, pixel_format); };
+                } else {
+                    auto depth_str = entry.second.get<std::wstring>(L"depth");
+                    auto depth     = depth_str == L"8"         ? common::bit_depth::bit8
+                                     : depth_str == L"float16" ? common::bit_depth::float16
+                                                               : common::bit_depth::bit16;
+                    auto stride    = entry.second.get<int>(L"stride");
+                    auto mipmapped = entry.second.get<bool>(L"mipmapped");
+                    if (stride < 1 || stride > 4) {
+                        continue;
+                    }
+                    pool   = &texture_pool(depth_pool_index(depth), stride - 1 + (mipmapped ? 4 : 0), width, height);
+                    create = [=] { return std::make_shared<texture>(width, height, stride, depth, mipmapped); };
+                }
+
+                for (; pool->warmed < count; ++pool->warmed, ++textures) {
+                    if (device_pool_budget_ > 0 && pooled_device_bytes_ >= device_pool_budget_) {
+                        break;
+                    }
+                    auto tex = create();
+                    pooled_device_bytes_ += tex->size();
+                    pool->idle.push(std::move(tex));
+                }
+                pool->last_used = warm_until;
+            } else if (entry.first == L"buffer") {
+                auto size  = entry.second.get<int>(L"size");
+                auto write = entry.second.get<bool>(L"write");
+                auto count = entry.second.get<int>(L"count");
+                if (size <= 0 || static_cast<size_t>(size) != size_class(size)) {
+                    continue;
+                }
+
+                auto pool = &host_pools_[write ? 1 : 0][size];
+                for (; pool->warmed < count; ++pool->warmed, ++buffers) {
+                    if (host_pool_budget_ > 0 && pooled_host_bytes_ >= host_pool_budget_) {
+                        break;
+                    }
+                    auto buf = std::make_shared<buffer>(size, write);
+                    pooled_host_bytes_ += buf->size();
+                    pool->idle.push(std::move(buf));
+                }
+                pool->last_used = warm_until;
+            }
+        }
+
+        CASPAR_LOG(info) << L"[device] Allocated " << textures << L" textures (" << pooled_device_bytes_ / (1024 * 1024)
+                         << L" MB) and " << buffers << L" host buffers (" << pooled_host_bytes_ / (1024 * 1024)
+                         << L" MB) from " << file.wstring();
+    }
+
+    // Saves the most resources each pool had in use at once. A pool that was warmed but used less this run keeps half
+    // of what it was warmed with, so that a short run does not forget the profile at once.
+    void save_pool_profile()
+    {
+        auto file = pool_profile_file();
+        if (file.empty()) {
+            return;
+        }
+
+        auto count = [](const auto& pool) { return std::max(pool.peak.load(), pool.warmed / 2); };
+
+        boost::property_tree::wptree profile;
+        for (size_t i = 0; i < device_pools_.size(); ++i) {
+            for (size_t j = 0; j < device_pools_[i].size(); ++j) {
+                for (auto& pool : device_pools_[i][j]) {
+                    if (count(pool.second) == 0) {
+                        continue;
+                    }
+                    auto& entry = profile.add(L"pool-profile.texture", L"");
+                    entry.add(L"width", static_cast<int>(pool.first >> 16));
+                    entry.add(L"height", static_cast<int>(pool.first & 0x0000FFFF));
+                    if (j > 7) {
+                        entry.add(L"format", j == 8 ? L"bc1" : L"bc3");
+                    } else {
+                        entry.add(L"depth", i == 0 ? L"8" : i == 2 ? L"float16" : L"16");
+                        entry.add(L"stride", static_cast<int>(j % 4 + 1));
+                        entry.add(L"mipmapped", j > 3);
+                    }
+                    entry.add(L"count", count(pool.second));
+                }
+            }
+        }
+        for (size_t i = 0; i < host_pools_.size(); ++i) {
+            for (auto& pool : host_pools_[i]) {
+                if (count(pool.second) == 0) {
+                    continue;
+                }
+                auto& entry = profile.add(L"pool-profile.buffer", L"");
+                entry.add(L"size", pool.first);
+                entry.add(L"write", i == 1);
+                entry.add(L"count", count(pool.second));
+            }
+        }
+
+        boost::filesystem::create_directories(file.parent_path());
+
+        // Written under a name of its own and renamed into place, so that a crash while saving keeps the old profile
+        auto tmp = file.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp");
+        {
+            boost::filesystem::wofstream                            stream(tmp, std::ios::trunc);
+            boost::property_tree::xml_writer_settings<std::wstring> settings(' ', 3);
+            boost::property_tree::write_xml(stream, profile, settings);
+            if (!stream) {
+                CASPAR_LOG(warning) << L"[device] Failed to write pool profile " << tmp.wstring();
+                stream.close();
+                boost::filesystem::remove(tmp);
+                return;
+            }
+        }
+        boost::filesystem::rename(tmp, file);
+    }
+
     array<uint8_t> create_array(int size)
     {
         auto buf = create_buffer(size, true);
         auto ptr = reinterpret_cast<uint8_t*>(buf->data());
-        return array<uint8_t>(ptr, buf->size(), std::move(buf));
+        return array<uint8_t>(ptr, size, std::move(buf), array_origin::gl_buffer);
     }
 
     std::future<std::shared_ptr<texture>>
     copy_async(const array<const uint8_t>& source, int width, int height, int stride, common::bit_depth depth)
     {
-        return dispatch_async([=] {
-            std::shared_ptr<buffer> buf;
-
-            auto tmp = source.storage<std::shared_ptr<buffer>>();
-            if (tmp) {
-                buf = *tmp;
-            } else {
-                buf = create_buffer(static_cast<int>(source.size()), true);
-                // TODO (perf) Copy inside a TBB worker.
-                std::memcpy(buf->data(), source.data(), source.size());
+        return upload(source, [=] { return create_texture(width, height, stride, depth, false); });
+    }
+
+    std::future<std::shared_ptr<texture>>
+    copy_async(const array<const uint8_t>& source, int width, int height, core::pixel_format format)
+    {
+        return upload(source, [=] { return create_texture(width, height, format); });
+    }
+
+    // Uploads source to the texture create returns, on the upload thread
+    template <typename Func>
+    std::future<std::shared_ptr<texture>> upload(const array<const uint8_t>& source, Func create)
+    {
+        std::shared_ptr<buffer> buf;
+
+        // Allocated through create_array, or a view on the start of such an array, so the data is already in a mapped
+        // upload buffer
+        auto tmp = source.origin() == array_origin::gl_buffer ? source.storage<std::shared_ptr<buffer>>() : nullptr;
+        if (tmp && (*tmp)->data() == source.data()) {
+            buf = *tmp;
+        } else {
+            // Stage into a mapped upload buffer on the calling thread and TBB workers, keeping the OpenGL thread free
+            // for GL work
+            buf = create_buffer(static_cast<int>(source.size()), true);
+
+            auto dst = reinterpret_cast<uint8_t*>(buf->data());
+            auto src = source.data();
+            run_in_arena(task_kind::realtime, [&] {
+                tbb::parallel_for(tbb::blocked_range<size_t>(0, source.size(), 1 << 20),
+                                  [&](const tbb::blocked_range<size_t>& r) {
+                                      std::memcpy(dst + r.begin(), src + r.begin(), r.size());
+                                  });
+            });
+        }
+
+        auto task = std::make_shared<std::packaged_task<std::shared_ptr<texture>()>>([=] {
+            auto tex = create();
+            tex->copy_from(*buf);
+            tex->fence();
+            return tex;
+        });
+        upload_queue_.push([task] { (*task)(); });
+        return task->get_future();
+    }
+
+    std::future<std::shared_ptr<texture>> copy_async(const array<const uint8_t>&                        source,
+                                                     int                                                 width,
+                                                     int                                                 height,
+                                                     int                                                 stride,
+                                                     common::bit_depth                                   depth,
+                                                     const std::shared_future<std::shared_ptr<texture>>& base,
+                                                     const std::vector<core::damage_rect>&               damage)
+    {
+        auto pixel = stride * (depth == common::bit_depth::bit8 ? 1 : 2);
+
+        struct area
+        {
+            int offset;
+            int x;
+            int y;
+            int width;
+            int height;
+        };
+        std::vector<area> areas;
+        auto              size = 0;
+        for (auto& rect : damage) {
+            auto left   = std::max(rect.x, 0);
+            auto top    = std::max(rect.y, 0);
+            auto right  = std::min(rect.x + rect.width, width);
+            auto bottom = std::min(rect.y + rect.height, height);
+            if (right > left && bottom > top) {
+                areas.push_back(area{size, left, top, right - left, bottom - top});
+                size += (right - left) * (bottom - top) * pixel;
+            }
+        }
+
+        // Stage the rows of the damaged areas tightly packed, one after the other
+        auto buf = size > 0 ? create_buffer(size, true) : nullptr;
+        for (auto& area : areas) {
+            auto dst = reinterpret_cast<uint8_t*>(buf->data()) + area.offset;
+            auto src = source.data() + (static_cast<size_t>(area.y) * width + area.x) * pixel;
+            for (int y = 0; y < area.height; ++y) {
+                std::memcpy(
+                    dst + y * area.width * pixel, src + static_cast<size_t>(y) * width * pixel, area.width * pixel);
             }
+        }
 
+        return dispatch_async([=] {
             auto tex = create_texture(width, height, stride, depth, false);
-            tex->copy_from(*buf);
-            // TODO (perf) save tex on source
+            tex->copy_from(*base.get());
+            for (auto& area : areas) {
+                tex->copy_from(*buf, area.offset, area.x, area.y, area.width, area.height);
+            }
             return tex;
         });
     }
 
-    std::future<array<const uint8_t>> copy_async(const std::shared_ptr<texture>& source)
+    std::shared_future<std::shared_ptr<texture>> copy_async_cached(const array<const uint8_t>& source,
+                                                                   int                         width,
+                                                                   int                         height,
+                                                                   int                         stride,
+                                                                   common::bit_depth           depth,
+                                                                   core::pixel_format          format)
     {
-        return spawn_async([=](yield_context yield) {
-            auto buf = create_buffer(source->size(), false);
-            source->copy_to(*buf);
+        auto owner = source.owner();
 
-            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        std::lock_guard<std::mutex> lock(texture_cache_mutex_);
 
-            GL(glFlush());
+        auto it = texture_cache_.find(source.data());
+        if (it != texture_cache_.end()) {
+            auto& entry = it->second;
+            if (entry.owner == owner && entry.size == source.size() && entry.width == width && entry.height == height &&
+                entry.stride == stride && entry.depth == depth && entry.format == format) {
+                return entry.future;
+            }
+        }
 
-            deadline_timer timer(service_);
-            for (auto n = 0; true; ++n) {
-                // TODO (perf) Smarter non-polling solution?
-                timer.expires_from_now(boost::posix_time::milliseconds(2));
-                timer.async_wait(yield);
+        if (texture_cache_.size() >= texture_cache_sweep_) {
+            for (auto entry = texture_cache_.begin(); entry != texture_cache_.end();) {
+                entry = entry->second.owner.expired() ? texture_cache_.erase(entry) : std::next(entry);
+            }
+            texture_cache_sweep_ = std::max<size_t>(64, texture_cache_.size() * 2);
+        }
 
-                auto wait = glClientWaitSync(fence, 0, 1);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    break;
-                }
+        auto tex = core::is_block_compressed(format) ? copy_async(source, width, height, format).share()
+                                                     : copy_async(source, width, height, stride, depth).share();
+        texture_cache_[source.data()] =
+            cached_texture{std::move(owner), source.size(), width, height, stride, depth, format, tex};
+        return tex;
+    }
+
+    void clear_texture_cache()
+    {
+        std::lock_guard<std::mutex> lock(texture_cache_mutex_);
+        texture_cache_.clear();
+    }
+
+    std::future<array<const uint8_t>> copy_async(const std::shared_ptr<texture>& source,
+                                                 const readback_options&         options)
+    {
+        auto readback       = std::make_shared<pending_readback>();
+        readback->source    = source;
+        readback->options   = options;
+        readback->requested = std::chrono::steady_clock::now();
+        auto future         = readback->promise.get_future();
+
+        boost::asio::dispatch(service_, [=] {
+            // Issued behind the work already queued, such as the renders of other channels, whose readbacks join
+            // this batch
+            readback_batch_.push_back(readback);
+            if (readback_batch_.size() == 1) {
+                boost::asio::post(service_, [this] { issue_readbacks(); });
             }
+        });
 
+        return future;
+    }
+
+    // The readbacks of clocked channels first and the rest in the order they were requested, each with a fence of its
+    // own, in a single submission. The fence thread waits on the fences in that order, which is also the order the GPU
+    // completes them in.
+    void issue_readbacks()
+    {
+        if (readback_batch_.empty()) {
+            return;
+        }
+
+        auto batch = std::move(readback_batch_);
+        readback_batch_.clear();
+
+        std::stable_sort(batch.begin(), batch.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs->options.clocked && !rhs->options.clocked;
+        });
+
+        std::vector<std::shared_ptr<pending_readback>> issued;
+        for (auto& readback : batch) {
+            try {
+                auto source    = std::move(readback->source);
+                readback->buf  = create_buffer(source->size(), false);
+                readback->size = source->size();
+                source->copy_to(*readback->buf);
+
+                readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                issued.push_back(readback);
+            } catch (...) {
+                readback->promise.set_exception(std::current_exception());
+            }
+        }
+
+        // The fences are waited on from the readback context, so they have to reach the GPU from this one
+        glFlush();
+
+        for (auto& readback : issued) {
+            fence_queue_.push(std::move(readback));
+        }
+    }
+
+    void flush_readbacks(int channel)
+    {
+        if (std::any_of(readback_batch_.begin(), readback_batch_.end(), [&](const auto& readback) {
+                return readback->options.channel == channel;
+            })) {
+            issue_readbacks();
+        }
+    }
+
+    void complete_readback(pending_readback& readback)
+    {
+        GLenum wait;
+        do {
+            wait = glClientWaitSync(readback.fence, 0, 100000000); // 100 ms
+        } while (wait == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(readback.fence);
+
+        if (wait == GL_WAIT_FAILED) {
+            try {
+                CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("glClientWaitSync failed during readback"));
+            } catch (...) {
+                readback.promise.set_exception(std::current_exception());
+            }
+            return;
+        }
+
+        auto latency =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readback.requested).count();
+        size_t bucket = 0;
+        while (bucket < readback_latency_.size() - 1 && latency >= (1 << bucket)) {
+            ++bucket;
+        }
+        readback_latency_[bucket]++;
+
+        if (readback.options.channel >= 0) {
+            std::lock_guard<std::mutex> lock(channel_readbacks_mutex_);
+            auto&                       channel = channel_readbacks_[readback.options.channel];
+            channel.latency[bucket]++;
+            channel.count++;
+            channel.total += latency;
+            channel.last = latency;
+        }
+
+        auto ptr  = reinterpret_cast<uint8_t*>(readback.buf->data());
+        auto size = readback.size;
+        readback.promise.set_value(array<const uint8_t>(ptr, size, std::move(readback.buf)));
+    }
+
+    std::shared_ptr<texture> copy_shared(const core::shared_texture& source)
+    {
+        if (!shared_textures_ || source.width <= 0 || source.height <= 0) {
+            return nullptr;
+        }
+
+        return dispatch_sync([&]() -> std::shared_ptr<texture> {
+            auto tex    = create_texture(source.width, source.height, 4, common::bit_depth::bit8, false);
+            auto copied =
+                context_->import_texture(source, [&](unsigned int id) { tex->copy_from(static_cast<int>(id)); });
+            if (!copied) {
+                return nullptr;
+            }
+
+            // The owner may reuse the texture once this returns, so the copy has to be done by then. This holds up the
+            // device thread until the GPU has also finished the work queued before it.
+            auto   fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            GLenum wait;
+            do {
+                wait = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000); // 100 ms
+            } while (wait == GL_TIMEOUT_EXPIRED);
             glDeleteSync(fence);
 
-            auto ptr  = reinterpret_cast<uint8_t*>(buf->data());
-            auto size = buf->size();
-            return array<const uint8_t>(ptr, size, std::move(buf));
+            return wait == GL_WAIT_FAILED ? nullptr : tex;
         });
     }
 
@@ -286,34 +1026,43 @@ struct device::impl : public std::enable_shared_from_this<impl>
         boost::property_tree::wptree pooled_device_buffers;
         size_t                       total_pooled_device_buffer_size  = 0;
         size_t                       total_pooled_device_buffer_count = 0;
+        uint64_t                     total_device_hits                = 0;
+        uint64_t                     total_device_misses              = 0;
 
         for (size_t i = 0; i < device_pools_.size(); ++i) {
             auto& depth_pools = device_pools_.at(i);
             for (size_t j = 0; j < depth_pools.size(); ++j) {
                 auto& pools      = depth_pools.at(j);
+                bool  compressed = j > 7;
                 bool  mipmapping = j > 3;
-                auto  stride     = mipmapping ? j - 3 : j + 1;
+                auto  stride     = compressed ? 4 : mipmapping ? j - 3 : j + 1;
+                auto  format     = j == 8 ? core::pixel_format::bc1 : core::pixel_format::bc3;
 
                 for (auto& pool : pools) {
-                    auto width  = pool.first >> 16;
-                    auto height = pool.first & 0x0000FFFF;
-                    auto size   = width * height * stride;
-                    auto count  = pool.second.size();
-
-                    if (count == 0)
-                        continue;
+                    auto width  = static_cast<int>(pool.first >> 16);
+                    auto height = static_cast<int>(pool.first & 0x0000FFFF);
+                    auto size   = compressed ? core::block_compressed_size(format, width, height)
+                                             : width * height * stride * (mipmapping ? 4 : 3) / 3;
+                    auto count  = pool.second.idle.size();
 
                     boost::property_tree::wptree pool_info;
 
+                    if (compressed) {
+                        pool_info.add(L"format", j == 8 ? L"bc1" : L"bc3");
+                    }
                     pool_info.add(L"stride", stride);
                     pool_info.add(L"mipmapping", mipmapping);
                     pool_info.add(L"width", width);
                     pool_info.add(L"height", height);
                     pool_info.add(L"size", size);
                     pool_info.add(L"count", count);
+                    pool_info.add(L"hits", static_cast<uint64_t>(pool.second.hits));
+                    pool_info.add(L"misses", static_cast<uint64_t>(pool.second.misses));
 
                     total_pooled_device_buffer_size += size * count;
                     total_pooled_device_buffer_count += count;
+                    total_device_hits += pool.second.hits;
+                    total_device_misses += pool.second.misses;
 
                     pooled_device_buffers.add_child(L"device_buffer_pool", pool_info);
                 }
@@ -327,6 +1076,8 @@ struct device::impl : public std::enable_shared_from_this<impl>
         size_t                       total_write_size  = 0;
         size_t                       total_read_count  = 0;
         size_t                       total_write_count = 0;
+        uint64_t                     total_host_hits   = 0;
+        uint64_t                     total_host_misses = 0;
 
         for (size_t i = 0; i < host_pools_.size(); ++i) {
             auto& pools    = host_pools_.at(i);
@@ -334,16 +1085,18 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
             for (auto& pool : pools) {
                 auto size  = pool.first;
-                auto count = pool.second.size();
-
-                if (count == 0)
-                    continue;
+                auto count = pool.second.idle.size();
 
                 boost::property_tree::wptree pool_info;
 
                 pool_info.add(L"usage", is_write ? L"write_only" : L"read_only");
                 pool_info.add(L"size", size);
                 pool_info.add(L"count", count);
+                pool_info.add(L"hits", static_cast<uint64_t>(pool.second.hits));
+                pool_info.add(L"misses", static_cast<uint64_t>(pool.second.misses));
+
+                total_host_hits += pool.second.hits;
+                total_host_misses += pool.second.misses;
 
                 pooled_host_buffers.add_child(L"host_buffer_pool", pool_info);
 
@@ -355,13 +1108,40 @@ struct device::impl : public std::enable_shared_from_this<impl>
         info.add_child(L"gl.details.pooled_host_buffers", pooled_host_buffers);
         info.add(L"gl.summary.pooled_device_buffers.total_count", total_pooled_device_buffer_count);
         info.add(L"gl.summary.pooled_device_buffers.total_size", total_pooled_device_buffer_size);
+        info.add(L"gl.summary.pooled_device_buffers.hits", total_device_hits);
+        info.add(L"gl.summary.pooled_device_buffers.misses", total_device_misses);
+        info.add(L"gl.summary.pooled_device_buffers.budget", device_pool_budget_);
         // info.add_child(L"gl.summary.all_device_buffers", texture::info());
         info.add(L"gl.summary.pooled_host_buffers.total_read_count", total_read_count);
         info.add(L"gl.summary.pooled_host_buffers.total_write_count", total_write_count);
         info.add(L"gl.summary.pooled_host_buffers.total_read_size", total_read_size);
         info.add(L"gl.summary.pooled_host_buffers.total_write_size", total_write_size);
+        info.add(L"gl.summary.pooled_host_buffers.hits", total_host_hits);
+        info.add(L"gl.summary.pooled_host_buffers.misses", total_host_misses);
+        info.add(L"gl.summary.pooled_host_buffers.budget", host_pool_budget_);
         info.add_child(L"gl.summary.all_host_buffers", buffer::info());
 
+        static const wchar_t* latency_buckets[] = {L"lt_1ms", L"lt_2ms", L"lt_4ms", L"lt_8ms", L"lt_16ms", L"ge_16ms"};
+        for (size_t n = 0; n < readback_latency_.size(); ++n) {
+            info.add(std::wstring(L"gl.summary.readback_latency.") + latency_buckets[n],
+                     static_cast<uint64_t>(readback_latency_[n]));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(channel_readbacks_mutex_);
+            for (auto& channel : channel_readbacks_) {
+                boost::property_tree::wptree channel_info;
+                channel_info.add(L"channel", channel.first);
+                channel_info.add(L"count", channel.second.count);
+                channel_info.add(L"last_ms", channel.second.last);
+                channel_info.add(L"average_ms", channel.second.total / std::max<uint64_t>(channel.second.count, 1));
+                for (size_t n = 0; n < channel.second.latency.size(); ++n) {
+                    channel_info.add(std::wstring(L"latency.") + latency_buckets[n], channel.second.latency[n]);
+                }
+                info.add_child(L"gl.details.channel_readbacks.channel_readback", channel_info);
+            }
+        }
+
         return info;
     }
 
@@ -374,28 +1154,35 @@ struct device::impl : public std::enable_shared_from_this<impl>
                 for (auto& depth_pools : device_pools_) {
                     for (auto& pools : depth_pools) {
                         for (auto& pool : pools)
-                            pool.second.clear();
+                            pooled_device_bytes_ -= drain(pool.second);
                     }
                 }
                 for (auto& pools : host_pools_) {
                     for (auto& pool : pools)
-                        pool.second.clear();
+                        pooled_host_bytes_ -= drain(pool.second);
                 }
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
+
+            clear_texture_cache();
         });
     }
 };
 
-device::device()
-    : impl_(new impl())
+device::device(int index)
+    : impl_(new impl(index))
+{
+}
+device::~device()
 {
+    // Cached textures hold a reference to the device
+    impl_->clear_texture_cache();
 }
-device::~device() {}
-std::shared_ptr<texture> device::create_texture(int width, int height, int stride, common::bit_depth depth)
+std::shared_ptr<texture>
+device::create_texture(int width, int height, int stride, common::bit_depth depth, bool clear, bool mipmapped)
 {
-    return impl_->create_texture(width, height, stride, depth, true);
+    return impl_->create_texture(width, height, stride, depth, clear, mipmapped);
 }
 array<uint8_t> device::create_array(int size) { return impl_->create_array(size); }
 std::future<std::shared_ptr<texture>>
@@ -403,11 +1190,47 @@ device::copy_async(const array<const uint8_t>& source, int width, int height, in
 {
     return impl_->copy_async(source, width, height, stride, depth);
 }
-std::future<array<const uint8_t>> device::copy_async(const std::shared_ptr<texture>& source)
+std::shared_future<std::shared_ptr<texture>> device::copy_async_cached(const array<const uint8_t>& source,
+                                                                      int                         width,
+                                                                      int                         height,
+                                                                      int                         stride,
+                                                                      common::bit_depth           depth)
+{
+    return impl_->copy_async_cached(source, width, height, stride, depth, core::pixel_format::invalid);
+}
+std::future<std::shared_ptr<texture>>
+device::copy_async(const array<const uint8_t>& source, int width, int height, core::pixel_format format)
+{
+    return impl_->copy_async(source, width, height, format);
+}
+std::shared_future<std::shared_ptr<texture>>
+device::copy_async_cached(const array<const uint8_t>& source, int width, int height, core::pixel_format format)
+{
+    return impl_->copy_async_cached(source, width, height, 4, common::bit_depth::bit8, format);
+}
+std::future<std::shared_ptr<texture>> device::copy_async(const array<const uint8_t>&                        source,
+                                                       int                                                 width,
+                                                       int                                                 height,
+                                                       int                                                 stride,
+                                                       common::bit_depth                                   depth,
+                                                       const std::shared_future<std::shared_ptr<texture>>& base,
+                                                       const std::vector<core::damage_rect>&               damage)
+{
+    return impl_->copy_async(source, width, height, stride, depth, base, damage);
+}
+std::future<array<const uint8_t>> device::copy_async(const std::shared_ptr<texture>& source,
+                                                     const readback_options&         options)
+{
+    return impl_->copy_async(source, options);
+}
+void device::flush_readbacks(int channel) { impl_->flush_readbacks(channel); }
+bool device::supports_shared_textures() const { return impl_->shared_textures_; }
+std::shared_ptr<texture> device::copy_shared(const core::shared_texture& source)
 {
-    return impl_->copy_async(source);
+    return impl_->copy_shared(source);
 }
 void         device::dispatch(std::function<void()> func) { boost::asio::dispatch(impl_->service_, std::move(func)); }
+void         device::post(std::function<void()> func) { boost::asio::post(impl_->service_, std::move(func)); }
 std::wstring device::version() const { return impl_->version(); }
 boost::property_tree::wptree device::info() const { return impl_->info(); }
 std::future<void>            device::gc() { return impl_->gc(); }
@@ -24,9 +24,15 @@
 #include <accelerator/accelerator.h>
 #include <common/array.h>
 #include <common/bit_depth.h>
+#include <common/diagnostics/trace.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
 
 #include <functional>
 #include <future>
+#include <vector>
 
 #ifdef WIN32
 #include <GL/glew.h>
@@ -34,24 +40,66 @@
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+// Who a readback is for, which orders it among the readbacks of other channels and accounts its latency
+struct readback_options
+{
+    int  channel = -1;    // -1 for none
+    bool clocked = false; // Whether a consumer of the channel is clocked by its hardware, such as a DeckLink card
+};
+
 class device final
     : public std::enable_shared_from_this<device>
     , public accelerator_device
 {
   public:
-    device();
+    // index names the pool profile the device is warmed from at startup, see accelerator/pool-profile-path
+    explicit device(int index = 0);
     ~device();
 
     device(const device&) = delete;
 
     device& operator=(const device&) = delete;
 
-    std::shared_ptr<class texture> create_texture(int width, int height, int stride, common::bit_depth depth);
-    array<uint8_t>                 create_array(int size);
+    // Textures come from a pool, so their content is undefined unless they are cleared
+    std::shared_ptr<class texture> create_texture(int               width,
+                                                  int               height,
+                                                  int               stride,
+                                                  common::bit_depth depth,
+                                                  bool              clear     = true,
+                                                  bool              mipmapped = false);
+    array<uint8_t> create_array(int size);
 
     std::future<std::shared_ptr<class texture>>
     copy_async(const array<const uint8_t>& source, int width, int height, int stride, common::bit_depth depth);
-    std::future<array<const uint8_t>> copy_async(const std::shared_ptr<class texture>& source);
+    // Like copy_async, but the upload is shared by every caller passing the same buffer for as long as it is alive
+    std::shared_future<std::shared_ptr<class texture>>
+    copy_async_cached(const array<const uint8_t>& source, int width, int height, int stride, common::bit_depth depth);
+    // Uploads a block compressed image with all its mip levels, see core::is_block_compressed
+    std::future<std::shared_ptr<class texture>>
+    copy_async(const array<const uint8_t>& source, int width, int height, core::pixel_format format);
+    std::shared_future<std::shared_ptr<class texture>>
+    copy_async_cached(const array<const uint8_t>& source, int width, int height, core::pixel_format format);
+    // Like copy_async, but copies base on the GPU and only uploads the damaged areas of source on top of it. base has
+    // to be a texture of the same size and format.
+    std::future<std::shared_ptr<class texture>>
+    copy_async(const array<const uint8_t>&                               source,
+               int                                                       width,
+               int                                                       height,
+               int                                                       stride,
+               common::bit_depth                                         depth,
+               const std::shared_future<std::shared_ptr<class texture>>& base,
+               const std::vector<core::damage_rect>&                     damage);
+    // Readbacks requested while the device thread is busy are issued together once it gets to them, those of clocked
+    // channels first, so that a channel does not wait behind the readbacks of slower ones
+    std::future<array<const uint8_t>> copy_async(const std::shared_ptr<class texture>& source,
+                                                 const readback_options&               options = {});
+    // Issues the batched readbacks now if any of them are of channel, such as before a texture one of them reads is
+    // drawn over. Only called on the device thread.
+    void flush_readbacks(int channel);
+    // Copies a texture that another graphics API shares with this process into one of the pool, which is done on the
+    // GPU by the time this returns. Returns nullptr when it cannot be imported.
+    std::shared_ptr<class texture> copy_shared(const core::shared_texture& source);
+    bool                           supports_shared_textures() const;
     template <typename Func>
     auto dispatch_async(Func&& func)
     {
@@ -60,7 +108,11 @@ class device final
 
         auto task   = std::make_shared<task_type>(std::forward<Func>(func));
         auto future = task->get_future();
-        dispatch([=] { (*task)(); });
+        dispatch([=, frame = diagnostics::trace::frame()] {
+            diagnostics::trace::frame_scope  scope(frame);
+            diagnostics::trace::scoped_event event("ogl");
+            (*task)();
+        });
         return future;
     }
 
@@ -70,6 +122,9 @@ class device final
         return dispatch_async(std::forward<Func>(func)).get();
     }
 
+    // Queues func behind the work already scheduled on the device thread, also when called from it
+    void post(std::function<void()> func);
+
     std::wstring version() const;
 
     boost::property_tree::wptree info() const;
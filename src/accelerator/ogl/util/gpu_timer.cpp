@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gpu_timer.h"
+
+#include "device.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+struct gpu_timer::impl
+{
+    struct section_query
+    {
+        std::string name;
+        GLuint      query;
+    };
+
+    // Beyond this many frames in flight the oldest is waited on, rather than queries piling up
+    static constexpr size_t max_pending = 8;
+
+    spl::shared_ptr<device>                   ogl_;
+    const size_t                              window_;
+    std::vector<GLuint>                       queries_;
+    std::vector<GLuint>                       free_;
+    std::vector<section_query>                current_;
+    std::deque<std::vector<section_query>>    pending_;
+    mutable std::mutex                        mutex_;
+    std::deque<std::map<std::string, double>> frames_;
+
+    impl(const spl::shared_ptr<device>& ogl, int window)
+        : ogl_(ogl)
+        , window_(static_cast<size_t>(std::max(1, window)))
+    {
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            if (!queries_.empty()) {
+                GL(glDeleteQueries(static_cast<GLsizei>(queries_.size()), queries_.data()));
+            }
+        });
+    }
+
+    void begin(const std::string& section)
+    {
+        if (free_.empty()) {
+            GLuint query = 0;
+            GL(glGenQueries(1, &query));
+            queries_.push_back(query);
+            free_.push_back(query);
+        }
+
+        auto query = free_.back();
+        free_.pop_back();
+
+        GL(glBeginQuery(GL_TIME_ELAPSED, query));
+        current_.push_back(section_query{section, query});
+    }
+
+    void end() { GL(glEndQuery(GL_TIME_ELAPSED)); }
+
+    void end_frame()
+    {
+        pending_.push_back(std::move(current_));
+        current_.clear();
+
+        while (!pending_.empty()) {
+            auto& frame = pending_.front();
+
+            // Queries complete in order, so once one frame is not done the later ones are not either
+            if (!frame.empty() && pending_.size() <= max_pending) {
+                GLint available = 0;
+                GL(glGetQueryObjectiv(frame.back().query, GL_QUERY_RESULT_AVAILABLE, &available));
+                if (!available) {
+                    break;
+                }
+            }
+
+            std::map<std::string, double> times;
+            double                        total = 0.0;
+            for (auto& section : frame) {
+                GLuint64 elapsed = 0;
+                GL(glGetQueryObjectui64v(section.query, GL_QUERY_RESULT, &elapsed));
+                times[section.name] += elapsed / 1000000.0;
+                total += elapsed / 1000000.0;
+                free_.push_back(section.query);
+            }
+            times["total"] = total;
+            pending_.pop_front();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            frames_.push_back(std::move(times));
+            if (frames_.size() > window_) {
+                frames_.pop_front();
+            }
+        }
+    }
+
+    std::map<std::string, double> averages() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::map<std::string, double> result;
+        for (auto& frame : frames_) {
+            for (auto& section : frame) {
+                result[section.first] += section.second / frames_.size();
+            }
+        }
+        return result;
+    }
+};
+
+gpu_timer::gpu_timer(const spl::shared_ptr<device>& ogl, int window)
+    : impl_(new impl(ogl, window))
+{
+}
+gpu_timer::~gpu_timer() {}
+void                          gpu_timer::begin(const std::string& section) { impl_->begin(section); }
+void                          gpu_timer::end() { impl_->end(); }
+void                          gpu_timer::end_frame() { impl_->end_frame(); }
+std::map<std::string, double> gpu_timer::averages() const { return impl_->averages(); }
+
+}}} // namespace caspar::accelerator::ogl
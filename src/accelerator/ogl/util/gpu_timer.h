@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <map>
+#include <string>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Measures the GPU time of the sections of each frame with GL_TIME_ELAPSED queries. Results are collected once the
+// GPU has finished with them, which is usually a frame or two later, so measuring does not stall the device.
+// Sections cannot nest. Must be used from the device thread, apart from averages.
+class gpu_timer final
+{
+    gpu_timer(const gpu_timer&);
+    gpu_timer& operator=(const gpu_timer&);
+
+  public:
+    explicit gpu_timer(const spl::shared_ptr<class device>& ogl, int window = 50);
+    ~gpu_timer();
+
+    // Sections of the same name in one frame are added up
+    void begin(const std::string& section);
+    void end();
+    void end_frame();
+
+    // Milliseconds per frame of each section, and of all of them as "total", averaged over the last window frames
+    std::map<std::string, double> averages() const;
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -2,54 +2,37 @@
 
 #include <core/frame/frame_transform.h>
 
-#include <common/except.h>
-#include <common/log.h>
-
 #include <cmath>
-#include <utility>
-#include <vector>
 
-#include <boost/numeric/ublas/io.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
-#include <boost/numeric/ublas/matrix_vector.hpp>
 #include <boost/numeric/ublas/vector.hpp>
 
 #include "matrix.h"
 
 namespace caspar::accelerator::ogl {
 
-t_matrix create_matrix(std::vector<std::vector<double>> data)
-{
-    if (data.empty())
-        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"data cannot be empty"));
-
-    t_matrix matrix(data.size(), data.at(0).size());
-    for (int y = 0; y < matrix.size1(); ++y) {
-        if (data.at(y).size() != matrix.size2())
-            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Each row must be of the same length"));
-
-        for (int x = 0; x < matrix.size2(); ++x)
-            matrix(x, y) = data.at(y).at(x);
-    }
-    return matrix;
-}
-
 t_matrix get_vertex_matrix(const core::image_transform& transform, double aspect_ratio)
 {
-    using namespace boost::numeric::ublas;
-    auto anchor_matrix =
-        create_matrix({{1.0, 0.0, -transform.anchor[0]}, {0.0, 1.0, -transform.anchor[1]}, {0.0, 0.0, 1.0}});
-    auto scale_matrix =
-        create_matrix({{transform.fill_scale[0], 0.0, 0.0}, {0.0, transform.fill_scale[1], 0.0}, {0.0, 0.0, 1.0}});
-    auto aspect_matrix      = create_matrix({{1.0, 0.0, 0.0}, {0.0, 1.0 / aspect_ratio, 0.0}, {0.0, 0.0, 1.0}});
-    auto aspect_inv_matrix  = create_matrix({{1.0, 0.0, 0.0}, {0.0, aspect_ratio, 0.0}, {0.0, 0.0, 1.0}});
-    auto rotation_matrix    = create_matrix({{std::cos(transform.angle), -std::sin(transform.angle), 0.0},
-                                             {std::sin(transform.angle), std::cos(transform.angle), 0.0},
-                                             {0.0, 0.0, 1.0}});
-    auto translation_matrix = create_matrix(
-        {{1.0, 0.0, transform.fill_translation[0]}, {0.0, 1.0, transform.fill_translation[1]}, {0.0, 0.0, 1.0}});
-
-    return anchor_matrix * aspect_matrix * scale_matrix * rotation_matrix * aspect_inv_matrix * translation_matrix;
+    // Points are row vectors, which are moved by the anchor, squeezed to square pixels, scaled, rotated, stretched back
+    // and translated, composed here in one matrix
+    const auto cos = std::cos(transform.angle);
+    const auto sin = std::sin(transform.angle);
+    const auto sx  = transform.fill_scale[0];
+    const auto sy  = transform.fill_scale[1];
+    const auto ax  = transform.anchor[0];
+    const auto ay  = transform.anchor[1];
+
+    t_matrix matrix(3, 3);
+    matrix(0, 0) = cos * sx;
+    matrix(0, 1) = aspect_ratio * sin * sx;
+    matrix(0, 2) = 0.0;
+    matrix(1, 0) = -sin * sy / aspect_ratio;
+    matrix(1, 1) = cos * sy;
+    matrix(1, 2) = 0.0;
+    matrix(2, 0) = -matrix(0, 0) * ax - matrix(1, 0) * ay + transform.fill_translation[0];
+    matrix(2, 1) = -matrix(0, 1) * ax - matrix(1, 1) * ay + transform.fill_translation[1];
+    matrix(2, 2) = 1.0;
+    return matrix;
 }
 
 } // namespace caspar::accelerator::ogl
@@ -9,9 +9,12 @@
 
 namespace caspar::accelerator::ogl {
 
-typedef boost::numeric::ublas::matrix<double, boost::numeric::ublas::row_major, std::vector<double>> t_matrix;
+// Kept inline rather than on the heap, as several are made for every item drawn
+typedef boost::numeric::ublas::
+    matrix<double, boost::numeric::ublas::row_major, boost::numeric::ublas::bounded_array<double, 9>>
+        t_matrix;
 
-typedef boost::numeric::ublas::vector<double, std::vector<double>> t_point;
+typedef boost::numeric::ublas::vector<double, boost::numeric::ublas::bounded_array<double, 3>> t_point;
 
 t_matrix get_vertex_matrix(const core::image_transform& transform, double aspect_ratio);
 
@@ -22,7 +25,7 @@ template <typename T, typename L, typename S>
 boost::numeric::ublas::matrix<T, L, S> operator*(const boost::numeric::ublas::matrix<T, L, S>& lhs,
                                                  const boost::numeric::ublas::matrix<T, L, S>& rhs)
 {
-    return boost::numeric::ublas::matrix<T>(boost::numeric::ublas::prod(lhs, rhs));
+    return boost::numeric::ublas::matrix<T, L, S>(boost::numeric::ublas::prod(lhs, rhs));
 }
 template <typename T, typename L, typename S1, typename S2>
 boost::numeric::ublas::vector<T, S1> operator*(const boost::numeric::ublas::vector<T, S1>&    lhs,
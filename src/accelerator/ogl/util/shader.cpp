@@ -20,14 +20,77 @@
  */
 #include "shader.h"
 
+#include <common/env.h>
 #include <common/gl/gl_check.h>
+#include <common/log.h>
 
 #include <GL/glew.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstdint>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+namespace {
+
+// Linked programs are kept on disk so that restarts skip compilation. An empty path disables the cache.
+const boost::filesystem::path& cache_folder()
+{
+    static const auto folder = [] {
+        boost::filesystem::path path =
+            env::properties().get(L"configuration.accelerator.shader-cache-path", std::wstring(L"shader-cache/"));
+        if (!path.empty() && path.is_relative()) {
+            path = boost::filesystem::path(env::initial_folder()) / path;
+        }
+        return path;
+    }();
+    return folder;
+}
+
+std::string gl_string(GLenum name)
+{
+    auto str = reinterpret_cast<const char*>(glGetString(name));
+    return str ? str : "";
+}
+
+// Binaries are only valid for the driver that produced them, so it is part of the key along with the sources
+boost::filesystem::path cache_file(const std::vector<std::string>& sources)
+{
+    if (cache_folder().empty()) {
+        return {};
+    }
+
+    // FNV-1a, which unlike std::hash is stable between builds
+    std::uint64_t hash = 14695981039346656037ULL;
+    auto          add  = [&](const std::string& str) {
+        for (auto c : str) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xFF) * 1099511628211ULL;
+    };
+
+    add(gl_string(GL_VENDOR));
+    add(gl_string(GL_RENDERER));
+    add(gl_string(GL_VERSION));
+    for (auto& source : sources) {
+        add(source);
+    }
+
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return cache_folder() / name.str();
+}
+
+} // namespace
+
 struct shader::impl
 {
     GLuint                                 program_;
@@ -41,6 +104,11 @@ struct shader::impl
     impl(const std::string& vertex_source_str, const std::string& fragment_source_str)
         : program_(0)
     {
+        auto file = cache_file({vertex_source_str, fragment_source_str});
+        if (load(file)) {
+            return;
+        }
+
         GLint success;
 
         const char* vertex_source = vertex_source_str.c_str();
@@ -81,6 +149,7 @@ struct shader::impl
 
         GL(glAttachObjectARB(program_, vertex_shader));
         GL(glAttachObjectARB(program_, fragmemt_shader));
+        GL(glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
 
         GL(glLinkProgramARB(program_));
 
@@ -97,6 +166,134 @@ struct shader::impl
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
         }
         GL(glUseProgramObjectARB(program_));
+
+        store(file);
+    }
+
+    explicit impl(const std::string& compute_source_str)
+        : program_(0)
+    {
+        auto file = cache_file({compute_source_str});
+        if (load(file)) {
+            return;
+        }
+
+        GLint success;
+
+        const char* compute_source = compute_source_str.c_str();
+
+        auto compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+
+        GL(glShaderSource(compute_shader, 1, &compute_source, NULL));
+        GL(glCompileShader(compute_shader));
+
+        GL(glGetShaderiv(compute_shader, GL_COMPILE_STATUS, &success));
+        if (success == GL_FALSE) {
+            char info[2048];
+            GL(glGetShaderInfoLog(compute_shader, sizeof(info), 0, info));
+            GL(glDeleteShader(compute_shader));
+            std::stringstream str;
+            str << "Failed to compile compute shader:" << std::endl << info << std::endl;
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
+        }
+
+        program_ = glCreateProgram();
+
+        GL(glAttachShader(program_, compute_shader));
+        GL(glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        GL(glLinkProgram(program_));
+        GL(glDeleteShader(compute_shader));
+
+        GL(glGetProgramiv(program_, GL_LINK_STATUS, &success));
+        if (success == GL_FALSE) {
+            char info[2048];
+            GL(glGetProgramInfoLog(program_, sizeof(info), 0, info));
+            GL(glDeleteProgram(program_));
+            std::stringstream str;
+            str << "Failed to link compute program:" << std::endl << info << std::endl;
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
+        }
+        GL(glUseProgram(program_));
+
+        store(file);
+    }
+
+    // Links the program from a cached binary. Fails without error if there is none or the driver rejects it.
+    bool load(const boost::filesystem::path& file)
+    {
+        if (file.empty()) {
+            return false;
+        }
+
+        boost::filesystem::ifstream stream(file, std::ios::binary);
+        if (!stream) {
+            return false;
+        }
+
+        GLenum format = 0;
+        if (!stream.read(reinterpret_cast<char*>(&format), sizeof(format))) {
+            return false;
+        }
+        std::vector<char> binary((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        if (binary.empty()) {
+            return false;
+        }
+
+        program_ = glCreateProgram();
+
+        // Binaries of another driver version may be rejected with an error, which only means compiling from source
+        glProgramBinary(program_, format, binary.data(), static_cast<GLsizei>(binary.size()));
+        while (glGetError() != GL_NO_ERROR) {
+        }
+
+        GLint success = GL_FALSE;
+        GL(glGetProgramiv(program_, GL_LINK_STATUS, &success));
+        if (success == GL_FALSE) {
+            GL(glDeleteProgram(program_));
+            program_ = 0;
+            return false;
+        }
+
+        GL(glUseProgram(program_));
+        return true;
+    }
+
+    void store(const boost::filesystem::path& file)
+    {
+        if (file.empty()) {
+            return;
+        }
+
+        GLint length = 0;
+        GL(glGetProgramiv(program_, GL_PROGRAM_BINARY_LENGTH, &length));
+        if (length <= 0) {
+            return;
+        }
+
+        GLenum            format = 0;
+        std::vector<char> binary(length);
+        GL(glGetProgramBinary(program_, length, nullptr, &format, binary.data()));
+
+        try {
+            boost::filesystem::create_directories(file.parent_path());
+
+            // Devices may store the same program at once, so each writes its own file and renames it into place
+            auto tmp = file.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp");
+            {
+                boost::filesystem::ofstream stream(tmp, std::ios::binary | std::ios::trunc);
+                stream.write(reinterpret_cast<const char*>(&format), sizeof(format));
+                stream.write(binary.data(), binary.size());
+                if (!stream) {
+                    CASPAR_LOG(warning) << L"[shader] Failed to write shader cache file " << tmp.wstring();
+                    stream.close();
+                    boost::filesystem::remove(tmp);
+                    return;
+                }
+            }
+            boost::filesystem::rename(tmp, file);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
     }
 
     ~impl() { glDeleteProgram(program_); }
@@ -132,7 +329,7 @@ struct shader::impl
         GL(glUniform3f(get_uniform_location(name.c_str()),
                        static_cast<float>(value0),
                        static_cast<float>(value1),
-                       static_cast<float>(value1)));
+                       static_cast<float>(value2)));
     }
 
     void set(const std::string& name, double value)
@@ -151,6 +348,10 @@ shader::shader(const std::string& vertex_source_str, const std::string& fragment
     : impl_(new impl(vertex_source_str, fragment_source_str))
 {
 }
+shader::shader(const std::string& compute_source_str)
+    : impl_(new impl(compute_source_str))
+{
+}
 shader::~shader() {}
 void shader::set(const std::string& name, bool value) { impl_->set(name, value); }
 void shader::set(const std::string& name, int value) { impl_->set(name, value); }
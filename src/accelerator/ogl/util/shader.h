@@ -35,6 +35,7 @@ class shader final
 
   public:
     shader(const std::string& vertex_source_str, const std::string& fragment_source_str);
+    explicit shader(const std::string& compute_source_str);
     ~shader();
 
     void set(const std::string& name, bool value);
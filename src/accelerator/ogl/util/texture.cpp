@@ -27,12 +27,24 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
+#include <cstdint>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 static GLenum FORMAT[]             = {0, GL_RED, GL_RG, GL_BGR, GL_BGRA};
-static GLenum INTERNAL_FORMAT[][5] = {{0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8}, {0, GL_R16, GL_RG16, GL_RGB16, GL_RGBA16}};
+static GLenum INTERNAL_FORMAT[][5] = {{0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8},
+                                      {0, GL_R16, GL_RG16, GL_RGB16, GL_RGBA16},
+                                      {0, GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F}};
 static GLenum TYPE[][5] = {{0, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_8_8_8_8_REV},
-                           {0, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT}};
+                           {0, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT},
+                           {0, GL_HALF_FLOAT, GL_HALF_FLOAT, GL_HALF_FLOAT, GL_HALF_FLOAT}};
+
+// The row of the tables above, integer depths above 8 bits being sampled from 16 bits
+static int depth_index(common::bit_depth depth)
+{
+    return depth == common::bit_depth::bit8 ? 0 : depth == common::bit_depth::float16 ? 2 : 1;
+}
 
 struct texture::impl
 {
@@ -41,31 +53,92 @@ struct texture::impl
     GLsizei           height_ = 0;
     GLsizei           stride_ = 0;
     GLsizei           size_   = 0;
+    GLsizei           levels_ = 1;
     common::bit_depth depth_;
+    GLenum            compressed_ = 0; // The internal format of a block compressed texture
+
+    // The writes of another context that have to be done before the texture is used, see texture::fence
+    mutable GLsync written_ = nullptr;
 
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
   public:
-    impl(int width, int height, int stride, common::bit_depth depth)
+    impl(int width, int height, int stride, common::bit_depth depth, bool mipmapped)
         : width_(width)
         , height_(height)
         , stride_(stride)
         , depth_(depth)
         , size_(width * height * stride * (depth == common::bit_depth::bit8 ? 1 : 2))
+    {
+        if (mipmapped) {
+            // Down to a level of a single texel, which adds up to a third of the first level
+            while ((std::max(width_, height_) >> levels_) > 0) {
+                ++levels_;
+            }
+            size_ += size_ / 3;
+        }
+
+        create(INTERNAL_FORMAT[depth_index(depth_)][stride_]);
+    }
+
+    impl(int width, int height, core::pixel_format format)
+        : width_(width)
+        , height_(height)
+        , stride_(4)
+        , size_(core::block_compressed_size(format, width, height))
+        , depth_(common::bit_depth::bit8)
+        , compressed_(format == core::pixel_format::bc1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                                        : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+    {
+        while ((std::max(width_, height_) >> levels_) > 0) {
+            ++levels_;
+        }
+
+        create(compressed_);
+    }
+
+    void create(GLenum internal_format)
     {
         GL(glCreateTextures(GL_TEXTURE_2D, 1, &id_));
-        GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, levels_ > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-        GL(glTextureStorage2D(
-            id_, 1, INTERNAL_FORMAT[depth_ == common::bit_depth::bit8 ? 0 : 1][stride_], width_, height_));
+        GL(glTextureStorage2D(id_, levels_, internal_format, width_, height_));
+    }
+
+    ~impl()
+    {
+        if (written_) {
+            glDeleteSync(written_);
+        }
+        glDeleteTextures(1, &id_);
     }
 
-    ~impl() { glDeleteTextures(1, &id_); }
+    void wait() const
+    {
+        if (written_) {
+            GL(glWaitSync(written_, 0, GL_TIMEOUT_IGNORED));
+            glDeleteSync(written_);
+            written_ = nullptr;
+        }
+    }
+
+    void fence()
+    {
+        wait();
+        written_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // The fence is waited on from another context, so it has to reach the GPU from this one
+        GL(glFlush());
+    }
 
-    void bind() { GL(glBindTexture(GL_TEXTURE_2D, id_)); }
+    void bind()
+    {
+        wait();
+        GL(glBindTexture(GL_TEXTURE_2D, id_));
+    }
 
     void bind(int index)
     {
@@ -75,25 +148,148 @@ struct texture::impl
 
     void unbind() { GL(glBindTexture(GL_TEXTURE_2D, 0)); }
 
-    void attach() { GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, id_, 0)); }
+    void attach()
+    {
+        wait();
+        GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, id_, 0));
+    }
 
     void clear()
     {
-        GL(glClearTexImage(id_, 0, FORMAT[stride_], TYPE[depth_ == common::bit_depth::bit8 ? 0 : 1][stride_], nullptr));
+        wait();
+        GL(glClearTexImage(id_, 0, FORMAT[stride_], TYPE[depth_index(depth_)][stride_], nullptr));
+    }
+
+    void clear(int x, int y, int width, int height)
+    {
+        wait();
+        GL(glClearTexSubImage(
+            id_, 0, x, y, 0, width, height, 1, FORMAT[stride_], TYPE[depth_index(depth_)][stride_], nullptr));
+    }
+
+    void clear(int x, int y, int width, int height, const std::array<float, 4>& color)
+    {
+        wait();
+        GL(glClearTexSubImage(id_, 0, x, y, 0, width, height, 1, FORMAT[stride_], GL_FLOAT, color.data()));
     }
 
-#ifdef WIN32
     void copy_from(int texture_id)
     {
-        GL(glCopyImageSubData(
-            texture_id, GL_TEXTURE_2D, 0, 0, 0, 0, id_, GL_TEXTURE_2D, 0, 0, 0, 0, width_, height_, 1));
+        // Blitted rather than copied texel by texel, so that textures of other component orders are converted, such
+        // as those imported from other graphics APIs
+        wait();
+        GLuint framebuffers[2];
+        GL(glCreateFramebuffers(2, framebuffers));
+        GL(glNamedFramebufferTexture(framebuffers[0], GL_COLOR_ATTACHMENT0, texture_id, 0));
+        GL(glNamedFramebufferTexture(framebuffers[1], GL_COLOR_ATTACHMENT0, id_, 0));
+        GL(glBlitNamedFramebuffer(framebuffers[0],
+                                  framebuffers[1],
+                                  0,
+                                  0,
+                                  width_,
+                                  height_,
+                                  0,
+                                  0,
+                                  width_,
+                                  height_,
+                                  GL_COLOR_BUFFER_BIT,
+                                  GL_NEAREST));
+        GL(glDeleteFramebuffers(2, framebuffers));
+    }
+
+    void downscale_from(const impl& src)
+    {
+        // Blits are clipped by the scissor, which a draw may have set for its target
+        auto scissor = glIsEnabled(GL_SCISSOR_TEST);
+        GL(glDisable(GL_SCISSOR_TEST));
+
+        src.wait();
+        wait();
+
+        GLuint framebuffers[2];
+        GL(glCreateFramebuffers(2, framebuffers));
+        GL(glNamedFramebufferTexture(framebuffers[0], GL_COLOR_ATTACHMENT0, src.id_, 0));
+        GL(glNamedFramebufferTexture(framebuffers[1], GL_COLOR_ATTACHMENT0, id_, 0));
+        GL(glBlitNamedFramebuffer(framebuffers[0],
+                                  framebuffers[1],
+                                  0,
+                                  0,
+                                  src.width_,
+                                  src.height_,
+                                  0,
+                                  0,
+                                  width_,
+                                  height_,
+                                  GL_COLOR_BUFFER_BIT,
+                                  GL_LINEAR));
+        GL(glDeleteFramebuffers(2, framebuffers));
+
+        if (scissor) {
+            GL(glEnable(GL_SCISSOR_TEST));
+        }
+
+        if (levels_ > 1) {
+            GL(glGenerateTextureMipmap(id_));
+        }
+    }
+
+    void copy_from(const impl& src)
+    {
+        src.wait();
+        wait();
+        GL(glCopyImageSubData(src.id_, GL_TEXTURE_2D, 0, 0, 0, 0, id_, GL_TEXTURE_2D, 0, 0, 0, 0, width_, height_, 1));
+    }
+
+    void copy_from(buffer& src, int offset, int x, int y, int width, int height)
+    {
+        wait();
+        src.bind();
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, (width * stride_) % 4 > 0 ? 1 : 4);
+
+        GL(glTextureSubImage2D(id_,
+                               0,
+                               x,
+                               y,
+                               width,
+                               height,
+                               FORMAT[stride_],
+                               TYPE[depth_index(depth_)][stride_],
+                               reinterpret_cast<const void*>(static_cast<intptr_t>(offset))));
+
+        src.unbind();
     }
-#endif
 
     void copy_from(buffer& src)
     {
+        wait();
         src.bind();
 
+        if (compressed_) {
+            // The blocks of each level follow those of the level before
+            const auto block_bytes = compressed_ == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+
+            GLsizei offset = 0;
+            for (GLsizei level = 0; level < levels_; ++level) {
+                const auto width  = std::max(1, width_ >> level);
+                const auto height = std::max(1, height_ >> level);
+                const auto size   = (width + 3) / 4 * ((height + 3) / 4) * block_bytes;
+                GL(glCompressedTextureSubImage2D(id_,
+                                                 level,
+                                                 0,
+                                                 0,
+                                                 width,
+                                                 height,
+                                                 compressed_,
+                                                 size,
+                                                 reinterpret_cast<const void*>(static_cast<intptr_t>(offset))));
+                offset += size;
+            }
+
+            src.unbind();
+            return;
+        }
+
         if (width_ % 16 > 0) {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         } else {
@@ -107,7 +303,7 @@ struct texture::impl
                                width_,
                                height_,
                                FORMAT[stride_],
-                               TYPE[depth_ == common::bit_depth::bit8 ? 0 : 1][stride_],
+                               TYPE[depth_index(depth_)][stride_],
                                nullptr));
 
         src.unbind();
@@ -115,15 +311,19 @@ struct texture::impl
 
     void copy_to(buffer& dst)
     {
+        wait();
         dst.bind();
-        GL(glGetTextureImage(
-            id_, 0, FORMAT[stride_], TYPE[depth_ == common::bit_depth::bit8 ? 0 : 1][stride_], size_, nullptr));
+        GL(glGetTextureImage(id_, 0, FORMAT[stride_], TYPE[depth_index(depth_)][stride_], size_, nullptr));
         dst.unbind();
     }
 };
 
-texture::texture(int width, int height, int stride, common::bit_depth depth)
-    : impl_(new impl(width, height, stride, depth))
+texture::texture(int width, int height, int stride, common::bit_depth depth, bool mipmapped)
+    : impl_(new impl(width, height, stride, depth, mipmapped))
+{
+}
+texture::texture(int width, int height, core::pixel_format format)
+    : impl_(new impl(width, height, format))
 {
 }
 texture::texture(texture&& other)
@@ -140,16 +340,27 @@ void texture::bind(int index) { impl_->bind(index); }
 void texture::unbind() { impl_->unbind(); }
 void texture::attach() { impl_->attach(); }
 void texture::clear() { impl_->clear(); }
-#ifdef WIN32
-void texture::copy_from(int source) { impl_->copy_from(source); }
-#endif
+void texture::clear(int x, int y, int width, int height) { impl_->clear(x, y, width, height); }
+void texture::clear(int x, int y, int width, int height, const std::array<float, 4>& color)
+{
+    impl_->clear(x, y, width, height, color);
+}
+void              texture::copy_from(int source) { impl_->copy_from(source); }
+void              texture::copy_from(const texture& source) { impl_->copy_from(*source.impl_); }
+void              texture::downscale_from(const texture& source) { impl_->downscale_from(*source.impl_); }
 void              texture::copy_from(buffer& source) { impl_->copy_from(source); }
+void texture::copy_from(buffer& source, int offset, int x, int y, int width, int height)
+{
+    impl_->copy_from(source, offset, x, y, width, height);
+}
 void              texture::copy_to(buffer& dest) { impl_->copy_to(dest); }
+void              texture::fence() { impl_->fence(); }
 int               texture::width() const { return impl_->width_; }
 int               texture::height() const { return impl_->height_; }
 int               texture::stride() const { return impl_->stride_; }
 common::bit_depth texture::depth() const { return impl_->depth_; }
 int               texture::size() const { return impl_->size_; }
 int               texture::id() const { return impl_->id_; }
+bool              texture::mipmapped() const { return impl_->levels_ > 1; }
 
 }}} // namespace caspar::accelerator::ogl
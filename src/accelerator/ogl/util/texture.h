@@ -22,6 +22,10 @@
 #pragma once
 
 #include <common/bit_depth.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <array>
 #include <memory>
 
 namespace caspar { namespace accelerator { namespace ogl {
@@ -29,7 +33,15 @@ namespace caspar { namespace accelerator { namespace ogl {
 class texture final
 {
   public:
-    texture(int width, int height, int stride, common::bit_depth depth = common::bit_depth::bit8);
+    // A mipmapped texture is sampled from its smaller levels when drawn at a fraction of its size
+    texture(int               width,
+            int               height,
+            int               stride,
+            common::bit_depth depth     = common::bit_depth::bit8,
+            bool              mipmapped = false);
+    // A texture of a block compressed format with all its mip levels, see core::is_block_compressed, which is only
+    // sampled and uploaded to by copy_from(buffer&)
+    texture(int width, int height, core::pixel_format format);
     texture(const texture&) = delete;
     texture(texture&& other);
     ~texture();
@@ -37,14 +49,24 @@ class texture final
     texture& operator=(const texture&) = delete;
     texture& operator=(texture&& other);
 
-#ifdef WIN32
     void copy_from(int source);
-#endif
+    void copy_from(const texture& source);
     void copy_from(class buffer& source);
+    // Uploads an area of the texture from tightly packed rows at offset in source
+    void copy_from(class buffer& source, int offset, int x, int y, int width, int height);
+    // Scales source down to this texture with a linear filter, and generates the smaller levels if mipmapped
+    void downscale_from(const texture& source);
     void copy_to(class buffer& dest);
 
+    // Marks the texture as written by the context of the calling thread. The next use of it on another context then
+    // waits for those writes on the GPU, without blocking the thread.
+    void fence();
+
     void attach();
     void clear();
+    void clear(int x, int y, int width, int height);
+    // Fills an area with one colour, given in the order of the components of the texture, e.g. BGRA
+    void clear(int x, int y, int width, int height, const std::array<float, 4>& color);
     void bind(int index);
     void unbind();
 
@@ -54,6 +76,7 @@ class texture final
     common::bit_depth depth() const;
     int               size() const;
     int               id() const;
+    bool              mipmapped() const;
 
   private:
     struct impl;
@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// casparcg-bench runs channels with synthetic producers into consumers that throw the frames away, as fast as the
+// pipeline allows, and reports how long each stage of it took. Everything it renders is generated from the options, so
+// two builds run with the same options do the same work.
+
+#include <accelerator/accelerator.h>
+
+#include <common/array.h>
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/consumer/channel_info.h>
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/color/color_producer.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace bench {
+
+const double pi = 3.14159265358979323846;
+
+struct options
+{
+    std::wstring config         = L"casparcg-bench.config";
+    std::wstring format         = L"1080p5000";
+    int          channels       = 1;
+    int          colors         = 1;
+    int          stills         = 2;
+    int          videos         = 2;
+    int          frames         = 1000;
+    int          warmup         = 50;
+    int          color_depth    = 8;
+    int          pipeline_depth = 0;
+    int          mixer_depth    = 1;
+    std::string  trace_file;
+};
+
+void print_usage()
+{
+    std::wcout << L"Usage: casparcg-bench [options]\n"
+                  L"  --config <file>          Configuration, for the accelerator and paths (casparcg-bench.config)\n"
+                  L"  --format <video-mode>    Video mode of the channels (1080p5000)\n"
+                  L"  --channels <n>           Channels to run (1)\n"
+                  L"  --colors <n>             Layers of a solid colour per channel (1)\n"
+                  L"  --stills <n>             Layers of a still image per channel (2)\n"
+                  L"  --videos <n>             Layers of an image and audio generated every frame per channel (2)\n"
+                  L"  --frames <n>             Frames measured per channel (1000)\n"
+                  L"  --warmup <n>             Frames run per channel before measuring (50)\n"
+                  L"  --color-depth <8|16>     Color depth of the channels (8)\n"
+                  L"  --pipeline-depth <n>     Pipeline depth of the channels (0)\n"
+                  L"  --mixer-depth <n>        Mixer depth of the channels (1)\n"
+                  L"  --trace <file>           Also writes the measured frames as a Chrome trace, for Perfetto\n";
+}
+
+options parse_options(int argc, char** argv)
+{
+    options result;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string name = argv[n];
+        if (name == "--help" || name == "-h") {
+            print_usage();
+            std::exit(0);
+        }
+        if (n + 1 >= argc) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value of " + name));
+        }
+        std::string value = argv[++n];
+
+        auto to_int = [&](int min, int max) {
+            auto number = boost::lexical_cast<int>(value);
+            if (number < min || number > max) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid " + name + ": " + value));
+            }
+            return number;
+        };
+
+        if (name == "--config") {
+            result.config = u16(value);
+        } else if (name == "--format") {
+            result.format = u16(value);
+        } else if (name == "--channels") {
+            result.channels = to_int(1, 64);
+        } else if (name == "--colors") {
+            result.colors = to_int(0, 100);
+        } else if (name == "--stills") {
+            result.stills = to_int(0, 100);
+        } else if (name == "--videos") {
+            result.videos = to_int(0, 100);
+        } else if (name == "--frames") {
+            result.frames = to_int(1, 1000000);
+        } else if (name == "--warmup") {
+            result.warmup = to_int(0, 1000000);
+        } else if (name == "--color-depth") {
+            result.color_depth = to_int(8, 16);
+        } else if (name == "--pipeline-depth") {
+            result.pipeline_depth = to_int(0, 4);
+        } else if (name == "--mixer-depth") {
+            result.mixer_depth = to_int(1, 4);
+        } else if (name == "--trace") {
+            result.trace_file = value;
+        } else {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown option " + name));
+        }
+    }
+
+    if (result.color_depth != 8 && result.color_depth != 16) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid --color-depth, must be 8 or 16"));
+    }
+
+    return result;
+}
+
+// A full frame image, which is generated once when still and every frame otherwise, along with a tone on every audio
+// channel, as a decoder would deliver them
+class synthetic_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::video_format_desc              format_desc_;
+    const bool                                 still_;
+    const std::uint32_t                        seed_;
+    core::draw_frame                           frame_;
+    std::int64_t                               frame_count_  = 0;
+    std::int64_t                               sample_count_ = 0;
+
+  public:
+    synthetic_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                       const core::video_format_desc&              format_desc,
+                       bool                                        still,
+                       std::uint32_t                               seed)
+        : frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , still_(still)
+        , seed_(seed)
+    {
+        if (still_) {
+            frame_ = generate(0);
+        }
+    }
+
+    core::draw_frame generate(int nb_samples)
+    {
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, format_desc_.height, 4));
+        auto frame = frame_factory_->create_frame(this, desc);
+
+        // Diagonal bands that move along by a pixel a frame
+        auto dest = reinterpret_cast<std::uint32_t*>(frame.image_data(0).data());
+        for (int y = 0; y < format_desc_.height; ++y) {
+            auto row = dest + static_cast<size_t>(y) * format_desc_.width;
+            for (int x = 0; x < format_desc_.width; ++x) {
+                auto band = static_cast<std::uint32_t>((x + y + frame_count_) / 64);
+                row[x]    = 0xFF000000 | ((band * 0x9E3779B9u + seed_) & 0x00FFFFFF);
+            }
+        }
+
+        if (nb_samples > 0) {
+            std::vector<std::int32_t> samples(static_cast<size_t>(nb_samples) * format_desc_.audio_channels);
+            for (int n = 0; n < nb_samples; ++n) {
+                auto t     = static_cast<double>(sample_count_ + n) / format_desc_.audio_sample_rate;
+                auto tone  = 440.0 + seed_ % 8 * 55.0;
+                auto value = static_cast<std::int32_t>(std::sin(2.0 * pi * tone * t) * 0x10000000);
+                std::fill_n(samples.begin() + static_cast<size_t>(n) * format_desc_.audio_channels,
+                            format_desc_.audio_channels,
+                            value);
+            }
+            frame.audio_data() = array<std::int32_t>(std::move(samples));
+            sample_count_ += nb_samples;
+        }
+
+        frame_count_ += 1;
+        return core::draw_frame(std::move(frame));
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        return still_ ? frame_ : generate(nb_samples);
+    }
+
+    std::wstring print() const override { return L"synthetic[" + std::wstring(still_ ? L"still" : L"video") + L"]"; }
+
+    std::wstring name() const override { return L"synthetic"; }
+
+    core::monitor::state state() const override { return {}; }
+
+    bool is_ready() override { return true; }
+};
+
+// Reads the mixed image like a consumer would and throws it away. Claiming a clock of its own keeps the channel from
+// pacing itself, so that it runs as fast as it can.
+class null_consumer : public core::frame_consumer
+{
+    std::atomic<std::int64_t> frames_{0};
+    std::uint8_t              checksum_ = 0;
+
+  public:
+    std::future<bool> send(const core::video_field field, core::const_frame frame) override
+    {
+        auto& image = frame.image_data(0);
+        if (image.size() > 0) {
+            checksum_ ^= image.data()[image.size() / 2];
+        }
+
+        if (field != core::video_field::b) {
+            frames_.fetch_add(1, std::memory_order_release);
+        }
+        return make_ready_future(true);
+    }
+
+    void initialize(const core::video_format_desc& format_desc,
+                    const core::channel_info&      channel_info,
+                    int                            port_index) override
+    {
+    }
+
+    std::int64_t frames() const { return frames_.load(std::memory_order_acquire); }
+
+    core::monitor::state state() const override { return {}; }
+    std::wstring         print() const override { return L"null[]"; }
+    std::wstring         name() const override { return L"null"; }
+    bool                 has_synchronization_clock() const override { return true; }
+    int                  index() const override { return 900; }
+};
+
+struct percentiles
+{
+    size_t count = 0;
+    double mean  = 0.0;
+    double p50   = 0.0;
+    double p90   = 0.0;
+    double p99   = 0.0;
+    double max   = 0.0;
+};
+
+percentiles summarise(std::vector<double> values)
+{
+    percentiles result;
+    if (values.empty()) {
+        return result;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    // Nearest rank, so that every reported value is one that was measured
+    auto rank = [&](double p) {
+        auto index = static_cast<size_t>(std::ceil(p * values.size()));
+        return values[std::min(values.size() - 1, index > 0 ? index - 1 : 0)];
+    };
+
+    double sum = 0.0;
+    for (auto value : values) {
+        sum += value;
+    }
+
+    result.count = values.size();
+    result.mean  = sum / values.size();
+    result.p50   = rank(0.50);
+    result.p90   = rank(0.90);
+    result.p99   = rank(0.99);
+    result.max   = values.back();
+    return result;
+}
+
+void print_row(const std::string& name, const percentiles& p)
+{
+    std::cout << std::left << std::setw(16) << name << std::right << std::setw(10) << p.count << std::fixed
+              << std::setprecision(3) << std::setw(10) << p.mean << std::setw(10) << p.p50 << std::setw(10) << p.p90
+              << std::setw(10) << p.p99 << std::setw(10) << p.max << "\n";
+}
+
+int run(const options& opts)
+{
+    core::video_format_repository format_repository;
+    auto                          format_desc = format_repository.find(opts.format);
+    if (format_desc.format == core::video_format::invalid) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + opts.format));
+    }
+
+    accelerator::accelerator accelerator(format_repository);
+
+    // The GPU time of each mix, which the mixer reports as an average over its last frames
+    std::atomic<bool>   measuring{false};
+    std::mutex          gpu_mutex;
+    std::vector<double> gpu_times;
+
+    std::vector<spl::shared_ptr<core::video_channel>> channels;
+    std::vector<spl::shared_ptr<null_consumer>>       consumers;
+
+    for (int index = 1; index <= opts.channels; ++index) {
+        core::video_channel_options channel_options;
+        channel_options.pipeline_depth = opts.pipeline_depth;
+        channel_options.mixer_depth    = opts.mixer_depth;
+
+        auto depth   = opts.color_depth == 16 ? common::bit_depth::bit16 : common::bit_depth::bit8;
+        auto channel = spl::make_shared<core::video_channel>(
+            index,
+            format_desc,
+            core::color_space::bt709,
+            accelerator.create_image_mixer(index, depth),
+            [&](core::monitor::state state) {
+                if (!measuring) {
+                    return;
+                }
+                for (auto& entry : state) {
+                    if (entry.first == "mixer/image/gpu/total" && !entry.second.empty()) {
+                        if (auto value = boost::get<double>(&entry.second.front())) {
+                            std::lock_guard<std::mutex> lock(gpu_mutex);
+                            gpu_times.push_back(*value);
+                        }
+                    }
+                }
+            },
+            channel_options);
+
+        auto frame_factory = channel->frame_factory();
+        auto stage         = channel->stage();
+
+        // Every layer but the bottom one is translucent, so that the mixer cannot cull those below it
+        int layer = 0;
+        auto add  = [&](const spl::shared_ptr<core::frame_producer>& producer) {
+            stage->load(layer, producer).get();
+            stage->play(layer).get();
+            if (layer > 0) {
+                stage
+                    ->apply_transform(
+                        layer,
+                        [](core::frame_transform transform) {
+                            transform.image_transform.opacity = 0.5;
+                            return transform;
+                        },
+                        0,
+                        tweener(L"linear"))
+                    .get();
+            }
+            layer += 1;
+        };
+
+        for (int n = 0; n < opts.colors; ++n) {
+            add(core::create_color_producer(frame_factory, 0xFF202020u + static_cast<std::uint32_t>(n) * 0x00102030u));
+        }
+        for (int n = 0; n < opts.stills; ++n) {
+            add(spl::make_shared<synthetic_producer>(frame_factory, format_desc, true, index * 100 + layer));
+        }
+        for (int n = 0; n < opts.videos; ++n) {
+            add(spl::make_shared<synthetic_producer>(frame_factory, format_desc, false, index * 100 + layer));
+        }
+
+        auto consumer = spl::make_shared<null_consumer>();
+        channel->output().add(consumer);
+
+        channels.push_back(channel);
+        consumers.push_back(consumer);
+    }
+
+    auto wait_for_frames = [&](std::int64_t frames) {
+        for (auto& consumer : consumers) {
+            while (consumer->frames() < frames) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    };
+
+    wait_for_frames(opts.warmup);
+
+    std::vector<std::int64_t> start_frames;
+    for (auto& consumer : consumers) {
+        start_frames.push_back(consumer->frames());
+    }
+
+    diagnostics::trace::start(std::max<size_t>(65536, static_cast<size_t>(opts.frames) * 64));
+    measuring       = true;
+    auto start_time = std::chrono::steady_clock::now();
+
+    for (size_t n = 0; n < consumers.size(); ++n) {
+        while (consumers[n]->frames() < start_frames[n] + opts.frames) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    measuring    = false;
+
+    auto events = diagnostics::trace::stop_events();
+    if (!opts.trace_file.empty()) {
+        std::ofstream(opts.trace_file, std::ios::binary) << diagnostics::trace::stop();
+    }
+
+    // The channels are torn down before reporting, so that their threads are done with the GPU times
+    channels.clear();
+    consumers.clear();
+
+    std::map<std::string, std::vector<double>> durations;
+    for (auto& event : events) {
+        durations[event.name].push_back(static_cast<double>(event.end - event.start) / 1000000.0);
+    }
+
+    auto frames_per_second = static_cast<double>(opts.frames) * opts.channels / elapsed;
+    auto realtime          = static_cast<double>(opts.frames) / elapsed / format_desc.fps;
+
+    std::cout << "casparcg-bench " << u8(env::version()) << "\n";
+    std::cout << "format " << u8(format_desc.name) << ", " << opts.channels << " channels, " << opts.colors
+              << " colors, " << opts.stills << " stills, " << opts.videos << " videos, color depth "
+              << opts.color_depth << ", pipeline depth " << opts.pipeline_depth << ", mixer depth "
+              << opts.mixer_depth << "\n";
+    std::cout << std::fixed << std::setprecision(2) << opts.frames << " frames per channel in " << elapsed << " s, "
+              << frames_per_second << " frames/s, " << realtime << "x real time\n\n";
+
+    std::cout << std::left << std::setw(16) << "ms" << std::right << std::setw(10) << "count" << std::setw(10)
+              << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(10) << "max" << "\n";
+    for (auto& duration : durations) {
+        print_row(duration.first, summarise(duration.second));
+    }
+    {
+        std::lock_guard<std::mutex> lock(gpu_mutex);
+        print_row("gpu", summarise(gpu_times));
+    }
+
+    return 0;
+}
+
+}} // namespace caspar::bench
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    try {
+        auto opts = bench::parse_options(argc, argv);
+
+        log::add_cout_sink();
+        env::configure(opts.config);
+        log::set_log_level(env::properties().get(L"configuration.log-level", L"warning"));
+
+        return bench::run(opts);
+    } catch (user_error&) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        bench::print_usage();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+    return 1;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+namespace caspar { namespace bench {
+
+namespace {
+
+struct benchmark
+{
+    std::string                 name;
+    std::function<void(state&)> body;
+};
+
+// Function local, as the registrars of the other translation units may run before the globals of this one are built
+std::vector<benchmark>& benchmarks()
+{
+    static std::vector<benchmark> instance;
+    return instance;
+}
+
+std::string format_rate(double per_second, const char* unit)
+{
+    const char* prefixes[] = {"", "k", "M", "G", "T"};
+    int         prefix     = 0;
+    while (per_second >= 1000.0 && prefix < 4) {
+        per_second /= 1000.0;
+        prefix += 1;
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << per_second << " " << prefixes[prefix] << unit << "/s";
+    return out.str();
+}
+
+std::string format_time(double seconds)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(seconds < 1e-6 ? 1 : 3);
+    if (seconds < 1e-6) {
+        out << seconds * 1e9 << " ns";
+    } else if (seconds < 1e-3) {
+        out << seconds * 1e6 << " us";
+    } else {
+        out << seconds * 1e3 << " ms";
+    }
+    return out.str();
+}
+
+} // namespace
+
+void register_benchmark(std::string name, std::function<void(state&)> body)
+{
+    benchmarks().push_back(benchmark{std::move(name), std::move(body)});
+}
+
+const std::vector<std::wstring>& video_modes()
+{
+    static const std::vector<std::wstring> modes = {L"720p5000", L"1080i5000", L"1080p5000", L"2160p5000"};
+    return modes;
+}
+
+core::video_format_desc video_mode(const std::wstring& name)
+{
+    static const core::video_format_repository repository;
+    return repository.find(name);
+}
+
+}} // namespace caspar::bench
+
+int main(int argc, char** argv)
+{
+    using namespace caspar::bench;
+
+    std::string filter;
+    double      min_time = 0.5;
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+        if (arg == "--filter" && n + 1 < argc) {
+            filter = argv[++n];
+        } else if (arg == "--min-time" && n + 1 < argc) {
+            min_time = std::atof(argv[++n]);
+        } else if (arg == "--list") {
+            for (auto& benchmark : benchmarks()) {
+                std::cout << benchmark.name << "\n";
+            }
+            return 0;
+        } else {
+            std::cout << "Usage: casparcg-microbench [--filter <substring>] [--min-time <seconds>] [--list]\n";
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::cout << std::left << std::setw(48) << "Benchmark" << std::right << std::setw(14) << "Time"
+              << std::setw(12) << "Iterations" << std::setw(16) << "Bytes" << std::setw(16) << "Items" << "\n";
+    std::cout << std::string(106, '-') << "\n";
+
+    std::sort(benchmarks().begin(), benchmarks().end(), [](auto& a, auto& b) { return a.name < b.name; });
+
+    for (auto& benchmark : benchmarks()) {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        try {
+            // Grows the iterations until a run takes min_time, aiming a little past it from the last run
+            std::int64_t           iterations = 1;
+            std::unique_ptr<state> result;
+            while (true) {
+                result = std::make_unique<state>(iterations);
+                benchmark.body(*result);
+
+                auto seconds = result->seconds();
+                if (seconds >= min_time || iterations >= 1000000000) {
+                    break;
+                }
+                auto factor = seconds > 0.0 ? min_time * 1.4 / seconds : 100.0;
+                iterations  = std::max(iterations + 1, static_cast<std::int64_t>(iterations * std::min(factor, 100.0)));
+            }
+
+            auto seconds = result->seconds();
+            auto bytes   = result->bytes_processed() > 0 ? format_rate(result->bytes_processed() / seconds, "B") : "";
+            auto items = result->items_processed() > 0 ? format_rate(result->items_processed() / seconds, "items") : "";
+            std::cout << std::left << std::setw(48) << benchmark.name << std::right << std::setw(14)
+                      << format_time(seconds / result->iterations()) << std::setw(12) << result->iterations()
+                      << std::setw(16) << bytes << std::setw(16) << items << "\n";
+        } catch (const std::exception& e) {
+            std::cout << std::left << std::setw(48) << benchmark.name << " failed: " << e.what() << "\n";
+        }
+    }
+
+    return 0;
+}
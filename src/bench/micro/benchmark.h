@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/video_format.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A minimal harness in the manner of Google Benchmark, which runs the body of a benchmark for more and more iterations
+// until they take long enough to be timed, and reports the time of one of them.
+namespace caspar { namespace bench {
+
+class state
+{
+    const std::int64_t                    iterations_;
+    std::int64_t                          remaining_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point end_;
+    std::int64_t                          bytes_ = 0;
+    std::int64_t                          items_ = 0;
+
+  public:
+    explicit state(std::int64_t iterations)
+        : iterations_(iterations)
+        , remaining_(iterations)
+    {
+    }
+
+    // Runs the body of the benchmark, while (state.keep_running()) { ... }. Whatever comes before the loop is setup,
+    // which is not timed.
+    bool keep_running()
+    {
+        if (remaining_ == iterations_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+        if (remaining_-- > 0) {
+            return true;
+        }
+        end_ = std::chrono::steady_clock::now();
+        return false;
+    }
+
+    std::int64_t iterations() const { return iterations_; }
+
+    // What all of the iterations processed, reported per second
+    void set_bytes_processed(std::int64_t bytes) { bytes_ = bytes; }
+    void set_items_processed(std::int64_t items) { items_ = items; }
+
+    std::int64_t bytes_processed() const { return bytes_; }
+    std::int64_t items_processed() const { return items_; }
+    double       seconds() const { return std::chrono::duration<double>(end_ - start_).count(); }
+};
+
+// Keeps the compiler from optimising away what is computed for value
+template <typename T>
+void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+void register_benchmark(std::string name, std::function<void(state&)> body);
+
+// Registers a benchmark when the binary starts, e.g. static registrar memshfl("memshfl/1080p5000", [](state& s) {...})
+struct registrar
+{
+    registrar(std::string name, std::function<void(state&)> body)
+    {
+        register_benchmark(std::move(name), std::move(body));
+    }
+};
+
+// The video modes the kernels are benchmarked at
+const std::vector<std::wstring>& video_modes();
+
+core::video_format_desc video_mode(const std::wstring& name);
+
+}} // namespace caspar::bench
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark.h"
+
+#include <common/memory.h>
+#include <common/memshfl.h>
+#include <common/utf.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace caspar { namespace bench {
+
+namespace {
+
+// BGRA to ARGB, as the key and fill conversions shuffle bytes
+const bool registered = [] {
+    for (auto& mode : video_modes()) {
+        for (int depth : {8, 16}) {
+            register_benchmark("aligned_memshfl/" + u8(mode) + "/" + std::to_string(depth) + "bit", [=](state& s) {
+                auto format_desc = video_mode(mode);
+                auto size        = static_cast<size_t>(format_desc.width) * format_desc.height * 4 * (depth / 8);
+                auto source      = create_aligned_buffer(size);
+                auto dest        = create_aligned_buffer(size);
+                std::memset(source.get(), 0x55, size);
+                std::memset(dest.get(), 0, size);
+
+                while (s.keep_running()) {
+                    aligned_memshfl(dest.get(), source.get(), size, 0x0C0F0E0D, 0x080B0A09, 0x04070605, 0x00030201);
+                    do_not_optimize(dest.get());
+                }
+                s.set_bytes_processed(static_cast<std::int64_t>(size) * s.iterations());
+                s.set_items_processed(s.iterations());
+            });
+        }
+    }
+    return true;
+}();
+
+} // namespace
+
+}} // namespace caspar::bench
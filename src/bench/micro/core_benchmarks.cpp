@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark.h"
+
+#include <common/array.h>
+#include <common/diagnostics/graph.h>
+#include <common/memory.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/monitor/monitor.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace bench {
+
+namespace {
+
+// A frame of audio for each item, mixed like a channel mixes its layers
+const bool audio_mixer_registered = [] {
+    for (int items : {1, 8, 32}) {
+        for (int channels : {2, 16}) {
+            auto name = "audio_mixer/items:" + std::to_string(items) + "/channels:" + std::to_string(channels);
+            register_benchmark(name, [=](state& s) {
+                auto format_desc = video_mode(L"1080p5000");
+                auto nb_samples  = format_desc.audio_cadence.front();
+
+                std::vector<int>               tags(items);
+                std::vector<core::const_frame> frames;
+                for (int n = 0; n < items; ++n) {
+                    std::vector<std::int32_t> samples(static_cast<size_t>(nb_samples) * channels);
+                    for (size_t i = 0; i < samples.size(); ++i) {
+                        samples[i] = static_cast<std::int32_t>((i * 7919 + n * 104729) % 0x10000000);
+                    }
+                    core::mutable_frame frame(&tags[n],
+                                              {},
+                                              array<std::int32_t>(std::move(samples)),
+                                              core::pixel_format_desc(core::pixel_format::invalid));
+                    frame.audio_channels() = channels;
+                    frames.push_back(core::const_frame(std::move(frame)));
+                }
+
+                core::frame_transform transform;
+                transform.audio_transform.volume = 0.5;
+
+                core::audio_mixer mixer(spl::make_shared<diagnostics::graph>());
+                while (s.keep_running()) {
+                    for (int n = 0; n < items; ++n) {
+                        mixer.set_layer(n);
+                        mixer.push(transform);
+                        mixer.visit(frames[n]);
+                        mixer.pop();
+                    }
+                    auto result = mixer(format_desc, nb_samples);
+                    do_not_optimize(result.data());
+                }
+                s.set_items_processed(static_cast<std::int64_t>(items) * nb_samples * s.iterations());
+            });
+        }
+    }
+    return true;
+}();
+
+// The state of a channel, built like the stage, the layers and their producers build it every frame
+const bool monitor_state_registered = [] {
+    for (int layers : {1, 10, 50}) {
+        register_benchmark("monitor_state/layers:" + std::to_string(layers), [=](state& s) {
+            std::int64_t frame_number = 0;
+            while (s.keep_running()) {
+                core::monitor::state stage;
+                stage["frame"] = frame_number;
+                for (int n = 0; n < layers; ++n) {
+                    core::monitor::state producer;
+                    producer["file/name"]       = std::string("media/clip-") + std::to_string(n) + ".mov";
+                    producer["file/time"]       = {frame_number / 50.0, 3600.0};
+                    producer["file/clip"]       = {0.0, 3600.0};
+                    producer["frame"]           = {static_cast<std::int64_t>(frame_number), std::int64_t(180000)};
+                    producer["loop"]            = false;
+                    producer["paused"]          = false;
+                    producer["preroll/frames"]  = 8;
+                    producer["preroll/ready"]   = true;
+                    producer["streams/0/fps"]   = {50, 1};
+                    producer["streams/0/codec"] = std::string("prores");
+
+                    core::monitor::state layer;
+                    layer["foreground"]             = producer;
+                    layer["foreground"]["producer"] = std::string("ffmpeg");
+                    layer["foreground"]["paused"]   = false;
+                    layer["background"]["producer"] = std::string("empty");
+
+                    stage["layer"][n] = layer;
+                }
+
+                core::monitor::state channel;
+                channel["stage"]     = stage;
+                channel["framerate"] = {50, 1};
+                channel["format"]    = std::string("1080p5000");
+                do_not_optimize(channel);
+
+                frame_number += 1;
+            }
+            s.set_items_processed(static_cast<std::int64_t>(layers) * s.iterations());
+        });
+    }
+    return true;
+}();
+
+} // namespace
+
+}} // namespace caspar::bench
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark.h"
+
+#include <common/array.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+
+#include <modules/decklink/consumer/config.h>
+#include <modules/decklink/consumer/frame.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace bench {
+
+namespace {
+
+core::const_frame make_mixed_frame(const core::video_format_desc& format_desc, bool hdr)
+{
+    auto depth = hdr ? common::bit_depth::bit16 : common::bit_depth::bit8;
+
+    core::pixel_format_desc desc(core::pixel_format::bgra);
+    desc.planes.push_back(core::pixel_format_desc::plane(format_desc.width, format_desc.height, 4, depth));
+
+    std::vector<std::uint8_t> image(desc.planes[0].size);
+    for (size_t n = 0; n < image.size(); ++n) {
+        image[n] = static_cast<std::uint8_t>(n * 31 + n / 4096);
+    }
+
+    std::vector<array<const std::uint8_t>> planes;
+    planes.push_back(array<const std::uint8_t>(std::move(image)));
+    return core::const_frame(nullptr, std::move(planes), array<const std::int32_t>(), desc);
+}
+
+// The conversion of a mixed frame into the buffer a DeckLink card plays, of the fill and of the key
+const bool registered = [] {
+    for (auto& mode : video_modes()) {
+        for (bool hdr : {false, true}) {
+            for (bool key_only : {false, true}) {
+                auto name = std::string(key_only ? "decklink_convert_to_key_only/" : "decklink_convert_frame/") +
+                            u8(mode) + (hdr ? "/16bit" : "/8bit");
+                register_benchmark(name, [=](state& s) {
+                    auto format_desc = video_mode(mode);
+                    auto frame       = make_mixed_frame(format_desc, hdr);
+
+                    decklink::port_configuration config;
+                    config.key_only = key_only;
+                    config.format   = format_desc;
+
+                    auto field_dominance = format_desc.field_count == 2 ? bmdUpperFieldFirst : bmdProgressiveFrame;
+
+                    decklink::frame_pool pool(format_desc, hdr, 4);
+                    while (s.keep_running()) {
+                        auto buffer = decklink::convert_frame_for_port(
+                            pool, format_desc, format_desc, config, frame, frame, field_dominance, hdr);
+                        do_not_optimize(buffer.get());
+                    }
+                    s.set_bytes_processed(static_cast<std::int64_t>(frame.image_data(0).size()) * s.iterations());
+                    s.set_items_processed(static_cast<std::int64_t>(format_desc.width) * format_desc.height *
+                                          s.iterations());
+                });
+            }
+        }
+    }
+    return true;
+}();
+
+} // namespace
+
+}} // namespace caspar::bench
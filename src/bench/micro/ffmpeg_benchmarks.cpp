@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark.h"
+
+#include <common/array.h>
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+
+#include <modules/ffmpeg/util/av_assert.h>
+#include <modules/ffmpeg/util/av_util.h>
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace bench {
+
+namespace {
+
+// Makes frames in host memory, so that what is timed is the copy into them rather than an upload
+class memory_frame_factory : public core::frame_factory
+{
+  public:
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> planes;
+        for (auto& plane : desc.planes) {
+            planes.push_back(array<std::uint8_t>(plane.size));
+        }
+        return core::mutable_frame(tag, std::move(planes), array<std::int32_t>(), desc);
+    }
+
+    core::mutable_frame
+    create_frame(const void* tag, const core::pixel_format_desc& desc, common::bit_depth depth) override
+    {
+        return create_frame(tag, desc);
+    }
+
+    core::mutable_frame import_frame(const void* tag, const core::shared_texture& texture) override
+    {
+        CASPAR_THROW_EXCEPTION(not_implemented());
+    }
+
+    core::mutable_frame update_frame(const void*                           tag,
+                                     const core::const_frame&              previous,
+                                     const core::pixel_format_desc&        desc,
+                                     const array<const std::uint8_t>&      image,
+                                     const std::vector<core::damage_rect>& damage) override
+    {
+        CASPAR_THROW_EXCEPTION(not_implemented());
+    }
+};
+
+struct pixel_format
+{
+    const char*   name;
+    AVPixelFormat format;
+};
+
+// A decoded frame is copied plane by plane into a frame of the frame factory, unless it was decoded into one already
+const bool registered = [] {
+    const pixel_format formats[] = {
+        {"yuv420p", AV_PIX_FMT_YUV420P},
+        {"yuv422p10le", AV_PIX_FMT_YUV422P10LE},
+        {"bgra", AV_PIX_FMT_BGRA},
+    };
+
+    for (auto& mode : video_modes()) {
+        for (auto& format : formats) {
+            register_benchmark("ffmpeg_make_frame/" + u8(mode) + "/" + format.name, [=](state& s) {
+                auto format_desc = video_mode(mode);
+
+                auto video    = ffmpeg::alloc_frame();
+                video->format = format.format;
+                video->width  = format_desc.width;
+                video->height = format_desc.height;
+                FF(av_frame_get_buffer(video.get(), 64));
+                for (int n = 0; n < AV_NUM_DATA_POINTERS && video->buf[n]; ++n) {
+                    std::memset(video->buf[n]->data, 0x40 + n, video->buf[n]->size);
+                }
+
+                memory_frame_factory frame_factory;
+                std::int64_t         bytes = 0;
+                while (s.keep_running()) {
+                    auto frame = ffmpeg::make_frame(nullptr, frame_factory, video, nullptr);
+                    do_not_optimize(frame.image_data(0).data());
+                    for (size_t n = 0; n < frame.pixel_format_desc().planes.size(); ++n) {
+                        bytes += frame.image_data(n).size();
+                    }
+                }
+                s.set_bytes_processed(bytes);
+                s.set_items_processed(s.iterations());
+            });
+        }
+    }
+    return true;
+}();
+
+} // namespace
+
+}} // namespace caspar::bench
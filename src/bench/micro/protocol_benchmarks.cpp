@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "benchmark.h"
+
+#include <protocol/amcp/amcp_args.h>
+#include <protocol/util/tokenize.h>
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace bench {
+
+namespace {
+
+// Commands as clients send them, from a short one to a template update with a JSON payload full of escapes
+const std::vector<std::pair<std::string, std::wstring>>& commands()
+{
+    static const std::vector<std::pair<std::string, std::wstring>> instance = {
+        {"mixer", L"MIXER 1-10 FILL 0.25 0.25 0.5 0.5 25 EASEINSINE"},
+        {"play", L"PLAY 1-10 \"media/folder/clip name\" LOOP SEEK 100 LENGTH 500 FILTER \"yadif=1:-1\" AUTO"},
+        {"cg_update",
+         L"CG 1-20 UPDATE 1 \"{\\\"f0\\\":\\\"Anna Andersson\\\",\\\"f1\\\":\\\"Reporter, Stockholm\\\","
+         L"\\\"f2\\\":\\\"Breaking: \\\\\\\"quoted\\\\\\\" text with a line\\nbreak\\\","
+         L"\\\"f3\\\":[1,2,3,4,5,6,7,8]}\""},
+    };
+    return instance;
+}
+
+const bool registered = [] {
+    for (auto& command : commands()) {
+        register_benchmark("amcp_tokenize/" + command.first, [=](state& s) {
+            while (s.keep_running()) {
+                std::list<std::wstring> tokens;
+                IO::tokenize(command.second, tokens);
+                do_not_optimize(tokens);
+            }
+            s.set_bytes_processed(static_cast<std::int64_t>(command.second.size() * sizeof(wchar_t)) *
+                                  s.iterations());
+        });
+    }
+
+    register_benchmark("amcp_tokenize_args", [](state& s) {
+        const std::wstring message = L"(SEEK=100 LENGTH=500 FILTER=\"yadif=1:-1\" IN=10 OUT=490 AUTO=1)";
+        while (s.keep_running()) {
+            auto args = protocol::amcp::tokenize_args(message);
+            do_not_optimize(args);
+        }
+        s.set_items_processed(s.iterations());
+    });
+
+    return true;
+}();
+
+} // namespace
+
+}} // namespace caspar::bench
@@ -1,14 +1,255 @@
 #pragma once
 
-#include <any>
+#include <atomic>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
-#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace caspar {
 
+// Where the memory of an array comes from, which lets those who read it recognise memory they can use as it is
+enum class array_origin
+{
+    other,
+    heap,
+    vector,
+    gl_buffer,
+    ndi,
+};
+
+template <typename T>
+class array;
+
+namespace detail {
+
+template <typename S>
+const void* array_storage_type()
+{
+    static const char type = 0;
+    return &type;
+}
+
+// Keeps the memory of arrays alive. It is counted intrusively, so an array costs at most the one allocation of its
+// owner, and a view on an array none.
+class array_owner
+{
+    std::atomic<long> strong_{1};
+    std::atomic<long> weak_{1}; // Held by the strong references together
+
+  public:
+    const array_origin origin;
+    const void* const  type; // Of the storage, from array_storage_type
+
+    array_owner(array_origin origin, const void* type)
+        : origin(origin)
+        , type(type)
+    {
+    }
+
+    array_owner(const array_owner&)            = delete;
+    array_owner& operator=(const array_owner&) = delete;
+
+    void add_ref() { strong_.fetch_add(1, std::memory_order_relaxed); }
+
+    void release()
+    {
+        if (strong_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            dispose();
+            release_weak();
+        }
+    }
+
+    void add_weak() { weak_.fetch_add(1, std::memory_order_relaxed); }
+
+    void release_weak()
+    {
+        if (weak_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            destroy();
+        }
+    }
+
+    bool expired() const { return strong_.load(std::memory_order_acquire) == 0; }
+
+    virtual void* storage() { return nullptr; }
+
+  protected:
+    virtual ~array_owner() = default;
+
+    // Releases the memory once no array uses it
+    virtual void dispose() = 0;
+
+    // Frees the owner once nothing refers to it
+    virtual void destroy() = 0;
+};
+
+// Owns the memory through whatever keeps it alive, e.g. a std::shared_ptr to a buffer
+template <typename S>
+class storage_owner final : public array_owner
+{
+    std::optional<S> storage_;
+
+  public:
+    template <typename U>
+    storage_owner(U&& storage, array_origin origin)
+        : array_owner(origin, array_storage_type<S>())
+        , storage_(std::forward<U>(storage))
+    {
+    }
+
+    void* storage() override { return storage_ ? &*storage_ : nullptr; }
+
+  protected:
+    void dispose() override { storage_.reset(); }
+    void destroy() override { delete this; }
+};
+
+// Owns zeroed memory, allocated along with the owner
+class heap_owner final : public array_owner
+{
+    static const std::size_t HEADER_SIZE =
+        (sizeof(array_owner) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+    heap_owner()
+        : array_owner(array_origin::heap, nullptr)
+    {
+    }
+
+  public:
+    static heap_owner* create(std::size_t size, void*& data)
+    {
+        auto block = std::malloc(HEADER_SIZE + size);
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        data = static_cast<char*>(block) + HEADER_SIZE;
+        std::memset(data, 0, size);
+        return new (block) heap_owner();
+    }
+
+  protected:
+    void dispose() override {}
+
+    void destroy() override
+    {
+        this->~heap_owner();
+        std::free(this);
+    }
+};
+
+class owner_ref
+{
+    array_owner* owner_ = nullptr;
+
+  public:
+    owner_ref() = default;
+
+    // Takes over the reference that the owner was created with
+    explicit owner_ref(array_owner* owner)
+        : owner_(owner)
+    {
+    }
+
+    owner_ref(const owner_ref& other)
+        : owner_(other.owner_)
+    {
+        if (owner_) {
+            owner_->add_ref();
+        }
+    }
+
+    owner_ref(owner_ref&& other) noexcept
+        : owner_(other.owner_)
+    {
+        other.owner_ = nullptr;
+    }
+
+    ~owner_ref()
+    {
+        if (owner_) {
+            owner_->release();
+        }
+    }
+
+    owner_ref& operator=(owner_ref other) noexcept
+    {
+        std::swap(owner_, other.owner_);
+        return *this;
+    }
+
+    array_owner* get() const { return owner_; }
+
+    template <typename S>
+    S* storage() const
+    {
+        return owner_ && owner_->type == array_storage_type<S>() ? static_cast<S*>(owner_->storage()) : nullptr;
+    }
+
+    array_origin origin() const { return owner_ ? owner_->origin : array_origin::other; }
+};
+
+template <typename S>
+struct is_caspar_array : std::false_type
+{
+};
+
+template <typename T>
+struct is_caspar_array<array<T>> : std::true_type
+{
+};
+
+} // namespace detail
+
+// Identifies the contents of an array without keeping them alive
+class weak_array_owner
+{
+    detail::array_owner* owner_ = nullptr;
+
+  public:
+    weak_array_owner() = default;
+
+    explicit weak_array_owner(detail::array_owner* owner)
+        : owner_(owner)
+    {
+        if (owner_) {
+            owner_->add_weak();
+        }
+    }
+
+    weak_array_owner(const weak_array_owner& other)
+        : weak_array_owner(other.owner_)
+    {
+    }
+
+    weak_array_owner(weak_array_owner&& other) noexcept
+        : owner_(other.owner_)
+    {
+        other.owner_ = nullptr;
+    }
+
+    ~weak_array_owner()
+    {
+        if (owner_) {
+            owner_->release_weak();
+        }
+    }
+
+    weak_array_owner& operator=(weak_array_owner other) noexcept
+    {
+        std::swap(owner_, other.owner_);
+        return *this;
+    }
+
+    bool expired() const { return !owner_ || owner_->expired(); }
+
+    bool operator==(const weak_array_owner& other) const { return owner_ == other.owner_; }
+    bool operator!=(const weak_array_owner& other) const { return owner_ != other.owner_; }
+};
+
 template <typename T>
 class array final
 {
@@ -25,27 +266,31 @@ class array final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
-            ptr_         = reinterpret_cast<T*>(storage.get());
-            std::memset(ptr_, 0, size_);
-            storage_ = std::make_shared<std::any>(std::move(storage));
+            void* data = nullptr;
+            owner_     = detail::owner_ref(detail::heap_owner::create(size_, data));
+            ptr_       = reinterpret_cast<T*>(data);
         }
     }
 
     array(std::vector<T> other)
     {
-        auto storage = std::make_shared<std::vector<T>>(std::move(other));
-        ptr_         = storage->data();
-        size_        = storage->size();
-        storage_     = std::make_shared<std::any>(std::move(storage));
+        auto owner = new detail::storage_owner<std::vector<T>>(std::move(other), array_origin::vector);
+        owner_     = detail::owner_ref(owner);
+        ptr_       = static_cast<std::vector<T>*>(owner->storage())->data();
+        size_      = static_cast<std::vector<T>*>(owner->storage())->size();
     }
 
+    // The memory is kept alive by storage, or by the owner of storage if it is an array itself, of which this is a view
     template <typename S>
-    explicit array(T* ptr, std::size_t size, S&& storage)
+    explicit array(T* ptr, std::size_t size, S&& storage, array_origin origin = array_origin::other)
         : ptr_(ptr)
         , size_(size)
-        , storage_(std::make_shared<std::any>(std::forward<S>(storage)))
     {
+        if constexpr (detail::is_caspar_array<std::decay_t<S>>::value) {
+            owner_ = storage.owner_;
+        } else {
+            owner_ = detail::owner_ref(new detail::storage_owner<std::decay_t<S>>(std::forward<S>(storage), origin));
+        }
     }
 
     array(const array<T>&) = delete;
@@ -53,7 +298,7 @@ class array final
     array(array&& other)
         : ptr_(other.ptr_)
         , size_(other.size_)
-        , storage_(std::move(other.storage_))
+        , owner_(std::move(other.owner_))
     {
         other.ptr_  = nullptr;
         other.size_ = 0;
@@ -63,9 +308,9 @@ class array final
 
     array& operator=(array&& other)
     {
-        ptr_     = std::move(other.ptr_);
-        size_    = std::move(other.size_);
-        storage_ = std::move(other.storage_);
+        ptr_   = std::move(other.ptr_);
+        size_  = std::move(other.size_);
+        owner_ = std::move(other.owner_);
 
         return *this;
     }
@@ -77,21 +322,27 @@ class array final
 
     explicit operator bool() const { return size_ > 0; };
 
+    // What keeps the memory alive, if it is an S
     template <typename S>
     S* storage() const
     {
-        return std::any_cast<S>(storage_.get());
+        return owner_.template storage<S>();
     }
 
+    array_origin origin() const { return owner_.origin(); }
+
   private:
-    T*                        ptr_  = nullptr;
-    std::size_t               size_ = 0;
-    std::shared_ptr<std::any> storage_;
+    T*                ptr_  = nullptr;
+    std::size_t       size_ = 0;
+    detail::owner_ref owner_;
 };
 
 template <typename T>
 class array<const T> final
 {
+    template <typename>
+    friend class array;
+
   public:
     using iterator       = const T*;
     using const_iterator = const T*;
@@ -102,51 +353,54 @@ class array<const T> final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
-            ptr_         = reinterpret_cast<T*>(storage.get());
-            std::memset(ptr_, 0, size_);
-            storage_ = std::make_shared<std::any>(storage);
+            void* data = nullptr;
+            owner_     = detail::owner_ref(detail::heap_owner::create(size_, data));
+            ptr_       = reinterpret_cast<const T*>(data);
         }
     }
 
     array(const std::vector<T>& other)
     {
-        auto storage = std::make_shared<std::vector<T>>(std::move(other));
-        ptr_         = storage->data();
-        size_        = storage->size();
-        storage_     = std::make_shared<std::any>(std::move(storage));
+        auto owner = new detail::storage_owner<std::vector<T>>(other, array_origin::vector);
+        owner_     = detail::owner_ref(owner);
+        ptr_       = static_cast<std::vector<T>*>(owner->storage())->data();
+        size_      = static_cast<std::vector<T>*>(owner->storage())->size();
     }
 
+    // The memory is kept alive by storage, or by the owner of storage if it is an array itself, of which this is a view
     template <typename S>
-    explicit array(const T* ptr, std::size_t size, S&& storage)
+    explicit array(const T* ptr, std::size_t size, S&& storage, array_origin origin = array_origin::other)
         : ptr_(ptr)
         , size_(size)
-        , storage_(std::make_shared<std::any>(std::forward<S>(storage)))
     {
+        if constexpr (detail::is_caspar_array<std::decay_t<S>>::value) {
+            owner_ = storage.owner_;
+        } else {
+            owner_ = detail::owner_ref(new detail::storage_owner<std::decay_t<S>>(std::forward<S>(storage), origin));
+        }
     }
 
     array(const array& other)
         : ptr_(other.ptr_)
         , size_(other.size_)
-        , storage_(other.storage_)
+        , owner_(other.owner_)
     {
     }
 
     array(array<T>&& other)
         : ptr_(other.ptr_)
         , size_(other.size_)
-        , storage_(other.storage_)
+        , owner_(std::move(other.owner_))
     {
-        other.ptr_     = nullptr;
-        other.size_    = 0;
-        other.storage_ = nullptr;
+        other.ptr_  = nullptr;
+        other.size_ = 0;
     }
 
     array& operator=(const array& other)
     {
-        ptr_     = other.ptr_;
-        size_    = other.size_;
-        storage_ = other.storage_;
+        ptr_   = other.ptr_;
+        size_  = other.size_;
+        owner_ = other.owner_;
         return *this;
     }
 
@@ -157,16 +411,23 @@ class array<const T> final
 
     explicit operator bool() const { return size_ > 0; }
 
+    // What keeps the memory alive, if it is an S
     template <typename S>
     S* storage() const
     {
-        return std::any_cast<S>(storage_.get());
+        return owner_.template storage<S>();
     }
 
+    array_origin origin() const { return owner_.origin(); }
+
+    // Shared by every copy and view of the array and alive for as long as any of them is, which makes it an identity
+    // for the immutable contents.
+    weak_array_owner owner() const { return weak_array_owner(owner_.get()); }
+
   private:
-    const T*                  ptr_  = nullptr;
-    std::size_t               size_ = 0;
-    std::shared_ptr<std::any> storage_;
+    const T*          ptr_  = nullptr;
+    std::size_t       size_ = 0;
+    detail::owner_ref owner_;
 };
 
 } // namespace caspar
@@ -11,6 +11,7 @@ enum class bit_depth : uint8_t
     bit12,
     // bit14,
     bit16,
+    float16, // Half float, only for the linear light targets of the mixer
 };
 
 }} // namespace caspar::common
\ No newline at end of file
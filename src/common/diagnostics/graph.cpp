@@ -20,6 +20,7 @@
  */
 #include "graph.h"
 
+#include <atomic>
 #include <mutex>
 #include <vector>
 
@@ -48,6 +49,9 @@ using sink_factories_t = std::vector<spi::sink_factory_t>;
 static std::mutex       g_sink_factories_mutex;
 static sink_factories_t g_sink_factories;
 
+// The number of sampling tokens held
+static std::atomic<int> g_samplers{0};
+
 std::vector<spl::shared_ptr<spi::graph_sink>> create_sinks()
 {
     std::lock_guard<std::mutex> lock(g_sink_factories_mutex);
@@ -59,8 +63,16 @@ std::vector<spl::shared_ptr<spi::graph_sink>> create_sinks()
     return result;
 }
 
+void add(std::atomic<double>& target, double value)
+{
+    auto current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+}
+
 struct graph::impl
 {
+    std::shared_ptr<spi::graph_state>             state_ = std::make_shared<spi::graph_state>();
     std::vector<spl::shared_ptr<spi::graph_sink>> sinks_ = create_sinks();
 
   public:
@@ -69,39 +81,59 @@ struct graph::impl
     void activate()
     {
         for (auto& sink : sinks_)
-            sink->activate();
+            sink->activate(state_);
     }
 
-    void set_text(const std::wstring& value)
-    {
-        for (auto& sink : sinks_)
-            sink->set_text(value);
-    }
+    bool sampled() const { return !sinks_.empty() && g_samplers.load(std::memory_order_relaxed) > 0; }
+
+    void set_text(const std::wstring& value) { state_->set_text(value); }
 
     void set_value(const std::string& name, double value)
     {
-        for (auto& sink : sinks_)
-            sink->set_value(name, value);
+        if (!sampled())
+            return;
+
+        auto line = state_->line(name);
+        if (!line)
+            return;
+
+        line->value.store(value, std::memory_order_relaxed);
+        add(line->sum, value);
+        for (size_t n = 0; n < spi::bucket_bounds.size(); ++n) {
+            if (value <= spi::bucket_bounds[n]) {
+                line->buckets[n].fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        // Counted last, so that a sink which sees the count also sees the value
+        line->values.fetch_add(1, std::memory_order_release);
     }
 
     void set_tag(tag_severity severity, const std::string& name)
     {
-        for (auto& sink : sinks_)
-            sink->set_tag(severity, name);
+        if (!sampled())
+            return;
+
+        auto line = state_->line(name);
+        if (!line)
+            return;
+
+        line->severity.store(severity, std::memory_order_relaxed);
+        line->tags.fetch_add(1, std::memory_order_release);
     }
 
+    // Colors are set as a graph is created, before anything may sample it
     void set_color(const std::string& name, int color)
     {
-        for (auto& sink : sinks_)
-            sink->set_color(name, color);
-    }
+        if (sinks_.empty())
+            return;
 
-    void auto_reset()
-    {
-        for (auto& sink : sinks_)
-            sink->auto_reset();
+        if (auto line = state_->line(name))
+            line->color.store(color, std::memory_order_relaxed);
     }
 
+    void auto_reset() { state_->set_auto_reset(); }
+
   private:
     impl(impl&);
     impl& operator=(impl&);
@@ -122,6 +154,54 @@ void register_graph(const spl::shared_ptr<graph>& graph) { graph->impl_->activat
 
 namespace spi {
 
+graph_state::~graph_state()
+{
+    for (auto& line : lines_)
+        delete line.load(std::memory_order_relaxed);
+}
+
+line_state* graph_state::line(const std::string& name)
+{
+    for (auto& slot : lines_) {
+        auto line = slot.load(std::memory_order_acquire);
+        if (!line) {
+            // Another thread may add a line to the same slot first, which is then compared like any other
+            auto added = new line_state(name);
+            if (slot.compare_exchange_strong(line, added, std::memory_order_acq_rel)) {
+                return added;
+            }
+            delete added;
+        }
+        if (line->name == name) {
+            return line;
+        }
+    }
+    return nullptr;
+}
+
+void graph_state::for_each_line(const std::function<void(const line_state&)>& f) const
+{
+    for (auto& slot : lines_) {
+        auto line = slot.load(std::memory_order_acquire);
+        if (!line) {
+            break;
+        }
+        f(*line);
+    }
+}
+
+void graph_state::set_text(const std::wstring& value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    text_ = value;
+}
+
+std::wstring graph_state::text() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return text_;
+}
+
 void register_sink_factory(sink_factory_t factory)
 {
     std::lock_guard<std::mutex> lock(g_sink_factories_mutex);
@@ -129,6 +209,12 @@ void register_sink_factory(sink_factory_t factory)
     g_sink_factories.push_back(std::move(factory));
 }
 
+std::shared_ptr<void> start_sampling()
+{
+    ++g_samplers;
+    return std::shared_ptr<void>(nullptr, [](void*) { --g_samplers; });
+}
+
 } // namespace spi
 
 }} // namespace caspar::diagnostics
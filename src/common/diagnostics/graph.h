@@ -23,7 +23,12 @@
 
 #include "../memory.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <tuple>
 
@@ -39,6 +44,8 @@ enum class tag_severity
     SILENT,
 };
 
+// Records values and tags in atomics which sinks sample when they need them, so that setting them takes no locks. While
+// nothing samples, see spi::start_sampling, set_value and set_tag return without recording anything.
 class graph
 {
     friend void register_graph(const spl::shared_ptr<graph>& graph);
@@ -63,6 +70,59 @@ void register_graph(const spl::shared_ptr<graph>& graph);
 
 namespace spi {
 
+// Upper bounds of the buckets every value of a line is counted in, in the units of the graphs where 0.5 is the duration
+// of a frame
+constexpr std::array<double, 10> bucket_bounds = {0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.75, 1.0, 2.0};
+
+// A line of a graph. The counts only grow, so a sink samples what happened since it last looked by comparing them.
+struct line_state
+{
+    explicit line_state(std::string name)
+        : name(std::move(name))
+    {
+    }
+
+    const std::string                                            name;
+    std::atomic<int>                                             color{static_cast<int>(0xFFFFFFFF)};
+    std::atomic<double>                                          value{0.0};
+    std::atomic<double>                                          sum{0.0};
+    std::atomic<std::uint64_t>                                   values{0};
+    std::array<std::atomic<std::uint64_t>, bucket_bounds.size()> buckets{}; // Values above the last bound are left out
+    std::atomic<std::uint64_t>                                   tags{0};
+    std::atomic<tag_severity>                                    severity{tag_severity::SILENT};
+};
+
+// What a graph has recorded, which is shared with its sinks
+class graph_state
+{
+  public:
+    static const size_t max_lines = 32;
+
+    graph_state() = default;
+    ~graph_state();
+
+    graph_state(const graph_state&)            = delete;
+    graph_state& operator=(const graph_state&) = delete;
+
+    // The line with the name, which is added if there is none. Returns nullptr once a graph has max_lines lines.
+    line_state* line(const std::string& name);
+
+    // Calls f with each line, in the order they were added
+    void for_each_line(const std::function<void(const line_state&)>& f) const;
+
+    void         set_text(const std::wstring& value);
+    std::wstring text() const;
+
+    void set_auto_reset() { auto_reset_ = true; }
+    bool auto_reset() const { return auto_reset_; }
+
+  private:
+    std::array<std::atomic<line_state*>, max_lines> lines_{};
+    mutable std::mutex                              mutex_;
+    std::wstring                                    text_;
+    std::atomic<bool>                               auto_reset_{false};
+};
+
 class graph_sink
 {
     graph_sink(const graph_sink&)            = delete;
@@ -71,17 +131,17 @@ class graph_sink
   public:
     graph_sink() = default;
     virtual ~graph_sink(){};
-    virtual void activate()                                              = 0;
-    virtual void set_text(const std::wstring& value)                     = 0;
-    virtual void set_value(const std::string& name, double value)        = 0;
-    virtual void set_color(const std::string& name, int color)           = 0;
-    virtual void set_tag(tag_severity severity, const std::string& name) = 0;
-    virtual void auto_reset()                                            = 0;
+
+    // Called once the graph is registered, with the state the sink is to sample
+    virtual void activate(const std::shared_ptr<const graph_state>& state) = 0;
 };
 
 using sink_factory_t = std::function<spl::shared_ptr<graph_sink>()>;
 void register_sink_factory(sink_factory_t factory);
 
+// Values and tags are recorded while any of the returned tokens are held, e.g. while the OSD window is open
+std::shared_ptr<void> start_sampling();
+
 } // namespace spi
 
 }} // namespace caspar::diagnostics
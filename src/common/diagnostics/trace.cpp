@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "trace.h"
+
+#include "../utf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace diagnostics { namespace trace {
+
+namespace detail {
+
+std::atomic<bool> running{false};
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace detail
+
+namespace {
+
+// The events of a thread, which only it appends to. A reader sees those below size.
+struct thread_events
+{
+    int                        id;
+    std::string                name; // Guarded by g_mutex
+    std::vector<event>         events;
+    std::atomic<size_t>        size{0};
+    std::atomic<std::uint64_t> session{0};
+};
+
+std::mutex                                  g_mutex;
+std::vector<std::shared_ptr<thread_events>> g_threads;
+std::atomic<std::uint64_t>                  g_session{0};
+std::atomic<size_t>                         g_max_events{0};
+std::int64_t                                g_start   = 0;
+int                                         g_next_id = 1;
+
+thread_local std::int64_t                   t_frame = -1;
+thread_local std::string                    t_name;
+thread_local std::shared_ptr<thread_events> t_events;
+
+thread_events& events_of_thread()
+{
+    if (!t_events) {
+        auto events  = std::make_shared<thread_events>();
+        events->name = t_name;
+
+        std::lock_guard<std::mutex> lock(g_mutex);
+        events->id = g_next_id++;
+        g_threads.push_back(events);
+        t_events = std::move(events);
+    }
+    return *t_events;
+}
+
+void append_escaped(std::string& out, const std::string& value)
+{
+    for (auto c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+}
+
+void append_microseconds(std::string& out, std::int64_t nanoseconds)
+{
+    char buffer[32];
+    std::snprintf(buffer,
+                  sizeof(buffer),
+                  "%lld.%03lld",
+                  static_cast<long long>(nanoseconds / 1000),
+                  static_cast<long long>(nanoseconds % 1000));
+    out += buffer;
+}
+
+} // namespace
+
+namespace detail {
+
+void record(const char* name, std::int64_t start, std::int64_t end)
+{
+    auto& events  = events_of_thread();
+    auto  session = g_session.load(std::memory_order_acquire);
+
+    // The first event of a trace on this thread discards those of the previous one
+    if (events.session.load(std::memory_order_relaxed) != session) {
+        events.size.store(0, std::memory_order_relaxed);
+        events.events.resize(g_max_events.load(std::memory_order_relaxed));
+        events.session.store(session, std::memory_order_release);
+    }
+
+    auto n = events.size.load(std::memory_order_relaxed);
+    if (n >= events.events.size()) {
+        return;
+    }
+
+    events.events[n] = event{name, start, end, t_frame};
+    events.size.store(n + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+frame_scope::frame_scope(std::int64_t frame)
+    : saved_(t_frame)
+{
+    t_frame = frame;
+}
+
+frame_scope::~frame_scope() { t_frame = saved_; }
+
+std::int64_t frame() { return t_frame; }
+
+void set_thread_name(const std::wstring& name)
+{
+    t_name = u8(name);
+    if (t_events) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        t_events->name = t_name;
+    }
+}
+
+void start(size_t max_events)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    // The events of threads which have since exited were kept for the previous trace
+    auto exited = [](const std::shared_ptr<thread_events>& events) { return events.use_count() == 1; };
+    g_threads.erase(std::remove_if(g_threads.begin(), g_threads.end(), exited), g_threads.end());
+
+    g_max_events = max_events;
+    g_start      = detail::now();
+    g_session.fetch_add(1, std::memory_order_release);
+    detail::running = true;
+}
+
+std::string stop()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    detail::running = false;
+    auto session    = g_session.load(std::memory_order_relaxed);
+
+    std::string out   = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    auto        first = true;
+    for (auto& thread : g_threads) {
+        if (thread->session.load(std::memory_order_acquire) != session) {
+            continue;
+        }
+
+        auto tid = std::to_string(thread->id);
+
+        out += first ? "" : ",";
+        out += "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"";
+        append_escaped(out, thread->name.empty() ? "thread " + tid : thread->name);
+        out += "\"}}";
+        first = false;
+
+        auto size = thread->size.load(std::memory_order_acquire);
+        for (size_t n = 0; n < size; ++n) {
+            auto& event = thread->events[n];
+            if (event.start < g_start) {
+                continue;
+            }
+
+            out += ",\n{\"ph\":\"X\",\"name\":\"";
+            append_escaped(out, event.name);
+            out += "\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+            append_microseconds(out, event.start - g_start);
+            out += ",\"dur\":";
+            append_microseconds(out, event.end - event.start);
+            if (event.frame >= 0) {
+                out += ",\"args\":{\"frame\":" + std::to_string(event.frame) + "}";
+            }
+            out += "}";
+        }
+    }
+    out += "\n]}\n";
+
+    return out;
+}
+
+std::vector<event> stop_events()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    detail::running = false;
+    auto session    = g_session.load(std::memory_order_relaxed);
+
+    std::vector<event> result;
+    for (auto& thread : g_threads) {
+        if (thread->session.load(std::memory_order_acquire) != session) {
+            continue;
+        }
+
+        auto size = thread->size.load(std::memory_order_acquire);
+        for (size_t n = 0; n < size; ++n) {
+            if (thread->events[n].start >= g_start) {
+                result.push_back(thread->events[n]);
+            }
+        }
+    }
+    return result;
+}
+
+}}} // namespace caspar::diagnostics::trace
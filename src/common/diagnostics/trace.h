@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Records timed events on the threads of the pipeline while a trace is running, which can then be opened in Perfetto or
+// chrome://tracing. While no trace is running an event costs a single relaxed load.
+namespace caspar { namespace diagnostics { namespace trace {
+
+namespace detail {
+
+extern std::atomic<bool> running;
+
+std::int64_t now();
+void         record(const char* name, std::int64_t start, std::int64_t end);
+
+} // namespace detail
+
+inline bool running() { return detail::running.load(std::memory_order_relaxed); }
+
+// The time an event starts, or 0 while no trace is running
+inline std::int64_t begin() { return running() ? detail::now() : 0; }
+
+// Records an event named by a string literal, from start until now, if it started while a trace was running
+inline void end(const char* name, std::int64_t start)
+{
+    if (start != 0) {
+        detail::record(name, start, detail::now());
+    }
+}
+
+// Records an event named by a string literal for the lifetime of the scope
+class scoped_event
+{
+    const char*  name_;
+    std::int64_t start_;
+
+  public:
+    explicit scoped_event(const char* name)
+        : name_(name)
+        , start_(begin())
+    {
+    }
+
+    ~scoped_event() { end(name_, start_); }
+
+    scoped_event(const scoped_event&)            = delete;
+    scoped_event& operator=(const scoped_event&) = delete;
+};
+
+// Events on the thread are of the channel frame for the lifetime of the scope
+class frame_scope
+{
+    std::int64_t saved_;
+
+  public:
+    explicit frame_scope(std::int64_t frame);
+    ~frame_scope();
+
+    frame_scope(const frame_scope&)            = delete;
+    frame_scope& operator=(const frame_scope&) = delete;
+};
+
+// The channel frame of the events on the thread, or -1 outside of a frame_scope, to be carried over to another thread
+std::int64_t frame();
+
+// Names the thread in traces, which set_thread_name does
+void set_thread_name(const std::wstring& name);
+
+// An event of a trace, timed in nanoseconds of the steady clock
+struct event
+{
+    const char*  name;
+    std::int64_t start;
+    std::int64_t end;
+    std::int64_t frame;
+};
+
+// Starts a trace, discarding what was recorded by a previous one. Each thread keeps up to max_events events, after
+// which it records no more.
+void start(size_t max_events = 65536);
+
+// Stops the trace and returns it in the Chrome trace event format. The events are kept until the next trace starts, so
+// stopping again returns the same trace.
+std::string stop();
+
+// Stops the trace like stop, but returns its events, for those who summarise them rather than view them
+std::vector<event> stop_events();
+
+}}} // namespace caspar::diagnostics::trace
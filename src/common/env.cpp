@@ -37,6 +37,7 @@
 
 namespace caspar { namespace env {
 
+std::wstring                 file;
 std::wstring                 initial;
 std::wstring                 media;
 std::wstring                 log;
@@ -99,12 +100,10 @@ void configure(const std::wstring& filename)
                                << msg_info(L"Configuration file " + fullpath + L" was not found."));
     }
 
+    file = fullpath;
+
     try {
-        boost::filesystem::wifstream file(fullpath);
-        boost::property_tree::read_xml(file,
-                                       pt,
-                                       boost::property_tree::xml_parser::trim_whitespace |
-                                           boost::property_tree::xml_parser::no_comments);
+        pt = read_properties();
 
         auto paths = ptree_get_child(pt, L"configuration.paths");
         media      = clean_path(paths.get(L"media-path", initial + L"/media/"));
@@ -182,6 +181,17 @@ const std::wstring& version()
     return ver;
 }
 
+boost::property_tree::wptree read_properties()
+{
+    boost::property_tree::wptree result;
+    boost::filesystem::wifstream stream(file);
+    boost::property_tree::read_xml(stream,
+                                   result,
+                                   boost::property_tree::xml_parser::trim_whitespace |
+                                       boost::property_tree::xml_parser::no_comments);
+    return result;
+}
+
 const boost::property_tree::wptree& properties()
 {
     check_is_configured();
@@ -40,6 +40,10 @@ bool log_to_file();
 
 const boost::property_tree::wptree& properties();
 
+// Reads the configuration file again, for changes to it to be applied without a restart. properties() stays as it was
+// read on start.
+boost::property_tree::wptree read_properties();
+
 void log_configuration_warnings();
 
 }} // namespace caspar::env
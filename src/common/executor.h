@@ -28,23 +28,145 @@
 #include <tbb/concurrent_queue.h>
 
 #include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <future>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
 namespace caspar {
 
+namespace detail {
+
+// A move-only void() callable which keeps small callables inline rather than on the heap, so that a task and the
+// promise of its result are queued without allocating anything but the state the future shares with the promise
+class executor_task
+{
+    static const std::size_t INLINE_SIZE = 96;
+
+    struct ops_t
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* from, void* to); // Move constructs into to and destroys from
+        void (*destroy)(void* storage);
+    };
+
+    template <typename F>
+    static const ops_t* inline_ops()
+    {
+        static const ops_t ops = {
+            [](void* storage) { (*static_cast<F*>(storage))(); },
+            [](void* from, void* to) {
+                new (to) F(std::move(*static_cast<F*>(from)));
+                static_cast<F*>(from)->~F();
+            },
+            [](void* storage) { static_cast<F*>(storage)->~F(); },
+        };
+        return &ops;
+    }
+
+    template <typename F>
+    static const ops_t* heap_ops()
+    {
+        static const ops_t ops = {
+            [](void* storage) { (**static_cast<F**>(storage))(); },
+            [](void* from, void* to) { *static_cast<F**>(to) = *static_cast<F**>(from); },
+            [](void* storage) { delete *static_cast<F**>(storage); },
+        };
+        return &ops;
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+    const ops_t* ops_ = nullptr;
+
+  public:
+    executor_task() = default;
+
+    executor_task(std::nullptr_t) {}
+
+    template <typename Func,
+              typename F = std::decay_t<Func>,
+              typename   = std::enable_if_t<!std::is_same<F, executor_task>::value>>
+    executor_task(Func&& func)
+    {
+        if constexpr (sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<F>::value) {
+            new (storage_) F(std::forward<Func>(func));
+            ops_ = inline_ops<F>();
+        } else {
+            *reinterpret_cast<F**>(storage_) = new F(std::forward<Func>(func));
+            ops_                             = heap_ops<F>();
+        }
+    }
+
+    executor_task(executor_task&& other) noexcept
+        : ops_(other.ops_)
+    {
+        if (ops_) {
+            ops_->move(other.storage_, storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    executor_task& operator=(executor_task&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            if (other.ops_) {
+                other.ops_->move(other.storage_, storage_);
+                ops_       = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    executor_task(const executor_task&)            = delete;
+    executor_task& operator=(const executor_task&) = delete;
+
+    ~executor_task() { reset(); }
+
+    void reset()
+    {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void operator()() { ops_->invoke(storage_); }
+};
+
+} // namespace detail
+
+enum class task_priority
+{
+    normal,
+    // Runs before any queued normal task, e.g. the per-frame tick of a stage
+    high,
+};
+
 class executor final
 {
     executor(const executor&);
     executor& operator=(const executor&);
 
-    using task_t  = std::function<void()>;
+    using task_t  = detail::executor_task;
     using queue_t = tbb::concurrent_bounded_queue<task_t>;
 
-    std::wstring      name_;
-    std::atomic<bool> is_running_{true};
-    queue_t           queue_;
-    std::thread       thread_;
+    // How long the thread looks for more work before it sleeps, which saves waking it for tasks that come in bursts
+    static constexpr std::chrono::microseconds SPIN_TIME{20};
+
+    std::wstring                  name_;
+    std::atomic<bool>             is_running_{true};
+    queue_t                       queue_;
+    tbb::concurrent_queue<task_t> high_queue_;
+    std::thread                   thread_;
 
   public:
     executor(const std::wstring& name)
@@ -56,7 +178,7 @@ class executor final
     ~executor() { stop_and_wait(); }
 
     template <typename Func>
-    auto begin_invoke(Func&& func)
+    auto begin_invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (!is_running_) {
             CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("executor not running."));
@@ -64,39 +186,64 @@ class executor final
 
         using result_type = decltype(func());
 
-        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
+        std::promise<result_type> promise;
+        auto                      future = promise.get_future();
 
-        queue_.push([=]() mutable { (*task)(); });
+        task_t task([func = std::forward<Func>(func), promise = std::move(promise)]() mutable {
+            try {
+                if constexpr (std::is_void<result_type>::value) {
+                    func();
+                    promise.set_value();
+                } else {
+                    promise.set_value(func());
+                }
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        });
+
+        if (priority == task_priority::high) {
+            high_queue_.push(std::move(task));
+            // Wakes up the executor if it is waiting for work
+            queue_.push([] {});
+        } else {
+            queue_.push(std::move(task));
+        }
 
-        return task->get_future();
+        return future;
     }
 
     template <typename Func>
-    auto invoke(Func&& func)
+    auto invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (is_current()) { // Avoids potential deadlock.
             return func();
         }
 
-        return begin_invoke(std::forward<Func>(func)).get();
+        return begin_invoke(std::forward<Func>(func), priority).get();
     }
 
     template <typename Func>
-    typename std::enable_if<std::is_same<void, decltype(std::declval<Func>())>::value, void>::type invoke(Func&& func)
+    typename std::enable_if<std::is_same<void, decltype(std::declval<Func>())>::value, void>::type
+    invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (is_current()) { // Avoids potential deadlock.
             func();
             return;
         }
 
-        begin_invoke(std::forward<Func>(func)).wait();
+        begin_invoke(std::forward<Func>(func), priority).wait();
     }
 
     void set_capacity(queue_t::size_type capacity) { queue_.set_capacity(capacity); }
 
     queue_t::size_type capacity() const { return queue_.capacity(); }
 
-    void clear() { queue_.clear(); }
+    void clear()
+    {
+        queue_.clear();
+        high_queue_.clear();
+    }
 
     void stop()
     {
@@ -137,8 +284,11 @@ class executor final
 
         while (is_running_) {
             try {
-                queue_.pop(task);
+                if (!spin_pop(task)) {
+                    queue_.pop(task);
+                }
                 do {
+                    run_high_priority();
                     if (!task) {
                         return;
                     }
@@ -149,6 +299,30 @@ class executor final
             }
         }
     }
+
+    bool spin_pop(task_t& task)
+    {
+        auto deadline = std::chrono::steady_clock::now() + SPIN_TIME;
+        do {
+            if (queue_.try_pop(task)) {
+                return true;
+            }
+            std::this_thread::yield();
+        } while (std::chrono::steady_clock::now() < deadline);
+        return false;
+    }
+
+    void run_high_priority()
+    {
+        task_t task;
+        while (high_queue_.try_pop(task)) {
+            try {
+                task();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
 };
 
 } // namespace caspar
@@ -22,6 +22,7 @@
 
 #include "./os/filesystem.h"
 #include "filesystem.h"
+#include "media_index.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -64,8 +65,30 @@ find_file_within_dir_or_absolute(const std::wstring&
                                  const std::wstring&                                        filename,
                                  const std::function<bool(const boost::filesystem::path&)>& is_valid_file)
 {
+    auto file_path = boost::filesystem::path(filename);
+
+    // Names within a folder that is indexed are looked up without searching it. Those the index does not know, or
+    // only knows of files that have gone, are searched for as before, as the index may not see every change on
+    // network shares.
+    if (!file_path.is_absolute()) {
+        std::vector<boost::filesystem::path> files;
+        auto                                 index = find_media_index(parent_dir);
+        if (index && index->find(filename, files)) {
+            bool found = false;
+            for (auto& file : files) {
+                boost::system::error_code ec;
+                if (!boost::filesystem::exists(file, ec))
+                    continue;
+                found = true;
+                if (is_valid_file(file))
+                    return file;
+            }
+            if (found)
+                return {};
+        }
+    }
+
     // Try it assuming an absolute path was given
-    auto file_path       = boost::filesystem::path(filename);
     auto file_path_match = probe_path(file_path, is_valid_file);
     if (file_path_match) {
         return file_path_match;
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_buffer.h"
+
+#include "memory_governor.h"
+
+#include <algorithm>
+#include <utility>
+#include <map>
+#include <mutex>
+#include <new>
+
+namespace caspar {
+
+namespace {
+
+// A buffer and the size it was mapped with
+using mapping = std::pair<void*, std::size_t>;
+
+struct slab
+{
+    std::vector<mapping> free;
+    std::uint64_t        allocated = 0;
+    std::uint64_t        reused    = 0;
+    std::size_t          in_use    = 0;
+};
+
+struct pool
+{
+    std::mutex                  mutex;
+    std::map<std::size_t, slab> slabs;
+    huge_pages                  mode           = huge_pages::none;
+    std::size_t                 max_free_bytes = 1024ull * 1024 * 1024;
+    std::size_t                 free_bytes     = 0;
+};
+
+// Releases free buffers, of the largest sizes first, until bytes have been released
+void trim(pool& pool, std::int64_t bytes)
+{
+    std::vector<mapping> released;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        for (auto it = pool.slabs.rbegin(); it != pool.slabs.rend() && bytes > 0; ++it) {
+            auto& free = it->second.free;
+            while (!free.empty() && bytes > 0) {
+                released.push_back(free.back());
+                free.pop_back();
+                pool.free_bytes -= released.back().second;
+                bytes -= static_cast<std::int64_t>(released.back().second);
+            }
+        }
+    }
+    for (auto& buffer : released) {
+        free_pages(buffer.first, buffer.second);
+    }
+}
+
+// Never destroyed, as buffers may be returned to it while static objects are destroyed
+pool& get_pool()
+{
+    static auto instance = new pool();
+
+    // Buffers in use and free, of which the free ones are given back
+    static auto account = new memory_account(
+        "host-buffers",
+        memory_reclaim::pool,
+        [] {
+            std::lock_guard<std::mutex> lock(instance->mutex);
+            std::int64_t                bytes = instance->free_bytes;
+            for (auto& slab : instance->slabs) {
+                bytes += static_cast<std::int64_t>(slab.first * slab.second.in_use);
+            }
+            return bytes;
+        },
+        [](std::int64_t bytes) { trim(*instance, bytes); });
+
+    return *instance;
+}
+
+void release(std::size_t size, mapping buffer)
+{
+    auto& pool = get_pool();
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    auto&                       slab = pool.slabs[size];
+    slab.in_use -= 1;
+    if (pool.free_bytes + buffer.second <= pool.max_free_bytes) {
+        slab.free.push_back(buffer);
+        pool.free_bytes += buffer.second;
+    } else {
+        free_pages(buffer.first, buffer.second);
+    }
+}
+
+} // namespace
+
+void configure_host_buffers(huge_pages mode, std::size_t max_free_bytes)
+{
+    auto& pool = get_pool();
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.mode           = mode;
+    pool.max_free_bytes = max_free_bytes;
+}
+
+std::shared_ptr<void> create_host_buffer(std::size_t size)
+{
+    auto& pool = get_pool();
+
+    mapping    buffer = {nullptr, size};
+    huge_pages mode;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        auto&                       slab = pool.slabs[size];
+        if (!slab.free.empty()) {
+            buffer = slab.free.back();
+            slab.free.pop_back();
+            pool.free_bytes -= buffer.second;
+            slab.reused += 1;
+            slab.in_use += 1;
+        }
+        mode = pool.mode;
+    }
+
+    if (!buffer.first) {
+        buffer.first = allocate_pages(buffer.second, mode);
+        if (!buffer.first) {
+            throw std::bad_alloc();
+        }
+
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        auto&                       slab = pool.slabs[size];
+        slab.allocated += 1;
+        slab.in_use += 1;
+    }
+
+    return std::shared_ptr<void>(buffer.first, [size, buffer](void*) { release(size, buffer); });
+}
+
+huge_pages host_buffer_huge_pages()
+{
+    auto& pool = get_pool();
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.mode;
+}
+
+std::vector<host_buffer_stats> host_buffer_statistics()
+{
+    auto& pool = get_pool();
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+
+    std::vector<host_buffer_stats> result;
+    for (auto& slab : pool.slabs) {
+        result.push_back(host_buffer_stats{
+            slab.first, slab.second.allocated, slab.second.reused, slab.second.in_use, slab.second.free.size()});
+    }
+    return result;
+}
+
+} // namespace caspar
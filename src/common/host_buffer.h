@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "os/page_memory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace caspar {
+
+// Large host buffers, such as whole video frames, mapped in pages and pooled by size. Buffers of the same format are
+// handed out again with their pages already faulted in, and may be backed by huge pages.
+void configure_host_buffers(huge_pages mode, std::size_t max_free_bytes);
+
+// A page aligned buffer of at least size bytes, which goes back to the pool once the last reference to it is dropped
+std::shared_ptr<void> create_host_buffer(std::size_t size);
+
+struct host_buffer_stats
+{
+    std::size_t   size;      // Of the buffers in this slab
+    std::uint64_t allocated; // Mapped from the OS
+    std::uint64_t reused;    // Handed out again from the pool
+    std::size_t   in_use;
+    std::size_t   free;
+};
+
+huge_pages                     host_buffer_huge_pages();
+std::vector<host_buffer_stats> host_buffer_statistics();
+
+} // namespace caspar
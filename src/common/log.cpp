@@ -32,7 +32,7 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/sinks/async_frontend.hpp>
-#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
 #include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/sources/logger.hpp>
@@ -56,6 +56,43 @@ namespace caspar { namespace log {
 
 logging_config current_config;
 
+namespace detail {
+
+std::atomic<int> min_severity{static_cast<int>(boost::log::trivial::trace)};
+
+} // namespace detail
+
+namespace {
+
+// Records a sink may have queued before it drops them
+const std::size_t MAX_QUEUED_RECORDS = 16384;
+
+// Drops the records that do not fit in the queue of a sink instead of waiting for room, and counts them. Sink tells the
+// counters of the sinks apart.
+template <int Sink>
+struct count_on_overflow
+{
+    static std::atomic<std::uint64_t> dropped;
+
+    template <typename Lock>
+    static bool on_overflow(const boost::log::record_view&, Lock&)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    static void on_queue_space_available() {}
+    static void interrupt() {}
+};
+
+template <int Sink>
+std::atomic<std::uint64_t> count_on_overflow<Sink>::dropped{0};
+
+using file_overflow = count_on_overflow<0>;
+using cout_overflow = count_on_overflow<1>;
+
+} // namespace
+
 std::string current_exception_diagnostic_information()
 {
     {
@@ -143,20 +180,33 @@ class column_writer
 };
 
 template <typename Stream>
-void my_formatter(bool print_all_characters, const boost::log::record_view& rec, Stream& strm)
+void my_formatter(bool                           print_all_characters,
+                  std::atomic<std::uint64_t>*    dropped,
+                  const boost::log::record_view& rec,
+                  Stream&                        strm)
 {
     // static column_writer thread_id_column;
     static column_writer severity_column(7);
     namespace expr = boost::log::expressions;
 
+    auto timestamp = boost::log::extract<boost::posix_time::ptime>("TimestampMillis", rec).get();
+
     std::wstringstream pre_message_stream;
-    append_timestamp(pre_message_stream, boost::log::extract<boost::posix_time::ptime>("TimestampMillis", rec).get());
+    append_timestamp(pre_message_stream, timestamp);
     // thread_id_column.write(pre_message_stream, boost::log::extract<std::int64_t>("NativeThreadId", rec));
     severity_column.write(pre_message_stream,
                           boost::log::extract<boost::log::trivial::severity_level>("Severity", rec));
 
     auto pre_message = pre_message_stream.str();
 
+    // Written ahead of the first record there was room for again
+    if (auto count = dropped->exchange(0, std::memory_order_relaxed)) {
+        std::wstringstream dropped_stream;
+        append_timestamp(dropped_stream, timestamp);
+        severity_column.write(dropped_stream, boost::log::trivial::warning);
+        strm << dropped_stream.str() << count << L" log records were dropped, as the log could not keep up\n";
+    }
+
     strm << pre_message;
 
     auto line_break_replacement = L"\n" + pre_message;
@@ -171,7 +221,9 @@ void my_formatter(bool print_all_characters, const boost::log::record_view& rec,
 
 void add_file_sink(const std::wstring& file)
 {
-    using file_sink_type = boost::log::sinks::synchronous_sink<boost::log::sinks::text_file_backend>;
+    using file_sink_type =
+        sinks::asynchronous_sink<sinks::text_file_backend,
+                                 sinks::bounded_fifo_queue<MAX_QUEUED_RECORDS, file_overflow>>;
 
     try {
         if (!boost::filesystem::is_directory(boost::filesystem::path(file).parent_path())) {
@@ -184,7 +236,8 @@ void add_file_sink(const std::wstring& file)
             boost::log::keywords::auto_flush          = true,
             boost::log::keywords::open_mode           = std::ios::app);
 
-        file_sink->set_formatter(boost::bind(&my_formatter<boost::log::formatting_ostream>, true, _1, _2));
+        file_sink->set_formatter(
+            boost::bind(&my_formatter<boost::log::formatting_ostream>, true, &file_overflow::dropped, _1, _2));
 
         boost::log::core::get()->add_sink(file_sink);
     } catch (...) {
@@ -201,7 +254,9 @@ void add_cout_sink()
                                                       return boost::posix_time::microsec_clock::local_time();
                                                   }));
 
-    using stream_sink_type = sinks::asynchronous_sink<sinks::wtext_ostream_backend>;
+    using stream_sink_type =
+        sinks::asynchronous_sink<sinks::wtext_ostream_backend,
+                                 sinks::bounded_fifo_queue<MAX_QUEUED_RECORDS, cout_overflow>>;
 
     auto stream_backend = boost::make_shared<boost::log::sinks::wtext_ostream_backend>();
     stream_backend->add_stream(boost::shared_ptr<std::wostream>(&std::wcout, boost::null_deleter()));
@@ -209,28 +264,33 @@ void add_cout_sink()
 
     auto stream_sink = boost::make_shared<stream_sink_type>(stream_backend);
 
-    stream_sink->set_formatter(boost::bind(&my_formatter<boost::log::wformatting_ostream>, false, _1, _2));
+    stream_sink->set_formatter(
+        boost::bind(&my_formatter<boost::log::wformatting_ostream>, false, &cout_overflow::dropped, _1, _2));
 
     logging::core::get()->add_sink(stream_sink);
 }
 
 bool set_log_level(const std::wstring& lvl)
 {
+    boost::log::trivial::severity_level severity;
     if (boost::iequals(lvl, L"trace"))
-        logging::core::get()->set_filter(logging::trivial::severity >= boost::log::trivial::trace);
+        severity = boost::log::trivial::trace;
     else if (boost::iequals(lvl, L"debug"))
-        logging::core::get()->set_filter(logging::trivial::severity >= boost::log::trivial::debug);
+        severity = boost::log::trivial::debug;
     else if (boost::iequals(lvl, L"info"))
-        logging::core::get()->set_filter(logging::trivial::severity >= boost::log::trivial::info);
+        severity = boost::log::trivial::info;
     else if (boost::iequals(lvl, L"warning"))
-        logging::core::get()->set_filter(logging::trivial::severity >= boost::log::trivial::warning);
+        severity = boost::log::trivial::warning;
     else if (boost::iequals(lvl, L"error"))
-        logging::core::get()->set_filter(logging::trivial::severity >= boost::log::trivial::error);
+        severity = boost::log::trivial::error;
     else if (boost::iequals(lvl, L"fatal"))
-        logging::core::get()->set_filter(logging::trivial::severity >= boost::log::trivial::fatal);
+        severity = boost::log::trivial::fatal;
     else
         return false;
 
+    logging::core::get()->set_filter(logging::trivial::severity >= severity);
+    detail::min_severity = static_cast<int>(severity);
+
     // TODO is this a race condition?
     current_config.current_level = lvl;
     return true;
@@ -56,7 +56,25 @@ std::string current_exception_diagnostic_information();
 using caspar_logger = boost::log::sources::wseverity_logger<boost::log::trivial::severity_level>;
 
 BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(logger, caspar_logger)
-#define CASPAR_LOG(lvl) BOOST_LOG_SEV(::caspar::log::logger::get(), boost::log::trivial::severity_level::lvl)
+
+namespace detail {
+
+extern std::atomic<int> min_severity;
+
+} // namespace detail
+
+// Whether records of the severity pass the log level, which costs a relaxed load rather than the filtering of the
+// logging core
+inline bool enabled(boost::log::trivial::severity_level severity)
+{
+    return static_cast<int>(severity) >= detail::min_severity.load(std::memory_order_relaxed);
+}
+
+#define CASPAR_LOG(lvl)                                                                                                \
+    for (bool caspar_log_enabled = ::caspar::log::enabled(boost::log::trivial::severity_level::lvl);                   \
+         caspar_log_enabled;                                                                                           \
+         caspar_log_enabled = false)                                                                                   \
+    BOOST_LOG_SEV(::caspar::log::logger::get(), boost::log::trivial::severity_level::lvl)
 
 struct logging_config
 {
@@ -64,6 +82,8 @@ struct logging_config
     std::wstring      current_level;
 };
 
+// The sinks write on threads of their own from queues of a bounded size, so that a stalled disk or console does not
+// hold up the threads that log. Records that do not fit are dropped, and how many is written once there is room again.
 void          add_file_sink(const std::wstring& file);
 void          add_cout_sink();
 bool          set_log_level(const std::wstring& lvl);
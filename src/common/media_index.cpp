@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "media_index.h"
+
+#include "log.h"
+#include "os/directory_watcher.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace caspar {
+
+namespace {
+
+boost::filesystem::path normalize(std::wstring folder)
+{
+    while (folder.size() > 1 && (folder.back() == L'/' || folder.back() == L'\\')) {
+        folder.pop_back();
+    }
+    return boost::filesystem::path(folder).lexically_normal();
+}
+
+} // namespace
+
+struct media_index::impl
+{
+    const boost::filesystem::path folder_;
+    const std::locale             loc_ = std::locale(""); // Use system locale
+
+    mutable std::mutex                                             mutex_;
+    bool                                                           ready_ = false;
+    std::unordered_map<std::wstring, boost::filesystem::path>      files_; // By relative path
+    std::unordered_multimap<std::wstring, boost::filesystem::path> stems_; // By relative path without extension
+
+    std::atomic<bool>                  stop_{false};
+    std::unique_ptr<directory_watcher> watcher_;
+    std::thread                        thread_;
+
+    explicit impl(const std::wstring& folder)
+        : folder_(normalize(folder))
+    {
+        // Before the folder is scanned, so that nothing that changes while it is goes unseen
+        watcher_ = watch_directory(folder_.wstring(),
+                                   [this](directory_change change, const boost::filesystem::path& relative) {
+                                       on_change(change, relative);
+                                   });
+        if (!watcher_) {
+            CASPAR_LOG(warning) << L"Unable to watch " << folder_.wstring()
+                                << L" for changes. Files that are not in its index are searched for.";
+        }
+
+        thread_ = std::thread([this] {
+            try {
+                scan();
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                CASPAR_LOG(info) << L"Indexed " << files_.size() << L" files in " << folder_.wstring() << L".";
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        stop_ = true;
+        watcher_.reset();
+        thread_.join();
+    }
+
+    std::wstring key(const boost::filesystem::path& relative) const
+    {
+        return boost::algorithm::to_lower_copy(relative.generic_wstring(), loc_);
+    }
+
+    void add(const boost::filesystem::path& relative)
+    {
+        auto path = folder_ / relative;
+        files_.insert_or_assign(key(relative), path);
+        stems_.emplace(key(relative.parent_path() / relative.stem()), path);
+    }
+
+    void remove(const std::wstring& file_key, boost::filesystem::path path) // A copy, as it may be the one erased
+    {
+        files_.erase(file_key);
+
+        auto relative = path.lexically_relative(folder_);
+        auto range    = stems_.equal_range(key(relative.parent_path() / relative.stem()));
+        for (auto it = range.first; it != range.second;) {
+            it = it->second == path ? stems_.erase(it) : std::next(it);
+        }
+    }
+
+    // Adds the file at relative, or the files below it if it is a folder
+    void add_tree(const boost::filesystem::path& relative)
+    {
+        boost::system::error_code ec;
+        auto                      path = folder_ / relative;
+        if (boost::filesystem::is_regular_file(path, ec)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            add(relative);
+            return;
+        }
+        if (!boost::filesystem::is_directory(path, ec)) {
+            return;
+        }
+
+        std::vector<boost::filesystem::path> found;
+        for (auto it = boost::filesystem::recursive_directory_iterator(
+                 path, boost::filesystem::directory_options::skip_permission_denied, ec);
+             !ec && it != boost::filesystem::recursive_directory_iterator() && !stop_;
+             it.increment(ec)) {
+            if (boost::filesystem::is_regular_file(it->status())) {
+                found.push_back(it->path().lexically_relative(folder_));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& file : found) {
+            add(file);
+        }
+    }
+
+    // Indexes the folder anew, answering from the old index until the new one is complete
+    void scan()
+    {
+        std::unordered_map<std::wstring, boost::filesystem::path>      files;
+        std::unordered_multimap<std::wstring, boost::filesystem::path> stems;
+
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::recursive_directory_iterator(
+                 folder_, boost::filesystem::directory_options::skip_permission_denied, ec);
+             !ec && it != boost::filesystem::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (stop_) {
+                return;
+            }
+            if (boost::filesystem::is_regular_file(it->status())) {
+                auto relative = it->path().lexically_relative(folder_);
+                files.insert_or_assign(key(relative), it->path());
+                stems.emplace(key(relative.parent_path() / relative.stem()), it->path());
+            }
+        }
+        if (ec) {
+            CASPAR_LOG(warning) << L"Unable to index " << folder_.wstring() << L": " << ec.message().c_str();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        files_.swap(files);
+        stems_.swap(stems);
+        ready_ = true;
+    }
+
+    void on_change(directory_change change, const boost::filesystem::path& relative)
+    {
+        if (change == directory_change::overflow) {
+            scan();
+        } else if (change == directory_change::added) {
+            add_tree(relative);
+        } else {
+            auto                        file_key = key(relative);
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = files_.find(file_key);
+            if (it != files_.end()) {
+                remove(file_key, it->second);
+                return;
+            }
+
+            // A folder, which takes the files below it along
+            auto                                                          prefix = file_key + L"/";
+            std::vector<std::pair<std::wstring, boost::filesystem::path>> removed;
+            for (auto& file : files_) {
+                if (boost::algorithm::starts_with(file.first, prefix)) {
+                    removed.push_back(file);
+                }
+            }
+            for (auto& file : removed) {
+                remove(file.first, file.second);
+            }
+        }
+    }
+
+    bool find(const std::wstring& name, std::vector<boost::filesystem::path>& files) const
+    {
+        auto relative = boost::filesystem::path(boost::algorithm::replace_all_copy(name, L"\\", L"/"));
+        auto file_key = key(relative.lexically_normal());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ready_) {
+            return false;
+        }
+
+        auto file = files_.find(file_key);
+        if (file != files_.end()) {
+            files.push_back(file->second);
+        }
+        auto range = stems_.equal_range(file_key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (file == files_.end() || it->second != file->second) {
+                files.push_back(it->second);
+            }
+        }
+        return !files.empty();
+    }
+};
+
+media_index::media_index(const std::wstring& folder)
+    : impl_(new impl(folder))
+{
+}
+
+media_index::~media_index() {}
+
+const boost::filesystem::path& media_index::folder() const { return impl_->folder_; }
+
+bool media_index::find(const std::wstring& name, std::vector<boost::filesystem::path>& files) const
+{
+    return impl_->find(name, files);
+}
+
+size_t media_index::size() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->files_.size();
+}
+
+namespace {
+
+std::mutex                              indexes_mutex;
+std::vector<std::weak_ptr<media_index>> indexes;
+
+} // namespace
+
+std::shared_ptr<media_index> start_media_index(const std::wstring& folder)
+{
+    auto index = std::make_shared<media_index>(folder);
+
+    std::lock_guard<std::mutex> lock(indexes_mutex);
+    indexes.erase(std::remove_if(indexes.begin(), indexes.end(), [](auto& index) { return index.expired(); }),
+                  indexes.end());
+    indexes.push_back(index);
+    return index;
+}
+
+std::shared_ptr<media_index> find_media_index(const std::wstring& folder)
+{
+    auto path = normalize(folder);
+
+    std::lock_guard<std::mutex> lock(indexes_mutex);
+    for (auto& weak : indexes) {
+        auto index = weak.lock();
+        if (index && index->folder() == path) {
+            return index;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace caspar
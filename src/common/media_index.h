@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+// An index of the files below a folder by their lowercase paths relative to it, with and without extension, which
+// resolves clips without searching the folder on disk. It is built in the background and kept up to date by watching
+// the folder.
+class media_index
+{
+  public:
+    explicit media_index(const std::wstring& folder);
+    ~media_index();
+
+    media_index(const media_index&)            = delete;
+    media_index& operator=(const media_index&) = delete;
+
+    const boost::filesystem::path& folder() const;
+
+    // The files that name, relative to the folder, could refer to case-insensitively, by their name or by their name
+    // without extension. False until the index is built, or when no file has that name, in which case it may still
+    // be there if the folder can not be watched, e.g. on some network shares.
+    bool find(const std::wstring& name, std::vector<boost::filesystem::path>& files) const;
+
+    size_t size() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+// Indexes folder for as long as the index is held, which find_file_within_dir_or_absolute then resolves files within
+// it from
+std::shared_ptr<media_index> start_media_index(const std::wstring& folder);
+
+// The index of folder, if one is held
+std::shared_ptr<media_index> find_media_index(const std::wstring& folder);
+
+} // namespace caspar
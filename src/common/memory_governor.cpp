@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memory_governor.h"
+
+#include "log.h"
+#include "os/thread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace caspar {
+
+namespace {
+
+struct account
+{
+    const std::string                             subsystem;
+    const memory_reclaim                          reclaim;
+    const std::function<std::int64_t()>           usage;
+    const std::function<void(std::int64_t bytes)> trim;
+};
+
+class governor
+{
+    std::mutex                                    mutex_;
+    std::condition_variable                       cond_;
+    std::vector<std::shared_ptr<account>>         accounts_;
+    memory_limits                                 limits_;
+    memory_statistics                             statistics_;
+    std::function<void(const memory_statistics&)> listener_;
+    bool                                          abort_ = false;
+
+    std::atomic<memory_pressure> pressure_{memory_pressure::normal};
+    std::thread                  thread_;
+
+  public:
+    governor()
+        : thread_([this] { run(); })
+    {
+    }
+
+    ~governor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    static governor& instance()
+    {
+        static governor instance;
+        return instance;
+    }
+
+    void add(std::shared_ptr<account> account)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        accounts_.push_back(std::move(account));
+    }
+
+    // Once this returns, the governor no longer calls the account
+    void remove(const std::shared_ptr<account>& account)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        accounts_.erase(std::remove(accounts_.begin(), accounts_.end(), account), accounts_.end());
+    }
+
+    void configure(const memory_limits& limits)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limits_ = limits;
+        cond_.notify_all();
+    }
+
+    void set_listener(std::function<void(const memory_statistics&)> listener)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listener_ = std::move(listener);
+    }
+
+    memory_pressure pressure() const { return pressure_; }
+
+    memory_statistics statistics()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return statistics_;
+    }
+
+  private:
+    void run()
+    {
+        set_thread_name(L"[memory_governor]");
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!abort_) {
+            try {
+                sample();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            auto listener   = listener_;
+            auto statistics = statistics_;
+            if (listener) {
+                lock.unlock();
+                try {
+                    listener(statistics);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+                lock.lock();
+            }
+
+            cond_.wait_for(lock, std::chrono::milliseconds(500), [&] { return abort_; });
+        }
+    }
+
+    // Called with mutex_ held
+    void sample()
+    {
+        std::vector<std::pair<std::int64_t, account*>> usages;
+        std::map<std::string, memory_usage>            subsystems;
+        std::int64_t                                   total = 0;
+        for (auto& account : accounts_) {
+            auto bytes = std::max<std::int64_t>(account->usage(), 0);
+            usages.emplace_back(bytes, account.get());
+            total += bytes;
+
+            auto& usage     = subsystems[account->subsystem];
+            usage.subsystem = account->subsystem;
+            usage.bytes += bytes;
+            usage.accounts += 1;
+        }
+
+        auto pressure = memory_pressure::normal;
+        if (limits_.hard > 0 && total > limits_.hard) {
+            pressure = memory_pressure::hard;
+        } else if (limits_.soft > 0 && total > limits_.soft) {
+            pressure = memory_pressure::soft;
+        }
+
+        if (pressure != pressure_) {
+            if (pressure == memory_pressure::normal) {
+                CASPAR_LOG(info) << L"[memory_governor] Back under the limits at " << total / (1024 * 1024) << L" MB.";
+            } else {
+                CASPAR_LOG(warning) << L"[memory_governor] " << total / (1024 * 1024) << L" MB is over the "
+                                    << to_string(pressure) << L" limit.";
+            }
+            pressure_ = pressure;
+        }
+
+        if (pressure != memory_pressure::normal) {
+            // Back under the soft limit, from caches before pools, and from the largest account of each first
+            auto excess = total - (limits_.soft > 0 ? limits_.soft : limits_.hard);
+            std::sort(usages.begin(), usages.end(), [](const auto& lhs, const auto& rhs) {
+                return lhs.first > rhs.first;
+            });
+            for (auto reclaim : {memory_reclaim::cache, memory_reclaim::pool}) {
+                for (auto& usage : usages) {
+                    if (excess <= 0) {
+                        break;
+                    }
+                    auto& account = *usage.second;
+                    if (account.reclaim != reclaim || !account.trim || usage.first == 0) {
+                        continue;
+                    }
+                    auto bytes = std::min(excess, usage.first);
+                    account.trim(bytes);
+                    excess -= bytes;
+                    statistics_.trims += 1;
+                }
+            }
+        }
+
+        statistics_.limits   = limits_;
+        statistics_.pressure = pressure;
+        statistics_.total    = total;
+        statistics_.subsystems.clear();
+        for (auto& subsystem : subsystems) {
+            statistics_.subsystems.push_back(std::move(subsystem.second));
+        }
+    }
+};
+
+} // namespace
+
+struct memory_account::impl
+{
+    std::shared_ptr<account> account_;
+
+    impl(std::shared_ptr<account> account)
+        : account_(std::move(account))
+    {
+        governor::instance().add(account_);
+    }
+
+    ~impl() { governor::instance().remove(account_); }
+};
+
+memory_account::memory_account(std::string                             subsystem,
+                               memory_reclaim                          reclaim,
+                               std::function<std::int64_t()>           usage,
+                               std::function<void(std::int64_t bytes)> trim)
+    : impl_(new impl(
+          std::make_shared<account>(account{std::move(subsystem), reclaim, std::move(usage), std::move(trim)})))
+{
+}
+
+memory_account::~memory_account() {}
+
+void configure_memory_governor(const memory_limits& limits) { governor::instance().configure(limits); }
+
+memory_pressure current_memory_pressure() { return governor::instance().pressure(); }
+
+memory_statistics memory_governor_statistics() { return governor::instance().statistics(); }
+
+void set_memory_governor_listener(std::function<void(const memory_statistics&)> listener)
+{
+    governor::instance().set_listener(std::move(listener));
+}
+
+const wchar_t* to_string(memory_pressure pressure)
+{
+    switch (pressure) {
+        case memory_pressure::soft:
+            return L"soft";
+        case memory_pressure::hard:
+            return L"hard";
+        default:
+            return L"normal";
+    }
+}
+
+} // namespace caspar
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+// How far the memory of the accounted subsystems is over the limits of the governor
+enum class memory_pressure
+{
+    normal,
+    soft, // Over the soft limit, caches and idle pools are trimmed back under it and read-ahead shrinks
+    hard, // Over the hard limit, read-ahead and queues are also cut to what playback needs
+};
+
+// What the governor may take back from a subsystem, in the order it asks them
+enum class memory_reclaim
+{
+    none,  // Only accounted, such as buffers that shrink by themselves under pressure
+    cache, // What can be loaded again, such as decoded stills
+    pool,  // Idle resources kept for reuse
+};
+
+struct memory_limits
+{
+    std::int64_t soft = 0; // In bytes, 0 is unlimited
+    std::int64_t hard = 0;
+};
+
+// Accounts the memory of a subsystem for as long as it is held. The governor samples usage twice a second and calls
+// trim with the bytes it wants back while over a limit, both on its own thread until the account is destroyed. They
+// must not block, trimming that has to be done on another thread is posted to it and shows in the next sample.
+class memory_account final
+{
+  public:
+    memory_account(std::string                             subsystem,
+                   memory_reclaim                          reclaim,
+                   std::function<std::int64_t()>           usage,
+                   std::function<void(std::int64_t bytes)> trim = nullptr);
+    ~memory_account();
+
+    memory_account(const memory_account&)            = delete;
+    memory_account& operator=(const memory_account&) = delete;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+void configure_memory_governor(const memory_limits& limits);
+
+// As of the last sample, cheap enough to be checked on every read
+memory_pressure current_memory_pressure();
+
+struct memory_usage
+{
+    std::string  subsystem;
+    std::int64_t bytes    = 0;
+    int          accounts = 0; // Such as one per device or clip
+};
+
+struct memory_statistics
+{
+    memory_limits             limits;
+    memory_pressure           pressure = memory_pressure::normal;
+    std::int64_t              total    = 0;
+    std::uint64_t             trims    = 0; // Times a subsystem was asked to trim
+    std::vector<memory_usage> subsystems;
+};
+
+memory_statistics memory_governor_statistics();
+
+// Called on the thread of the governor after each sample, such as to send the usage over OSC
+void set_memory_governor_listener(std::function<void(const memory_statistics&)> listener);
+
+const wchar_t* to_string(memory_pressure pressure);
+
+} // namespace caspar
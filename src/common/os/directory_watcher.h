@@ -0,0 +1,31 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace caspar {
+
+enum class directory_change
+{
+    added,
+    removed,
+    overflow, // Changes were lost, so whatever relies on them must look at the folder again
+};
+
+// Reports the files and folders that come and go below a folder, by path relative to it, on a thread of its own until
+// it is destroyed. Folders that are added are watched as well.
+class directory_watcher
+{
+  public:
+    using callback_t = std::function<void(directory_change, const boost::filesystem::path&)>;
+
+    virtual ~directory_watcher() = default;
+};
+
+// Nothing when the OS can not watch folder
+std::unique_ptr<directory_watcher> watch_directory(const std::wstring& folder, directory_watcher::callback_t callback);
+
+} // namespace caspar
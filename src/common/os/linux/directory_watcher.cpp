@@ -0,0 +1,165 @@
+#include "../directory_watcher.h"
+#include "../../log.h"
+
+#include <boost/filesystem.hpp>
+
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace caspar {
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+class inotify_watcher : public directory_watcher
+{
+    const boost::filesystem::path folder_;
+    const callback_t              callback_;
+
+    int                                    fd_      = -1;
+    int                                    stop_fd_ = -1;
+    std::map<int, boost::filesystem::path> watches_; // Of the folders, relative to folder_
+    std::thread                            thread_;
+
+  public:
+    inotify_watcher(const std::wstring& folder, callback_t callback)
+        : folder_(folder)
+        , callback_(std::move(callback))
+    {
+        fd_      = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        stop_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (fd_ < 0 || stop_fd_ < 0) {
+            close_fds();
+            return;
+        }
+
+        watch(boost::filesystem::path());
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~inotify_watcher() override
+    {
+        if (thread_.joinable()) {
+            uint64_t value = 1;
+            if (write(stop_fd_, &value, sizeof(value)) == sizeof(value)) {
+                thread_.join();
+            } else {
+                thread_.detach();
+                return;
+            }
+        }
+        close_fds();
+    }
+
+    bool valid() const { return fd_ >= 0; }
+
+  private:
+    void close_fds()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+        if (stop_fd_ >= 0)
+            close(stop_fd_);
+        fd_      = -1;
+        stop_fd_ = -1;
+    }
+
+    // Watches the folder and those below it, as inotify does not watch a tree
+    void watch(const boost::filesystem::path& relative)
+    {
+        auto wd = inotify_add_watch(fd_, (folder_ / relative).c_str(), WATCH_MASK);
+        if (wd < 0) {
+            CASPAR_LOG(warning) << L"Unable to watch " << (folder_ / relative).wstring()
+                                << L" for changes. Raise fs.inotify.max_user_watches if it has many folders.";
+            return;
+        }
+        watches_[wd] = relative;
+
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::directory_iterator(folder_ / relative, ec);
+             !ec && it != boost::filesystem::directory_iterator();
+             it.increment(ec)) {
+            if (boost::filesystem::is_directory(it->status())) {
+                watch(relative / it->path().filename());
+            }
+        }
+    }
+
+    void run()
+    {
+        alignas(struct inotify_event) char buffer[64 * 1024];
+
+        while (true) {
+            pollfd fds[2] = {{fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                continue;
+            }
+            if (fds[1].revents != 0) {
+                return;
+            }
+
+            auto size = read(fd_, buffer, sizeof(buffer));
+            for (ssize_t offset = 0; offset < size;) {
+                auto event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+                offset += sizeof(struct inotify_event) + event->len;
+
+                try {
+                    handle(*event);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        }
+    }
+
+    void handle(const struct inotify_event& event)
+    {
+        if ((event.mask & IN_Q_OVERFLOW) != 0) {
+            callback_(directory_change::overflow, boost::filesystem::path());
+            return;
+        }
+
+        auto it = watches_.find(event.wd);
+        if (it == watches_.end()) {
+            return;
+        }
+        if ((event.mask & IN_IGNORED) != 0) {
+            watches_.erase(it);
+            return;
+        }
+        if (event.len == 0) {
+            return;
+        }
+
+        auto relative = it->second / event.name;
+        if ((event.mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+            // Before it is reported, so that nothing added to the folder in between goes unseen
+            if ((event.mask & IN_ISDIR) != 0) {
+                watch(relative);
+            }
+            callback_(directory_change::added, relative);
+        } else if ((event.mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+            callback_(directory_change::removed, relative);
+        }
+    }
+};
+
+} // namespace
+
+std::unique_ptr<directory_watcher> watch_directory(const std::wstring& folder, directory_watcher::callback_t callback)
+{
+    auto watcher = std::make_unique<inotify_watcher>(folder, std::move(callback));
+    if (!watcher->valid()) {
+        return nullptr;
+    }
+    return watcher;
+}
+
+} // namespace caspar
@@ -0,0 +1,62 @@
+#include "../page_memory.h"
+
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace caspar {
+
+namespace {
+
+const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+std::size_t round_up(std::size_t size, std::size_t alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+void* map(std::size_t size, int flags)
+{
+    auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+} // namespace
+
+void* allocate_pages(std::size_t& size, huge_pages mode)
+{
+    if (mode == huge_pages::none) {
+        size = round_up(size, static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+        return map(size, 0);
+    }
+
+    // Huge pages only back whole, aligned huge pages of a mapping
+    auto rounded = round_up(size, HUGE_PAGE_SIZE);
+    size         = rounded;
+
+#ifdef MAP_HUGETLB
+    if (mode == huge_pages::reserved) {
+        if (auto ptr = map(rounded, MAP_HUGETLB)) {
+            return ptr;
+        }
+    }
+#endif
+
+    // Maps a huge page more than needed, to trim down to an aligned range
+    auto ptr = static_cast<char*>(map(rounded + HUGE_PAGE_SIZE, 0));
+    if (!ptr) {
+        return nullptr;
+    }
+    auto aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<std::uintptr_t>(ptr), HUGE_PAGE_SIZE));
+    if (aligned != ptr) {
+        munmap(ptr, aligned - ptr);
+    }
+    munmap(aligned + rounded, ptr + rounded + HUGE_PAGE_SIZE - (aligned + rounded));
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, rounded, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+void free_pages(void* ptr, std::size_t size) { munmap(ptr, size); }
+
+} // namespace caspar
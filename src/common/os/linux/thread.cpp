@@ -1,11 +1,85 @@
 #include "../thread.h"
+#include "../../diagnostics/trace.h"
+#include "../../log.h"
 #include "../../utf.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include <pthread.h>
 #include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
 namespace caspar {
 
-void set_thread_name(const std::wstring& name) { pthread_setname_np(pthread_self(), u8(name).c_str()); }
+namespace {
+
+std::vector<int> numa_node_cpus(int node)
+{
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string   list;
+    if (!std::getline(file, list)) {
+        return {};
+    }
+    return parse_cpu_list(u16(list));
+}
+
+// Prefers the memory of the node for what the thread allocates, and first touches, from now on
+bool prefer_numa_node(int node)
+{
+    const int    MPOL_PREFERRED = 1;
+    const size_t BITS           = 8 * sizeof(unsigned long);
+
+    std::vector<unsigned long> mask(node / BITS + 1, 0);
+    mask[node / BITS] |= 1ul << (node % BITS);
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), mask.size() * BITS + 1) == 0;
+}
+
+void place_thread(const std::wstring& name)
+{
+    thread_placement placement;
+    if (!detail::find_thread_placement(name, placement)) {
+        return;
+    }
+
+    auto cpus = placement.cpus;
+    if (cpus.empty() && placement.numa_node >= 0) {
+        cpus = numa_node_cpus(placement.numa_node);
+    }
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            CASPAR_LOG(warning) << L"Failed to set the cpus of thread " << name;
+        }
+    }
+
+    if (placement.numa_node >= 0 && !prefer_numa_node(placement.numa_node)) {
+        CASPAR_LOG(warning) << L"Failed to prefer numa node " << placement.numa_node << L" for thread " << name;
+    }
+
+    if (placement.realtime) {
+        set_thread_realtime_priority();
+    }
+}
+
+} // namespace
+
+void set_thread_name(const std::wstring& name)
+{
+    pthread_setname_np(pthread_self(), u8(name).c_str());
+    diagnostics::trace::set_thread_name(name);
+    place_thread(name);
+}
 
 void set_thread_realtime_priority()
 {
@@ -18,4 +92,12 @@ void set_thread_realtime_priority()
     pthread_setschedparam(handle, SCHED_FIFO, &param);
 }
 
+std::int64_t thread_cpu_time()
+{
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+        return 0;
+    return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
 } // namespace caspar
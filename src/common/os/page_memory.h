@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+namespace caspar {
+
+enum class huge_pages
+{
+    none,
+    // Transparent huge pages, which the kernel backs the memory with where it can
+    transparent,
+    // The huge pages set aside by the administrator, falling back to normal pages once they run out
+    reserved,
+};
+
+// Maps whole pages straight from the OS, of which there are far fewer to fault in and to keep in the TLB when they are
+// huge. Rounds size up to what was mapped, which is what the pages are freed with. Returns nullptr if it fails.
+void* allocate_pages(std::size_t& size, huge_pages mode);
+
+void free_pages(void* ptr, std::size_t size);
+
+} // namespace caspar
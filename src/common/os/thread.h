@@ -1,9 +1,37 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace caspar {
 
 void set_thread_name(const std::wstring& name);
 void set_thread_realtime_priority();
+
+// The CPU time the calling thread has used, in nanoseconds
+std::int64_t thread_cpu_time();
+
+// Where the threads of a role run, matched by the name given to set_thread_name, in which * matches any characters,
+// e.g. "channel-*". A thread is placed as it is named.
+struct thread_placement
+{
+    std::wstring     name;
+    std::vector<int> cpus;           // The cpus it may run on, or any if empty
+    int              numa_node = -1; // The node it runs and allocates memory on, or -1 for any
+    bool             realtime  = false;
+};
+
+// Replaces the placements, the first of which that matches a thread name applies
+void set_thread_placements(std::vector<thread_placement> placements);
+
+// Parses a list of cpus such as "0-7,16-23"
+std::vector<int> parse_cpu_list(const std::wstring& list);
+
+namespace detail {
+
+bool find_thread_placement(const std::wstring& name, thread_placement& placement);
+
+} // namespace detail
+
 } // namespace caspar
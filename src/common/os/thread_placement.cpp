@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "thread.h"
+
+#include "../except.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <mutex>
+
+namespace caspar {
+
+namespace {
+
+std::mutex                    g_mutex;
+std::vector<thread_placement> g_placements;
+
+bool matches(const wchar_t* pattern, const wchar_t* name)
+{
+    if (*pattern == L'*') {
+        return matches(pattern + 1, name) || (*name != 0 && matches(pattern, name + 1));
+    }
+    if (*pattern == 0 || *name == 0) {
+        return *pattern == *name;
+    }
+    return *pattern == *name && matches(pattern + 1, name + 1);
+}
+
+} // namespace
+
+void set_thread_placements(std::vector<thread_placement> placements)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_placements = std::move(placements);
+}
+
+std::vector<int> parse_cpu_list(const std::wstring& list)
+{
+    std::vector<std::wstring> ranges;
+    boost::split(ranges, list, boost::is_any_of(L","), boost::token_compress_on);
+
+    std::vector<int> cpus;
+    for (auto range : ranges) {
+        boost::trim(range);
+        if (range.empty()) {
+            continue;
+        }
+
+        try {
+            auto dash  = range.find(L'-');
+            auto first = boost::lexical_cast<int>(boost::trim_copy(range.substr(0, dash)));
+            auto last  = dash == std::wstring::npos ? first
+                                                    : boost::lexical_cast<int>(boost::trim_copy(range.substr(dash + 1)));
+            if (first < 0 || last < first) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid cpu range: " + range));
+            }
+            for (auto cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (boost::bad_lexical_cast&) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid cpu range: " + range));
+        }
+    }
+    return cpus;
+}
+
+namespace detail {
+
+bool find_thread_placement(const std::wstring& name, thread_placement& placement)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    for (auto& candidate : g_placements) {
+        if (matches(candidate.name.c_str(), name.c_str())) {
+            placement = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace detail
+
+} // namespace caspar
@@ -0,0 +1,145 @@
+#include "../directory_watcher.h"
+
+#include <thread>
+#include <vector>
+
+#include <windows.h>
+
+#include "../../log.h"
+
+namespace caspar {
+
+namespace {
+
+class read_directory_changes_watcher : public directory_watcher
+{
+    const callback_t callback_;
+
+    HANDLE      directory_ = INVALID_HANDLE_VALUE;
+    HANDLE      changed_   = nullptr;
+    HANDLE      stop_      = nullptr;
+    std::thread thread_;
+
+  public:
+    read_directory_changes_watcher(const std::wstring& folder, callback_t callback)
+        : callback_(std::move(callback))
+    {
+        directory_ = CreateFileW(folder.c_str(),
+                                 FILE_LIST_DIRECTORY,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 nullptr,
+                                 OPEN_EXISTING,
+                                 FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                 nullptr);
+        changed_   = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        stop_      = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!valid()) {
+            return;
+        }
+
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~read_directory_changes_watcher() override
+    {
+        if (thread_.joinable()) {
+            SetEvent(stop_);
+            thread_.join();
+        }
+
+        if (directory_ != INVALID_HANDLE_VALUE)
+            CloseHandle(directory_);
+        if (changed_ != nullptr)
+            CloseHandle(changed_);
+        if (stop_ != nullptr)
+            CloseHandle(stop_);
+    }
+
+    bool valid() const { return directory_ != INVALID_HANDLE_VALUE && changed_ != nullptr && stop_ != nullptr; }
+
+  private:
+    void run()
+    {
+        // DWORD aligned, as ReadDirectoryChangesW requires
+        std::vector<DWORD> buffer(16 * 1024);
+
+        while (true) {
+            OVERLAPPED overlapped = {};
+            overlapped.hEvent     = changed_;
+            ResetEvent(changed_);
+
+            if (!ReadDirectoryChangesW(directory_,
+                                       buffer.data(),
+                                       static_cast<DWORD>(buffer.size() * sizeof(DWORD)),
+                                       TRUE,
+                                       FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME,
+                                       nullptr,
+                                       &overlapped,
+                                       nullptr)) {
+                CASPAR_LOG(warning) << L"Stopped watching the media folder for changes.";
+                return;
+            }
+
+            HANDLE handles[] = {changed_, stop_};
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+                CancelIoEx(directory_, &overlapped);
+                DWORD bytes = 0;
+                GetOverlappedResult(directory_, &overlapped, &bytes, TRUE);
+                return;
+            }
+
+            DWORD bytes = 0;
+            if (!GetOverlappedResult(directory_, &overlapped, &bytes, FALSE)) {
+                continue;
+            }
+
+            try {
+                // No bytes means that the changes did not fit in the buffer
+                if (bytes == 0) {
+                    callback_(directory_change::overflow, boost::filesystem::path());
+                    continue;
+                }
+
+                auto data = reinterpret_cast<const char*>(buffer.data());
+                while (true) {
+                    auto info     = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(data);
+                    auto relative = boost::filesystem::path(
+                        std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+
+                    switch (info->Action) {
+                        case FILE_ACTION_ADDED:
+                        case FILE_ACTION_RENAMED_NEW_NAME:
+                            callback_(directory_change::added, relative);
+                            break;
+                        case FILE_ACTION_REMOVED:
+                        case FILE_ACTION_RENAMED_OLD_NAME:
+                            callback_(directory_change::removed, relative);
+                            break;
+                        default:
+                            break;
+                    }
+
+                    if (info->NextEntryOffset == 0) {
+                        break;
+                    }
+                    data += info->NextEntryOffset;
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+};
+
+} // namespace
+
+std::unique_ptr<directory_watcher> watch_directory(const std::wstring& folder, directory_watcher::callback_t callback)
+{
+    auto watcher = std::make_unique<read_directory_changes_watcher>(folder, std::move(callback));
+    if (!watcher->valid()) {
+        return nullptr;
+    }
+    return watcher;
+}
+
+} // namespace caspar
@@ -0,0 +1,28 @@
+#include "../page_memory.h"
+
+#include <windows.h>
+
+namespace caspar {
+
+void* allocate_pages(std::size_t& size, huge_pages mode)
+{
+    // Large pages need the SeLockMemoryPrivilege, without which this falls back to normal pages. Windows has no
+    // transparent huge pages.
+    if (mode == huge_pages::reserved) {
+        auto large_page_size = GetLargePageMinimum();
+        if (large_page_size > 0) {
+            auto rounded = (size + large_page_size - 1) / large_page_size * large_page_size;
+            auto ptr     = VirtualAlloc(nullptr, rounded, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (ptr) {
+                size = rounded;
+                return ptr;
+            }
+        }
+    }
+
+    return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+void free_pages(void* ptr, std::size_t size) { VirtualFree(ptr, 0, MEM_RELEASE); }
+
+} // namespace caspar
@@ -4,6 +4,8 @@
 
 #include <windows.h>
 
+#include "../../diagnostics/trace.h"
+#include "../../log.h"
 #include "../../utf.h"
 
 namespace caspar {
@@ -31,8 +33,59 @@ inline void SetThreadName(DWORD dwThreadID, LPCSTR szThreadName)
     }
 }
 
-void set_thread_name(const std::wstring& name) { SetThreadName(GetCurrentThreadId(), u8(name).c_str()); }
+namespace {
+
+void place_thread(const std::wstring& name)
+{
+    thread_placement placement;
+    if (!detail::find_thread_placement(name, placement)) {
+        return;
+    }
+
+    DWORD_PTR mask = 0;
+    for (auto cpu : placement.cpus) {
+        if (cpu < static_cast<int>(sizeof(mask) * 8)) {
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+    }
+    if (mask == 0 && placement.numa_node >= 0) {
+        ULONGLONG node_mask = 0;
+        if (GetNumaNodeProcessorMask(static_cast<UCHAR>(placement.numa_node), &node_mask)) {
+            mask = static_cast<DWORD_PTR>(node_mask);
+        }
+    }
+
+    // Memory is allocated on the node of the processor that first touches it, so running there is enough
+    if (mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+        CASPAR_LOG(warning) << L"Failed to set the cpus of thread " << name;
+    }
+
+    if (placement.realtime) {
+        set_thread_realtime_priority();
+    }
+}
+
+} // namespace
+
+void set_thread_name(const std::wstring& name)
+{
+    SetThreadName(GetCurrentThreadId(), u8(name).c_str());
+    diagnostics::trace::set_thread_name(name);
+    place_thread(name);
+}
 
 void set_thread_realtime_priority() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL); }
 
+std::int64_t thread_cpu_time()
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    auto ticks = [](const FILETIME& time) {
+        return static_cast<std::int64_t>(time.dwHighDateTime) << 32 | time.dwLowDateTime;
+    };
+    // In units of 100 ns
+    return (ticks(kernel) + ticks(user)) * 100;
+}
+
 } // namespace caspar
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "task_arena.h"
+
+#include <array>
+#include <memory>
+#include <mutex>
+
+namespace caspar {
+
+namespace {
+
+constexpr std::size_t kind_count = 3;
+
+std::array<task_arena_config, kind_count> g_configs = {
+    task_arena_config{0, tbb::task_arena::priority::high},
+    task_arena_config{0, tbb::task_arena::priority::normal},
+    task_arena_config{0, tbb::task_arena::priority::low},
+};
+std::array<std::unique_ptr<tbb::task_arena>, kind_count> g_arenas;
+std::array<std::once_flag, kind_count>                   g_created;
+
+} // namespace
+
+void configure_task_arena(task_kind kind, const task_arena_config& config)
+{
+    g_configs.at(static_cast<std::size_t>(kind)) = config;
+}
+
+tbb::task_arena& get_task_arena(task_kind kind)
+{
+    auto index = static_cast<std::size_t>(kind);
+    std::call_once(g_created.at(index), [&] {
+        auto& config = g_configs[index];
+        auto  concurrency =
+            config.concurrency > 0 ? config.concurrency : static_cast<int>(tbb::task_arena::automatic);
+
+        // One slot is kept for the thread that runs the work, so it always takes part rather than waiting on workers
+        g_arenas[index] = std::make_unique<tbb::task_arena>(concurrency, 1, config.priority);
+    });
+    return *g_arenas[index];
+}
+
+} // namespace caspar
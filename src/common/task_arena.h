@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <tbb/task_arena.h>
+
+#include <utility>
+
+namespace caspar {
+
+// The kinds of work that parallel loops are run for. Each kind has a task arena of its own, so the tasks of a loop
+// never queue behind those of another kind, and idle workers join the arena of the highest priority first.
+enum class task_kind
+{
+    realtime,   // Work a channel has to finish within the frame, such as converting its output for a consumer
+    decode,     // Work of producers ahead of the channel, such as copying decoded frames
+    background, // Work without a deadline, such as destroying producers
+};
+
+struct task_arena_config
+{
+    int                       concurrency = 0; // Threads that work in the arena at once, or 0 for one per cpu
+    tbb::task_arena::priority priority    = tbb::task_arena::priority::normal;
+};
+
+// Replaces the configuration of the arena of a kind of work, which has to be done before anything runs in it
+void configure_task_arena(task_kind kind, const task_arena_config& config);
+
+tbb::task_arena& get_task_arena(task_kind kind);
+
+// Runs func in the arena of a kind of work, along with the parallel loops it starts, and returns its result
+template <typename Func>
+decltype(auto) run_in_arena(task_kind kind, Func&& func)
+{
+    return get_task_arena(kind).execute(std::forward<Func>(func));
+}
+
+} // namespace caspar
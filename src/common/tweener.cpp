@@ -55,33 +55,30 @@
 
 #include <algorithm>
 #include <cmath>
-#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace caspar {
 
-using tweener_t = std::function<double(double, double, double, double)>;
-
 static const double PI   = std::atan(1.0) * 4.0;
 static const double H_PI = std::atan(1.0) * 2.0;
 
-double ease_none(double t, double b, double c, double d, const std::vector<double>& params) { return c * t / d + b; }
+double ease_none(double t, double b, double c, double d, const tween_params& params) { return c * t / d + b; }
 
-double ease_in_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_quad(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t + b;
 }
 
-double ease_out_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_quad(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return -c * t * (t - 2) + b;
 }
 
-double ease_in_out_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_quad(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -90,7 +87,7 @@ double ease_in_out_quad(double t, double b, double c, double d, const std::vecto
     return -c / 2 * ((t - 1) * (t - 3) - 1) + b;
 }
 
-double ease_out_in_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_quad(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_quad(t * 2, b, c / 2, d, params);
@@ -98,19 +95,19 @@ double ease_out_in_quad(double t, double b, double c, double d, const std::vecto
     return ease_in_quad(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t * t + b;
 }
 
-double ease_out_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return c * (t * t * t + 1) + b;
 }
 
-double ease_in_out_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -120,26 +117,26 @@ double ease_in_out_cubic(double t, double b, double c, double d, const std::vect
     return c / 2 * (t * t * t + 2) + b;
 }
 
-double ease_out_in_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_cubic(t * 2, b, c / 2, d, params);
     return ease_in_cubic(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_quart(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t * t * t + b;
 }
 
-double ease_out_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_quart(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return -c * (t * t * t * t - 1) + b;
 }
 
-double ease_in_out_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_quart(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -149,7 +146,7 @@ double ease_in_out_quart(double t, double b, double c, double d, const std::vect
     return -c / 2 * (t * t * t * t - 2) + b;
 }
 
-double ease_out_in_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_quart(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_quart(t * 2, b, c / 2, d, params);
@@ -157,19 +154,19 @@ double ease_out_in_quart(double t, double b, double c, double d, const std::vect
     return ease_in_quart(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_quint(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t * t * t * t + b;
 }
 
-double ease_out_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_quint(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return c * (t * t * t * t * t + 1) + b;
 }
 
-double ease_in_out_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_quint(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -179,7 +176,7 @@ double ease_in_out_quint(double t, double b, double c, double d, const std::vect
     return c / 2 * (t * t * t * t * t + 2) + b;
 }
 
-double ease_out_in_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_quint(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_quint(t * 2, b, c / 2, d, params);
@@ -187,22 +184,22 @@ double ease_out_in_quint(double t, double b, double c, double d, const std::vect
     return ease_in_quint(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_sine(double t, double b, double c, double d, const tween_params& params)
 {
     return -c * std::cos(t / d * (PI / 2)) + c + b;
 }
 
-double ease_out_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_sine(double t, double b, double c, double d, const tween_params& params)
 {
     return c * std::sin(t / d * (PI / 2)) + b;
 }
 
-double ease_in_out_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_sine(double t, double b, double c, double d, const tween_params& params)
 {
     return -c / 2 * (std::cos(PI * t / d) - 1) + b;
 }
 
-double ease_out_in_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_sine(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_sine(t * 2, b, c / 2, d, params);
@@ -210,17 +207,17 @@ double ease_out_in_sine(double t, double b, double c, double d, const std::vecto
     return ease_in_sine(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_expo(double t, double b, double c, double d, const tween_params& params)
 {
     return t == 0 ? b : c * std::pow(2, 10 * (t / d - 1)) + b - c * 0.001;
 }
 
-double ease_out_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_expo(double t, double b, double c, double d, const tween_params& params)
 {
     return t == d ? b + c : c * 1.001 * (-std::pow(2, -10 * t / d) + 1) + b;
 }
 
-double ease_in_out_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_expo(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -233,7 +230,7 @@ double ease_in_out_expo(double t, double b, double c, double d, const std::vecto
     return c / 2 * 1.0005 * (-std::pow(2, -10 * (t - 1)) + 2) + b;
 }
 
-double ease_out_in_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_expo(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_expo(t * 2, b, c / 2, d, params);
@@ -241,19 +238,19 @@ double ease_out_in_expo(double t, double b, double c, double d, const std::vecto
     return ease_in_expo(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_circ(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return -c * (std::sqrt(1 - t * t) - 1) + b;
 }
 
-double ease_out_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_circ(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return c * std::sqrt(1 - t * t) + b;
 }
 
-double ease_in_out_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_circ(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -263,14 +260,14 @@ double ease_in_out_circ(double t, double b, double c, double d, const std::vecto
     return c / 2 * (std::sqrt(1 - t * t) + 1) + b;
 }
 
-double ease_out_in_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_circ(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_circ(t * 2, b, c / 2, d, params);
     return ease_in_circ(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -293,7 +290,7 @@ double ease_in_elastic(double t, double b, double c, double d, const std::vector
     return -(a * std::pow(2, 10 * t) * std::sin((t * d - s) * (2 * PI) / p)) + b;
 }
 
-double ease_out_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -315,7 +312,7 @@ double ease_out_elastic(double t, double b, double c, double d, const std::vecto
     return a * std::pow(2, -10 * t) * std::sin((t * d - s) * (2 * PI) / p) + c + b;
 }
 
-double ease_in_out_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -340,14 +337,14 @@ double ease_in_out_elastic(double t, double b, double c, double d, const std::ve
     return a * std::pow(2, -10 * t) * std::sin((t * d - s) * (2 * PI) / p) * .5 + c + b;
 }
 
-double ease_out_in_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_elastic(t * 2, b, c / 2, d, params);
     return ease_in_elastic(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_back(double t, double b, double c, double d, const tween_params& params)
 {
     // var s:Number = !Boolean(p_params) || isNaN(p_params.overshoot) ? 1.70158 : p_params.overshoot;
     double s = !params.empty() ? params[0] : 1.70158;
@@ -355,7 +352,7 @@ double ease_in_back(double t, double b, double c, double d, const std::vector<do
     return c * t * t * ((s + 1) * t - s) + b;
 }
 
-double ease_out_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_back(double t, double b, double c, double d, const tween_params& params)
 {
     // var s:Number = !Boolean(p_params) || isNaN(p_params.overshoot) ? 1.70158 : p_params.overshoot;
     double s = !params.empty() ? params[0] : 1.70158;
@@ -363,7 +360,7 @@ double ease_out_back(double t, double b, double c, double d, const std::vector<d
     return c * (t * t * ((s + 1) * t + s) + 1) + b;
 }
 
-double ease_in_out_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_back(double t, double b, double c, double d, const tween_params& params)
 {
     // var s:Number = !Boolean(p_params) || isNaN(p_params.overshoot) ? 1.70158 : p_params.overshoot;
     double s = !params.empty() ? params[0] : 1.70158;
@@ -375,14 +372,14 @@ double ease_in_out_back(double t, double b, double c, double d, const std::vecto
     return c / 2 * (t * t * ((s + 1) * t + s) + 2) + b;
 }
 
-double ease_out_int_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_int_back(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_back(t * 2, b, c / 2, d, params);
     return ease_in_back(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_out_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     if (t < 1 / 2.75)
@@ -399,26 +396,26 @@ double ease_out_bounce(double t, double b, double c, double d, const std::vector
     return c * (7.5625 * t * t + .984375) + b;
 }
 
-double ease_in_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     return c - ease_out_bounce(d - t, 0, c, d, params) + b;
 }
 
-double ease_in_out_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_in_bounce(t * 2, 0, c, d, params) * .5 + b;
     return ease_out_bounce(t * 2 - d, 0, c, d, params) * .5 + c * .5 + b;
 }
 
-double ease_out_in_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_bounce(t * 2, b, c / 2, d, params);
     return ease_in_bounce(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-using tween_t = std::function<double(double, double, double, double, const std::vector<double>&)>;
+using tween_t = tweener::func_t;
 
 const std::unordered_map<std::wstring, tween_t>& get_tweens()
 {
@@ -469,43 +466,41 @@ const std::unordered_map<std::wstring, tween_t>& get_tweens()
     return tweens;
 }
 
-tweener_t get_tweener(std::wstring name)
+tweener::tweener(const std::wstring& name)
 {
-    std::transform(name.begin(), name.end(), name.begin(), std::towlower);
-
-    if (name == L"linear")
-        return [](double t, double b, double c, double d) { return ease_none(t, b, c, d, std::vector<double>()); };
-
-    std::vector<double> params;
+    auto lower_name = name;
+    std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(), std::towlower);
 
     static const boost::wregex expr(
         LR"((?<NAME>\w*)(:(?<V0>\d+\.?\d?))?(:(?<V1>\d+\.?\d?))?)"); // boost::regex has no repeated captures?
     boost::wsmatch what;
-    if (boost::regex_match(name, what, expr)) {
-        name = what["NAME"].str();
+    if (boost::regex_match(lower_name, what, expr)) {
+        lower_name = what["NAME"].str();
         if (what["V0"].matched)
-            params.push_back(std::stod(what["V0"].str()));
+            params_.values[params_.count++] = std::stod(what["V0"].str());
         if (what["V1"].matched)
-            params.push_back(std::stod(what["V1"].str()));
+            params_.values[params_.count++] = std::stod(what["V1"].str());
     }
 
-    auto it = get_tweens().find(name);
+    auto it = get_tweens().find(lower_name);
     if (it == get_tweens().end())
-        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not find tween " + name));
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not find tween " + lower_name));
 
-    auto tween = it->second;
-    return [=](double t, double b, double c, double d) { return tween(t, b, c, d, params); };
-};
+    func_ = it->second;
+}
 
-tweener::tweener(const std::wstring& name)
-    : func_(get_tweener(name))
-    , name_(name)
+bool tweener::is_separable() const
 {
+    auto elastic = func_ == ease_in_elastic || func_ == ease_out_elastic || func_ == ease_in_out_elastic ||
+                   func_ == ease_out_in_elastic;
+    return !elastic || params_.size() < 2 || params_[1] == 0.0;
 }
 
-double tweener::operator()(double t, double b, double c, double d) const { return func_(t, b, c, d); }
-
-bool tweener::operator==(const tweener& other) const { return name_ == other.name_; }
+bool tweener::operator==(const tweener& other) const
+{
+    return func_ == other.func_ && params_.count == other.params_.count &&
+           std::equal(params_.values, params_.values + params_.count, other.params_.values);
+}
 
 bool tweener::operator!=(const tweener& other) const { return !(*this == other); }
 
@@ -21,12 +21,27 @@
 
 #pragma once
 
-#include <functional>
+#include <cstddef>
 #include <string>
 #include <vector>
 
 namespace caspar {
 
+/**
+ * The parameters appended to the name of a tween function, e.g. the period and
+ * amplitude of easeinelastic:0.5:2, kept inline so that a tweener is copied
+ * and evaluated without touching the heap.
+ */
+struct tween_params
+{
+    double values[2] = {0.0, 0.0};
+    int    count     = 0;
+
+    bool        empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+    double      operator[](std::size_t index) const { return values[index]; }
+};
+
 /**
  * A tweener can be used for creating any kind of (image position, image fade
  * in/out, audio volume etc) transition, by invoking it for each temporal
@@ -69,14 +84,23 @@ class tweener
      * @return The tweened value for the given timepoint. Can sometimes be less
      * 	       than b or greater than b + c for some tweener functions.
      */
-    double operator()(double t, double b, double c, double d) const;
+    double operator()(double t, double b, double c, double d) const { return func_(t, b, c, d, params_); }
+
+    /**
+     * @return Whether the tweened value is always b + c * (*this)(t, 0, 1, d),
+     *         so that any number of values can be tweened from one evaluation.
+     *         It is for all but the elastic tweens given an amplitude.
+     */
+    bool is_separable() const;
 
     bool operator==(const tweener& other) const;
     bool operator!=(const tweener& other) const;
 
+    using func_t = double (*)(double t, double b, double c, double d, const tween_params& params);
+
   private:
-    std::function<double(double, double, double, double)> func_;
-    std::wstring                                          name_;
+    func_t       func_;
+    tween_params params_;
 };
 
 } // namespace caspar
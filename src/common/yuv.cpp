@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "yuv.h"
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/ssse3.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <tmmintrin.h>
+#endif
+#endif
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace caspar {
+
+namespace {
+
+// BT.709
+constexpr double kr = 0.2126;
+constexpr double kb = 0.0722;
+
+// Fixed point coefficients, in the channel order of BGRA, that take input_max to the limited range of output_bits.
+// The chroma ones sum to zero, so that grey has none.
+struct coefficients
+{
+    int32_t y[3];
+    int32_t cb[3];
+    int32_t cr[3];
+
+    coefficients(int input_max, int output_bits, int shift)
+    {
+        const auto scale = static_cast<double>(1 << shift) * (1 << (output_bits - 8)) / input_max;
+        auto       q     = [&](double value) { return static_cast<int32_t>(std::lround(value * scale)); };
+
+        y[0] = q(219.0 * kb);
+        y[2] = q(219.0 * kr);
+        y[1] = q(219.0) - y[0] - y[2];
+
+        cb[0] = q(112.0);
+        cb[2] = q(-112.0 * kr / (1.0 - kb));
+        cb[1] = -cb[0] - cb[2];
+
+        cr[0] = q(-112.0 * kb / (1.0 - kr));
+        cr[2] = q(112.0);
+        cr[1] = -cr[0] - cr[2];
+    }
+};
+
+// 8 bit BGRA to 8 bit output, in Q15
+const coefficients q15(255, 8, 15);
+
+void row8_scalar(const uint8_t* src, int begin, int width, uint8_t* y, uint8_t* cb, uint8_t* cr, uint8_t* a)
+{
+    auto dot = [&](const int32_t* c, int x) { return c[0] * src[x * 4] + c[1] * src[x * 4 + 1] + c[2] * src[x * 4 + 2]; };
+
+    for (auto x = begin; x < width; ++x) {
+        y[x] = static_cast<uint8_t>((dot(q15.y, x) + (16 << 15) + (1 << 14)) >> 15);
+        if (a) {
+            a[x] = src[x * 4 + 3];
+        }
+    }
+    for (auto x = begin; x < width; x += 2) {
+        // The last pixel of an odd row is a pair of its own
+        const auto x2 = x + 1 < width ? x + 1 : x;
+
+        cb[x / 2] = static_cast<uint8_t>((dot(q15.cb, x) + dot(q15.cb, x2) + (128 << 16) + (1 << 15)) >> 16);
+        cr[x / 2] = static_cast<uint8_t>((dot(q15.cr, x) + dot(q15.cr, x2) + (128 << 16) + (1 << 15)) >> 16);
+    }
+}
+
+// Eight pixels at a time, with the same arithmetic as row8_scalar
+void row8(const uint8_t* src, int width, uint8_t* y, uint8_t* cb, uint8_t* cr, uint8_t* a)
+{
+    auto coeffs = [](const int32_t* c) {
+        const auto c0 = static_cast<int16_t>(c[0]);
+        const auto c1 = static_cast<int16_t>(c[1]);
+        const auto c2 = static_cast<int16_t>(c[2]);
+        return _mm_setr_epi16(c0, c1, c2, 0, c0, c1, c2, 0);
+    };
+    const auto y_coeffs  = coeffs(q15.y);
+    const auto cb_coeffs = coeffs(q15.cb);
+    const auto cr_coeffs = coeffs(q15.cr);
+    const auto y_round   = _mm_set1_epi32((16 << 15) + (1 << 14));
+    const auto c_round   = _mm_set1_epi32((128 << 16) + (1 << 15));
+    const auto alpha     = _mm_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const auto zero      = _mm_setzero_si128();
+
+    auto x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const auto p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        const auto p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4 + 16));
+
+        // Two pixels of 16 bit channels each
+        const __m128i q[4] = {_mm_unpacklo_epi8(p0, zero),
+                              _mm_unpackhi_epi8(p0, zero),
+                              _mm_unpacklo_epi8(p1, zero),
+                              _mm_unpackhi_epi8(p1, zero)};
+
+        // The dot products of pixels 0-3 and 4-7
+        auto dot = [&](__m128i c, int n) {
+            return _mm_hadd_epi32(_mm_madd_epi16(q[n * 2], c), _mm_madd_epi16(q[n * 2 + 1], c));
+        };
+
+        const auto luma = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(dot(y_coeffs, 0), y_round), 15),
+                                          _mm_srai_epi32(_mm_add_epi32(dot(y_coeffs, 1), y_round), 15));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y + x), _mm_packus_epi16(luma, luma));
+
+        auto chroma = [&](__m128i c, uint8_t* dst) {
+            const auto pairs = _mm_hadd_epi32(dot(c, 0), dot(c, 1));
+            const auto value = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(pairs, c_round), 16), zero);
+            const auto bytes = _mm_cvtsi128_si32(_mm_packus_epi16(value, value));
+            std::memcpy(dst + x / 2, &bytes, sizeof(bytes));
+        };
+        chroma(cb_coeffs, cb);
+        chroma(cr_coeffs, cr);
+
+        if (a) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(a + x),
+                             _mm_unpacklo_epi32(_mm_shuffle_epi8(p0, alpha), _mm_shuffle_epi8(p1, alpha)));
+        }
+    }
+
+    row8_scalar(src, x, width, y, cb, cr, a);
+}
+
+// Any BGRA to 8 or 10 bit output, through 12 bit samples in Q14
+template <typename S, typename T>
+void row(const S* src, int width, int bits, T* y, T* cb, T* cr, T* a)
+{
+    static const coefficients q14_8(4095, 8, 14);
+    static const coefficients q14_10(4095, 10, 14);
+
+    const auto& c        = bits == 8 ? q14_8 : q14_10;
+    const auto  y_offset = ((16 << (bits - 8)) << 14) + (1 << 13);
+    const auto  c_offset = ((128 << (bits - 8)) << 15) + (1 << 14);
+
+    auto sample = [&](int n) -> int32_t { return sizeof(S) == 1 ? (src[n] << 4) | (src[n] >> 4) : src[n] >> 4; };
+    auto dot    = [&](const int32_t* k, int x) {
+        return k[0] * sample(x * 4) + k[1] * sample(x * 4 + 1) + k[2] * sample(x * 4 + 2);
+    };
+
+    for (auto x = 0; x < width; ++x) {
+        y[x] = static_cast<T>((dot(c.y, x) + y_offset) >> 14);
+        if (a) {
+            a[x] = static_cast<T>(sample(x * 4 + 3) >> (12 - bits));
+        }
+    }
+    for (auto x = 0; x < width; x += 2) {
+        const auto x2 = x + 1 < width ? x + 1 : x;
+
+        cb[x / 2] = static_cast<T>((dot(c.cb, x) + dot(c.cb, x2) + c_offset) >> 15);
+        cr[x / 2] = static_cast<T>((dot(c.cr, x) + dot(c.cr, x2) + c_offset) >> 15);
+    }
+}
+
+} // namespace
+
+void bgra_to_yuv(const uint8_t*    src,
+                 int               src_stride,
+                 common::bit_depth src_depth,
+                 int               width,
+                 int               height,
+                 yuv_format        format,
+                 uint8_t* const*   dst,
+                 const int*        dst_stride)
+{
+    const auto src16        = src_depth != common::bit_depth::bit8;
+    const auto chroma_width = (width + 1) / 2;
+
+    auto line  = [&](int n) { return src + static_cast<std::ptrdiff_t>(n) * src_stride; };
+    auto plane = [&](int p, int n) { return dst[p] + static_cast<std::ptrdiff_t>(n) * dst_stride[p]; };
+
+    // A row of source as 8 bit Y', Cb, Cr and, unless a is null, alpha, with chroma halved horizontally
+    auto row_8 = [&](int n, uint8_t* y, uint8_t* cb, uint8_t* cr, uint8_t* a) {
+        if (src16) {
+            row(reinterpret_cast<const uint16_t*>(line(n)), width, 8, y, cb, cr, a);
+        } else {
+            row8(line(n), width, y, cb, cr, a);
+        }
+    };
+
+    auto row_10 = [&](int n, uint16_t* y, uint16_t* cb, uint16_t* cr, uint16_t* a) {
+        if (src16) {
+            row(reinterpret_cast<const uint16_t*>(line(n)), width, 10, y, cb, cr, a);
+        } else {
+            row(line(n), width, 10, y, cb, cr, a);
+        }
+    };
+
+    switch (format) {
+        case yuv_format::yuv422p:
+        case yuv_format::yuva422p: {
+            const auto alpha = format == yuv_format::yuva422p;
+            tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& r) {
+                for (auto n = r.begin(); n != r.end(); ++n) {
+                    row_8(n, plane(0, n), plane(1, n), plane(2, n), alpha ? plane(3, n) : nullptr);
+                }
+            });
+            break;
+        }
+        case yuv_format::yuv422p10:
+        case yuv_format::yuva422p10: {
+            const auto alpha = format == yuv_format::yuva422p10;
+            auto       p     = [&](int p, int n) { return reinterpret_cast<uint16_t*>(plane(p, n)); };
+            tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& r) {
+                for (auto n = r.begin(); n != r.end(); ++n) {
+                    row_10(n, p(0, n), p(1, n), p(2, n), alpha ? p(3, n) : nullptr);
+                }
+            });
+            break;
+        }
+        case yuv_format::yuv420p:
+        case yuv_format::nv12: {
+            // Chroma is also halved vertically, averaging that of row pairs
+            tbb::parallel_for(tbb::blocked_range<int>(0, (height + 1) / 2), [&](const tbb::blocked_range<int>& r) {
+                std::vector<uint8_t> chroma(chroma_width * 4);
+                const auto           cb0 = chroma.data();
+                const auto           cr0 = cb0 + chroma_width;
+                const auto           cb1 = cr0 + chroma_width;
+                const auto           cr1 = cb1 + chroma_width;
+
+                for (auto n = r.begin(); n != r.end(); ++n) {
+                    row_8(n * 2, plane(0, n * 2), cb0, cr0, nullptr);
+                    if (n * 2 + 1 < height) {
+                        row_8(n * 2 + 1, plane(0, n * 2 + 1), cb1, cr1, nullptr);
+                    } else {
+                        std::memcpy(cb1, cb0, chroma_width * 2);
+                    }
+
+                    if (format == yuv_format::yuv420p) {
+                        const auto cb = plane(1, n);
+                        const auto cr = plane(2, n);
+                        for (auto x = 0; x < chroma_width; ++x) {
+                            cb[x] = static_cast<uint8_t>((cb0[x] + cb1[x] + 1) >> 1);
+                            cr[x] = static_cast<uint8_t>((cr0[x] + cr1[x] + 1) >> 1);
+                        }
+                    } else {
+                        const auto cbcr = plane(1, n);
+                        for (auto x = 0; x < chroma_width; ++x) {
+                            cbcr[x * 2]     = static_cast<uint8_t>((cb0[x] + cb1[x] + 1) >> 1);
+                            cbcr[x * 2 + 1] = static_cast<uint8_t>((cr0[x] + cr1[x] + 1) >> 1);
+                        }
+                    }
+                }
+            });
+            break;
+        }
+        case yuv_format::uyvy422: {
+            tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& r) {
+                std::vector<uint8_t> buffer(width + chroma_width * 2);
+                const auto           y  = buffer.data();
+                const auto           cb = y + width;
+                const auto           cr = cb + chroma_width;
+
+                for (auto n = r.begin(); n != r.end(); ++n) {
+                    row_8(n, y, cb, cr, nullptr);
+
+                    const auto uyvy = plane(0, n);
+                    for (auto x = 0; x < chroma_width; ++x) {
+                        uyvy[x * 4]     = cb[x];
+                        uyvy[x * 4 + 1] = y[x * 2];
+                        uyvy[x * 4 + 2] = cr[x];
+                        uyvy[x * 4 + 3] = x * 2 + 1 < width ? y[x * 2 + 1] : y[x * 2];
+                    }
+                }
+            });
+            break;
+        }
+    }
+}
+
+} // namespace caspar
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "bit_depth.h"
+
+#include <cstdint>
+
+namespace caspar {
+
+// The Y'CbCr layouts that channel output converts to, named and laid out as in ffmpeg. The 10 bit ones are little
+// endian.
+enum class yuv_format
+{
+    yuv420p,
+    yuv422p,
+    yuva422p,
+    yuv422p10,
+    yuva422p10,
+    nv12,
+    uyvy422,
+};
+
+// Converts full range BGRA, 8 or 16 bits a channel as the channel puts it out, to limited range BT.709 Y'CbCr, with
+// the rows converted in parallel. dst and dst_stride hold the planes of format in the order ffmpeg has them.
+void bgra_to_yuv(const uint8_t*    src,
+                 int               src_stride,
+                 common::bit_depth src_depth,
+                 int               width,
+                 int               height,
+                 yuv_format        format,
+                 uint8_t* const*   dst,
+                 const int*        dst_stride);
+
+} // namespace caspar
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "channel_clock.h"
+
+#include <thread>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Below this the remaining time is spent yielding rather than sleeping
+const auto spin_threshold = std::chrono::milliseconds(2);
+
+void wait_until(channel_clock::clock_t::time_point deadline)
+{
+    auto now = channel_clock::clock_t::now();
+    while (deadline - now > spin_threshold) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        now = channel_clock::clock_t::now();
+    }
+    while (now < deadline) {
+        std::this_thread::yield();
+        now = channel_clock::clock_t::now();
+    }
+}
+
+} // namespace
+
+std::chrono::nanoseconds channel_clock::offset(int64_t frames) const
+{
+    // frames * 1e9 * den / num, split so the intermediate product cannot overflow on long running channels
+    const int64_t num   = framerate_.numerator();
+    const int64_t den   = framerate_.denominator();
+    const int64_t whole = frames / num;
+    const int64_t rem   = frames % num;
+    return std::chrono::nanoseconds(whole * den * 1000000000LL + rem * den * 1000000000LL / num);
+}
+
+void channel_clock::tick(const boost::rational<int>& framerate)
+{
+    const auto now = clock_t::now();
+
+    if (!start_ || framerate != framerate_ || framerate.numerator() <= 0) {
+        start_     = now;
+        framerate_ = framerate;
+        frames_    = 0;
+        jitter_    = std::chrono::nanoseconds(0);
+        return;
+    }
+
+    const auto deadline = *start_ + offset(++frames_);
+
+    // More than a frame behind, e.g. after a stall. Restart from now instead of bursting frames to catch up.
+    if (now - deadline > offset(1)) {
+        jitter_ = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline);
+        start_  = now;
+        frames_ = 0;
+        return;
+    }
+
+    wait_until(deadline);
+
+    jitter_ = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - deadline);
+}
+
+void channel_clock::reset() { start_.reset(); }
+
+}} // namespace caspar::core
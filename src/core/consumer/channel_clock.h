@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/rational.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace caspar { namespace core {
+
+// Paces a channel that has no consumer with a synchronization clock.
+//
+// Frame deadlines are computed from the number of frames since the clock was started and the exact rational
+// framerate, so fractional rates such as 59.94 do not accumulate drift. The wait sleeps while the deadline is far away
+// and yields for the last couple of milliseconds to avoid OS sleep granularity.
+class channel_clock final
+{
+  public:
+    using clock_t = std::chrono::steady_clock;
+
+    // Blocks until the next frame deadline. The first tick, and the first tick after a change of framerate, starts the
+    // clock and returns immediately.
+    void tick(const boost::rational<int>& framerate);
+
+    // Restarts the clock on the next tick.
+    void reset();
+
+    // How late the last tick returned relative to its deadline.
+    std::chrono::nanoseconds jitter() const { return jitter_; }
+
+  private:
+    std::chrono::nanoseconds offset(int64_t frames) const;
+
+    std::optional<clock_t::time_point> start_;
+    boost::rational<int>               framerate_;
+    int64_t                            frames_ = 0;
+    std::chrono::nanoseconds           jitter_{0};
+};
+
+}} // namespace caspar::core
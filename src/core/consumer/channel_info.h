@@ -28,15 +28,26 @@ namespace caspar::core {
 
 struct channel_info
 {
-    channel_info(int channel_index, common::bit_depth depth, color_space color_space)
+    channel_info(int               channel_index,
+                 common::bit_depth depth,
+                 color_space       color_space,
+                 bool              offline  = false,
+                 color_transfer    transfer = color_transfer::bt709)
     : index(channel_index)
     , depth(depth)
     , default_color_space(color_space)
+    , transfer(transfer)
+    , offline(offline)
     {}
 
     int               index;
     common::bit_depth depth;
     color_space       default_color_space;
+    color_transfer    transfer; // That the image is encoded with
+
+    // The channel ticks as fast as it can rather than at the frame rate, so consumers should take every frame even if
+    // that holds it up
+    bool offline;
 };
 
 } // namespace caspar::core
@@ -27,6 +27,7 @@
 #include <common/bit_depth.h>
 #include <common/memory.h>
 
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
 #include <boost/property_tree/ptree_fwd.hpp>
@@ -57,6 +58,25 @@ class frame_consumer
     virtual std::wstring print() const = 0;
     virtual std::wstring name() const  = 0;
     virtual bool         has_synchronization_clock() const { return false; }
+
+    // Packings of the mixed image this consumer reads through const_frame::packed_data instead of image_data. They
+    // are rendered on the GPU once per channel, and the unpacked image is only read back if another consumer needs it.
+    // Frames mixed before the consumer was added may still only carry the unpacked image.
+    virtual std::vector<output_packing> packings() const { return {}; }
+
+    // Sizes of the mixed image this consumer reads through const_frame::scaled_data, for outputs of a video format
+    // smaller or larger than the channel's. Each size is scaled on the GPU once per channel. The size of the channel
+    // itself stands for image_data, which is otherwise not read back for this consumer.
+    virtual std::vector<output_size> sizes() const { return {}; }
+
+    // Whether this consumer draws the mixed image from the texture the mixer keeps on the GPU, see
+    // image_mixer::rendered, instead of reading image_data. The image is then only read back if this or another
+    // consumer calls image_data, and frames mixed before the consumer was added may carry neither.
+    virtual bool draws_texture() const { return false; }
+
+    // Whether, on an interlaced channel, this consumer only shows the upper lines of the frames sent for field a and
+    // the lower lines of those sent for field b. When every consumer does, both fields are mixed into one image.
+    virtual bool shows_fields() const { return false; }
     virtual int          index() const = 0;
 };
 
@@ -99,6 +99,11 @@ class destroy_consumer_proxy : public frame_consumer
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                  index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+
+    std::vector<output_packing> packings() const override { return consumer_->packings(); }
+    std::vector<output_size>    sizes() const override { return consumer_->sizes(); }
+    bool                        draws_texture() const override { return consumer_->draws_texture(); }
+    bool                        shows_fields() const override { return consumer_->shows_fields(); }
 };
 
 class print_consumer_proxy : public frame_consumer
@@ -133,6 +138,11 @@ class print_consumer_proxy : public frame_consumer
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                  index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+
+    std::vector<output_packing> packings() const override { return consumer_->packings(); }
+    std::vector<output_size>    sizes() const override { return consumer_->sizes(); }
+    bool                        draws_texture() const override { return consumer_->draws_texture(); }
+    bool                        shows_fields() const override { return consumer_->shows_fields(); }
 };
 
 frame_consumer_registry::frame_consumer_registry() {}
@@ -20,105 +20,229 @@
  */
 #include "output.h"
 
+#include "channel_clock.h"
 #include "frame_consumer.h"
 #include "channel_info.h"
 
+#include "../diagnostics/cpu_cost.h"
 #include "../frame/frame.h"
 #include "../frame/pixel_format.h"
 
 #include <common/bit_depth.h>
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/except.h>
 #include <common/memory.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
 #include <chrono>
+#include <deque>
+#include <future>
+#include <iterator>
 #include <map>
-#include <optional>
-#include <thread>
+#include <mutex>
+#include <cmath>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace core {
 
-using time_point_t = decltype(std::chrono::high_resolution_clock::now());
+namespace {
+
+// The frames of the last ticks are held for the delayed consumers, which is as long as the longest delay
+const double max_delay_seconds = 2.0;
+
+} // namespace
+
+consumer_delay::amount parse_consumer_delay(const std::wstring& value)
+{
+    consumer_delay::amount amount;
+    try {
+        if (boost::iends_with(value, L"ms")) {
+            amount.milliseconds = boost::lexical_cast<double>(value.substr(0, value.size() - 2));
+        } else {
+            amount.frames = boost::lexical_cast<int>(value);
+        }
+    } catch (const boost::bad_lexical_cast&) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid delay " + value + L", expected frames or ms"));
+    }
+    if (amount.frames < 0 || amount.milliseconds < 0.0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid delay " + value + L", it can't be negative"));
+    }
+    return amount;
+}
 
 struct output::impl
 {
-    monitor::state                      state_;
-    spl::shared_ptr<diagnostics::graph> graph_;
-    const channel_info                  channel_info_;
-    video_format_desc                   format_desc_;
+    monitor::state                              state_;
+    spl::shared_ptr<caspar::diagnostics::graph> graph_;
+    const channel_info                          channel_info_;
+    video_format_desc                           format_desc_;
+
+    using consumers_t = std::map<int, spl::shared_ptr<frame_consumer>>;
+
+    using delays_t    = std::map<int, consumer_delay>;
+
+    // Readers take a snapshot with std::atomic_load, writers copy, modify and publish a new map under the mutex
+    std::mutex                         consumers_mutex_;
+    std::shared_ptr<const consumers_t> consumers_ = std::make_shared<consumers_t>();
+    std::shared_ptr<const delays_t>    delays_    = std::make_shared<delays_t>();
+
+    // The frames of the last ticks, the current one first, for the consumers that are delayed. They are the frames the
+    // mixer produced, so a delay costs neither mixing nor copies. Only touched from the channel thread.
+    std::deque<std::pair<const_frame, const_frame>> history_;
+
+    const consumer_deadline_policy deadline_policy_;
+    const double                   deadline_budget_;
+
+    // Sends that missed their deadline, keyed by port. Only touched from the channel thread.
+    std::map<int, std::vector<std::future<bool>>> pending_;
+    std::map<int, int64_t>                        late_frames_;
+
+    // Consumers being reinitialised for a new format in the background. They rejoin at the first frame boundary after
+    // their initialize has returned. Only touched from the channel thread.
+    std::map<int, std::pair<std::shared_ptr<frame_consumer>, std::future<bool>>> initializing_;
 
-    std::mutex                                     consumers_mutex_;
-    std::map<int, spl::shared_ptr<frame_consumer>> consumers_;
+    channel_clock clock_;
 
-    std::optional<time_point_t> time_;
+    std::vector<consumer_timing> timings_;
 
   public:
-    impl(const spl::shared_ptr<diagnostics::graph>& graph, const video_format_desc& format_desc, const core::channel_info& channel_info)
+    impl(const spl::shared_ptr<caspar::diagnostics::graph>& graph,
+         const video_format_desc&                           format_desc,
+         const core::channel_info&                          channel_info,
+         consumer_deadline_policy                           deadline_policy,
+         double                                             deadline_budget)
         : graph_(graph)
         , channel_info_(channel_info)
         , format_desc_(format_desc)
+        , deadline_policy_(channel_info.offline ? consumer_deadline_policy::wait : deadline_policy)
+        , deadline_budget_(deadline_budget > 0.0 ? deadline_budget : 1.0)
     {
+        graph_->set_color("late-consumer", caspar::diagnostics::color(0.9f, 0.3f, 0.9f));
+        graph_->set_color("clock-jitter", caspar::diagnostics::color(0.3f, 0.9f, 0.9f));
     }
 
-    void add(int index, spl::shared_ptr<frame_consumer> consumer)
+    std::shared_ptr<const consumers_t> snapshot() const { return std::atomic_load(&consumers_); }
+
+    template <typename Func>
+    void modify(Func&& func)
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        auto                        consumers = std::make_shared<consumers_t>(*consumers_);
+        func(*consumers);
+        std::atomic_store(&consumers_, std::shared_ptr<const consumers_t>(std::move(consumers)));
+    }
+
+    // Set before the consumer is added and cleared after it is removed, so that it is never sent an undelayed frame
+    void set_delay(int index, const consumer_delay& delay)
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        auto                        delays = std::make_shared<delays_t>(*delays_);
+        if (delay.empty()) {
+            delays->erase(index);
+        } else {
+            (*delays)[index] = delay;
+        }
+        std::atomic_store(&delays_, std::shared_ptr<const delays_t>(std::move(delays)));
+    }
+
+    void add(int index, spl::shared_ptr<frame_consumer> consumer, const consumer_delay& delay)
     {
         remove(index);
 
         consumer->initialize(format_desc_, channel_info_, index);
 
-        std::lock_guard<std::mutex> lock(consumers_mutex_);
-        consumers_.emplace(index, std::move(consumer));
+        set_delay(index, delay);
+        modify([&](consumers_t& consumers) { consumers.emplace(index, std::move(consumer)); });
     }
 
-    void add(const spl::shared_ptr<frame_consumer>& consumer) { add(consumer->index(), consumer); }
+    void add(const spl::shared_ptr<frame_consumer>& consumer, const consumer_delay& delay)
+    {
+        add(consumer->index(), consumer, delay);
+    }
 
     bool remove(int index)
     {
-        std::lock_guard<std::mutex> lock(consumers_mutex_);
-        auto                        count = consumers_.erase(index);
+        size_t count = 0;
+        modify([&](consumers_t& consumers) { count = consumers.erase(index); });
+        set_delay(index, {});
         return count > 0;
     }
 
+    int frames(const consumer_delay::amount& amount) const
+    {
+        auto frames = amount.frames + static_cast<int>(std::lround(amount.milliseconds * format_desc_.hz / 1000.0));
+        return std::min(frames, static_cast<int>(max_delay_seconds * format_desc_.hz));
+    }
+
     bool remove(const spl::shared_ptr<frame_consumer>& consumer) { return remove(consumer->index()); }
 
-    size_t consumer_count()
+    size_t consumer_count() const { return snapshot()->size(); }
+
+    output_request request() const
     {
-        std::lock_guard<std::mutex> lock(consumers_mutex_);
-        return consumers_.size();
+        output_request request;
+        request.image       = false;
+        request.color_space = channel_info_.default_color_space;
+
+        auto consumers = snapshot();
+        request.fields = !consumers->empty();
+        for (auto& p : *consumers) {
+            request.fields  = request.fields && p.second->shows_fields();
+            request.clocked = request.clocked || p.second->has_synchronization_clock();
+            if (p.second->draws_texture()) {
+                request.texture = true;
+                continue;
+            }
+            auto packings = p.second->packings();
+            auto sizes    = p.second->sizes();
+            if (packings.empty() && sizes.empty()) {
+                request.image = true;
+                continue;
+            }
+            for (auto packing : packings) {
+                if (std::find(request.packings.begin(), request.packings.end(), packing) == request.packings.end())
+                    request.packings.push_back(packing);
+            }
+            for (auto size : sizes) {
+                if (size == output_size{format_desc_.width, format_desc_.height})
+                    request.image = true;
+                else if (std::find(request.sizes.begin(), request.sizes.end(), size) == request.sizes.end())
+                    request.sizes.push_back(size);
+            }
+        }
+
+        if (request.packings.empty() && request.sizes.empty() && !request.texture)
+            request.image = true;
+
+        return request;
     }
 
     void operator()(const const_frame&             input_frame1,
                     const const_frame&             input_frame2,
                     const core::video_format_desc& format_desc)
     {
-        auto time = std::move(time_);
+        auto frame_start = std::chrono::high_resolution_clock::now();
 
         if (format_desc_ != format_desc) {
-            std::lock_guard<std::mutex> lock(consumers_mutex_);
-            for (auto it = consumers_.begin(); it != consumers_.end();) {
-                try {
-                    it->second->initialize(format_desc, channel_info_, it->first);
-                    ++it;
-                } catch (...) {
-                    CASPAR_LOG_CURRENT_EXCEPTION();
-                    it = consumers_.erase(it);
-                }
+            for (auto& p : *snapshot()) {
+                reinitialize(p.first, p.second, format_desc);
             }
             format_desc_ = format_desc;
-            time_        = {};
+            clock_.reset();
+            history_.clear();
             return;
         }
 
         // If no frame is provided, this should only happen when the channel has no consumers.
         // Take a shortcut and perform the sleep to let the channel tick correctly.
         if (!input_frame1) {
-            if (!time) {
-                time = std::chrono::high_resolution_clock::now();
-            } else {
-                std::this_thread::sleep_until(*time);
-            }
-            time_ = *time + std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.hz));
+            if (!channel_info_.offline)
+                tick_clock();
             return;
         }
 
@@ -139,94 +263,338 @@ struct output::impl
             }
         }
 
-        decltype(consumers_) consumers;
-        {
-            std::lock_guard<std::mutex> lock(consumers_mutex_);
-            consumers = consumers_;
+        auto consumers = snapshot();
+        auto delays    = std::atomic_load(&delays_);
+
+        size_t depth = 0;
+        for (auto& p : *delays) {
+            depth = std::max<size_t>(depth, std::max(frames(p.second.video), frames(p.second.audio)));
         }
+        if (depth > 0) {
+            history_.emplace_front(input_frame1, input_frame2);
+            history_.resize(std::min(history_.size(), depth + 1));
+        } else {
+            history_.clear();
+        }
+
+        // The frame of a consumer, from as far back as its delays, which until there are enough frames is the oldest
+        auto delayed = [&](int index, bool second) -> const_frame {
+            auto delay = delays->find(index);
+            if (delay == delays->end() || history_.empty()) {
+                return second ? input_frame2 : input_frame1;
+            }
+
+            auto  last  = static_cast<int>(history_.size()) - 1;
+            auto& video = history_.at(std::min(frames(delay->second.video), last));
+            auto& audio = history_.at(std::min(frames(delay->second.audio), last));
+
+            auto& frame = second ? video.second : video.first;
+            if (&video == &audio) {
+                return frame;
+            }
+            auto& sound = second ? audio.second : audio.first;
+            return frame.with_audio(sound.audio_data(), sound.audio_channels());
+        };
+
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            it = consumers->count(it->first) > 0 ? std::next(it) : pending_.erase(it);
+        }
+
+        std::vector<int> failed;
+        auto             fail = [&](int index) {
+            failed.push_back(index);
+            pending_.erase(index);
+        };
+
+        for (auto it = initializing_.begin(); it != initializing_.end();) {
+            auto& future = it->second.second;
 
-        auto do_send = [this, &consumers](core::video_field field, const core::const_frame& frame) {
-            std::map<int, std::future<bool>> futures;
+            // Offline, the consumers must not miss the first frames of the new format
+            if (channel_info_.offline)
+                future.wait();
+
+            if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++it;
+                continue;
+            }
+
+            // The consumer may have been replaced while it was initializing, in which case the result is stale
+            auto current = consumers->find(it->first);
+            if (!future.get() && current != consumers->end() && current->second.get() == it->second.first.get())
+                fail(it->first);
+            it = initializing_.erase(it);
+        }
 
-            for (auto it = consumers.begin(); it != consumers.end();) {
+        auto is_initializing = [&](int index) {
+            auto it = initializing_.find(index);
+            return it != initializing_.end() && consumers->at(index).get() == it->second.first.get();
+        };
+
+        // Returns whether the consumer has finished all earlier sends. Under the drop policy a consumer that is still
+        // busy skips this frame instead of holding up the channel.
+        auto is_ready = [&](int index) {
+            auto it = pending_.find(index);
+            if (it == pending_.end())
+                return true;
+
+            for (auto& future : it->second) {
+                if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    return false;
+            }
+
+            for (auto& future : it->second) {
                 try {
-                    futures.emplace(it->first, it->second->send(field, frame));
-                    ++it;
+                    if (!future.get()) {
+                        fail(index);
+                        return false;
+                    }
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
-                    auto index = it->first;
-                    it         = consumers.erase(it);
-
-                    std::lock_guard<std::mutex> lock(consumers_mutex_);
-                    consumers_.erase(index);
+                    fail(index);
+                    return false;
                 }
             }
 
-            for (auto& p : futures) {
-                try {
-                    if (!p.second.get()) {
-                        consumers.erase(p.first);
+            pending_.erase(index);
+            return true;
+        };
 
-                        std::lock_guard<std::mutex> lock(consumers_mutex_);
-                        consumers_.erase(p.first);
-                    }
+        // Frames mixed before a consumer was added may not carry what it reads, in which case it skips them. The image
+        // is checked last, as asking for it reads it back when the frame was only mixed to a texture.
+        auto can_read = [&](const frame_consumer& consumer, const core::const_frame& frame) {
+            if (consumer.draws_texture() && frame.opaque().has_value())
+                return true;
+
+            auto packings = consumer.packings();
+            auto sizes    = consumer.sizes();
+            return std::any_of(packings.begin(),
+                               packings.end(),
+                               [&](output_packing packing) { return frame.packed_data(packing).size() > 0; }) ||
+                   std::any_of(sizes.begin(),
+                               sizes.end(),
+                               [&](const output_size& size) { return frame.scaled_data(size).size() > 0; }) ||
+                   frame.image_data(0).size() > 0;
+        };
+
+        std::map<int, std::vector<std::future<bool>>> futures;
+
+        auto do_send = [&](core::video_field field, bool second) {
+            for (auto& p : *consumers) {
+                if (std::find(failed.begin(), failed.end(), p.first) != failed.end())
+                    continue;
+
+                if (pending_.count(p.first) > 0 || is_initializing(p.first))
+                    continue;
+
+                auto frame = delayed(p.first, second);
+                if (!can_read(*p.second, frame))
+                    continue;
+
+                try {
+                    diagnostics::scoped_call_context save;
+                    diagnostics::call_context::for_thread().video_channel = channel_info_.index;
+                    diagnostics::call_context::for_thread().layer         = -1;
+                    diagnostics::call_context::for_thread().port          = p.first;
+                    diagnostics::scoped_cpu_cost cost;
+
+                    caspar::diagnostics::trace::scoped_event event("consumer-send");
+                    futures[p.first].push_back(p.second->send(field, frame));
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
-                    consumers.erase(p.first);
-
-                    std::lock_guard<std::mutex> lock(consumers_mutex_);
-                    consumers_.erase(p.first);
+                    futures.erase(p.first);
+                    fail(p.first);
                 }
             }
         };
 
+        for (auto& p : *consumers) {
+            if (!is_ready(p.first) && std::find(failed.begin(), failed.end(), p.first) == failed.end()) {
+                late_frames_[p.first] += 1;
+                graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "late-consumer");
+            }
+        }
+
+        // Seconds since the frame was sent, by port
+        const auto            send_start = std::chrono::high_resolution_clock::now();
+        std::map<int, double> send_times;
+
+        auto send_time = [&] {
+            return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - send_start).count();
+        };
+
         if (format_desc_.field_count == 2) {
-            do_send(core::video_field::a, input_frame1);
-            do_send(core::video_field::b, input_frame2);
+            do_send(core::video_field::a, false);
+            do_send(core::video_field::b, true);
         } else {
-            do_send(core::video_field::progressive, input_frame1);
+            do_send(core::video_field::progressive, false);
+        }
+
+        const auto deadline = frame_start + std::chrono::microseconds(
+                                                static_cast<int64_t>(deadline_budget_ * 1e6 / format_desc_.hz));
+
+        for (auto& p : futures) {
+            auto& index = p.first;
+
+            if (deadline_policy_ == consumer_deadline_policy::drop) {
+                auto late = std::any_of(p.second.begin(), p.second.end(), [&](std::future<bool>& future) {
+                    return future.wait_until(deadline) != std::future_status::ready;
+                });
+                if (late) {
+                    // Collect the result on a later tick, and skip frames for this consumer until then
+                    graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "late-consumer");
+                    pending_[index]   = std::move(p.second);
+                    send_times[index] = send_time();
+                    continue;
+                }
+            }
+
+            for (auto& future : p.second) {
+                try {
+                    if (!future.get()) {
+                        fail(index);
+                        break;
+                    }
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    fail(index);
+                    break;
+                }
+            }
+            send_times[index] = send_time();
+        }
+
+        timings_.clear();
+        for (auto& p : *consumers) {
+            auto sent    = send_times.find(p.first);
+            auto pending = pending_.find(p.first);
+
+            consumer_timing timing;
+            timing.port      = p.first;
+            timing.send_time = sent != send_times.end() ? sent->second : 0.0;
+            timing.pending   = pending != pending_.end() ? static_cast<int>(pending->second.size()) : 0;
+            timing.late      = timing.pending > 0;
+            timing.failed    = std::find(failed.begin(), failed.end(), p.first) != failed.end();
+            timings_.push_back(timing);
+        }
+
+        if (!failed.empty()) {
+            modify([&](consumers_t& consumers) {
+                for (auto index : failed) {
+                    consumers.erase(index);
+                    late_frames_.erase(index);
+                }
+            });
         }
 
         monitor::state state;
-        for (auto& p : consumers) {
+        for (auto& p : *consumers) {
+            if (std::find(failed.begin(), failed.end(), p.first) != failed.end())
+                continue;
+
+            if (is_initializing(p.first)) {
+                state["port"][p.first]["consumer"]     = p.second->name();
+                state["port"][p.first]["initializing"] = true;
+                continue;
+            }
+
             state["port"][p.first]             = p.second->state();
             state["port"][p.first]["consumer"] = p.second->name();
+
+            auto delay = delays->find(p.first);
+            if (delay != delays->end()) {
+                state["port"][p.first]["delay"]["video"] = frames(delay->second.video);
+                state["port"][p.first]["delay"]["audio"] = frames(delay->second.audio);
+            }
+
+            auto late = late_frames_.find(p.first);
+            if (late != late_frames_.end())
+                state["port"][p.first]["late_frames"] = late->second;
         }
         state_ = std::move(state);
 
-        const auto needs_sync = std::all_of(
-            consumers.begin(), consumers.end(), [](auto& p) { return !p.second->has_synchronization_clock(); });
+        // Consumers that are still initializing are not being fed, so they cannot pace the channel
+        const auto needs_sync = std::all_of(consumers->begin(), consumers->end(), [&](auto& p) {
+            return !p.second->has_synchronization_clock() || is_initializing(p.first);
+        });
 
-        if (needs_sync) {
-            if (!time) {
-                time = std::chrono::high_resolution_clock::now();
-            } else {
-                std::this_thread::sleep_until(*time);
-            }
-            time_ = *time + std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.hz));
+        if (needs_sync && !channel_info_.offline) {
+            tick_clock();
         } else {
-            time_.reset();
+            clock_.reset();
         }
     }
 
+    void reinitialize(int index, const spl::shared_ptr<frame_consumer>& consumer, const video_format_desc& format_desc)
+    {
+        // Sends still in flight, and any previous reinitialisation, must finish before initialize is called again
+        auto previous = std::make_shared<std::vector<std::future<bool>>>();
+
+        auto pending = pending_.find(index);
+        if (pending != pending_.end()) {
+            std::move(pending->second.begin(), pending->second.end(), std::back_inserter(*previous));
+            pending_.erase(pending);
+        }
+
+        auto initializing = initializing_.find(index);
+        if (initializing != initializing_.end()) {
+            previous->push_back(std::move(initializing->second.second));
+            initializing_.erase(initializing);
+        }
+
+        auto channel_info = channel_info_;
+        auto future       = std::async(std::launch::async, [=]() {
+            for (auto& f : *previous) {
+                f.wait();
+            }
+
+            try {
+                consumer->initialize(format_desc, channel_info, index);
+                return true;
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                return false;
+            }
+        });
+
+        initializing_[index] = std::make_pair(std::shared_ptr<frame_consumer>(consumer), std::move(future));
+    }
+
+    void tick_clock()
+    {
+        clock_.tick(format_desc_.framerate);
+
+        auto jitter = std::chrono::duration<double>(clock_.jitter()).count() * format_desc_.hz;
+        graph_->set_value("clock-jitter", std::min(1.0, std::abs(jitter)));
+    }
+
     std::wstring print() const { return L"output[" + std::to_wstring(channel_info_.index) + L"]"; }
 };
 
-output::output(const spl::shared_ptr<diagnostics::graph>& graph,
-               const video_format_desc&                   format_desc,
-               const core::channel_info&                  channel_info)
-    : impl_(new impl(graph, format_desc, channel_info))
+output::output(const spl::shared_ptr<caspar::diagnostics::graph>& graph,
+               const video_format_desc&                           format_desc,
+               const core::channel_info&                          channel_info,
+               consumer_deadline_policy                           deadline_policy,
+               double                                             deadline_budget)
+    : impl_(new impl(graph, format_desc, channel_info, deadline_policy, deadline_budget))
 {
 }
 output::~output() {}
-void   output::add(int index, const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(index, consumer); }
-void   output::add(const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(consumer); }
-bool   output::remove(int index) { return impl_->remove(index); }
-bool   output::remove(const spl::shared_ptr<frame_consumer>& consumer) { return impl_->remove(consumer); }
-size_t output::consumer_count() const { return impl_->consumer_count(); }
-void   output::operator()(const const_frame& frame, const const_frame& frame2, const video_format_desc& format_desc)
+void output::add(int index, const spl::shared_ptr<frame_consumer>& consumer, const consumer_delay& delay)
+{
+    impl_->add(index, consumer, delay);
+}
+void output::add(const spl::shared_ptr<frame_consumer>& consumer, const consumer_delay& delay)
+{
+    impl_->add(consumer, delay);
+}
+bool           output::remove(int index) { return impl_->remove(index); }
+bool           output::remove(const spl::shared_ptr<frame_consumer>& consumer) { return impl_->remove(consumer); }
+size_t         output::consumer_count() const { return impl_->consumer_count(); }
+output_request output::request() const { return impl_->request(); }
+void           output::operator()(const const_frame& frame, const const_frame& frame2, const video_format_desc& format_desc)
 {
     return (*impl_)(frame, frame2, format_desc);
 }
-core::monitor::state output::state() const { return impl_->state_; }
+core::monitor::state         output::state() const { return impl_->state_; }
+std::vector<consumer_timing> output::timings() const { return impl_->timings_; }
 }} // namespace caspar::core
@@ -28,6 +28,8 @@
 #include <core/video_format.h>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace caspar::diagnostics {
 class graph;
@@ -35,12 +37,54 @@ class graph;
 
 namespace caspar { namespace core {
 
+enum class consumer_deadline_policy
+{
+    // Block the channel until every consumer has accepted the frame
+    wait,
+    // A consumer that has not accepted the frame within its budget is marked late, and is skipped until it has
+    // caught up instead of stalling the channel
+    drop,
+};
+
+// How a consumer took the last frame
+struct consumer_timing
+{
+    int    port      = 0;
+    double send_time = 0.0;   // Seconds from the frame being sent until the consumer accepted it, or gave up waiting
+    int    pending   = 0;     // Sends still in flight after the frame, which is how far behind the consumer is
+    bool   late      = false; // Missed its deadline, so it skips frames until it has caught up
+    bool   failed    = false; // Was removed from the channel
+};
+
+// Holds back what a consumer is sent behind the other consumers of the channel, to line it up with those that have
+// more latency of their own. Video and audio are delayed separately, by whole frames of the channel.
+struct consumer_delay
+{
+    struct amount
+    {
+        int    frames       = 0;
+        double milliseconds = 0.0; // Rounded to frames, and added to them
+
+        bool empty() const { return frames == 0 && milliseconds == 0.0; }
+    };
+
+    amount video;
+    amount audio;
+
+    bool empty() const { return video.empty() && audio.empty(); }
+};
+
+// Such as 2 for frames or 40ms, throwing user_error for anything else
+consumer_delay::amount parse_consumer_delay(const std::wstring& value);
+
 class output final
 {
   public:
     explicit output(const spl::shared_ptr<diagnostics::graph>& graph,
                     const video_format_desc&                   format_desc,
-                    const core::channel_info&                  channel_info);
+                    const core::channel_info&                  channel_info,
+                    consumer_deadline_policy                   deadline_policy = consumer_deadline_policy::wait,
+                    double                                     deadline_budget = 1.0);
 
     output(const output&)            = delete;
     output& operator=(const output&) = delete;
@@ -49,15 +93,21 @@ class output final
     // Send a frame to the output. If running an interlaced channel, two frames will be provided
     void operator()(const const_frame& frame, const const_frame& frame2, const video_format_desc& format_desc);
 
-    void add(const spl::shared_ptr<frame_consumer>& consumer);
-    void add(int index, const spl::shared_ptr<frame_consumer>& consumer);
+    void add(const spl::shared_ptr<frame_consumer>& consumer, const consumer_delay& delay = {});
+    void add(int index, const spl::shared_ptr<frame_consumer>& consumer, const consumer_delay& delay = {});
     bool remove(const spl::shared_ptr<frame_consumer>& consumer);
     bool remove(int index);
 
     size_t consumer_count() const;
 
+    // What the mixer has to read back for the current consumers
+    output_request request() const;
+
     core::monitor::state state() const;
 
+    // How each consumer took the last frame. Only called from the thread that sends the frames.
+    std::vector<consumer_timing> timings() const;
+
   private:
     struct impl;
     std::unique_ptr<impl> impl_;
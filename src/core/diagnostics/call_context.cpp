@@ -33,6 +33,8 @@ std::wstring call_context::to_string() const
 {
     if (video_channel == -1)
         return L"[]";
+    if (port != -1)
+        return L"[ch=" + std::to_wstring(video_channel) + L"; port=" + std::to_wstring(port) + L"]";
     if (layer == -1)
         return L"[ch=" + std::to_wstring(video_channel) + L"]";
     return L"[ch=" + std::to_wstring(video_channel) + L"; layer=" + std::to_wstring(layer) + L"]";
@@ -29,6 +29,7 @@ struct call_context
 {
     int video_channel = -1;
     int layer         = -1;
+    int port          = -1; // Of a consumer
 
     static call_context& for_thread();
     std::wstring         to_string() const;
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "cpu_cost.h"
+
+#include <common/os/thread.h>
+
+#include <climits>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+namespace {
+
+std::mutex                                         mutex;
+std::map<std::tuple<int, int, int>, std::int64_t> charges; // Nanoseconds by channel, layer and port
+
+void charge(const call_context& context, std::int64_t time)
+{
+    if (context.video_channel == -1 || time <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    charges[std::make_tuple(context.video_channel, context.layer, context.port)] += time;
+}
+
+} // namespace
+
+scoped_cpu_cost::scoped_cpu_cost()
+    : context_(call_context::for_thread())
+    , start_(thread_cpu_time())
+{
+}
+
+scoped_cpu_cost::~scoped_cpu_cost() { charge(context_, thread_cpu_time() - start_); }
+
+void charge_thread_cpu_time()
+{
+    thread_local std::int64_t last = thread_cpu_time();
+
+    auto now = thread_cpu_time();
+    charge(call_context::for_thread(), now - last);
+    last = now;
+}
+
+std::vector<cpu_cost> take_cpu_costs(int channel)
+{
+    std::vector<cpu_cost> costs;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto                        it = charges.lower_bound(std::make_tuple(channel, INT_MIN, INT_MIN));
+    while (it != charges.end() && std::get<0>(it->first) == channel) {
+        cpu_cost cost;
+        cost.layer   = std::get<1>(it->first);
+        cost.port    = std::get<2>(it->first);
+        cost.seconds = static_cast<double>(it->second) / 1e9;
+        costs.push_back(cost);
+        it = charges.erase(it);
+    }
+    return costs;
+}
+
+}}} // namespace caspar::core::diagnostics
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "call_context.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+// CPU time is charged to the producer of a layer or the consumer of a port, by the call context of the thread that
+// used it. Threads of their own that producers and consumers loop on take the call context they were created in.
+
+// Charges the CPU time the calling thread used within the scope to its call context
+class scoped_cpu_cost
+{
+    const call_context context_;
+    const std::int64_t start_;
+
+    scoped_cpu_cost(const scoped_cpu_cost&)            = delete;
+    scoped_cpu_cost& operator=(const scoped_cpu_cost&) = delete;
+
+  public:
+    scoped_cpu_cost();
+    ~scoped_cpu_cost();
+};
+
+// Charges the CPU time the calling thread used since the previous call to its call context, for threads that loop
+void charge_thread_cpu_time();
+
+struct cpu_cost
+{
+    int    layer   = -1;
+    int    port    = -1; // Of a consumer, when layer is -1
+    double seconds = 0.0;
+};
+
+// What was charged to the layers and ports of channel since the previous call, those without a charge are left out
+std::vector<cpu_cost> take_cpu_costs(int channel);
+
+}}} // namespace caspar::core::diagnostics
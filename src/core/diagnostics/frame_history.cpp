@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "frame_history.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+namespace {
+
+// A glitch tends to come with more in the frames that follow, which the first dump has most of
+const std::int64_t DUMP_INTERVAL_MS = 10000;
+
+std::shared_ptr<const frame_timing_listener> listener_;
+
+void append_number(std::string& out, double value)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    out += buffer;
+}
+
+std::string to_json(int channel, const std::string& reason, const boost::circular_buffer<frame_timing>& frames)
+{
+    std::string out = "{\"channel\":" + std::to_string(channel) + ",\"reason\":\"" + reason + "\",\"frames\":[";
+    auto        first = true;
+    for (auto& frame : frames) {
+        out += first ? "\n" : ",\n";
+        first = false;
+
+        // Times in milliseconds, which is what the graphs are read in
+        out += "{\"frame\":" + std::to_string(frame.frame) + ",\"time\":" + std::to_string(frame.time);
+        out += ",\"produce\":";
+        append_number(out, frame.produce * 1000.0);
+        out += ",\"mix\":";
+        append_number(out, frame.mix * 1000.0);
+        out += ",\"gpu\":";
+        append_number(out, frame.gpu);
+        out += ",\"consume\":";
+        append_number(out, frame.consume * 1000.0);
+        out += ",\"total\":";
+        append_number(out, frame.total * 1000.0);
+
+        out += ",\"layers\":{";
+        for (size_t n = 0; n < frame.layers.size(); ++n) {
+            out += (n > 0 ? ",\"" : "\"") + std::to_string(frame.layers[n].first) + "\":";
+            append_number(out, frame.layers[n].second * 1000.0);
+        }
+
+        out += "},\"consumers\":{";
+        for (size_t n = 0; n < frame.consumers.size(); ++n) {
+            auto& consumer = frame.consumers[n];
+            out += (n > 0 ? ",\"" : "\"") + std::to_string(consumer.port) + "\":{\"send\":";
+            append_number(out, consumer.send_time * 1000.0);
+            out += ",\"pending\":" + std::to_string(consumer.pending);
+            out += consumer.late ? ",\"late\":true" : "";
+            out += consumer.failed ? ",\"failed\":true" : "";
+            out += "}";
+        }
+        out += "}}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+} // namespace
+
+frame_history::frame_history(int channel, size_t capacity)
+    : channel_(channel)
+    , frames_(std::max<size_t>(capacity, 1))
+    , executor_(L"frame-history-" + std::to_wstring(channel))
+{
+}
+
+void frame_history::push(frame_timing timing, double frame_duration)
+{
+    std::string reason;
+    if (timing.total > frame_duration) {
+        reason = "late frame";
+    }
+    for (auto& consumer : timing.consumers) {
+        if (consumer.failed) {
+            reason = "consumer " + std::to_string(consumer.port) + " failed";
+        } else if (consumer.late && reason.empty()) {
+            reason = "consumer " + std::to_string(consumer.port) + " late";
+        }
+    }
+
+    auto time = timing.time;
+    frames_.push_back(std::move(timing));
+
+    if (!reason.empty() && time - last_dump_ >= DUMP_INTERVAL_MS) {
+        last_dump_ = time;
+        dump(reason);
+    }
+}
+
+void frame_history::dump(const std::string& reason)
+{
+    auto json = to_json(channel_, reason, frames_);
+
+    // Written off the channel thread, which is already behind
+    executor_.begin_invoke([channel = channel_, reason, json = std::move(json)] {
+        auto time     = boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time());
+        auto name     = L"frame-history-" + std::to_wstring(channel) + L"-" + time + L".json";
+        auto filename = (boost::filesystem::path(env::log_folder()) / name).wstring();
+
+        boost::filesystem::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            CASPAR_LOG(warning) << L"frame_history[" << channel << L"] Could not open file " << filename;
+            return;
+        }
+        file << json << std::flush;
+
+        CASPAR_LOG(warning) << L"frame_history[" << channel << L"] " << u16(reason)
+                            << L", the timings of the last frames were written to " << filename;
+    });
+}
+
+void set_frame_timing_listener(frame_timing_listener listener)
+{
+    std::atomic_store(&listener_,
+                      listener ? std::make_shared<const frame_timing_listener>(std::move(listener))
+                               : std::shared_ptr<const frame_timing_listener>());
+}
+
+std::shared_ptr<const frame_timing_listener> get_frame_timing_listener() { return std::atomic_load(&listener_); }
+
+}}} // namespace caspar::core::diagnostics
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../consumer/output.h"
+
+#include <common/executor.h>
+
+#include <boost/circular_buffer.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+// How a channel took a frame, where times are in seconds unless noted
+struct frame_timing
+{
+    std::uint64_t                       frame   = 0;
+    std::int64_t                        time    = 0; // Milliseconds since the epoch at which the frame was produced
+    double                              produce = 0.0;
+    double                              mix     = 0.0;
+    double                              gpu     = 0.0; // Milliseconds
+    double                              consume = 0.0;
+    double                              total   = 0.0;
+    std::vector<std::pair<int, double>> layers; // The time each layer took to receive its frame
+    std::vector<consumer_timing>        consumers;
+};
+
+// Keeps the timings of the last frames of a channel, which are written to a JSON file in the log folder when a frame is
+// late or a consumer falls behind. That way the cause of a glitch is at hand without having run a trace.
+class frame_history final
+{
+    const int                            channel_;
+    boost::circular_buffer<frame_timing> frames_;
+    std::int64_t                         last_dump_ = 0;
+    executor                             executor_;
+
+  public:
+    frame_history(int channel, size_t capacity);
+
+    frame_history(const frame_history&)            = delete;
+    frame_history& operator=(const frame_history&) = delete;
+
+    // Records a frame, and dumps the history if something about it went wrong. Called from one thread at a time.
+    void push(frame_timing timing, double frame_duration);
+
+  private:
+    void dump(const std::string& reason);
+};
+
+using frame_timing_listener = std::function<void(int channel, const frame_timing& timing, double frame_duration)>;
+
+// Called on the thread of each channel with the timing of every frame it outputs, whether it keeps a history or not,
+// such as to summarise a replay
+void                                         set_frame_timing_listener(frame_timing_listener listener);
+std::shared_ptr<const frame_timing_listener> get_frame_timing_listener();
+
+}}} // namespace caspar::core::diagnostics
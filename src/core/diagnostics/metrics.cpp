@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "metrics.h"
+
+#include "call_context.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/utf.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <locale>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace caspar { namespace core { namespace diagnostics { namespace metrics {
+
+namespace spi = caspar::diagnostics::spi;
+
+namespace {
+
+struct graph
+    : public spi::graph_sink
+    , public std::enable_shared_from_this<graph>
+{
+    const call_context                      context_ = call_context::for_thread();
+    std::shared_ptr<const spi::graph_state> state_;
+
+    void activate(const std::shared_ptr<const spi::graph_state>& state) override;
+
+    std::string labels() const
+    {
+        std::string result = "graph=\"";
+        for (auto c : u8(state_->text())) {
+            if (c == '\\' || c == '"') {
+                result += '\\';
+            }
+            result += c == '\n' ? ' ' : c;
+        }
+        result += '"';
+
+        if (context_.video_channel != -1) {
+            result += ",channel=\"" + std::to_string(context_.video_channel) + "\"";
+        }
+        if (context_.layer != -1) {
+            result += ",layer=\"" + std::to_string(context_.layer) + "\"";
+        }
+        return result;
+    }
+};
+
+std::mutex                        g_graphs_mutex;
+std::vector<std::weak_ptr<graph>> g_graphs;
+
+void graph::activate(const std::shared_ptr<const spi::graph_state>& state)
+{
+    state_ = state;
+
+    std::lock_guard<std::mutex> lock(g_graphs_mutex);
+    g_graphs.push_back(shared_from_this());
+}
+
+std::vector<std::shared_ptr<graph>> live_graphs()
+{
+    std::lock_guard<std::mutex> lock(g_graphs_mutex);
+
+    std::vector<std::shared_ptr<graph>> result;
+    auto                                it = g_graphs.begin();
+    while (it != g_graphs.end()) {
+        if (auto graph = it->lock()) {
+            result.push_back(std::move(graph));
+            ++it;
+        } else {
+            it = g_graphs.erase(it);
+        }
+    }
+    return result;
+}
+
+// What is scraped of the lines with the same labels, which are summed should several graphs share them
+struct line_snapshot
+{
+    double                                               last  = 0.0;
+    double                                               sum   = 0.0;
+    std::uint64_t                                        count = 0;
+    std::array<std::uint64_t, spi::bucket_bounds.size()> buckets{};
+};
+
+const char* severity_name(caspar::diagnostics::tag_severity severity)
+{
+    switch (severity) {
+        case caspar::diagnostics::tag_severity::WARNING:
+            return "warning";
+        case caspar::diagnostics::tag_severity::INFO:
+            return "info";
+        default:
+            return "silent";
+    }
+}
+
+} // namespace
+
+void register_sink()
+{
+    spi::register_sink_factory([] { return spl::make_shared<graph>(); });
+}
+
+std::shared_ptr<void> start() { return spi::start_sampling(); }
+
+std::string scrape()
+{
+    std::map<std::string, line_snapshot> lines;
+    std::map<std::string, std::uint64_t> tags_total;
+
+    for (auto& graph : live_graphs()) {
+        auto labels = graph->labels();
+
+        graph->state_->for_each_line([&](const spi::line_state& line) {
+            auto values = line.values.load(std::memory_order_acquire);
+            if (values > 0) {
+                auto& snapshot = lines[labels + ",line=\"" + line.name + "\""];
+                snapshot.last  = line.value.load(std::memory_order_relaxed);
+                snapshot.sum += line.sum.load(std::memory_order_relaxed);
+                snapshot.count += values;
+                for (size_t n = 0; n < snapshot.buckets.size(); ++n) {
+                    snapshot.buckets[n] += line.buckets[n].load(std::memory_order_relaxed);
+                }
+            }
+
+            auto tags = line.tags.load(std::memory_order_acquire);
+            if (tags > 0) {
+                auto severity = severity_name(line.severity.load(std::memory_order_relaxed));
+                tags_total[labels + ",tag=\"" + line.name + "\",severity=\"" + severity + "\""] += tags;
+            }
+        });
+    }
+
+    std::ostringstream out;
+    out.imbue(std::locale::classic());
+    out.precision(9);
+
+    out << "# HELP casparcg_graph_value The latest value of a line of a diagnostics graph.\n";
+    out << "# TYPE casparcg_graph_value gauge\n";
+    for (auto& line : lines) {
+        out << "casparcg_graph_value{" << line.first << "} " << line.second.last << "\n";
+    }
+
+    out << "# HELP casparcg_graph_distribution The values of a line of a diagnostics graph, where times are 0.5 for "
+           "the duration of a frame.\n";
+    out << "# TYPE casparcg_graph_distribution histogram\n";
+    for (auto& line : lines) {
+        std::uint64_t cumulative = 0;
+        for (size_t n = 0; n < line.second.buckets.size(); ++n) {
+            cumulative += line.second.buckets[n];
+            out << "casparcg_graph_distribution_bucket{" << line.first << ",le=\"" << spi::bucket_bounds[n]
+                << "\"} " << cumulative << "\n";
+        }
+        // The buckets and the count are read separately while they are updated, so neither is taken to be exact
+        auto count = std::max(cumulative, line.second.count);
+        out << "casparcg_graph_distribution_bucket{" << line.first << ",le=\"+Inf\"} " << count << "\n";
+        out << "casparcg_graph_distribution_sum{" << line.first << "} " << line.second.sum << "\n";
+        out << "casparcg_graph_distribution_count{" << line.first << "} " << count << "\n";
+    }
+
+    out << "# HELP casparcg_graph_tags_total The number of times a tag, e.g. dropped-frame, was set on a diagnostics "
+           "graph.\n";
+    out << "# TYPE casparcg_graph_tags_total counter\n";
+    for (auto& tag : tags_total) {
+        out << "casparcg_graph_tags_total{" << tag.first << "} " << tag.second << "\n";
+    }
+
+    return out.str();
+}
+
+}}}} // namespace caspar::core::diagnostics::metrics
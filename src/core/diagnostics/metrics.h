@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace core { namespace diagnostics { namespace metrics {
+
+// Makes the diagnostics graphs created after it is called available to scrape.
+void register_sink();
+
+// The graphs record their values and tags, which are counted in histograms, while the returned token is held.
+std::shared_ptr<void> start();
+
+// The recorded metrics in the Prometheus text format (version 0.0.4), labelled by the text of the graph and the channel
+// and layer it was created on. The values are those of the graphs, where times are 0.5 for the duration of a frame.
+std::string scrape();
+
+}}}} // namespace caspar::core::diagnostics::metrics
@@ -34,18 +34,16 @@
 
 #include <boost/circular_buffer.hpp>
 
-#include <tbb/concurrent_unordered_map.h>
-
 #include <GL/glew.h>
 
-#include <atomic>
+#include <cstdint>
 #include <cstdio>
 #include <filesystem>
 #include <list>
 #include <memory>
-#include <mutex>
 #include <optional>
 #include <thread>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -106,6 +104,7 @@ struct drawable
 class context : public drawable
 {
     std::unique_ptr<sf::RenderWindow> window_;
+    std::shared_ptr<void>             sampling_; // Held while the window is open
     sf::View                          view_;
 
     std::list<std::weak_ptr<drawable>> drawables_;
@@ -142,6 +141,7 @@ class context : public drawable
             if (!window_) {
                 window_.reset(
                     new sf::RenderWindow(sf::VideoMode(RENDERING_WIDTH, RENDERING_WIDTH), "CasparCG Diagnostics"));
+                sampling_ = caspar::diagnostics::spi::start_sampling();
                 window_->setPosition(sf::Vector2i(0, 0));
                 window_->setActive();
                 window_->setVerticalSyncEnabled(true);
@@ -153,8 +153,10 @@ class context : public drawable
 
                 tick();
             }
-        } else
+        } else {
             window_.reset();
+            sampling_.reset();
+        }
     }
 
     void tick()
@@ -167,6 +169,7 @@ class context : public drawable
             switch (e.type) {
                 case sf::Event::Closed:
                     window_.reset();
+                    sampling_.reset();
                     return;
                 case sf::Event::Resized:
                     calculate_view_ = true;
@@ -267,37 +270,33 @@ class line : public drawable
     boost::circular_buffer<sf::Vertex>                     line_data_{res_};
     boost::circular_buffer<std::optional<sf::VertexArray>> line_tags_{res_};
 
-    std::atomic<float> tick_data_;
-    std::atomic<bool>  tick_tag_;
-    std::atomic<int>   color_;
+    float         tick_data_ = -1.0f;
+    bool          tick_tag_  = false;
+    int           color_     = static_cast<int>(0xFFFFFFFF);
+    std::uint64_t values_    = 0;
+    std::uint64_t tags_      = 0;
 
     double x_delta_ = 1.0 / (static_cast<double>(res_) - 1.0);
 
   public:
-    line()
-        : tick_data_(-1.0f)
-        , tick_tag_(false)
-        , color_(0xFFFFFFFF)
+    // Takes what was recorded since the previous frame of the window
+    void sample(const caspar::diagnostics::spi::line_state& state, bool auto_reset)
     {
-    }
+        color_ = state.color.load(std::memory_order_relaxed);
+
+        auto values = state.values.load(std::memory_order_acquire);
+        if (values != values_) {
+            tick_data_ = static_cast<float>(state.value.load(std::memory_order_relaxed));
+            values_    = values;
+        } else if (auto_reset && values_ > 0) {
+            tick_data_ = 0.0f;
+        }
 
-    line(const line& other)
-        : res_(other.res_)
-        , line_data_(other.line_data_)
-        , line_tags_(other.line_tags_)
-        , tick_data_(other.tick_data_.load())
-        , tick_tag_(other.tick_tag_.load())
-        , color_(other.color_.load())
-        , x_delta_(other.x_delta_)
-    {
+        auto tags = state.tags.load(std::memory_order_acquire);
+        tick_tag_ = tags != tags_;
+        tags_     = tags;
     }
 
-    void set_value(float value) { tick_data_ = value; }
-
-    void set_tag() { tick_tag_ = true; }
-
-    void set_color(int color) { color_ = color; }
-
     int get_color() { return color_; }
 
     void render(sf::RenderTarget& target, sf::RenderStates states) override
@@ -372,40 +371,16 @@ struct graph
     , public caspar::diagnostics::spi::graph_sink
     , public std::enable_shared_from_this<graph>
 {
-    call_context                                     context_ = call_context::for_thread();
-    tbb::concurrent_unordered_map<std::string, line> lines_;
-
-    std::mutex   mutex_;
-    std::wstring text_;
-    bool         auto_reset_ = false;
+    call_context                                                 context_ = call_context::for_thread();
+    std::shared_ptr<const caspar::diagnostics::spi::graph_state> state_;
+    std::vector<std::pair<std::string, line>>                    lines_; // Only used by the thread of the window
 
     graph() {}
 
-    void activate() override { context::register_drawable(shared_from_this()); }
-
-    void set_text(const std::wstring& value) override
+    void activate(const std::shared_ptr<const caspar::diagnostics::spi::graph_state>& state) override
     {
-        auto                        temp = value;
-        std::lock_guard<std::mutex> lock(mutex_);
-        text_ = std::move(temp);
-    }
-
-    void set_value(const std::string& name, double value) override
-    {
-        lines_[name].set_value(static_cast<float>(value));
-    }
-
-    void set_tag(caspar::diagnostics::tag_severity /*severity*/, const std::string& name) override
-    {
-        lines_[name].set_tag();
-    }
-
-    void set_color(const std::string& name, int color) override { lines_[name].set_color(color); }
-
-    void auto_reset() override
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto_reset_ = true;
+        state_ = state;
+        context::register_drawable(shared_from_this());
     }
 
   private:
@@ -415,14 +390,17 @@ struct graph
         const size_t text_margin = 2;
         const size_t text_offset = (text_size + text_margin * 2) * 2;
 
-        std::wstring text_str;
-        bool         auto_reset;
+        auto text_str   = state_->text();
+        auto auto_reset = state_->auto_reset();
 
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            text_str   = text_;
-            auto_reset = auto_reset_;
-        }
+        // Lines are only ever added, in the same order
+        size_t n = 0;
+        state_->for_each_line([&](const caspar::diagnostics::spi::line_state& state) {
+            if (n == lines_.size()) {
+                lines_.emplace_back(state.name, line());
+            }
+            lines_[n++].second.sample(state, auto_reset);
+        });
 
         sf::Text text(text_str.c_str(), get_default_font(), text_size);
         text.setStyle(sf::Text::Italic);
@@ -498,8 +476,6 @@ struct graph
 
         for (auto it = lines_.begin(); it != lines_.end(); ++it) {
             target.draw(it->second, states);
-            if (auto_reset)
-                it->second.set_value(0.0f);
         }
     }
 };
@@ -26,10 +26,61 @@
 
 #include <boost/variant.hpp>
 
+#include <new>
+
 namespace caspar { namespace core {
 
 using frame_t = boost::variant<boost::blank, const_frame, std::vector<draw_frame>>;
 
+namespace {
+
+// Every layer builds and drops a tree of nodes every tick, so each thread keeps the nodes it drops for the next ones it
+// builds rather than going to the heap for each of them. A node may be dropped on another thread than it was built on,
+// e.g. by a consumer of a route, which then keeps it instead.
+class node_cache
+{
+    static const size_t MAX_NODES = 4096;
+
+    std::vector<void*> nodes_;
+
+  public:
+    static thread_local bool destroyed;
+
+    node_cache() { nodes_.reserve(MAX_NODES); }
+
+    ~node_cache()
+    {
+        destroyed = true;
+        for (auto node : nodes_) {
+            ::operator delete(node);
+        }
+    }
+
+    void* allocate(size_t size)
+    {
+        if (nodes_.empty()) {
+            return ::operator new(size);
+        }
+        auto node = nodes_.back();
+        nodes_.pop_back();
+        return node;
+    }
+
+    void deallocate(void* node)
+    {
+        if (nodes_.size() < MAX_NODES) {
+            nodes_.push_back(node);
+        } else {
+            ::operator delete(node);
+        }
+    }
+};
+
+thread_local bool node_cache::destroyed = false;
+thread_local node_cache t_nodes;
+
+} // namespace
+
 struct draw_frame::impl
 {
     frame_t         frame_;
@@ -71,6 +122,21 @@ struct draw_frame::impl
     }
 
     bool operator==(const impl& other) { return frame_ == other.frame_ && transform_ == other.transform_; }
+
+    // Nodes dropped after the cache of the thread was destroyed, as it exits, go straight back to the heap
+    static void* operator new(size_t size)
+    {
+        return node_cache::destroyed ? ::operator new(size) : t_nodes.allocate(size);
+    }
+
+    static void operator delete(void* node)
+    {
+        if (node_cache::destroyed) {
+            ::operator delete(node);
+        } else {
+            t_nodes.deallocate(node);
+        }
+    }
 };
 
 draw_frame::draw_frame()
@@ -23,11 +23,14 @@
 #include "geometry.h"
 #include "pixel_format.h"
 
+#include "../video_format.h"
+
 #include <common/array.h>
 #include <common/except.h>
 
 #include <cstdint>
 #include <functional>
+#include <mutex>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -36,9 +39,12 @@ struct mutable_frame::impl
 {
     std::vector<array<std::uint8_t>> image_data_;
     array<std::int32_t>              audio_data_;
+    int                              audio_channels_ = 0;
     const core::pixel_format_desc    desc_;
     const void*                      tag_;
     frame_geometry                   geometry_ = frame_geometry::get_default();
+    std::vector<damage_rect>         damage_;
+    frame_timestamps                 timestamps_;
     mutable_frame::commit_t          commit_;
 
     impl(const impl&)            = delete;
@@ -82,29 +88,58 @@ const array<std::uint8_t>& mutable_frame::image_data(std::size_t index) const {
 const array<std::int32_t>& mutable_frame::audio_data() const { return impl_->audio_data_; }
 array<std::uint8_t>&       mutable_frame::image_data(std::size_t index) { return impl_->image_data_.at(index); }
 array<std::int32_t>&       mutable_frame::audio_data() { return impl_->audio_data_; }
+int&                       mutable_frame::audio_channels() { return impl_->audio_channels_; }
+int                        mutable_frame::audio_channels() const { return impl_->audio_channels_; }
 std::size_t                mutable_frame::width() const { return impl_->desc_.planes.at(0).width; }
 std::size_t                mutable_frame::height() const { return impl_->desc_.planes.at(0).height; }
 const void*                mutable_frame::stream_tag() const { return impl_->tag_; }
 const frame_geometry&      mutable_frame::geometry() const { return impl_->geometry_; }
 frame_geometry&            mutable_frame::geometry() { return impl_->geometry_; }
+std::vector<damage_rect>&  mutable_frame::damage() { return impl_->damage_; }
+const std::vector<damage_rect>& mutable_frame::damage() const { return impl_->damage_; }
+frame_timestamps&               mutable_frame::timestamps() { return impl_->timestamps_; }
+const frame_timestamps&         mutable_frame::timestamps() const { return impl_->timestamps_; }
+
+// The image of a frame that is read back when it is first asked for, see const_frame::with_readback
+struct deferred_image
+{
+    std::function<array<const std::uint8_t>()> read;
+    std::once_flag                             once;
+    array<const std::uint8_t>                  data;
+};
 
 struct const_frame::impl
 {
     std::vector<array<const std::uint8_t>> image_data_;
     array<const std::int32_t>              audio_data_;
-    core::pixel_format_desc                desc_     = core::pixel_format_desc(pixel_format::invalid);
+    int                                    audio_channels_ = 0;
+    core::pixel_format_desc                desc_           = core::pixel_format_desc(pixel_format::invalid);
     const void*                            tag_;
-    frame_geometry                         geometry_ = frame_geometry::get_default();
+    frame_geometry                         geometry_       = frame_geometry::get_default();
     std::any                               opaque_;
+    const_frame::packed_data_t             packed_data_;
+    const_frame::scaled_data_t             scaled_data_;
+    std::vector<damage_rect>               damage_;
+    frame_timestamps                       timestamps_;
+    video_field                            field_ = video_field::progressive;
+    std::shared_ptr<deferred_image>        readback_;
 
     impl(const void*                            tag,
          std::vector<array<const std::uint8_t>> image_data,
          array<const std::int32_t>              audio_data,
-         const core::pixel_format_desc&         desc)
+         const core::pixel_format_desc&         desc,
+         const_frame::packed_data_t             packed_data,
+         std::vector<damage_rect>               damage,
+         const frame_timestamps&                timestamps,
+         const_frame::scaled_data_t             scaled_data)
         : image_data_(std::move(image_data))
         , audio_data_(std::move(audio_data))
         , desc_(desc)
         , tag_(tag)
+        , packed_data_(std::move(packed_data))
+        , scaled_data_(std::move(scaled_data))
+        , damage_(std::move(damage))
+        , timestamps_(timestamps)
     {
         if (desc_.planes.size() != image_data_.size()) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
@@ -116,9 +151,12 @@ struct const_frame::impl
         : image_data_(std::make_move_iterator(other.impl_->image_data_.begin()),
                       std::make_move_iterator(other.impl_->image_data_.end()))
         , audio_data_(std::move(other.impl_->audio_data_))
+        , audio_channels_(other.impl_->audio_channels_)
         , desc_(std::move(other.impl_->desc_))
         , tag_(other.stream_tag())
         , geometry_(std::move(other.impl_->geometry_))
+        , damage_(std::move(other.impl_->damage_))
+        , timestamps_(other.impl_->timestamps_)
     {
         if (desc_.planes.size() != image_data_.size() && !other.impl_->commit_) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
@@ -128,7 +166,36 @@ struct const_frame::impl
         }
     }
 
-    const array<const std::uint8_t>& image_data(std::size_t index) const { return image_data_.at(index); }
+    const array<const std::uint8_t>& image_data(std::size_t index) const
+    {
+        if (index == 0 && readback_ && image_data_.at(0).size() == 0) {
+            std::call_once(readback_->once, [&] { readback_->data = readback_->read(); });
+            return readback_->data;
+        }
+        return image_data_.at(index);
+    }
+
+    const array<const std::uint8_t>& packed_data(output_packing packing) const
+    {
+        static const array<const std::uint8_t> empty;
+
+        for (auto& packed : packed_data_) {
+            if (packed.first == packing)
+                return packed.second;
+        }
+        return empty;
+    }
+
+    const array<const std::uint8_t>& scaled_data(const output_size& size) const
+    {
+        static const array<const std::uint8_t> empty;
+
+        for (auto& scaled : scaled_data_) {
+            if (scaled.first == size)
+                return scaled.second;
+        }
+        return empty;
+    }
 
     std::size_t width() const { return desc_.planes.at(0).width; }
 
@@ -141,8 +208,19 @@ const_frame::const_frame() {}
 const_frame::const_frame(const void*                            tag,
                          std::vector<array<const std::uint8_t>> image_data,
                          array<const std::int32_t>              audio_data,
-                         const core::pixel_format_desc&         desc)
-    : impl_(new impl(tag, std::move(image_data), std::move(audio_data), desc))
+                         const core::pixel_format_desc&         desc,
+                         packed_data_t                          packed_data,
+                         std::vector<damage_rect>               damage,
+                         const frame_timestamps&                timestamps,
+                         scaled_data_t                          scaled_data)
+    : impl_(new impl(tag,
+                     std::move(image_data),
+                     std::move(audio_data),
+                     desc,
+                     std::move(packed_data),
+                     std::move(damage),
+                     timestamps,
+                     std::move(scaled_data)))
 {
 }
 const_frame::const_frame(mutable_frame&& other)
@@ -165,7 +243,16 @@ bool                     const_frame::operator<(const const_frame& other) const
 bool                     const_frame::operator>(const const_frame& other) const { return impl_ > other.impl_; }
 const pixel_format_desc& const_frame::pixel_format_desc() const { return impl_->desc_; }
 const array<const std::uint8_t>& const_frame::image_data(std::size_t index) const { return impl_->image_data(index); }
+const array<const std::uint8_t>& const_frame::packed_data(output_packing packing) const
+{
+    return impl_->packed_data(packing);
+}
+const array<const std::uint8_t>& const_frame::scaled_data(const output_size& size) const
+{
+    return impl_->scaled_data(size);
+}
 const array<const std::int32_t>& const_frame::audio_data() const { return impl_->audio_data_; }
+int                              const_frame::audio_channels() const { return impl_->audio_channels_; }
 std::size_t                      const_frame::width() const { return impl_->width(); }
 std::size_t                      const_frame::height() const { return impl_->height(); }
 std::size_t                      const_frame::size() const { return impl_->size(); }
@@ -176,16 +263,107 @@ const_frame                      const_frame::with_tag(const void* new_tag) cons
     }
     
     std::vector<array<const std::uint8_t>> image_data_copy = impl_->image_data_;
-    auto new_frame = const_frame(new_tag, std::move(image_data_copy), impl_->audio_data_, impl_->desc_);
+    auto new_frame = const_frame(new_tag,
+                                 std::move(image_data_copy),
+                                 impl_->audio_data_,
+                                 impl_->desc_,
+                                 impl_->packed_data_,
+                                 impl_->damage_,
+                                 impl_->timestamps_,
+                                 impl_->scaled_data_);
     
-    new_frame.impl_->geometry_ = impl_->geometry_;
+    new_frame.impl_->geometry_       = impl_->geometry_;
+    new_frame.impl_->audio_channels_ = impl_->audio_channels_;
+    new_frame.impl_->field_          = impl_->field_;
     if (impl_->opaque_.has_value()) {
         new_frame.impl_->opaque_ = impl_->opaque_;
     }
+    new_frame.impl_->readback_ = impl_->readback_;
     
     return new_frame;
 }
 const frame_geometry&            const_frame::geometry() const { return impl_->geometry_; }
+const std::vector<damage_rect>&  const_frame::damage() const { return impl_->damage_; }
+const_frame                      const_frame::with_damage(std::vector<damage_rect> damage) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto new_frame           = const_frame();
+    new_frame.impl_          = std::make_shared<impl>(*impl_);
+    new_frame.impl_->damage_ = std::move(damage);
+
+    return new_frame;
+}
+const frame_timestamps&          const_frame::timestamps() const { return impl_->timestamps_; }
+const_frame                      const_frame::with_timestamps(const frame_timestamps& timestamps) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto new_frame               = const_frame();
+    new_frame.impl_              = std::make_shared<impl>(*impl_);
+    new_frame.impl_->timestamps_ = timestamps;
+
+    return new_frame;
+}
+video_field                      const_frame::field() const { return impl_->field_; }
+const_frame                      const_frame::with_field(video_field field) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto new_frame          = const_frame();
+    new_frame.impl_         = std::make_shared<impl>(*impl_);
+    new_frame.impl_->field_ = field;
+    if (field != impl_->field_) {
+        // Another field is interpolated from other lines
+        new_frame.impl_->damage_.clear();
+    }
+
+    return new_frame;
+}
+const_frame const_frame::with_audio(array<const std::int32_t> audio_data, int audio_channels) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto new_frame                   = const_frame();
+    new_frame.impl_                  = std::make_shared<impl>(*impl_);
+    new_frame.impl_->audio_data_     = std::move(audio_data);
+    new_frame.impl_->audio_channels_ = audio_channels;
+
+    return new_frame;
+}
 const std::any&                  const_frame::opaque() const { return impl_->opaque_; }
+const_frame                      const_frame::with_opaque(std::any opaque) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto new_frame           = const_frame();
+    new_frame.impl_          = std::make_shared<impl>(*impl_);
+    new_frame.impl_->opaque_ = std::move(opaque);
+
+    return new_frame;
+}
+const_frame const_frame::with_readback(std::function<array<const std::uint8_t>()> readback) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto new_frame                   = const_frame();
+    new_frame.impl_                  = std::make_shared<impl>(*impl_);
+    new_frame.impl_->readback_       = std::make_shared<deferred_image>();
+    new_frame.impl_->readback_->read = std::move(readback);
+
+    return new_frame;
+}
 const_frame::operator bool() const { return impl_ != nullptr && impl_->desc_.format != core::pixel_format::invalid; }
 }} // namespace caspar::core
@@ -3,14 +3,41 @@
 #include <common/array.h>
 
 #include <any>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace core {
 
+enum class output_packing;
+struct output_size;
+enum class video_field;
+
+// A rectangle of the pixels of a frame, with its origin at the top left
+struct damage_rect final
+{
+    int x      = 0;
+    int y      = 0;
+    int width  = 0;
+    int height = 0;
+};
+
+// Points in time a frame passed on its way through the server, for measuring latency. Those it has not passed are left
+// at the epoch.
+struct frame_timestamps final
+{
+    // When the image arrived from a live input. A mixed frame has that of the oldest image in it.
+    std::chrono::steady_clock::time_point captured;
+    // When the mixer started on the tick the frame is the output of
+    std::chrono::steady_clock::time_point mixed;
+    // When the mixed image had been read back from the GPU
+    std::chrono::steady_clock::time_point rendered;
+};
+
 class mutable_frame final
 {
     friend class const_frame;
@@ -41,6 +68,10 @@ class mutable_frame final
     array<std::int32_t>&       audio_data();
     const array<std::int32_t>& audio_data() const;
 
+    // The number of channels interleaved in audio_data, 0 when it has as many as the channel it is mixed in
+    int& audio_channels();
+    int  audio_channels() const;
+
     std::size_t width() const;
 
     std::size_t height() const;
@@ -50,6 +81,14 @@ class mutable_frame final
     class frame_geometry&       geometry();
     const class frame_geometry& geometry() const;
 
+    // The areas that changed since the previous frame of the same source. Empty means the frame may differ anywhere,
+    // and a rectangle without area that nothing changed.
+    std::vector<damage_rect>&       damage();
+    const std::vector<damage_rect>& damage() const;
+
+    frame_timestamps&       timestamps();
+    const frame_timestamps& timestamps() const;
+
   private:
     struct impl;
     std::unique_ptr<impl> impl_;
@@ -58,11 +97,18 @@ class mutable_frame final
 class const_frame final
 {
   public:
+    using packed_data_t = std::vector<std::pair<output_packing, array<const std::uint8_t>>>;
+    using scaled_data_t = std::vector<std::pair<output_size, array<const std::uint8_t>>>;
+
     const_frame();
     explicit const_frame(const void*                            tag,
                          std::vector<array<const std::uint8_t>> image_data,
                          array<const std::int32_t>              audio_data,
-                         const struct pixel_format_desc&        desc);
+                         const struct pixel_format_desc&        desc,
+                         packed_data_t                          packed_data = {},
+                         std::vector<damage_rect>               damage      = {},
+                         const frame_timestamps&                timestamps  = {},
+                         scaled_data_t                          scaled_data = {});
     const_frame(const const_frame& other);
     const_frame(mutable_frame&& other);
 
@@ -74,8 +120,17 @@ class const_frame final
 
     const array<const std::uint8_t>& image_data(std::size_t index) const;
 
+    // The image packed on the GPU, empty unless a consumer of the channel asked for that packing when it was mixed
+    const array<const std::uint8_t>& packed_data(output_packing packing) const;
+
+    // The image scaled on the GPU, empty unless a consumer of the channel asked for that size when it was mixed
+    const array<const std::uint8_t>& scaled_data(const output_size& size) const;
+
     const array<const std::int32_t>& audio_data() const;
 
+    // See mutable_frame::audio_channels
+    int audio_channels() const;
+
     std::size_t width() const;
 
     std::size_t height() const;
@@ -86,9 +141,31 @@ class const_frame final
     const_frame with_tag(const void* new_tag) const;
 
     const std::any& opaque() const;
+    const_frame     with_opaque(std::any opaque) const;
+
+    // A frame whose image, left out when it was mixed, is read by readback the first time image_data is called. The
+    // frames made from it share the one read.
+    const_frame with_readback(std::function<array<const std::uint8_t>()> readback) const;
 
     const class frame_geometry& geometry() const;
 
+    // See mutable_frame::damage
+    const std::vector<damage_rect>& damage() const;
+    const_frame                     with_damage(std::vector<damage_rect> damage) const;
+
+    // See frame_timestamps
+    const frame_timestamps& timestamps() const;
+    const_frame             with_timestamps(const frame_timestamps& timestamps) const;
+
+    // The field of interlaced video the frame shows, which the mixer interpolates to full height when it draws it, a
+    // being the upper field and b the lower one. Progressive frames are drawn as they are. Lets a producer deinterlace
+    // on the GPU by passing the same image on once for every field.
+    video_field field() const;
+    const_frame with_field(video_field field) const;
+
+    // The same image with other audio, e.g. that of the next field
+    const_frame with_audio(array<const std::int32_t> audio_data, int audio_channels) const;
+
     bool operator==(const const_frame& other) const;
     bool operator!=(const const_frame& other) const;
     bool operator<(const const_frame& other) const;
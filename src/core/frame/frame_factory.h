@@ -21,10 +21,37 @@
 
 #pragma once
 
+#include "frame.h"
+
+#include <common/array.h>
 #include <common/bit_depth.h>
 
+#include <cstdint>
+#include <vector>
+
 namespace caspar { namespace core {
 
+// A BGRA image that another graphics API shares with this process, e.g. rendered by the GPU process of a browser. It
+// only has to stay valid until it has been imported.
+struct shared_texture final
+{
+    int width  = 0;
+    int height = 0;
+
+    // Windows: an NT handle to a D3D11 texture
+    void* handle = nullptr;
+
+    // Linux: the planes of a dma-buf in the layout of the modifier
+    struct plane
+    {
+        int           fd     = -1;
+        std::uint32_t stride = 0;
+        std::uint64_t offset = 0;
+    };
+    std::vector<plane> planes;
+    std::uint64_t      modifier = 0x00ffffffffffffffULL; // DRM_FORMAT_MOD_INVALID, an implicit layout
+};
+
 class frame_factory
 {
   public:
@@ -37,6 +64,25 @@ class frame_factory
     virtual class mutable_frame create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc) = 0;
     virtual class mutable_frame
     create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc, common::bit_depth depth) = 0;
+
+    // Whether import_frame can make frames of shared textures on this platform and graphics driver
+    virtual bool supports_shared_textures() const { return false; }
+    // Makes a frame of a copy of the shared texture, which is made on the GPU before this returns, so that the texture
+    // can be reused by its owner at once. The frame has no image data in host memory.
+    virtual class mutable_frame import_frame(const void* video_stream_tag, const shared_texture& texture) = 0;
+
+    // Makes a frame of a BGRA image of the same size as previous, a frame of the same source, of which only the damaged
+    // areas have changed. When previous was made by this factory only those areas are read from image and uploaded,
+    // otherwise all of it. image only has to stay valid until this returns, and the frame has no image data in host
+    // memory.
+    virtual class mutable_frame update_frame(const void*                      video_stream_tag,
+                                             const class const_frame&         previous,
+                                             const struct pixel_format_desc&  desc,
+                                             const array<const std::uint8_t>& image,
+                                             const std::vector<damage_rect>&  damage) = 0;
+
+    // Frames created by factories with the same scope can be drawn by any of them
+    virtual const void* frame_scope() const { return this; }
 };
 
 }} // namespace caspar::core
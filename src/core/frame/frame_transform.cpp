@@ -24,42 +24,53 @@
 #include <boost/range/algorithm/equal.hpp>
 
 #include <cmath>
+#include <cstdint>
 #include <utility>
 
 namespace caspar { namespace core {
 
-double do_tween(double time, double source, double dest, double duration, const tweener& tween)
+// Tweens values with a single evaluation of the tween function where it allows, rather than one for each of them
+class value_tween
 {
-    return tween(time, source, dest - source, duration);
-}
+    double         time_;
+    double         duration_;
+    const tweener& tween_;
+    bool           separable_;
+    double         progress_;
+
+  public:
+    value_tween(double time, double duration, const tweener& tween)
+        : time_(time)
+        , duration_(duration)
+        , tween_(tween)
+        , separable_(tween.is_separable())
+        , progress_(separable_ ? tween(time, 0.0, 1.0, duration) : 0.0)
+    {
+    }
+
+    double operator()(double source, double dest) const
+    {
+        return separable_ ? source + (dest - source) * progress_ : tween_(time_, source, dest - source, duration_);
+    }
+};
 
 template <typename Rect>
-void do_tween_rectangle(const Rect&    source,
-                        const Rect&    dest,
-                        Rect&          out,
-                        double         time,
-                        double         duration,
-                        const tweener& tweener)
+void do_tween_rectangle(const Rect& source, const Rect& dest, Rect& out, const value_tween& value)
 {
-    out.ul[0] = do_tween(time, source.ul[0], dest.ul[0], duration, tweener);
-    out.ul[1] = do_tween(time, source.ul[1], dest.ul[1], duration, tweener);
-    out.lr[0] = do_tween(time, source.lr[0], dest.lr[0], duration, tweener);
-    out.lr[1] = do_tween(time, source.lr[1], dest.lr[1], duration, tweener);
+    out.ul[0] = value(source.ul[0], dest.ul[0]);
+    out.ul[1] = value(source.ul[1], dest.ul[1]);
+    out.lr[0] = value(source.lr[0], dest.lr[0]);
+    out.lr[1] = value(source.lr[1], dest.lr[1]);
 }
 
-void do_tween_corners(const corners& source,
-                      const corners& dest,
-                      corners&       out,
-                      double         time,
-                      double         duration,
-                      const tweener& tweener)
+void do_tween_corners(const corners& source, const corners& dest, corners& out, const value_tween& value)
 {
-    do_tween_rectangle(source, dest, out, time, duration, tweener);
+    do_tween_rectangle(source, dest, out, value);
 
-    out.ur[0] = do_tween(time, source.ur[0], dest.ur[0], duration, tweener);
-    out.ur[1] = do_tween(time, source.ur[1], dest.ur[1], duration, tweener);
-    out.ll[0] = do_tween(time, source.ll[0], dest.ll[0], duration, tweener);
-    out.ll[1] = do_tween(time, source.ll[1], dest.ll[1], duration, tweener);
+    out.ur[0] = value(source.ur[0], dest.ur[0]);
+    out.ur[1] = value(source.ur[1], dest.ur[1]);
+    out.ll[0] = value(source.ll[0], dest.ll[0]);
+    out.ll[1] = value(source.ll[1], dest.ll[1]);
 }
 
 image_transform image_transform::tween(double                 time,
@@ -68,39 +79,38 @@ image_transform image_transform::tween(double                 time,
                                        double                 duration,
                                        const tweener&         tween)
 {
+    const value_tween value(time, duration, tween);
+
     image_transform result;
 
-    result.brightness          = do_tween(time, source.brightness, dest.brightness, duration, tween);
-    result.contrast            = do_tween(time, source.contrast, dest.contrast, duration, tween);
-    result.saturation          = do_tween(time, source.saturation, dest.saturation, duration, tween);
-    result.opacity             = do_tween(time, source.opacity, dest.opacity, duration, tween);
-    result.anchor[0]           = do_tween(time, source.anchor[0], dest.anchor[0], duration, tween);
-    result.anchor[1]           = do_tween(time, source.anchor[1], dest.anchor[1], duration, tween);
-    result.fill_translation[0] = do_tween(time, source.fill_translation[0], dest.fill_translation[0], duration, tween);
-    result.fill_translation[1] = do_tween(time, source.fill_translation[1], dest.fill_translation[1], duration, tween);
-    result.fill_scale[0]       = do_tween(time, source.fill_scale[0], dest.fill_scale[0], duration, tween);
-    result.fill_scale[1]       = do_tween(time, source.fill_scale[1], dest.fill_scale[1], duration, tween);
-    result.clip_translation[0] = do_tween(time, source.clip_translation[0], dest.clip_translation[0], duration, tween);
-    result.clip_translation[1] = do_tween(time, source.clip_translation[1], dest.clip_translation[1], duration, tween);
-    result.clip_scale[0]       = do_tween(time, source.clip_scale[0], dest.clip_scale[0], duration, tween);
-    result.clip_scale[1]       = do_tween(time, source.clip_scale[1], dest.clip_scale[1], duration, tween);
-    result.angle               = do_tween(time, source.angle, dest.angle, duration, tween);
-    result.levels.max_input    = do_tween(time, source.levels.max_input, dest.levels.max_input, duration, tween);
-    result.levels.min_input    = do_tween(time, source.levels.min_input, dest.levels.min_input, duration, tween);
-    result.levels.max_output   = do_tween(time, source.levels.max_output, dest.levels.max_output, duration, tween);
-    result.levels.min_output   = do_tween(time, source.levels.min_output, dest.levels.min_output, duration, tween);
-    result.levels.gamma        = do_tween(time, source.levels.gamma, dest.levels.gamma, duration, tween);
-    result.chroma.target_hue   = do_tween(time, source.chroma.target_hue, dest.chroma.target_hue, duration, tween);
-    result.chroma.hue_width    = do_tween(time, source.chroma.hue_width, dest.chroma.hue_width, duration, tween);
-    result.chroma.min_saturation =
-        do_tween(time, source.chroma.min_saturation, dest.chroma.min_saturation, duration, tween);
-    result.chroma.min_brightness =
-        do_tween(time, source.chroma.min_brightness, dest.chroma.min_brightness, duration, tween);
-    result.chroma.softness = do_tween(time, source.chroma.softness, dest.chroma.softness, duration, tween);
-    result.chroma.spill_suppress =
-        do_tween(time, source.chroma.spill_suppress, dest.chroma.spill_suppress, duration, tween);
+    result.brightness                       = value(source.brightness, dest.brightness);
+    result.contrast                         = value(source.contrast, dest.contrast);
+    result.saturation                       = value(source.saturation, dest.saturation);
+    result.opacity                          = value(source.opacity, dest.opacity);
+    result.anchor[0]                        = value(source.anchor[0], dest.anchor[0]);
+    result.anchor[1]                        = value(source.anchor[1], dest.anchor[1]);
+    result.fill_translation[0]              = value(source.fill_translation[0], dest.fill_translation[0]);
+    result.fill_translation[1]              = value(source.fill_translation[1], dest.fill_translation[1]);
+    result.fill_scale[0]                    = value(source.fill_scale[0], dest.fill_scale[0]);
+    result.fill_scale[1]                    = value(source.fill_scale[1], dest.fill_scale[1]);
+    result.clip_translation[0]              = value(source.clip_translation[0], dest.clip_translation[0]);
+    result.clip_translation[1]              = value(source.clip_translation[1], dest.clip_translation[1]);
+    result.clip_scale[0]                    = value(source.clip_scale[0], dest.clip_scale[0]);
+    result.clip_scale[1]                    = value(source.clip_scale[1], dest.clip_scale[1]);
+    result.angle                            = value(source.angle, dest.angle);
+    result.levels.max_input                 = value(source.levels.max_input, dest.levels.max_input);
+    result.levels.min_input                 = value(source.levels.min_input, dest.levels.min_input);
+    result.levels.max_output                = value(source.levels.max_output, dest.levels.max_output);
+    result.levels.min_output                = value(source.levels.min_output, dest.levels.min_output);
+    result.levels.gamma                     = value(source.levels.gamma, dest.levels.gamma);
+    result.chroma.target_hue                = value(source.chroma.target_hue, dest.chroma.target_hue);
+    result.chroma.hue_width                 = value(source.chroma.hue_width, dest.chroma.hue_width);
+    result.chroma.min_saturation            = value(source.chroma.min_saturation, dest.chroma.min_saturation);
+    result.chroma.min_brightness            = value(source.chroma.min_brightness, dest.chroma.min_brightness);
+    result.chroma.softness                  = value(source.chroma.softness, dest.chroma.softness);
+    result.chroma.spill_suppress            = value(source.chroma.spill_suppress, dest.chroma.spill_suppress);
     result.chroma.spill_suppress_saturation =
-        do_tween(time, source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation, duration, tween);
+        value(source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation);
     result.chroma.enable    = dest.chroma.enable;
     result.chroma.show_mask = dest.chroma.show_mask;
     result.is_key           = source.is_key || dest.is_key;
@@ -108,9 +118,10 @@ image_transform image_transform::tween(double                 time,
     result.is_mix           = source.is_mix || dest.is_mix;
     result.blend_mode       = std::max(source.blend_mode, dest.blend_mode);
     result.layer_depth      = dest.layer_depth;
+    result.layer_cache      = dest.layer_cache;
 
-    do_tween_rectangle(source.crop, dest.crop, result.crop, time, duration, tween);
-    do_tween_corners(source.perspective, dest.perspective, result.perspective, time, duration, tween);
+    do_tween_rectangle(source.crop, dest.crop, result.crop, value);
+    do_tween_corners(source.perspective, dest.perspective, result.perspective, value);
 
     return result;
 }
@@ -131,22 +142,23 @@ bool operator==(const rectangle& lhs, const rectangle& rhs)
 bool operator==(const image_transform& lhs, const image_transform& rhs)
 {
     return eq(lhs.opacity, rhs.opacity) && eq(lhs.contrast, rhs.contrast) && eq(lhs.brightness, rhs.brightness) &&
-               eq(lhs.saturation, rhs.saturation) && boost::range::equal(lhs.anchor, rhs.anchor, eq) &&
-               boost::range::equal(lhs.fill_translation, rhs.fill_translation, eq) &&
-               boost::range::equal(lhs.fill_scale, rhs.fill_scale, eq) &&
-               boost::range::equal(lhs.clip_translation, rhs.clip_translation, eq) &&
-               boost::range::equal(lhs.clip_scale, rhs.clip_scale, eq) && eq(lhs.angle, rhs.angle) &&
-               lhs.is_key == rhs.is_key && lhs.invert == rhs.invert && lhs.is_mix == rhs.is_mix &&
-               lhs.blend_mode == rhs.blend_mode && lhs.layer_depth == rhs.layer_depth &&
-               lhs.chroma.enable == rhs.chroma.enable && lhs.chroma.show_mask == rhs.chroma.show_mask &&
-               eq(lhs.chroma.target_hue, rhs.chroma.target_hue) && eq(lhs.chroma.hue_width, rhs.chroma.hue_width) &&
-               eq(lhs.chroma.min_saturation, rhs.chroma.min_saturation) &&
-               eq(lhs.chroma.min_brightness, rhs.chroma.min_brightness) &&
-               eq(lhs.chroma.softness, rhs.chroma.softness) &&
-               eq(lhs.chroma.spill_suppress, rhs.chroma.spill_suppress) &&
-               eq(lhs.chroma.spill_suppress_saturation, rhs.chroma.spill_suppress_saturation) && lhs.crop == rhs.crop &&
-               lhs.perspective == rhs.perspective ||
-           lhs.enable_geometry_modifiers == rhs.enable_geometry_modifiers;
+           eq(lhs.saturation, rhs.saturation) && boost::range::equal(lhs.anchor, rhs.anchor, eq) &&
+           boost::range::equal(lhs.fill_translation, rhs.fill_translation, eq) &&
+           boost::range::equal(lhs.fill_scale, rhs.fill_scale, eq) &&
+           boost::range::equal(lhs.clip_translation, rhs.clip_translation, eq) &&
+           boost::range::equal(lhs.clip_scale, rhs.clip_scale, eq) && eq(lhs.angle, rhs.angle) &&
+           lhs.is_key == rhs.is_key && lhs.invert == rhs.invert && lhs.is_mix == rhs.is_mix &&
+           lhs.blend_mode == rhs.blend_mode && lhs.layer_depth == rhs.layer_depth &&
+           lhs.layer_cache == rhs.layer_cache && lhs.chroma.enable == rhs.chroma.enable &&
+           lhs.chroma.show_mask == rhs.chroma.show_mask && eq(lhs.chroma.target_hue, rhs.chroma.target_hue) &&
+           eq(lhs.chroma.hue_width, rhs.chroma.hue_width) && eq(lhs.chroma.min_saturation, rhs.chroma.min_saturation) &&
+           eq(lhs.chroma.min_brightness, rhs.chroma.min_brightness) && eq(lhs.chroma.softness, rhs.chroma.softness) &&
+           eq(lhs.chroma.spill_suppress, rhs.chroma.spill_suppress) &&
+           eq(lhs.chroma.spill_suppress_saturation, rhs.chroma.spill_suppress_saturation) &&
+           eq(lhs.levels.min_input, rhs.levels.min_input) && eq(lhs.levels.max_input, rhs.levels.max_input) &&
+           eq(lhs.levels.gamma, rhs.levels.gamma) && eq(lhs.levels.min_output, rhs.levels.min_output) &&
+           eq(lhs.levels.max_output, rhs.levels.max_output) && lhs.crop == rhs.crop &&
+           lhs.perspective == rhs.perspective && lhs.enable_geometry_modifiers == rhs.enable_geometry_modifiers;
 }
 
 bool operator!=(const image_transform& lhs, const image_transform& rhs) { return !(lhs == rhs); }
@@ -156,6 +168,23 @@ bool operator!=(const image_transform& lhs, const image_transform& rhs) { return
 audio_transform& audio_transform::operator*=(const audio_transform& other)
 {
     volume *= other.volume;
+
+    // The other transform is applied to the source first, so this map picks from the channels it outputs
+    if (channel_map.empty()) {
+        channel_map = other.channel_map;
+    } else if (!other.channel_map.empty()) {
+        for (auto& channel : channel_map) {
+            const auto valid = channel >= 0 && channel < static_cast<int>(other.channel_map.size());
+            channel          = valid ? other.channel_map[channel] : -1;
+        }
+    }
+
+    if (!tag_namespace) {
+        tag_namespace = other.tag_namespace;
+    } else if (other.tag_namespace) {
+        // Such as the sources of a route of a route
+        tag_namespace = combine_tags(tag_namespace, other.tag_namespace);
+    }
     return *this;
 }
 
@@ -171,15 +200,29 @@ audio_transform audio_transform::tween(double                 time,
                                        const tweener&         tween)
 {
     audio_transform result;
-    result.volume = do_tween(time, source.volume, dest.volume, duration, tween);
+    result.volume        = value_tween(time, duration, tween)(source.volume, dest.volume);
+    result.channel_map   = dest.channel_map;
+    result.tag_namespace = dest.tag_namespace;
 
     return result;
 }
 
-bool operator==(const audio_transform& lhs, const audio_transform& rhs) { return eq(lhs.volume, rhs.volume); }
+bool operator==(const audio_transform& lhs, const audio_transform& rhs)
+{
+    return eq(lhs.volume, rhs.volume) && lhs.channel_map == rhs.channel_map && lhs.tag_namespace == rhs.tag_namespace;
+}
 
 bool operator!=(const audio_transform& lhs, const audio_transform& rhs) { return !(lhs == rhs); }
 
+const void* combine_tags(const void* tag_namespace, const void* tag)
+{
+    auto ns    = reinterpret_cast<std::uintptr_t>(tag_namespace);
+    auto value = reinterpret_cast<std::uintptr_t>(tag);
+
+    // The multiplication spreads the namespace over the bits, so that nearby namespaces and tags do not cancel out
+    return reinterpret_cast<const void*>((ns * static_cast<std::uintptr_t>(0x9E3779B1)) ^ value ^ 0xDEADBEEF);
+}
+
 // frame_transform
 frame_transform::frame_transform() = default;
 
@@ -217,6 +260,8 @@ tweened_transform::tweened_transform(const frame_transform& source,
 
 const frame_transform& tweened_transform::dest() const { return dest_; }
 
+bool tweened_transform::is_animating() const { return time_ < duration_; }
+
 frame_transform tweened_transform::fetch()
 {
     return time_ == duration_
@@ -27,6 +27,7 @@
 
 #include <array>
 #include <optional>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -73,6 +74,14 @@ struct rectangle final
     std::array<double, 2> lr = {1.0, 1.0};
 };
 
+// Whether the mixer keeps what a layer draws while none of it changes, to draw it again as a single texture
+enum class layer_cache
+{
+    automatic, // Layers that draw more than one item
+    enabled,
+    disabled
+};
+
 struct image_transform final
 {
     double opacity    = 1.0;
@@ -97,11 +106,12 @@ struct image_transform final
     core::levels          levels;
     core::chroma          chroma;
 
-    bool             is_key      = false;
-    bool             invert      = false;
-    bool             is_mix      = false;
-    core::blend_mode blend_mode  = blend_mode::normal;
-    int              layer_depth = 0;
+    bool              is_key      = false;
+    bool              invert      = false;
+    bool              is_mix      = false;
+    core::blend_mode  blend_mode  = blend_mode::normal;
+    int               layer_depth = 0;
+    core::layer_cache layer_cache = layer_cache::automatic;
 
     static image_transform tween(double                 time,
                                  const image_transform& source,
@@ -117,6 +127,14 @@ struct audio_transform final
 {
     double volume = 1.0;
 
+    // Output channel n plays source channel channel_map[n], or nothing where that is -1 or past the end of the map.
+    // Empty plays each source channel on the output channel of the same index.
+    std::vector<int> channel_map;
+
+    // Tells the streams below apart from the same streams mixed elsewhere in the channel, such as the sources of a
+    // route, which the audio mixer would otherwise take for one stream. See combine_tags.
+    const void* tag_namespace = nullptr;
+
     audio_transform& operator*=(const audio_transform& other);
     audio_transform  operator*(const audio_transform& other) const;
 
@@ -130,6 +148,9 @@ struct audio_transform final
 bool operator==(const audio_transform& lhs, const audio_transform& rhs);
 bool operator!=(const audio_transform& lhs, const audio_transform& rhs);
 
+// The tag of a stream within a tag namespace, the same for the same pair and distinct from the tag itself
+const void* combine_tags(const void* tag_namespace, const void* tag);
+
 struct frame_transform final
 {
   public:
@@ -162,6 +183,7 @@ class tweened_transform
     tweened_transform(const frame_transform& source, const frame_transform& dest, int duration, tweener tween);
 
     const frame_transform& dest() const;
+    bool                   is_animating() const;
 
     frame_transform fetch();
     void            tick(int num);
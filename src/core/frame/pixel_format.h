@@ -42,6 +42,8 @@ enum class pixel_format
     uyvy,
     gbrp,  // planar
     gbrap, // planar
+    bc1,   // block compressed, see is_block_compressed
+    bc3,   // block compressed, see is_block_compressed
     count,
     invalid,
 };
@@ -53,6 +55,15 @@ enum class color_space
     bt2020,
 };
 
+// The transfer function the values of an image are encoded with. Channels that mix in linear light decode frames with
+// it, and encode their output with their own.
+enum class color_transfer
+{
+    bt709, // Gamma 2.4, as displayed (BT.1886)
+    pq,    // SMPTE ST 2084
+    hlg,   // ARIB STD-B67
+};
+
 struct pixel_format_desc final
 {
     struct plane
@@ -85,10 +96,98 @@ struct pixel_format_desc final
     {
     }
 
-    pixel_format       format            = pixel_format::invalid;
-    bool               is_straight_alpha = false;
-    std::vector<plane> planes;
-    core::color_space  color_space = core::color_space::bt709;
+    pixel_format         format            = pixel_format::invalid;
+    bool                 is_straight_alpha = false;
+    std::vector<plane>   planes;
+    core::color_space    color_space = core::color_space::bt709;
+    core::color_transfer transfer    = core::color_transfer::bt709;
+};
+
+// Formats of one plane of 4x4 pixel blocks that the GPU samples without decompressing them: BC1 blocks of 8 bytes for
+// opaque images and BC3 blocks of 16 bytes with alpha, with components as those of bgra. The blocks of the image are
+// followed by those of each smaller mip level, down to 1x1, see block_compressed_size.
+inline bool is_block_compressed(pixel_format format)
+{
+    return format == pixel_format::bc1 || format == pixel_format::bc3;
+}
+
+inline int block_compressed_size(pixel_format format, int width, int height)
+{
+    const auto block_bytes = format == pixel_format::bc1 ? 8 : 16;
+
+    auto size = 0;
+    while (true) {
+        size += (width + 3) / 4 * ((height + 3) / 4) * block_bytes;
+        if (width == 1 && height == 1) {
+            return size;
+        }
+        width  = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+}
+
+// Layouts the mixer can pack the channel image into on the GPU, so that consumers read them back directly instead of
+// converting on the CPU. Rows are made of little endian 32-bit words.
+enum class output_packing
+{
+    rgb10, // 10-bit R << 22 | G << 12 | B << 2, rows padded to 64 pixels (bmdFormat10BitRGBXLE)
+    uyvy,  // 8-bit 4:2:2 as Cb Y0 Cr Y1
+    v210,  // 10-bit 4:2:2, 6 pixels in 16 bytes, rows padded to 48 pixels
+};
+
+inline int packed_row_bytes(output_packing packing, int width)
+{
+    switch (packing) {
+        case output_packing::rgb10:
+            return (width + 63) / 64 * 256;
+        case output_packing::uyvy:
+            return (width + 1) / 2 * 4;
+        case output_packing::v210:
+            return (width + 47) / 48 * 128;
+    }
+    return 0;
+}
+
+// A size other than that of the channel that the mixer scales its image to on the GPU, for consumers of a video format
+// of that size. The scaled image has the layout and depth of the channel image.
+struct output_size final
+{
+    int width  = 0;
+    int height = 0;
+};
+
+inline bool operator==(const output_size& lhs, const output_size& rhs)
+{
+    return lhs.width == rhs.width && lhs.height == rhs.height;
+}
+inline bool operator!=(const output_size& lhs, const output_size& rhs) { return !(lhs == rhs); }
+
+// What the mixer reads back for the consumers of a channel
+struct output_request final
+{
+    bool                        image = true; // Whether any consumer reads the mixed image itself
+    std::vector<output_packing> packings;
+    core::color_space           color_space = core::color_space::bt709; // Matrix of the YCbCr packings
+
+    // Whether only the areas that changed since the previous render are drawn, over the previous output
+    bool damage_tracking = false;
+
+    // Whether the mixed image is kept on the GPU for other channels and consumers to draw, see image_mixer::rendered
+    bool texture = false;
+
+    // Whether every consumer only shows the lines of its field of each frame, see frame_consumer::shows_fields
+    bool fields = false;
+
+    // The fraction of the width and height of the channel that progressive frames are drawn at, before they are
+    // scaled up to it
+    double scale = 1.0;
+
+    // Sizes the mixed image is also scaled to, once each, see frame_consumer::sizes
+    std::vector<output_size> sizes;
+
+    // Whether a consumer is clocked by its hardware, see frame_consumer::has_synchronization_clock. The readbacks of
+    // such channels go ahead of those of others on the same device.
+    bool clocked = false;
 };
 
 }} // namespace caspar::core
@@ -35,12 +35,14 @@ class image_mixer;
 struct video_format_desc;
 class frame_factory;
 class frame_producer;
+struct frame_budget;
 class frame_consumer;
 class draw_frame;
 class mutable_frame;
 class const_frame;
 class video_channel;
 struct pixel_format_desc;
+struct output_request;
 struct frame_transform;
 struct frame_producer_dependencies;
 struct module_dependencies;
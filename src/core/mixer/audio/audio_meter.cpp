@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "audio_meter.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace core {
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+// Floor of the reported levels, which would otherwise be minus infinity for silence
+double to_db(double level) { return std::max(-144.0, 20.0 * std::log10(level)); }
+
+double to_lufs(double energy) { return std::max(-144.0, -0.691 + 10.0 * std::log10(energy)); }
+
+struct biquad
+{
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    double z1 = 0.0, z2 = 0.0;
+
+    double operator()(double x)
+    {
+        auto y = b0 * x + z1;
+        z1     = b1 * x - a1 * y + z2;
+        z2     = b2 * x - a2 * y;
+        return y;
+    }
+};
+
+// The K-weighting of ITU-R BS.1770, a high shelf followed by a high pass, for any sample rate
+std::array<biquad, 2> k_weighting(int sample_rate)
+{
+    std::array<biquad, 2> filters;
+
+    {
+        const double f0 = 1681.974450955533;
+        const double g  = 3.999843853973347;
+        const double q  = 0.7071752369554196;
+        const double k  = std::tan(pi * f0 / sample_rate);
+        const double vh = std::pow(10.0, g / 20.0);
+        const double vb = std::pow(vh, 0.4996667741545416);
+        const double a0 = 1.0 + k / q + k * k;
+
+        filters[0].b0 = (vh + vb * k / q + k * k) / a0;
+        filters[0].b1 = 2.0 * (k * k - vh) / a0;
+        filters[0].b2 = (vh - vb * k / q + k * k) / a0;
+        filters[0].a1 = 2.0 * (k * k - 1.0) / a0;
+        filters[0].a2 = (1.0 - k / q + k * k) / a0;
+    }
+    {
+        const double f0 = 38.13547087602444;
+        const double q  = 0.5003270373238773;
+        const double k  = std::tan(pi * f0 / sample_rate);
+        const double a0 = 1.0 + k / q + k * k;
+
+        filters[1].b0 = 1.0;
+        filters[1].b1 = -2.0;
+        filters[1].b2 = 1.0;
+        filters[1].a1 = 2.0 * (k * k - 1.0) / a0;
+        filters[1].a2 = (1.0 - k / q + k * k) / a0;
+    }
+
+    return filters;
+}
+
+struct levels
+{
+    std::vector<double> peak;
+    std::vector<double> sum_squares;
+    size_t              frames = 0;
+
+    void add(const int32_t* samples, size_t count, int channels, double volume)
+    {
+        if (peak.size() != static_cast<size_t>(channels)) {
+            peak.assign(channels, 0.0);
+            sum_squares.assign(channels, 0.0);
+        }
+
+        const auto scale = volume / 2147483648.0;
+        for (size_t n = 0; n + channels <= count; n += channels) {
+            for (int ch = 0; ch < channels; ++ch) {
+                auto sample = samples[n + ch] * scale;
+                peak[ch]    = std::max(peak[ch], std::abs(sample));
+                sum_squares[ch] += sample * sample;
+            }
+        }
+        frames += count / channels;
+    }
+
+    monitor::state state() const
+    {
+        monitor::state     state;
+        std::vector<float> peak_db;
+        std::vector<float> rms_db;
+        for (size_t ch = 0; ch < peak.size(); ++ch) {
+            peak_db.push_back(static_cast<float>(to_db(peak[ch])));
+            rms_db.push_back(static_cast<float>(to_db(frames > 0 ? std::sqrt(sum_squares[ch] / frames) : 0.0)));
+        }
+        state["peak"] = peak_db;
+        state["rms"]  = rms_db;
+        return state;
+    }
+};
+
+// EBU R128 loudness over the first two channels, the main program pair, each with a weight of one
+class loudness_meter
+{
+    // Loudness blocks are 400 ms long and start every 100 ms, so they are built from 100 ms sub blocks
+    static constexpr size_t momentary_blocks  = 4;
+    static constexpr size_t short_term_blocks = 30;
+
+    // Gated blocks are counted in bins of 0.1 LU from the absolute gate at -70 LUFS up to +5 LUFS, which keeps the
+    // integrated loudness of arbitrarily long programs in fixed memory
+    static constexpr double gate    = -70.0;
+    static constexpr int    bins    = 750;
+    static constexpr double bin_lus = 0.1;
+
+    std::vector<std::array<biquad, 2>> filters_;
+    size_t                             sub_block_size_   = 0;
+    size_t                             sub_block_fill_   = 0;
+    double                             sub_block_energy_ = 0.0;
+    std::deque<double>                 sub_blocks_;
+    std::vector<double>                bin_energy_ = std::vector<double>(bins, 0.0);
+    std::vector<uint64_t>              bin_count_  = std::vector<uint64_t>(bins, 0);
+
+  public:
+    loudness_meter(int sample_rate, int channels)
+        : filters_(std::min(channels, 2), k_weighting(sample_rate))
+        , sub_block_size_(std::max(1, sample_rate / 10))
+    {
+    }
+
+    void add(const int32_t* samples, size_t count, int channels)
+    {
+        const auto metered = filters_.size();
+        for (size_t n = 0; n + channels <= count; n += channels) {
+            for (size_t ch = 0; ch < metered; ++ch) {
+                auto sample = filters_[ch][1](filters_[ch][0](samples[n + ch] / 2147483648.0));
+                sub_block_energy_ += sample * sample;
+            }
+
+            if (++sub_block_fill_ == sub_block_size_) {
+                sub_blocks_.push_back(sub_block_energy_ / sub_block_size_);
+                if (sub_blocks_.size() > short_term_blocks) {
+                    sub_blocks_.pop_front();
+                }
+                sub_block_fill_   = 0;
+                sub_block_energy_ = 0.0;
+
+                if (sub_blocks_.size() >= momentary_blocks) {
+                    add_gating_block(energy(momentary_blocks));
+                }
+            }
+        }
+    }
+
+    double momentary() const
+    {
+        return sub_blocks_.size() >= momentary_blocks ? to_lufs(energy(momentary_blocks)) : gate;
+    }
+
+    double short_term() const
+    {
+        return sub_blocks_.size() >= short_term_blocks ? to_lufs(energy(short_term_blocks)) : gate;
+    }
+
+    double integrated() const
+    {
+        double   energy = 0.0;
+        uint64_t count  = 0;
+        for (int n = 0; n < bins; ++n) {
+            energy += bin_energy_[n];
+            count += bin_count_[n];
+        }
+        if (count == 0) {
+            return gate;
+        }
+
+        // The relative gate is 10 LU below the loudness of the blocks above the absolute gate
+        const auto relative_gate = to_lufs(energy / count) - 10.0;
+        const auto first_bin     = std::clamp(static_cast<int>(std::ceil((relative_gate - gate) / bin_lus)), 0, bins);
+
+        energy = 0.0;
+        count  = 0;
+        for (int n = first_bin; n < bins; ++n) {
+            energy += bin_energy_[n];
+            count += bin_count_[n];
+        }
+        return count > 0 ? to_lufs(energy / count) : gate;
+    }
+
+  private:
+    // The mean energy of the last blocks sub blocks
+    double energy(size_t blocks) const
+    {
+        double sum = 0.0;
+        for (auto it = sub_blocks_.end() - blocks; it != sub_blocks_.end(); ++it) {
+            sum += *it;
+        }
+        return sum / blocks;
+    }
+
+    void add_gating_block(double energy)
+    {
+        auto loudness = to_lufs(energy);
+        if (loudness < gate) {
+            return;
+        }
+        auto bin = std::min(bins - 1, static_cast<int>((loudness - gate) / bin_lus));
+        bin_energy_[bin] += energy;
+        bin_count_[bin] += 1;
+    }
+};
+
+} // namespace
+
+struct audio_meter::impl
+{
+    struct block
+    {
+        int                      sample_rate;
+        int                      channels;
+        array<const int32_t>     mix;
+        std::vector<layer_audio> layers;
+    };
+
+    const double rate_;
+
+    tbb::concurrent_bounded_queue<std::shared_ptr<block>> queue_;
+
+    // Only used from the worker
+    int                             sample_rate_ = 0;
+    int                             channels_    = 0;
+    std::unique_ptr<loudness_meter> loudness_;
+    levels                          mix_levels_;
+    std::map<int, levels>           layer_levels_;
+    size_t                          frames_since_publish_ = 0;
+
+    mutable std::mutex mutex_;
+    monitor::state     state_;
+
+    std::thread thread_;
+
+    explicit impl(double rate)
+        : rate_(rate)
+    {
+        // About a second of frames at the usual rates, beyond which the worker is not keeping up anyway
+        queue_.set_capacity(64);
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~impl()
+    {
+        queue_.push(nullptr);
+        thread_.join();
+    }
+
+    void push(int sample_rate, int channels, array<const int32_t> mix, std::vector<layer_audio> layers)
+    {
+        queue_.try_push(std::make_shared<block>(block{sample_rate, channels, std::move(mix), std::move(layers)}));
+    }
+
+    monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+
+    void run()
+    {
+        set_thread_name(L"Audio Meter");
+
+        while (true) {
+            std::shared_ptr<block> block;
+            queue_.pop(block);
+            if (!block) {
+                break;
+            }
+
+            try {
+                measure(*block);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void measure(const block& block)
+    {
+        if (block.channels <= 0 || block.sample_rate <= 0) {
+            return;
+        }
+
+        if (block.sample_rate != sample_rate_ || block.channels != channels_) {
+            sample_rate_ = block.sample_rate;
+            channels_    = block.channels;
+            loudness_    = std::make_unique<loudness_meter>(sample_rate_, channels_);
+            mix_levels_  = levels{};
+            layer_levels_.clear();
+            frames_since_publish_ = 0;
+        }
+
+        loudness_->add(block.mix.data(), block.mix.size(), channels_);
+        mix_levels_.add(block.mix.data(), block.mix.size(), channels_, 1.0);
+        for (auto& layer : block.layers) {
+            layer_levels_[layer.layer].add(layer.samples.data(), layer.samples.size(), layer.channels, layer.volume);
+        }
+
+        frames_since_publish_ += block.mix.size() / channels_;
+        if (frames_since_publish_ < sample_rate_ / rate_) {
+            return;
+        }
+
+        // Layers without audio since the last publish are left out, so removed layers are dropped from the state
+        monitor::state state;
+        state["mix"] = mix_levels_.state();
+        for (auto& layer : layer_levels_) {
+            state["layer"][layer.first] = layer.second.state();
+        }
+        state["loudness"]["momentary"]  = static_cast<float>(loudness_->momentary());
+        state["loudness"]["short-term"] = static_cast<float>(loudness_->short_term());
+        state["loudness"]["integrated"] = static_cast<float>(loudness_->integrated());
+
+        mix_levels_ = levels{};
+        layer_levels_.clear();
+        frames_since_publish_ = 0;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        state_ = std::move(state);
+    }
+};
+
+audio_meter::audio_meter(double rate)
+    : impl_(new impl(rate))
+{
+}
+audio_meter::~audio_meter() {}
+void audio_meter::push(int sample_rate, int channels, array<const int32_t> mix, std::vector<layer_audio> layers)
+{
+    impl_->push(sample_rate, channels, std::move(mix), std::move(layers));
+}
+monitor::state audio_meter::state() const { return impl_->state(); }
+
+}} // namespace caspar::core
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/array.h>
+#include <common/memory.h>
+
+#include <core/monitor/monitor.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// Measures the peak and RMS levels of each layer and of the mix, and the EBU R128 loudness of the mix, on a worker
+// thread. The channel thread only queues references to the buffers it already has, and the results are published to
+// the state rate times per second.
+class audio_meter final
+{
+    audio_meter(const audio_meter&);
+    audio_meter& operator=(const audio_meter&);
+
+  public:
+    struct layer_audio
+    {
+        int                  layer;
+        double               volume;
+        array<const int32_t> samples;
+        int                  channels; // Interleaved in samples
+    };
+
+    explicit audio_meter(double rate);
+    ~audio_meter();
+
+    // Never blocks. Frames are dropped when the worker falls behind, which leaves a gap in the measurements.
+    void push(int sample_rate, int channels, array<const int32_t> mix, std::vector<layer_audio> layers);
+
+    // The levels in dBFS per channel under layer/<index>/peak and rms and under mix/peak and rms, and the loudness of
+    // the mix in LUFS under loudness/momentary, short-term and integrated
+    monitor::state state() const;
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
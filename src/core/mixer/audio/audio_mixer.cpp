@@ -22,6 +22,8 @@
 #include "../../StdAfx.h"
 
 #include "audio_mixer.h"
+#include "audio_meter.h"
+#include "audio_resampler.h"
 
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
@@ -32,10 +34,14 @@
 #include <boost/container/flat_map.hpp>
 #include <boost/range/algorithm.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
 #include <stack>
 #include <vector>
-#include <map>
 
 namespace caspar { namespace core {
 
@@ -46,31 +52,91 @@ struct audio_item
     const void*          tag = nullptr;
     audio_transform      transform;
     array<const int32_t> samples;
+    int                  channels = 0; // Interleaved in samples
+    int                  layer    = 0;
 };
 
-using audio_buffer_ps = std::vector<double>;
+// Volumes are applied in fixed point with this many fractional bits, which keeps unity gain bit exact and lets the
+// accumulation vectorise as widening 32 x 32 bit multiplies
+constexpr int volume_bits = 16;
+
+// Gains above this are clamped, which keeps hundreds of full scale items from overflowing the accumulator
+constexpr double max_volume = 256.0;
+
+// The samples of a stream left over after a frame with variable cadence, mixed in first by the next frame, or the
+// resampler of a stream that does not keep to the cadence of the channel
+struct audio_stream
+{
+    std::vector<int32_t>             carry;
+    std::vector<int32_t>             next_carry;
+    std::unique_ptr<audio_resampler> resampler;
+    array<const int32_t>             last; // Held so that its buffer is not reused while compared against
+    bool                             seen = false;
+};
+
+// Lays out frames of source_channels interleaved channels as channels interleaved ones, routed by channel_map as
+// described by audio_transform
+inline void remap(const int32_t*          src,
+                  size_t                  frames,
+                  int                     source_channels,
+                  const std::vector<int>& channel_map,
+                  int32_t*                dst,
+                  int                     channels)
+{
+    for (int ch = 0; ch < channels; ++ch) {
+        auto source = channel_map.empty() ? ch : ch < static_cast<int>(channel_map.size()) ? channel_map[ch] : -1;
+        if (source < 0 || source >= source_channels) {
+            for (size_t n = 0; n < frames; ++n) {
+                dst[n * channels + ch] = 0;
+            }
+        } else {
+            for (size_t n = 0; n < frames; ++n) {
+                dst[n * channels + ch] = src[n * source_channels + source];
+            }
+        }
+    }
+}
+
+// acc[n] += src[n] * volume over count samples
+inline void accumulate(int64_t* acc, const int32_t* src, size_t count, int32_t volume)
+{
+    for (size_t n = 0; n < count; ++n) {
+        acc[n] += static_cast<int64_t>(src[n]) * volume;
+    }
+}
 
 struct audio_mixer::impl
 {
-    monitor::state                              state_;
-    std::stack<core::audio_transform>           transform_stack_;
-    std::vector<audio_item>                     items_;
-    std::map<const void*, std::vector<int32_t>> audio_streams_;
-    video_format_desc                           format_desc_;
-    std::atomic<float>                          master_volume_{1.0f};
-    spl::shared_ptr<diagnostics::graph>         graph_;
-    size_t                                      max_expected_cadence_samples_{0};
-    size_t                                      max_buffer_size_{0};
-    bool                                        has_variable_cadence_{false};
-    std::vector<int32_t>                        silence_buffer_;
-    int                                         channels_{0};
-
-    impl(spl::shared_ptr<diagnostics::graph> graph)
+    monitor::state                                     state_;
+    std::stack<core::audio_transform>                  transform_stack_;
+    std::vector<audio_item>                            items_;
+    flat_map<const void*, audio_stream>                audio_streams_;
+    video_format_desc                                  format_desc_;
+    std::atomic<float>                                 master_volume_{1.0f};
+    spl::shared_ptr<diagnostics::graph>                graph_;
+    size_t                                             max_expected_cadence_samples_{0};
+    size_t                                             max_buffer_size_{0};
+    bool                                               has_variable_cadence_{false};
+    std::vector<int32_t>                               silence_buffer_;
+    int                                                channels_{0};
+    std::vector<int64_t>                               mixed_;
+    std::vector<int32_t>                               remapped_;
+    std::vector<int32_t>                               resampled_;
+    std::vector<int32_t>                               peaks_;
+    std::vector<std::shared_ptr<std::vector<int32_t>>> results_; // Reused once no output references them
+    std::unique_ptr<audio_meter>                       meter_;
+    int                                                layer_ = 0;
+
+    impl(spl::shared_ptr<diagnostics::graph> graph, double meter_rate)
         : graph_(std::move(graph))
     {
+        if (meter_rate > 0.0) {
+            meter_ = std::make_unique<audio_meter>(meter_rate);
+        }
         graph_->set_color("volume", diagnostics::color(1.0f, 0.8f, 0.1f));
         graph_->set_color("audio-clipping", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("audio-buffer-overflow", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("audio-resampler-xrun", diagnostics::color(0.6f, 0.3f, 0.6f));
         transform_stack_.push(core::audio_transform());
     }
 
@@ -87,15 +153,42 @@ struct audio_mixer::impl
         if (transform_stack_.top().volume < 0.002 || !frame.audio_data())
             return;
 
-        items_.push_back(std::move(audio_item{frame.stream_tag(), transform_stack_.top(), frame.audio_data()}));
+        // Streams under a tag namespace, e.g. the sources of a route, are told apart from the same streams mixed
+        // elsewhere in the channel
+        auto tag = frame.stream_tag();
+        if (transform_stack_.top().tag_namespace) {
+            tag = combine_tags(transform_stack_.top().tag_namespace, tag);
+        }
+
+        items_.push_back(std::move(
+            audio_item{tag, transform_stack_.top(), frame.audio_data(), frame.audio_channels(), layer_}));
     }
 
     void pop() { transform_stack_.pop(); }
 
+    void set_layer(int layer) { layer_ = layer; }
+
     void set_master_volume(float volume) { master_volume_ = volume; }
 
     float get_master_volume() { return master_volume_; }
 
+    // A result buffer no longer referenced by any earlier output, so that mixing does not allocate once warmed up
+    std::shared_ptr<std::vector<int32_t>> acquire_result(size_t size)
+    {
+        for (auto& result : results_) {
+            if (result.use_count() == 1) {
+                result->resize(size);
+                return result;
+            }
+        }
+
+        auto result = std::make_shared<std::vector<int32_t>>(size);
+        if (results_.size() < 16) {
+            results_.push_back(result);
+        }
+        return result;
+    }
+
     array<const int32_t> mix(const video_format_desc& format_desc, int nb_samples)
     {
         if (format_desc_ != format_desc) {
@@ -127,25 +220,66 @@ struct audio_mixer::impl
         }
 
         auto items    = std::move(items_);
-        auto result   = std::vector<int32_t>(size_t(nb_samples) * channels_, 0);
+        auto dst_size = size_t(nb_samples) * channels_;
+
+        mixed_.assign(dst_size, 0);
 
-        auto mixed = std::vector<double>(size_t(nb_samples) * channels_, 0.0f);
+        auto master_volume = master_volume_.load();
 
-        std::map<const void*, std::vector<int32_t>> next_audio_streams;
-        
         for (auto& item : items) {
             auto ptr       = item.samples.data();
             auto item_size = item.samples.size();
-            auto dst_size  = result.size();
+            auto source    = item.samples;
+
+            // Narrower or routed sources are laid out at the channel width here rather than by their producers
+            auto item_channels = item.channels > 0 ? item.channels : channels_;
+            if (item_channels != channels_ || !item.transform.channel_map.empty()) {
+                auto frames = item_size / item_channels;
+                remapped_.resize(frames * channels_);
+                remap(ptr, frames, item_channels, item.transform.channel_map, remapped_.data(), channels_);
+                ptr       = remapped_.data();
+                item_size = remapped_.size();
+            }
 
-            size_t last_size = 0;
-            const int32_t* last_ptr = nullptr;
-            
+            const auto volume = static_cast<int32_t>(
+                std::llround(std::min(item.transform.volume * master_volume, max_volume) * (1 << volume_bits)));
+
+            size_t         last_size = 0;
+            const int32_t* last_ptr  = nullptr;
+            audio_stream*  stream    = nullptr;
+
+            auto audio_stream = audio_streams_.find(item.tag);
+            if (audio_stream != audio_streams_.end()) {
+                stream = &audio_stream->second;
+
+                // A stream that repeats a buffer or brings another number of samples than the channel asks for, such
+                // as a route from a channel at another frame rate or a source on its own clock, is resampled from
+                // then on rather than padded by holding its last sample
+                auto repeated = source.data() == stream->last.data();
+                if (!stream->resampler && (repeated || item_size != dst_size)) {
+                    stream->resampler = std::make_unique<audio_resampler>(channels_);
+                    stream->resampler->push(stream->carry.data(), stream->carry.size() / channels_);
+                }
+
+                if (stream->resampler) {
+                    if (!repeated) {
+                        stream->resampler->push(ptr, item_size / channels_);
+                    }
+                    resampled_.resize(dst_size);
+                    if (!stream->resampler->pull(resampled_.data(), nb_samples)) {
+                        graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-resampler-xrun");
+                    }
+                    accumulate(mixed_.data(), resampled_.data(), dst_size, volume);
+
+                    stream->last = std::move(source);
+                    stream->seen = true;
+                    continue;
+                }
+            }
             if (has_variable_cadence_) {
-                auto audio_stream = audio_streams_.find(item.tag);
-                if (audio_stream != audio_streams_.end()) {
-                    last_size = audio_stream->second.size();
-                    last_ptr = audio_stream->second.data();
+                if (stream) {
+                    last_size = stream->carry.size();
+                    last_ptr  = stream->carry.data();
                 } else if (nullptr != item.tag) {
                     // Insert a sample of silence at startup
                     // Covers the startup case where there may be a cadence mismatch
@@ -155,24 +289,37 @@ struct audio_mixer::impl
                 }
             }
 
-            for (auto n = 0; n < dst_size; ++n) {
-                if (last_ptr && n < last_size) {
-                    mixed[n] = static_cast<double>(last_ptr[n]) * item.transform.volume + mixed[n];
-                } else if (n < last_size + item_size) {
-                    mixed[n] = static_cast<double>(ptr[n - last_size]) * item.transform.volume + mixed[n];
-                } else {
-                    // If we run out of samples, hold the last sample value per channel
+            // The carry over from the last frame, then the frame's own samples, then its last sample of each channel
+            // held for as long as it falls short
+            auto carry_size = last_ptr ? std::min(last_size, dst_size) : 0;
+            auto own_end    = std::min(last_size + item_size, dst_size);
+
+            accumulate(mixed_.data(), last_ptr, carry_size, volume);
+            if (own_end > last_size) {
+                accumulate(mixed_.data() + last_size, ptr, own_end - last_size, volume);
+            }
+            if (item_size > 0) {
+                for (auto n = std::max(own_end, carry_size); n < dst_size; ++n) {
                     int channel_pos = n % channels_;
                     int offset = int(item_size) - (channels_ - channel_pos);
                     if (offset < 0) {
                         offset = channel_pos;
                     }
-                    mixed[n] = static_cast<double>(ptr[offset]) * item.transform.volume + mixed[n];
+                    mixed_[n] += static_cast<int64_t>(ptr[offset]) * volume;
                 }
             }
 
-            if (has_variable_cadence_ && item.tag) {
-                if (item_size + last_size > dst_size) {
+            if (item.tag) {
+                if (!stream) {
+                    stream = &audio_streams_[item.tag];
+                }
+                stream->seen = true;
+                stream->last = std::move(source);
+
+                auto& next_carry = stream->next_carry;
+                next_carry.clear();
+
+                if (has_variable_cadence_ && item_size + last_size > dst_size) {
                     // Calculate remaining samples after mixing the current frame
                     auto remaining_samples = item_size + last_size - dst_size;
                     
@@ -184,57 +331,81 @@ struct audio_mixer::impl
                         remaining_samples = (max_buffer_size_ < item_size) ? max_buffer_size_ : item_size;
                     }
                     
-                    std::vector<int32_t> buf(remaining_samples);
                     // Calculate the correct offset in the source buffer
                     size_t offset = (dst_size > last_size) ? (dst_size - last_size) : 0;
                     if (offset < item_size) {
-                        std::memcpy(buf.data(), ptr + offset, remaining_samples * sizeof(int32_t));
-                        next_audio_streams[item.tag] = std::move(buf);
-                    } else {
-                        next_audio_streams[item.tag] = std::vector<int32_t>();
+                        next_carry.assign(ptr + offset, ptr + offset + remaining_samples);
                     }
-                } else {
-                    next_audio_streams[item.tag] = std::vector<int32_t>();
                 }
             }
         }
 
-        audio_streams_ = std::move(next_audio_streams);
-
-        auto master_volume = master_volume_.load();
-        for (auto n = 0; n < mixed.size(); ++n) {
-            auto sample = mixed[n] * master_volume;
-            if (sample > std::numeric_limits<int32_t>::max()) {
-                result[n] = std::numeric_limits<int32_t>::max();
-            } else if (sample < std::numeric_limits<int32_t>::min()) {
-                result[n] = std::numeric_limits<int32_t>::min();
+        // Streams that were not mixed this frame are dropped, the others move on to their new carry over, keeping
+        // the buffers for reuse
+        for (auto it = audio_streams_.begin(); it != audio_streams_.end();) {
+            if (!it->second.seen) {
+                it = audio_streams_.erase(it);
             } else {
-                result[n] = static_cast<int32_t>(sample);
+                std::swap(it->second.carry, it->second.next_carry);
+                it->second.seen = false;
+                ++it;
             }
         }
 
-        auto max = std::vector<int32_t>(channels_, std::numeric_limits<int32_t>::min());
-        for (size_t n = 0; n < result.size(); n += channels_) {
+        auto result = acquire_result(dst_size);
+        auto dst    = result->data();
+
+        const int64_t min_sample = static_cast<int64_t>(std::numeric_limits<int32_t>::min()) << volume_bits;
+        const int64_t max_sample = static_cast<int64_t>(std::numeric_limits<int32_t>::max()) << volume_bits;
+        for (size_t n = 0; n < dst_size; ++n) {
+            dst[n] = static_cast<int32_t>(std::clamp(mixed_[n], min_sample, max_sample) >> volume_bits);
+        }
+
+        peaks_.assign(channels_, 0);
+        for (size_t n = 0; n < dst_size; n += channels_) {
             for (int ch = 0; ch < channels_; ++ch) {
-                max[ch] = std::max(max[ch], std::abs(result[n + ch]));
+                // Widened, as the magnitude of the most negative sample does not fit
+                auto magnitude = std::min<int64_t>(std::abs(static_cast<int64_t>(dst[n + ch])),
+                                                   std::numeric_limits<int32_t>::max());
+                peaks_[ch]     = std::max(peaks_[ch], static_cast<int32_t>(magnitude));
             }
         }
 
-        if (boost::range::count_if(max, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
+        if (boost::range::count_if(peaks_, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-clipping");
         }
 
-        state_["volume"] = std::move(max);
+        // Rebuilt every frame, so that the levels of layers that are gone do not linger
+        monitor::state state;
+        state["volume"] = peaks_;
+
+        array<const int32_t> output(dst, dst_size, std::move(result));
+
+        if (meter_) {
+            std::vector<audio_meter::layer_audio> layers;
+            for (auto& item : items) {
+                layers.push_back(audio_meter::layer_audio{item.layer,
+                                                          item.transform.volume * master_volume,
+                                                          item.samples,
+                                                          item.channels > 0 ? item.channels : channels_});
+            }
+            meter_->push(format_desc.audio_sample_rate, channels_, output, std::move(layers));
+            state["meter"] = meter_->state();
+        }
+
+        state_ = std::move(state);
 
         graph_->set_value("volume",
-                          static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
+                          peaks_.empty() ? 0.0
+                                         : static_cast<double>(*boost::max_element(peaks_)) /
+                                               std::numeric_limits<int32_t>::max());
 
-        return std::move(result);
+        return output;
     }
 };
 
-audio_mixer::audio_mixer(spl::shared_ptr<diagnostics::graph> graph)
-    : impl_(new impl(std::move(graph)))
+audio_mixer::audio_mixer(spl::shared_ptr<diagnostics::graph> graph, double meter_rate)
+    : impl_(new impl(std::move(graph), meter_rate))
 {
 }
 void                 audio_mixer::push(const frame_transform& transform) { impl_->push(transform); }
@@ -247,5 +418,6 @@ array<const int32_t> audio_mixer::operator()(const video_format_desc& format_des
     return impl_->mix(format_desc, nb_samples);
 }
 core::monitor::state audio_mixer::state() const { return impl_->state_; }
+void                 audio_mixer::set_layer(int layer) { impl_->set_layer(layer); }
 
 }} // namespace caspar::core
@@ -42,13 +42,18 @@ class audio_mixer final : public frame_visitor
     audio_mixer& operator=(const audio_mixer&);
 
   public:
-    audio_mixer(spl::shared_ptr<::caspar::diagnostics::graph> graph);
+    // meter_rate is how many times per second the levels of each layer and the loudness of the mix are published to
+    // the state, 0 disables metering
+    explicit audio_mixer(spl::shared_ptr<::caspar::diagnostics::graph> graph, double meter_rate = 0.0);
 
     array<const int32_t> operator()(const struct video_format_desc& format_desc, int nb_samples);
     void                 set_master_volume(float volume);
     float                get_master_volume();
     core::monitor::state state() const;
 
+    // The stage layer that the frames visited next belong to, which their levels are published under
+    void set_layer(int layer);
+
     void push(const struct frame_transform& transform) override;
     void visit(const class const_frame& frame) override;
     void pop() override;
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "audio_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+// Windowed sinc taps on each side of the read position, and the fractional positions they are tabulated at
+constexpr int half_taps = 16;
+constexpr int taps      = 2 * half_taps;
+constexpr int phases    = 128;
+
+// How far the read rate may stray from the input rate, which bounds the pitch error while the queue is steered back
+constexpr double max_deviation = 0.005;
+constexpr double gain          = 0.005;
+
+// Weight of each pull in the average of the queue length, which evens out bursty input
+constexpr double smoothing = 0.05;
+
+// Rows of taps, row p interpolating at p / phases past a sample. Row 0 is a unit impulse, so that an input on the
+// same clock as the channel passes through unchanged.
+std::vector<float> make_table()
+{
+    std::vector<float> table((phases + 1) * taps);
+    for (int p = 0; p <= phases; ++p) {
+        auto   row = table.data() + p * taps;
+        double sum = 0.0;
+        for (int k = 0; k < taps; ++k) {
+            auto x    = (k - half_taps + 1) - static_cast<double>(p) / phases;
+            auto sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+            auto w    = x / half_taps;
+
+            // Blackman-Harris
+            auto window = 0.35875 + 0.48829 * std::cos(pi * w) + 0.14128 * std::cos(2.0 * pi * w) +
+                          0.01168 * std::cos(3.0 * pi * w);
+
+            row[k] = static_cast<float>(sinc * window);
+            sum += row[k];
+        }
+        for (int k = 0; k < taps; ++k) {
+            row[k] = static_cast<float>(row[k] / sum);
+        }
+    }
+    return table;
+}
+
+} // namespace
+
+struct audio_resampler::impl
+{
+    const int          channels_;
+    std::vector<float> table_  = make_table();
+    std::vector<float> coeffs_ = std::vector<float>(taps);
+    std::vector<float> input_; // Interleaved, from the oldest sample the filter still reaches back to
+    std::vector<float> acc_;
+    double             pos_      = half_taps - 1; // Read position in frames into input_
+    double             fill_     = 0.0;
+    size_t             max_push_ = 0;
+    size_t             max_pull_ = 0;
+    bool               running_  = false;
+
+    explicit impl(int channels)
+        : channels_(channels)
+        , input_((half_taps - 1) * channels, 0.0f)
+        , acc_(channels)
+    {
+    }
+
+    size_t frames() const { return input_.size() / channels_; }
+
+    // Frames queued past the read position
+    double buffered() const { return static_cast<double>(frames()) - pos_; }
+
+    void push(const int32_t* samples, size_t frames)
+    {
+        max_push_ = std::max(max_push_, frames);
+
+        auto offset = input_.size();
+        input_.resize(offset + frames * channels_);
+        for (size_t n = 0; n < frames * channels_; ++n) {
+            input_[offset + n] = static_cast<float>(samples[n]);
+        }
+    }
+
+    bool pull(int32_t* samples, size_t frames)
+    {
+        max_pull_ = std::max(max_pull_, frames);
+
+        // Enough to ride out the largest bursts of input and output, and the taps ahead of the read position
+        auto target = static_cast<double>(max_push_ + max_pull_ + half_taps);
+        auto result = true;
+
+        if (buffered() > 4.0 * target) {
+            auto skip = static_cast<size_t>(buffered() - target);
+            input_.erase(input_.begin(), input_.begin() + skip * channels_);
+            fill_  = target;
+            result = false;
+        }
+
+        if (!running_) {
+            if (buffered() < target) {
+                std::fill(samples, samples + frames * channels_, 0);
+                return result;
+            }
+            running_ = true;
+            fill_    = buffered();
+        }
+
+        fill_ += (buffered() - fill_) * smoothing;
+        auto ratio = 1.0 + std::clamp((fill_ - target) / target * gain, -max_deviation, max_deviation);
+
+        const double min_sample = std::numeric_limits<int32_t>::min();
+        const double max_sample = std::numeric_limits<int32_t>::max();
+
+        for (size_t n = 0; n < frames; ++n) {
+            auto index = static_cast<size_t>(pos_);
+            if (index + half_taps >= this->frames()) {
+                std::fill(samples + n * channels_, samples + frames * channels_, 0);
+                running_ = false;
+                result   = false;
+                break;
+            }
+
+            auto phase = (pos_ - index) * phases;
+            auto p     = static_cast<int>(phase);
+            auto t     = static_cast<float>(phase - p);
+            auto row0  = table_.data() + p * taps;
+            auto row1  = row0 + taps;
+            for (int k = 0; k < taps; ++k) {
+                coeffs_[k] = row0[k] + (row1[k] - row0[k]) * t;
+            }
+
+            // Channels innermost, as they are contiguous in the input
+            std::fill(acc_.begin(), acc_.end(), 0.0f);
+            auto src = input_.data() + (index - half_taps + 1) * channels_;
+            for (int k = 0; k < taps; ++k) {
+                auto c   = coeffs_[k];
+                auto row = src + k * channels_;
+                for (int ch = 0; ch < channels_; ++ch) {
+                    acc_[ch] += c * row[ch];
+                }
+            }
+            for (int ch = 0; ch < channels_; ++ch) {
+                samples[n * channels_ + ch] =
+                    static_cast<int32_t>(std::llrint(std::clamp<double>(acc_[ch], min_sample, max_sample)));
+            }
+
+            pos_ += ratio;
+        }
+
+        // Drop what the filter no longer reaches back to, in place so that the buffer keeps its capacity
+        auto earliest = std::min(static_cast<size_t>(pos_) + 1, this->frames() + half_taps);
+        if (earliest > half_taps) {
+            auto drop = earliest - half_taps;
+            input_.erase(input_.begin(), input_.begin() + drop * channels_);
+            pos_ -= static_cast<double>(drop);
+        }
+
+        return result;
+    }
+};
+
+audio_resampler::audio_resampler(int channels)
+    : impl_(new impl(channels))
+{
+}
+audio_resampler::~audio_resampler() {}
+void audio_resampler::push(const int32_t* samples, size_t frames) { impl_->push(samples, frames); }
+bool audio_resampler::pull(int32_t* samples, size_t frames) { return impl_->pull(samples, frames); }
+
+}} // namespace caspar::core
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caspar { namespace core {
+
+// Band limited interpolation of an audio stream that arrives on another clock than the channel it is mixed in. Input
+// is queued as it comes and read back at a rate slightly above or below it, steered by how much is queued, so that the
+// channel gets a continuous stream at its own cadence without repeating or dropping samples.
+class audio_resampler final
+{
+    audio_resampler(const audio_resampler&);
+    audio_resampler& operator=(const audio_resampler&);
+
+  public:
+    explicit audio_resampler(int channels);
+    ~audio_resampler();
+
+    // Queues frames of interleaved samples
+    void push(const int32_t* samples, size_t frames);
+
+    // Writes exactly frames of interleaved samples, silence while the queue is filling. Returns false if the queue ran
+    // dry or overflowed, which leaves a gap or a skip in the stream.
+    bool pull(int32_t* samples, size_t frames);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
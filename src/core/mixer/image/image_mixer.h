@@ -26,8 +26,12 @@
 #include <core/frame/frame_visitor.h>
 #include <core/frame/pixel_format.h>
 
+#include <any>
 #include <cstdint>
+#include <functional>
 #include <future>
+#include <map>
+#include <string>
 
 namespace caspar { namespace core {
 
@@ -48,14 +52,49 @@ class image_mixer
 
     virtual void update_aspect_ratio(double aspect_ratio) = 0;
 
-    virtual std::future<array<const uint8_t>> render(const struct video_format_desc& format_desc) = 0;
+    // The first buffer is the mixed image, left empty unless request.image is set, followed by the image packed into
+    // each of request.packings and the image scaled to each of request.sizes. The fields of an interlaced frame, a
+    // followed by b, are drawn into one image, each to its own lines, which both renders complete with. Damage tracking
+    // and request.texture are then not supported. Progressive frames are drawn at request.scale of the format, and
+    // scaled up to it.
+    virtual std::future<std::vector<array<const uint8_t>>> render(const struct video_format_desc& format_desc,
+                                                                  const output_request&           request,
+                                                                  video_field                     field) = 0;
+
+    // The image of the last render as the opaque of a frame, which image mixers on the same device draw without an
+    // upload. Empty unless request.texture was set.
+    virtual std::any rendered() const = 0;
+
+    // Reads the image of the last render back from the device each time it is called, for frames mixed without it
+    // that a consumer reads after all. Empty unless request.texture was set.
+    virtual std::function<array<const uint8_t>()> readback() const = 0;
 
     class mutable_frame create_frame(const void* tag, const struct pixel_format_desc& desc) override = 0;
     class mutable_frame create_frame(const void*                     video_stream_tag,
                                      const struct pixel_format_desc& desc,
                                      common::bit_depth               depth) override                               = 0;
+    class mutable_frame import_frame(const void* video_stream_tag, const shared_texture& texture) override         = 0;
+    class mutable_frame update_frame(const void*                      video_stream_tag,
+                                     const class const_frame&         previous,
+                                     const struct pixel_format_desc&  desc,
+                                     const array<const std::uint8_t>& image,
+                                     const std::vector<damage_rect>&  damage) override = 0;
 
     virtual common::bit_depth depth() const = 0;
+
+    // The transfer the output is encoded with, anything but bt709 having been mixed in linear light
+    virtual color_transfer transfer() const = 0;
+
+    // The items visited for the last render, and how many of them were not drawn as nothing of them would be visible
+    virtual int visited_items() const = 0;
+    virtual int culled_items() const  = 0;
+
+    // The areas the last render changed, as described by mutable_frame::damage
+    virtual std::vector<damage_rect> damage() const = 0;
+
+    // Milliseconds of GPU time per render spent on each pass, averaged over recent renders: "layer/<n>" for the layers
+    // in the order they are drawn, "pack", "readback" and their "total". Measurements lag the renders by a few frames.
+    virtual std::map<std::string, double> gpu_times() const = 0;
 };
 
 }} // namespace caspar::core
@@ -24,81 +24,238 @@
 #include "mixer.h"
 
 #include "../frame/frame.h"
+#include "../frame/frame_visitor.h"
 
 #include "audio/audio_mixer.h"
 #include "image/image_mixer.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/timer.h>
 
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_transform.h>
 #include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
-#include <queue>
+#include <algorithm>
+#include <any>
+#include <chrono>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace caspar { namespace core {
 
+namespace {
+
+// Finds when the oldest live image in the frames of a tick was captured
+struct capture_visitor final : public frame_visitor
+{
+    std::chrono::steady_clock::time_point captured;
+
+    void push(const frame_transform& transform) override {}
+
+    void visit(const const_frame& frame) override
+    {
+        const auto time = frame.timestamps().captured;
+        if (time != std::chrono::steady_clock::time_point{} &&
+            (captured == std::chrono::steady_clock::time_point{} || time < captured))
+            captured = time;
+    }
+
+    void pop() override {}
+};
+
+} // namespace
+
 struct mixer::impl
 {
-    monitor::state                       state_;
-    int                                  channel_index_;
-    spl::shared_ptr<diagnostics::graph>  graph_;
-    audio_mixer                          audio_mixer_{graph_};
-    spl::shared_ptr<image_mixer>         image_mixer_;
-    std::queue<std::future<const_frame>> buffer_;
+    // A render that has been submitted to the image mixer and whose readback may still be in progress
+    struct pending_frame
+    {
+        std::future<std::vector<array<const uint8_t>>> image;
+        std::vector<output_packing>                    packings;
+        std::vector<output_size>                       sizes;
+        std::vector<damage_rect>                       damage;
+        std::any                                       rendered;
+        std::function<array<const uint8_t>()>          readback;
+        frame_timestamps                               timestamps;
+        array<const int32_t>                           audio;
+        caspar::timer                                  submitted;
+    };
+
+    monitor::state                      state_;
+    int                                 channel_index_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    audio_mixer                         audio_mixer_;
+    spl::shared_ptr<image_mixer>        image_mixer_;
+    const int                           depth_;
+
+    // Fixed ring of in-flight renders, sized once the field count is known
+    std::vector<pending_frame> pipeline_;
+    size_t                     pipeline_head_  = 0;
+    size_t                     pipeline_count_ = 0;
+
+    // The output description only changes with the format, so it is built once instead of per frame
+    pixel_format_desc desc_{pixel_format::bgra};
 
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
-    impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
+    impl(int                                 channel_index,
+         spl::shared_ptr<diagnostics::graph> graph,
+         spl::shared_ptr<image_mixer>        image_mixer,
+         int                                 depth,
+         double                              audio_meter_rate)
         : channel_index_(channel_index)
         , graph_(std::move(graph))
+        , audio_mixer_(graph_, audio_meter_rate)
         , image_mixer_(std::move(image_mixer))
+        , depth_(std::max(1, depth))
     {
+        graph_->set_color("mix-wait", diagnostics::color(0.9f, 0.9f, 0.3f));
+        graph_->set_color("mix-latency", diagnostics::color(0.5f, 0.5f, 0.9f));
+        graph_->set_color("culled-items", diagnostics::color(0.3f, 0.8f, 0.8f));
+        graph_->set_color("gpu-draw", diagnostics::color(0.9f, 0.4f, 0.2f, 0.8f));
+        graph_->set_color("gpu-pack", diagnostics::color(0.6f, 0.3f, 0.9f, 0.8f));
+        graph_->set_color("gpu-readback", diagnostics::color(0.2f, 0.6f, 0.3f, 0.8f));
+    }
+
+    void update_desc(const video_format_desc& format_desc, common::bit_depth depth)
+    {
+        if (!desc_.planes.empty()) {
+            auto& plane = desc_.planes.at(0);
+            if (plane.width == format_desc.width && plane.height == format_desc.height && plane.depth == depth)
+                return;
+        }
+
+        desc_ = pixel_format_desc(pixel_format::bgra);
+        desc_.planes.push_back(pixel_format_desc::plane(format_desc.width, format_desc.height, 4, depth));
     }
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+    const_frame operator()(std::vector<draw_frame>  frames,
+                           const video_format_desc& format_desc,
+                           int                      nb_samples,
+                           const output_request&    request,
+                           const std::vector<int>&  layers,
+                           video_field              field)
     {
         image_mixer_->update_aspect_ratio(static_cast<double>(format_desc.square_width) /
                                           static_cast<double>(format_desc.square_height));
 
-        for (auto& frame : frames) {
+        frame_timestamps timestamps;
+        timestamps.mixed = std::chrono::steady_clock::now();
+
+        capture_visitor captures;
+        for (size_t n = 0; n < frames.size(); ++n) {
+            auto& frame = frames[n];
+            audio_mixer_.set_layer(n < layers.size() ? layers[n] : static_cast<int>(n));
             frame.accept(audio_mixer_);
+            frame.accept(captures);
             frame.transform().image_transform.layer_depth = 1;
             frame.accept(*image_mixer_);
         }
 
-        auto image = image_mixer_->render(format_desc);
+        auto image = image_mixer_->render(format_desc, request, field);
         auto audio = audio_mixer_(format_desc, nb_samples);
 
         state_["audio"] = audio_mixer_.state();
 
-        auto depth = image_mixer_->depth();
-
-        buffer_.push(std::async(std::launch::deferred,
-                                [image = std::move(image),
-                                 audio = std::move(audio),
-                                 graph = graph_,
-                                 depth,
-                                 format_desc,
-                                 tag = this]() mutable {
-                                    auto desc = pixel_format_desc(pixel_format::bgra);
-                                    desc.planes.push_back(
-                                        pixel_format_desc::plane(format_desc.width, format_desc.height, 4, depth));
-                                    std::vector<array<const uint8_t>> image_data;
-                                    image_data.emplace_back(std::move(image.get()));
-                                    return const_frame(tag, std::move(image_data), std::move(audio), desc);
-                                }));
-
-        if (buffer_.size() <= format_desc.field_count) {
+        // Share of the items that were culled before reaching the GPU
+        const auto visited_items = image_mixer_->visited_items();
+        const auto culled_items  = image_mixer_->culled_items();
+        graph_->set_value("culled-items", visited_items > 0 ? static_cast<double>(culled_items) / visited_items : 0.0);
+        state_["image/items"]  = visited_items;
+        state_["image/culled"] = culled_items;
+
+        // GPU time per render, the draw lines on the same scale as mix-time
+        auto                gpu_times = image_mixer_->gpu_times();
+        std::vector<double> layer_times;
+        for (auto& time : gpu_times) {
+            if (time.first.compare(0, 6, "layer/") == 0) {
+                auto index = std::stoul(time.first.substr(6));
+                layer_times.resize(std::max(layer_times.size(), index + 1));
+                layer_times[index] = time.second;
+            }
+        }
+        const auto draw_time = gpu_times["total"] - gpu_times["pack"] - gpu_times["readback"];
+        graph_->set_value("gpu-draw", draw_time * 0.001 * format_desc.hz * 0.5);
+        graph_->set_value("gpu-pack", gpu_times["pack"] * 0.001 * format_desc.hz * 0.5);
+        graph_->set_value("gpu-readback", gpu_times["readback"] * 0.001 * format_desc.hz * 0.5);
+        state_["image/gpu/layers"]   = layer_times;
+        state_["image/gpu/pack"]     = gpu_times["pack"];
+        state_["image/gpu/readback"] = gpu_times["readback"];
+        state_["image/gpu/total"]    = gpu_times["total"];
+
+        update_desc(format_desc, image_mixer_->depth());
+
+        // One render per field, and depth_ frames of them are kept in flight before the oldest is read back
+        const auto capacity = static_cast<size_t>(depth_ * format_desc.field_count + 1);
+        if (pipeline_.size() != capacity) {
+            // Only happens when the field count changes, the frames in flight belong to the previous format
+            pipeline_       = std::vector<pending_frame>(capacity);
+            pipeline_head_  = 0;
+            pipeline_count_ = 0;
+        }
+
+        timestamps.captured = captures.captured;
+
+        auto& slot      = pipeline_[(pipeline_head_ + pipeline_count_) % pipeline_.size()];
+        slot.image      = std::move(image);
+        slot.packings   = request.packings;
+        slot.sizes      = request.sizes;
+        slot.damage     = image_mixer_->damage();
+        slot.rendered   = image_mixer_->rendered();
+        slot.readback   = image_mixer_->readback();
+        slot.timestamps = timestamps;
+        slot.audio      = std::move(audio);
+        slot.submitted  = caspar::timer();
+        pipeline_count_ += 1;
+
+        if (pipeline_count_ < pipeline_.size()) {
             return const_frame{};
         }
 
-        auto frame = std::move(buffer_.front().get());
-        buffer_.pop();
+        auto& oldest = pipeline_[pipeline_head_];
+        pipeline_head_ = (pipeline_head_ + 1) % pipeline_.size();
+        pipeline_count_ -= 1;
+
+        // Time spent in flight versus time this tick had to block for the readback to finish
+        graph_->set_value("mix-latency", oldest.submitted.elapsed() * format_desc.hz / (depth_ + 1));
+        caspar::timer wait_timer;
+        auto          buffers = oldest.image.get();
+        graph_->set_value("mix-wait", wait_timer.elapsed() * format_desc.fps);
+        oldest.timestamps.rendered = std::chrono::steady_clock::now();
+
+        auto image_data = std::vector<array<const uint8_t>>{};
+        image_data.emplace_back(std::move(buffers.at(0)));
+
+        const_frame::packed_data_t packed_data;
+        for (size_t n = 0; n < oldest.packings.size(); ++n) {
+            packed_data.emplace_back(oldest.packings[n], std::move(buffers.at(n + 1)));
+        }
+
+        const_frame::scaled_data_t scaled_data;
+        for (size_t n = 0; n < oldest.sizes.size(); ++n) {
+            scaled_data.emplace_back(oldest.sizes[n], std::move(buffers.at(n + 1 + oldest.packings.size())));
+        }
+
+        auto frame = const_frame(this,
+                                 std::move(image_data),
+                                 std::move(oldest.audio),
+                                 desc_,
+                                 std::move(packed_data),
+                                 std::move(oldest.damage),
+                                 oldest.timestamps,
+                                 std::move(scaled_data));
+        if (oldest.rendered.has_value()) {
+            frame = frame.with_opaque(std::move(oldest.rendered));
+        }
+
+        // Only the consumers that draw the texture asked for this frame, but it is read back if any other reads it
+        if (frame.image_data(0).size() == 0 && oldest.readback) {
+            frame = frame.with_readback(std::move(oldest.readback));
+        }
         return frame;
     }
 
@@ -107,15 +264,24 @@ struct mixer::impl
     float get_master_volume() { return audio_mixer_.get_master_volume(); }
 };
 
-mixer::mixer(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
-    : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer)))
+mixer::mixer(int                                 channel_index,
+             spl::shared_ptr<diagnostics::graph> graph,
+             spl::shared_ptr<image_mixer>        image_mixer,
+             int                                 depth,
+             double                              audio_meter_rate)
+    : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer), depth, audio_meter_rate))
 {
 }
 void        mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
 float       mixer::get_master_volume() { return impl_->get_master_volume(); }
-const_frame mixer::operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+const_frame mixer::operator()(std::vector<draw_frame>  frames,
+                              const video_format_desc& format_desc,
+                              int                      nb_samples,
+                              const output_request&    request,
+                              const std::vector<int>&  layers,
+                              video_field              field)
 {
-    return (*impl_)(std::move(frames), format_desc, nb_samples);
+    return (*impl_)(std::move(frames), format_desc, nb_samples, request, layers, field);
 }
 mutable_frame mixer::create_frame(const void* tag, const pixel_format_desc& desc)
 {
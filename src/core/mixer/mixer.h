@@ -24,8 +24,10 @@
 #include <common/bit_depth.h>
 #include <common/memory.h>
 
+#include <core/frame/pixel_format.h>
 #include <core/fwd.h>
 #include <core/monitor/monitor.h>
+#include <core/video_format.h>
 
 namespace caspar::diagnostics {
 class graph;
@@ -39,11 +41,22 @@ class mixer final
     mixer& operator=(const mixer&);
 
   public:
+    // depth is the number of frames rendered ahead of the one returned, allowing GPU readback to overlap later ticks.
+    // audio_meter_rate is how many times per second audio levels and loudness are published, 0 disables metering.
     explicit mixer(int                                         channel_index,
                    spl::shared_ptr<caspar::diagnostics::graph> graph,
-                   spl::shared_ptr<image_mixer>                image_mixer);
+                   spl::shared_ptr<image_mixer>                image_mixer,
+                   int                                         depth            = 1,
+                   double                                      audio_meter_rate = 0.0);
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples);
+    // layers holds the stage layer of each of frames, if known. field is that of an interlaced frame whose fields are
+    // mixed into one image, see image_mixer::render.
+    const_frame operator()(std::vector<draw_frame>  frames,
+                           const video_format_desc& format_desc,
+                           int                      nb_samples,
+                           const output_request&    request = {},
+                           const std::vector<int>&  layers  = {},
+                           video_field              field   = video_field::progressive);
 
     void  set_master_volume(float volume);
     float get_master_volume();
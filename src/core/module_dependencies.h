@@ -27,6 +27,9 @@
 #include "producer/cg_proxy.h"
 #include "producer/frame_producer_registry.h"
 
+#include <functional>
+#include <memory>
+
 namespace caspar::protocol::amcp {
 class amcp_command_repository_wrapper;
 }
@@ -40,14 +43,19 @@ struct module_dependencies
     const spl::shared_ptr<frame_consumer_registry>                         consumer_registry;
     const std::shared_ptr<protocol::amcp::amcp_command_repository_wrapper> command_repository;
 
+    // An 8 bit mixer of no channel, for modules that render frames off the channels, such as thumbnails
+    const std::function<std::unique_ptr<image_mixer>()> create_image_mixer;
+
     module_dependencies(const spl::shared_ptr<cg_producer_registry>&                            cg_registry,
                         const spl::shared_ptr<frame_producer_registry>&                         producer_registry,
                         const spl::shared_ptr<frame_consumer_registry>&                         consumer_registry,
-                        const std::shared_ptr<protocol::amcp::amcp_command_repository_wrapper>& command_repository)
+                        const std::shared_ptr<protocol::amcp::amcp_command_repository_wrapper>& command_repository,
+                        std::function<std::unique_ptr<image_mixer>()>                           create_image_mixer)
         : cg_registry(cg_registry)
         , producer_registry(producer_registry)
         , consumer_registry(consumer_registry)
         , command_repository(command_repository)
+        , create_image_mixer(std::move(create_image_mixer))
     {
     }
 };
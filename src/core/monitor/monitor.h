@@ -24,7 +24,10 @@
 #include <boost/variant.hpp>
 
 #include <cstdint>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <boost/container/flat_map.hpp>
@@ -37,9 +40,27 @@ using data_t = boost::
 using vector_t   = boost::container::small_vector<data_t, 2>;
 using data_map_t = boost::container::flat_map<std::string, vector_t>;
 
+namespace detail {
+
+template <typename T>
+std::string to_key(const T& key)
+{
+    if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>) {
+        return std::to_string(key);
+    } else if constexpr (std::is_convertible_v<const T&, std::string>) {
+        return std::string(key);
+    } else {
+        return boost::lexical_cast<std::string>(key);
+    }
+}
+
+} // namespace detail
+
+// The underlying map is shared between copies and only cloned when a shared instance is modified, so taking a
+// snapshot of a state, e.g. for the OSC client or INFO, does not copy every entry.
 class state
 {
-    data_map_t data_;
+    std::shared_ptr<data_map_t> data_;
 
     class state_proxy
     {
@@ -47,8 +68,8 @@ class state
         data_map_t& data_;
 
       public:
-        state_proxy(const std::string& key, data_map_t& data)
-            : key_(key)
+        state_proxy(std::string key, data_map_t& data)
+            : key_(std::move(key))
             , data_(data)
         {
         }
@@ -68,7 +89,11 @@ class state
         template <typename T>
         state_proxy operator[](const T& key)
         {
-            return state_proxy(key_ + "/" + boost::lexical_cast<std::string>(key), data_);
+            auto        child_key = detail::to_key(key);
+            std::string path;
+            path.reserve(key_.size() + 1 + child_key.size());
+            path.append(key_).append(1, '/').append(child_key);
+            return state_proxy(std::move(path), data_);
         }
 
         template <typename T>
@@ -86,38 +111,74 @@ class state
 
         state_proxy& operator=(const state& other)
         {
+            auto prefix = key_ + "/";
+
+            auto existing = data_.lower_bound(prefix);
+            if (existing != data_.end() && existing->first.compare(0, prefix.size(), prefix) == 0) {
+                for (auto& p : other) {
+                    data_[prefix + p.first] = p.second;
+                }
+                return *this;
+            }
+
+            // Nothing lives under this key yet. The prefixed keys keep the order of other, so they can be merged in
+            // a single pass instead of one sorted insert per entry.
+            std::vector<data_map_t::value_type> entries;
+            entries.reserve(std::distance(other.begin(), other.end()));
             for (auto& p : other) {
-                data_[key_ + "/" + p.first] = std::move(p.second);
+                entries.emplace_back(prefix + p.first, p.second);
             }
+            data_.insert(boost::container::ordered_unique_range, entries.begin(), entries.end());
             return *this;
         }
     };
 
-  public:
-    state() = default;
-    state(const state& other)
-        : data_(other.data_)
+    data_map_t& mutable_data()
     {
+        if (!data_) {
+            data_ = std::make_shared<data_map_t>();
+        } else if (data_.use_count() > 1) {
+            data_ = std::make_shared<data_map_t>(*data_);
+        }
+        return *data_;
     }
-    state(data_map_t data)
-        : data_(std::move(data))
+
+    static const data_map_t& empty()
     {
+        static const data_map_t data;
+        return data;
     }
-    state& operator=(const state& other)
+
+  public:
+    state() = default;
+    state(const state& other) = default;
+    state(state&& other)      = default;
+    state(data_map_t data)
+        : data_(std::make_shared<data_map_t>(std::move(data)))
     {
-        data_ = other.data_;
-        return *this;
     }
+    state& operator=(const state& other) = default;
+    state& operator=(state&& other) = default;
 
     template <typename T>
     state_proxy operator[](const T& key)
     {
-        return state_proxy(boost::lexical_cast<std::string>(key), data_);
+        return state_proxy(detail::to_key(key), mutable_data());
     }
 
-    data_map_t::const_iterator begin() const { return data_.begin(); }
+    data_map_t::const_iterator begin() const { return data_ ? data_->cbegin() : empty().cbegin(); }
+
+    data_map_t::const_iterator end() const { return data_ ? data_->cend() : empty().cend(); }
+
+    // Only compares the entries when other does not share them, as a snapshot that was not modified since does
+    bool operator==(const state& other) const
+    {
+        const auto& lhs = data_ ? *data_ : empty();
+        const auto& rhs = other.data_ ? *other.data_ : empty();
+        return &lhs == &rhs || lhs == rhs;
+    }
 
-    data_map_t::const_iterator end() const { return data_.end(); }
+    bool operator!=(const state& other) const { return !(*this == other); }
 };
 
 }}} // namespace caspar::core::monitor
@@ -66,6 +66,7 @@ struct cg_producer_registry::impl
         cg_proxy_factory    proxy_factory;
         cg_producer_factory producer_factory;
         bool                reusable_producer_instance;
+        cg_preloader        preloader;
     };
 
     mutable std::mutex             mutex_;
@@ -76,14 +77,16 @@ struct cg_producer_registry::impl
                               std::set<std::wstring> file_extensions,
                               cg_proxy_factory       proxy_factory,
                               cg_producer_factory    producer_factory,
-                              bool                   reusable_producer_instance)
+                              bool                   reusable_producer_instance,
+                              cg_preloader           preloader)
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
         record rec{std::move(cg_producer_name),
                    std::move(proxy_factory),
                    std::move(producer_factory),
-                   reusable_producer_instance};
+                   reusable_producer_instance,
+                   std::move(preloader)};
 
         for (auto& extension : file_extensions) {
             records_by_extension_.insert(std::make_pair(extension, rec));
@@ -101,6 +104,16 @@ struct cg_producer_registry::impl
         return found->producer_factory(dependencies, filename);
     }
 
+    bool preload(const frame_producer_dependencies& dependencies, const std::wstring& filename) const
+    {
+        auto found = find_record(filename);
+
+        if (!found || !found->preloader)
+            return false;
+
+        return found->preloader(dependencies, filename);
+    }
+
     spl::shared_ptr<cg_proxy> get_proxy(const spl::shared_ptr<frame_producer>& producer) const
     {
         auto producer_name = producer->name();
@@ -216,13 +229,15 @@ void cg_producer_registry::register_cg_producer(std::wstring           cg_produc
                                                 std::set<std::wstring> file_extensions,
                                                 cg_proxy_factory       proxy_factory,
                                                 cg_producer_factory    producer_factory,
-                                                bool                   reusable_producer_instance)
+                                                bool                   reusable_producer_instance,
+                                                cg_preloader           preloader)
 {
     impl_->register_cg_producer(std::move(cg_producer_name),
                                 std::move(file_extensions),
                                 std::move(proxy_factory),
                                 std::move(producer_factory),
-                                reusable_producer_instance);
+                                reusable_producer_instance,
+                                std::move(preloader));
 }
 
 spl::shared_ptr<frame_producer> cg_producer_registry::create_producer(const frame_producer_dependencies& dependencies,
@@ -231,6 +246,11 @@ spl::shared_ptr<frame_producer> cg_producer_registry::create_producer(const fram
     return impl_->create_producer(dependencies, filename);
 }
 
+bool cg_producer_registry::preload(const frame_producer_dependencies& dependencies, const std::wstring& filename) const
+{
+    return impl_->preload(dependencies, filename);
+}
+
 spl::shared_ptr<cg_proxy> cg_producer_registry::get_proxy(const spl::shared_ptr<frame_producer>& producer) const
 {
     return impl_->get_proxy(producer);
@@ -57,6 +57,9 @@ using cg_proxy_factory = std::function<spl::shared_ptr<cg_proxy>(const spl::shar
 using cg_producer_factory =
     std::function<spl::shared_ptr<frame_producer>(const frame_producer_dependencies& dependencies,
                                                   const std::wstring&                filename)>;
+// Prepares a template in the background so that producers of it start at once, false when it cannot be found
+using cg_preloader =
+    std::function<bool(const frame_producer_dependencies& dependencies, const std::wstring& filename)>;
 
 class cg_producer_registry
 {
@@ -67,11 +70,15 @@ class cg_producer_registry
                               std::set<std::wstring> file_extensions,
                               cg_proxy_factory       proxy_factory,
                               cg_producer_factory    producer_factory,
-                              bool                   reusable_producer_instance);
+                              bool                   reusable_producer_instance,
+                              cg_preloader           preloader = nullptr);
 
     spl::shared_ptr<frame_producer> create_producer(const frame_producer_dependencies& dependencies,
                                                     const std::wstring&                filename) const;
 
+    // False when the template cannot be found or its kind of producer cannot be preloaded
+    bool preload(const frame_producer_dependencies& dependencies, const std::wstring& filename) const;
+
     spl::shared_ptr<cg_proxy> get_proxy(const spl::shared_ptr<frame_producer>& producer) const;
     spl::shared_ptr<cg_proxy> get_proxy(const spl::shared_ptr<video_channel>& video_channel, int render_layer) const;
     spl::shared_ptr<cg_proxy> get_or_create_proxy(const spl::shared_ptr<video_channel>& video_channel,
@@ -30,6 +30,7 @@
 #include <core/frame/draw_frame.h>
 #include <core/video_format.h>
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <future>
@@ -40,6 +41,13 @@
 
 namespace caspar { namespace core {
 
+// The time the producers of a channel have for the frames of a tick, by the clock of the channel
+struct frame_budget
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // Of the tick
+    int                                   behind   = 0; // Ticks the channel is behind its clock by
+};
+
 class frame_producer
 {
     frame_producer(const frame_producer&);
@@ -107,6 +115,16 @@ class frame_producer
     virtual spl::shared_ptr<frame_producer> following_producer() const { return core::frame_producer::empty(); }
     virtual std::optional<int64_t>          auto_play_delta() const { return {}; }
 
+    // Whether the frames of the producer can be seen, from the transform of its layer. A producer that is not seen may
+    // produce its frames more cheaply, such as with fewer of them decoded or painted, as long as it keeps time and
+    // produces full frames again as soon as it is seen. Its audio is still heard.
+    virtual void set_visible(bool visible) {}
+
+    // The budget of the tick about to be received, set before each tick. A producer that is behind may produce its
+    // frames more cheaply, such as by skipping the decoding of frames it would drop or painting less often, so that the
+    // channel catches up rather than stalls. Offline channels have no deadline and are never behind.
+    virtual void set_budget(const frame_budget& budget) {}
+
     /**
      * Some producers take a couple of frames before they produce frames.
      * While this returns false, the previous producer will be left running for a limited number of frames.
@@ -164,6 +182,10 @@ struct frame_producer_dependencies
     spl::shared_ptr<const frame_producer_registry> producer_registry;
     spl::shared_ptr<const cg_producer_registry>    cg_registry;
 
+    // The channel ticks as fast as it can rather than at the frame rate, so producers should wait for a frame that is
+    // not ready rather than skip it
+    bool offline = false;
+
     frame_producer_dependencies(const spl::shared_ptr<core::frame_factory>&           frame_factory,
                                 const std::vector<spl::shared_ptr<video_channel>>&    channels,
                                 const video_format_repository&                        format_repository,
@@ -26,11 +26,23 @@
 #include "frame_producer_registry.h"
 
 #include "color/color_producer.h"
+#include "multiview/multiview_producer.h"
+#include "playlist/playlist_producer.h"
 #include "route/route_producer.h"
 #include "separated/separated_producer.h"
 
+#include <common/executor.h>
+#include <common/task_arena.h>
+
 #include <boost/algorithm/string/predicate.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
 namespace caspar { namespace core {
 
 frame_producer_registry::frame_producer_registry() {}
@@ -40,13 +52,135 @@ void frame_producer_registry::register_producer_factory(std::wstring name, const
     producer_factories_.push_back(factory);
 }
 
-std::shared_ptr<executor>& producer_destroyer()
+// Producers can take long to tear down, e.g. joining decoders or closing a browser, and a CLEAR of a busy channel
+// destroys many of them at once. They are destroyed on a few threads of their own, so that neither the stage nor a
+// single slow producer holds up the others.
+class producer_destroyer
 {
-    static auto destroyer = [] {
-        auto result = std::make_shared<executor>(L"Producer destroyer");
-        result->set_capacity(std::numeric_limits<unsigned int>::max());
-        return result;
-    }();
+    using clock_t = std::chrono::steady_clock;
+
+    struct destruction
+    {
+        std::wstring        name;
+        clock_t::time_point queued;
+        bool                destroying = false;
+    };
+
+    std::vector<std::unique_ptr<executor>> executors_;
+
+    mutable std::mutex              mutex_;
+    std::condition_variable         cond_;
+    std::map<uint64_t, destruction> pending_;
+    uint64_t                        next_id_          = 0;
+    uint64_t                        destroyed_        = 0;
+    uint64_t                        still_referenced_ = 0;
+
+  public:
+    explicit producer_destroyer(int threads)
+    {
+        for (int n = 0; n < threads; ++n) {
+            executors_.push_back(std::make_unique<executor>(L"Producer destroyer " + std::to_wstring(n)));
+            executors_.back()->set_capacity(std::numeric_limits<unsigned int>::max());
+        }
+    }
+
+    // Queues the destruction of producer without ever blocking, on the thread with the least queued
+    void destroy(spl::shared_ptr<frame_producer>&& producer)
+    {
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            id = next_id_++;
+            pending_.emplace(id, destruction{producer->print(), clock_t::now()});
+        }
+
+        auto& destroyer = *std::min_element(
+            executors_.begin(), executors_.end(), [](auto& a, auto& b) { return a->size() < b->size(); });
+
+        auto pointer = new spl::shared_ptr<frame_producer>(std::move(producer));
+
+        destroyer->begin_invoke([=] {
+            std::unique_ptr<spl::shared_ptr<frame_producer>> pointer_guard(pointer);
+
+            std::wstring str;
+            bool         unique = true;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.at(id).destroying = true;
+                str                        = pending_.at(id).name;
+            }
+
+            try {
+                unique = pointer->unique();
+                if (!unique)
+                    CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
+                                      << pointer->use_count();
+                else
+                    CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
+            } catch (...) {
+            }
+
+            auto start = clock_t::now();
+            try {
+                // Any parallel work of the destructor gives way to that of the channels
+                run_in_arena(task_kind::background, [&] { pointer_guard.reset(); });
+                CASPAR_LOG(info) << str << L" Destroyed.";
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            auto elapsed = clock_t::now() - start;
+            if (elapsed > std::chrono::seconds(1)) {
+                CASPAR_LOG(warning) << str << L" Took "
+                                    << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+                                    << L" ms to destroy.";
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.erase(id);
+                destroyed_ += 1;
+                still_referenced_ += unique ? 0 : 1;
+            }
+            cond_.notify_all();
+        });
+    }
+
+    // Holds up whoever creates producers, not the stage, while more than max_pending are waiting to be destroyed, so
+    // that the memory of those not yet destroyed stays bounded. Returns false if they did not drain within timeout.
+    bool wait(size_t max_pending, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, timeout, [&] { return pending_.size() <= max_pending; });
+    }
+
+    producer_destroyer_info info() const
+    {
+        producer_destroyer_info info;
+        info.threads = static_cast<int>(executors_.size());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        info.destroyed        = destroyed_;
+        info.still_referenced = still_referenced_;
+
+        auto now = clock_t::now();
+        for (auto& destruction : pending_) {
+            info.pending.push_back(producer_destruction{
+                destruction.second.name,
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - destruction.second.queued),
+                destruction.second.destroying});
+        }
+        return info;
+    }
+};
+
+// Destructions that may wait before new producers are created
+static const size_t MAX_PENDING_DESTRUCTIONS = 32;
+
+std::shared_ptr<producer_destroyer>& destroyer()
+{
+    static auto destroyer = std::make_shared<producer_destroyer>(
+        static_cast<int>(std::clamp(std::thread::hardware_concurrency() / 2, 2u, 8u)));
 
     return destroyer;
 }
@@ -62,7 +196,13 @@ void destroy_producers_synchronously()
 {
     destroy_producers_in_separate_thread() = false;
     // Join destroyer, executing rest of producers in queue synchronously.
-    producer_destroyer().reset();
+    destroyer().reset();
+}
+
+producer_destroyer_info producer_destroyer_statistics()
+{
+    auto instance = destroyer();
+    return instance ? instance->info() : producer_destroyer_info{};
 }
 
 class destroy_producer_proxy : public frame_producer
@@ -81,34 +221,12 @@ class destroy_producer_proxy : public frame_producer
         if (producer_ == core::frame_producer::empty() || !destroy_producers_in_separate_thread())
             return;
 
-        auto destroyer = producer_destroyer();
+        auto instance = destroyer();
 
-        if (!destroyer)
+        if (!instance)
             return;
 
-        CASPAR_VERIFY(destroyer->size() < 8);
-
-        auto producer = new spl::shared_ptr<frame_producer>(std::move(producer_));
-
-        destroyer->begin_invoke([=] {
-            std::unique_ptr<spl::shared_ptr<frame_producer>> pointer_guard(producer);
-            auto                                             str = (*producer)->print();
-            try {
-                if (!producer->unique())
-                    CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
-                                      << producer->use_count();
-                else
-                    CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
-            } catch (...) {
-            }
-
-            try {
-                pointer_guard.reset();
-                CASPAR_LOG(info) << str << L" Destroyed.";
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-        });
+        instance->destroy(spl::make_shared_ptr(std::move(producer_)));
     }
 
     draw_frame receive_impl(const core::video_field field, int nb_samples) override
@@ -122,6 +240,8 @@ class destroy_producer_proxy : public frame_producer
     {
         return producer_->leading_producer(producer);
     }
+    void                 set_visible(bool visible) override { producer_->set_visible(visible); }
+    void                 set_budget(const frame_budget& budget) override { producer_->set_budget(budget); }
     uint32_t             frame_number() const override { return producer_->frame_number(); }
     uint32_t             nb_frames() const override { return producer_->nb_frames(); }
     draw_frame           last_frame(const core::video_field field) override { return producer_->last_frame(field); }
@@ -149,6 +269,16 @@ spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_de
         return producer;
     }
 
+    producer = create_multiview_producer(dependencies, params);
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
+    producer = create_playlist_producer(dependencies, params);
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
     if (std::any_of(factories.begin(), factories.end(), [&](const producer_factory_t& factory) -> bool {
             try {
                 producer = factory(dependencies, params);
@@ -171,6 +301,12 @@ spl::shared_ptr<core::frame_producer>
 frame_producer_registry::create_producer(const frame_producer_dependencies& dependencies,
                                          const std::vector<std::wstring>&   params) const
 {
+    if (auto instance = destroyer()) {
+        if (!instance->wait(MAX_PENDING_DESTRUCTIONS, std::chrono::seconds(5)))
+            CASPAR_LOG(warning) << L"More than " << MAX_PENDING_DESTRUCTIONS
+                                << L" producers are still waiting to be destroyed.";
+    }
+
     auto& producer_factories = producer_factories_;
     auto  producer           = do_create_producer(dependencies, params, producer_factories);
     auto  key_producer       = frame_producer::empty();
@@ -30,6 +30,7 @@
 #include <core/frame/draw_frame.h>
 #include <core/video_format.h>
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <future>
@@ -62,4 +63,23 @@ class frame_producer_registry
 
 void destroy_producers_synchronously();
 
+struct producer_destruction
+{
+    std::wstring              name;
+    std::chrono::milliseconds age; // Since the producer was released
+    bool                      destroying;
+};
+
+// Producers are destroyed on a pool of threads of their own. Those pending show leaks and slow teardowns, as do
+// producers that were still referenced elsewhere when their destruction came up.
+struct producer_destroyer_info
+{
+    int                               threads          = 0;
+    uint64_t                          destroyed        = 0;
+    uint64_t                          still_referenced = 0;
+    std::vector<producer_destruction> pending;
+};
+
+producer_destroyer_info producer_destroyer_statistics();
+
 }} // namespace caspar::core
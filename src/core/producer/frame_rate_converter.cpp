@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_rate_converter.h"
+
+#include "../frame/frame_transform.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
+
+namespace caspar { namespace core {
+
+frame_rate_conversion frame_rate_conversion_from_string(const std::wstring& str)
+{
+    if (boost::iequals(str, L"REPEAT")) {
+        return frame_rate_conversion::repeat;
+    }
+    if (boost::iequals(str, L"BLEND")) {
+        return frame_rate_conversion::blend;
+    }
+    if (boost::iequals(str, L"MOTION")) {
+        return frame_rate_conversion::motion;
+    }
+    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown frame rate conversion: " + str));
+}
+
+std::wstring to_string(frame_rate_conversion conversion)
+{
+    switch (conversion) {
+        case frame_rate_conversion::blend:
+            return L"blend";
+        case frame_rate_conversion::motion:
+            return L"motion";
+        default:
+            return L"repeat";
+    }
+}
+
+frame_rate_converter::frame_rate_converter(frame_rate_conversion conversion)
+    : conversion_(conversion)
+{
+    if (conversion_ == frame_rate_conversion::motion) {
+        // The image mixer has no motion estimation, the frames are blended instead
+        CASPAR_LOG(warning) << L"[frame_rate_converter] Motion compensated conversion is not supported by the "
+                               L"accelerator, blending instead.";
+        conversion_ = frame_rate_conversion::blend;
+    }
+}
+
+draw_frame frame_rate_converter::convert(const draw_frame& from,
+                                         time_point        from_time,
+                                         const draw_frame& to,
+                                         time_point        to_time,
+                                         time_point        time) const
+{
+    if (conversion_ == frame_rate_conversion::repeat || !to || to_time <= from_time) {
+        return from;
+    }
+
+    const auto delta = std::clamp(std::chrono::duration<double>(time - from_time).count() /
+                                      std::chrono::duration<double>(to_time - from_time).count(),
+                                  0.0,
+                                  1.0);
+
+    // Close enough to a frame of the source to show it as it is, which also keeps equal rates from blending
+    if (delta < 0.01) {
+        return from;
+    }
+
+    auto src_frame = draw_frame::push(from);
+    auto dst_frame = draw_frame::push(to);
+
+    src_frame.transform().image_transform.opacity = 1.0 - delta;
+    src_frame.transform().image_transform.is_mix  = true;
+    dst_frame.transform().image_transform.opacity = delta;
+    dst_frame.transform().image_transform.is_mix  = true;
+
+    // The newer frame is heard once it becomes the one that is due
+    dst_frame.transform().audio_transform.volume = 0.0;
+
+    return draw_frame::over(src_frame, dst_frame);
+}
+
+}} // namespace caspar::core
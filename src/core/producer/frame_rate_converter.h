@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../frame/draw_frame.h"
+
+#include <chrono>
+#include <string>
+
+namespace caspar { namespace core {
+
+enum class frame_rate_conversion
+{
+    repeat, // The newest frame that is due, repeated or skipped to follow the clock of the channel
+    blend,  // The frames on either side of the tick, mixed by how close the tick is to each
+    motion, // Interpolated along the motion between the frames, where the accelerator supports it
+};
+
+frame_rate_conversion frame_rate_conversion_from_string(const std::wstring& str);
+std::wstring          to_string(frame_rate_conversion conversion);
+
+// Converts frames timed by the clock of their source to the ticks of a channel. Blended frames are mixed by the image
+// mixer in the same pass as a MIX transition. Their audio is only that of the older frame, so that the audio mixer
+// resamples it like a stream that repeats or skips buffers rather than mixing two of them.
+class frame_rate_converter final
+{
+  public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    explicit frame_rate_converter(frame_rate_conversion conversion = frame_rate_conversion::repeat);
+
+    // The frame to show at time, from the newest frame that is due and the one after it, which may be empty
+    draw_frame convert(const draw_frame& from,
+                       time_point        from_time,
+                       const draw_frame& to,
+                       time_point        to_time,
+                       time_point        time) const;
+
+    frame_rate_conversion conversion() const { return conversion_; }
+
+  private:
+    frame_rate_conversion conversion_;
+};
+
+}} // namespace caspar::core
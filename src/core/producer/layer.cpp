@@ -40,6 +40,7 @@ struct layer::impl
 
     bool auto_play_ = false;
     bool paused_    = false;
+    bool visible_   = true;
 
   public:
     impl(const core::video_format_desc format_desc)
@@ -51,6 +52,17 @@ struct layer::impl
 
     void resume() { paused_ = false; }
 
+    void set_visible(bool visible)
+    {
+        if (visible != visible_) {
+            visible_ = visible;
+            foreground_->set_visible(visible_);
+        }
+    }
+
+    // Set on every tick, so a producer that takes over the foreground has it from its second tick
+    void set_budget(const frame_budget& budget) { foreground_->set_budget(budget); }
+
     void load(spl::shared_ptr<frame_producer> producer, bool preview_producer, bool auto_play)
     {
         background_ = std::move(producer);
@@ -90,6 +102,7 @@ struct layer::impl
 
             foreground_ = std::move(background_);
             background_ = frame_producer::empty();
+            foreground_->set_visible(visible_);
 
             auto_play_ = false;
         }
@@ -108,6 +121,7 @@ struct layer::impl
         try {
             if (foreground_->following_producer() != core::frame_producer::empty() && field != video_field::b) {
                 foreground_ = foreground_->following_producer();
+                foreground_->set_visible(visible_);
             }
 
             int64_t frames_left = 0;
@@ -184,6 +198,8 @@ void       layer::preview() { impl_->preview(false); }
 void       layer::pause() { impl_->pause(); }
 void       layer::resume() { impl_->resume(); }
 void       layer::stop() { impl_->stop(); }
+void       layer::set_visible(bool visible) { impl_->set_visible(visible); }
+void       layer::set_budget(const frame_budget& budget) { impl_->set_budget(budget); }
 draw_frame layer::receive(const video_field field, int nb_samples) { return impl_->receive(field, nb_samples); }
 draw_frame layer::receive_background(const video_field field, int nb_samples)
 {
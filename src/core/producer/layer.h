@@ -50,6 +50,12 @@ class layer final
     void resume();
     void stop();
 
+    // Whether the frames of the layer can be seen, which the producer in the foreground is told
+    void set_visible(bool visible);
+
+    // Of the tick about to be received, which the producer in the foreground is told
+    void set_budget(const frame_budget& budget);
+
     draw_frame receive(const video_field field, int nb_samples);
     draw_frame receive_background(const video_field field, int nb_samples);
 
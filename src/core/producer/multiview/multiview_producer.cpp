@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "multiview_producer.h"
+
+#include <common/except.h>
+#include <common/future.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/color/color_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/signals2.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace core {
+
+enum class tally_state
+{
+    off,
+    preview,
+    program,
+};
+
+const char* to_string(tally_state tally)
+{
+    switch (tally) {
+        case tally_state::preview:
+            return "preview";
+        case tally_state::program:
+            return "program";
+        default:
+            return "off";
+    }
+}
+
+class multiview_producer
+    : public frame_producer
+    , public std::enable_shared_from_this<multiview_producer>
+{
+    // The latest mixed frame of a channel, which is shown until the next one arrives rather than queued
+    struct source
+    {
+        int                                channel;
+        int                                audio_channels;
+        boost::signals2::scoped_connection connection;
+
+        mutable std::mutex mutex;
+        const_frame        frame;
+        std::vector<float> peaks;
+        tally_state        tally = tally_state::off;
+    };
+
+    // Borders and meter bars, in pixels of the output
+    static constexpr double border_size  = 4.0;
+    static constexpr double meter_width  = 6.0;
+    static constexpr double meter_margin = 2.0;
+    static constexpr int    max_meters   = 16;
+
+    const video_format_desc              format_desc_;
+    std::vector<std::unique_ptr<source>> sources_;
+    const int                            columns_;
+    const int                            rows_;
+    const bool                           meters_;
+
+    const draw_frame program_color_;
+    const draw_frame preview_color_;
+    const draw_frame meter_color_;
+    const draw_frame meter_warning_color_;
+    const draw_frame meter_clip_color_;
+
+    draw_frame last_frame_;
+
+  public:
+    multiview_producer(const frame_producer_dependencies& dependencies,
+                       const std::vector<int>&            channels,
+                       int                                columns,
+                       bool                               meters)
+        : format_desc_(dependencies.format_desc)
+        , columns_(columns > 0 ? columns : static_cast<int>(std::ceil(std::sqrt(channels.size()))))
+        , rows_((static_cast<int>(channels.size()) + columns_ - 1) / columns_)
+        , meters_(meters)
+        , program_color_(create_color_frame(this, dependencies.frame_factory, 0xFFE00000))
+        , preview_color_(create_color_frame(this, dependencies.frame_factory, 0xFF00C000))
+        , meter_color_(create_color_frame(this, dependencies.frame_factory, 0xFF00D000))
+        , meter_warning_color_(create_color_frame(this, dependencies.frame_factory, 0xFFE0E000))
+        , meter_clip_color_(create_color_frame(this, dependencies.frame_factory, 0xFFF00000))
+    {
+        for (auto index : channels) {
+            auto channel_it = std::find_if(
+                dependencies.channels.begin(),
+                dependencies.channels.end(),
+                [=](const spl::shared_ptr<core::video_channel>& channel) { return channel->index() == index; });
+
+            if (channel_it == dependencies.channels.end()) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channel with id " + std::to_wstring(index)));
+            }
+
+            auto source            = std::make_unique<core::multiview_producer::source>();
+            source->channel        = index;
+            source->audio_channels = (*channel_it)->stage()->video_format_desc().audio_channels;
+            sources_.push_back(std::move(source));
+        }
+
+        CASPAR_LOG(debug) << print() << L" Initialized";
+    }
+
+    void connect_slots(const std::vector<spl::shared_ptr<video_channel>>& channels)
+    {
+        auto weak_self = weak_from_this();
+
+        for (auto& source : sources_) {
+            auto channel = std::find_if(channels.begin(),
+                                        channels.end(),
+                                        [&](const spl::shared_ptr<core::video_channel>& channel) {
+                                            return channel->index() == source->channel;
+                                        });
+
+            auto ptr           = source.get();
+            source->connection = (*channel)->mixed().connect(
+                [weak_self, ptr](const core::const_frame& frame, const core::const_frame& /*frame2*/) {
+                    if (auto self = weak_self.lock()) {
+                        self->update(*ptr, frame);
+                    }
+                });
+        }
+    }
+
+    void update(source& source, const const_frame& frame)
+    {
+        std::vector<float> peaks;
+        if (meters_) {
+            auto audio_channels = frame.audio_channels() > 0 ? frame.audio_channels() : source.audio_channels;
+            peaks.resize(std::min(audio_channels, max_meters), 0.0f);
+
+            auto& audio = frame.audio_data();
+            for (size_t n = 0; audio_channels > 0 && n < audio.size(); ++n) {
+                auto channel = static_cast<int>(n % audio_channels);
+                if (channel < static_cast<int>(peaks.size())) {
+                    auto level     = std::abs(static_cast<float>(audio[n])) / std::numeric_limits<std::int32_t>::max();
+                    peaks[channel] = std::max(peaks[channel], level);
+                }
+            }
+        }
+
+        // The audio is only measured, as the sources are heard on their own channels
+        auto picture = frame.with_audio(array<const std::int32_t>{}, 0);
+
+        std::lock_guard<std::mutex> lock(source.mutex);
+        source.frame = std::move(picture);
+        source.peaks = std::move(peaks);
+    }
+
+    static draw_frame place(draw_frame frame, double x, double y, double width, double height)
+    {
+        auto& transform               = frame.transform().image_transform;
+        transform.fill_translation[0] = x;
+        transform.fill_translation[1] = y;
+        transform.fill_scale[0]       = width;
+        transform.fill_scale[1]       = height;
+        return frame;
+    }
+
+    draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        const auto border_x = border_size / format_desc_.width;
+        const auto border_y = border_size / format_desc_.height;
+
+        std::vector<draw_frame> frames;
+        for (size_t n = 0; n < sources_.size(); ++n) {
+            const_frame        frame;
+            std::vector<float> peaks;
+            tally_state        tally;
+            {
+                std::lock_guard<std::mutex> lock(sources_[n]->mutex);
+                frame = sources_[n]->frame;
+                peaks = sources_[n]->peaks;
+                tally = sources_[n]->tally;
+            }
+
+            const auto width  = 1.0 / columns_;
+            const auto height = 1.0 / rows_;
+            const auto x      = static_cast<double>(n % columns_) * width;
+            const auto y      = static_cast<double>(n / columns_) * height;
+
+            if (tally != tally_state::off) {
+                frames.push_back(
+                    place(tally == tally_state::program ? program_color_ : preview_color_, x, y, width, height));
+            }
+
+            const auto inner_x      = x + border_x;
+            const auto inner_y      = y + border_y;
+            const auto inner_width  = width - 2.0 * border_x;
+            const auto inner_height = height - 2.0 * border_y;
+
+            if (frame) {
+                frames.push_back(place(draw_frame(frame), inner_x, inner_y, inner_width, inner_height));
+            }
+
+            // Bars from the bottom of the cell, from the right edge inwards
+            for (size_t channel = 0; channel < peaks.size(); ++channel) {
+                const auto peak = std::min(1.0, static_cast<double>(peaks[channel]));
+                if (peak <= 0.0) {
+                    continue;
+                }
+
+                const auto bar_width  = meter_width / format_desc_.width;
+                const auto bar_height = inner_height * peak;
+                const auto bar_x      = inner_x + inner_width -
+                                   static_cast<double>(peaks.size() - channel) * (meter_width + meter_margin) /
+                                       format_desc_.width;
+                const auto bar_y = inner_y + inner_height - bar_height;
+
+                // Red from -1 dBFS and yellow from -6 dBFS
+                auto& color = peak >= 0.89 ? meter_clip_color_ : peak >= 0.5 ? meter_warning_color_ : meter_color_;
+                frames.push_back(place(color, bar_x, bar_y, bar_width, bar_height));
+            }
+        }
+
+        last_frame_ = draw_frame(std::move(frames));
+        return last_frame_;
+    }
+
+    draw_frame last_frame(const core::video_field field) override { return draw_frame::still(last_frame_); }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        // TALLY <channel> PROGRAM|PREVIEW|OFF
+        if (params.size() < 3 || !boost::iequals(params.at(0), L"TALLY")) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected TALLY <channel> PROGRAM|PREVIEW|OFF"));
+        }
+
+        auto channel = boost::lexical_cast<int>(params.at(1));
+
+        auto tally = tally_state::off;
+        if (boost::iequals(params.at(2), L"PROGRAM")) {
+            tally = tally_state::program;
+        } else if (boost::iequals(params.at(2), L"PREVIEW")) {
+            tally = tally_state::preview;
+        }
+
+        for (auto& source : sources_) {
+            if (source->channel == channel) {
+                std::lock_guard<std::mutex> lock(source->mutex);
+                source->tally = tally;
+            }
+        }
+
+        return make_ready_future(std::wstring());
+    }
+
+    bool is_ready() override { return true; }
+
+    std::wstring print() const override { return L"multiview[" + std::to_wstring(sources_.size()) + L"]"; }
+
+    std::wstring name() const override { return L"multiview"; }
+
+    core::monitor::state state() const override
+    {
+        core::monitor::state state;
+        state["multiview/columns"] = columns_;
+        state["multiview/rows"]    = rows_;
+        for (size_t n = 0; n < sources_.size(); ++n) {
+            std::lock_guard<std::mutex> lock(sources_[n]->mutex);
+            auto                        prefix = "multiview/source/" + std::to_string(n);
+            state[prefix + "/channel"]         = sources_[n]->channel;
+            state[prefix + "/tally"]           = std::string(to_string(sources_[n]->tally));
+        }
+        return state;
+    }
+};
+
+spl::shared_ptr<frame_producer> create_multiview_producer(const frame_producer_dependencies& dependencies,
+                                                          const std::vector<std::wstring>&   params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"MULTIVIEW")) {
+        return frame_producer::empty();
+    }
+
+    // The channels are listed up to the first named parameter
+    std::vector<int> channels;
+    for (size_t n = 1; n < params.size(); ++n) {
+        int channel;
+        if (!boost::conversion::try_lexical_convert(params.at(n), channel)) {
+            break;
+        }
+        channels.push_back(channel);
+    }
+
+    if (channels.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"MULTIVIEW requires at least one channel"));
+    }
+
+    auto columns = get_param(L"COLUMNS", params, 0);
+    auto meters  = get_param(L"METERS", params, 1) != 0;
+
+    auto producer = spl::make_shared<multiview_producer>(dependencies, channels, columns, meters);
+    producer->connect_slots(dependencies.channels);
+    return producer;
+}
+
+}} // namespace caspar::core
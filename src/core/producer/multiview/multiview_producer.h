@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/producer/frame_producer.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// MULTIVIEW <channel>... [COLUMNS <n>] [METERS 0|1] shows the mixed output of each channel in a cell of a grid, with a
+// tally border and the peak levels of its audio. Frames of channels on the same device are drawn from their mixed
+// texture, so a source costs a single scaled draw rather than mixing its layers again.
+spl::shared_ptr<frame_producer> create_multiview_producer(const frame_producer_dependencies& dependencies,
+                                                          const std::vector<std::wstring>&   params);
+
+}} // namespace caspar::core
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "playlist_producer.h"
+
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer_registry.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <limits>
+
+namespace caspar { namespace core {
+
+class playlist_producer : public frame_producer
+{
+    // A clip of the playlist that is playing or opened ahead of it
+    struct entry
+    {
+        size_t                                       clip;
+        std::future<spl::shared_ptr<frame_producer>> opening;
+        std::shared_ptr<frame_producer>              producer;
+        bool                                         failed = false;
+    };
+
+    const frame_producer_dependencies dependencies_;
+    std::vector<std::wstring>         clips_;
+    const bool                        loop_;
+    const int                         lookahead_;
+
+    std::deque<entry> entries_; // The clip playing first, then those opened ahead in the order they play
+    size_t            next_clip_ = 0;
+    uint64_t          played_    = 0; // Clips that started playing
+    bool              visible_   = true;
+    draw_frame        last_frame_;
+
+    // Clips are opened one at a time, in the order they play, away from the channel. Declared last, so that clips still
+    // opening are finished before the others are released.
+    executor opener_{L"playlist"};
+
+  public:
+    playlist_producer(const frame_producer_dependencies& dependencies,
+                      std::vector<std::wstring>          clips,
+                      bool                               loop,
+                      int                                lookahead)
+        : dependencies_(dependencies)
+        , clips_(std::move(clips))
+        , loop_(loop)
+        , lookahead_(lookahead)
+    {
+        opener_.set_capacity(std::numeric_limits<unsigned int>::max());
+        open_ahead();
+
+        CASPAR_LOG(debug) << print() << L" Initialized";
+    }
+
+    draw_frame receive_impl(const video_field field, int nb_samples) override
+    {
+        // The next clip starts on the tick after the last frame of the one before, never between the fields of a frame
+        if (field != video_field::b) {
+            advance(false);
+        }
+
+        auto current = playing();
+        if (!current) {
+            // The next clip is late to open, which holds the last frame rather than showing nothing
+            return draw_frame::still(last_frame_);
+        }
+
+        auto frame = current->receive(field, nb_samples);
+        if (frame) {
+            last_frame_ = frame;
+        }
+        return frame;
+    }
+
+    draw_frame first_frame(const video_field field) override
+    {
+        auto current = playing();
+        return current ? current->first_frame(field) : draw_frame{};
+    }
+
+    draw_frame last_frame(const video_field field) override
+    {
+        auto current = playing();
+        return current ? current->last_frame(field) : draw_frame::still(last_frame_);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        if (!params.empty() && boost::iequals(params.at(0), L"APPEND")) {
+            if (params.size() < 2) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected APPEND \"<clip> [params]\""));
+            }
+            // A playlist that had played to its end starts again at the clip appended
+            clips_.insert(clips_.end(), params.begin() + 1, params.end());
+            open_ahead();
+            return make_ready_future(std::wstring());
+        }
+
+        if (!params.empty() && boost::iequals(params.at(0), L"NEXT")) {
+            advance(true);
+            return make_ready_future(std::wstring());
+        }
+
+        auto current = playing();
+        if (!current) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No clip of the playlist is playing"));
+        }
+        return current->call(params);
+    }
+
+    void set_visible(bool visible) override
+    {
+        visible_ = visible;
+        if (auto current = playing()) {
+            current->set_visible(visible_);
+        }
+    }
+
+    void set_budget(const frame_budget& budget) override
+    {
+        if (auto current = playing()) {
+            current->set_budget(budget);
+        }
+    }
+
+    uint32_t nb_frames() const override
+    {
+        // Only the last clip of a playlist that does not loop ends it
+        if (loop_ || entries_.size() != 1 || next_clip_ < clips_.size()) {
+            return std::numeric_limits<uint32_t>::max();
+        }
+        auto current = playing();
+        return current ? current->nb_frames() : std::numeric_limits<uint32_t>::max();
+    }
+
+    uint32_t frame_number() const override
+    {
+        auto current = playing();
+        return current ? current->frame_number() : 0;
+    }
+
+    bool is_ready() override
+    {
+        auto current = playing();
+        return current && current->is_ready();
+    }
+
+    std::wstring print() const override
+    {
+        return L"playlist[" + std::to_wstring(clips_.size()) + L"|" + std::to_wstring(lookahead_) + L"]";
+    }
+
+    std::wstring name() const override { return L"playlist"; }
+
+    monitor::state state() const override
+    {
+        monitor::state state;
+        if (auto current = playing()) {
+            state = current->state();
+        }
+
+        state["playlist/clips"]     = static_cast<int>(clips_.size());
+        state["playlist/played"]    = played_;
+        state["playlist/loop"]      = loop_;
+        state["playlist/lookahead"] = lookahead_;
+
+        for (size_t n = 0; n < entries_.size(); ++n) {
+            auto& entry              = entries_[n];
+            auto  prefix             = "playlist/item/" + std::to_string(n);
+            state[prefix + "/clip"]  = clips_.at(entry.clip);
+            state[prefix + "/index"] = static_cast<int>(entry.clip);
+            state[prefix + "/state"] = std::string(entry_state(entry, n == 0));
+        }
+        return state;
+    }
+
+  private:
+    std::shared_ptr<frame_producer> playing() const
+    {
+        return entries_.empty() ? nullptr : entries_.front().producer;
+    }
+
+    static const char* entry_state(const entry& entry, bool front)
+    {
+        if (entry.failed) {
+            return "failed";
+        }
+        if (!entry.producer) {
+            return "opening";
+        }
+        if (front) {
+            return "playing";
+        }
+        return entry.producer->is_ready() ? "ready" : "buffering";
+    }
+
+    static bool ended(frame_producer& producer)
+    {
+        auto nb_frames = producer.nb_frames();
+        return nb_frames != std::numeric_limits<uint32_t>::max() && producer.frame_number() >= nb_frames;
+    }
+
+    // Takes the producers of the clips that finished opening, and moves on from the clip playing when it ended or skip
+    // is set. Clips that failed to open are passed over.
+    void advance(bool skip)
+    {
+        auto previous = playing();
+
+        for (auto& entry : entries_) {
+            if (!entry.opening.valid() ||
+                entry.opening.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                continue;
+            }
+            try {
+                entry.producer = entry.opening.get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(warning) << print() << L" Passed over " << clips_.at(entry.clip)
+                                    << L", which failed to open.";
+                entry.failed = true;
+            }
+        }
+
+        // The last clip of a playlist that does not loop stays on its last frame, as a layer does with a clip, until
+        // more are appended
+        auto       current = playing();
+        const auto last    = entries_.size() == 1 && !loop_ && next_clip_ >= clips_.size();
+        if (current && (skip || (!last && ended(*current)))) {
+            entries_.pop_front();
+        }
+
+        while (!entries_.empty() && entries_.front().failed) {
+            entries_.pop_front();
+        }
+
+        open_ahead();
+
+        auto next = playing();
+        if (next && next != previous) {
+            next->set_visible(visible_);
+            played_ += 1;
+        }
+    }
+
+    void open_ahead()
+    {
+        if (loop_ && next_clip_ >= clips_.size()) {
+            next_clip_ = 0;
+        }
+
+        while (static_cast<int>(entries_.size()) <= lookahead_ && next_clip_ < clips_.size()) {
+            entry entry;
+            entry.clip = next_clip_++;
+
+            auto dependencies = dependencies_;
+            auto params       = clips_.at(entry.clip);
+            entry.opening     = opener_.begin_invoke(
+                [=] { return dependencies.producer_registry->create_producer(dependencies, params); });
+            entries_.push_back(std::move(entry));
+
+            if (loop_ && next_clip_ >= clips_.size()) {
+                next_clip_ = 0;
+            }
+        }
+    }
+};
+
+spl::shared_ptr<frame_producer> create_playlist_producer(const frame_producer_dependencies& dependencies,
+                                                         const std::vector<std::wstring>&   params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"PLAYLIST")) {
+        return frame_producer::empty();
+    }
+
+    // Each clip is a single parameter, quoted along with its own parameters, and the named ones are the playlist's
+    std::vector<std::wstring> clips;
+    for (size_t n = 1; n < params.size(); ++n) {
+        if (boost::iequals(params.at(n), L"LOOP")) {
+            continue;
+        }
+        if (boost::iequals(params.at(n), L"LOOKAHEAD")) {
+            n += 1;
+            continue;
+        }
+        clips.push_back(params.at(n));
+    }
+
+    if (clips.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"PLAYLIST requires at least one clip"));
+    }
+
+    auto loop      = contains_param(L"LOOP", params);
+    auto lookahead = std::clamp(get_param(L"LOOKAHEAD", params, 2), 1, 16);
+
+    return spl::make_shared<playlist_producer>(dependencies, std::move(clips), loop, lookahead);
+}
+
+}} // namespace caspar::core
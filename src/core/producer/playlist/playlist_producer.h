@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/producer/frame_producer.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// PLAYLIST "<clip> [params]"... [LOOP] [LOOKAHEAD <n>] plays the clips back to back. The next n clips are opened and
+// buffered while the current one plays, so that each starts on the tick after the last frame of the one before, and a
+// clip that fails to open is passed over without a gap. CALL APPEND "<clip> [params]" adds a clip and CALL NEXT skips
+// to the next one, any other call goes to the clip playing.
+spl::shared_ptr<frame_producer> create_playlist_producer(const frame_producer_dependencies& dependencies,
+                                                         const std::vector<std::wstring>&   params);
+
+}} // namespace caspar::core
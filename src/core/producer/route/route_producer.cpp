@@ -27,89 +27,25 @@
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
-#include <core/frame/frame_visitor.h>
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/frame_rate_converter.h>
+#include <core/producer/stage.h>
 #include <core/video_channel.h>
 
 #include <boost/regex.hpp>
 #include <boost/signals2.hpp>
 
-#include <tbb/concurrent_queue.h>
-
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
 #include <optional>
-#include <stack>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace caspar { namespace core {
 
-class fix_stream_tag : public frame_visitor
-{
-    const void*                                                route_producer_ptr_;
-    std::stack<std::pair<frame_transform, std::vector<draw_frame>>> frames_stack_;
-    std::optional<const_frame>                                 upd_frame_;
-    
-    fix_stream_tag(const fix_stream_tag&);
-    fix_stream_tag& operator=(const fix_stream_tag&);
-
-  public:
-    fix_stream_tag(void* stream_tag)
-        : route_producer_ptr_(stream_tag)
-    {
-        frames_stack_ = std::stack<std::pair<frame_transform, std::vector<draw_frame>>>();
-        frames_stack_.emplace(frame_transform{}, std::vector<draw_frame>());
-    }
-
-    void push(const frame_transform& transform) {
-        frames_stack_.emplace(transform, std::vector<core::draw_frame>());
-    }
-
-    void visit(const const_frame& frame) {
-        // Get original tag from the frame
-        const void* source_tag = frame.stream_tag();
-        
-        // Calculate a unique but stable tag for this source
-        // This calculation will always produce the same result for the same inputs
-        intptr_t base_addr = reinterpret_cast<intptr_t>(route_producer_ptr_);
-        intptr_t source_addr = reinterpret_cast<intptr_t>(source_tag);
-        // Use XOR to create a unique value that combines route producer and source identities
-        intptr_t unique_value = base_addr ^ source_addr ^ 0xDEADBEEF; // Constant helps avoid collisions
-        const void* unique_tag = reinterpret_cast<const void*>(unique_value);
-        
-        // Apply the tag to the frame
-        upd_frame_ = frame.with_tag(unique_tag);
-    }
-
-    void pop() {
-        auto popped = frames_stack_.top();
-        frames_stack_.pop();
-
-        if (upd_frame_ != std::nullopt) {
-            auto new_frame        = draw_frame(std::move(*upd_frame_));
-            upd_frame_            = std::nullopt;
-            new_frame.transform() = popped.first;
-            frames_stack_.top().second.push_back(std::move(new_frame));
-        } else {
-            auto new_frame        = draw_frame(std::move(popped.second));
-            new_frame.transform() = popped.first;
-            frames_stack_.top().second.push_back(new_frame);
-        }
-    }
-
-    draw_frame operator()(draw_frame frame) {
-        frame.accept(*this);
-
-        auto popped = frames_stack_.top();
-        frames_stack_.pop();
-        draw_frame result = draw_frame(std::move(popped.second));
-
-        frames_stack_ = std::stack<std::pair<frame_transform, std::vector<draw_frame>>>();
-        frames_stack_.emplace(frame_transform{}, std::vector<draw_frame>());
-        return result;
-    }
-};
-
 class route_producer
     : public frame_producer
     , public route_control
@@ -117,101 +53,211 @@ class route_producer
 {
     spl::shared_ptr<diagnostics::graph> graph_;
 
-    tbb::concurrent_bounded_queue<std::pair<core::draw_frame, core::draw_frame>> buffer_;
-
-    caspar::timer produce_timer_;
     caspar::timer consume_timer_;
 
     std::shared_ptr<route> route_;
     const video_format_desc format_desc_;
 
     std::optional<std::pair<core::draw_frame, core::draw_frame>> frame_;
+    std::optional<std::pair<core::draw_frame, core::draw_frame>> shown_; // frame_, converted to this channel
     int                                                          source_channel_;
     int                                                          source_layer_;
-    fix_stream_tag                                               tag_fix_;
     core::video_format_desc                                      source_format_;
-    bool                                                         is_cross_channel_ = false;
+    std::atomic<bool>                                            is_cross_channel_{false};
+
+    // Frames are read from the mailbox of the route at the tick of this channel, and kept with the time they were
+    // published. Routes within a channel take the single frame published earlier in the same tick. Of frames of another
+    // channel, the newest one that is older than the latency is shown. This repeats or skips frames to follow the clock
+    // of this channel, rather than dropping them whenever the two channels drift in phase, or is blended with the
+    // frame after it by the converter.
+    struct timed_frames
+    {
+        std::chrono::steady_clock::time_point         time;
+        std::pair<core::draw_frame, core::draw_frame> frames;
+    };
+    static constexpr size_t                   max_timed_frames = route_mailbox::capacity;
+    const std::chrono::steady_clock::duration latency_;
+    std::mutex                                timed_mutex_;
+    std::deque<timed_frames>                  timed_;
+    size_t                                    buffer_size_;
+    std::uint64_t                             read_ = 0; // The sequence of the last frame read from the mailbox
+    std::chrono::steady_clock::time_point     published_;
+    std::chrono::steady_clock::time_point     frame_time_; // When frame_ was published
+    const frame_rate_converter                converter_;
 
     boost::signals2::scoped_connection connection_;
 
     int get_source_channel() const override { return source_channel_; }
     int get_source_layer() const override { return source_layer_; }
 
-    // set the buffer depth to 2 for cross-channel routes, 1 otherwise
+    // Routes within a channel are published earlier in the same tick and use a single frame buffer
     void set_cross_channel(bool cross) override
     {
+        std::lock_guard<std::mutex> lock(timed_mutex_);
+
         is_cross_channel_ = cross;
+        timed_.clear();
         if (cross) {
-            buffer_.set_capacity(2);
             source_format_ = route_->format_desc;
         } else {
-            buffer_.set_capacity(1);
+            buffer_size_   = 1;
             source_format_ = core::video_format_desc();
         }
     }
 
   public:
-    route_producer(std::shared_ptr<route> route, video_format_desc format_desc, int buffer, int source_channel, int source_layer)
+    route_producer(std::shared_ptr<route> route,
+                   video_format_desc      format_desc,
+                   int                    buffer,
+                   double                 latency,
+                   int                    source_channel,
+                   int                    source_layer,
+                   frame_rate_conversion  conversion)
         : route_(route)
         , format_desc_(format_desc)
         , source_channel_(source_channel)
         , source_layer_(source_layer)
-        , tag_fix_(this)
+        , latency_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(latency / format_desc.fps)))
+        , buffer_size_(buffer > 0 ? buffer : 1)
+        , read_(route_->mailbox.newest())
+        , converter_(conversion)
     {
         graph_ = spl::make_shared<diagnostics::graph>();
-        buffer_.set_capacity(buffer > 0 ? buffer : 1);
 
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("buffered-frames", diagnostics::color(0.5f, 0.8f, 1.0f));
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
         CASPAR_LOG(debug) << print() << L" Initialized";
     }
 
-    void connect_slot()
+    std::pair<core::draw_frame, core::draw_frame> wrap(const core::draw_frame& frame1, const core::draw_frame& frame2)
+    {
+        // Wrapping the frame also makes it a real frame when it is empty (otherwise the layer gets confused). The tag
+        // namespace lets the audio mixer distinguish between the source frame and the routed frame, without rewriting
+        // the tags of the whole tree.
+        auto frame1b = core::draw_frame::push(frame1);
+        frame1b.transform().audio_transform.tag_namespace = this;
+
+        auto frame2b = frame1b;
+        if (frame2) {
+            // For interlaced formats, field B gets the same namespace. Otherwise the frame is repeated instead of
+            // showing black.
+            frame2b = core::draw_frame::push(frame2);
+            frame2b.transform().audio_transform.tag_namespace = this;
+        }
+
+        return std::make_pair(frame1b, frame2b);
+    }
+
+    // Reads the frames published since the last read. Called with timed_mutex_ held.
+    void pull()
+    {
+        const auto newest = route_->mailbox.newest();
+        if (newest - read_ > route_mailbox::capacity) {
+            // Nothing has been taken for a while, e.g. while the layer is paused
+            read_ = newest - route_mailbox::capacity;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        for (; read_ < newest; ++read_) {
+            auto entry = route_->mailbox.get(read_ + 1);
+            if (!entry) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                continue;
+            }
+
+            if (published_.time_since_epoch().count() > 0) {
+                graph_->set_value("produce-time",
+                                  std::chrono::duration<double>(entry->time - published_).count() *
+                                      route_->format_desc.fps * 0.5);
+            }
+            published_ = entry->time;
+
+            timed_.push_back(timed_frames{entry->time, wrap(entry->frame1, entry->frame2)});
+        }
+
+        const auto capacity = is_cross_channel_ ? max_timed_frames : buffer_size_;
+        while (timed_.size() > capacity) {
+            timed_.pop_front();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+    }
+
+    // Routes the mixed output of the channel rather than its layers, so that it is drawn from the texture the source
+    // channel rendered instead of being mixed again, see video_channel::mixed
+    void connect_mixed(video_channel& channel)
     {
         auto weak_self = weak_from_this();
         connection_ =
-            route_->signal.connect([weak_self](const core::draw_frame& frame1, const core::draw_frame& frame2) {
+            channel.mixed().connect([weak_self](const core::const_frame& frame1, const core::const_frame& frame2) {
                 if (auto self = weak_self.lock()) {
-                    auto frame1b = frame1;
-                    if (!frame1b) {
-                        // We got a frame, so ensure it is a real frame (otherwise the layer gets confused)
-                        frame1b = core::draw_frame::push(frame1);
-                    }
-
-                    // Update the tag in the frame to allow the audio mixer to distinguish between the source frame and the routed frame
-                    frame1b = self->tag_fix_(frame1b);
-
-                    auto frame2b = frame2;
-                    if (!frame2b) {
-                        // Ensure that any interlaced channel will repeat frames instead of showing black.
-                        frame2b = frame1b;
-                    } else {
-                        // For interlaced formats, ensure field B gets the proper tag as well
-                        frame2b = self->tag_fix_(frame2b);
-                    }
+                    // The mixed audio is interleaved for the source channel, which may differ from this one
+                    auto audio_channels = self->route_->format_desc.audio_channels;
 
-                    if (!self->buffer_.try_push(std::make_pair(frame1b, frame2b))) {
-                        self->graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                    draw_frame field2;
+                    if (frame2) {
+                        field2 = draw_frame(frame2.with_audio(frame2.audio_data(), audio_channels));
                     }
-                    self->graph_->set_value("produce-time",
-                                            self->produce_timer_.elapsed() * self->route_->format_desc.fps * 0.5);
-                    self->produce_timer_.restart();
+                    // Mixed frames are timed by the tick they were mixed on, which the render pipeline delays
+                    self->route_->mailbox.publish(draw_frame(frame1.with_audio(frame1.audio_data(), audio_channels)),
+                                                  field2,
+                                                  frame1.timestamps().mixed);
                 }
             });
     }
 
+    // Moves on to the next frame to show, if there is one
+    bool take()
+    {
+        std::lock_guard<std::mutex> lock(timed_mutex_);
+
+        pull();
+
+        if (!is_cross_channel_) {
+            if (timed_.empty()) {
+                return false;
+            }
+            frame_ = std::move(timed_.front().frames);
+            shown_ = frame_;
+            timed_.pop_front();
+            return true;
+        }
+
+        const auto due = std::chrono::steady_clock::now() - latency_;
+
+        bool taken = false;
+        while (!timed_.empty() && timed_.front().time <= due) {
+            frame_      = std::move(timed_.front().frames);
+            frame_time_ = timed_.front().time;
+            timed_.pop_front();
+            taken = true;
+        }
+        graph_->set_value("buffered-frames", static_cast<double>(timed_.size()) / max_timed_frames);
+
+        // Converted on every tick, as the weights of a blend move on even while the frames stay the same
+        if (frame_) {
+            if (timed_.empty()) {
+                shown_ = frame_;
+            } else {
+                auto& next = timed_.front();
+                shown_     = std::make_pair(
+                    converter_.convert(frame_->first, frame_time_, next.frames.first, next.time, due),
+                    converter_.convert(frame_->second, frame_time_, next.frames.second, next.time, due));
+            }
+        }
+        return taken;
+    }
+
     draw_frame last_frame(const core::video_field field) override
     {
         if (!frame_) {
-            std::pair<core::draw_frame, core::draw_frame> frame;
-            if (buffer_.try_pop(frame)) {
-                frame_ = frame;
-            }
+            take();
         }
 
         if (!frame_) {
@@ -236,25 +282,23 @@ class route_producer
         }
 
         if (field == core::video_field::a || field == core::video_field::progressive) {
-            std::pair<core::draw_frame, core::draw_frame> frame;
-            if (!buffer_.try_pop(frame)) {
+            // Frames of a slower channel are expected to repeat
+            if (!take() && (!is_cross_channel_ || source_format_.fps >= format_desc_.fps)) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
-            } else {
-                frame_ = frame;
             }
         }
 
         graph_->set_value("consume-time", consume_timer_.elapsed() * route_->format_desc.fps * 0.5);
         consume_timer_.restart();
 
-        if (!frame_) {
+        if (!shown_) {
             return core::draw_frame{};
         }
 
         if (field == core::video_field::b) {
-            return frame_->second;
+            return shown_->second;
         } else {
-            return frame_->first;
+            return shown_->first;
         }
     }
 
@@ -273,6 +317,11 @@ class route_producer
             state["route/layer"] = source_layer_;
         }
 
+        if (is_cross_channel_) {
+            state["route/latency"]               = std::chrono::duration<double>(latency_).count();
+            state["route/frame-rate-conversion"] = to_string(converter_.conversion());
+        }
+
         return state;
     }
 };
@@ -308,9 +357,27 @@ spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_pr
     }
 
     auto buffer = get_param(L"BUFFER", params, 0);
-    auto rp     = spl::make_shared<route_producer>((*channel_it)->route(layer, mode), dependencies.format_desc, buffer, channel, layer);
-    rp->connect_slot();
-    return rp;
+
+    // Frames of this channel that a route from another channel trails its source by
+    auto latency = get_param(L"LATENCY", params, 1.0);
+
+    // How frames of a channel at another rate are converted, REPEAT, BLEND or MOTION
+    auto conversion = frame_rate_conversion_from_string(get_param(L"FRC", params, std::wstring(L"REPEAT")));
+
+    if (layer < 0 && contains_param(L"MIXED", params)) {
+        // Not registered with the channel, which would otherwise forward its layers as well
+        auto route         = std::make_shared<core::route>();
+        route->format_desc = (*channel_it)->stage()->video_format_desc();
+        route->name        = std::to_wstring(channel) + L"/mixed";
+
+        auto rp = spl::make_shared<route_producer>(
+            route, dependencies.format_desc, buffer, latency, channel, layer, conversion);
+        rp->connect_mixed(**channel_it);
+        return rp;
+    }
+
+    return spl::make_shared<route_producer>(
+        (*channel_it)->route(layer, mode), dependencies.format_desc, buffer, latency, channel, layer, conversion);
 }
 
 }} // namespace caspar::core
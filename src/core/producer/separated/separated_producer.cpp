@@ -29,6 +29,8 @@
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
 
+#include <cstdint>
+#include <cstdlib>
 #include <future>
 
 namespace caspar { namespace core {
@@ -57,6 +59,8 @@ struct frame_pair
 
 class separated_producer : public frame_producer
 {
+    static constexpr int max_catch_up = 2;
+
     monitor::state state_;
 
     spl::shared_ptr<frame_producer> fill_producer_;
@@ -83,6 +87,18 @@ class separated_producer : public frame_producer
         return draw_frame::mask(fill_producer_->first_frame(field), key_producer_->first_frame(field));
     }
 
+    void set_visible(bool visible) override
+    {
+        fill_producer_->set_visible(visible);
+        key_producer_->set_visible(visible);
+    }
+
+    void set_budget(const frame_budget& budget) override
+    {
+        fill_producer_->set_budget(budget);
+        key_producer_->set_budget(budget);
+    }
+
     draw_frame receive_impl(const core::video_field field, int nb_samples) override
     {
         CASPAR_SCOPE_EXIT
@@ -108,6 +124,24 @@ class separated_producer : public frame_producer
             return core::draw_frame{};
         }
 
+        // The clips are decoded apart, and one may skip a frame that the other shows. The one that fell behind catches
+        // up within the tick, so that key and fill never drift apart. Larger gaps are left alone, as they are where
+        // one of them looped.
+        for (int n = 0; n < max_catch_up; ++n) {
+            auto gap = static_cast<std::int64_t>(fill_producer_->frame_number()) -
+                       static_cast<std::int64_t>(key_producer_->frame_number());
+            if (gap == 0 || std::abs(gap) > max_catch_up) {
+                break;
+            }
+
+            auto& behind = gap < 0 ? fill : key;
+            auto  next   = (gap < 0 ? fill_producer_ : key_producer_)->receive(field, nb_samples);
+            if (!next) {
+                break;
+            }
+            behind = std::move(next);
+        }
+
         auto frame = draw_frame::mask(fill, key);
 
         fill_.set(field, draw_frame{});
@@ -25,17 +25,29 @@
 
 #include "layer.h"
 
+#include "../diagnostics/cpu_cost.h"
 #include "../frame/draw_frame.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/executor.h>
 #include <common/future.h>
+#include <common/task_arena.h>
+#include <common/timer.h>
 
 #include <core/frame/frame_transform.h>
 #include <core/producer/route/route_producer.h>
 
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 #include <boost/range/adaptors.hpp>
 
+#include <tbb/blocked_range.h>
+#include <tbb/concurrent_unordered_map.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <future>
 #include <map>
@@ -43,20 +55,71 @@
 
 namespace caspar { namespace core {
 
+namespace {
+
+// Whether anything of a layer drawn with the transform can be seen. The clip is a rectangle of the canvas, so what is
+// clipped away entirely is never seen, wherever the frame is placed. Keys mask what follows them, so they count.
+bool is_visible(const image_transform& transform)
+{
+    if (transform.is_key)
+        return true;
+
+    if (transform.opacity <= 0.0 || transform.fill_scale[0] == 0.0 || transform.fill_scale[1] == 0.0)
+        return false;
+
+    if (!transform.enable_geometry_modifiers)
+        return true;
+
+    const auto& clip = transform.clip_translation;
+    const auto& size = transform.clip_scale;
+    const auto& crop = transform.crop;
+    return size[0] > 0.0 && size[1] > 0.0 && clip[0] < 1.0 && clip[1] < 1.0 && clip[0] + size[0] > 0.0 &&
+           clip[1] + size[1] > 0.0 && crop.lr[0] > crop.ul[0] && crop.lr[1] > crop.ul[1];
+}
+
+} // namespace
+
 struct stage::impl : public std::enable_shared_from_this<impl>
 {
-    int                                 channel_index_;
-    spl::shared_ptr<diagnostics::graph> graph_;
-    monitor::state                      state_;
-    std::map<int, layer>                layers_;
-    std::map<int, tweened_transform>    tweens_;
-    std::set<int>                       routeSources;
+    int                                         channel_index_;
+    spl::shared_ptr<caspar::diagnostics::graph> graph_;
+    monitor::state                              state_;
+    std::map<int, layer>                        layers_;
+    std::set<int>                               routeSources;
+
+    // Tweens are kept sorted by layer index in contiguous storage, and only those still animating are ticked
+    boost::container::flat_map<int, tweened_transform> tweens_;
+    boost::container::flat_set<int>                    animating_;
+
+    // Route topology is derived from the foreground producer of every layer. It is cached and only rebuilt when a
+    // layer is changed through the stage, or when a layer's foreground producer has changed on its own.
+    uint64_t                                           layers_version_   = 0;
+    uint64_t                                           topology_version_ = ~0ull;
+    std::vector<std::pair<int, const frame_producer*>> topology_key_;
+    std::vector<std::pair<int, const frame_producer*>> current_key_;
+    std::map<int, std::pair<int, int>>                 routed_layers_;
+    std::vector<std::pair<int, bool>>                  layer_order_;
 
     mutable std::mutex      format_desc_mutex_;
     core::video_format_desc format_desc_;
 
     executor   executor_{L"stage " + std::to_wstring(channel_index_)};
     std::mutex lock_;
+    double     command_wait_ = 0.0; // Only touched on the executor
+
+    // The latest values set through control, of fill, anchor, rotation, opacity and volume in that order. Values are
+    // stored before the bit of their property is set, so a frame that reads them while they are set again may mix the
+    // two, which the next frame corrects.
+    struct control_slot
+    {
+        std::atomic<uint32_t>              changed{0};
+        std::array<std::atomic<double>, 9> values{};
+    };
+    tbb::concurrent_unordered_map<int, control_slot> controls_;
+
+    mutable std::mutex                              scheduled_mutex_;
+    std::multimap<uint64_t, std::function<void()>> scheduled_;
+    uint64_t                                        frame_number_ = 0;
 
   private:
     void orderSourceLayers(std::vector<std::pair<int, bool>>&        layerVec,
@@ -99,28 +162,79 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         }
     }
 
+    void update_route_topology()
+    {
+        current_key_.clear();
+        for (auto& p : layers_)
+            current_key_.emplace_back(p.first, p.second.foreground().get());
+
+        if (topology_version_ == layers_version_ && current_key_ == topology_key_)
+            return;
+
+        std::swap(topology_key_, current_key_);
+        topology_version_ = layers_version_;
+
+        // build a map of layers that are sourced from route producers
+        routed_layers_.clear();
+        for (auto& p : layers_) {
+            auto producer = p.second.foreground();
+            if (0 == producer->name().compare(L"route")) {
+                try {
+                    auto rc       = spl::dynamic_pointer_cast<core::route_control>(producer);
+                    auto srcChan  = rc->get_source_channel();
+                    auto srcLayer = rc->get_source_layer();
+                    routed_layers_.emplace(p.first, std::make_pair(srcChan, srcLayer));
+                    rc->set_cross_channel(channel_index_ != srcChan);
+                } catch (std::bad_cast) {
+                    CASPAR_LOG(error) << "Failed to cast route producer";
+                }
+            }
+        }
+
+        // sort layer order so that sources get pulled before routes
+        layer_order_.clear();
+        if (routed_layers_.empty()) {
+            for (auto& p : layers_)
+                layer_order_.emplace_back(p.first, true);
+        } else {
+            for (auto& p : layers_)
+                orderSourceLayers(layer_order_, routed_layers_, p.first, 0);
+        }
+    }
+
     layer& get_layer(int index)
     {
         auto it = layers_.find(index);
         if (it == std::end(layers_)) {
             it = layers_.emplace(index, layer(video_format_desc())).first;
         }
+        layers_version_++;
         return it->second;
     }
 
   public:
-    impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph, const core::video_format_desc& format_desc)
+    impl(int                                         channel_index,
+         spl::shared_ptr<caspar::diagnostics::graph> graph,
+         const core::video_format_desc&              format_desc)
         : channel_index_(channel_index)
         , graph_(std::move(graph))
         , format_desc_(format_desc)
     {
+        graph_->set_color("command-wait", caspar::diagnostics::color(0.9f, 0.6f, 0.2f));
     }
 
     const stage_frames operator()(uint64_t                                     frame_number,
                                   std::vector<int>&                            fetch_background,
-                                  std::function<void(int, const layer_frame&)> routesCb)
+                                  const std::vector<int>&                      route_sources,
+                                  std::function<void(int, const layer_frame&)> routesCb,
+                                  const frame_budget&                          budget)
     {
-        return executor_.invoke([=] {
+        run_scheduled(frame_number);
+
+        auto tick = [=] {
+            caspar::diagnostics::trace::frame_scope  frame(static_cast<std::int64_t>(frame_number));
+            caspar::diagnostics::trace::scoped_event event("stage");
+
             std::map<int, layer_frame> frames;
             stage_frames               result = {};
 
@@ -132,45 +246,27 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             auto field1        = is_interlaced ? video_field::a : video_field::progressive;
 
             try {
-                for (auto& t : tweens_)
-                    t.second.tick(1);
+                tick_tweens();
+                apply_controls();
 
-                // build a map of layers that are sourced from route producers
-                std::map<int, std::pair<int, int>> routed_layers;
-                for (auto& p : layers_) {
-                    auto producer = std::move(p.second.foreground());
-                    if (0 == producer->name().compare(L"route")) {
-                        try {
-                            auto rc       = spl::dynamic_pointer_cast<core::route_control>(producer);
-                            auto srcChan  = rc->get_source_channel();
-                            auto srcLayer = rc->get_source_layer();
-                            routed_layers.emplace(p.first, std::make_pair(srcChan, srcLayer));
-                            rc->set_cross_channel(channel_index_ != srcChan);
-                        } catch (std::bad_cast) {
-                            CASPAR_LOG(error) << "Failed to cast route producer";
-                        }
-                    }
-                }
+                update_route_topology();
 
-                // sort layer order so that sources get pulled before routes
-                std::vector<std::pair<int, bool>> layerVec;
-                for (auto& p : layers_)
-                    orderSourceLayers(layerVec, routed_layers, p.first, 0);
+                const auto& routed_layers = routed_layers_;
+                const auto& layerVec      = layer_order_;
 
                 // when running interlaced, both fields are be pulled at once.
                 // This will risk some stutter for freshly created producers, but it lets us tick at 25hz and avoids
                 // amcp changes starting on the second field
 
-                for (auto& l : layerVec) {
-                    auto p = layers_.find(l.first);
-                    if (p == layers_.end())
-                        continue;
-
-                    auto& layer = p->second;
-                    auto& tween = tweens_[p->first];
-
+                auto receive_layer = [&](const std::pair<int, bool>& l, layer& layer, tweened_transform& tween) {
                     auto has_background_route =
-                        std::find(fetch_background.begin(), fetch_background.end(), p->first) != fetch_background.end();
+                        std::find(fetch_background.begin(), fetch_background.end(), l.first) != fetch_background.end();
+
+                    // A route takes the frames of its source without the transform of the layer, so they are seen
+                    const auto is_route_source =
+                        std::find(route_sources.begin(), route_sources.end(), l.first) != route_sources.end();
+                    layer.set_visible(is_route_source || is_visible(tween.fetch().image_transform));
+                    layer.set_budget(budget);
 
                     layer_frame res = {};
                     if (l.second) {
@@ -193,16 +289,90 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                             res.background2 = layer.receive_background(video_field::b, result.nb_samples);
                     }
 
-                    frames[p->first] = res;
-
                     // push received foreground frame to any configured route producer
-                    routesCb(p->first, res);
+                    routesCb(l.first, res);
+
+                    return res;
+                };
+
+                // Layers that are not fed by a route on this channel don't depend on each other, so they can be
+                // produced concurrently. Same-channel routes are pulled afterwards, in the order computed above, so
+                // that their sources have always been signalled first.
+                struct pending_layer
+                {
+                    std::pair<int, bool> entry;
+                    layer*               target;
+                    tweened_transform*   tween;
+                    layer_frame          frame;
+                    double               time;
+                };
+
+                auto receive_pending = [&](pending_layer& pending) {
+                    // Charged to the layer on whichever thread of the arena it is received
+                    diagnostics::scoped_call_context save;
+                    diagnostics::call_context::for_thread().video_channel = channel_index_;
+                    diagnostics::call_context::for_thread().layer         = pending.entry.first;
+                    diagnostics::call_context::for_thread().port          = -1;
+                    diagnostics::scoped_cpu_cost cost;
+
+                    caspar::timer receive_timer;
+                    pending.frame = receive_layer(pending.entry, *pending.target, *pending.tween);
+                    pending.time  = receive_timer.elapsed();
+                };
+
+                // tweens_ must not be modified while producing in parallel, and inserting into it moves existing
+                // entries, so every layer gets its entry before any pointer into it is taken
+                for (auto& l : layerVec) {
+                    if (layers_.count(l.first) > 0)
+                        tweens_.try_emplace(l.first);
+                }
+
+                std::vector<pending_layer> independent;
+                std::vector<pending_layer> dependent;
+                for (auto& l : layerVec) {
+                    auto p = layers_.find(l.first);
+                    if (p == layers_.end())
+                        continue;
+
+                    auto route_it     = routed_layers.find(l.first);
+                    auto is_dependent = route_it != routed_layers.end() && route_it->second.first == channel_index_;
+
+                    (is_dependent ? dependent : independent)
+                        .push_back(pending_layer{l, &p->second, &tweens_.at(l.first), layer_frame{}, 0.0});
+                }
+
+                if (independent.size() > 1) {
+                    run_in_arena(task_kind::realtime, [&] {
+                        tbb::parallel_for(tbb::blocked_range<size_t>(0, independent.size(), 1),
+                                          [&](const tbb::blocked_range<size_t>& r) {
+                                              for (auto i = r.begin(); i != r.end(); ++i)
+                                                  receive_pending(independent[i]);
+                                          });
+                    });
+                } else {
+                    for (auto& pending : independent)
+                        receive_pending(pending);
+                }
+
+                for (auto& pending : dependent)
+                    receive_pending(pending);
+
+                std::map<int, double> times;
+                for (auto& pending : independent) {
+                    frames[pending.entry.first] = std::move(pending.frame);
+                    times[pending.entry.first]  = pending.time;
+                }
+                for (auto& pending : dependent) {
+                    frames[pending.entry.first] = std::move(pending.frame);
+                    times[pending.entry.first]  = pending.time;
                 }
 
                 for (auto& p : frames) {
-                    result.frames.push_back(p.second.foreground1);
+                    result.layers.push_back(p.first);
+                    result.layer_times.push_back(times[p.first]);
+                    result.frames.push_back(std::move(p.second.foreground1));
                     if (is_interlaced)
-                        result.frames2.push_back(p.second.foreground2);
+                        result.frames2.push_back(std::move(p.second.foreground2));
                 }
 
                 {
@@ -217,16 +387,170 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                 }
 
                 monitor::state state;
+                state["frame"] = frame_number;
                 for (auto& p : layers_) {
                     state["layer"][p.first] = p.second.state();
                 }
                 state_ = std::move(state);
             } catch (...) {
                 layers_.clear();
+                layers_version_++;
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
 
+            // Longest time a command waited in the queue since the previous tick
+            graph_->set_value("command-wait", std::min(1.0, command_wait_ * format_desc_.hz));
+            command_wait_ = 0.0;
+
             return result;
+        };
+
+        // The tick runs ahead of queued commands, which are then processed together before the next tick
+        return executor_.invoke(tick, task_priority::high);
+    }
+
+    // Runs on the channel thread while the executor is free, so that commands waited for by the scheduled functions
+    // are processed before the tick is
+    void run_scheduled(uint64_t frame_number)
+    {
+        std::vector<std::function<void()>> due;
+        {
+            std::lock_guard<std::mutex> lock(scheduled_mutex_);
+            frame_number_ = frame_number;
+
+            auto end = scheduled_.upper_bound(frame_number);
+            for (auto it = scheduled_.begin(); it != end; ++it) {
+                due.push_back(std::move(it->second));
+            }
+            scheduled_.erase(scheduled_.begin(), end);
+        }
+
+        for (auto& func : due) {
+            try {
+                func();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void schedule(uint64_t frame_number, std::function<void()> func)
+    {
+        std::lock_guard<std::mutex> lock(scheduled_mutex_);
+        if (frame_number <= frame_number_) {
+            CASPAR_LOG(warning) << L"stage " << channel_index_ << L" Scheduled frame " << frame_number
+                                << L" has already been produced, running on frame " << frame_number_ + 1 << L".";
+        }
+        scheduled_.emplace(frame_number, std::move(func));
+    }
+
+    uint64_t frame_number() const
+    {
+        std::lock_guard<std::mutex> lock(scheduled_mutex_);
+        return frame_number_;
+    }
+
+    void tick_tweens()
+    {
+        for (auto it = animating_.begin(); it != animating_.end();) {
+            auto tween = tweens_.find(*it);
+            if (tween == tweens_.end()) {
+                it = animating_.erase(it);
+                continue;
+            }
+
+            tween->second.tick(1);
+            it = tween->second.is_animating() ? std::next(it) : animating_.erase(it);
+        }
+    }
+
+    static std::pair<int, int> control_values(layer_control property)
+    {
+        switch (property) {
+            case layer_control::fill:
+                return {0, 4};
+            case layer_control::anchor:
+                return {4, 2};
+            case layer_control::rotation:
+                return {6, 1};
+            case layer_control::opacity:
+                return {7, 1};
+            default:
+                return {8, 1};
+        }
+    }
+
+    void control(int index, layer_control property, const std::array<double, 4>& values)
+    {
+        auto& slot  = controls_[index];
+        auto  range = control_values(property);
+        for (int n = 0; n < range.second; ++n) {
+            slot.values[range.first + n].store(values[n], std::memory_order_relaxed);
+        }
+        slot.changed.fetch_or(1u << static_cast<int>(property), std::memory_order_release);
+    }
+
+    // Runs on the channel thread at the start of each tick
+    void apply_controls()
+    {
+        static const double  PI = 3.141592653589793;
+        static const tweener linear;
+
+        for (auto& entry : controls_) {
+            auto changed = entry.second.changed.exchange(0, std::memory_order_acquire);
+            if (changed == 0) {
+                continue;
+            }
+
+            auto value = [&](int n) { return entry.second.values[n].load(std::memory_order_relaxed); };
+            auto is    = [&](layer_control property) { return (changed & 1u << static_cast<int>(property)) != 0; };
+
+            auto& tween     = tweens_[entry.first];
+            auto  transform = tween.fetch();
+            auto& image     = transform.image_transform;
+            if (is(layer_control::fill)) {
+                image.fill_translation = {value(0), value(1)};
+                image.fill_scale       = {value(2), value(3)};
+            }
+            if (is(layer_control::anchor)) {
+                image.anchor = {value(4), value(5)};
+            }
+            if (is(layer_control::rotation)) {
+                image.angle = value(6) * PI / 180.0;
+            }
+            if (is(layer_control::opacity)) {
+                image.opacity = value(7);
+            }
+            if (is(layer_control::volume)) {
+                transform.audio_transform.volume = value(8);
+            }
+            tween = tweened_transform(transform, transform, 0, linear);
+        }
+    }
+
+    void set_tween(int index, tweened_transform tween)
+    {
+        tweens_[index] = std::move(tween);
+        animating_.insert(index);
+    }
+
+    void swap_tweens(int index, int other_index)
+    {
+        // Insert both before taking references, an insert may move the other entry
+        tweens_.try_emplace(index);
+        tweens_.try_emplace(other_index);
+        std::swap(tweens_.at(index), tweens_.at(other_index));
+        animating_.insert(index);
+        animating_.insert(other_index);
+    }
+
+    template <typename Func>
+    auto begin_invoke(Func&& func)
+    {
+        caspar::timer queued;
+        return executor_.begin_invoke([this, queued, func = std::forward<Func>(func)]() mutable {
+            command_wait_ = std::max(command_wait_, queued.elapsed());
+            return func();
         });
     }
 
@@ -237,19 +561,19 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             // Tell the compositor that these are layers, matching what normal rendering does
             frame.transform().image_transform.layer_depth = 1;
         }
-        return core::draw_frame(frames);
+        return core::draw_frame(std::move(frames));
     }
 
     std::future<void>
     apply_transforms(const std::vector<std::tuple<int, stage::transform_func_t, unsigned int, tweener>>& transforms)
     {
-        return executor_.begin_invoke([=] {
+        return begin_invoke([=] {
             for (auto& transform : transforms) {
                 auto& tween = tweens_[std::get<0>(transform)];
                 auto  src   = tween.fetch();
                 auto  dst   = std::get<1>(transform)(tween.dest());
-                tweens_[std::get<0>(transform)] =
-                    tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
+                set_tween(std::get<0>(transform),
+                          tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform)));
             }
         });
     }
@@ -259,66 +583,75 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                       unsigned int                   mix_duration,
                                       const tweener&                 tween)
     {
-        return executor_.begin_invoke([=] {
-            auto src       = tweens_[index].fetch();
-            auto dst       = transform(src);
-            tweens_[index] = tweened_transform(src, dst, mix_duration, tween);
+        return begin_invoke([=] {
+            auto src = tweens_[index].fetch();
+            auto dst = transform(src);
+            set_tween(index, tweened_transform(src, dst, mix_duration, tween));
         });
     }
 
     std::future<void> clear_transforms(int index)
     {
-        return executor_.begin_invoke([=] { tweens_.erase(index); });
+        return begin_invoke([=] { tweens_.erase(index); });
     }
 
     std::future<void> clear_transforms()
     {
-        return executor_.begin_invoke([=] { tweens_.clear(); });
+        return begin_invoke([=] {
+            tweens_.clear();
+            animating_.clear();
+        });
     }
 
     std::future<frame_transform> get_current_transform(int index)
     {
-        return executor_.begin_invoke([=] { return tweens_[index].fetch(); });
+        return begin_invoke([=] { return tweens_[index].fetch(); });
     }
 
     std::future<void> load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
     {
-        return executor_.begin_invoke([=] { get_layer(index).load(producer, preview, auto_play); });
+        return begin_invoke([=] { get_layer(index).load(producer, preview, auto_play); });
     }
 
     std::future<void> preview(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).preview(); });
+        return begin_invoke([=] { get_layer(index).preview(); });
     }
 
     std::future<void> pause(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).pause(); });
+        return begin_invoke([=] { get_layer(index).pause(); });
     }
 
     std::future<void> resume(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).resume(); });
+        return begin_invoke([=] { get_layer(index).resume(); });
     }
 
     std::future<void> play(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).play(); });
+        return begin_invoke([=] { get_layer(index).play(); });
     }
 
     std::future<void> stop(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).stop(); });
+        return begin_invoke([=] { get_layer(index).stop(); });
     }
 
     std::future<void> clear(int index)
     {
-        return executor_.begin_invoke([=] { layers_.erase(index); });
+        return begin_invoke([=] {
+            layers_.erase(index);
+            layers_version_++;
+        });
     }
 
     std::future<void> clear()
     {
-        return executor_.begin_invoke([=] { layers_.clear(); });
+        return begin_invoke([=] {
+            layers_.clear();
+            layers_version_++;
+        });
     }
 
     std::future<void> swap_layers(const std::shared_ptr<stage>& other, bool swap_transforms)
@@ -334,9 +667,13 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             auto other_layers = other_impl->layers_ | boost::adaptors::map_values;
 
             std::swap(layers_, other_impl->layers_);
+            layers_version_++;
+            other_impl->layers_version_++;
 
-            if (swap_transforms)
+            if (swap_transforms) {
                 std::swap(tweens_, other_impl->tweens_);
+                std::swap(animating_, other_impl->animating_);
+            }
         };
 
         return invoke_both(other, func);
@@ -344,11 +681,11 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> swap_layer(int index, int other_index, bool swap_transforms)
     {
-        return executor_.begin_invoke([=] {
+        return begin_invoke([=] {
             std::swap(get_layer(index), get_layer(other_index));
 
             if (swap_transforms)
-                std::swap(tweens_[index], tweens_[other_index]);
+                swap_tweens(index, other_index);
         });
     }
 
@@ -363,47 +700,52 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             auto& other_layer = other_impl->get_layer(other_index);
 
             std::swap(my_layer, other_layer);
+            other_impl->layers_version_++;
 
             if (swap_transforms) {
                 auto& my_tween    = tweens_[index];
                 auto& other_tween = other_impl->tweens_[other_index];
                 std::swap(my_tween, other_tween);
+                animating_.insert(index);
+                other_impl->animating_.insert(other_index);
             }
         };
 
         return invoke_both(other, func);
     }
 
+    // Runs between the ticks of both stages. The inner one runs ahead of its queued commands, so that the outer one is
+    // held for at most the task the other stage is running, which leaves it the time to tick without missing a frame.
     std::future<void> invoke_both(const std::shared_ptr<stage>& other, std::function<void()> func)
     {
         auto other_impl = other->impl_;
 
         if (other_impl->channel_index_ < channel_index_) {
-            return other_impl->executor_.begin_invoke([=] { executor_.invoke(func); });
+            return other_impl->executor_.begin_invoke([=] { executor_.invoke(func, task_priority::high); });
         }
 
-        return executor_.begin_invoke([=] { other_impl->executor_.invoke(func); });
+        return begin_invoke([=] { other_impl->executor_.invoke(func, task_priority::high); });
     }
 
     std::future<std::shared_ptr<frame_producer>> foreground(int index)
     {
-        return executor_.begin_invoke(
+        return begin_invoke(
             [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).foreground(); });
     }
 
     std::future<std::shared_ptr<frame_producer>> background(int index)
     {
-        return executor_.begin_invoke(
+        return begin_invoke(
             [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).background(); });
     }
 
     std::future<std::wstring> call(int index, const std::vector<std::wstring>& params)
     {
-        return flatten(executor_.begin_invoke([=] { return get_layer(index).foreground()->call(params).share(); }));
+        return flatten(begin_invoke([=] { return get_layer(index).foreground()->call(params).share(); }));
     }
     std::future<std::wstring> callbg(int index, const std::vector<std::wstring>& params)
     {
-        return flatten(executor_.begin_invoke([=] { return get_layer(index).background()->call(params).share(); }));
+        return flatten(begin_invoke([=] { return get_layer(index).background()->call(params).share(); }));
     }
 
     std::unique_lock<std::mutex> get_lock() { return std::move(std::unique_lock<std::mutex>(lock_)); }
@@ -416,18 +758,21 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> video_format_desc(const core::video_format_desc& format_desc)
     {
-        return executor_.begin_invoke([=] {
+        return begin_invoke([=] {
             {
                 std::lock_guard<std::mutex> lock(format_desc_mutex_);
                 format_desc_ = format_desc;
             }
 
             layers_.clear();
+            layers_version_++;
         });
     }
 };
 
-stage::stage(int channel_index, spl::shared_ptr<diagnostics::graph> graph, const core::video_format_desc& format_desc)
+stage::stage(int                                         channel_index,
+             spl::shared_ptr<caspar::diagnostics::graph> graph,
+             const core::video_format_desc&              format_desc)
     : impl_(new impl(channel_index, std::move(graph), format_desc))
 {
 }
@@ -483,9 +828,11 @@ std::future<std::shared_ptr<frame_producer>> stage::foreground(int index) { retu
 std::future<std::shared_ptr<frame_producer>> stage::background(int index) { return impl_->background(index); }
 const stage_frames                           stage::operator()(uint64_t                                     frame_number,
                                      std::vector<int>&                            fetch_background,
-                                     std::function<void(int, const layer_frame&)> routesCb)
+                                     const std::vector<int>&                      route_sources,
+                                     std::function<void(int, const layer_frame&)> routesCb,
+                                     const frame_budget&                          budget)
 {
-    return (*impl_)(frame_number, fetch_background, routesCb);
+    return (*impl_)(frame_number, fetch_background, route_sources, routesCb, budget);
 }
 core::monitor::state    stage::state() const { return impl_->state_; }
 core::video_format_desc stage::video_format_desc() const { return impl_->video_format_desc(); }
@@ -494,6 +841,15 @@ std::future<void>       stage::video_format_desc(const core::video_format_desc&
     return impl_->video_format_desc(format_desc);
 }
 std::unique_lock<std::mutex> stage::get_lock() const { return impl_->get_lock(); }
+void stage::schedule(uint64_t frame_number, std::function<void()> func)
+{
+    impl_->schedule(frame_number, std::move(func));
+}
+uint64_t                     stage::frame_number() const { return impl_->frame_number(); }
+void stage::control(int index, layer_control property, const std::array<double, 4>& values)
+{
+    impl_->control(index, property, values);
+}
 std::future<void>            stage::execute(std::function<void()> func)
 {
     func();
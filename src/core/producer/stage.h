@@ -31,6 +31,7 @@
 #include <core/frame/draw_frame.h>
 #include <core/video_format.h>
 
+#include <array>
 #include <functional>
 #include <future>
 #include <map>
@@ -60,6 +61,18 @@ struct stage_frames
     int                     nb_samples;
     std::vector<draw_frame> frames;
     std::vector<draw_frame> frames2;
+    std::vector<int>        layers;      // The layer index of each of frames and frames2
+    std::vector<double>     layer_times; // The seconds each of layers took to receive its frames
+};
+
+// Properties of a layer that are set directly rather than through a command, see stage::control
+enum class layer_control
+{
+    fill,     // x, y, x-scale, y-scale
+    anchor,   // x, y
+    rotation, // Degrees
+    opacity,
+    volume,
 };
 
 /**
@@ -118,7 +131,9 @@ class stage final : public stage_base
 
     const stage_frames operator()(uint64_t                                     frame_number,
                                   std::vector<int>&                            fetch_background,
-                                  std::function<void(int, const layer_frame&)> routesCb);
+                                  const std::vector<int>&                      route_sources,
+                                  std::function<void(int, const layer_frame&)> routesCb,
+                                  const frame_budget&                          budget);
 
     std::future<void>            apply_transforms(const std::vector<transform_tuple_t>& transforms) override;
     std::future<void>            apply_transform(int                     index,
@@ -154,6 +169,18 @@ class stage final : public stage_base
     std::future<void>            execute(std::function<void()> k) override;
     std::unique_lock<std::mutex> get_lock() const;
 
+    // Runs func on the channel thread right before frame_number is produced, or before the next frame when it has
+    // already been. func may wait for commands on the stage, which are then applied to exactly that frame.
+    void schedule(uint64_t frame_number, std::function<void()> func);
+
+    // The number of the frame last produced
+    uint64_t frame_number() const;
+
+    // Sets a property of a layer from the next frame on, replacing any tween of the layer, for control at a high rate
+    // such as from OSC. It is lock free and only allocates the first time a layer is controlled. Of the values set
+    // before a frame only the latest is applied, so that a frame never waits for them.
+    void control(int index, layer_control property, const std::array<double, 4>& values);
+
     core::video_format_desc video_format_desc() const;
     std::future<void>       video_format_desc(const core::video_format_desc& format_desc);
 
@@ -31,6 +31,7 @@
 
 #include <common/scope_exit.h>
 
+#include <deque>
 #include <future>
 
 namespace caspar { namespace core {
@@ -57,6 +58,13 @@ struct frame_pair
     }
 };
 
+// A mask frame and the overlay frame shown with it
+struct sting_frames
+{
+    draw_frame mask;
+    draw_frame overlay;
+};
+
 class sting_producer : public frame_producer
 {
     monitor::state  state_;
@@ -68,6 +76,9 @@ class sting_producer : public frame_producer
     frame_pair mask_;
     frame_pair overlay_;
 
+    // Received ahead of the start of the sting, per field
+    std::deque<sting_frames> prerolled_[2];
+
     const sting_info info_;
 
     spl::shared_ptr<frame_producer> dst_producer_     = frame_producer::empty();
@@ -91,6 +102,22 @@ class sting_producer : public frame_producer
 
     void leading_producer(const spl::shared_ptr<frame_producer>& producer) override { src_producer_ = producer; }
 
+    void set_visible(bool visible) override
+    {
+        src_producer_->set_visible(visible);
+        dst_producer_->set_visible(visible);
+        mask_producer_->set_visible(visible);
+        overlay_producer_->set_visible(visible);
+    }
+
+    void set_budget(const frame_budget& budget) override
+    {
+        src_producer_->set_budget(budget);
+        dst_producer_->set_budget(budget);
+        mask_producer_->set_budget(budget);
+        overlay_producer_->set_budget(budget);
+    }
+
     spl::shared_ptr<frame_producer> following_producer() const override
     {
         auto duration = target_duration();
@@ -121,6 +148,39 @@ class sting_producer : public frame_producer
         return autoplay2;
     }
 
+    static int field_index(const core::video_field field) { return field == video_field::b ? 1 : 0; }
+
+    // Receives the mask and overlay frames of a field until both are there, as one may be ready before the other
+    bool receive_mask_and_overlay(const core::video_field field, int nb_samples)
+    {
+        if (!mask_.get(field)) {
+            mask_.set(field, mask_producer_->receive(field, nb_samples));
+        }
+
+        bool expecting_overlay = overlay_producer_ != core::frame_producer::empty();
+        if (expecting_overlay && !overlay_.get(field)) {
+            overlay_.set(field, overlay_producer_->receive(field, nb_samples));
+        }
+
+        return mask_.get(field) && (!expecting_overlay || overlay_.get(field));
+    }
+
+    // Called on every tick while the sting is loaded in the background. Masks and overlays are commonly clips that
+    // would otherwise start decoding with the transition, along with the clip it brings in.
+    void preroll(const core::video_field field)
+    {
+        auto& prerolled = prerolled_[field_index(field)];
+        if (prerolled.size() < info_.preroll && receive_mask_and_overlay(field, 0)) {
+            prerolled.push_back(sting_frames{mask_.get(field), overlay_.get(field)});
+            mask_.set(field, draw_frame{});
+            overlay_.set(field, draw_frame{});
+        }
+
+        state_                       = dst_producer_->state();
+        state_["transition/type"]    = std::string("sting");
+        state_["transition/preroll"] = {static_cast<int>(prerolled.size()), static_cast<int>(info_.preroll)};
+    }
+
     draw_frame receive_impl(const core::video_field field, int nb_samples) override
     {
         auto duration = target_duration();
@@ -162,20 +222,12 @@ class sting_producer : public frame_producer
             }
         }
 
-        auto mask = mask_.get(field);
-        if (!mask) {
-            mask = mask_producer_->receive(field, nb_samples);
-            mask_.set(field, mask);
-        }
-        bool expecting_overlay = overlay_producer_ != core::frame_producer::empty();
-        auto overlay           = overlay_.get(field);
-        if (expecting_overlay && !overlay) {
-            overlay = overlay_producer_->receive(field, nb_samples);
-            overlay_.set(field, overlay);
-        }
+        auto& prerolled              = prerolled_[field_index(field)];
+        bool  mask_and_overlay_valid = !prerolled.empty() || receive_mask_and_overlay(field, nb_samples);
+        auto  mask                   = prerolled.empty() ? mask_.get(field) : prerolled.front().mask;
+        auto  overlay                = prerolled.empty() ? overlay_.get(field) : prerolled.front().overlay;
 
         // Not started, and mask or overlay is not ready
-        bool mask_and_overlay_valid = mask && (!expecting_overlay || overlay);
         if (current_frame_ == 0 && !mask_and_overlay_valid) {
             src_.set(field, draw_frame{});
             return src;
@@ -194,8 +246,12 @@ class sting_producer : public frame_producer
         src_.set(field, draw_frame{});
 
         if (mask_and_overlay_valid) {
-            mask_.set(field, draw_frame{});
-            overlay_.set(field, draw_frame{});
+            if (prerolled.empty()) {
+                mask_.set(field, draw_frame{});
+                overlay_.set(field, draw_frame{});
+            } else {
+                prerolled.pop_front();
+            }
 
             current_frame_ += 1;
         }
@@ -203,7 +259,11 @@ class sting_producer : public frame_producer
         return res;
     }
 
-    core::draw_frame first_frame(const core::video_field field) override { return dst_producer_->first_frame(field); }
+    core::draw_frame first_frame(const core::video_field field) override
+    {
+        preroll(field);
+        return dst_producer_->first_frame(field);
+    }
 
     uint32_t nb_frames() const override { return dst_producer_->nb_frames(); }
 
@@ -266,7 +326,11 @@ class sting_producer : public frame_producer
 
     monitor::state state() const override { return state_; }
 
-    bool is_ready() override { return dst_producer_->is_ready(); }
+    // The mask and overlay are waited for as well, so that the sting starts on the frame it is played
+    bool is_ready() override
+    {
+        return dst_producer_->is_ready() && mask_producer_->is_ready() && overlay_producer_->is_ready();
+    }
 };
 
 spl::shared_ptr<frame_producer> create_sting_producer(const frame_producer_dependencies&     dependencies,
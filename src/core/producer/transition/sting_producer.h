@@ -37,6 +37,9 @@ struct sting_info
     uint32_t     trigger_point       = 0;
     uint32_t     audio_fade_start    = 0;
     uint32_t     audio_fade_duration = UINT32_MAX;
+
+    // Mask and overlay frames received while the sting is loaded in the background, so that it starts on time
+    uint32_t preroll = 4;
 };
 
 spl::shared_ptr<frame_producer> create_sting_producer(const frame_producer_dependencies&     dependencies,
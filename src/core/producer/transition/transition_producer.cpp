@@ -89,6 +89,18 @@ class transition_producer : public frame_producer
 
     void leading_producer(const spl::shared_ptr<frame_producer>& producer) override { src_producer_ = producer; }
 
+    void set_visible(bool visible) override
+    {
+        src_producer_->set_visible(visible);
+        dst_producer_->set_visible(visible);
+    }
+
+    void set_budget(const frame_budget& budget) override
+    {
+        src_producer_->set_budget(budget);
+        dst_producer_->set_budget(budget);
+    }
+
     [[nodiscard]] spl::shared_ptr<frame_producer> following_producer() const override
     {
         return current_frame_ >= info_.duration && dst_is_ready_ ? dst_producer_ : core::frame_producer::empty();
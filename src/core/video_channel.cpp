@@ -26,33 +26,57 @@
 
 #include "video_format.h"
 
+#include "consumer/channel_clock.h"
 #include "consumer/channel_info.h"
 #include "consumer/output.h"
 #include "frame/draw_frame.h"
 #include "frame/frame.h"
 #include "frame/frame_factory.h"
 #include "mixer/mixer.h"
+#include "producer/frame_producer.h"
 #include "producer/stage.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/executor.h>
 #include <common/timer.h>
 
 #include <core/diagnostics/call_context.h>
+#include <core/diagnostics/cpu_cost.h>
+#include <core/diagnostics/frame_history.h>
 #include <core/mixer/image/image_mixer.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <mutex>
+#include <queue>
 #include <string>
 #include <unordered_map>
 #include <utility>
 
 namespace caspar { namespace core {
 
+void route_mailbox::publish(draw_frame frame1, draw_frame frame2, std::chrono::steady_clock::time_point time)
+{
+    auto sequence = published_.load(std::memory_order_relaxed) + 1;
+    std::atomic_store(&slots_[sequence % capacity],
+                      std::shared_ptr<const entry>(new entry{sequence, time, std::move(frame1), std::move(frame2)}));
+    published_.store(sequence, std::memory_order_release);
+}
+
+std::shared_ptr<const route_mailbox::entry> route_mailbox::get(std::uint64_t sequence) const
+{
+    auto slot = std::atomic_load(&slots_[sequence % capacity]);
+    return slot && slot->sequence == sequence ? slot : nullptr;
+}
+
 bool operator<(const route_id& a, const route_id& b) { return a.mode + (a.index << 2) < b.mode + (b.index << 2); }
 
 struct video_channel::impl final
 {
-    monitor::state state_;
+    mutable std::mutex state_mutex_;
+    monitor::state     state_;
 
     const channel_info channel_info_;
 
@@ -71,15 +95,44 @@ struct video_channel::impl final
 
     std::function<void(core::monitor::state)> tick_;
 
+    const int                     pipeline_depth_;
+    std::unique_ptr<executor>     consume_executor_;
+    std::queue<std::future<void>> in_flight_;
+
+    const bool    route_only_;
+    bool          route_only_idle_   = false;
+    bool          idle_initialising_ = false; // As published while idle
+    channel_clock route_only_clock_;
+
+    // When the tick was due by the clock of the channel, see next_budget
+    std::chrono::steady_clock::time_point scheduled_;
+    static constexpr int                  max_behind = 8;
+
+    const bool   damage_tracking_;
+    const double render_scale_;
+
+    std::unique_ptr<core::diagnostics::frame_history> history_;
+
     std::map<route_id, std::weak_ptr<core::route>> routes_;
     std::mutex                                     routes_mutex_;
 
+    // Bumped whenever a route is created or destroyed, so that the tick only rebuilds its view of routes on change
+    std::shared_ptr<std::atomic<uint64_t>> routes_version_          = std::make_shared<std::atomic<uint64_t>>(0);
+    uint64_t                               routes_snapshot_version_ = ~0ull;
+    std::vector<std::pair<route_id, std::weak_ptr<core::route>>> routes_snapshot_;
+    std::vector<int>                                             background_routes_;
+    std::vector<int>                                             route_sources_;
+
+    boost::signals2::signal<void(const_frame, const_frame)> mixed_;
+
     std::atomic<bool> abort_request_{false};
+    std::atomic<bool> initialising_{false};
     std::thread       thread_;
 
+    // Only reads the snapshot, which is rebuilt on the channel thread before the stage is ticked. This makes it safe
+    // to call from the stage while it produces layers in parallel.
     std::function<void(int, const layer_frame&)> routesCb = [&](int layer, const layer_frame& layer_frame) {
-        std::lock_guard<std::mutex> lock(routes_mutex_);
-        for (auto& r : routes_) {
+        for (auto& r : routes_snapshot_) {
             // if this layer is the source for this route, push the frame to the route producers
             if (layer == r.first.index) {
                 auto route = r.second.lock();
@@ -87,12 +140,14 @@ struct video_channel::impl final
                     continue;
 
                 if (r.first.index == -1) {
-                    route->signal(layer_frame.foreground1, layer_frame.foreground2);
+                    route->mailbox.publish(layer_frame.foreground1, layer_frame.foreground2);
                 } else if (r.first.mode == route_mode::background ||
                            (r.first.mode == route_mode::next && layer_frame.has_background)) {
-                    route->signal(draw_frame::pop(layer_frame.background1), draw_frame::pop(layer_frame.background2));
+                    route->mailbox.publish(draw_frame::pop(layer_frame.background1),
+                                           draw_frame::pop(layer_frame.background2));
                 } else {
-                    route->signal(draw_frame::pop(layer_frame.foreground1), draw_frame::pop(layer_frame.foreground2));
+                    route->mailbox.publish(draw_frame::pop(layer_frame.foreground1),
+                                           draw_frame::pop(layer_frame.foreground2));
                 }
             }
         }
@@ -103,14 +158,33 @@ struct video_channel::impl final
          const core::video_format_desc&            format_desc,
          color_space                               default_color_space,
          std::unique_ptr<image_mixer>              image_mixer,
-         std::function<void(core::monitor::state)> tick)
-        : channel_info_(index, image_mixer->depth(), default_color_space)
-        , output_(graph_, format_desc, channel_info_)
+         std::function<void(core::monitor::state)> tick,
+         const video_channel_options&              options)
+        : channel_info_(index, image_mixer->depth(), default_color_space, options.offline, image_mixer->transfer())
+        , output_(graph_,
+                  format_desc,
+                  channel_info_,
+                  options.drop_late_consumers ? consumer_deadline_policy::drop : consumer_deadline_policy::wait,
+                  options.consumer_budget)
         , image_mixer_(std::move(image_mixer))
-        , mixer_(index, graph_, image_mixer_)
+        , mixer_(index, graph_, image_mixer_, options.mixer_depth, options.audio_meter_rate)
         , stage_(std::make_shared<core::stage>(index, graph_, format_desc))
         , tick_(std::move(tick))
+        , pipeline_depth_(std::max(0, options.pipeline_depth))
+        , route_only_(options.route_only)
+        , damage_tracking_(options.damage_tracking)
+        , render_scale_(options.render_scale)
     {
+        if (options.frame_history > 0.0) {
+            auto capacity = static_cast<size_t>(std::ceil(options.frame_history * format_desc.hz));
+            history_      = std::make_unique<core::diagnostics::frame_history>(index, capacity);
+        }
+
+        if (pipeline_depth_ > 0) {
+            consume_executor_ =
+                std::make_unique<executor>(L"channel-consume-" + std::to_wstring(channel_info_.index));
+        }
+
         graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("mix-time", caspar::diagnostics::color(1.0f, 0.0f, 0.9f, 0.8f));
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
@@ -119,6 +193,19 @@ struct video_channel::impl final
         graph_->set_text(print());
         caspar::diagnostics::register_graph(graph_);
 
+        if (pipeline_depth_ > 0) {
+            CASPAR_LOG(info) << print() << " Running pipelined with a latency of " << pipeline_depth_
+                             << " frame(s).";
+        }
+
+        if (route_only_) {
+            CASPAR_LOG(info) << print() << " Skipping mixing while no consumers are attached.";
+        }
+
+        if (channel_info_.offline) {
+            CASPAR_LOG(info) << print() << " Running offline, as fast as the producers and consumers allow.";
+        }
+
         CASPAR_LOG(info) << print() << " Successfully Initialized.";
 
         thread_ = std::thread([=] {
@@ -131,63 +218,66 @@ struct video_channel::impl final
 
                     frame_counter_ += 1;
 
-                    caspar::timer frame_timer;
+                    caspar::diagnostics::trace::frame_scope  frame(frame_counter_);
+                    caspar::diagnostics::trace::scoped_event tick_event("tick");
 
-                    // Determine all layers that need a frame from the background producer
-                    std::vector<int> background_routes = {};
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
+                    caspar::timer frame_timer;
 
-                        for (auto& r : routes_) {
-                            // Ensure pointer is still valid
-                            if (!r.second.lock())
-                                continue;
+                    update_routes_snapshot();
 
-                            if (r.first.mode != route_mode::foreground) {
-                                background_routes.push_back(r.first.index);
-                            }
-                        }
-                    }
+                    const auto budget = next_budget(format_desc);
 
                     // Produce
                     caspar::timer produce_timer;
-                    auto          stage_frames = (*stage_)(frame_counter_, background_routes, routesCb);
+                    auto          produce_start = caspar::diagnostics::trace::begin();
+                    auto          stage_frames =
+                        (*stage_)(frame_counter_, background_routes_, route_sources_, routesCb, budget);
+                    caspar::diagnostics::trace::end("produce", produce_start);
                     graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.hz * 0.5);
 
-                    // This is a little race prone, but at worst a new consumer will start with a frame of black
-                    bool has_consumers = output_.consumer_count() > 0;
-
-                    // Mix
-                    caspar::timer mix_timer;
-                    auto          mixed_frame =
-                        has_consumers ? mixer_(stage_frames.frames, stage_frames.format_desc, stage_frames.nb_samples)
-                                               : const_frame{};
-                    auto mixed_frame2 =
-                        has_consumers && stage_frames.format_desc.field_count == 2
-                            ? mixer_(stage_frames.frames2, stage_frames.format_desc, stage_frames.nb_samples)
-                            : const_frame{};
-                    graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.hz * 0.5);
-
-                    // Consume
-                    caspar::timer consume_timer;
-                    output_(mixed_frame, mixed_frame2, stage_frames.format_desc);
-                    graph_->set_value("consume-time", consume_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
-
-                    graph_->set_value("frame-time", frame_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
-
-                    monitor::state state = {};
-                    state["stage"]       = stage_->state();
-                    state["mixer"]       = mixer_.state();
-                    state["output"]      = output_.state();
-                    state["framerate"]   = {stage_frames.format_desc.framerate.numerator() *
-                                                stage_frames.format_desc.field_count,
-                                            stage_frames.format_desc.framerate.denominator()};
-                    state["format"]      = stage_frames.format_desc.name;
-                    state_               = state;
-
-                    caspar::timer osc_timer;
-                    tick_(state_);
-                    graph_->set_value("osc-time", osc_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+                    auto now = std::chrono::system_clock::now().time_since_epoch();
+
+                    core::diagnostics::frame_timing timing;
+                    timing.frame   = frame_counter_;
+                    timing.time    = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+                    timing.produce = produce_timer.elapsed();
+
+                    if (route_only_ && output_.consumer_count() == 0 && mixed_.empty()) {
+                        // Nothing but routes will ever see these frames, and they have already been signalled
+                        drop_route_only_frame(stage_frames.format_desc, frame_timer);
+                        continue;
+                    }
+                    route_only_idle_ = false;
+
+                    // Snapshot the stage state now, so that a pipelined mix/consume reports the frame it is
+                    // actually outputting rather than whatever the stage has moved on to since.
+                    auto stage_state = stage_->state();
+
+                    if (consume_executor_) {
+                        auto task = [this,
+                                     frame_number = frame_counter_,
+                                     frames       = std::move(stage_frames),
+                                     state        = std::move(stage_state),
+                                     timing       = std::move(timing)]() mutable {
+                            caspar::diagnostics::trace::frame_scope frame(frame_number);
+                            try {
+                                caspar::timer frame_timer;
+                                mix_and_consume(std::move(frames), std::move(state), std::move(timing), frame_timer);
+                            } catch (...) {
+                                CASPAR_LOG_CURRENT_EXCEPTION();
+                            }
+                        };
+                        in_flight_.push(consume_executor_->begin_invoke(std::move(task)));
+
+                        // Wait once pipeline_depth frames are in flight, which keeps the added latency fixed.
+                        while (static_cast<int>(in_flight_.size()) > pipeline_depth_) {
+                            in_flight_.front().wait();
+                            in_flight_.pop();
+                        }
+                    } else {
+                        mix_and_consume(
+                            std::move(stage_frames), std::move(stage_state), std::move(timing), frame_timer);
+                    }
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
                 }
@@ -195,11 +285,207 @@ struct video_channel::impl final
         });
     }
 
+    void set_state(const monitor::state& state)
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_ = state;
+    }
+
+    monitor::state get_state() const
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+
+    void drop_route_only_frame(const video_format_desc& format_desc, const caspar::timer& frame_timer)
+    {
+        auto initialising = initialising_.load();
+        if (!route_only_idle_ || initialising != idle_initialising_) {
+            // The channel state is static while idle, so publish it once instead of on every tick
+            monitor::state state = {};
+            state["framerate"]   = {format_desc.framerate.numerator() * format_desc.field_count,
+                                    format_desc.framerate.denominator()};
+            state["format"]      = format_desc.name;
+            state["route_only"]  = true;
+            if (initialising) {
+                state["initialising"] = true;
+            }
+            set_state(state);
+            tick_(state);
+            route_only_idle_   = true;
+            idle_initialising_ = initialising;
+        }
+
+        graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.hz * 0.5);
+
+        if (!channel_info_.offline) {
+            route_only_clock_.tick(format_desc.framerate);
+        }
+    }
+
+    // The clock of the channel runs at its frame rate from its first tick. It never runs ahead of the ticks, so time
+    // the channel is early by, such as while consumers fill their buffers, is not banked. Ticks that start late fall
+    // behind it, by at most max_behind frames, and a sixteenth of that is forgiven on each tick, so that a channel that
+    // stalled once, or that its consumers pace at a fixed offset, is soon no longer behind. Only a channel that keeps
+    // falling further behind stays so.
+    core::frame_budget next_budget(const video_format_desc& format_desc)
+    {
+        core::frame_budget budget;
+        if (channel_info_.offline) {
+            return budget;
+        }
+
+        const auto now    = std::chrono::steady_clock::now();
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / format_desc.hz));
+
+        if (scheduled_.time_since_epoch().count() == 0) {
+            scheduled_ = now - period;
+        }
+        scheduled_ = std::clamp(scheduled_ + period, now - period * max_behind, now);
+        scheduled_ += (now - scheduled_) / 16;
+
+        budget.deadline = scheduled_ + period;
+        budget.behind   = static_cast<int>((now - scheduled_) / period);
+        return budget;
+    }
+
+    void update_routes_snapshot()
+    {
+        if (routes_snapshot_version_ == *routes_version_)
+            return;
+
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+
+        routes_snapshot_version_ = *routes_version_;
+        routes_snapshot_.clear();
+        background_routes_.clear();
+        route_sources_.clear();
+
+        for (auto it = routes_.begin(); it != routes_.end();) {
+            // Forget routes that no longer have any producer attached
+            if (it->second.expired()) {
+                it = routes_.erase(it);
+                continue;
+            }
+
+            routes_snapshot_.emplace_back(it->first, it->second);
+
+            // Routes of a layer take its frames whatever its transform, so the layer has to keep producing them
+            if (it->first.index != -1)
+                route_sources_.push_back(it->first.index);
+
+            // Determine all layers that need a frame from the background producer
+            if (it->first.mode != route_mode::foreground)
+                background_routes_.push_back(it->first.index);
+
+            ++it;
+        }
+    }
+
+    void mix_and_consume(stage_frames                    stage_frames,
+                         monitor::state                  stage_state,
+                         core::diagnostics::frame_timing timing,
+                         const caspar::timer&            frame_timer)
+    {
+        // This is a little race prone, but at worst a new consumer will start with a frame of black
+        bool has_consumers = output_.consumer_count() > 0;
+        bool has_drawers   = !mixed_.empty();
+
+        // Mix
+        caspar::timer mix_timer;
+        auto          mix_start = caspar::diagnostics::trace::begin();
+        auto          request = has_consumers ? output_.request() : output_request{};
+        request.image           = request.image && has_consumers;
+        request.damage_tracking = damage_tracking_;
+        request.scale           = render_scale_;
+        request.texture         = request.texture || has_drawers;
+
+        const_frame mixed_frame;
+        const_frame mixed_frame2;
+        if (has_consumers || has_drawers) {
+            const auto& format = stage_frames.format_desc;
+            if (format.field_count == 2 && request.fields && !request.texture && request.sizes.empty()) {
+                // Both fields are mixed into one image, each drawing only its own lines, which is read back once
+                request.damage_tracking = false;
+
+                const auto  nb_samples = stage_frames.nb_samples;
+                const auto& layers     = stage_frames.layers;
+                mixed_frame  = mixer_(stage_frames.frames, format, nb_samples, request, layers, video_field::a);
+                mixed_frame2 = mixer_(stage_frames.frames2, format, nb_samples, request, layers, video_field::b);
+            } else {
+                mixed_frame =
+                    mixer_(stage_frames.frames, format, stage_frames.nb_samples, request, stage_frames.layers);
+                if (format.field_count == 2) {
+                    mixed_frame2 =
+                        mixer_(stage_frames.frames2, format, stage_frames.nb_samples, request, stage_frames.layers);
+                }
+            }
+        }
+        caspar::diagnostics::trace::end("mix", mix_start);
+        timing.mix = mix_timer.elapsed();
+        graph_->set_value("mix-time", timing.mix * stage_frames.format_desc.hz * 0.5);
+
+        if (has_drawers && mixed_frame) {
+            mixed_(mixed_frame, mixed_frame2);
+        }
+
+        // Consume
+        caspar::timer consume_timer;
+        auto          consume_start = caspar::diagnostics::trace::begin();
+        output_(mixed_frame, mixed_frame2, stage_frames.format_desc);
+        caspar::diagnostics::trace::end("consume", consume_start);
+        timing.consume = consume_timer.elapsed();
+        graph_->set_value("consume-time", timing.consume * stage_frames.format_desc.hz * 0.5);
+
+        timing.total = frame_timer.elapsed();
+        graph_->set_value("frame-time", timing.total * stage_frames.format_desc.hz * 0.5);
+
+        auto timing_listener = core::diagnostics::get_frame_timing_listener();
+        if (history_ || timing_listener) {
+            for (size_t n = 0; n < stage_frames.layers.size() && n < stage_frames.layer_times.size(); ++n) {
+                timing.layers.emplace_back(stage_frames.layers[n], stage_frames.layer_times[n]);
+            }
+            if (has_consumers || has_drawers) {
+                timing.gpu = image_mixer_->gpu_times()["total"];
+            }
+            timing.consumers = output_.timings();
+            if (timing_listener) {
+                (*timing_listener)(channel_info_.index, timing, 1.0 / stage_frames.format_desc.hz);
+            }
+            if (history_) {
+                history_->push(std::move(timing), 1.0 / stage_frames.format_desc.hz);
+            }
+        }
+
+        monitor::state state    = {};
+        state["stage"]          = stage_state;
+        state["mixer"]          = mixer_.state();
+        state["output"]         = output_.state();
+        state["framerate"]      = {stage_frames.format_desc.framerate.numerator() * stage_frames.format_desc.field_count,
+                                   stage_frames.format_desc.framerate.denominator()};
+        state["format"]         = stage_frames.format_desc.name;
+        state["pipeline_depth"] = pipeline_depth_;
+        state["clock"]          = std::string(channel_info_.offline ? "offline" : "realtime");
+        if (initialising_) {
+            state["initialising"] = true;
+        }
+        state["cost"] = cost_state(stage_frames, has_consumers || has_drawers);
+        set_state(state);
+
+        caspar::timer osc_timer;
+        auto          osc_start = caspar::diagnostics::trace::begin();
+        tick_(state);
+        caspar::diagnostics::trace::end("osc", osc_start);
+        graph_->set_value("osc-time", osc_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+    }
+
     ~impl()
     {
         CASPAR_LOG(info) << print() << " Uninitializing.";
         abort_request_ = true;
         thread_.join();
+        consume_executor_.reset();
     }
 
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground)
@@ -212,7 +498,10 @@ struct video_channel::impl final
 
         auto route = routes_[id].lock();
         if (!route) {
-            route              = std::make_shared<core::route>();
+            route = std::shared_ptr<core::route>(new core::route(), [version = routes_version_](core::route* r) {
+                delete r;
+                (*version)++;
+            });
             route->format_desc = stage_->video_format_desc(); // TODO this needs updating whenever the videomode changes
             route->name        = std::to_wstring(channel_info_.index);
             if (index != -1) {
@@ -224,6 +513,7 @@ struct video_channel::impl final
                 route->name += L"/next";
             }
             routes_[id] = route;
+            (*routes_version_)++;
         }
 
         return route;
@@ -234,6 +524,32 @@ struct video_channel::impl final
         return L"video_channel[" + std::to_wstring(channel_info_.index) + L"|" + stage_->video_format_desc().name + L"]";
     }
 
+    // What each producer and consumer cost this frame in milliseconds: the CPU time charged to its layer or port on any
+    // thread, the time its layer took to receive, and the GPU time of drawing the layer
+    monitor::state cost_state(const stage_frames& frames, bool mixed)
+    {
+        monitor::state cost;
+        for (auto& charge : core::diagnostics::take_cpu_costs(channel_info_.index)) {
+            if (charge.layer != -1) {
+                cost["layer"][charge.layer]["cpu"] = charge.seconds * 1000.0;
+            } else if (charge.port != -1) {
+                cost["port"][charge.port]["cpu"] = charge.seconds * 1000.0;
+            }
+        }
+
+        auto gpu_times = mixed ? image_mixer_->gpu_times() : std::map<std::string, double>();
+        for (size_t n = 0; n < frames.layers.size(); ++n) {
+            if (n < frames.layer_times.size()) {
+                cost["layer"][frames.layers[n]]["time"] = frames.layer_times[n] * 1000.0;
+            }
+            auto gpu = gpu_times.find("layer/" + std::to_string(n));
+            if (gpu != gpu_times.end()) {
+                cost["layer"][frames.layers[n]]["gpu"] = gpu->second;
+            }
+        }
+        return cost;
+    }
+
     int index() const { return channel_info_.index; }
 
     channel_info get_consumer_channel_info() const { return channel_info_; }
@@ -243,8 +559,9 @@ video_channel::video_channel(int                                       index,
                              const core::video_format_desc&            format_desc,
                              color_space                               default_color_space,
                              std::unique_ptr<image_mixer>              image_mixer,
-                             std::function<void(core::monitor::state)> tick)
-    : impl_(new impl(index, format_desc, default_color_space, std::move(image_mixer), std::move(tick)))
+                             std::function<void(core::monitor::state)> tick,
+                             const video_channel_options&              options)
+    : impl_(new impl(index, format_desc, default_color_space, std::move(image_mixer), std::move(tick), options))
 {
 }
 video_channel::~video_channel() {}
@@ -257,8 +574,11 @@ output&                             video_channel::output() { return impl_->outp
 spl::shared_ptr<frame_factory>      video_channel::frame_factory() { return impl_->image_mixer_; }
 int                                 video_channel::index() const { return impl_->index(); }
 channel_info         video_channel::get_consumer_channel_info() const { return impl_->get_consumer_channel_info(); };
-core::monitor::state video_channel::state() const { return impl_->state_; }
+core::monitor::state video_channel::state() const { return impl_->get_state(); }
+void                 video_channel::set_initialising(bool initialising) { impl_->initialising_ = initialising; }
 
 std::shared_ptr<route> video_channel::route(int index, route_mode mode) { return impl_->route(index, mode); }
 
+boost::signals2::signal<void(const_frame, const_frame)>& video_channel::mixed() { return impl_->mixed_; }
+
 }} // namespace caspar::core
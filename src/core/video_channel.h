@@ -24,6 +24,7 @@
 #include "fwd.h"
 #include "video_format.h"
 
+#include "frame/draw_frame.h"
 #include "frame/pixel_format.h"
 
 #include "monitor/monitor.h"
@@ -32,6 +33,10 @@
 
 #include <boost/signals2.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
 
 namespace caspar { namespace core {
@@ -51,18 +56,89 @@ struct route_id
     bool const operator==(const route_id& o) { return index == o.index && mode == o.mode; }
 };
 
+// The recent frames of the source of a route, which the source publishes once per tick and every producer of the route
+// reads at its own tick. Publishing is an atomic store into a ring, so the source is not held up by the producers, nor
+// are they by each other.
+class route_mailbox final
+{
+  public:
+    struct entry
+    {
+        std::uint64_t                         sequence;
+        std::chrono::steady_clock::time_point time;
+        draw_frame                            frame1;
+        draw_frame                            frame2;
+    };
+
+    static constexpr std::uint64_t capacity = 64;
+
+    // Only called from one thread at a time, that of the source
+    void publish(draw_frame                            frame1,
+                 draw_frame                            frame2,
+                 std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now());
+
+    // The sequence of the newest frame, 0 before the first
+    std::uint64_t newest() const { return published_.load(std::memory_order_acquire); }
+
+    // The frame with the sequence, or nullptr once a newer one has taken its place in the ring
+    std::shared_ptr<const entry> get(std::uint64_t sequence) const;
+
+  private:
+    std::array<std::shared_ptr<const entry>, capacity> slots_;
+    std::atomic<std::uint64_t>                         published_{0};
+};
+
 struct route
 {
     route()             = default;
     route(const route&) = delete;
-    route(route&&)      = default;
 
     route& operator=(const route&) = delete;
-    route& operator=(route&&)      = default;
 
-    boost::signals2::signal<void(class draw_frame, class draw_frame)> signal;
-    video_format_desc                                                 format_desc;
-    std::wstring                                                      name;
+    route_mailbox     mailbox;
+    video_format_desc format_desc;
+    std::wstring      name;
+};
+
+struct video_channel_options
+{
+    // Number of frames the mix and consume stages may run behind produce. 0 runs the tick serially, while N lets
+    // stage N+1 produce while earlier frames are still being mixed and consumed, at the cost of N frames of latency.
+    int pipeline_depth = 0;
+
+    // Number of frames the mixer renders ahead of the frame it hands to the consumers, so that the GPU readback of a
+    // frame can complete during later ticks.
+    int mixer_depth = 1;
+
+    // While no consumers are attached, frames are only produced and forwarded to routes. Mixing, output and the
+    // per-frame monitor state are skipped, and the channel is paced by a precision timer instead.
+    bool route_only = false;
+
+    // Ticks as fast as the producers and consumers allow instead of at the frame rate, for rendering to file and
+    // automated tests. Consumer clocks and late-consumer are ignored, as every consumer is waited for on every frame,
+    // and producers that can are stepped a frame at a time rather than skipping what is not ready.
+    bool offline = false;
+
+    // When set, a consumer that has not accepted a frame within consumer_budget frame durations stops holding up the
+    // channel. It is marked late and skips frames until it has caught up.
+    bool   drop_late_consumers = false;
+    double consumer_budget     = 1.0;
+
+    // Redraw only the areas of a frame that changed since the previous one, for channels that mostly show static
+    // graphics. Mixed frames list the changed areas in their damage.
+    bool damage_tracking = false;
+
+    // The fraction of the width and height of the video format that layers are drawn at, for preview and multiview
+    // channels that are only ever shown small. The output keeps the size of the video format.
+    double render_scale = 1.0;
+
+    // Times per second the peak and RMS levels of each layer and the loudness of the mix are published to the state,
+    // measured on a worker thread. 0 disables metering.
+    double audio_meter_rate = 0.0;
+
+    // Seconds of per-stage timings to keep, which are written to the log folder when a frame is late or a consumer falls
+    // behind, at most once every 10 seconds. 0 keeps none.
+    double frame_history = 0.0;
 };
 
 class video_channel final
@@ -75,11 +151,16 @@ class video_channel final
                            const video_format_desc&                  format_desc,
                            color_space                               default_color_space,
                            std::unique_ptr<image_mixer>              image_mixer,
-                           std::function<void(core::monitor::state)> on_tick);
+                           std::function<void(core::monitor::state)> on_tick,
+                           const video_channel_options&              options = {});
     ~video_channel();
 
     core::monitor::state state() const;
 
+    // Reported in the state while the consumers and producers of the configuration are set up, which AMCP clients
+    // may connect during
+    void set_initialising(bool initialising);
+
     const std::shared_ptr<core::stage>& stage() const;
     std::shared_ptr<core::stage>&       stage();
     const core::mixer&                  mixer() const;
@@ -95,6 +176,11 @@ class video_channel final
 
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground);
 
+    // Signalled on every tick with the mixed frames, the second being that of the lower field of interlaced formats.
+    // Their opaque holds the mixed image for the channels on the same device to draw without an upload. The channel
+    // mixes while anything is connected, even without consumers.
+    boost::signals2::signal<void(class const_frame, class const_frame)>& mixed();
+
   private:
     struct impl;
     spl::unique_ptr<impl> impl_;
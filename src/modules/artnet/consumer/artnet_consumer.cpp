@@ -24,16 +24,29 @@
 #undef NOMINMAX
 // ^^ This is needed to avoid a conflict between boost asio and other header files defining NOMINMAX
 
+#include "../util/dmx_packet.h"
+
 #include <common/future.h>
 #include <common/log.h>
 #include <common/ptree.h>
 
+#include <core/consumer/channel_clock.h>
 #include <core/consumer/channel_info.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid.hpp>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -45,15 +58,31 @@ namespace caspar { namespace artnet {
 
 struct configuration
 {
-    int            universe = 0;
-    std::wstring   host     = L"127.0.0.1";
-    unsigned short port     = 6454;
+    dmx_protocol   protocol = dmx_protocol::artnet;
+    int            universe = 0; // The first of the universes
+    std::wstring   host;         // Empty for 127.0.0.1 with Art-Net and the multicast group of each universe with sACN
+    unsigned short port = 6454;
 
-    int refreshRate = 10;
+    boost::rational<int>     refresh_rate{10};
+    bool                     lock_to_channel = false;        // Sends once for every frame of the channel instead
+    std::chrono::nanoseconds keepalive_interval{1000000000}; // Unchanged universes are resent this often, 0 always
+
+    std::wstring source_name = L"CasparCG";
+    int          priority    = 100;
 
     std::vector<fixture> fixtures;
 };
 
+// Enough universes for the channels of every fixture
+int count_universes(const std::vector<fixture>& fixtures)
+{
+    int channels = 1;
+    for (auto& fixture : fixtures) {
+        channels = std::max(channels, fixture.startAddress + fixture.fixtureCount * fixture.fixtureChannels);
+    }
+    return (channels + static_cast<int>(DMX_UNIVERSE_SIZE) - 1) / static_cast<int>(DMX_UNIVERSE_SIZE);
+}
+
 struct artnet_consumer : public core::frame_consumer
 {
     const configuration           config;
@@ -69,66 +98,68 @@ struct artnet_consumer : public core::frame_consumer
     {
         socket.open(udp::v4());
 
-        std::string host_ = u8(this->config.host);
-        remote_endpoint =
-            boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(host_), this->config.port);
-
         compute_fixtures();
+
+        universe_count_ = count_universes(this->config.fixtures);
+
+        if (this->config.protocol == dmx_protocol::sacn) {
+            auto cid = boost::uuids::random_generator()();
+            std::copy(cid.begin(), cid.end(), source_.cid);
+            source_.name     = u8(this->config.source_name);
+            source_.priority = this->config.priority;
+        }
+
+        std::string host = u8(this->config.host);
+        if (!host.empty()) {
+            remote_endpoints_.emplace_back(boost::asio::ip::address::from_string(host), this->config.port);
+        } else if (this->config.protocol == dmx_protocol::sacn) {
+            for (int n = 0; n < universe_count_; n++) {
+                auto group = sacn_multicast_address(this->config.universe + n);
+                remote_endpoints_.emplace_back(boost::asio::ip::address::from_string(group), this->config.port);
+            }
+        } else {
+            remote_endpoints_.emplace_back(boost::asio::ip::address::from_string("127.0.0.1"), this->config.port);
+        }
+
+        dmx_data_.resize(universe_count_ * DMX_UNIVERSE_SIZE);
+        sent_data_.resize(universe_count_ * DMX_UNIVERSE_SIZE);
+        sent_time_.resize(universe_count_);
+        packets_.resize(universe_count_ * dmx_packet_size(this->config.protocol));
+        packet_endpoints_.resize(universe_count_);
     }
 
     void initialize(const core::video_format_desc& /*format_desc*/, const core::channel_info& channel_info, int port_index) override
     {
         thread_ = std::thread([this] {
-            long long time      = 1000 / config.refreshRate;
-            auto      last_send = std::chrono::system_clock::now();
+            core::channel_clock clock;
+            std::uint64_t       sampled_frame = 0;
 
             while (!abort_request_) {
                 try {
-                    auto                          now             = std::chrono::system_clock::now();
-                    std::chrono::duration<double> elapsed_seconds = now - last_send;
-                    long long                     elapsed_ms =
-                        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
-
-                    long long sleep_time = time - elapsed_ms * 1000;
-                    if (sleep_time > 0)
-                        std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time));
-
-                    last_send = now;
-
-                    frame_mutex_.lock();
-                    auto frame = last_frame_;
+                    core::const_frame frame;
+
+                    if (config.lock_to_channel) {
+                        // Once for every frame of the channel, as it is sent
+                        std::unique_lock<std::mutex> lock(frame_mutex_);
+                        frame_cond_.wait_for(lock, std::chrono::milliseconds(100), [&] {
+                            return abort_request_ || frame_number_ != sampled_frame;
+                        });
+                        if (frame_number_ == sampled_frame)
+                            continue;
+                        sampled_frame = frame_number_;
+                        frame         = last_frame_;
+                    } else {
+                        clock.tick(config.refresh_rate);
+
+                        std::lock_guard<std::mutex> lock(frame_mutex_);
+                        frame = last_frame_;
+                    }
 
-                    frame_mutex_.unlock();
                     if (!frame)
                         continue; // No frame available
 
-                    uint8_t dmx_data[512];
-                    memset(dmx_data, 0, 512);
-
-                    for (auto computed_fixture : computed_fixtures) {
-                        auto     color = average_color(frame, computed_fixture.rectangle);
-                        uint8_t* ptr   = dmx_data + computed_fixture.address;
-
-                        switch (computed_fixture.type) {
-                            case FixtureType::DIMMER:
-                                ptr[0] = (uint8_t)(0.279 * color.r + 0.547 * color.g + 0.106 * color.b);
-                                break;
-                            case FixtureType::RGB:
-                                ptr[0] = color.r;
-                                ptr[1] = color.g;
-                                ptr[2] = color.b;
-                                break;
-                            case FixtureType::RGBW:
-                                uint8_t w = std::min(std::min(color.r, color.g), color.b);
-                                ptr[0]    = color.r - w;
-                                ptr[1]    = color.g - w;
-                                ptr[2]    = color.b - w;
-                                ptr[3]    = w;
-                                break;
-                        }
-                    }
-
-                    send_dmx_data(dmx_data, 512);
+                    sample_fixtures(frame);
+                    send_dmx_data();
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
                 }
@@ -139,14 +170,19 @@ struct artnet_consumer : public core::frame_consumer
     ~artnet_consumer()
     {
         abort_request_ = true;
+        frame_cond_.notify_all();
         if (thread_.joinable())
             thread_.join();
     }
 
     std::future<bool> send(core::video_field field, core::const_frame frame) override
     {
-        std::lock_guard<std::mutex> lock(frame_mutex_);
-        last_frame_ = frame;
+        {
+            std::lock_guard<std::mutex> lock(frame_mutex_);
+            last_frame_ = frame;
+            frame_number_ += 1;
+        }
+        frame_cond_.notify_one();
 
         return make_ready_future(true);
     }
@@ -159,27 +195,93 @@ struct artnet_consumer : public core::frame_consumer
 
     core::monitor::state state() const override
     {
+        // 0 while sending once for every frame of the channel
+        double refresh_rate = config.lock_to_channel ? 0.0 : boost::rational_cast<double>(config.refresh_rate);
+
         core::monitor::state state;
         state["artnet/computed-fixtures"] = computed_fixtures.size();
         state["artnet/fixtures"]          = config.fixtures.size();
+        state["artnet/protocol"]          = std::string(config.protocol == dmx_protocol::sacn ? "sacn" : "artnet");
         state["artnet/universe"]          = config.universe;
+        state["artnet/universes"]         = universe_count_;
+        state["artnet/universes-sent"]    = static_cast<std::uint64_t>(universes_sent_);
         state["artnet/host"]              = config.host;
         state["artnet/port"]              = config.port;
-        state["artnet/refresh-rate"]      = config.refreshRate;
+        state["artnet/refresh-rate"]      = refresh_rate;
 
         return state;
     }
 
   private:
-    core::const_frame last_frame_;
-    std::mutex        frame_mutex_;
+    core::const_frame       last_frame_;
+    std::uint64_t           frame_number_ = 0;
+    std::mutex              frame_mutex_;
+    std::condition_variable frame_cond_;
 
     std::thread       thread_;
     std::atomic<bool> abort_request_{false};
 
-    io_service    io_service_;
-    udp::socket   socket;
-    udp::endpoint remote_endpoint;
+    io_service                 io_service_;
+    udp::socket                socket;
+    std::vector<udp::endpoint> remote_endpoints_; // One for each universe, or one for all of them
+
+    int          universe_count_ = 1;
+    sacn_source  source_;
+    std::uint8_t sequence_ = 0;
+
+    int sampled_width_  = 0;
+    int sampled_height_ = 0;
+
+    // The channels of all of the universes, one after the other, and as they and when each universe was last sent
+    std::vector<std::uint8_t>                          dmx_data_;
+    std::vector<std::uint8_t>                          sent_data_;
+    std::vector<std::chrono::steady_clock::time_point> sent_time_;
+
+    std::vector<std::uint8_t>   packets_; // Of the universes that are sent, one after the other
+    std::vector<udp::endpoint*> packet_endpoints_;
+    std::atomic<std::uint64_t>  universes_sent_{0};
+
+    void sample_fixtures(const core::const_frame& frame)
+    {
+        int width  = (int)frame.width();
+        int height = (int)frame.height();
+
+        // The pixels of the fixtures only change with the frame size, so they are found once for it
+        if (width != sampled_width_ || height != sampled_height_) {
+            for (auto& computed_fixture : computed_fixtures) {
+                computed_fixture.spans = rasterize(computed_fixture.rectangle, width, height);
+            }
+            sampled_width_  = width;
+            sampled_height_ = height;
+        }
+
+        const std::uint8_t* image = frame.image_data(0).data();
+
+        std::fill(dmx_data_.begin(), dmx_data_.end(), 0);
+
+        for (auto& computed_fixture : computed_fixtures) {
+            auto     color = average_color(image, width, computed_fixture.spans);
+            uint8_t* ptr   = dmx_data_.data() + computed_fixture.address;
+
+            switch (computed_fixture.type) {
+                case FixtureType::DIMMER:
+                    ptr[0] = (uint8_t)(0.279 * color.r + 0.547 * color.g + 0.106 * color.b);
+                    break;
+                case FixtureType::RGB:
+                    ptr[0] = color.r;
+                    ptr[1] = color.g;
+                    ptr[2] = color.b;
+                    break;
+                case FixtureType::RGBW:
+                    uint8_t w = std::min(std::min(color.r, color.g), color.b);
+                    ptr[0]    = color.r - w;
+                    ptr[1]    = color.g - w;
+                    ptr[2]    = color.b - w;
+                    ptr[3]    = w;
+                    break;
+            }
+        }
+    }
 
     void compute_fixtures()
     {
@@ -196,41 +298,81 @@ struct artnet_consumer : public core::frame_consumer
         }
     }
 
-    void send_dmx_data(const std::uint8_t* data, std::size_t length)
+    void send_dmx_data()
     {
-        int universe = this->config.universe;
+        auto packet_size = dmx_packet_size(config.protocol);
+        auto now         = std::chrono::steady_clock::now();
 
-        std::uint8_t hUni = (universe >> 8) & 0xff;
-        std::uint8_t lUni = universe & 0xff;
+        // Only the universes that changed, and those that have not been sent for the keepalive interval, so that
+        // receivers do not time out
+        std::size_t count = 0;
 
-        std::uint8_t hLen = (length >> 8) & 0xff;
-        std::uint8_t lLen = (length & 0xff);
+        sequence_ += 1;
+        for (int n = 0; n < universe_count_; n++) {
+            auto data = dmx_data_.data() + n * DMX_UNIVERSE_SIZE;
+            auto sent = sent_data_.data() + n * DMX_UNIVERSE_SIZE;
 
-        std::uint8_t header[] = {65, 114, 116, 45, 78, 101, 116, 0, 0, 80, 0, 14, 0, 0, lUni, hUni, hLen, lLen};
-        std::uint8_t buffer[18 + 512];
-
-        for (int i = 0; i < 18 + 512; i++) {
-            if (i < 18) {
-                buffer[i] = header[i];
+            if (config.keepalive_interval.count() > 0 && now - sent_time_[n] < config.keepalive_interval &&
+                std::memcmp(data, sent, DMX_UNIVERSE_SIZE) == 0)
                 continue;
+
+            std::memcpy(sent, data, DMX_UNIVERSE_SIZE);
+            sent_time_[n] = now;
+
+            auto packet   = packets_.data() + count * packet_size;
+            auto universe = config.universe + n;
+
+            if (config.protocol == dmx_protocol::sacn) {
+                write_sacn_packet(packet, source_, universe, sequence_, data);
+            } else {
+                write_artnet_packet(packet, universe, data);
             }
+            packet_endpoints_[count] = &remote_endpoints_[std::min<std::size_t>(n, remote_endpoints_.size() - 1)];
+            count += 1;
+        }
 
-            if (i - 18 < length) {
-                buffer[i] = data[i - 18];
-                continue;
+        universes_sent_ += count;
+
+#ifdef __linux__
+        // All of the universes in as few system calls as possible
+        const int   BATCH_SIZE = 64;
+        mmsghdr     messages[BATCH_SIZE];
+        iovec       vectors[BATCH_SIZE];
+        std::size_t sent = 0;
+
+        while (sent < count) {
+            auto batch = std::min<std::size_t>(BATCH_SIZE, count - sent);
+            for (std::size_t n = 0; n < batch; n++) {
+                auto endpoint = packet_endpoints_[sent + n];
+
+                vectors[n].iov_base = packets_.data() + (sent + n) * packet_size;
+                vectors[n].iov_len  = packet_size;
+
+                std::memset(&messages[n], 0, sizeof(mmsghdr));
+                messages[n].msg_hdr.msg_name    = endpoint->data();
+                messages[n].msg_hdr.msg_namelen = endpoint->size();
+                messages[n].msg_hdr.msg_iov     = &vectors[n];
+                messages[n].msg_hdr.msg_iovlen  = 1;
             }
 
-            buffer[i] = 0;
+            int result = ::sendmmsg(socket.native_handle(), messages, static_cast<unsigned int>(batch), 0);
+            if (result < 0)
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(std::strerror(errno)));
+            sent += result;
         }
-
-        boost::system::error_code err;
-        socket.send_to(boost::asio::buffer(buffer), remote_endpoint, 0, err);
-        if (err)
-            CASPAR_THROW_EXCEPTION(io_error() << msg_info(err.message()));
+#else
+        for (std::size_t n = 0; n < count; n++) {
+            boost::system::error_code err;
+            socket.send_to(
+                boost::asio::buffer(packets_.data() + n * packet_size, packet_size), *packet_endpoints_[n], 0, err);
+            if (err)
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(err.message()));
+        }
+#endif
     }
 };
 
-std::vector<fixture> get_fixtures_ptree(const boost::property_tree::wptree& ptree)
+std::vector<fixture> get_fixtures_ptree(const boost::property_tree::wptree& ptree, int first_universe)
 {
     std::vector<fixture> fixtures;
 
@@ -245,7 +387,13 @@ std::vector<fixture> get_fixtures_ptree(const boost::property_tree::wptree& ptre
         if (startAddress < 1)
             CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Fixture start address must be specified"));
 
-        f.startAddress = (unsigned short)startAddress - 1;
+        // The address may run on into the universes after that of the fixture
+        int universe = xml_channel.second.get(L"universe", first_universe);
+        if (universe < first_universe)
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"Fixture universe must not come before the universe of the consumer"));
+
+        f.startAddress = (universe - first_universe) * static_cast<int>(DMX_UNIVERSE_SIZE) + startAddress - 1;
 
         int fixtureCount = xml_channel.second.get(L"fixture-count", -1);
         if (fixtureCount < 1)
@@ -313,15 +461,57 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     if (channel_info.depth != common::bit_depth::bit8)
         CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Artnet consumer only supports 8-bit color depth."));
 
+    auto protocol = ptree.get(L"protocol", L"artnet");
+    if (boost::iequals(protocol, L"sacn")) {
+        config.protocol = dmx_protocol::sacn;
+        config.universe = 1;
+        config.port     = 5568;
+    } else if (!boost::iequals(protocol, L"artnet")) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown protocol, expected artnet or sacn"));
+    }
+
     config.universe    = ptree.get(L"universe", config.universe);
     config.host        = ptree.get(L"host", config.host);
     config.port        = ptree.get(L"port", config.port);
-    config.refreshRate = ptree.get(L"refresh-rate", config.refreshRate);
+    config.source_name = ptree.get(L"source-name", config.source_name);
+    config.priority    = ptree.get(L"priority", config.priority);
+
+    // A number of sends per second, which may be a fraction such as 30000/1001, or channel for one send per frame
+    auto refresh_rate = ptree.get(L"refresh-rate", L"10");
+    if (boost::iequals(refresh_rate, L"channel")) {
+        config.lock_to_channel = true;
+    } else {
+        try {
+            std::vector<std::wstring> parts;
+            boost::split(parts, refresh_rate, boost::is_any_of(L"/"));
+            if (parts.size() > 2)
+                throw std::invalid_argument("refresh-rate");
+            config.refresh_rate =
+                boost::rational<int>(std::stoi(parts[0]), parts.size() == 2 ? std::stoi(parts[1]) : 1);
+        } catch (...) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Refresh rate must be a number, a fraction or channel"));
+        }
+
+        if (config.refresh_rate < 1)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Refresh rate must be at least 1"));
+    }
+
+    auto keepalive = ptree.get(L"keepalive-interval", 1.0);
+    if (keepalive < 0.0)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Keepalive interval must not be negative"));
+    config.keepalive_interval = std::chrono::nanoseconds(static_cast<std::int64_t>(keepalive * 1e9));
+
+    if (config.priority < 0 || config.priority > 200)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Priority must be between 0 and 200"));
+
+    config.fixtures = get_fixtures_ptree(ptree, config.universe);
 
-    if (config.refreshRate < 1)
-        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Refresh rate must be at least 1"));
+    // Art-Net addresses 15 bits of universes, sACN 1 to 63999
+    int last_universe = config.universe + count_universes(config.fixtures) - 1;
 
-    config.fixtures = get_fixtures_ptree(ptree);
+    if (config.protocol == dmx_protocol::sacn ? config.universe < 1 || last_universe > 63999
+                                              : config.universe < 0 || last_universe > 32767)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"The fixtures address universes outside of the protocol"));
 
     return spl::make_shared<artnet_consumer>(config);
 }
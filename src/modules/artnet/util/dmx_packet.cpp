@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Eliyah Sundström eliyah@sundstroem.com
+ */
+
+#include "dmx_packet.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace caspar { namespace artnet {
+
+namespace {
+
+const std::size_t ARTNET_HEADER_SIZE = 18;
+const std::size_t SACN_HEADER_SIZE   = 126;
+
+void write_u16(std::uint8_t* ptr, std::size_t value)
+{
+    ptr[0] = (value >> 8) & 0xff;
+    ptr[1] = value & 0xff;
+}
+
+void write_u32(std::uint8_t* ptr, std::uint32_t value)
+{
+    write_u16(ptr, value >> 16);
+    write_u16(ptr + 2, value & 0xffff);
+}
+
+// The flags and length of a PDU of the ACN layers, which runs to the end of the packet
+void write_pdu_length(std::uint8_t* packet, std::size_t offset)
+{
+    write_u16(packet + offset, 0x7000 | (SACN_HEADER_SIZE + DMX_UNIVERSE_SIZE - offset));
+}
+
+} // namespace
+
+std::size_t dmx_packet_size(dmx_protocol protocol)
+{
+    return (protocol == dmx_protocol::sacn ? SACN_HEADER_SIZE : ARTNET_HEADER_SIZE) + DMX_UNIVERSE_SIZE;
+}
+
+void write_artnet_packet(std::uint8_t* packet, int universe, const std::uint8_t* data)
+{
+    std::uint8_t hUni = (universe >> 8) & 0xff;
+    std::uint8_t lUni = universe & 0xff;
+
+    std::uint8_t hLen = (DMX_UNIVERSE_SIZE >> 8) & 0xff;
+    std::uint8_t lLen = (DMX_UNIVERSE_SIZE & 0xff);
+
+    std::uint8_t header[] = {65, 114, 116, 45, 78, 101, 116, 0, 0, 80, 0, 14, 0, 0, lUni, hUni, hLen, lLen};
+
+    std::memcpy(packet, header, ARTNET_HEADER_SIZE);
+    std::memcpy(packet + ARTNET_HEADER_SIZE, data, DMX_UNIVERSE_SIZE);
+}
+
+void write_sacn_packet(std::uint8_t*       packet,
+                       const sacn_source&  source,
+                       int                 universe,
+                       std::uint8_t        sequence,
+                       const std::uint8_t* data)
+{
+    std::memset(packet, 0, SACN_HEADER_SIZE);
+
+    // Root layer
+    write_u16(packet + 0, 0x0010);                // Preamble size
+    std::memcpy(packet + 4, "ASC-E1.17\0\0", 12); // ACN packet identifier
+    write_pdu_length(packet, 16);
+    write_u32(packet + 18, 0x00000004); // VECTOR_ROOT_E131_DATA
+    std::memcpy(packet + 22, source.cid, sizeof(source.cid));
+
+    // Framing layer
+    write_pdu_length(packet, 38);
+    write_u32(packet + 40, 0x00000002); // VECTOR_E131_DATA_PACKET
+    std::memcpy(packet + 44, source.name.data(), std::min<std::size_t>(source.name.size(), 63));
+    packet[108] = static_cast<std::uint8_t>(source.priority);
+    packet[111] = sequence;
+    write_u16(packet + 113, universe);
+
+    // DMP layer
+    write_pdu_length(packet, 115);
+    packet[117] = 0x02;                             // VECTOR_DMP_SET_PROPERTY
+    packet[118] = 0xa1;                             // Address and data type
+    write_u16(packet + 121, 0x0001);                // Address increment
+    write_u16(packet + 123, DMX_UNIVERSE_SIZE + 1); // Property value count, with the start code
+    packet[125] = 0x00;                             // DMX512 start code
+
+    std::memcpy(packet + SACN_HEADER_SIZE, data, DMX_UNIVERSE_SIZE);
+}
+
+std::string sacn_multicast_address(int universe)
+{
+    return "239.255." + std::to_string((universe >> 8) & 0xff) + "." + std::to_string(universe & 0xff);
+}
+
+}} // namespace caspar::artnet
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Eliyah Sundström eliyah@sundstroem.com
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace artnet {
+
+enum class dmx_protocol
+{
+    artnet, // Art-Net 4 ArtDmx, to a host or broadcast address
+    sacn,   // ANSI E1.31 streaming ACN, to the multicast group of each universe or a host
+};
+
+const std::size_t DMX_UNIVERSE_SIZE = 512;
+
+// Identifies the consumer to sACN receivers, which merge the sources of a universe by priority
+struct sacn_source
+{
+    std::uint8_t cid[16];
+    std::string  name;
+    int          priority = 100;
+};
+
+// The size of a packet that carries one universe
+std::size_t dmx_packet_size(dmx_protocol protocol);
+
+// Writes the packets that carry DMX_UNIVERSE_SIZE channels of data to a universe into packet
+void write_artnet_packet(std::uint8_t* packet, int universe, const std::uint8_t* data);
+void write_sacn_packet(std::uint8_t*       packet,
+                       const sacn_source&  source,
+                       int                 universe,
+                       std::uint8_t        sequence,
+                       const std::uint8_t* data);
+
+// The multicast group that the receivers of an sACN universe join
+std::string sacn_multicast_address(int universe);
+
+}} // namespace caspar::artnet
@@ -84,11 +84,8 @@ rect compute_rect(box fixtureBox, int index, int count)
     return rectangle;
 }
 
-color average_color(const core::const_frame& frame, rect& rectangle)
+std::vector<span> rasterize(const rect& rectangle, int width, int height)
 {
-    int width  = (int)frame.width();
-    int height = (int)frame.height();
-
     float x_values[] = {rectangle.p1.x, rectangle.p2.x, rectangle.p3.x, rectangle.p4.x};
     float y_values[] = {rectangle.p1.y, rectangle.p2.y, rectangle.p3.y, rectangle.p4.y};
 
@@ -119,8 +116,7 @@ color average_color(const core::const_frame& frame, rect& rectangle)
         }
     }
 
-    // Below is a rasterization algorithm that goes through the pixels in rectangle
-    // and calculates the average color
+    // Below is a rasterization algorithm that finds the pixels in the rectangle, row by row
 
     // Which lines to use for the rasterization
     // in the format [a, b, c, d] => a -> b, c -> d
@@ -135,16 +131,8 @@ color average_color(const core::const_frame& frame, rect& rectangle)
     int y_min = std::max(0, std::min(height - 1, (int)y_values[0]));
     int y_max = std::max(0, std::min(height - 1, (int)y_values[3]));
 
-    const array<const std::uint8_t>& values    = frame.image_data(0);
-    const std::uint8_t*              value_ptr = values.data();
-
-    // Total color values, as well as the number of pixels in the rectangle
-    // used to calculate the average without loss of precision
-    unsigned long long tr = 0;
-    unsigned long long tg = 0;
-    unsigned long long tb = 0;
-
-    unsigned long long count = 0;
+    std::vector<span> spans;
+    spans.reserve(y_max - y_min + 1);
 
     // Go through the vertical lines of the rectangle, and then through the pixels in the line
     // that are inside the rectangle
@@ -193,28 +181,50 @@ color average_color(const core::const_frame& frame, rect& rectangle)
         int min_x = std::min(x1, x2);
         int max_x = std::max(x1, x2);
 
-        // Go through the pixels in the line
-        for (int x = min_x; x <= max_x; x++) {
-            int                 pos      = y * width + x;
-            const std::uint8_t* base_ptr = value_ptr + pos * 4;
+        spans.push_back(span{y, min_x, max_x});
+    }
+
+    return spans;
+}
 
-            float a = (float)base_ptr[3] / 255.0f;
+color average_color(const std::uint8_t* bgra, int width, const std::vector<span>& spans)
+{
+    // Total color values, as well as the number of pixels in the rectangle
+    // used to calculate the average without loss of precision
+    unsigned long long tr = 0;
+    unsigned long long tg = 0;
+    unsigned long long tb = 0;
 
-            float r = (float)base_ptr[2] * a;
-            float g = (float)base_ptr[1] * a;
-            float b = (float)base_ptr[0] * a;
+    unsigned long long count = 0;
+
+    for (auto& row : spans) {
+        const std::uint8_t* base_ptr = bgra + (static_cast<std::size_t>(row.y) * width + row.x1) * 4;
 
-            tr += (unsigned long long)(r);
-            tg += (unsigned long long)(g);
-            tb += (unsigned long long)(b);
+        for (int x = row.x1; x <= row.x2; x++, base_ptr += 4) {
+            float a = (float)base_ptr[3] / 255.0f;
 
-            count++;
+            tr += (unsigned long long)((float)base_ptr[2] * a);
+            tg += (unsigned long long)((float)base_ptr[1] * a);
+            tb += (unsigned long long)((float)base_ptr[0] * a);
         }
+
+        count += row.x2 - row.x1 + 1;
     }
 
+    if (count == 0)
+        return color{0, 0, 0};
+
     color c{(std::uint8_t)(tr / count), (std::uint8_t)(tg / count), (std::uint8_t)(tb / count)};
 
     return c;
 }
 
+color average_color(const core::const_frame& frame, rect& rectangle)
+{
+    int width  = (int)frame.width();
+    int height = (int)frame.height();
+
+    return average_color(frame.image_data(0).data(), width, rasterize(rectangle, width, height));
+}
+
 }} // namespace caspar::artnet
\ No newline at end of file
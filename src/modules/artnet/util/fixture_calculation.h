@@ -24,7 +24,9 @@
 #include <core/frame/frame.h>
 
 #include <cmath>
+#include <cstdint>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace artnet {
 
@@ -49,12 +51,22 @@ struct rect
     point p4;
 };
 
+// The pixels x1 to x2 of row y
+struct span
+{
+    int y;
+    int x1;
+    int x2;
+};
+
 struct computed_fixture
 {
-    FixtureType    type;
-    unsigned short address;
+    FixtureType type;
+    int         address; // Of the first channel, counted across the universes of the consumer
 
     rect rectangle;
+
+    std::vector<span> spans; // The pixels of the rectangle, for the frame size they were rasterized for
 };
 
 struct color
@@ -78,14 +90,22 @@ struct box
 struct fixture
 {
     FixtureType    type;
-    unsigned short startAddress;    // DMX address of the first channel in the fixture
+    int            startAddress;    // DMX address of the first channel in the fixture, counted across universes
     unsigned short fixtureCount;    // number of fixtures in the chain, dividing along the width
     unsigned short fixtureChannels; // number of channels per fixture
 
     box fixtureBox;
 };
 
-rect  compute_rect(box fixtureBox, int index, int count);
+rect compute_rect(box fixtureBox, int index, int count);
+
+// The rows of pixels inside the rectangle, clamped to a frame of the given size. They only depend on the size, so they
+// can be computed once and sampled for every frame.
+std::vector<span> rasterize(const rect& rectangle, int width, int height);
+
+// The average of the premultiplied BGRA pixels in the spans of an image with the given width
+color average_color(const std::uint8_t* bgra, int width, const std::vector<span>& spans);
+
 color average_color(const core::const_frame& frame, rect& rectangle);
 
 }} // namespace caspar::artnet
\ No newline at end of file
@@ -35,7 +35,6 @@
 #include <common/timer.h>
 
 #include <boost/property_tree/ptree.hpp>
-#include <boost/range/algorithm.hpp>
 
 #include <atomic>
 #include <condition_variable>
@@ -44,7 +43,6 @@
 
 namespace caspar { namespace bluefish {
 
-#define BLUEFISH_MAX_SOFTWARE_BUFFERS 4
 #define SIZE_TEMP_AUDIO_BUFFER                                                                                         \
     (2048 * 16) // max 2002 samples across 16 channels, use 2048 for safety cos sometimes caspar gives us too many...
 
@@ -91,6 +89,7 @@ struct configuration
         hardware_downstream_keyer_audio_source::VideoOutputChannel;
     unsigned int      watchdog_timeout = 2;
     uhd_output_option uhd_mode         = uhd_output_option::disable_BVC_MultiLink;
+    unsigned int      software_buffers = 4;
 };
 
 bool get_videooutput_channel_routing_info_from_streamid(bluefish_hardware_output_channel streamid,
@@ -187,9 +186,9 @@ struct bluefish_consumer
     unsigned int mode_; // ie bf video mode / format
     bool         interlaced_ = false;
 
-    std::array<blue_dma_buffer_ptr, BLUEFISH_MAX_SOFTWARE_BUFFERS> all_frames_;
-    tbb::concurrent_bounded_queue<blue_dma_buffer_ptr>             reserved_frames_;
-    tbb::concurrent_bounded_queue<blue_dma_buffer_ptr>             live_frames_;
+    std::vector<blue_dma_buffer_ptr>                   all_frames_;
+    tbb::concurrent_bounded_queue<blue_dma_buffer_ptr> reserved_frames_;
+    tbb::concurrent_bounded_queue<blue_dma_buffer_ptr> live_frames_;
 
     std::atomic<int64_t> audio_frames_filled_{0};
     blue_dma_buffer_ptr  last_field_buf_ = nullptr;
@@ -226,8 +225,8 @@ struct bluefish_consumer
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
-        reserved_frames_.set_capacity(BLUEFISH_MAX_SOFTWARE_BUFFERS);
-        live_frames_.set_capacity(BLUEFISH_MAX_SOFTWARE_BUFFERS);
+        reserved_frames_.set_capacity(config_.software_buffers);
+        live_frames_.set_capacity(config_.software_buffers);
 
         // get BF video mode
         mode_ = get_bluefish_video_format(format_desc_.format);
@@ -300,9 +299,8 @@ struct bluefish_consumer
 
         // ok here we create a bunch of Bluefish buffers, that contain video and encoded hanc....
         // this is the software Q. / software buffers
-        int n = 0;
-        boost::range::generate(
-            all_frames_, [&] { return std::make_shared<blue_dma_buffer>(static_cast<int>(format_desc_.size), n++); });
+        for (unsigned int n = 0; n < config_.software_buffers; ++n)
+            all_frames_.push_back(std::make_shared<blue_dma_buffer>(static_cast<int>(format_desc_.size), n));
 
         for (size_t i = 0; i < all_frames_.size(); i++)
             reserved_frames_.push(all_frames_[i]);
@@ -684,6 +682,7 @@ struct bluefish_consumer
                 }
 
                 ++scheduled_frames_completed_;
+                buf->release_image();
                 reserved_frames_.push(buf);
             }
 
@@ -716,9 +715,11 @@ struct bluefish_consumer
             if (!last_field_buf_) // field 1
             {
                 if (reserved_frames_.try_pop(last_field_buf_)) {
-                    // copy video data into holding buf
+                    // DMA the video data from the frame, or copy it into the holding buf
                     void* dest = last_field_buf_->image_data();
-                    if (frame.image_data(0).size()) {
+                    if (frame.image_data(0).size() == last_field_buf_->image_size()) {
+                        last_field_buf_->set_image(frame.image_data(0));
+                    } else if (frame.image_data(0).size()) {
                         std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
                     } else
                         std::memset(dest, 0, last_field_buf_->image_size());
@@ -763,6 +764,9 @@ struct bluefish_consumer
                         // Do the Square Division top 2si conversion here.
                         blue_->convert_sq_to_2si(
                             (int)frame.width(), (int)frame.height(), (void*)frame.image_data(0).begin(), dest);
+                    } else if (frame.image_data(0).size() == buf->image_size()) {
+                        // DMA straight from the frame, which is usually a readback buffer of the mixer
+                        buf->set_image(frame.image_data(0));
                     } else
                         std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
                 } else
@@ -872,6 +876,9 @@ struct bluefish_consumer_proxy : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return true; }
 
+    // The frame of field a is shown whole, which then holds the lines of both fields
+    bool shows_fields() const override { return true; }
+
     core::monitor::state state() const override
     {
         core::monitor::state state;
@@ -991,6 +998,11 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     auto watchdog_timeout   = ptree.get(L"watchdog", 2);
     config.watchdog_timeout = watchdog_timeout;
 
+    auto software_buffers = ptree.get(L"software-buffers", config.software_buffers);
+    if (software_buffers < 2)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Bluefish consumer needs at least 2 software-buffers."));
+    config.software_buffers = software_buffers;
+
     auto uhd_mode   = ptree.get(L"uhd-mode", 0);
     config.uhd_mode = uhd_output_option::disable_BVC_MultiLink;
     if (uhd_mode == 1)
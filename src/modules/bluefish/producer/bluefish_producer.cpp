@@ -173,6 +173,8 @@ struct bluefish_producer
     spl::shared_ptr<core::frame_factory> frame_factory_;
     const core::video_format_repository  format_repository_;
     std::vector<uint8_t>                 conversion_buffer_;
+    FrameAllocator                       frame_allocator_;
+    array<const uint8_t>                 capture_buffer_;
 
     tbb::concurrent_bounded_queue<core::draw_frame> frame_buffer_;
     std::exception_ptr                              exception_;
@@ -215,6 +217,9 @@ struct bluefish_producer
         mode_ = static_cast<unsigned int>(VID_FMT_EXT_INVALID);
         frame_buffer_.set_capacity(2);
 
+        frame_allocator_.tag           = this;
+        frame_allocator_.frame_factory = frame_factory_;
+
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("frame-time", diagnostics::color(1.0f, 0.0f, 0.0f));
@@ -454,9 +459,8 @@ struct bluefish_producer
                 // src_video->display_picture_number = frames_captured;
                 src_video->pts = capture_ts;
 
-                void* video_bytes = reserved_frames_.front()->image_data();
-                if (reserved_frames_.front() && video_bytes) {
-                    src_video->data[0]     = reinterpret_cast<uint8_t*>(reserved_frames_.front()->image_data());
+                if (capture_buffer_) {
+                    src_video->data[0]     = const_cast<uint8_t*>(capture_buffer_.data());
                     src_video->linesize[0] = static_cast<int>(width * 3); // image_size / height);
                 }
 
@@ -516,13 +520,16 @@ struct bluefish_producer
                     }
                 }
 
-                if (uhd_mode_ == 2 && conversion_buffer_.size() <= (width * height * 3)) {
+                if (uhd_mode_ == 2 && conversion_buffer_.size() <= (width * height * 3) && src_video->data[0]) {
                     // Do additional processing required to handle a 2SI input
-                    memcpy(&conversion_buffer_[0], reserved_frames_.front()->image_data(), (width * height * 3));
-                    blue_->convert_2si_to_sq(
-                        width, height, &conversion_buffer_[0], reserved_frames_.front()->image_data());
+                    memcpy(&conversion_buffer_[0], src_video->data[0], (width * height * 3));
+                    blue_->convert_2si_to_sq(width, height, &conversion_buffer_[0], src_video->data[0]);
                 }
 
+                // The video was DMAed into an upload buffer of the mixer, which make_frame then passes on by
+                // reference and the mixer expands to RGBA on the GPU
+                wrap_frame_buffer(frame_allocator_, src_video.get(), capture_buffer_);
+
                 // pass to caspar
                 auto frame = core::draw_frame(make_frame(this, *frame_factory_, src_video, src_audio));
                 if (!frame_buffer_.try_push(frame)) {
@@ -544,23 +551,35 @@ struct bluefish_producer
         return S_OK;
     }
 
+    // A pooled upload buffer of the mixer to DMA the next frame into. The second field of an interlaced frame is taken
+    // from the buffer of the first.
+    array<const uint8_t> create_capture_buffer()
+    {
+        core::pixel_format_desc desc(core::pixel_format::gray);
+        desc.planes.emplace_back(static_cast<int>(reserved_frames_.front()->image_size()), 1, 1);
+        return array<const uint8_t>(std::move(frame_factory_->create_frame(this, desc).image_data(0)));
+    }
+
     bool grab_frame_from_bluefishcard()
     {
         try {
-            if (reserved_frames_.front()->image_data()) {
+            if (sync_format_ == UPD_FMT_FRAME || first_frame_) {
+                capture_buffer_ = create_capture_buffer();
+            }
+            if (capture_buffer_) {
                 if (sync_format_ == UPD_FMT_FIELD && first_frame_) {
-                    blue_->system_buffer_read(const_cast<uint8_t*>(reserved_frames_.front()->image_data()),
-                                              static_cast<unsigned long>(reserved_frames_.front()->image_size()),
+                    blue_->system_buffer_read(const_cast<uint8_t*>(capture_buffer_.data()),
+                                              static_cast<unsigned long>(capture_buffer_.size()),
                                               BlueImage_HANC_DMABuffer(dma_ready_captured_frame_id_, BLUE_DATA_FRAME),
                                               0);
                 } else if (sync_format_ == UPD_FMT_FRAME) {
-                    blue_->system_buffer_read(const_cast<uint8_t*>(reserved_frames_.front()->image_data()),
-                                              static_cast<unsigned long>(reserved_frames_.front()->image_size()),
+                    blue_->system_buffer_read(const_cast<uint8_t*>(capture_buffer_.data()),
+                                              static_cast<unsigned long>(capture_buffer_.size()),
                                               BlueImage_HANC_DMABuffer(dma_ready_captured_frame_id_, BLUE_DATA_IMAGE),
                                               0);
                 }
             } else {
-                CASPAR_LOG(warning) << print() << TEXT(" NO image data in reserved frames list.");
+                CASPAR_LOG(warning) << print() << TEXT(" No buffer to capture into.");
                 return false;
             }
             if (sync_format_ == UPD_FMT_FRAME || (sync_format_ == UPD_FMT_FIELD && !first_frame_)) {
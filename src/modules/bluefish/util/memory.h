@@ -23,6 +23,9 @@
 #pragma once
 
 #include <Windows.h>
+
+#include <common/array.h>
+
 #include <boost/align.hpp>
 #include <vector>
 
@@ -45,7 +48,12 @@ struct blue_dma_buffer
 
     int id() const { return id_; }
 
-    PBYTE image_data() { return image_buffer_.data(); }
+    // The image of a mixed frame, e.g. in a readback buffer of the accelerator, rather than the image buffer. It is DMAed
+    // from where it is, and kept alive until the buffer is reserved again.
+    void set_image(array<const std::uint8_t> image) { image_ = std::move(image); }
+    void release_image() { image_ = array<const std::uint8_t>(); }
+
+    PBYTE image_data() { return image_ ? const_cast<PBYTE>(image_.data()) : image_buffer_.data(); }
     PBYTE hanc_data() { return hanc_buffer_.data(); }
 
     size_t image_size() const { return image_size_; }
@@ -57,6 +65,7 @@ struct blue_dma_buffer
     size_t                                                           hanc_size_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> image_buffer_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> hanc_buffer_;
+    array<const std::uint8_t>                                        image_;
 };
 using blue_dma_buffer_ptr = std::shared_ptr<blue_dma_buffer>;
 
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "buffer_depth.h"
+
+#include <algorithm>
+
+namespace caspar { namespace decklink {
+
+namespace {
+
+const auto shrink_period = std::chrono::seconds(10);
+
+// Frames that must stay buffered for a whole period before the depth shrinks, leaving two above the last one
+const int shrink_slack = 3;
+
+} // namespace
+
+buffer_controller::buffer_controller(int min_depth, int max_depth)
+    : min_depth_(min_depth)
+    , max_depth_(std::max(min_depth, max_depth))
+    , depth_(min_depth)
+{
+}
+
+int buffer_controller::update(int buffered, bool late, clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A stall of the channel delays the completions behind it, which then find the frames shown meanwhile gone
+    const auto drained = previous_ < 0 ? 0 : previous_ - buffered;
+    previous_          = buffered;
+
+    warning_ = late || buffered <= 1 || (drained > 0 && buffered <= drained);
+    if (warning_) {
+        warnings_ += 1;
+    }
+
+    if (lowest_ < 0) {
+        lowest_       = buffered;
+        period_start_ = now;
+    }
+    lowest_ = std::min(lowest_, buffered);
+
+    if (warning_ && depth_ < max_depth_) {
+        depth_ += 1;
+        grown_ += 1;
+        lowest_   = -1;
+        previous_ = -1; // The extra frame is not a recovery
+        return 2;
+    }
+
+    if (now - period_start_ < shrink_period) {
+        return 1;
+    }
+
+    const auto calm = lowest_ >= shrink_slack;
+    lowest_         = -1;
+
+    if (calm && depth_ > min_depth_) {
+        depth_ -= 1;
+        shrunk_ += 1;
+        previous_ = -1;
+        return 0;
+    }
+
+    return 1;
+}
+
+int buffer_controller::depth() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return depth_;
+}
+
+core::monitor::state buffer_controller::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    core::monitor::state state;
+    state["depth"]            = {depth_, min_depth_, max_depth_};
+    state["buffered"]         = previous_ < 0 ? 0 : previous_;
+    state["underrun-warning"] = warning_;
+    state["warnings"]         = warnings_;
+    state["grown"]            = grown_;
+    state["shrunk"]           = shrunk_;
+    return state;
+}
+
+}} // namespace caspar::decklink
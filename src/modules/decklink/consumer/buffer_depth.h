@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace caspar { namespace decklink {
+
+// Adapts how many frames are scheduled ahead of the device to how much of them stalls in the channel take up. Every
+// completed frame reports the frames still buffered:
+//
+// - An under-run is predicted once they are down to the last one, or to no more than the last stall took, as another
+//   stall like it would leave the device without a frame. That, and a frame shown late or dropped, raises a warning and
+//   grows the depth by a frame, up to the maximum.
+// - A depth above the minimum that kept at least three frames buffered for a whole period of some seconds shrinks by
+//   a frame.
+//
+// The depth is how far the channel runs ahead of the device, so it grows by scheduling an extra frame of the channel
+// and shrinks by scheduling none for a completed frame. Neither repeats nor drops anything.
+class buffer_controller
+{
+  public:
+    using clock = std::chrono::steady_clock;
+
+    buffer_controller(int min_depth, int max_depth);
+
+    // How many frames to schedule for a completed frame, with the given number of frames still buffered on the device.
+    // Normally 1, 2 to grow and 0 to shrink.
+    int update(int buffered, bool late, clock::time_point now = clock::now());
+
+    [[nodiscard]] int depth() const;
+
+    [[nodiscard]] core::monitor::state state() const;
+
+  private:
+    mutable std::mutex mutex_;
+
+    const int min_depth_;
+    const int max_depth_;
+    int       depth_;
+
+    int               previous_ = -1; // Buffered at the previous completion
+    int               lowest_   = -1; // Buffered at least, over the period
+    clock::time_point period_start_;
+
+    bool          warning_  = false;
+    std::uint64_t warnings_ = 0;
+    std::uint64_t grown_    = 0;
+    std::uint64_t shrunk_   = 0;
+};
+
+}} // namespace caspar::decklink
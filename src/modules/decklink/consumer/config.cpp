@@ -51,6 +51,10 @@ port_configuration parse_output_config(const boost::property_tree::wptree&  ptre
         port_config.region_h = subregion_tree->get(L"height", port_config.region_h);
     }
 
+    port_config.scale = ptree.get(L"scale", port_config.scale);
+    if (port_config.scale && port_config.has_subregion_geometry())
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"A decklink port can not both scale and copy a subregion"));
+
     return port_config;
 }
 
@@ -119,7 +123,10 @@ configuration parse_xml_config(const boost::property_tree::wptree&  ptree,
     }
 
     config.embedded_audio    = ptree.get(L"embedded-audio", config.embedded_audio);
+    config.audio_channels    = ptree.get(L"audio-channels", config.audio_channels);
     config.base_buffer_depth = ptree.get(L"buffer-depth", config.base_buffer_depth);
+    config.max_buffer_depth  = ptree.get(L"max-buffer-depth", config.max_buffer_depth);
+    config.measure_latency   = ptree.get(L"measure-latency", config.measure_latency);
 
     if (ptree.get_child_optional(L"ports")) {
         for (auto& xml_port : ptree | witerate_children(L"ports") | welement_context_iteration) {
@@ -176,6 +183,9 @@ configuration parse_amcp_config(const std::vector<std::wstring>&     params,
 
     config.embedded_audio   = contains_param(L"EMBEDDED_AUDIO", params);
     config.primary.key_only = contains_param(L"KEY_ONLY", params);
+    config.measure_latency  = contains_param(L"MEASURE_LATENCY", params);
+    config.max_buffer_depth = get_param(L"MAX_BUFFER_DEPTH", params, config.max_buffer_depth);
+    config.audio_channels   = get_param(L"AUDIO_CHANNELS", params, config.audio_channels);
 
     config.color_space = channel_info.default_color_space;
 
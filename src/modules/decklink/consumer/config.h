@@ -42,6 +42,9 @@ struct port_configuration
     int                     region_w = 0;
     int                     region_h = 0;
 
+    // Whether the channel is scaled to the video-mode of the port on the GPU, rather than a region of it copied
+    bool scale = false;
+
     [[nodiscard]] bool has_subregion_geometry() const
     {
         return src_x != 0 || src_y != 0 || region_w != 0 || region_h != 0 || dest_x != 0 || dest_y != 0;
@@ -54,6 +57,9 @@ struct hdr_meta_configuration
     float max_dml  = 1000.0f;
     float max_fall = 100.0f;
     float max_cll  = 1000.0f;
+
+    // Of the channel, signalled as the PQ EOTF for pq and as the HLG one otherwise
+    core::color_transfer transfer = core::color_transfer::bt709;
 };
 
 struct configuration
@@ -88,13 +94,16 @@ struct configuration
     };
 
     bool                 embedded_audio              = false;
+    int                  audio_channels              = 0; // Embedded, 0 for as many as the channel has
     keyer_t              keyer                       = keyer_t::default_keyer;
     duplex_t             duplex                      = duplex_t::default_duplex;
     latency_t            latency                     = latency_t::default_latency;
     wait_for_reference_t wait_for_reference          = wait_for_reference_t::automatic;
     int                  wait_for_reference_duration = 10; // seconds
     int                  base_buffer_depth           = 3;
+    int                  max_buffer_depth            = 0; // Adapts the depth up to this when above buffer_depth()
     bool                 hdr                         = false;
+    bool                 measure_latency             = false;
 
     port_configuration              primary;
     std::vector<port_configuration> secondaries;
@@ -22,10 +22,12 @@
 
 #include "../StdAfx.h"
 
+#include "buffer_depth.h"
 #include "common/os/thread.h"
 #include "config.h"
 #include "decklink_consumer.h"
 #include "frame.h"
+#include "latency.h"
 #include "monitor.h"
 
 #include "../util/util.h"
@@ -39,12 +41,12 @@
 #include <common/diagnostics/graph.h>
 #include <common/except.h>
 #include <common/executor.h>
+#include <common/task_arena.h>
 #include <common/timer.h>
 
 #include <tbb/parallel_for.h>
 
-#include <boost/circular_buffer.hpp>
-
+#include <algorithm>
 #include <atomic>
 #include <common/prec_timer.h>
 #include <condition_variable>
@@ -55,6 +57,7 @@
 #include <queue>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace decklink {
 
@@ -191,6 +194,25 @@ core::video_format_desc get_decklink_format(const port_configuration&      confi
     return fallback_format_desc;
 }
 
+// The channels of the embedded audio, which the cards take in counts of 2, 8 or 16
+int get_audio_channels(const configuration& config, const core::video_format_desc& format_desc)
+{
+    if (config.audio_channels == 0) {
+        return format_desc.audio_channels;
+    }
+    if (config.audio_channels != 2 && config.audio_channels != 8 && config.audio_channels != 16) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid decklink audio-channels, must be 2, 8 or 16"));
+    }
+    return config.audio_channels;
+}
+
+// The samples of the frame of the cadence that has the most
+int get_max_audio_samples(const core::video_format_desc& format_desc)
+{
+    return *std::max_element(format_desc.audio_cadence.begin(), format_desc.audio_cadence.end()) *
+           format_desc.field_count;
+}
+
 enum EOTF
 {
     SDR = 0,
@@ -227,6 +249,9 @@ class decklink_frame
     hdr_meta_configuration  hdr_metadata_;
     BMDFrameFlags           flags_;
     BMDPixelFormat          pix_fmt_;
+    core::frame_timestamps  timestamps_;
+
+    std::chrono::steady_clock::time_point scheduled_;
 
   public:
     decklink_frame(std::shared_ptr<void>         data,
@@ -308,6 +333,16 @@ class decklink_frame
 
     [[nodiscard]] int nb_samples() const { return nb_samples_; }
 
+    // Records when the channel frame this was converted from passed each stage, and that it is now being scheduled
+    void stamp(const core::frame_timestamps& timestamps)
+    {
+        timestamps_ = timestamps;
+        scheduled_  = std::chrono::steady_clock::now();
+    }
+
+    [[nodiscard]] const core::frame_timestamps&         timestamps() const { return timestamps_; }
+    [[nodiscard]] std::chrono::steady_clock::time_point scheduled() const { return scheduled_; }
+
     // IDeckLinkVideoFrameMetadataExtensions
     HRESULT STDMETHODCALLTYPE GetInt(BMDDeckLinkFrameMetadataID metadataID, int64_t* value) override
     {
@@ -315,7 +350,7 @@ class decklink_frame
 
         switch (metadataID) {
             case bmdDeckLinkFrameMetadataHDRElectroOpticalTransferFunc:
-                *value = EOTF::HLG;
+                *value = hdr_metadata_.transfer == core::color_transfer::pq ? EOTF::PQ : EOTF::HLG;
                 break;
 
             case bmdDeckLinkFrameMetadataColorspace:
@@ -439,6 +474,10 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
                                                            bmdSupportedVideoModeDefault,
                                                            config_.hdr);
 
+    // Every scheduled frame, plus the one being displayed and the one being converted
+    frame_pool frame_pool_{
+        decklink_format_desc_, config_.hdr, std::max(config_.buffer_depth(), config_.max_buffer_depth) + 2};
+
     decklink_secondary_port(const configuration&           config,
                             port_configuration             output_config,
                             core::video_format_desc        channel_format_desc,
@@ -518,6 +557,18 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
         }
     }
 
+    // Whether the frames for this port can be converted together with those of a port that takes them in the same
+    // pairs of fields
+    [[nodiscard]] bool shares_conversion(int field_count) const
+    {
+        return decklink_format_desc_.field_count == field_count && !first_field_.has_value();
+    }
+
+    port_output output()
+    {
+        return {&decklink_format_desc_, &output_config_, mode_->GetFieldDominance(), frame_pool_.acquire()};
+    }
+
     void schedule_frame(core::const_frame frame, BMDTimeValue display_time)
     {
         bool isInterlaced = decklink_format_desc_.field_count != 1;
@@ -538,7 +589,8 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
             frame1 = frame;
         }
 
-        auto image_data = convert_frame_for_port(channel_format_desc_,
+        auto image_data = convert_frame_for_port(frame_pool_,
+                                                 channel_format_desc_,
                                                  decklink_format_desc_,
                                                  output_config_,
                                                  frame1,
@@ -584,8 +636,10 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
 
 struct decklink_consumer final : public IDeckLinkVideoOutputCallback
 {
-    const int           channel_index_;
-    const configuration config_;
+    const int                              channel_index_;
+    const configuration                    config_;
+    const std::shared_ptr<latency_monitor>   latency_;
+    const std::shared_ptr<buffer_controller> buffer_depth_;
 
     com_ptr<IDeckLink>                        decklink_      = get_device(config_.primary.device_index);
     com_iface_ptr<IDeckLinkOutput>            output_        = iface_cast<IDeckLinkOutput>(decklink_);
@@ -605,12 +659,19 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
     std::queue<core::const_frame> buffer_;
     int                           buffer_capacity_ = channel_format_desc_.field_count;
 
-    const int buffer_size_ = config_.buffer_depth(); // Minimum buffer-size 3.
+    const int buffer_size_     = config_.buffer_depth(); // Minimum buffer-size 3.
+    const int max_buffer_size_ = buffer_depth_ ? config_.max_buffer_depth : buffer_size_;
 
     long long video_scheduled_ = 0;
     long long audio_scheduled_ = 0;
 
-    boost::circular_buffer<std::vector<int32_t>> audio_container_{static_cast<unsigned long>(buffer_size_ + 1)};
+    // The audio scheduled ahead, a slot per frame with room for the most samples of the cadence. The card copies it out
+    // before the slot comes round again, so nothing is allocated as audio is scheduled.
+    const int            audio_channels_     = get_audio_channels(config_, decklink_format_desc_);
+    const int            audio_slot_samples_ = get_max_audio_samples(decklink_format_desc_);
+    const int            audio_slots_        = max_buffer_size_ + 1;
+    std::vector<int32_t> audio_ring_;
+    int                  audio_slot_ = 0;
 
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
@@ -625,12 +686,20 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
                                                            bmdSupportedVideoModeDefault,
                                                            config_.hdr);
 
+    frame_pool frame_pool_{decklink_format_desc_, config_.hdr, max_buffer_size_ + 2};
+
     std::atomic<bool> abort_request_{false};
 
   public:
-    decklink_consumer(const configuration& config, core::video_format_desc channel_format_desc, int channel_index)
+    decklink_consumer(const configuration&               config,
+                      core::video_format_desc            channel_format_desc,
+                      int                                channel_index,
+                      std::shared_ptr<latency_monitor>   latency,
+                      std::shared_ptr<buffer_controller> buffer_depth)
         : channel_index_(channel_index)
         , config_(config)
+        , latency_(std::move(latency))
+        , buffer_depth_(std::move(buffer_depth))
         , channel_format_desc_(std::move(channel_format_desc))
         , decklink_format_desc_(get_decklink_format(config.primary, channel_format_desc_))
     {
@@ -640,6 +709,7 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         graph_->set_color("flushed-frame", diagnostics::color(0.4f, 0.3f, 0.8f));
         graph_->set_color("buffered-audio", diagnostics::color(0.9f, 0.9f, 0.5f));
         graph_->set_color("buffered-video", diagnostics::color(0.2f, 0.9f, 0.9f));
+        graph_->set_color("underrun-warning", diagnostics::color(0.9f, 0.6f, 0.2f));
 
         if (config.duplex != configuration::duplex_t::default_duplex) {
             set_duplex(iface_cast<IDeckLinkAttributes_v10_11>(decklink_),
@@ -698,20 +768,23 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         }
 
         if (config.embedded_audio) {
+            audio_ring_.resize(static_cast<size_t>(audio_slots_) * audio_slot_samples_ * audio_channels_);
             output_->BeginAudioPreroll();
         }
 
-        for (int n = 0; n < buffer_size_; ++n) {
+        const auto depth = buffer_depth_ ? buffer_depth_->depth() : buffer_size_;
+        for (int n = 0; n < depth; ++n) {
             auto nb_samples = decklink_format_desc_.audio_cadence[n % decklink_format_desc_.audio_cadence.size()] *
                               decklink_format_desc_.field_count;
             if (config.embedded_audio) {
-                schedule_next_audio(std::vector<int32_t>(nb_samples * decklink_format_desc_.audio_channels),
-                                    nb_samples);
+                auto slot = next_audio_slot();
+                std::fill(slot, slot + static_cast<size_t>(nb_samples) * audio_channels_, 0);
+                schedule_next_audio(slot, nb_samples);
             }
 
-            std::shared_ptr<void> image_data = allocate_frame_data(decklink_format_desc_, config_.hdr);
+            std::shared_ptr<void> image_data = frame_pool_.acquire();
 
-            schedule_next_video(image_data, nb_samples, video_scheduled_, config_.color_space);
+            schedule_next_video(image_data, nb_samples, video_scheduled_, config_.color_space, {});
             for (auto& context : secondary_port_contexts_) {
                 context->schedule_next_video(image_data, 0, video_scheduled_);
             }
@@ -790,7 +863,7 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
     {
         if (FAILED(output_->EnableAudioOutput(bmdAudioSampleRate48kHz,
                                               bmdAudioSampleType32bitInteger,
-                                              decklink_format_desc_.audio_channels,
+                                              audio_channels_,
                                               bmdAudioOutputStreamTimestamped))) {
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable audio output."));
         }
@@ -882,65 +955,122 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "flushed-frame");
             }
 
+            if (latency_ && result != bmdOutputFrameDropped && result != bmdOutputFrameFlushed) {
+                // The frame has been shown once it completes, so it went out a frame earlier
+                auto duration = std::chrono::duration<double>(static_cast<double>(decklink_format_desc_.duration) /
+                                                              decklink_format_desc_.time_scale);
+                latency_->add(dframe->timestamps(),
+                              dframe->scheduled(),
+                              std::chrono::steady_clock::now() -
+                                  std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+            }
+
+            UINT32 buffered_video = 0;
+            output_->GetBufferedVideoFrameCount(&buffered_video);
+
+            // Scheduling more or less than a frame per completed frame is what grows or shrinks the buffer
+            auto count = 1;
+            if (buffer_depth_) {
+                count = buffer_depth_->update(static_cast<int>(buffered_video),
+                                              result == bmdOutputFrameDisplayedLate || result == bmdOutputFrameDropped);
+                if (count > 1) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "underrun-warning");
+                }
+            }
+
             {
-                UINT32 buffered;
-                output_->GetBufferedVideoFrameCount(&buffered);
-                graph_->set_value("buffered-video", static_cast<double>(buffered) / config_.buffer_depth());
+                const auto depth = buffer_depth_ ? buffer_depth_->depth() : buffer_size_;
+                graph_->set_value("buffered-video", static_cast<double>(buffered_video) / depth);
 
                 if (config_.embedded_audio) {
-                    output_->GetBufferedAudioSampleFrameCount(&buffered);
+                    UINT32 buffered_audio = 0;
+                    output_->GetBufferedAudioSampleFrameCount(&buffered_audio);
                     graph_->set_value("buffered-audio",
-                                      static_cast<double>(buffered) /
+                                      static_cast<double>(buffered_audio) /
                                           (decklink_format_desc_.audio_cadence[0] * decklink_format_desc_.field_count *
-                                           config_.buffer_depth()));
+                                           depth));
                 }
             }
 
-            core::const_frame frame1 = pop();
-            core::const_frame frame2;
-
-            bool isInterlaced = mode_->GetFieldDominance() != bmdProgressiveFrame;
-            if (mode_->GetFieldDominance() != bmdProgressiveFrame) {
-                // If the main is not progressive, then pop the second frame
-                frame2 = pop();
+            for (int n = 0; n < count; ++n) {
+                if (!schedule_next_frame())
+                    return E_FAIL;
             }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            exception_ = std::current_exception();
+            return E_FAIL;
+        }
 
-            if (abort_request_)
-                return E_FAIL;
+        return S_OK;
+    }
 
-            BMDTimeValue video_display_time = video_scheduled_;
-            video_scheduled_ += decklink_format_desc_.duration;
+    bool schedule_next_frame()
+    {
+        core::const_frame frame1 = pop();
+        core::const_frame frame2;
 
-            std::vector<std::int32_t> audio_data;
-            if (config_.embedded_audio) {
-                audio_data.insert(audio_data.end(), frame1.audio_data().begin(), frame1.audio_data().end());
-                if (isInterlaced) {
-                    audio_data.insert(audio_data.end(), frame2.audio_data().begin(), frame2.audio_data().end());
-                }
+        bool isInterlaced = mode_->GetFieldDominance() != bmdProgressiveFrame;
+        if (mode_->GetFieldDominance() != bmdProgressiveFrame) {
+            // If the main is not progressive, then pop the second frame
+            frame2 = pop();
+        }
+
+        if (abort_request_)
+            return false;
+
+        BMDTimeValue video_display_time = video_scheduled_;
+        video_scheduled_ += decklink_format_desc_.duration;
+
+        std::int32_t* audio_data = nullptr;
+        int           nb_samples = 0;
+        if (config_.embedded_audio) {
+            audio_data = next_audio_slot();
+            nb_samples = convert_audio_for_port(frame1,
+                                                isInterlaced ? frame2 : core::const_frame{},
+                                                channel_format_desc_.audio_channels,
+                                                audio_data,
+                                                audio_channels_,
+                                                audio_slot_samples_);
+        }
+
+        // The secondary ports that take the same fields are converted in the same pass as the primary
+        std::vector<port_output> outputs{
+            {&decklink_format_desc_, &config_.primary, mode_->GetFieldDominance(), frame_pool_.acquire()}};
+        std::vector<decklink_secondary_port*> shared_ports;
+        std::vector<decklink_secondary_port*> other_ports;
+        for (auto& context : secondary_port_contexts_) {
+            if (context->shares_conversion(decklink_format_desc_.field_count)) {
+                outputs.push_back(context->output());
+                shared_ports.push_back(context.get());
+            } else {
+                other_ports.push_back(context.get());
             }
-            // TODO: is this reliable?
-            const int nb_samples = static_cast<int>(audio_data.size()) / decklink_format_desc_.audio_channels;
+        }
 
-            // Schedule video
-            tbb::parallel_for(-1, static_cast<int>(secondary_port_contexts_.size()), [&](int i) {
+        // Schedule video, in the arena of work that has to finish within the frame
+        run_in_arena(task_kind::realtime, [&] {
+            tbb::parallel_for(-1, static_cast<int>(other_ports.size()), [&](int i) {
                 if (i == -1) {
                     // Primary port
-                    std::shared_ptr<void> image_data = convert_frame_for_port(channel_format_desc_,
-                                                                              decklink_format_desc_,
-                                                                              config_.primary,
-                                                                              frame1,
-                                                                              frame2,
-                                                                              mode_->GetFieldDominance(),
-                                                                              config_.hdr);
+                    convert_frame_for_ports(channel_format_desc_, outputs, frame1, frame2, config_.hdr);
 
-                    schedule_next_video(image_data, nb_samples, video_display_time, config_.color_space);
+                    schedule_next_video(outputs[0].image_data,
+                                        nb_samples,
+                                        video_display_time,
+                                        config_.color_space,
+                                        frame1 ? frame1.timestamps() : core::frame_timestamps{});
 
                     if (config_.embedded_audio) {
-                        schedule_next_audio(std::move(audio_data), nb_samples);
+                        schedule_next_audio(audio_data, nb_samples);
+                    }
+
+                    for (size_t n = 0; n < shared_ports.size(); ++n) {
+                        shared_ports[n]->schedule_next_video(outputs[n + 1].image_data, 0, video_display_time);
                     }
                 } else {
                     // Send frame to secondary ports
-                    auto& context = secondary_port_contexts_[i];
+                    auto context = other_ports[i];
                     context->schedule_frame(frame1, video_display_time);
                     if (isInterlaced) {
                         context->schedule_frame(frame2, video_display_time);
@@ -951,14 +1081,9 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
                     }
                 }
             });
+        });
 
-        } catch (...) {
-            std::lock_guard<std::mutex> lock(exception_mutex_);
-            exception_ = std::current_exception();
-            return E_FAIL;
-        }
-
-        return S_OK;
+        return true;
     }
 
     core::const_frame pop()
@@ -976,13 +1101,16 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         return frame;
     }
 
-    void schedule_next_audio(std::vector<std::int32_t> audio, int nb_samples)
+    std::int32_t* next_audio_slot()
     {
-        // TODO (refactor) does ScheduleAudioSamples copy data?
-
-        audio_container_.push_back(std::move(audio));
+        auto slot   = audio_ring_.data() + static_cast<size_t>(audio_slot_) * audio_slot_samples_ * audio_channels_;
+        audio_slot_ = (audio_slot_ + 1) % audio_slots_;
+        return slot;
+    }
 
-        if (FAILED(output_->ScheduleAudioSamples(audio_container_.back().data(),
+    void schedule_next_audio(std::int32_t* audio, int nb_samples)
+    {
+        if (FAILED(output_->ScheduleAudioSamples(audio,
                                                  nb_samples,
                                                  audio_scheduled_,
                                                  decklink_format_desc_.audio_sample_rate,
@@ -993,13 +1121,17 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         audio_scheduled_ += nb_samples; // TODO - what if there are too many/few samples in this frame?
     }
 
-    void schedule_next_video(std::shared_ptr<void> image_data,
-                             int                   nb_samples,
-                             BMDTimeValue          display_time,
-                             core::color_space     color_space)
+    void schedule_next_video(std::shared_ptr<void>         image_data,
+                             int                           nb_samples,
+                             BMDTimeValue                  display_time,
+                             core::color_space             color_space,
+                             const core::frame_timestamps& timestamps)
     {
-        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(
-            std::move(image_data), decklink_format_desc_, nb_samples, config_.hdr, color_space, config_.hdr_meta));
+        auto frame = new decklink_frame(
+            std::move(image_data), decklink_format_desc_, nb_samples, config_.hdr, color_space, config_.hdr_meta);
+        frame->stamp(timestamps);
+
+        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(frame);
         if (FAILED(output_->ScheduleVideoFrame(
                 get_raw(fill_frame), display_time, decklink_format_desc_.duration, decklink_format_desc_.time_scale))) {
             CASPAR_LOG(error) << print() << L" Failed to schedule primary video.";
@@ -1045,14 +1177,24 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
 
 struct decklink_consumer_proxy : public core::frame_consumer
 {
-    const configuration                config_;
-    std::unique_ptr<decklink_consumer> consumer_;
-    core::video_format_desc            format_desc_;
-    executor                           executor_;
+    const configuration                      config_;
+    const std::shared_ptr<latency_monitor>   latency_;
+    const std::shared_ptr<buffer_controller> buffer_depth_;
+    std::unique_ptr<decklink_consumer>       consumer_;
+    core::video_format_desc                  format_desc_;
+    std::atomic<bool>                        packed_rgb10_{false};
+    std::atomic<bool>                        shows_fields_{false};
+    std::vector<core::output_size>           sizes_;
+    mutable std::mutex                       sizes_mutex_;
+    executor                                 executor_;
 
   public:
     explicit decklink_consumer_proxy(const configuration& config)
         : config_(config)
+        , latency_(config.measure_latency ? std::make_shared<latency_monitor>() : nullptr)
+        , buffer_depth_(config.max_buffer_depth > config.buffer_depth()
+                            ? std::make_shared<buffer_controller>(config.buffer_depth(), config.max_buffer_depth)
+                            : nullptr)
         , executor_(L"decklink_consumer[" + std::to_wstring(config.primary.device_index) + L"]")
     {
         executor_.begin_invoke([=] { com_initialize(); });
@@ -1072,8 +1214,35 @@ struct decklink_consumer_proxy : public core::frame_consumer
         format_desc_ = format_desc;
         executor_.invoke([=] {
             consumer_.reset();
-            consumer_ = std::make_unique<decklink_consumer>(config_, format_desc, channel_info.index);
+            consumer_ = std::make_unique<decklink_consumer>(
+                config_, format_desc, channel_info.index, latency_, buffer_depth_);
         });
+
+        // HDR is sent as 10bit RGB, which the mixer can pack unless the port has to convert from another format
+        packed_rgb10_ = config_.hdr && get_decklink_format(config_.primary, format_desc).format == format_desc.format;
+
+        // Each port reads the channel image, or the image the mixer scaled to its format. A port at a progressive
+        // format shows every line of the frames of both fields, and a scaled one needs the fields as separate frames.
+        std::vector<core::output_size> sizes;
+        bool                           fields = true;
+
+        auto add_port = [&](const port_configuration& port) {
+            auto decklink_format_desc = get_decklink_format(port, format_desc);
+            auto size = port.scale ? core::output_size{decklink_format_desc.width, decklink_format_desc.height}
+                                   : core::output_size{format_desc.width, format_desc.height};
+            if (std::find(sizes.begin(), sizes.end(), size) == sizes.end())
+                sizes.push_back(size);
+            fields = fields && decklink_format_desc.field_count == 2 &&
+                     size == core::output_size{format_desc.width, format_desc.height};
+        };
+        add_port(config_.primary);
+        for (auto& port : config_.secondaries) {
+            add_port(port);
+        }
+        shows_fields_ = fields;
+
+        std::lock_guard<std::mutex> lock(sizes_mutex_);
+        sizes_ = std::move(sizes);
     }
 
     std::future<bool> send(core::video_field field, core::const_frame frame) override
@@ -1092,7 +1261,34 @@ struct decklink_consumer_proxy : public core::frame_consumer
 
     [[nodiscard]] bool has_synchronization_clock() const override { return true; }
 
-    [[nodiscard]] core::monitor::state state() const override { return get_state_for_config(config_, format_desc_); }
+    [[nodiscard]] std::vector<core::output_packing> packings() const override
+    {
+        if (packed_rgb10_)
+            return {core::output_packing::rgb10};
+        return {};
+    }
+
+    [[nodiscard]] std::vector<core::output_size> sizes() const override
+    {
+        if (packed_rgb10_)
+            return {};
+        std::lock_guard<std::mutex> lock(sizes_mutex_);
+        return sizes_;
+    }
+
+    [[nodiscard]] bool shows_fields() const override { return shows_fields_; }
+
+    [[nodiscard]] core::monitor::state state() const override
+    {
+        auto state = get_state_for_config(config_, format_desc_);
+        if (latency_) {
+            state["decklink/measured-latency"] = latency_->state();
+        }
+        if (buffer_depth_) {
+            state["decklink/buffer"] = buffer_depth_->state();
+        }
+        return state;
+    }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
@@ -1106,7 +1302,8 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     configuration config = parse_amcp_config(params, format_repository, channel_info);
 
-    config.hdr = (channel_info.depth != common::bit_depth::bit8);
+    config.hdr               = (channel_info.depth != common::bit_depth::bit8);
+    config.hdr_meta.transfer = channel_info.transfer;
 
     if (config.hdr && config.primary.key_only) {
         CASPAR_THROW_EXCEPTION(caspar_exception()
@@ -1124,7 +1321,8 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
 {
     configuration config = parse_xml_config(ptree, format_repository, channel_info);
 
-    config.hdr = (channel_info.depth != common::bit_depth::bit8);
+    config.hdr               = (channel_info.depth != common::bit_depth::bit8);
+    config.hdr_meta.transfer = channel_info.transfer;
 
     if (config.hdr && config.primary.has_subregion_geometry()) {
         CASPAR_THROW_EXCEPTION(caspar_exception()
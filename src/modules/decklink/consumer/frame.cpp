@@ -23,11 +23,27 @@
 
 #include "frame.h"
 
+#include <common/host_buffer.h>
 #include <common/memshfl.h>
 
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse4.1.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <smmintrin.h>
+#endif
+#endif
+
+#include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
 #include <tbb/scalable_allocator.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace caspar { namespace decklink {
 
 BMDPixelFormat get_pixel_format(bool hdr) { return hdr ? bmdFormat10BitRGBXLE : bmdFormat8BitBGRA; }
@@ -38,136 +54,385 @@ int            get_row_bytes(const core::video_format_desc& format_desc, bool hd
 
 std::shared_ptr<void> allocate_frame_data(const core::video_format_desc& format_desc, bool hdr)
 {
-    auto alignment = hdr ? 256 : 64;
-    auto size      = hdr ? get_row_bytes(format_desc, hdr) * format_desc.height : format_desc.size;
-    return create_aligned_buffer(size, alignment);
+    // Page aligned, which covers the 256 bytes that the 10 bit formats need
+    auto size = hdr ? get_row_bytes(format_desc, hdr) * format_desc.height : format_desc.size;
+    return create_host_buffer(size);
+}
+
+frame_pool::frame_pool(core::video_format_desc format_desc, bool hdr, int capacity)
+    : format_desc_(std::move(format_desc))
+    , hdr_(hdr)
+{
+    auto size = hdr_ ? get_row_bytes(format_desc_, hdr_) * format_desc_.height : format_desc_.size;
+    for (int n = 0; n < capacity; ++n) {
+        auto buffer = allocate_frame_data(format_desc_, hdr_);
+        // Fault the pages in now rather than on the first frames of playback
+        std::memset(buffer.get(), 0, size);
+        impl_->buffers.push_back(std::move(buffer));
+    }
 }
 
-std::shared_ptr<void> convert_to_key_only(const std::shared_ptr<void>& image_data, std::size_t byte_count)
+std::shared_ptr<void> frame_pool::acquire()
 {
-    auto key_data = create_aligned_buffer(byte_count);
+    std::shared_ptr<void> buffer;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        if (!impl_->buffers.empty()) {
+            buffer = std::move(impl_->buffers.back());
+            impl_->buffers.pop_back();
+        }
+    }
 
-    aligned_memshfl(key_data.get(), image_data.get(), byte_count, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+    // More frames are in flight than the pool was sized for, so grow it
+    if (!buffer)
+        buffer = allocate_frame_data(format_desc_, hdr_);
 
-    return key_data;
+    auto raw = buffer.get();
+    return std::shared_ptr<void>(raw, [buffer = std::move(buffer), impl = impl_](void*) mutable {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->buffers.push_back(std::move(buffer));
+    });
 }
 
-void convert_frame(const core::video_format_desc& channel_format_desc,
-                   const core::video_format_desc& decklink_format_desc,
-                   const port_configuration&      config,
-                   std::shared_ptr<void>&         image_data,
-                   bool                           topField,
-                   const core::const_frame&       frame,
-                   bool                           hdr)
+namespace {
+
+// Packs eight byte B16G16R16A16 pixels as four byte 10bit RGB R10G10B10XX
+void pack_rgb10_scalar(const uint16_t* src, uint32_t* dest, int begin, int count)
 {
-    // No point copying an empty frame
-    if (!frame)
-        return;
+    for (auto x = begin; x < count; ++x) {
+        const uint32_t blue  = src[x * 4] >> 6;
+        const uint32_t green = src[x * 4 + 1] >> 6;
+        const uint32_t red   = src[x * 4 + 2] >> 6;
+        dest[x]              = (red << 22) + (green << 12) + (blue << 2);
+    }
+}
 
-    int firstLine = topField ? 0 : 1;
-
-    if (channel_format_desc.format == decklink_format_desc.format && config.src_x == 0 && config.src_y == 0 &&
-        config.region_w == 0 && config.region_h == 0 && config.dest_x == 0 && config.dest_y == 0) {
-        // Fast path
-
-        if (hdr) {
-            // Pack eight byte R16G16B16A16 pixels as four byte 10bit RGB R10G10B10XX
-            const int NUM_THREADS     = 4;
-            auto      rows_per_thread = decklink_format_desc.height / NUM_THREADS;
-            size_t    byte_count_line = get_row_bytes(decklink_format_desc, hdr);
-            tbb::parallel_for(0, NUM_THREADS, [&](int i) {
-                auto end = (i + 1) * rows_per_thread;
-                for (int y = firstLine + i * rows_per_thread; y < end; y += decklink_format_desc.field_count) {
-                    auto dest = reinterpret_cast<uint32_t*>(image_data.get()) + (long long)y * byte_count_line / 4;
-                    for (int x = 0; x < decklink_format_desc.width; x += 1) {
-                        auto src = reinterpret_cast<const uint16_t*>(
-                            frame.image_data(0).data() + (long long)y * decklink_format_desc.width * 8 + x * 8);
-                        uint16_t blue  = src[0] >> 6;
-                        uint16_t green = src[1] >> 6;
-                        uint16_t red   = src[2] >> 6;
-                        dest[x]        = ((uint32_t)(red) << 22) + ((uint32_t)(green) << 12) + ((uint32_t)(blue) << 2);
-                    }
-                }
-            });
+// Four pixels at a time, with the same result as pack_rgb10_scalar
+void pack_rgb10(const uint16_t* src, uint32_t* dest, int count)
+{
+    // Multiplying by these moves each channel into its place in the packed pixel
+    const auto places = _mm_setr_epi32(1 << 2, 1 << 12, 1 << 22, 0);
+    const auto zero   = _mm_setzero_si128();
 
-        } else {
-            size_t byte_count_line = (size_t)decklink_format_desc.width * 4;
-            for (int y = firstLine; y < decklink_format_desc.height; y += decklink_format_desc.field_count) {
-                std::memcpy(reinterpret_cast<char*>(image_data.get()) + (long long)y * byte_count_line,
-                            frame.image_data(0).data() + (long long)y * byte_count_line,
-                            byte_count_line);
-            }
+    auto place = [&](__m128i channels) { return _mm_mullo_epi32(channels, places); };
+
+    auto x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const auto p0 = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4)), 6);
+        const auto p1 = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4 + 8)), 6);
+
+        // The channels don't overlap once placed, so adding them up packs the pixel
+        const auto p01 = _mm_hadd_epi32(place(_mm_unpacklo_epi16(p0, zero)), place(_mm_unpackhi_epi16(p0, zero)));
+        const auto p23 = _mm_hadd_epi32(place(_mm_unpacklo_epi16(p1, zero)), place(_mm_unpackhi_epi16(p1, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + x), _mm_hadd_epi32(p01, p23));
+    }
+
+    pack_rgb10_scalar(src, dest, x, count);
+}
+
+// Lines per task, so that each is around 256KB and small formats aren't split up more than is worth it while large
+// ones use all the cores
+int grain_size(std::size_t row_bytes) { return std::max<int>(1, static_cast<int>((256 * 1024) / row_bytes)); }
+
+// Calls func with every line of a field in parallel
+template <typename Func>
+void for_each_line(const core::video_format_desc& format_desc, int first_line, std::size_t row_bytes, Func&& func)
+{
+    const auto line_count = (format_desc.height - first_line + format_desc.field_count - 1) / format_desc.field_count;
+    const auto grain      = grain_size(row_bytes);
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, line_count, grain), [&](const tbb::blocked_range<int>& r) {
+        for (auto n = r.begin(); n != r.end(); ++n) {
+            func(first_line + n * format_desc.field_count);
         }
+    });
+}
+
+// Copies the alpha of four byte BGRA pixels into all four bytes, as a key
+void key_bgra(const uint8_t* src, uint8_t* dest, int count)
+{
+    const auto alpha = _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+
+    auto x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + x * 4), _mm_shuffle_epi8(p, alpha));
+    }
+
+    for (; x < count; ++x) {
+        std::memset(dest + x * 4, src[x * 4 + 3], 4);
+    }
+}
+
+// Packs the alpha of eight byte B16G16R16A16 pixels into each channel of four byte R10G10B10XX, as a key
+void key_rgb10(const uint16_t* src, uint32_t* dest, int count)
+{
+    const uint32_t places = (1 << 22) + (1 << 12) + (1 << 2);
+
+    const auto alpha01 = _mm_setr_epi8(6, 7, -1, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const auto alpha23 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 6, 7, -1, -1, 14, 15, -1, -1);
+
+    auto x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const auto p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        const auto p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4 + 8));
+
+        const auto a = _mm_srli_epi32(_mm_or_si128(_mm_shuffle_epi8(p0, alpha01), _mm_shuffle_epi8(p1, alpha23)), 6);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + x), _mm_mullo_epi32(a, _mm_set1_epi32(places)));
+    }
+
+    for (; x < count; ++x) {
+        dest[x] = (src[x * 4 + 3] >> 6) * places;
+    }
+}
+
+// How one port takes its lines of a field from the frame
+struct port_plan
+{
+    const core::video_format_desc* format_desc;
+    char*                          dest;
+    std::size_t                    byte_count_line;
+    int                            first_line;
+
+    // The source is either 8bit BGRA, 16bit BGRA to be packed, or 10bit RGB already packed by the mixer. A scaled
+    // source is the image the mixer scaled to the format of the port, rather than the channel image.
+    const char* src;
+    bool        scaled;
+    std::size_t byte_count_src_line;
+    std::size_t src_pixel_bytes;
+    bool        pack;
+    bool        key_only;
+
+    int x_skip_src;
+    int y_skip_src_lines;
+    int y_skip_dest_lines;
+    int max_y_content;
+    int copy_per_line;
+
+    std::size_t byte_offset_dest_line;
+    std::size_t byte_copy_per_line;
+    std::size_t byte_pad_end_of_line;
+};
+
+port_plan make_plan(const core::video_format_desc& channel_format_desc,
+                    const port_output&             output,
+                    bool                           topField,
+                    const core::const_frame&       frame,
+                    bool                           hdr)
+{
+    const auto& decklink_format_desc = *output.format_desc;
+    const auto& config               = *output.config;
+
+    port_plan plan;
+    plan.format_desc     = output.format_desc;
+    plan.dest            = reinterpret_cast<char*>(output.image_data.get());
+    plan.byte_count_line = get_row_bytes(decklink_format_desc, hdr);
+    plan.first_line      = topField ? 0 : 1;
+    plan.key_only        = config.key_only;
+
+    // Only set for a size other than that of the channel. Frames mixed before the consumer was added may not carry it
+    // either, and then a region is copied.
+    auto& scaled = frame.scaled_data(core::output_size{decklink_format_desc.width, decklink_format_desc.height});
+    plan.scaled  = config.scale && scaled.size() > 0;
+
+    const auto& source_format_desc = plan.scaled ? decklink_format_desc : channel_format_desc;
+
+    auto& packed = frame.packed_data(core::output_packing::rgb10);
+    if (plan.scaled) {
+        plan.src                 = reinterpret_cast<const char*>(scaled.data());
+        plan.src_pixel_bytes     = hdr ? 8 : 4;
+        plan.byte_count_src_line = (size_t)source_format_desc.width * plan.src_pixel_bytes;
+        plan.pack                = hdr;
+    } else if (hdr && packed.size() > 0 && !config.key_only) {
+        plan.src                 = reinterpret_cast<const char*>(packed.data());
+        plan.byte_count_src_line = get_row_bytes(channel_format_desc, hdr);
+        plan.src_pixel_bytes     = 4;
+        plan.pack                = false;
     } else {
-        // Take a sub-region
+        // The packed frame has no alpha, so a key is always taken from the 16bit one
+        plan.src                 = reinterpret_cast<const char*>(frame.image_data(0).data());
+        plan.src_pixel_bytes     = hdr ? 8 : 4;
+        plan.byte_count_src_line = (size_t)channel_format_desc.width * plan.src_pixel_bytes;
+        plan.pack                = hdr;
+    }
 
-        // TODO: Add support for hdr frames
+    // Some repetitive numbers, in pixels
+    int x_skip_dest        = std::min(std::max(0, config.dest_x), decklink_format_desc.width);
+    plan.x_skip_src        = std::max(0, config.src_x);
+    plan.y_skip_src_lines  = std::max(0, config.src_y);
+    plan.y_skip_dest_lines = std::max(0, config.dest_y);
 
-        // Some repetitive numbers
-        size_t byte_count_dest_line  = (size_t)decklink_format_desc.width * 4;
-        size_t byte_count_src_line   = (size_t)channel_format_desc.width * 4;
-        size_t byte_offset_src_line  = std::max(0, (config.src_x * 4));
-        size_t byte_offset_dest_line = std::max(0, (config.dest_x * 4));
-        int    y_skip_src_lines      = std::max(0, config.src_y);
-        int    y_skip_dest_lines     = std::max(0, config.dest_y);
+    plan.copy_per_line = std::max(
+        0, std::min(source_format_desc.width - plan.x_skip_src, decklink_format_desc.width - x_skip_dest));
+    if (config.region_w > 0) // If the user chose a width, respect that
+        plan.copy_per_line = std::min(plan.copy_per_line, config.region_w);
 
-        size_t byte_copy_per_line =
-            std::min(byte_count_src_line - byte_offset_src_line, byte_count_dest_line - byte_offset_dest_line);
-        if (config.region_w > 0) // If the user chose a width, respect that
-            byte_copy_per_line = std::min(byte_copy_per_line, (size_t)config.region_w * 4);
+    int copy_line_count = std::min(source_format_desc.height - plan.y_skip_src_lines,
+                                   decklink_format_desc.height - plan.y_skip_dest_lines);
+    if (config.region_h > 0) // If the user chose a height, respect that
+        copy_line_count = std::min(copy_line_count, config.region_h);
 
-        size_t byte_pad_end_of_line =
-            std::max(((size_t)decklink_format_desc.width * 4) - byte_copy_per_line - byte_offset_dest_line, (size_t)0);
+    plan.max_y_content =
+        plan.y_skip_dest_lines + std::max(0, std::min(copy_line_count, source_format_desc.height));
 
-        int copy_line_count =
-            std::min(channel_format_desc.height - y_skip_src_lines, decklink_format_desc.height - y_skip_dest_lines);
-        if (config.region_h > 0) // If the user chose a height, respect that
-            copy_line_count = std::min(copy_line_count, config.region_h);
+    plan.byte_offset_dest_line = (size_t)x_skip_dest * 4;
+    plan.byte_copy_per_line    = (size_t)plan.copy_per_line * 4;
+    plan.byte_pad_end_of_line  = plan.byte_count_line - plan.byte_offset_dest_line - plan.byte_copy_per_line;
 
-        int max_y_content = y_skip_dest_lines + std::min(copy_line_count, channel_format_desc.height);
+    return plan;
+}
 
-        for (int y = firstLine; y < y_skip_dest_lines; y += decklink_format_desc.field_count) {
-            // Fill the line with black
-            std::memset(
-                reinterpret_cast<char*>(image_data.get()) + (byte_count_dest_line * y), 0, byte_count_dest_line);
-        }
+void copy_line(const port_plan& plan, int y)
+{
+    auto line_start_ptr   = plan.dest + (long long)y * plan.byte_count_line;
+    auto line_content_ptr = line_start_ptr + plan.byte_offset_dest_line;
+
+    // Fill the start with black
+    if (plan.byte_offset_dest_line > 0) {
+        std::memset(line_start_ptr, 0, plan.byte_offset_dest_line);
+    }
 
-        int firstFillLine = y_skip_dest_lines;
-        if (decklink_format_desc.field_count != 1 && firstFillLine % 2 != firstLine)
-            firstFillLine += 1;
-        for (int y = firstFillLine; y < max_y_content; y += decklink_format_desc.field_count) {
-            auto line_start_ptr   = reinterpret_cast<char*>(image_data.get()) + (long long)y * byte_count_dest_line;
-            auto line_content_ptr = line_start_ptr + byte_offset_dest_line;
+    // Copy the pixels
+    long long src_y    = y + plan.y_skip_src_lines - plan.y_skip_dest_lines;
+    auto      src_line = plan.src + src_y * plan.byte_count_src_line + plan.x_skip_src * plan.src_pixel_bytes;
+    if (plan.key_only && plan.pack) {
+        key_rgb10(reinterpret_cast<const uint16_t*>(src_line),
+                  reinterpret_cast<uint32_t*>(line_content_ptr),
+                  plan.copy_per_line);
+    } else if (plan.key_only) {
+        key_bgra(reinterpret_cast<const uint8_t*>(src_line),
+                 reinterpret_cast<uint8_t*>(line_content_ptr),
+                 plan.copy_per_line);
+    } else if (plan.pack) {
+        pack_rgb10(reinterpret_cast<const uint16_t*>(src_line),
+                   reinterpret_cast<uint32_t*>(line_content_ptr),
+                   plan.copy_per_line);
+    } else {
+        std::memcpy(line_content_ptr, src_line, plan.byte_copy_per_line);
+    }
+
+    // Fill the end with black
+    if (plan.byte_pad_end_of_line > 0) {
+        std::memset(line_content_ptr + plan.byte_copy_per_line, 0, plan.byte_pad_end_of_line);
+    }
+}
 
-            // Fill the start with black
-            if (byte_offset_dest_line > 0) {
-                std::memset(line_start_ptr, 0, byte_offset_dest_line);
+void convert_field(const core::video_format_desc&  channel_format_desc,
+                   const std::vector<port_output>& outputs,
+                   bool                            second_field,
+                   const core::const_frame&        frame,
+                   bool                            hdr)
+{
+    // No point copying an empty frame
+    if (!frame)
+        return;
+
+    std::vector<port_plan> plans;
+    for (auto& output : outputs) {
+        if (output.field_dominance == bmdProgressiveFrame) {
+            if (!second_field)
+                plans.push_back(make_plan(channel_format_desc, output, true, frame, hdr));
+        } else {
+            auto upper_first = output.field_dominance == bmdUpperFieldFirst;
+            plans.push_back(make_plan(channel_format_desc, output, second_field != upper_first, frame, hdr));
+        }
+    }
+
+    // Each line of the frame is read once, and copied to every port that shows it while it is in cache
+    std::size_t byte_count_src_line = (size_t)channel_format_desc.width * (hdr ? 8 : 4);
+    tbb::parallel_for(
+        tbb::blocked_range<int>(0, channel_format_desc.height, grain_size(byte_count_src_line)),
+        [&](const tbb::blocked_range<int>& r) {
+            for (auto src_y = r.begin(); src_y != r.end(); ++src_y) {
+                for (auto& plan : plans) {
+                    int y = src_y - plan.y_skip_src_lines + plan.y_skip_dest_lines;
+                    if (plan.scaled || src_y < plan.y_skip_src_lines || y >= plan.max_y_content ||
+                        (y - plan.first_line) % plan.format_desc->field_count != 0)
+                        continue;
+
+                    copy_line(plan, y);
+                }
             }
+        });
+
+    // A scaled image is only read by its own port
+    for (auto& plan : plans) {
+        if (!plan.scaled)
+            continue;
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, plan.max_y_content, grain_size(plan.byte_count_src_line)),
+                          [&](const tbb::blocked_range<int>& r) {
+                              for (auto y = r.begin(); y != r.end(); ++y) {
+                                  if ((y - plan.first_line) % plan.format_desc->field_count == 0)
+                                      copy_line(plan, y);
+                              }
+                          });
+    }
 
-            // Copy the pixels
-            long long src_y = y + y_skip_src_lines - y_skip_dest_lines;
-            std::memcpy(line_content_ptr,
-                        frame.image_data(0).data() + src_y * byte_count_src_line + byte_offset_src_line,
-                        byte_copy_per_line);
+    // Fill the lines around the content with black
+    for (auto& plan : plans) {
+        if (plan.y_skip_dest_lines == 0 && plan.max_y_content >= plan.format_desc->height)
+            continue;
 
-            // Fill the end with black
-            if (byte_pad_end_of_line > 0) {
-                std::memset(line_content_ptr + byte_copy_per_line, 0, byte_pad_end_of_line);
+        for_each_line(*plan.format_desc, plan.first_line, plan.byte_count_line, [&](int y) {
+            if (y < plan.y_skip_dest_lines || y >= plan.max_y_content)
+                std::memset(plan.dest + (long long)y * plan.byte_count_line, 0, plan.byte_count_line);
+        });
+    }
+}
+
+// Copies the first channels of each sample of interleaved audio, and silences those that src does not have
+void reduce_audio(const int32_t* src, int src_channels, int32_t* dest, int dest_channels, int nb_samples)
+{
+    if (src_channels == dest_channels) {
+        std::memcpy(dest, src, sizeof(int32_t) * nb_samples * dest_channels);
+        return;
+    }
+
+    const auto channels = std::min(src_channels, dest_channels);
+
+    int n = 0;
+    if (channels == 2 && dest_channels == 2) {
+        // Two samples of stereo at a time
+        for (; n + 2 <= nb_samples; n += 2) {
+            const auto a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + n * src_channels));
+            const auto b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + (n + 1) * src_channels));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n * 2), _mm_unpacklo_epi64(a, b));
+        }
+    } else if (channels % 4 == 0) {
+        for (; n < nb_samples; ++n) {
+            auto s = src + n * src_channels;
+            auto d = dest + n * dest_channels;
+            for (int c = 0; c < channels; c += 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(d + c),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + c)));
             }
+            std::fill(d + channels, d + dest_channels, 0);
         }
+    }
 
-        // Calculate the first line number to fill with black
-        if (decklink_format_desc.field_count != 1 && max_y_content % 2 != firstLine)
-            max_y_content += 1;
-        for (int y = max_y_content; y < decklink_format_desc.height; y += decklink_format_desc.field_count) {
-            // Fill the line with black
-            std::memset(
-                reinterpret_cast<char*>(image_data.get()) + (byte_count_dest_line * y), 0, byte_count_dest_line);
-        }
+    for (; n < nb_samples; ++n) {
+        auto s = src + n * src_channels;
+        auto d = dest + n * dest_channels;
+        std::copy(s, s + channels, d);
+        std::fill(d + channels, d + dest_channels, 0);
     }
 }
 
-std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& channel_format_desc,
+} // namespace
+
+void convert_frame_for_ports(const core::video_format_desc&  channel_format_desc,
+                             const std::vector<port_output>& outputs,
+                             const core::const_frame&        frame1,
+                             const core::const_frame&        frame2,
+                             bool                            hdr)
+{
+    convert_field(channel_format_desc, outputs, false, frame1, hdr);
+    convert_field(channel_format_desc, outputs, true, frame2, hdr);
+}
+
+std::shared_ptr<void> convert_frame_for_port(frame_pool&                    pool,
+                                             const core::video_format_desc& channel_format_desc,
                                              const core::video_format_desc& decklink_format_desc,
                                              const port_configuration&      config,
                                              const core::const_frame&       frame1,
@@ -175,34 +440,33 @@ std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& chan
                                              BMDFieldDominance              field_dominance,
                                              bool                           hdr)
 {
-    std::shared_ptr<void> image_data = allocate_frame_data(decklink_format_desc, hdr);
-
-    if (field_dominance != bmdProgressiveFrame) {
-        convert_frame(channel_format_desc,
-                      decklink_format_desc,
-                      config,
-                      image_data,
-                      field_dominance == bmdUpperFieldFirst,
-                      frame1,
-                      hdr);
-
-        convert_frame(channel_format_desc,
-                      decklink_format_desc,
-                      config,
-                      image_data,
-                      field_dominance != bmdUpperFieldFirst,
-                      frame2,
-                      hdr);
+    std::vector<port_output> outputs{{&decklink_format_desc, &config, field_dominance, pool.acquire()}};
 
-    } else {
-        convert_frame(channel_format_desc, decklink_format_desc, config, image_data, true, frame1, hdr);
-    }
+    convert_frame_for_ports(channel_format_desc, outputs, frame1, frame2, hdr);
 
-    if (config.key_only) {
-        image_data = convert_to_key_only(image_data, decklink_format_desc.size);
-    }
+    return outputs[0].image_data;
+}
 
-    return image_data;
+int convert_audio_for_port(const core::const_frame& frame1,
+                           const core::const_frame& frame2,
+                           int                      frame_channels,
+                           int32_t*                 dest,
+                           int                      channels,
+                           int                      max_samples)
+{
+    int nb_samples = 0;
+    for (auto frame : {&frame1, &frame2}) {
+        const auto& audio = frame->audio_data();
+        if (audio.size() == 0) {
+            continue;
+        }
+        const auto src_channels = frame->audio_channels() > 0 ? frame->audio_channels() : frame_channels;
+        const auto count        = std::min(static_cast<int>(audio.size()) / src_channels, max_samples - nb_samples);
+
+        reduce_audio(audio.data(), src_channels, dest + static_cast<size_t>(nb_samples) * channels, channels, count);
+        nb_samples += count;
+    }
+    return nb_samples;
 }
 
 }} // namespace caspar::decklink
@@ -28,9 +28,12 @@
 #include "../decklink_api.h"
 
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace caspar { namespace decklink {
 
@@ -39,7 +42,44 @@ int            get_row_bytes(const core::video_format_desc& format_desc, bool hd
 
 std::shared_ptr<void> allocate_frame_data(const core::video_format_desc& format_desc, bool hdr);
 
-std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& channel_format_desc,
+// Recycles the image buffers of a port. A buffer goes back to the pool once the last reference to it is released,
+// which is when the DeckLink driver has completed the frame that wraps it.
+class frame_pool
+{
+    struct impl
+    {
+        std::mutex                         mutex;
+        std::vector<std::shared_ptr<void>> buffers;
+    };
+
+    core::video_format_desc format_desc_;
+    bool                    hdr_;
+    std::shared_ptr<impl>   impl_ = std::make_shared<impl>();
+
+  public:
+    frame_pool(core::video_format_desc format_desc, bool hdr, int capacity);
+
+    std::shared_ptr<void> acquire();
+};
+
+// A port to convert a frame for, into image_data
+struct port_output
+{
+    const core::video_format_desc* format_desc;
+    const port_configuration*      config;
+    BMDFieldDominance              field_dominance;
+    std::shared_ptr<void>          image_data;
+};
+
+// Converts the frame for several ports in one pass, reading each line of it once
+void convert_frame_for_ports(const core::video_format_desc&  channel_format_desc,
+                             const std::vector<port_output>& outputs,
+                             const core::const_frame&        frame1,
+                             const core::const_frame&        frame2,
+                             bool                            hdr);
+
+std::shared_ptr<void> convert_frame_for_port(frame_pool&                    pool,
+                                             const core::video_format_desc& channel_format_desc,
                                              const core::video_format_desc& decklink_format_desc,
                                              const port_configuration&      config,
                                              const core::const_frame&       frame1,
@@ -47,4 +87,14 @@ std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& chan
                                              BMDFieldDominance              field_dominance,
                                              bool                           hdr);
 
+// Copies the audio of frame1 and then frame2 into dest, at channels per sample, straight from the arrays of the mixer.
+// Frames that do not say how many channels they have are taken to have frame_channels. Returns the samples per channel
+// copied, at most max_samples.
+int convert_audio_for_port(const core::const_frame& frame1,
+                           const core::const_frame& frame2,
+                           int                      frame_channels,
+                           int32_t*                 dest,
+                           int                      channels,
+                           int                      max_samples);
+
 }} // namespace caspar::decklink
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace caspar { namespace decklink {
+
+namespace {
+
+const auto report_period = std::chrono::seconds(10);
+
+const char* const stage_names[] = {"input", "mixer", "consumer", "output", "end-to-end"};
+
+} // namespace
+
+void latency_histogram::add(double milliseconds)
+{
+    auto bucket = static_cast<std::size_t>(std::max(0.0, std::floor(milliseconds)));
+    buckets_[std::min(bucket, buckets_.size() - 1)] += 1;
+    count_ += 1;
+    max_ = std::max(max_, milliseconds);
+}
+
+double latency_histogram::percentile(double share) const
+{
+    const auto    rank = static_cast<std::uint32_t>(std::ceil(share * count_));
+    std::uint32_t seen = 0;
+    for (std::size_t n = 0; n < buckets_.size(); ++n) {
+        seen += buckets_[n];
+        if (seen >= rank && seen > 0)
+            return static_cast<double>(n + 1);
+    }
+    return 0.0;
+}
+
+void latency_monitor::add(const core::frame_timestamps& timestamps,
+                          clock::time_point             scheduled,
+                          clock::time_point             displayed)
+{
+    auto elapsed = [](clock::time_point from, clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+
+    const auto unset = clock::time_point{};
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (timestamps.captured != unset && timestamps.mixed != unset)
+        period_[input].add(elapsed(timestamps.captured, timestamps.mixed));
+    if (timestamps.mixed != unset && timestamps.rendered != unset)
+        period_[mixer].add(elapsed(timestamps.mixed, timestamps.rendered));
+    if (timestamps.rendered != unset)
+        period_[consumer].add(elapsed(timestamps.rendered, scheduled));
+    period_[output].add(elapsed(scheduled, displayed));
+    if (timestamps.captured != unset)
+        period_[end_to_end].add(elapsed(timestamps.captured, displayed));
+
+    if (displayed - period_start_ < report_period)
+        return;
+
+    core::monitor::state state;
+    for (int n = 0; n < stage_count; ++n) {
+        auto& histogram = period_[n];
+        if (histogram.count() == 0)
+            continue;
+
+        // In milliseconds, the median, 95th and 99th percentiles and the longest
+        state[stage_names[n]] = {histogram.percentile(0.5),
+                                 histogram.percentile(0.95),
+                                 histogram.percentile(0.99),
+                                 histogram.max()};
+    }
+
+    state_        = std::move(state);
+    period_       = {};
+    period_start_ = displayed;
+}
+
+core::monitor::state latency_monitor::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+}} // namespace caspar::decklink
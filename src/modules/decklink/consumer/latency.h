@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace caspar { namespace decklink {
+
+// Milliseconds of latency in 1ms buckets, the last of which also counts anything longer
+class latency_histogram
+{
+    std::array<std::uint32_t, 1000> buckets_{};
+    std::uint32_t                   count_ = 0;
+    double                          max_   = 0.0;
+
+  public:
+    void add(double milliseconds);
+
+    // The latency that the given share of frames did not exceed, to the millisecond
+    [[nodiscard]] double percentile(double share) const;
+
+    [[nodiscard]] double        max() const { return max_; }
+    [[nodiscard]] std::uint32_t count() const { return count_; }
+};
+
+// Measures how long frames take through each stage from a live input to this output. The frames of a period of some
+// seconds are collected before they are published, so that a report covers a steady state rather than single frames.
+//
+// input:      captured by an input until the mixer started on them, i.e. input buffering and the stage
+// mixer:      mixed and read back from the GPU
+// consumer:   queued for this output and converted until scheduled on the device
+// output:     scheduled until shown, i.e. the device's own buffer
+// end-to-end: captured by an input until shown
+//
+// Stages that a frame has no timestamps for, e.g. input when nothing in it came from a live input, are left out.
+class latency_monitor
+{
+  public:
+    using clock = std::chrono::steady_clock;
+
+    void add(const core::frame_timestamps& timestamps, clock::time_point scheduled, clock::time_point displayed);
+
+    [[nodiscard]] core::monitor::state state() const;
+
+  private:
+    enum stage
+    {
+        input,
+        mixer,
+        consumer,
+        output,
+        end_to_end,
+        stage_count
+    };
+
+    mutable std::mutex                         mutex_;
+    std::array<latency_histogram, stage_count> period_;
+    clock::time_point                          period_start_ = clock::now();
+    core::monitor::state                       state_;
+};
+
+}} // namespace caspar::decklink
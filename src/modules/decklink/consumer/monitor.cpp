@@ -30,6 +30,7 @@ core::monitor::state get_state_for_port(const port_configuration&      port_conf
 
     state["index"]    = port_config.device_index;
     state["key-only"] = port_config.key_only;
+    state["scale"]    = port_config.scale;
 
     if (port_config.format.format == core::video_format::invalid) {
         state["video-mode"] = channel_format.name;
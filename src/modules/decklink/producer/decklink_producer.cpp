@@ -67,7 +67,13 @@ extern "C" {
 
 #include <boost/format.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
 #include <mutex>
+#include <optional>
 
 #include "../decklink_api.h"
 
@@ -88,7 +94,8 @@ struct Filter
            AVMediaType                          type,
            const core::video_format_desc&       format_desc,
            const com_ptr<IDeckLinkDisplayMode>& dm,
-           bool                                 hdr)
+           bool                                 hdr,
+           bool                                 gpu_deinterlace)
     {
         BMDTimeScale timeScale;
         BMDTimeValue frameDuration;
@@ -104,17 +111,23 @@ struct Filter
             bool doFps = bmdFramerate != (format_desc.framerate * format_desc.field_count);
             bool i2p   = (dm->GetFieldDominance() != bmdProgressiveFrame) && (1 == format_desc.field_count);
 
-            std::string deintStr = (doFps || i2p) ? ",bwdif=mode=send_field" : ",yadif=mode=send_field_nospatial";
-            switch (dm->GetFieldDominance()) {
-                case bmdUpperFieldFirst:
-                    filter_spec += deintStr + ":parity=tff:deint=all";
-                    break;
-                case bmdLowerFieldFirst:
-                    filter_spec += deintStr + ":parity=bff:deint=all";
-                    break;
-                case bmdUnknownFieldDominance:
-                    filter_spec += deintStr + ":parity=auto:deint=interlaced";
-                    break;
+            if (gpu_deinterlace && dm->GetFieldDominance() != bmdProgressiveFrame) {
+                // The mixer deinterlaces, with fps repeating every frame for each of its fields
+                doFps = true;
+            } else {
+                std::string deintStr =
+                    (doFps || i2p) ? ",bwdif=mode=send_field" : ",yadif=mode=send_field_nospatial";
+                switch (dm->GetFieldDominance()) {
+                    case bmdUpperFieldFirst:
+                        filter_spec += deintStr + ":parity=tff:deint=all";
+                        break;
+                    case bmdLowerFieldFirst:
+                        filter_spec += deintStr + ":parity=bff:deint=all";
+                        break;
+                    case bmdUnknownFieldDominance:
+                        filter_spec += deintStr + ":parity=auto:deint=interlaced";
+                        break;
+                }
             }
 
             if (doFps) {
@@ -291,6 +304,105 @@ struct Filter
     }
 };
 
+// Hands the driver buffers of the frame factory to capture into, so that video reaches the mixer without a copy.
+// Buffers outlive ReleaseBuffer for as long as frames still reference them, and only then go back to the device.
+class capture_allocator : public IDeckLinkMemoryAllocator
+{
+    std::atomic<int> ref_count_{0};
+
+    const FrameAllocator allocator_;
+
+    std::mutex                            mutex_;
+    std::map<void*, array<const uint8_t>> buffers_;
+
+  public:
+    explicit capture_allocator(FrameAllocator allocator)
+        : allocator_(std::move(allocator))
+    {
+    }
+
+    // The buffer that bytes were captured into, or an empty array if the driver allocated them itself
+    array<const uint8_t> find(void* bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = buffers_.find(bytes);
+        return it != buffers_.end() ? it->second : array<const uint8_t>{};
+    }
+
+    // IUnknown
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID* ppv) override
+    {
+        if (ppv == nullptr)
+            return E_INVALIDARG;
+
+        REFIID iunknown = IID_IUnknown;
+
+        if (std::memcmp(&iid, &iunknown, sizeof(REFIID)) == 0) {
+            *ppv = this;
+            AddRef();
+        } else if (std::memcmp(&iid, &IID_IDeckLinkMemoryAllocator, sizeof(REFIID)) == 0) {
+            *ppv = static_cast<IDeckLinkMemoryAllocator*>(this);
+            AddRef();
+        } else {
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        return S_OK;
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++ref_count_; }
+
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        if (--ref_count_ == 0) {
+            delete this;
+
+            return 0;
+        }
+
+        return ref_count_;
+    }
+
+    // IDeckLinkMemoryAllocator
+
+    HRESULT STDMETHODCALLTYPE AllocateBuffer(unsigned int bufferSize, void** allocatedBuffer) override
+    {
+        try {
+            core::pixel_format_desc desc(core::pixel_format::gray);
+            desc.planes.emplace_back(static_cast<int>(bufferSize), 1, 1);
+
+            auto buffer = array<const uint8_t>(
+                std::move(allocator_.frame_factory->create_frame(allocator_.tag, desc).image_data(0)));
+            *allocatedBuffer = const_cast<uint8_t*>(buffer.data());
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.emplace(*allocatedBuffer, std::move(buffer));
+            return S_OK;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE ReleaseBuffer(void* buffer) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers_.erase(buffer);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Commit() override { return S_OK; }
+
+    HRESULT STDMETHODCALLTYPE Decommit() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers_.clear();
+        return S_OK;
+    }
+};
+
 struct Decoder
 {
     Decoder(const Decoder&) = delete;
@@ -302,7 +414,7 @@ struct Decoder
 
     Decoder() = default;
 
-    explicit Decoder(bool hdr, const com_ptr<IDeckLinkDisplayMode>& mode)
+    explicit Decoder(bool hdr, const com_ptr<IDeckLinkDisplayMode>& mode, const FrameAllocator* allocator)
         : hdr_(hdr)
     {
         const auto codec = avcodec_find_decoder(AV_CODEC_ID_V210);
@@ -331,10 +443,19 @@ struct Decoder
 
         // int thread_count = env::properties().get(L"configuration.ffmpeg.producer.threads", 0);
         FF(av_opt_set_image_size(ctx.get(), "video_size", mode->GetWidth(), mode->GetHeight(), 0));
+
+        // 10 bit video is unpacked straight into the upload buffers of the mixer
+        if (allocator && allocator->frame_factory) {
+            ctx->opaque      = const_cast<FrameAllocator*>(allocator);
+            ctx->get_buffer2 = get_frame_buffer;
+        }
+
         FF(avcodec_open2(ctx.get(), codec, nullptr));
     }
 
-    std::shared_ptr<AVFrame> decode(IDeckLinkVideoInputFrame* video, const com_ptr<IDeckLinkDisplayMode>& mode)
+    std::shared_ptr<AVFrame> decode(IDeckLinkVideoInputFrame*            video,
+                                    const com_ptr<IDeckLinkDisplayMode>& mode,
+                                    core::color_space                    color_space)
     {
         void* video_bytes = nullptr;
         if (SUCCEEDED(video->GetBytes(&video_bytes)) && video_bytes) {
@@ -348,6 +469,19 @@ struct Decoder
                 FF_RET(AVERROR(ENOMEM), "av_frame_alloc");
 
             if (hdr_) {
+                // Decoded frames take their color space from the context, which make_frame must find again
+                switch (color_space) {
+                    case core::color_space::bt2020:
+                        ctx->colorspace = AVCOL_SPC_BT2020_NCL;
+                        break;
+                    case core::color_space::bt601:
+                        ctx->colorspace = AVCOL_SPC_SMPTE170M;
+                        break;
+                    default:
+                        ctx->colorspace = AVCOL_SPC_BT709;
+                        break;
+                }
+
                 const auto size = video->GetRowBytes() * video->GetHeight();
                 AVPacket   packet;
                 av_init_packet(&packet);
@@ -446,6 +580,96 @@ static com_ptr<IDeckLinkDisplayMode> get_display_mode(const com_iface_ptr<IDeckL
 
 BMDPixelFormat get_pixel_format2(bool hdr) { return hdr ? bmdFormat10BitYUV : bmdFormat8BitYUV; }
 
+// Inputs on the same reference that are played together, such as the cameras of a multiview, are taken from frames
+// captured at the same instant, by the hardware reference clock that the cards of a machine share. Each tick of the
+// channel takes the newest frame that every input of the group has, less the delay of the group, instead of each input
+// taking its oldest frame with a margin of its own. The delay, in frames, absorbs the jitter of their callbacks.
+class capture_group
+{
+    const std::wstring name_;
+    const int          delay_;
+
+    std::mutex                                         mutex_;
+    std::map<const void*, std::optional<std::int64_t>> newest_; // Of the frames buffered by each input
+    std::optional<std::int64_t>                        target_;
+    std::chrono::steady_clock::time_point              target_time_;
+
+  public:
+    capture_group(std::wstring name, int delay)
+        : name_(std::move(name))
+        , delay_(delay)
+    {
+    }
+
+    // Shared by the inputs played with the same name. The delay is that of the first of them.
+    static std::shared_ptr<capture_group> get(const std::wstring& name, int delay)
+    {
+        static std::mutex                                           mutex;
+        static std::map<std::wstring, std::weak_ptr<capture_group>> groups;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto key   = boost::to_upper_copy(name);
+        auto group = groups[key].lock();
+        if (!group) {
+            group       = std::make_shared<capture_group>(name, delay);
+            groups[key] = group;
+        }
+        return group;
+    }
+
+    int delay() const { return delay_; }
+
+    void join(const void* input)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        newest_[input];
+    }
+
+    void leave(const void* input)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        newest_.erase(input);
+    }
+
+    void buffered(const void* input, std::int64_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto&                       newest = newest_[input];
+        newest                             = newest ? std::max(*newest, index) : index;
+    }
+
+    // The index of the frames to take in the current tick, nothing until every input has buffered one. Inputs are
+    // received within a fraction of a frame of each other, so the target is kept for half a frame, and every input of
+    // a tick takes the same one even when frames arrive in between.
+    std::optional<std::int64_t> target(double hz)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto now = std::chrono::steady_clock::now();
+        if (target_ && now - target_time_ < std::chrono::duration<double>(0.5 / hz)) {
+            return target_;
+        }
+
+        std::optional<std::int64_t> newest;
+        for (auto& input : newest_) {
+            if (!input.second) {
+                return {};
+            }
+            newest = newest ? std::min(*newest, *input.second) : *input.second;
+        }
+        if (!newest) {
+            return {};
+        }
+
+        target_      = *newest - delay_;
+        target_time_ = now;
+        return target_;
+    }
+
+    const std::wstring& name() const { return name_; }
+};
+
 class decklink_producer : public IDeckLinkInputCallback
 {
     const int                           device_index_;
@@ -470,15 +694,38 @@ class decklink_producer : public IDeckLinkInputCallback
     double in_sync_  = 0.0;
     double out_sync_ = 0.0;
 
+    // When the recent input frames arrived, by stream time, so that frames out of the filters can be stamped with the
+    // capture time and the index on the hardware reference clock of the input they were made from
+    struct arrival
+    {
+        BMDTimeValue                          pts;
+        std::chrono::steady_clock::time_point time;
+        std::int64_t                          index; // Frames of the hardware reference clock, -1 when unknown
+    };
+    std::deque<arrival> arrivals_;
+
+    const std::shared_ptr<capture_group> group_;
+    std::atomic<bool>                    aligned_{true}; // Left the group for frames without a reference time
+
     bool freeze_on_lost_;
     bool has_signal_;
     bool hdr_;
+    bool gpu_deinterlace_;
+
+    FieldSplitter fields_;
 
     core::draw_frame last_frame_;
 
-    int                                                        buffer_capacity_ = 4;
-    std::deque<std::pair<core::draw_frame, core::video_field>> buffer_;
-    mutable std::mutex                                         buffer_mutex_;
+    struct buffered_frame
+    {
+        core::draw_frame  frame;
+        core::video_field field;
+        std::int64_t      index; // See arrival::index
+    };
+
+    int                        buffer_capacity_ = 4;
+    std::deque<buffered_frame> buffer_;
+    mutable std::mutex         buffer_mutex_;
 
     std::exception_ptr exception_;
 
@@ -492,6 +739,10 @@ class decklink_producer : public IDeckLinkInputCallback
     Filter video_filter_;
     Filter audio_filter_;
 
+    // Before the decoder, which refers to it
+    FrameAllocator             frame_allocator_;
+    com_ptr<capture_allocator> capture_allocator_;
+
     Decoder video_decoder_;
 
   public:
@@ -503,13 +754,17 @@ class decklink_producer : public IDeckLinkInputCallback
                       std::string                                 afilter,
                       const std::wstring&                         format,
                       bool                                        freeze_on_lost,
-                      bool                                        hdr)
+                      bool                                        hdr,
+                      bool                                        gpu_deinterlace,
+                      std::shared_ptr<capture_group>              group)
         : device_index_(device_index)
         , format_desc_(std::move(format_desc))
         , frame_factory_(frame_factory)
         , format_repository_(format_repository)
+        , group_(std::move(group))
         , freeze_on_lost_(freeze_on_lost)
         , hdr_(hdr)
+        , gpu_deinterlace_(gpu_deinterlace)
         , input_format(format_desc_)
         , vfilter_(std::move(vfilter))
         , afilter_(std::move(afilter))
@@ -520,12 +775,20 @@ class decklink_producer : public IDeckLinkInputCallback
         }
 
         mode_ = get_display_mode(input_, input_format.format, get_pixel_format2(hdr_), bmdSupportedVideoModeDefault);
-        video_filter_  = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_, hdr_);
-        audio_filter_  = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_, hdr_);
-        video_decoder_ = Decoder(hdr_, mode_);
+        video_filter_  = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_, hdr_, gpu_deinterlace_);
+        audio_filter_  = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_, hdr_, gpu_deinterlace_);
+        frame_allocator_.tag           = this;
+        frame_allocator_.frame_factory = frame_factory_;
+        video_decoder_                 = Decoder(hdr_, mode_, &frame_allocator_);
 
         boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
 
+        if (group_) {
+            // Enough for the delay of the group and a frame of jitter on either side, in fields when interlaced
+            buffer_capacity_ = std::max(buffer_capacity_, (group_->delay() + 3) * format_desc_.field_count);
+            group_->join(this);
+        }
+
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("frame-time", diagnostics::color(1.0f, 0.0f, 0.0f));
@@ -547,6 +810,12 @@ class decklink_producer : public IDeckLinkInputCallback
             flags = 0;
         }
 
+        capture_allocator_ = wrap_raw<com_ptr>(new capture_allocator(frame_allocator_));
+        if (FAILED(input_->SetVideoInputFrameMemoryAllocator(get_raw(capture_allocator_)))) {
+            CASPAR_LOG(warning) << print() << L" Unable to capture into mixer buffers, video will be copied.";
+            capture_allocator_ = nullptr;
+        }
+
         if (FAILED(input_->EnableVideoInput(mode_->GetDisplayMode(), get_pixel_format2(hdr_), flags))) {
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable video input.")
                                                       << boost::errinfo_api_function("EnableVideoInput"));
@@ -578,6 +847,9 @@ class decklink_producer : public IDeckLinkInputCallback
             input_->StopStreams();
             input_->DisableVideoInput();
         }
+        if (group_) {
+            group_->leave(this);
+        }
     }
 
     HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) override { return E_NOINTERFACE; }
@@ -605,8 +877,8 @@ class decklink_producer : public IDeckLinkInputCallback
 
             graph_->set_text(print());
 
-            video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_, hdr_);
-            audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_, hdr_);
+            video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_, hdr_, gpu_deinterlace_);
+            audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_, hdr_, gpu_deinterlace_);
 
             // reinitializing video input with the new display mode
             if (FAILED(
@@ -635,6 +907,7 @@ class decklink_producer : public IDeckLinkInputCallback
                                                      IDeckLinkAudioInputPacket* audio) override
     {
         caspar::timer frame_timer;
+        const auto    arrived = std::chrono::steady_clock::now();
 
         CASPAR_SCOPE_EXIT
         {
@@ -655,6 +928,10 @@ class decklink_producer : public IDeckLinkInputCallback
                 state_["profiler/time"]          = {frame_timer.elapsed(), format_desc_.fps};
                 state_["buffer"]                 = {static_cast<int>(buffer_size), buffer_capacity_};
                 state_["has_signal"]             = has_signal_;
+                if (group_) {
+                    state_["group/name"]  = group_->name();
+                    state_["group/delay"] = group_->delay();
+                }
 
                 if (video) {
                     state_["file/video/width"]  = static_cast<int>(video->GetWidth());
@@ -691,11 +968,34 @@ class decklink_producer : public IDeckLinkInputCallback
                 }
 
                 color_space = get_color_space(video);
-                auto src    = video_decoder_.decode(video, mode_);
+                auto src    = video_decoder_.decode(video, mode_, color_space);
+
+                // Captured into a buffer of the mixer, which the filters and make_frame then pass on by reference
+                if (src && !hdr_ && capture_allocator_) {
+                    void* bytes = nullptr;
+                    if (SUCCEEDED(video->GetBytes(&bytes))) {
+                        wrap_frame_buffer(frame_allocator_, src.get(), capture_allocator_->find(bytes), color_space);
+                    }
+                }
 
                 BMDTimeValue duration;
                 if (SUCCEEDED(video->GetStreamTime(&in_video_pts, &duration, AV_TIME_BASE))) {
                     src->pts = in_video_pts;
+
+                    // Stream times start with the streams of each card, the hardware reference clock is shared
+                    std::int64_t index = -1;
+                    BMDTimeValue reference_time;
+                    BMDTimeValue reference_duration;
+                    if (SUCCEEDED(video->GetHardwareReferenceTimestamp(
+                            AV_TIME_BASE, &reference_time, &reference_duration)) &&
+                        reference_duration > 0) {
+                        index = (reference_time + reference_duration / 2) / reference_duration;
+                    }
+
+                    arrivals_.push_back(arrival{in_video_pts, arrived, index});
+                    if (arrivals_.size() > 32) {
+                        arrivals_.pop_front();
+                    }
                 }
 
                 if (src) {
@@ -789,16 +1089,29 @@ class decklink_producer : public IDeckLinkInputCallback
                 graph_->set_value("in-sync", in_sync * 2.0 + 0.5);
                 graph_->set_value("out-sync", out_sync * 2.0 + 0.5);
 
-                auto frame = core::draw_frame(make_frame(this, *frame_factory_, av_video, av_audio, color_space));
+                core::const_frame decoded;
+                if (gpu_deinterlace_) {
+                    decoded = fields_(this, *frame_factory_, av_video, av_audio, color_space);
+                } else {
+                    decoded = core::const_frame(make_frame(this, *frame_factory_, av_video, av_audio, color_space));
+                }
+
+                auto input = arrival_of(av_rescale_q(av_video->pts, video_tb, AVRational{1, AV_TIME_BASE}));
+
+                core::frame_timestamps timestamps;
+                timestamps.captured = input ? input->time : arrived;
+
+                auto frame = core::draw_frame(decoded.with_timestamps(timestamps));
                 auto field = core::video_field::progressive;
                 if (format_desc_.field_count == 2) {
                     field = frame_count_ % 2 == 0 ? core::video_field::a : core::video_field::b;
                 }
 
+                auto index = input ? input->index : -1;
                 {
                     std::lock_guard<std::mutex> lock(buffer_mutex_);
 
-                    buffer_.emplace_back(std::make_pair(frame, field));
+                    buffer_.push_back(buffered_frame{frame, field, index});
                     frame_count_++;
 
                     if (buffer_.size() > buffer_capacity_) {
@@ -809,6 +1122,17 @@ class decklink_producer : public IDeckLinkInputCallback
                         graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
                     }
                 }
+                if (group_ && aligned_) {
+                    if (index >= 0) {
+                        group_->buffered(this, index);
+                    } else {
+                        // Rather than holding up the other inputs of the group
+                        CASPAR_LOG(warning) << print() << L" Has no hardware reference time, leaving capture group "
+                                            << group_->name() << L".";
+                        group_->leave(this);
+                        aligned_ = false;
+                    }
+                }
 
                 boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
             }
@@ -820,20 +1144,42 @@ class decklink_producer : public IDeckLinkInputCallback
         return S_OK;
     }
 
+    // The input frame with the given stream time, or that before it for frames the filters made in between
+    const arrival* arrival_of(BMDTimeValue pts) const
+    {
+        for (auto it = arrivals_.rbegin(); it != arrivals_.rend(); ++it) {
+            if (it->pts <= pts)
+                return &*it;
+        }
+        return nullptr;
+    }
+
     core::draw_frame get_frame(const core::video_field field, bool use_last_frame)
     {
         if (exception_ != nullptr) {
             std::rethrow_exception(exception_);
         }
 
+        // The frame captured at the instant the group takes this tick
+        auto grouped = group_ && aligned_;
+        auto target  = grouped ? group_->target(format_desc_.hz) : std::optional<std::int64_t>();
+
         core::draw_frame frame;
         bool             wrong_field = false;
         {
             std::lock_guard<std::mutex> lock(buffer_mutex_);
-            if (!buffer_.empty()) {
+            if (target) {
+                while (!buffer_.empty() && buffer_.front().index < *target) {
+                    buffer_.pop_front();
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                }
+            }
+            if (grouped && !target) {
+                // Until every input of the group has a frame
+            } else if (!buffer_.empty() && (!target || buffer_.front().index == *target)) {
                 auto& candidate = buffer_.front();
-                if (candidate.second == field || candidate.second == core::video_field::progressive) {
-                    frame = std::move(candidate.first);
+                if (candidate.field == field || candidate.field == core::video_field::progressive) {
+                    frame = std::move(candidate.frame);
                     buffer_.pop_front();
                 } else {
                     wrong_field = true;
@@ -892,7 +1238,9 @@ class decklink_producer_proxy : public core::frame_producer
                                      uint32_t                                    length,
                                      const std::wstring&                         format,
                                      bool                                        freeze_on_lost,
-                                     bool                                        hdr)
+                                     bool                                        hdr,
+                                     bool                                        gpu_deinterlace,
+                                     std::shared_ptr<capture_group>              group)
         : length_(length)
         , executor_(L"decklink_producer[" + std::to_wstring(device_index) + L"]")
     {
@@ -908,7 +1256,9 @@ class decklink_producer_proxy : public core::frame_producer
                                                   afilter,
                                                   format,
                                                   freeze_on_lost,
-                                                  hdr));
+                                                  hdr,
+                                                  gpu_deinterlace,
+                                                  group));
         });
     }
 
@@ -959,6 +1309,9 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 
     auto hdr = contains_param(L"10BIT", params);
 
+    // Interlaced inputs are deinterlaced by the mixer rather than by yadif or bwdif
+    auto gpu_deinterlace = contains_param(L"GPU_DEINTERLACE", params);
+
     auto format_str = get_param(L"FORMAT", params);
 
     auto filter_str = get_param(L"FILTER", params);
@@ -971,6 +1324,13 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto vfilter = boost::to_lower_copy(get_param(L"VF", params, filter_str));
     auto afilter = boost::to_lower_copy(get_param(L"AF", params, get_param(L"FILTER", params, L"")));
 
+    // Inputs on the same reference played with the same GROUP are aligned to frames captured at the same instant
+    std::shared_ptr<capture_group> group;
+    auto                           group_name = get_param(L"GROUP", params);
+    if (!group_name.empty()) {
+        group = capture_group::get(group_name, std::max(0, get_param(L"GROUP_DELAY", params, 1)));
+    }
+
     return spl::make_shared<decklink_producer_proxy>(dependencies.format_desc,
                                                      dependencies.frame_factory,
                                                      dependencies.format_repository,
@@ -980,6 +1340,8 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
                                                      length,
                                                      format_str,
                                                      freeze_on_lost,
-                                                     hdr);
+                                                     hdr,
+                                                     gpu_deinterlace,
+                                                     group);
 }
 }} // namespace caspar::decklink
@@ -30,8 +30,12 @@
 #include <common/executor.h>
 #include <common/future.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 #include <common/scope_exit.h>
+#include <common/task_arena.h>
 #include <common/timer.h>
+#include <common/utf.h>
+#include <common/yuv.h>
 
 #include <core/consumer/channel_info.h>
 #include <core/frame/frame.h>
@@ -61,44 +65,171 @@ extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
-#include <libswscale/swscale.h>
 }
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
 #include <tbb/concurrent_queue.h>
-#include <tbb/parallel_for.h>
-#include <tbb/parallel_invoke.h>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <fcntl.h>
+
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <sstream>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace ffmpeg {
 
 // TODO multiple output streams
 // TODO multiple output files
-// TODO run video filter, video encoder, audio filter, audio encoder in separate threads.
 // TODO realtime with smaller buffer?
 
+// A step of the encoding that runs on a thread of its own, taking its input from a bounded queue, so that the steps of
+// consecutive frames run at once. Items are handled in order, and the first null one is the last.
+template <typename T>
+class Stage
+{
+    tbb::concurrent_bounded_queue<T> queue_;
+    std::thread                      thread_;
+
+  public:
+    Stage(std::string                             name,
+          size_t                                  capacity,
+          spl::shared_ptr<diagnostics::graph>     graph,
+          double                                  fps,
+          std::function<void(T)>                  fn,
+          std::function<void(std::exception_ptr)> on_error)
+    {
+        queue_.set_capacity(capacity);
+
+        thread_ = std::thread([=] {
+            try {
+                set_thread_name(L"[ffmpeg::consumer::" + u16(name) + L"]");
+
+                while (true) {
+                    T item;
+                    queue_.pop(item);
+                    const auto last = !item;
+
+                    caspar::timer timer;
+                    fn(std::move(item));
+                    graph->set_value(name + "-time", timer.elapsed() * fps * 0.5);
+
+                    if (last) {
+                        break;
+                    }
+                }
+            } catch (...) {
+                on_error(std::current_exception());
+            }
+        });
+    }
+
+    ~Stage()
+    {
+        queue_.abort();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    Stage(const Stage&)            = delete;
+    Stage& operator=(const Stage&) = delete;
+
+    void push(T item) { queue_.push(std::move(item)); }
+
+    // Stops taking items, which makes those waiting to push throw tbb::user_abort
+    void abort() { queue_.abort(); }
+
+    // Waits for the last item to be handled
+    void join()
+    {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+};
+
+// The file of segment number of path, which takes it where a printf style %d is, or else before its extension
+std::string segment_path(const std::string& path, int number)
+{
+    char buf[4096];
+    if (av_get_frame_filename2(buf, sizeof(buf), path.c_str(), number, 0) >= 0) {
+        return buf;
+    }
+    const auto file = boost::filesystem::path(path);
+    const auto name = boost::format("%s-%05d%s") % file.stem().string() % number % file.extension().string();
+    return (file.parent_path() / name.str()).string();
+}
+
+// Has the system write what it holds of file to the disk
+void sync_file(const boost::filesystem::path& file)
+{
+#ifdef _WIN32
+    const auto fd = _wopen(file.wstring().c_str(), _O_RDWR | _O_BINARY);
+    if (fd >= 0) {
+        _commit(fd);
+        _close(fd);
+    }
+#else
+    const auto fd = ::open(file.string().c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#endif
+}
+
+// The software encoder to fall back to when the hardware one, e.g. h264_nvenc, can not be opened. Nothing for
+// software encoders.
+const AVCodec* software_encoder(const AVCodec* codec)
+{
+    if (!(codec->capabilities & AV_CODEC_CAP_HARDWARE)) {
+        return nullptr;
+    }
+
+    void* it = nullptr;
+    while (auto fallback = av_codec_iterate(&it)) {
+        if (av_codec_is_encoder(fallback) && fallback->id == codec->id &&
+            !(fallback->capabilities & (AV_CODEC_CAP_HARDWARE | AV_CODEC_CAP_EXPERIMENTAL))) {
+            return fallback;
+        }
+    }
+    return nullptr;
+}
+
 struct Stream
 {
     std::shared_ptr<AVFilterGraph> graph  = nullptr;
     AVFilterContext*               sink   = nullptr;
     AVFilterContext*               source = nullptr;
 
-    std::shared_ptr<AVCodecContext> enc = nullptr;
-    AVStream*                       st  = nullptr;
+    std::shared_ptr<AVCodecContext> enc       = nullptr;
+    std::shared_ptr<AVBufferRef>    hw_frames = nullptr; // Video is uploaded to these for encoders that need it
 
-    tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
+    AVPixelFormat source_format = AV_PIX_FMT_NONE; // What convert puts out
 
     int64_t pts = 0;
 
-    Stream(AVFormatContext*                    oc,
+    // Video is forced to a keyframe as each key_interval begins, in AV_TIME_BASE units, so that segments start on one
+    int64_t key_interval = 0;
+    int64_t next_key     = 0;
+
+    Stream(bool                                global_header,
            std::string                         suffix,
            AVCodecID                           codec_id,
            const core::video_format_desc&      format_desc,
@@ -142,6 +273,46 @@ struct Stream
             FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
         }
 
+        try {
+            open(global_header, suffix, codec, filter_spec, format_desc, realtime, depth, stream_options, options);
+        } catch (...) {
+            const auto fallback = software_encoder(codec);
+            if (!fallback) {
+                throw;
+            }
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << "[ffmpeg_consumer] Failed to open " << codec->name << ", encoding with "
+                                << fallback->name << " instead.";
+
+            // Presets and tunings are named differently by each encoder
+            stream_options.erase("preset");
+            stream_options.erase("tune");
+            open(global_header, suffix, fallback, filter_spec, format_desc, realtime, depth, stream_options, options);
+        }
+    }
+
+    void open(bool                                global_header,
+              const std::string&                  suffix,
+              const AVCodec*                      codec,
+              std::string                         filter_spec,
+              const core::video_format_desc&      format_desc,
+              bool                                realtime,
+              common::bit_depth                   depth,
+              std::map<std::string, std::string>  stream_options,
+              std::map<std::string, std::string>& options)
+    {
+        graph     = nullptr;
+        sink      = nullptr;
+        source    = nullptr;
+        enc       = nullptr;
+        hw_frames = nullptr;
+
+        // Software H.264 is too slow for realtime at its default preset
+        if (codec->id == AV_CODEC_ID_H264 && !(codec->capabilities & AV_CODEC_CAP_HARDWARE) &&
+            stream_options.find("preset") == stream_options.end()) {
+            stream_options["preset"] = "veryfast";
+        }
+
         AVFilterInOut* outputs = nullptr;
         AVFilterInOut* inputs  = nullptr;
 
@@ -158,7 +329,33 @@ struct Stream
             FF_RET(AVERROR(ENOMEM), "avfilter_graph_alloc");
         }
 
+        std::vector<AVPixelFormat> pix_fmts;
+        bool                       upload = false;
+
         if (codec->type == AVMEDIA_TYPE_VIDEO) {
+            for (auto fmt = codec->pix_fmts; fmt && *fmt != AV_PIX_FMT_NONE; ++fmt) {
+                if (!(av_pix_fmt_desc_get(*fmt)->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+                    pix_fmts.push_back(*fmt);
+                }
+            }
+
+            // Encoders that only take frames on the device, e.g. vaapi and qsv, are fed NV12 or P010 uploads. Those
+            // that also take frames in memory, e.g. nvenc, upload them themselves.
+            if (codec->pix_fmts && pix_fmts.empty()) {
+                upload = true;
+                pix_fmts.push_back(depth == common::bit_depth::bit8 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_P010);
+            }
+            pix_fmts.push_back(AV_PIX_FMT_NONE);
+
+            // Without filters, frames are converted straight to the format the graph would have picked for the encoder
+            source_format = depth == common::bit_depth::bit8 ? AV_PIX_FMT_YUVA422P : AV_PIX_FMT_YUVA422P10;
+            if (filter_spec.empty() && codec->pix_fmts) {
+                const auto best = avcodec_find_best_pix_fmt_of_list(pix_fmts.data(), source_format, 1, nullptr);
+                if (to_yuv_format(best)) {
+                    source_format = best;
+                }
+            }
+
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
@@ -182,10 +379,8 @@ struct Stream
                 const auto sar = boost::rational<int>(format_desc.square_width, format_desc.square_height) /
                                  boost::rational<int>(format_desc.width, format_desc.height);
 
-                const auto pix_fmt = (depth == common::bit_depth::bit8) ? AV_PIX_FMT_YUVA422P : AV_PIX_FMT_YUVA422P10;
-
                 auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:sar=%d/%d:frame_rate=%d/%d") %
-                             format_desc.width % format_desc.height % pix_fmt % format_desc.duration %
+                             format_desc.width % format_desc.height % source_format % format_desc.duration %
                              (format_desc.time_scale * format_desc.field_count) % sar.numerator() % sar.denominator() %
                              (format_desc.framerate.numerator() * format_desc.field_count) %
                              format_desc.framerate.denominator())
@@ -222,7 +417,8 @@ struct Stream
             // TODO codec->profiles
             // TODO FF(av_opt_set_int_list(sink, "framerates", codec->supported_framerates, { 0, 0 },
             // AV_OPT_SEARCH_CHILDREN));
-            FF(av_opt_set_int_list(sink, "pix_fmts", codec->pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+            FF(av_opt_set_int_list(
+                sink, "pix_fmts", codec->pix_fmts ? pix_fmts.data() : nullptr, -1, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -270,11 +466,6 @@ struct Stream
 
         FF(avfilter_graph_config(graph.get(), nullptr));
 
-        st = avformat_new_stream(oc, nullptr);
-        if (!st) {
-            FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
-        }
-
         enc = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
 
@@ -283,23 +474,20 @@ struct Stream
         }
 
         if (codec->type == AVMEDIA_TYPE_VIDEO) {
-            st->time_base = av_inv_q(av_buffersink_get_frame_rate(sink));
-
-            // Ensure the frame_rate is set in a way that rtmp will find it
-            st->avg_frame_rate = av_buffersink_get_frame_rate(sink);
-
             enc->width               = av_buffersink_get_w(sink);
             enc->height              = av_buffersink_get_h(sink);
             enc->framerate           = av_buffersink_get_frame_rate(sink);
             enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink);
-            enc->time_base           = st->time_base;
+            enc->time_base           = av_inv_q(av_buffersink_get_frame_rate(sink));
             enc->pix_fmt             = static_cast<AVPixelFormat>(av_buffersink_get_format(sink));
-        } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
-            st->time_base = {1, av_buffersink_get_sample_rate(sink)};
 
+            if (upload) {
+                open_hw_frames(codec);
+            }
+        } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
             enc->sample_fmt  = static_cast<AVSampleFormat>(av_buffersink_get_format(sink));
             enc->sample_rate = av_buffersink_get_sample_rate(sink);
-            enc->time_base   = st->time_base;
+            enc->time_base   = {1, av_buffersink_get_sample_rate(sink)};
 
 #if FFMPEG_NEW_CHANNEL_LAYOUT
             FF(av_buffersink_get_ch_layout(sink, &enc->ch_layout));
@@ -322,7 +510,7 @@ struct Stream
             enc->thread_type = FF_THREAD_SLICE;
         }
 
-        if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+        if (global_header) {
             enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
         }
 
@@ -333,136 +521,468 @@ struct Stream
             options[p.first] = p.second + suffix;
         }
 
-        FF(avcodec_parameters_from_context(st->codecpar, enc.get()));
-
         if (codec->type == AVMEDIA_TYPE_AUDIO && !(codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE)) {
             av_buffersink_set_frame_size(sink, enc->frame_size);
         }
     }
 
-    std::shared_ptr<SwsContext> get_sws(int width, int height)
+    // Has enc take frames of the device of codec, in the format the filter graph puts out
+    void open_hw_frames(const AVCodec* codec)
+    {
+        const AVCodecHWConfig* config = nullptr;
+        for (int n = 0; (config = avcodec_get_hw_config(codec, n)); ++n) {
+            if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_FRAMES_CTX) {
+                break;
+            }
+        }
+        if (!config) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                    << msg_info_t("encoder takes no hardware frames"));
+        }
+
+        const auto device = get_hw_device(config->device_type);
+        if (!device) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(ENODEV)
+                                                    << msg_info_t("failed to open hardware device"));
+        }
+
+        hw_frames = std::shared_ptr<AVBufferRef>(av_hwframe_ctx_alloc(device.get()),
+                                                 [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+        if (!hw_frames) {
+            FF_RET(AVERROR(ENOMEM), "av_hwframe_ctx_alloc");
+        }
+
+        auto frames       = reinterpret_cast<AVHWFramesContext*>(hw_frames->data);
+        frames->format    = config->pix_fmt;
+        frames->sw_format = enc->pix_fmt;
+        frames->width     = enc->width;
+        frames->height    = enc->height;
+
+        // Some devices, e.g. qsv, can not grow their pools. Enough for the frames the encoder holds on to.
+        frames->initial_pool_size = 20;
+
+        FF(av_hwframe_ctx_init(hw_frames.get()));
+
+        enc->hw_frames_ctx = av_buffer_ref(hw_frames.get());
+        enc->pix_fmt       = config->pix_fmt;
+    }
+
+    // The frame of the channel as the filter graph takes it, or null for the empty frame that ends the stream
+    std::shared_ptr<AVFrame> convert(const core::const_frame& in_frame, const core::video_format_desc& format_desc)
     {
-        std::shared_ptr<SwsContext> sws;
+        std::shared_ptr<AVFrame> frame;
 
-        if (sws_.try_pop(sws)) {
-            return sws;
+        if (!in_frame) {
+            return frame;
         }
 
-        sws.reset(sws_getContext(
-                      width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUVA422P, 0, nullptr, nullptr, nullptr),
-                  [](SwsContext* ptr) { sws_freeContext(ptr); });
+        if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+            const auto src = make_av_video_frame(in_frame, format_desc);
+            if (src->format != AV_PIX_FMT_BGRA && src->format != AV_PIX_FMT_BGRA64) {
+                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                        << msg_info_t("unsupported channel pixel format"));
+            }
 
-        if (!sws) {
-            CASPAR_THROW_EXCEPTION(caspar_exception());
+            frame                      = alloc_frame();
+            frame->sample_aspect_ratio = src->sample_aspect_ratio;
+            frame->width               = src->width;
+            frame->height              = src->height;
+            frame->format              = source_format;
+            frame->colorspace          = AVCOL_SPC_BT709;
+            frame->color_primaries     = AVCOL_PRI_BT709;
+            frame->color_range         = AVCOL_RANGE_MPEG;
+            frame->color_trc           = AVCOL_TRC_BT709;
+            FF(av_frame_get_buffer(frame.get(), 64));
+
+            run_in_arena(task_kind::realtime, [&] {
+                bgra_to_yuv(src->data[0],
+                            src->linesize[0],
+                            src->format == AV_PIX_FMT_BGRA64 ? common::bit_depth::bit16 : common::bit_depth::bit8,
+                            src->width,
+                            src->height,
+                            *to_yuv_format(source_format),
+                            frame->data,
+                            frame->linesize);
+            });
+
+            frame->pts = pts;
+            pts += 1;
+        } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
+            frame      = make_av_audio_frame(in_frame, format_desc);
+            frame->pts = pts;
+            pts += frame->nb_samples;
+        } else {
+            // TODO
         }
 
-        int        brigthness;
-        int        contrast;
-        int        saturation;
-        int        in_full;
-        int        out_full;
-        const int* inv_table;
-        const int* table;
+        return frame;
+    }
 
-        sws_getColorspaceDetails(
-            sws.get(), (int**)&inv_table, &in_full, (int**)&table, &out_full, &brigthness, &contrast, &saturation);
+    // Hands frame to the filter graph and the frames it puts out on to cb. A null frame closes the graph, which is
+    // then drained.
+    void filter(const std::shared_ptr<AVFrame>& frame, const std::function<void(std::shared_ptr<AVFrame>)>& cb)
+    {
+        if (frame) {
+            FF(av_buffersrc_write_frame(source, frame.get()));
+        } else {
+            FF(av_buffersrc_close(source, pts, 0));
+        }
 
-        inv_table = sws_getCoefficients(AVCOL_SPC_RGB);
-        table     = sws_getCoefficients(AVCOL_SPC_BT709);
+        while (true) {
+            auto frame2 = alloc_frame();
+            auto ret    = av_buffersink_get_frame(sink, frame2.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return;
+            }
+            FF_RET(ret, "av_buffersink_get_frame");
+            cb(std::move(frame2));
+        }
+    }
+
+    // Encodes frame and hands the packets on to cb, in the time base of enc. A null frame drains the encoder.
+    void encode(std::shared_ptr<AVFrame> frame, const std::function<void(std::shared_ptr<AVPacket>)>& cb)
+    {
+        if (frame && key_interval > 0 && frame->pts != AV_NOPTS_VALUE) {
+            const auto time = av_rescale_q(frame->pts, av_buffersink_get_time_base(sink), AVRational{1, AV_TIME_BASE});
+            if (time >= next_key) {
+                frame->pict_type = AV_PICTURE_TYPE_I;
+                next_key         = (time / key_interval + 1) * key_interval;
+            }
+        }
 
-        in_full  = AVCOL_RANGE_JPEG;
-        out_full = AVCOL_RANGE_MPEG;
+        if (frame && hw_frames) {
+            auto frame2 = alloc_frame();
+            FF(av_hwframe_get_buffer(hw_frames.get(), frame2.get(), 0));
+            FF(av_hwframe_transfer_data(frame2.get(), frame.get(), 0));
+            FF(av_frame_copy_props(frame2.get(), frame.get()));
+            frame = std::move(frame2);
+        }
 
-        sws_setColorspaceDetails(sws.get(), inv_table, in_full, table, out_full, brigthness, contrast, saturation);
+        FF(avcodec_send_frame(enc.get(), frame.get()));
 
-        return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
+        while (true) {
+            auto pkt = alloc_packet();
+            auto ret = avcodec_receive_packet(enc.get(), pkt.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return;
+            }
+            FF_RET(ret, "avcodec_receive_packet");
+            cb(std::move(pkt));
+        }
     }
+};
 
-    void send(core::const_frame&                             in_frame,
-              const core::video_format_desc&                 format_desc,
-              std::function<void(std::shared_ptr<AVPacket>)> cb)
+// The encoders of a channel, shared by the ffmpeg consumers that would encode it alike, e.g. to a file and a stream.
+// Frames are taken from the first of the outputs, and the packets handed to each of them to mux, tee style.
+class EncodeSession
+{
+  public:
+    // Where the packets of the session go, with stream_index 0 for video and 1 for audio. A null packet ends them.
+    struct Output
     {
-        std::shared_ptr<AVFrame>  frame;
-        std::shared_ptr<AVPacket> pkt;
+        tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packets;
+        bool                                                     joined = false; // Added once encoding had begun
+    };
 
-        if (in_frame) {
-            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-                frame = make_av_video_frame(in_frame, format_desc);
-
-                {
-                    auto frame2                 = alloc_frame();
-                    frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
-                    frame2->width               = frame->width;
-                    frame2->height              = frame->height;
-                    frame2->format              = AV_PIX_FMT_YUVA422P;
-                    frame2->colorspace          = AVCOL_SPC_BT709;
-                    frame2->color_primaries     = AVCOL_PRI_BT709;
-                    frame2->color_range         = AVCOL_RANGE_MPEG;
-                    frame2->color_trc           = AVCOL_TRC_BT709;
-                    av_frame_get_buffer(frame2.get(), 64);
-
-                    int h = frame->height / 8;
-                    tbb::parallel_for(0, 8, [&](int i) {
-                        auto sws = get_sws(frame->width, h);
-
-                        uint8_t* src[4] = {};
-                        src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
-
-                        uint8_t* dst[4] = {};
-                        dst[0]          = frame2->data[0] + frame2->linesize[0] * (i * h);
-                        dst[1]          = frame2->data[1] + frame2->linesize[1] * (i * h);
-                        dst[2]          = frame2->data[2] + frame2->linesize[2] * (i * h);
-                        dst[3]          = frame2->data[3] + frame2->linesize[3] * (i * h);
-
-                        sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
-                    });
-
-                    int i = frame->height - h;
-                    if (i > 0) {
-                        // TODO
-                    }
+    std::optional<Stream> video;
+    std::optional<Stream> audio;
 
-                    frame = std::move(frame2);
-                }
+    // The stream options none of the encoders took
+    std::map<std::string, std::string> unused;
+
+  private:
+    const core::video_format_desc       format_desc_;
+    const bool                          realtime_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+
+    std::mutex                           mutex_;
+    std::vector<std::shared_ptr<Output>> outputs_;
+    bool                                 closed_  = false;
+    bool                                 started_ = false;
+    std::exception_ptr                   exception_;
+
+    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    std::thread                                      frame_thread_;
+
+  public:
+    // The session of key, with output added to it. Created by create when there is none, or it is closing.
+    static std::shared_ptr<EncodeSession> attach(const std::string&                                     key,
+                                                 const std::shared_ptr<Output>&                         output,
+                                                 const std::function<std::shared_ptr<EncodeSession>()>& create)
+    {
+        static std::mutex                                          mutex;
+        static std::map<std::string, std::weak_ptr<EncodeSession>> sessions;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Drop the entries of sessions that have ended
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            it = it->second.expired() ? sessions.erase(it) : std::next(it);
+        }
+
+        auto session = sessions[key].lock();
+        if (!session || !session->add(output)) {
+            session = create();
+            session->add(output);
+            sessions[key] = session;
+        }
+        return session;
+    }
+
+    EncodeSession(const core::video_format_desc&      format_desc,
+                  bool                                realtime,
+                  common::bit_depth                   depth,
+                  bool                                global_header,
+                  AVCodecID                           video_codec,
+                  AVCodecID                           audio_codec,
+                  std::map<std::string, std::string>  options,
+                  int64_t                             key_interval,
+                  spl::shared_ptr<diagnostics::graph> graph)
+        : format_desc_(format_desc)
+        , realtime_(realtime)
+        , graph_(std::move(graph))
+    {
+        if (video_codec != AV_CODEC_ID_NONE) {
+            video.emplace(global_header, ":v", video_codec, format_desc, realtime, depth, options);
+            video->key_interval = key_interval;
+        }
+        if (audio_codec != AV_CODEC_ID_NONE) {
+            audio.emplace(global_header, ":a", audio_codec, format_desc, realtime, depth, options);
+        }
+        unused = std::move(options);
+
+        frame_buffer_.set_capacity(realtime_ ? 1 : 64);
+        frame_thread_ = std::thread([this] { run(); });
+    }
+
+    ~EncodeSession()
+    {
+        frame_buffer_.abort();
+        if (frame_thread_.joinable()) {
+            frame_thread_.join();
+        }
+    }
+
+    EncodeSession(const EncodeSession&)            = delete;
+    EncodeSession& operator=(const EncodeSession&) = delete;
+
+    // Takes frame when it comes from the first output, as the others are sent the same frames. Unless wait is set, the
+    // frame is dropped if the encoders are behind.
+    void send(const std::shared_ptr<Output>& output, const core::const_frame& frame, bool wait)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (exception_) {
+                std::rethrow_exception(exception_);
+            }
+            if (closed_ || outputs_.empty() || outputs_.front() != output) {
+                return;
+            }
+        }
+
+        if (wait) {
+            frame_buffer_.push(frame);
+        } else if (!frame_buffer_.try_push(frame)) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+        graph_->set_value("input", static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
+    }
 
-                frame->pts = pts;
-                pts += 1;
-            } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
-                frame      = make_av_audio_frame(in_frame, format_desc);
-                frame->pts = pts;
-                pts += frame->nb_samples;
+    // Stops handing output packets, and ends them. The encoders are drained into the last output first, so that it gets
+    // all of the frames it was sent.
+    void remove(const std::shared_ptr<Output>& output)
+    {
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last = outputs_.size() == 1 && outputs_.front() == output;
+            if (last) {
+                closed_ = true;
             } else {
-                // TODO
+                outputs_.erase(std::remove(outputs_.begin(), outputs_.end(), output), outputs_.end());
             }
-            FF(av_buffersrc_write_frame(source, frame.get()));
-        } else {
-            FF(av_buffersrc_close(source, pts, 0));
         }
 
-        while (true) {
-            pkt     = alloc_packet();
-            int ret = avcodec_receive_packet(enc.get(), pkt.get());
-
-            if (ret == AVERROR(EAGAIN)) {
-                frame = alloc_frame();
-                ret   = av_buffersink_get_frame(sink, frame.get());
-                if (ret == AVERROR(EAGAIN)) {
-                    return;
+        if (last) {
+            try {
+                frame_buffer_.push(core::const_frame{});
+            } catch (tbb::user_abort&) {
+                // The frame thread has failed
+            }
+            if (frame_thread_.joinable()) {
+                frame_thread_.join();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            outputs_.clear();
+        }
+
+        try {
+            output->packets.push(nullptr);
+        } catch (tbb::user_abort&) {
+            // The output has failed
+        }
+    }
+
+  private:
+    // Fails when the session is closing
+    bool add(const std::shared_ptr<Output>& output)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return false;
+        }
+        output->joined = started_;
+        outputs_.push_back(output);
+        return true;
+    }
+
+    void set_exception(std::exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!exception_) {
+            exception_ = e;
+        }
+    }
+
+    void push(int index, std::shared_ptr<AVPacket> pkt)
+    {
+        pkt->stream_index = index;
+
+        std::vector<std::shared_ptr<Output>> outputs;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            started_ = true;
+            outputs  = outputs_;
+        }
+
+        // Each output waits on the others while its buffer is full, as a tee does
+        for (auto& output : outputs) {
+            try {
+                output->packets.push(pkt);
+            } catch (tbb::user_abort&) {
+                // The output has failed or gone
+            }
+        }
+    }
+
+    void run()
+    {
+        try {
+            // Sends after the thread has ended would otherwise wait forever
+            CASPAR_SCOPE_EXIT { frame_buffer_.abort(); };
+
+            // Video is converted, filtered and encoded on threads of its own, and audio on another. A failing
+            // stage stops the others, so that none of them waits on it forever.
+            using FrameStage   = Stage<std::shared_ptr<AVFrame>>;
+            using ChannelStage = Stage<core::const_frame>;
+
+            const auto                    capacity = realtime_ ? 1 : 4;
+            std::unique_ptr<FrameStage>   video_encode;
+            std::unique_ptr<FrameStage>   video_filter;
+            std::unique_ptr<ChannelStage> video_convert;
+            std::unique_ptr<ChannelStage> audio_encode;
+
+            auto for_each_stage = [&](auto fn) {
+                for (auto stage : {video_convert.get(), audio_encode.get()}) {
+                    if (stage) {
+                        fn(*stage);
+                    }
                 }
-                if (ret == AVERROR_EOF) {
-                    FF(avcodec_send_frame(enc.get(), nullptr));
-                } else {
-                    FF_RET(ret, "av_buffersink_get_frame");
-                    FF(avcodec_send_frame(enc.get(), frame.get()));
+                for (auto stage : {video_filter.get(), video_encode.get()}) {
+                    if (stage) {
+                        fn(*stage);
+                    }
                 }
-            } else if (ret == AVERROR_EOF) {
-                return;
-            } else {
-                FF_RET(ret, "avcodec_receive_packet");
-                pkt->stream_index = st->index;
-                av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
-                cb(std::move(pkt));
+            };
+
+            // Stages waiting on an aborted one fail in turn, so only the first error is kept
+            auto on_error = [&](std::exception_ptr e) {
+                set_exception(e);
+                for_each_stage([](auto& stage) { stage.abort(); });
+            };
+
+            if (video) {
+                video_encode = std::make_unique<FrameStage>(
+                    "video-encode",
+                    capacity,
+                    graph_,
+                    format_desc_.fps,
+                    [&](std::shared_ptr<AVFrame> frame) {
+                        video->encode(frame, [&](std::shared_ptr<AVPacket> pkt) { push(0, std::move(pkt)); });
+                    },
+                    on_error);
+                video_filter = std::make_unique<FrameStage>(
+                    "video-filter",
+                    capacity,
+                    graph_,
+                    format_desc_.fps,
+                    [&](std::shared_ptr<AVFrame> frame) {
+                        const auto last = !frame;
+                        video->filter(frame,
+                                      [&](std::shared_ptr<AVFrame> frame2) { video_encode->push(std::move(frame2)); });
+                        if (last) {
+                            video_encode->push(nullptr);
+                        }
+                    },
+                    on_error);
+                video_convert = std::make_unique<ChannelStage>(
+                    "video-convert",
+                    capacity,
+                    graph_,
+                    format_desc_.fps,
+                    [&](core::const_frame frame) { video_filter->push(video->convert(frame, format_desc_)); },
+                    on_error);
             }
+            if (audio) {
+                audio_encode = std::make_unique<ChannelStage>(
+                    "audio",
+                    capacity,
+                    graph_,
+                    format_desc_.fps,
+                    [&](core::const_frame frame) {
+                        auto packet_cb = [&](std::shared_ptr<AVPacket> pkt) { push(1, std::move(pkt)); };
+                        auto frame2    = audio->convert(frame, format_desc_);
+                        audio->filter(frame2,
+                                      [&](std::shared_ptr<AVFrame> frame3) { audio->encode(frame3, packet_cb); });
+                        if (!frame2) {
+                            audio->encode(nullptr, packet_cb);
+                        }
+                    },
+                    on_error);
+            }
+
+            // No stage is destroyed while another may still hand it an item
+            CASPAR_SCOPE_EXIT
+            {
+                for_each_stage([](auto& stage) { stage.abort(); });
+                for_each_stage([](auto& stage) { stage.join(); });
+            };
+
+            while (true) {
+                core::const_frame frame;
+                frame_buffer_.pop(frame);
+                graph_->set_value("input",
+                                  static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
+
+                // The time the stages take to accept the frame, which is the time of the slowest when they are full
+                caspar::timer frame_timer;
+                if (video_convert) {
+                    video_convert->push(frame);
+                }
+                if (audio_encode) {
+                    audio_encode->push(frame);
+                }
+                graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+
+                if (!frame) {
+                    break;
+                }
+            }
+
+            for_each_stage([](auto& stage) { stage.join(); });
+        } catch (...) {
+            set_exception(std::current_exception());
         }
     }
 };
@@ -474,6 +994,7 @@ struct ffmpeg_consumer : public core::frame_consumer
     int                     channel_index_ = -1;
     core::video_format_desc format_desc_;
     bool                    realtime_ = false;
+    bool                    offline_  = false;
 
     spl::shared_ptr<diagnostics::graph> graph_;
 
@@ -483,8 +1004,9 @@ struct ffmpeg_consumer : public core::frame_consumer
     std::exception_ptr exception_;
     std::mutex         exception_mutex_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
-    std::thread                                      frame_thread_;
+    std::shared_ptr<EncodeSession>         session_;
+    std::shared_ptr<EncodeSession::Output> output_;
+    std::thread                            packet_thread_;
 
     common::bit_depth depth_;
 
@@ -502,19 +1024,24 @@ struct ffmpeg_consumer : public core::frame_consumer
     {
         state_["file/path"] = u8(path_);
 
-        frame_buffer_.set_capacity(realtime_ ? 1 : 64);
-
         diagnostics::register_graph(graph_);
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+        graph_->set_color("output", diagnostics::color(0.4f, 0.4f, 0.7f));
+        graph_->set_color("video-convert-time", diagnostics::color(0.9f, 0.6f, 0.1f));
+        graph_->set_color("video-filter-time", diagnostics::color(0.6f, 0.9f, 0.9f));
+        graph_->set_color("video-encode-time", diagnostics::color(0.1f, 0.6f, 1.0f));
+        graph_->set_color("audio-time", diagnostics::color(0.9f, 0.4f, 0.9f));
     }
 
     ~ffmpeg_consumer()
     {
-        if (frame_thread_.joinable()) {
-            frame_buffer_.push(core::const_frame{});
-            frame_thread_.join();
+        if (session_) {
+            session_->remove(output_);
+        }
+        if (packet_thread_.joinable()) {
+            packet_thread_.join();
         }
     }
 
@@ -522,187 +1049,344 @@ struct ffmpeg_consumer : public core::frame_consumer
 
     void initialize(const core::video_format_desc& format_desc, const core::channel_info& channel_info, int port_index) override
     {
-        if (frame_thread_.joinable()) {
+        if (session_) {
             CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("Cannot reinitialize ffmpeg-consumer."));
         }
 
         format_desc_   = format_desc;
         channel_index_ = channel_info.index;
+        offline_       = channel_info.offline;
 
         graph_->set_text(print());
 
-        frame_thread_ = std::thread([=] {
-            try {
-                std::map<std::string, std::string> options;
-                {
-                    static boost::regex opt_exp("-(?<NAME>[^\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
-                    for (auto it = boost::sregex_iterator(args_.begin(), args_.end(), opt_exp);
-                         it != boost::sregex_iterator();
-                         ++it) {
-                        options[(*it)["NAME"].str().c_str()] =
-                            (*it)["VALUE"].matched ? (*it)["VALUE"].str().c_str() : "";
-                    }
-                }
+        std::map<std::string, std::string> options;
+        {
+            static boost::regex opt_exp("-(?<NAME>[^\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
+            for (auto it = boost::sregex_iterator(args_.begin(), args_.end(), opt_exp); it != boost::sregex_iterator();
+                 ++it) {
+                options[(*it)["NAME"].str().c_str()] = (*it)["VALUE"].matched ? (*it)["VALUE"].str().c_str() : "";
+            }
+        }
 
-                boost::filesystem::path full_path = path_;
+        // The options of the streams are the encoders', the others the muxer's
+        std::map<std::string, std::string> encode_options;
+        for (auto it = options.begin(); it != options.end();) {
+            if (boost::algorithm::ends_with(it->first, ":v") || boost::algorithm::ends_with(it->first, ":a")) {
+                encode_options.insert(*it);
+                it = options.erase(it);
+            } else {
+                ++it;
+            }
+        }
 
-                static boost::regex prot_exp("^.+:.*");
-                if (!boost::regex_match(path_, prot_exp)) {
-                    if (!full_path.is_absolute()) {
-                        full_path = u8(env::media_folder()) + path_;
-                    }
+        std::string format;
+        {
+            const auto format_it = options.find("format");
+            if (format_it != options.end()) {
+                format = std::move(format_it->second);
+                options.erase(format_it);
+            }
+        }
 
-                    // TODO -y?
-                    if (boost::filesystem::exists(full_path)) {
-                        boost::filesystem::remove(full_path);
-                    }
+        // As avformat_alloc_output_context2 picks it
+        const auto oformat = !format.empty() ? av_guess_format(format.c_str(), nullptr, nullptr)
+                                             : av_guess_format(nullptr, path_.c_str(), nullptr);
+        if (!oformat) {
+            FF_RET(AVERROR(EINVAL), "av_guess_format");
+        }
+        const auto global_header = (oformat->flags & AVFMT_GLOBALHEADER) != 0;
 
-                    boost::filesystem::create_directories(full_path.parent_path());
-                }
+        // The file is rotated every segment_time seconds while the encoders run on, unless the muxer segments itself
+        int64_t segment_time = 0;
+        {
+            auto       priv_class = oformat->priv_class;
+            const auto segmenting =
+                priv_class && av_opt_find(&priv_class, "segment_time", nullptr, 0, AV_OPT_SEARCH_FAKE_OBJ);
+            const auto it = options.find("segment_time");
+            if (it != options.end() && !segmenting) {
+                segment_time = static_cast<int64_t>(std::stod(it->second) * AV_TIME_BASE);
+                options.erase(it);
+            }
+        }
 
-                AVFormatContext* oc = nullptr;
+        // Consumers of the channel that would encode alike share the encoders
+        auto codec_name = [&](AVCodecID codec_id, const std::string& suffix) -> std::string {
+            if (codec_id == AV_CODEC_ID_NONE) {
+                return "none";
+            }
+            const auto it = encode_options.find("codec" + suffix);
+            if (it != encode_options.end()) {
+                return it->second;
+            }
+            const auto codec = avcodec_find_encoder(codec_id);
+            return codec ? codec->name : "";
+        };
 
-                {
-                    std::string format;
-                    {
-                        const auto format_it = options.find("format");
-                        if (format_it != options.end()) {
-                            format = std::move(format_it->second);
-                            options.erase(format_it);
-                        }
-                    }
+        std::stringstream key;
+        key << channel_info.index << "|" << u8(format_desc.name) << "|" << realtime_ << "|"
+            << static_cast<int>(depth_) << "|" << global_header << "|" << codec_name(oformat->video_codec, ":v") << "|"
+            << codec_name(oformat->audio_codec, ":a") << "|" << segment_time;
+        for (auto& p : encode_options) {
+            key << "|" << p.first << "=" << p.second;
+        }
 
-                    FF(avformat_alloc_output_context2(
-                        &oc, nullptr, !format.empty() ? format.c_str() : nullptr, path_.c_str()));
-                }
+        output_ = std::make_shared<EncodeSession::Output>();
+        output_->packets.set_capacity(realtime_ ? 1 : 128);
+
+        session_ = EncodeSession::attach(key.str(), output_, [&] {
+            return std::make_shared<EncodeSession>(format_desc,
+                                                   realtime_,
+                                                   depth_,
+                                                   global_header,
+                                                   oformat->video_codec,
+                                                   oformat->audio_codec,
+                                                   encode_options,
+                                                   segment_time,
+                                                   graph_);
+        });
 
-                CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
+        if (session_->video) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(session_->video->sink));
+        }
 
-                std::optional<Stream> video_stream;
-                if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
-                    if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
-                        options["preset:v"] = "veryfast";
-                    }
-                    video_stream.emplace(oc, ":v", oc->oformat->video_codec, format_desc, realtime_, depth_, options);
+        for (auto& p : session_->unused) {
+            options.insert(p);
+        }
 
-                    {
-                        std::lock_guard<std::mutex> lock(state_mutex_);
-                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_stream->sink));
-                    }
-                }
+        packet_thread_ =
+            std::thread([this, format = std::move(format), options = std::move(options), segment_time]() mutable {
+                mux(format, options, segment_time);
+            });
+    }
 
-                std::optional<Stream> audio_stream;
-                if (oc->oformat->audio_codec != AV_CODEC_ID_NONE) {
-                    audio_stream.emplace(oc, ":a", oc->oformat->audio_codec, format_desc, realtime_, depth_, options);
-                }
+    // A file of the output, which is all of it unless the output is segmented
+    struct Segment
+    {
+        boost::filesystem::path          path;
+        std::shared_ptr<AVFormatContext> oc;
+        AVStream*                        streams[2] = {}; // By the stream_index of the packets of the session
+        int64_t                          count[2]   = {}; // The packets written of each stream
+        int64_t                          start      = 0;  // In AV_TIME_BASE units, as the session counts
+        bool                             trim       = true; // Drops the packets from before start
+    };
+
+    std::shared_ptr<Segment> open_segment(const std::string&                  format,
+                                          const std::string&                  path,
+                                          bool                                is_file,
+                                          std::map<std::string, std::string>& options)
+    {
+        if (is_file) {
+            // TODO -y?
+            if (boost::filesystem::exists(path)) {
+                boost::filesystem::remove(path);
+            }
 
-                if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                    // TODO (fix) interrupt_cb
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
-                    options = to_map(&dict);
-                }
+            boost::filesystem::create_directories(boost::filesystem::path(path).parent_path());
+        }
 
-                {
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avformat_write_header(oc, &dict));
-                    options = to_map(&dict);
-                }
+        auto segment  = std::make_shared<Segment>();
+        segment->path = is_file ? path : "";
 
-                {
-                    for (auto& p : options) {
-                        CASPAR_LOG(warning) << print() << " Unused option " << p.first << "=" << p.second;
-                    }
-                }
+        AVFormatContext* oc = nullptr;
+        FF(avformat_alloc_output_context2(&oc, nullptr, !format.empty() ? format.c_str() : nullptr, path.c_str()));
+        segment->oc = std::shared_ptr<AVFormatContext>(oc, [](AVFormatContext* ctx) {
+            if (!(ctx->oformat->flags & AVFMT_NOFILE)) {
+                avio_closep(&ctx->pb);
+            }
+            avformat_free_context(ctx);
+        });
 
-                tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
-                packet_buffer.set_capacity(realtime_ ? 1 : 128);
-                auto packet_thread = std::thread([&] {
-                    try {
-                        CASPAR_SCOPE_EXIT
-                        {
-                            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                                FF(avio_closep(&oc->pb));
-                            }
-                        };
-
-                        std::map<int, int64_t> count;
-
-                        std::shared_ptr<AVPacket> pkt;
-                        while (true) {
-                            packet_buffer.pop(pkt);
-                            if (!pkt) {
-                                break;
-                            }
-                            count[pkt->stream_index] += 1;
-                            FF(av_interleaved_write_frame(oc, pkt.get()));
-                        }
+        const Stream* encoders[2] = {session_->video ? &*session_->video : nullptr,
+                                     session_->audio ? &*session_->audio : nullptr};
+        for (auto n = 0; n < 2; ++n) {
+            if (!encoders[n]) {
+                continue;
+            }
 
-                        auto video_st = video_stream ? video_stream->st : nullptr;
-                        auto audio_st = audio_stream ? audio_stream->st : nullptr;
+            auto st = avformat_new_stream(oc, nullptr);
+            if (!st) {
+                FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
+            }
 
-                        if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
-                            FF(av_write_trailer(oc));
-                        }
+            const auto& enc = encoders[n]->enc;
+            st->time_base   = enc->time_base;
+            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+                // Ensure the frame_rate is set in a way that rtmp will find it
+                st->avg_frame_rate = enc->framerate;
+            }
+            FF(avcodec_parameters_from_context(st->codecpar, enc.get()));
+            segment->streams[n] = st;
+        }
+
+        if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+            // TODO (fix) interrupt_cb
+            auto dict = to_dict(std::move(options));
+            CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+            FF(avio_open2(&oc->pb, path.c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
+            options = to_map(&dict);
+        }
 
+        {
+            auto dict = to_dict(std::move(options));
+            CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+            FF(avformat_write_header(oc, &dict));
+            options = to_map(&dict);
+        }
+
+        return segment;
+    }
+
+    // Writes the trailer of segment and closes it, syncing the file to the disk when it is segmented
+    static void close_segment(Segment& segment, bool sync)
+    {
+        const auto oc = segment.oc.get();
+        if ((!segment.streams[0] || segment.count[0]) && (!segment.streams[1] || segment.count[1])) {
+            FF(av_write_trailer(oc));
+        }
+        if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+            FF(avio_closep(&oc->pb));
+        }
+        if (sync && !segment.path.empty()) {
+            sync_file(segment.path);
+        }
+    }
+
+    // Muxes the packets of the session into the file or stream of the consumer, or into a file per segment_time
+    void mux(const std::string& format, std::map<std::string, std::string>& options, int64_t segment_time)
+    {
+        try {
+            // Lets the session know that the consumer takes no more packets
+            CASPAR_SCOPE_EXIT { output_->packets.abort(); };
+
+            static boost::regex prot_exp("^.+:.*");
+            const auto          is_file = !boost::regex_match(path_, prot_exp);
+
+            std::string path = path_;
+            if (is_file && !boost::filesystem::path(path_).is_absolute()) {
+                path = u8(env::media_folder()) + path_;
+            }
+
+            // Segments after the first take the muxer options as given, the first reports those none took
+            const auto segment_options = options;
+
+            auto segment  = open_segment(format, segment_time ? segment_path(path, 0) : path, is_file, options);
+            segment->trim = output_->joined;
+            for (auto& p : options) {
+                CASPAR_LOG(warning) << print() << " Unused option " << p.first << "=" << p.second;
+            }
+
+            // Finished segments have their trailers written and are synced on a thread of their own, while packets go
+            // on to the next. The last of them is only closed once the audio that would go in it has been written.
+            executor                 closer(L"ffmpeg_consumer::closer");
+            std::shared_ptr<Segment> previous;
+            auto                     number = 0;
+            int64_t                  frames = 0;
+
+            auto close_previous = [&] {
+                closer.begin_invoke([this, previous = std::move(previous)] {
+                    try {
+                        close_segment(*previous, true);
+                        CASPAR_LOG(info) << print() << L" Closed " << previous->path.wstring();
                     } catch (...) {
                         CASPAR_LOG_CURRENT_EXCEPTION();
-                        // TODO
-                        packet_buffer.abort();
                     }
                 });
-                CASPAR_SCOPE_EXIT
-                {
-                    if (packet_thread.joinable()) {
-                        // TODO Is nullptr needed?
-                        packet_buffer.push(nullptr);
-                        packet_buffer.abort();
-                        packet_thread.join();
-                    }
-                };
+                previous = nullptr;
+            };
 
-                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) { packet_buffer.push(std::move(pkt)); };
+            // Consumers that join a session being encoded start at a video keyframe, with the time from there
+            std::optional<int64_t> start;
+            if (!output_->joined) {
+                start = 0;
+            }
 
-                std::int32_t frame_number = 0;
-                while (true) {
-                    {
-                        std::lock_guard<std::mutex> lock(state_mutex_);
-                        state_["file/frame"] = frame_number++;
+            std::shared_ptr<AVPacket> pkt;
+            while (true) {
+                output_->packets.pop(pkt);
+                graph_->set_value("output",
+                                  static_cast<double>(output_->packets.size() + 0.001) /
+                                      output_->packets.capacity());
+                if (!pkt) {
+                    break;
+                }
+
+                const auto& enc      = pkt->stream_index == 0 ? session_->video->enc : session_->audio->enc;
+                const auto  is_video = pkt->stream_index == 0;
+                const auto  time     = av_rescale_q(pkt->pts, enc->time_base, AVRational{1, AV_TIME_BASE});
+                if (!start) {
+                    if (session_->video && (!is_video || !(pkt->flags & AV_PKT_FLAG_KEY))) {
+                        continue;
                     }
+                    start          = time;
+                    segment->start = time;
+                }
 
-                    core::const_frame frame;
-                    frame_buffer_.pop(frame);
-                    graph_->set_value("input",
-                                      static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
-
-                    caspar::timer frame_timer;
-                    tbb::parallel_invoke(
-                        [&] {
-                            if (video_stream) {
-                                video_stream->send(frame, format_desc, packet_cb);
-                            }
-                        },
-                        [&] {
-                            if (audio_stream) {
-                                audio_stream->send(frame, format_desc, packet_cb);
-                            }
-                        });
-                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
-
-                    if (!frame) {
-                        packet_buffer.push(nullptr);
-                        break;
+                // A segment starts on the first video keyframe, or audio packet when there is no video, of its time
+                if (segment_time && pkt->pts != AV_NOPTS_VALUE && time / segment_time > segment->start / segment_time &&
+                    (!session_->video || (is_video && (pkt->flags & AV_PKT_FLAG_KEY)))) {
+                    if (previous) {
+                        close_previous();
+                    }
+                    previous = std::move(segment);
+
+                    auto options2  = segment_options;
+                    segment        = open_segment(format, segment_path(path, ++number), is_file, options2);
+                    segment->start = time;
+
+                    std::lock_guard<std::mutex> lock(state_mutex_);
+                    state_["file/segment"] = number;
+                }
+
+                // Audio of the time of the previous segment still goes in it
+                auto target = segment.get();
+                if (previous && !is_video) {
+                    if (pkt->pts != AV_NOPTS_VALUE && time < segment->start) {
+                        target = previous.get();
+                    } else {
+                        close_previous();
                     }
                 }
 
-                packet_thread.join();
-            } catch (...) {
-                std::lock_guard<std::mutex> lock(exception_mutex_);
+                const auto offset = av_rescale_q(target->start, AVRational{1, AV_TIME_BASE}, enc->time_base);
+                if (target->trim && pkt->pts != AV_NOPTS_VALUE && pkt->pts < offset) {
+                    continue;
+                }
+
+                // The packet is shared with the other consumers of the session
+                auto pkt2 = alloc_packet();
+                FF(av_packet_ref(pkt2.get(), pkt.get()));
+                if (pkt2->pts != AV_NOPTS_VALUE) {
+                    pkt2->pts -= offset;
+                }
+                if (pkt2->dts != AV_NOPTS_VALUE) {
+                    pkt2->dts -= offset;
+                }
+                const auto st      = target->streams[pkt->stream_index];
+                pkt2->stream_index = st->index;
+                av_packet_rescale_ts(pkt2.get(), enc->time_base, st->time_base);
+
+                target->count[pkt->stream_index] += 1;
+                if (is_video) {
+                    std::lock_guard<std::mutex> lock(state_mutex_);
+                    state_["file/frame"] = ++frames;
+                }
+
+                FF(av_interleaved_write_frame(target->oc.get(), pkt2.get()));
+            }
+
+            if (previous) {
+                close_previous();
+            }
+            close_segment(*segment, segment_time != 0);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            if (!exception_) {
                 exception_ = std::current_exception();
             }
-        });
+        }
     }
 
     std::future<bool> send(core::video_field field, core::const_frame frame) override
@@ -716,10 +1400,7 @@ struct ffmpeg_consumer : public core::frame_consumer
             }
         }
 
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-        }
-        graph_->set_value("input", static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
+        session_->send(output_, frame, offline_);
 
         return make_ready_future(true);
     }
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_consumer.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+#include "../util/replay_buffer.h"
+
+#include <common/bit_depth.h>
+#include <common/diagnostics/graph.h>
+#include <common/future.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/task_arena.h>
+#include <common/timer.h>
+#include <common/utf.h>
+#include <common/yuv.h>
+
+#include <core/consumer/channel_info.h>
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/crc.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixfmt.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <tbb/concurrent_queue.h>
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+struct replay_consumer : public core::frame_consumer
+{
+    const std::wstring name_;
+    const std::string  codec_name_;
+    const int          duration_; // Seconds
+    const std::size_t  memory_;   // Bytes
+    const int          quality_;
+
+    core::monitor::state    state_;
+    mutable std::mutex      state_mutex_;
+    int                     channel_index_ = -1;
+    core::video_format_desc format_desc_;
+    common::bit_depth       depth_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+
+    std::exception_ptr exception_;
+    std::mutex         exception_mutex_;
+
+    std::shared_ptr<AVCodecContext> enc_;
+    AVPixelFormat                   pix_fmt_ = AV_PIX_FMT_NONE;
+    std::shared_ptr<ReplayBuffer>   buffer_;
+
+    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    std::thread                                      thread_;
+
+  public:
+    replay_consumer(std::wstring      name,
+                    std::string       codec_name,
+                    int               duration,
+                    std::size_t       memory,
+                    int               quality,
+                    common::bit_depth depth)
+        : name_(std::move(name))
+        , codec_name_(std::move(codec_name))
+        , duration_(duration)
+        , memory_(memory)
+        , quality_(quality)
+        , depth_(depth)
+    {
+        state_["replay/name"] = u8(name_);
+
+        diagnostics::register_graph(graph_);
+        graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+        graph_->set_color("memory", diagnostics::color(0.4f, 0.4f, 0.7f));
+
+        frame_buffer_.set_capacity(4);
+    }
+
+    ~replay_consumer()
+    {
+        frame_buffer_.abort();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    // frame consumer
+
+    void initialize(const core::video_format_desc& format_desc, const core::channel_info& channel_info, int port_index) override
+    {
+        if (enc_) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("Cannot reinitialize replay-consumer."));
+        }
+
+        format_desc_   = format_desc;
+        channel_index_ = channel_info.index;
+
+        graph_->set_text(print());
+
+        const auto codec = avcodec_find_encoder_by_name(codec_name_.c_str());
+        if (!codec || codec->type != AVMEDIA_TYPE_VIDEO) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown video encoder " + codec_name_));
+        }
+
+        // The formats bgra_to_yuv puts out, of which the one closest to the channel
+        std::vector<AVPixelFormat> pix_fmts;
+        for (auto fmt = codec->pix_fmts; fmt && *fmt != AV_PIX_FMT_NONE; ++fmt) {
+            if (to_yuv_format(*fmt)) {
+                pix_fmts.push_back(*fmt);
+            }
+        }
+        if (pix_fmts.empty()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(codec_name_ + " takes no pixel format replay supports"));
+        }
+        pix_fmts.push_back(AV_PIX_FMT_NONE);
+        pix_fmt_ = avcodec_find_best_pix_fmt_of_list(
+            pix_fmts.data(), depth_ == common::bit_depth::bit8 ? AV_PIX_FMT_YUV422P : AV_PIX_FMT_YUV422P10, 0, nullptr);
+
+        enc_ = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+        if (!enc_) {
+            FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+        }
+
+        enc_->width               = format_desc_.width;
+        enc_->height              = format_desc_.height;
+        enc_->sample_aspect_ratio = av_mul_q({format_desc_.square_width, format_desc_.square_height},
+                                             {format_desc_.height, format_desc_.width});
+        enc_->time_base           = AVRational{format_desc_.duration, format_desc_.time_scale};
+        enc_->framerate           = av_inv_q(enc_->time_base);
+        enc_->pix_fmt             = pix_fmt_;
+        enc_->colorspace          = AVCOL_SPC_BT709;
+        enc_->color_primaries     = AVCOL_PRI_BT709;
+        enc_->color_range         = AVCOL_RANGE_MPEG;
+        enc_->color_trc           = AVCOL_TRC_BT709;
+
+        // Every frame decodes on its own, so that playback can start anywhere at once
+        enc_->gop_size     = 1;
+        enc_->max_b_frames = 0;
+
+        // mjpeg only takes the limited range formats bgra_to_yuv puts out as an extension
+        if (codec->id == AV_CODEC_ID_MJPEG) {
+            enc_->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+        }
+        if (quality_ > 0) {
+            enc_->flags |= AV_CODEC_FLAG_QSCALE;
+            enc_->global_quality = FF_QP2LAMBDA * quality_;
+        }
+
+        // Frame threads would hold frames back, which a buffer read at its live edge can not afford
+        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
+            enc_->thread_type = FF_THREAD_SLICE;
+        }
+
+        FF(avcodec_open2(enc_.get(), codec, nullptr));
+
+        auto codecpar = std::shared_ptr<AVCodecParameters>(
+            avcodec_parameters_alloc(), [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+        FF(avcodec_parameters_from_context(codecpar.get(), enc_.get()));
+
+        buffer_ = std::make_shared<ReplayBuffer>(
+            codecpar, format_desc_, static_cast<int64_t>(duration_ * format_desc_.hz), memory_);
+        ReplayBuffer::publish(name_, buffer_);
+
+        CASPAR_LOG(info) << print() << L" Recording " << duration_ << L" seconds or " << (memory_ >> 20)
+                         << L" MB of " << u16(codec_name_) << L".";
+
+        thread_ = std::thread([this] {
+            try {
+                set_thread_name(L"[ffmpeg::replay_consumer]");
+
+                // The audio of the frames sent to the encoder, until it hands their packets back
+                std::deque<std::vector<int32_t>> audio;
+
+                auto              pkt = alloc_packet();
+                core::const_frame frame;
+                while (true) {
+                    frame_buffer_.pop(frame);
+                    graph_->set_value("input",
+                                      static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
+
+                    caspar::timer frame_timer;
+
+                    const auto av_frame = convert(frame);
+                    audio.emplace_back(frame.audio_data().begin(), frame.audio_data().end());
+
+                    FF(avcodec_send_frame(enc_.get(), av_frame.get()));
+                    while (true) {
+                        auto ret = avcodec_receive_packet(enc_.get(), pkt.get());
+                        if (ret == AVERROR(EAGAIN)) {
+                            break;
+                        }
+                        FF_RET(ret, "avcodec_receive_packet");
+
+                        ReplayBuffer::Frame replay;
+                        replay.video = alloc_packet();
+                        av_packet_move_ref(replay.video.get(), pkt.get());
+                        if (!audio.empty()) {
+                            replay.audio = std::move(audio.front());
+                            audio.pop_front();
+                        }
+                        buffer_->push(std::move(replay));
+                    }
+
+                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+                    graph_->set_value("memory", static_cast<double>(buffer_->size()) / memory_);
+
+                    const auto first = buffer_->first();
+                    const auto last  = buffer_->last();
+
+                    std::lock_guard<std::mutex> lock(state_mutex_);
+                    state_["replay/first"]  = first;
+                    state_["replay/last"]   = last;
+                    state_["replay/frames"] = last - first + 1;
+                    state_["replay/memory"] = static_cast<int64_t>(buffer_->size());
+                }
+            } catch (tbb::user_abort&) {
+                // Removed
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+
+                std::lock_guard<std::mutex> lock(exception_mutex_);
+                exception_ = std::current_exception();
+            }
+        });
+    }
+
+    std::shared_ptr<AVFrame> convert(const core::const_frame& in_frame) const
+    {
+        const auto src = make_av_video_frame(in_frame, format_desc_);
+        if (src->format != AV_PIX_FMT_BGRA && src->format != AV_PIX_FMT_BGRA64) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                    << msg_info_t("unsupported channel pixel format"));
+        }
+
+        auto frame                 = alloc_frame();
+        frame->sample_aspect_ratio = src->sample_aspect_ratio;
+        frame->width               = src->width;
+        frame->height              = src->height;
+        frame->format              = pix_fmt_;
+        frame->colorspace          = AVCOL_SPC_BT709;
+        frame->color_primaries     = AVCOL_PRI_BT709;
+        frame->color_range         = AVCOL_RANGE_MPEG;
+        frame->color_trc           = AVCOL_TRC_BT709;
+        FF(av_frame_get_buffer(frame.get(), 64));
+
+        run_in_arena(task_kind::realtime, [&] {
+            bgra_to_yuv(src->data[0],
+                        src->linesize[0],
+                        src->format == AV_PIX_FMT_BGRA64 ? common::bit_depth::bit16 : common::bit_depth::bit8,
+                        src->width,
+                        src->height,
+                        *to_yuv_format(pix_fmt_),
+                        frame->data,
+                        frame->linesize);
+        });
+
+        return frame;
+    }
+
+    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            if (exception_ != nullptr) {
+                std::rethrow_exception(exception_);
+            }
+        }
+
+        // The channel is never held up, a slow encoder leaves gaps in the history instead
+        if (!frame_buffer_.try_push(frame)) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        return make_ready_future(true);
+    }
+
+    std::wstring print() const override { return L"replay[" + name_ + L"]"; }
+
+    std::wstring name() const override { return L"replay"; }
+
+    int index() const override
+    {
+        boost::crc_16_type result;
+        result.process_bytes(name_.data(), name_.length() * sizeof(wchar_t));
+        return 200000 + result.checksum();
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer>
+create_replay_consumer(const std::vector<std::wstring>&                         params,
+                       const core::video_format_repository&                     format_repository,
+                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                       const core::channel_info&                                channel_info)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"REPLAY"))
+        return core::frame_consumer::empty();
+
+    return spl::make_shared<replay_consumer>(params.at(1),
+                                             u8(get_param(L"CODEC", params, L"mjpeg")),
+                                             get_param(L"DURATION", params, 120),
+                                             static_cast<std::size_t>(get_param(L"MEMORY", params, 2048)) << 20,
+                                             get_param(L"QUALITY", params, 3),
+                                             channel_info.depth);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_replay_consumer(const boost::property_tree::wptree&                      ptree,
+                                     const core::video_format_repository&                     format_repository,
+                                     const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                                     const core::channel_info&                                channel_info)
+{
+    return spl::make_shared<replay_consumer>(ptree.get<std::wstring>(L"name"),
+                                             u8(ptree.get<std::wstring>(L"codec", L"mjpeg")),
+                                             ptree.get(L"duration", 120),
+                                             static_cast<std::size_t>(ptree.get(L"memory", 2048)) << 20,
+                                             ptree.get(L"quality", 3),
+                                             channel_info.depth);
+}
+
+}} // namespace caspar::ffmpeg
@@ -24,13 +24,27 @@
 #include "ffmpeg.h"
 
 #include "consumer/ffmpeg_consumer.h"
+#include "consumer/replay_consumer.h"
+#include "producer/av_probe.h"
 #include "producer/ffmpeg_producer.h"
+#include "producer/replay_producer.h"
 
+#include <common/env.h>
+#include <common/filesystem.h>
 #include <common/log.h>
+#include <common/utf.h>
 
 #include <core/module_dependencies.h>
 
+#include <protocol/amcp/amcp_command_repository_wrapper.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <ctime>
+#include <iomanip>
 #include <mutex>
+#include <sstream>
 
 #if defined(_MSC_VER)
 #pragma warning(disable : 4244)
@@ -107,6 +121,67 @@ void log_callback(void* ptr, int level, const char* fmt, va_list vl)
 
 void log_for_thread(void* ptr, int level, const char* fmt, va_list vl) { log_callback(ptr, level, fmt, vl); }
 
+namespace {
+
+// Held for as long as the module is loaded, so that the prewarmed probes are kept
+std::shared_ptr<MediaCache> media_cache;
+
+// The line of a clip, as the media scanner answers CINF and CLS with it
+std::wstring media_line(const MediaInfo& info)
+{
+    auto clip = boost::to_upper_copy(get_relative_without_extension(info.path, env::media_folder()).generic_wstring());
+
+    std::tm tm = {};
+#ifdef _MSC_VER
+    localtime_s(&tm, &info.mtime);
+#else
+    localtime_r(&info.mtime, &tm);
+#endif
+
+    std::wstringstream line;
+    line << L"\"" << clip << L"\" " << u16(info.type) << L" " << info.size << L" "
+         << std::put_time(&tm, L"%Y%m%d%H%M%S") << L" " << info.frames << L" " << info.time_base_num << L"/"
+         << info.time_base_den << L"\r\n";
+    return line.str();
+}
+
+std::wstring cinf_command(protocol::amcp::command_context& ctx)
+{
+    auto cache = MediaCache::get();
+    if (!cache) {
+        return L"501 CINF FAILED\r\n";
+    }
+
+    auto file = cache->find(ctx.parameters.at(0), [](const boost::filesystem::path&) { return true; });
+    if (!file) {
+        file = find_file_within_dir_or_absolute(
+            env::media_folder(), ctx.parameters.at(0), [](const boost::filesystem::path&) { return true; });
+    }
+    auto info = file ? cache->probe(*file) : std::optional<MediaInfo>();
+    if (!info) {
+        return L"404 CINF ERROR\r\n";
+    }
+    return L"201 CINF OK\r\n" + media_line(*info);
+}
+
+std::wstring cls_command(protocol::amcp::command_context& ctx)
+{
+    auto cache = MediaCache::get();
+    if (!cache) {
+        return L"501 CLS FAILED\r\n";
+    }
+
+    std::wstringstream reply;
+    reply << L"200 CLS OK\r\n";
+    for (auto& info : cache->list(env::media_folder())) {
+        reply << media_line(info);
+    }
+    reply << L"\r\n";
+    return reply.str();
+}
+
+} // namespace
+
 void init(const core::module_dependencies& dependencies)
 {
     av_log_set_callback(log_for_thread);
@@ -124,12 +199,29 @@ void init(const core::module_dependencies& dependencies)
 
     dependencies.consumer_registry->register_consumer_factory(L"FFmpeg Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ffmpeg", create_preconfigured_consumer);
+    dependencies.consumer_registry->register_consumer_factory(L"Replay Consumer", create_replay_consumer);
+    dependencies.consumer_registry->register_preconfigured_consumer_factory(L"replay",
+                                                                            create_preconfigured_replay_consumer);
 
+    // Before the FFmpeg Producer, which would look for a clip named REPLAY
+    dependencies.producer_registry->register_producer_factory(L"Replay Producer", create_replay_producer);
     dependencies.producer_registry->register_producer_factory(L"FFmpeg Producer", create_producer);
+
+    media_cache = MediaCache::get();
+    if (media_cache) {
+        media_cache->prewarm(env::media_folder());
+
+        if (env::properties().get(L"configuration.ffmpeg.producer.media-cache-queries", false)) {
+            dependencies.command_repository->register_command(L"Query Commands", L"CINF", cinf_command, 1);
+            dependencies.command_repository->register_command(L"Query Commands", L"CLS", cls_command, 0);
+        }
+    }
 }
 
 void uninit()
 {
+    media_cache.reset();
+
     // avfilter_uninit();
     avformat_network_deinit();
 }
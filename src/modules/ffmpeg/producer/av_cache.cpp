@@ -0,0 +1,103 @@
+#include "av_cache.h"
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <map>
+
+namespace caspar { namespace ffmpeg {
+
+struct FrameCache::Impl
+{
+    const size_t              capacity_;
+    std::deque<CachedFrame>   frames_; // In the order they were put
+    boost::mutex              mutex_;
+    boost::condition_variable cond_;
+
+    explicit Impl(size_t capacity)
+        : capacity_(capacity)
+    {
+    }
+
+    static bool matches(const CachedFrame& frame, int64_t pts)
+    {
+        return std::abs(frame.pts - pts) * 2 < frame.duration;
+    }
+
+    std::deque<CachedFrame>::iterator lookup(int64_t pts)
+    {
+        return std::find_if(frames_.begin(), frames_.end(), [&](auto& frame) { return matches(frame, pts); });
+    }
+
+    void put(const CachedFrame& frame)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            if (lookup(frame.pts) != frames_.end()) {
+                return;
+            }
+            frames_.push_back(frame);
+            while (frames_.size() > capacity_) {
+                frames_.pop_front();
+            }
+        }
+        cond_.notify_all();
+    }
+
+    std::optional<CachedFrame> find(int64_t pts, std::chrono::microseconds timeout)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+
+        auto it = lookup(pts);
+        if (it == frames_.end()) {
+            auto next_due = std::any_of(
+                frames_.begin(), frames_.end(), [&](auto& frame) { return matches(frame, pts - frame.duration); });
+            if (!next_due) {
+                return {};
+            }
+            cond_.wait_for(lock, boost::chrono::microseconds(timeout.count()), [&] {
+                it = lookup(pts);
+                return it != frames_.end();
+            });
+            if (it == frames_.end()) {
+                return {};
+            }
+        }
+        return *it;
+    }
+};
+
+std::shared_ptr<FrameCache> FrameCache::get(const std::string& key, size_t capacity)
+{
+    static boost::mutex                                     mutex;
+    static std::map<std::string, std::weak_ptr<FrameCache>> caches;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+
+    // Drop the entries of clips no longer played
+    for (auto it = caches.begin(); it != caches.end();) {
+        it = it->second.expired() ? caches.erase(it) : std::next(it);
+    }
+
+    auto cache = caches[key].lock();
+    if (!cache) {
+        cache       = std::make_shared<FrameCache>(capacity);
+        caches[key] = cache;
+    }
+    return cache;
+}
+
+FrameCache::FrameCache(size_t capacity)
+    : impl_(new Impl(capacity))
+{
+}
+FrameCache::~FrameCache() {}
+void FrameCache::put(const CachedFrame& frame) { impl_->put(frame); }
+std::optional<CachedFrame> FrameCache::find(int64_t pts, std::chrono::microseconds timeout)
+{
+    return impl_->find(pts, timeout);
+}
+
+}} // namespace caspar::ffmpeg
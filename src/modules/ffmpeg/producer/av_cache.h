@@ -0,0 +1,46 @@
+#pragma once
+
+#include <core/frame/frame.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+struct CachedFrame
+{
+    core::const_frame frame;
+    int64_t           start_time = 0;
+    int64_t           pts        = 0;
+    int64_t           duration   = 0;
+};
+
+// The most recently decoded frames of a clip, shared by the producers that play it with the same filters into the same
+// device. A producer in lockstep with another takes the frames the other has decoded instead of decoding them again.
+class FrameCache
+{
+  public:
+    // The cache of key, created for the first producer that asks for it and released with the last
+    static std::shared_ptr<FrameCache> get(const std::string& key, size_t capacity);
+
+    explicit FrameCache(size_t capacity);
+    ~FrameCache();
+
+    FrameCache(const FrameCache&)            = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    void put(const CachedFrame& frame);
+
+    // The frame at pts, or nothing. When the frame before it is cached, waits up to timeout for another producer to
+    // decode it.
+    std::optional<CachedFrame> find(int64_t pts, std::chrono::microseconds timeout);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
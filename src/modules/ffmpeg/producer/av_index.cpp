@@ -0,0 +1,264 @@
+#include "av_index.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/thread.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Indexes are kept on disk so that files are only scanned once. An empty path disables the sidecar files.
+const boost::filesystem::path& index_folder()
+{
+    static const auto folder = [] {
+        boost::filesystem::path path = env::properties().get(L"configuration.ffmpeg.producer.keyframe-index-path",
+                                                             std::wstring(L"keyframe-index/"));
+        if (!path.empty() && path.is_relative()) {
+            path = boost::filesystem::path(env::data_folder()) / path;
+        }
+        return path;
+    }();
+    return folder;
+}
+
+// Scans read whole files, so they take turns rather than compete with playback for the disk
+boost::timed_mutex scan_mutex;
+
+} // namespace
+
+struct KeyframeIndex::Impl
+{
+    const std::string filename_;
+
+    mutable boost::mutex mutex_;
+    std::vector<int64_t> keyframes_; // Sorted, empty until the file has been scanned
+
+    std::atomic<bool> abort_{false};
+    boost::thread     thread_;
+
+    explicit Impl(const std::string& filename)
+        : filename_(filename)
+    {
+        thread_ = boost::thread([this] {
+            try {
+                set_thread_name(L"[ffmpeg::av_producer::KeyframeIndex]");
+
+                // The file is part of the key, so that a file that was replaced is scanned again
+                const auto        path = boost::filesystem::path(u16(filename_));
+                std::stringstream key;
+                key << filename_ << "|" << boost::filesystem::file_size(path) << "|"
+                    << boost::filesystem::last_write_time(path);
+
+                const auto file  = sidecar_file(key.str());
+                auto       index = load(file, key.str());
+                if (index.empty()) {
+                    index = scan();
+                    store(file, key.str(), index);
+                }
+
+                CASPAR_LOG(debug) << "[ffmpeg] " << index.size() << " keyframes indexed in " << filename_;
+
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                keyframes_ = std::move(index);
+            } catch (...) {
+                if (!abort_) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        });
+    }
+
+    ~Impl()
+    {
+        abort_ = true;
+        thread_.join();
+    }
+
+    static int interrupt_cb(void* ctx) { return static_cast<Impl*>(ctx)->abort_ ? 1 : 0; }
+
+    static boost::filesystem::path sidecar_file(const std::string& key)
+    {
+        if (index_folder().empty()) {
+            return {};
+        }
+
+        // FNV-1a, which unlike std::hash is stable between builds
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (auto c : key) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+
+        std::stringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << hash << ".idx";
+        return index_folder() / name.str();
+    }
+
+    static std::vector<int64_t> load(const boost::filesystem::path& file, const std::string& key)
+    {
+        std::vector<int64_t> index;
+        if (file.empty() || !boost::filesystem::exists(file)) {
+            return index;
+        }
+
+        boost::filesystem::ifstream stream(file);
+        std::string                 line;
+        if (!std::getline(stream, line) || line != key) {
+            return index;
+        }
+        for (int64_t time; stream >> time;) {
+            index.push_back(time);
+        }
+        return index;
+    }
+
+    static void store(const boost::filesystem::path& file, const std::string& key, const std::vector<int64_t>& index)
+    {
+        if (file.empty() || index.empty()) {
+            return;
+        }
+
+        try {
+            boost::filesystem::create_directories(file.parent_path());
+
+            // Producers may store the same file at once, so each writes its own file and renames it into place
+            auto tmp = file.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp");
+            {
+                boost::filesystem::ofstream stream(tmp, std::ios::trunc);
+                stream << key << "\n";
+                for (auto time : index) {
+                    stream << time << "\n";
+                }
+                if (!stream) {
+                    CASPAR_LOG(warning) << L"[ffmpeg] Failed to write keyframe index " << tmp.wstring();
+                    stream.close();
+                    boost::filesystem::remove(tmp);
+                    return;
+                }
+            }
+            boost::filesystem::rename(tmp, file);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    std::vector<int64_t> scan()
+    {
+        std::vector<int64_t> index;
+
+        boost::unique_lock<boost::timed_mutex> lock(scan_mutex, boost::defer_lock);
+        while (!lock.try_lock_for(boost::chrono::milliseconds(100))) {
+            if (abort_) {
+                return index;
+            }
+        }
+
+        AVFormatContext* ic             = avformat_alloc_context();
+        ic->interrupt_callback.callback = interrupt_cb;
+        ic->interrupt_callback.opaque   = this;
+
+        FF(avformat_open_input(&ic, filename_.c_str(), nullptr, nullptr));
+        auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+
+        FF(avformat_find_stream_info(ic, nullptr));
+
+        const auto video = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (video < 0) {
+            return index;
+        }
+
+        // Only the packet headers of the video stream matter
+        for (auto n = 0U; n < ic->nb_streams; ++n) {
+            if (static_cast<int>(n) != video) {
+                ic->streams[n]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        const auto time_base = ic->streams[video]->time_base;
+        auto       packet    = alloc_packet();
+        while (true) {
+            auto ret = av_read_frame(ic, packet.get());
+            if (ret == AVERROR_EOF) {
+                break;
+            }
+            FF_RET(ret, "av_read_frame");
+
+            const auto ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (packet->stream_index == video && (packet->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE) {
+                index.push_back(av_rescale_q(ts, time_base, {1, AV_TIME_BASE}));
+            }
+            av_packet_unref(packet.get());
+        }
+
+        std::sort(index.begin(), index.end());
+        index.erase(std::unique(index.begin(), index.end()), index.end());
+        return index;
+    }
+
+    std::optional<int64_t> find(int64_t time) const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), time);
+        if (it == keyframes_.begin()) {
+            return {};
+        }
+        return *std::prev(it);
+    }
+};
+
+std::shared_ptr<KeyframeIndex> KeyframeIndex::get(const std::string& filename)
+{
+    static boost::mutex                                        mutex;
+    static std::map<std::string, std::weak_ptr<KeyframeIndex>> indexes;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+
+    // Drop the entries of files no longer played
+    for (auto it = indexes.begin(); it != indexes.end();) {
+        it = it->second.expired() ? indexes.erase(it) : std::next(it);
+    }
+
+    auto index = indexes[filename].lock();
+    if (!index) {
+        index             = std::make_shared<KeyframeIndex>(filename);
+        indexes[filename] = index;
+    }
+    return index;
+}
+
+KeyframeIndex::KeyframeIndex(const std::string& filename)
+    : impl_(new Impl(filename))
+{
+}
+KeyframeIndex::~KeyframeIndex() {}
+std::optional<int64_t> KeyframeIndex::find(int64_t time) const { return impl_->find(time); }
+
+}} // namespace caspar::ffmpeg
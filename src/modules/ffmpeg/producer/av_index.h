@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// The keyframe times of the video stream of a file. The file is scanned once in the background and the result kept in
+// a sidecar file below the data folder, so later opens of the same file have it at once.
+class KeyframeIndex
+{
+  public:
+    // The index of filename, shared by the producers that play it
+    static std::shared_ptr<KeyframeIndex> get(const std::string& filename);
+
+    explicit KeyframeIndex(const std::string& filename);
+    ~KeyframeIndex();
+
+    KeyframeIndex(const KeyframeIndex&)            = delete;
+    KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+
+    // The last keyframe at or before time, in AV_TIME_BASE units as Input::seek takes them. Nothing until the file
+    // has been scanned.
+    std::optional<int64_t> find(int64_t time) const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
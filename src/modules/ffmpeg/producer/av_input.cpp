@@ -1,13 +1,17 @@
 #include "av_input.h"
+#include "av_read_ahead.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
 #include <common/except.h>
+#include <common/memory_governor.h>
 #include <common/os/thread.h>
 #include <common/param.h>
 #include <common/scope_exit.h>
 
+#include <core/diagnostics/cpu_cost.h>
+
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/filesystem.hpp>
 
@@ -26,21 +30,31 @@ extern "C" {
 
 namespace caspar { namespace ffmpeg {
 
-Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::optional<bool> seekable)
+Input::Input(const std::string&                  filename,
+             std::shared_ptr<diagnostics::graph> graph,
+             std::optional<bool>                 seekable,
+             std::function<void()>               notify,
+             bool                                live)
     : filename_(filename)
     , graph_(graph)
+    , notify_(std::move(notify))
     , seekable_(seekable)
+    , live_(live)
 {
     graph_->set_color("seek", diagnostics::color(1.0f, 0.5f, 0.0f));
     graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
 
     buffer_.set_capacity(256);
-    thread_ = boost::thread([=] {
+    thread_ = boost::thread([=, context = core::diagnostics::call_context::for_thread()] {
+        core::diagnostics::call_context::for_thread() = context;
         try {
             set_thread_name(L"[ffmpeg::av_producer::Input]");
 
             while (true) {
+                core::diagnostics::charge_thread_cpu_time();
+
                 auto packet = alloc_packet();
+                auto again  = false;
 
                 {
                     std::unique_lock<std::mutex> lock(ic_mutex_);
@@ -56,7 +70,7 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                     if (ret == AVERROR_EXIT) {
                         break;
                     } else if (ret == AVERROR(EAGAIN)) {
-                        boost::this_thread::yield();
+                        again = true;
                     } else if (ret == AVERROR_EOF) {
                         eof_   = true;
                         packet = nullptr;
@@ -65,8 +79,34 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                     }
                 }
 
+                if (again) {
+                    // Nothing to read yet from a non-blocking source, which is retried shortly rather than spun on.
+                    // The empty packet is not queued, as decoders would take it for the end of the stream.
+                    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+                    continue;
+                }
+
+                // Under memory pressure fewer packets are read ahead of the decoders, which is enough for playback
+                auto over_pressure_limit = [&] {
+                    switch (current_memory_pressure()) {
+                        case memory_pressure::soft:
+                            return buffer_.size() >= 64;
+                        case memory_pressure::hard:
+                            return buffer_.size() >= 16;
+                        default:
+                            return false;
+                    }
+                };
+                while (!abort_request_ && over_pressure_limit()) {
+                    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+                }
+
                 buffer_.push(std::move(packet));
                 graph_->set_value("input", (static_cast<double>(buffer_.size()) / buffer_.capacity()));
+
+                if (notify_) {
+                    notify_();
+                }
             }
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
@@ -145,12 +185,26 @@ void Input::internal_reset()
         filename_    = u8(url_parts.second);
     }
 
-    if (seekable_) {
+    // Files are read ahead on threads of their own rather than by the file protocol of avformat, which reads a block
+    // at a time when the demuxer asks for it
+    std::shared_ptr<ReadAhead> read_ahead;
+    if (input_format == nullptr && !live_ && url_parts.first.empty()) {
+        read_ahead = ReadAhead::open(filename_, graph_, [this] { return abort_request_.load(); });
+    }
+
+    if (seekable_ && !read_ahead) {
         CASPAR_LOG(debug) << "av_input[" + filename_ + "] Disabled seeking";
         FF(av_dict_set(&options, "seekable", *seekable_ ? "1" : "0", 0));
     }
 
-    if (input_format == nullptr) {
+    if (live_) {
+        // Enough to find the parameters of the usual contribution streams, which keyframes every second or so
+        FF(av_dict_set(&options, "probesize", "500000", 0));
+        FF(av_dict_set(&options, "analyzeduration", "500000", 0));
+        FF(av_dict_set(&options, "fflags", "nobuffer", 0));
+    }
+
+    if (input_format == nullptr && !read_ahead) {
         // TODO (fix) timeout?
         FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
     }
@@ -159,8 +213,19 @@ void Input::internal_reset()
     ic->interrupt_callback.callback = Input::interrupt_cb;
     ic->interrupt_callback.opaque   = this;
 
+    if (read_ahead) {
+        ic->pb = read_ahead->io_context();
+        ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+        if (seekable_ && !*seekable_) {
+            CASPAR_LOG(debug) << "av_input[" + filename_ + "] Disabled seeking";
+            ic->pb->seekable = 0;
+        }
+    }
+
+    // The read-ahead is released after the context, which leaves its I/O context alone
     FF(avformat_open_input(&ic, filename_.c_str(), input_format, &options));
-    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    auto ic2 =
+        std::shared_ptr<AVFormatContext>(ic, [read_ahead](AVFormatContext* ctx) { avformat_close_input(&ctx); });
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]" << " Unused option " << p.first << "=" << p.second;
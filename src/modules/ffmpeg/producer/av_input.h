@@ -21,10 +21,18 @@ struct AVFormatContext;
 
 namespace caspar { namespace ffmpeg {
 
+class ReadAhead;
+
 class Input
 {
   public:
-    Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::optional<bool> seekable);
+    // notify is called from the reader thread whenever a packet is queued. Live inputs are opened with as little
+    // probing and demuxer buffering as will do.
+    Input(const std::string&                  filename,
+          std::shared_ptr<diagnostics::graph> graph,
+          std::optional<bool>                 seekable,
+          std::function<void()>               notify = nullptr,
+          bool                                live   = false);
     ~Input();
 
     static int interrupt_cb(void* ctx);
@@ -44,9 +52,11 @@ class Input
     void internal_reset();
 
     std::optional<bool> seekable_;
+    bool                live_ = false;
 
     std::string                         filename_;
     std::shared_ptr<diagnostics::graph> graph_;
+    std::function<void()>               notify_;
 
     mutable std::mutex               ic_mutex_;
     std::shared_ptr<AVFormatContext> ic_;
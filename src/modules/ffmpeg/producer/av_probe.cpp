@@ -0,0 +1,264 @@
+#include "av_probe.h"
+
+#include "../util/av_assert.h"
+
+#include <common/env.h>
+#include <common/filesystem.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <atomic>
+#include <map>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// The clip of a file below folder, as CLS lists and PLAY takes it
+std::wstring clip_name(const boost::filesystem::path& file, const boost::filesystem::path& folder)
+{
+    return boost::to_upper_copy(get_relative_without_extension(file, folder).generic_wstring());
+}
+
+} // namespace
+
+struct MediaCache::Impl
+{
+    struct Entry
+    {
+        std::uintmax_t           size  = 0;
+        std::time_t              mtime = 0;
+        std::optional<MediaInfo> info; // Nothing when the file is not media
+    };
+
+    boost::mutex                                         mutex_;
+    std::map<boost::filesystem::path, Entry>             entries_;
+    std::multimap<std::wstring, boost::filesystem::path> clips_; // By clip_name, as of the last list
+
+    std::atomic<bool> abort_{false};
+    boost::thread     thread_;
+
+    ~Impl()
+    {
+        abort_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    static int interrupt_cb(void* ctx) { return static_cast<Impl*>(ctx)->abort_ ? 1 : 0; }
+
+    void prewarm(const boost::filesystem::path& folder)
+    {
+        if (thread_.joinable()) {
+            return;
+        }
+
+        thread_ = boost::thread([this, folder] {
+            try {
+                set_thread_name(L"[ffmpeg::av_producer::MediaCache]");
+
+                auto media = list(folder);
+                if (!abort_) {
+                    CASPAR_LOG(info) << L"[ffmpeg] " << media.size() << L" media files probed in " << folder.wstring();
+                }
+            } catch (...) {
+                if (!abort_) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        });
+    }
+
+    std::optional<MediaInfo> probe(const boost::filesystem::path& path)
+    {
+        boost::system::error_code ec;
+        const auto                size  = boost::filesystem::file_size(path, ec);
+        const auto                mtime = ec ? std::time_t(0) : boost::filesystem::last_write_time(path, ec);
+        if (ec) {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            entries_.erase(path);
+            return {};
+        }
+
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            auto                            it = entries_.find(path);
+            if (it != entries_.end() && it->second.size == size && it->second.mtime == mtime) {
+                return it->second.info;
+            }
+        }
+
+        // Probed without the lock, as it reads the file. Callers probing the same file at once is harmless.
+        Entry entry{size, mtime, probe_file(path)};
+        if (entry.info) {
+            entry.info->size  = size;
+            entry.info->mtime = mtime;
+        }
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        entries_[path] = entry;
+        return entry.info;
+    }
+
+    std::optional<MediaInfo> probe_file(const boost::filesystem::path& path)
+    {
+        try {
+            AVFormatContext* ic             = avformat_alloc_context();
+            ic->interrupt_callback.callback = interrupt_cb;
+            ic->interrupt_callback.opaque   = this;
+
+            if (avformat_open_input(&ic, path.generic_string().c_str(), nullptr, nullptr) < 0) {
+                return {};
+            }
+            auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+
+            FF(avformat_find_stream_info(ic, nullptr));
+
+            MediaInfo info;
+            info.path = path;
+
+            // The pictures some audio files carry are not video
+            auto video = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+            if (video >= 0 && (ic->streams[video]->disposition & AV_DISPOSITION_ATTACHED_PIC) != 0) {
+                video = -1;
+            }
+            const auto audio = av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+
+            // Images are read by the image2 demuxer or one of the <codec>_pipe ones
+            const auto format = std::string(ic->iformat->name);
+            const auto image  = format.rfind("image2", 0) == 0 ||
+                               (format.size() > 5 && format.compare(format.size() - 5, 5, "_pipe") == 0);
+
+            if (video >= 0 && !image && ic->duration > 0) {
+                const auto framerate = av_guess_frame_rate(ic, ic->streams[video], nullptr);
+                if (framerate.num > 0) {
+                    info.time_base_num = framerate.den;
+                    info.time_base_den = framerate.num;
+                    info.frames        = av_rescale_q(ic->duration, {1, AV_TIME_BASE}, av_inv_q(framerate));
+                }
+            } else if (video >= 0) {
+                info.type = "STILL";
+            } else if (audio >= 0) {
+                const auto sample_rate = ic->streams[audio]->codecpar->sample_rate;
+
+                info.type          = "AUDIO";
+                info.time_base_num = 1;
+                info.time_base_den = sample_rate;
+                info.frames        = ic->duration > 0 ? av_rescale(ic->duration, sample_rate, AV_TIME_BASE) : 0;
+            } else {
+                return {};
+            }
+            return info;
+        } catch (...) {
+            if (!abort_) {
+                CASPAR_LOG(debug) << L"[ffmpeg] Failed to probe " << path.wstring();
+            }
+            return {};
+        }
+    }
+
+    std::vector<MediaInfo> list(const boost::filesystem::path& folder)
+    {
+        std::vector<MediaInfo>                               media;
+        std::multimap<std::wstring, boost::filesystem::path> clips;
+
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::recursive_directory_iterator(folder, ec);
+             it != boost::filesystem::recursive_directory_iterator() && !abort_;
+             it.increment(ec)) {
+            if (ec || !boost::filesystem::is_regular_file(it->status())) {
+                continue;
+            }
+            if (auto info = probe(it->path())) {
+                clips.emplace(clip_name(it->path(), folder), it->path());
+                media.push_back(std::move(*info));
+            }
+        }
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (!abort_) {
+            clips_ = std::move(clips);
+        }
+
+        // Drops the entries of the files that have gone
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            it = boost::filesystem::exists(it->first, ec) ? std::next(it) : entries_.erase(it);
+        }
+        return media;
+    }
+
+    std::optional<boost::filesystem::path> find(const std::wstring&                                         clip,
+                                                const std::function<bool(const boost::filesystem::path&)>& is_valid)
+    {
+        std::vector<boost::filesystem::path> files;
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            auto                            range = clips_.equal_range(boost::to_upper_copy(clip));
+            for (auto it = range.first; it != range.second; ++it) {
+                files.push_back(it->second);
+            }
+        }
+
+        for (auto& file : files) {
+            boost::system::error_code ec;
+            if (boost::filesystem::exists(file, ec) && is_valid(file)) {
+                return file;
+            }
+        }
+        return {};
+    }
+};
+
+std::shared_ptr<MediaCache> MediaCache::get()
+{
+    static const bool enabled = env::properties().get(L"configuration.ffmpeg.producer.media-cache", true);
+    if (!enabled) {
+        return nullptr;
+    }
+
+    static boost::mutex              mutex;
+    static std::weak_ptr<MediaCache> instance;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+
+    auto cache = instance.lock();
+    if (!cache) {
+        cache    = std::make_shared<MediaCache>();
+        instance = cache;
+    }
+    return cache;
+}
+
+MediaCache::MediaCache()
+    : impl_(new Impl())
+{
+}
+MediaCache::~MediaCache() {}
+void MediaCache::prewarm(const boost::filesystem::path& folder) { impl_->prewarm(folder); }
+std::optional<MediaInfo> MediaCache::probe(const boost::filesystem::path& path) { return impl_->probe(path); }
+std::vector<MediaInfo>   MediaCache::list(const boost::filesystem::path& folder) { return impl_->list(folder); }
+std::optional<boost::filesystem::path>
+MediaCache::find(const std::wstring& clip, const std::function<bool(const boost::filesystem::path&)>& is_valid)
+{
+    return impl_->find(clip, is_valid);
+}
+
+}} // namespace caspar::ffmpeg
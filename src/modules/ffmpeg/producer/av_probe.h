@@ -0,0 +1,59 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+struct MediaInfo
+{
+    boost::filesystem::path path;
+    std::string             type          = "MOVIE"; // MOVIE, STILL or AUDIO, as CLS lists them
+    std::uintmax_t          size          = 0;
+    std::time_t             mtime         = 0;
+    int64_t                 frames        = 0; // In time_base units
+    int                     time_base_num = 0;
+    int                     time_base_den = 1;
+};
+
+// What a file holds, probed once and kept until the file changes. Shared by the producers, which look clips up in it
+// instead of searching the media folder, and the CINF and CLS commands, which it answers without the media scanner.
+class MediaCache
+{
+  public:
+    // The cache of the process, or nothing when ffmpeg.producer.media-cache is off
+    static std::shared_ptr<MediaCache> get();
+
+    MediaCache();
+    ~MediaCache();
+
+    MediaCache(const MediaCache&)            = delete;
+    MediaCache& operator=(const MediaCache&) = delete;
+
+    // Probes the files of folder in the background, so that the first LOAD and CLS do not have to
+    void prewarm(const boost::filesystem::path& folder);
+
+    // What path holds, or nothing when it is not media. Probes the file when it is new or has changed.
+    std::optional<MediaInfo> probe(const boost::filesystem::path& path);
+
+    // The media below folder, probing what is new or has changed
+    std::vector<MediaInfo> list(const boost::filesystem::path& folder);
+
+    // The file of clip, a path below the media folder without extension, for which is_valid holds. Nothing when no
+    // such file has been probed or it has since gone.
+    std::optional<boost::filesystem::path> find(const std::wstring&                                         clip,
+                                                const std::function<bool(const boost::filesystem::path&)>& is_valid);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
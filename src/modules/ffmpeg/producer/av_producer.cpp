@@ -1,5 +1,7 @@
 #include "av_producer.h"
 
+#include "av_cache.h"
+#include "av_index.h"
 #include "av_input.h"
 
 #include "../util/av_assert.h"
@@ -15,6 +17,7 @@
 #include <boost/thread/mutex.hpp>
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/env.h>
 #include <common/except.h>
 #include <common/executor.h>
@@ -22,6 +25,7 @@
 #include <common/scope_exit.h>
 #include <common/timer.h>
 
+#include <core/diagnostics/cpu_cost.h>
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/monitor/monitor.h>
@@ -39,9 +43,11 @@ extern "C" {
 #include <libavutil/avutil.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/error.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
+#include <libswscale/swscale.h>
 }
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -49,7 +55,9 @@ extern "C" {
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <deque>
+#include <functional>
 #include <iomanip>
 #include <memory>
 #include <queue>
@@ -65,6 +73,7 @@ struct Frame
 {
     std::shared_ptr<AVFrame> video;
     std::shared_ptr<AVFrame> audio;
+    core::const_frame        decoded;
     core::draw_frame         frame;
     int64_t                  start_time  = AV_NOPTS_VALUE;
     int64_t                  pts         = AV_NOPTS_VALUE;
@@ -75,27 +84,42 @@ struct Frame
 // TODO (fix) Handle ts discontinuities.
 // TODO (feat) Forward options.
 
-core::color_space get_color_space(const std::shared_ptr<AVFrame>& video)
+// Decoder threads are granted from a budget shared by all producers, so that many clips playing at once do not each
+// start a thread per core. Every decoder gets at least one, and returns its threads when released.
+std::shared_ptr<int> acquire_decode_threads(int wanted)
 {
-    auto result = core::color_space::bt709;
-    if (video) {
-        switch (video->colorspace) {
-            case AVColorSpace::AVCOL_SPC_BT2020_NCL:
-                result = core::color_space::bt2020;
-                break;
-            case AVColorSpace::AVCOL_SPC_BT470BG:
-            case AVColorSpace::AVCOL_SPC_SMPTE170M:
-            case AVColorSpace::AVCOL_SPC_SMPTE240M:
-                result = core::color_space::bt601;
-                break;
-            default:
-                break;
-        }
-    }
-
-    return result;
+    static const int budget = std::max(1,
+                                       env::properties().get(L"configuration.ffmpeg.producer.thread-budget",
+                                                             static_cast<int>(std::thread::hardware_concurrency())));
+
+    static boost::mutex mutex;
+    static int          used = 0;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+
+    const auto granted = std::clamp(budget - used, 1, std::max(wanted, 1));
+    used += granted;
+    return std::shared_ptr<int>(new int(granted), [](int* threads) {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        used -= *threads;
+        delete threads;
+    });
 }
 
+// How the decoders of a filter graph are set up
+struct DecoderOptions
+{
+    std::string                          hwaccel     = "none";
+    std::string                          thread_type = "auto"; // auto, frame, slice or none
+    int                                  threads     = 0;      // Per decoder, 0 picks from the picture size
+    bool                                 low_latency = false;  // Leaves out frame threading, which delays output
+    std::function<void()>                notify;
+    std::shared_ptr<core::frame_factory> frame_factory; // Video is decoded straight into its frames when set
+    const void*                          tag = nullptr;
+    std::shared_ptr<std::atomic<bool>>   hidden; // Video skips the frames no others refer to while set
+    std::shared_ptr<std::atomic<int>>    behind; // Ticks the channel is behind by, video decodes more cheaply then
+};
+
 class Decoder
 {
     Decoder(const Decoder&)            = delete;
@@ -115,15 +139,111 @@ class Decoder
     boost::condition_variable            output_cond;
     int                                  output_capacity = 8;
 
+    std::shared_ptr<AVBufferRef> hw_device;
+    SwsContext*                  sws = nullptr;
+    FrameAllocator               allocator;
+    std::shared_ptr<int>         threads; // Granted from the budget of all decoders
+
+    std::function<void()>              notify; // Called when a packet is taken or a frame is ready
+    std::shared_ptr<std::atomic<bool>> hidden;
+    std::shared_ptr<std::atomic<int>>  behind;
+
     boost::thread thread;
 
+    // Downloads a frame decoded on the device, in the software format the filter graph was set up with
+    std::shared_ptr<AVFrame> download(const std::shared_ptr<AVFrame>& src)
+    {
+        auto frame = alloc_frame();
+        FF(av_hwframe_transfer_data(frame.get(), src.get(), 0));
+        FF(av_frame_copy_props(frame.get(), src.get()));
+
+        if (frame->format == format) {
+            return frame;
+        }
+
+        // Devices download 4:2:0 as semi-planar NV12 or P010, which the filter graph does not expect
+        auto result    = alloc_frame();
+        result->format = format;
+        result->width  = frame->width;
+        result->height = frame->height;
+        FF(av_frame_get_buffer(result.get(), 0));
+        FF(av_frame_copy_props(result.get(), src.get()));
+
+        sws = sws_getCachedContext(sws,
+                                   frame->width,
+                                   frame->height,
+                                   static_cast<AVPixelFormat>(frame->format),
+                                   result->width,
+                                   result->height,
+                                   format,
+                                   SWS_POINT,
+                                   nullptr,
+                                   nullptr,
+                                   nullptr);
+        if (!sws) {
+            FF_RET(AVERROR(EINVAL), "sws_getCachedContext");
+        }
+        sws_scale(sws, frame->data, frame->linesize, 0, frame->height, result->data, result->linesize);
+
+        return result;
+    }
+
+    // Frame threading decodes a frame per thread, which scales best but delays the output by a frame per thread, so
+    // it is picked for large pictures. Slice threading splits the frames, and only helps where the codec has slices.
+    void open_threads(const AVCodec* codec, const DecoderOptions& options)
+    {
+        const auto frame_threads = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0 && !options.low_latency;
+        const auto slice_threads = (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) != 0;
+        const auto pixels        = static_cast<int64_t>(ctx->width) * ctx->height;
+
+        auto wanted = options.threads;
+        if (wanted <= 0) {
+            // One thread per quarter of an HD picture, and audio is not worth threading
+            const auto cores   = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+            const auto quarter = static_cast<int64_t>(960) * 540;
+            wanted             = ctx->codec_type == AVMEDIA_TYPE_VIDEO
+                                     ? std::clamp(static_cast<int>((pixels + quarter - 1) / quarter), 1, cores)
+                                     : 1;
+        }
+
+        auto type = 0;
+        if (options.thread_type == "frame") {
+            type = frame_threads ? FF_THREAD_FRAME : slice_threads ? FF_THREAD_SLICE : 0;
+        } else if (options.thread_type == "slice") {
+            type = slice_threads ? FF_THREAD_SLICE : frame_threads ? FF_THREAD_FRAME : 0;
+        } else if (options.thread_type != "none" && frame_threads && (pixels >= 1920 * 1080 || !slice_threads)) {
+            type = FF_THREAD_FRAME;
+        } else if (options.thread_type != "none" && slice_threads) {
+            type = FF_THREAD_SLICE;
+        }
+        if (type == 0) {
+            wanted = 1;
+        }
+
+        threads           = acquire_decode_threads(wanted);
+        ctx->thread_count = *threads;
+        ctx->thread_type  = type;
+
+        if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+            CASPAR_LOG(debug) << "[ffmpeg] decoding " << codec->name << " with " << *threads << " "
+                              << (type == FF_THREAD_FRAME ? "frame" : type == FF_THREAD_SLICE ? "slice" : "single")
+                              << " threads";
+        }
+    }
+
   public:
     std::shared_ptr<AVCodecContext> ctx;
 
+    // The software format decoded video is handed on in
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+
     Decoder() = default;
 
-    explicit Decoder(AVStream* stream)
+    explicit Decoder(AVStream* stream, const DecoderOptions& options = {})
         : st(stream)
+        , notify(options.notify)
+        , hidden(options.hidden)
+        , behind(options.behind)
     {
         const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
         if (!codec) {
@@ -139,14 +259,25 @@ class Decoder
 
         FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
 
-        int thread_count = env::properties().get(L"configuration.ffmpeg.producer.threads", 0);
-        FF(av_opt_set_int(ctx.get(), "threads", thread_count, 0));
-
         ctx->pkt_timebase = stream->time_base;
 
         if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
             ctx->framerate           = av_guess_frame_rate(nullptr, stream, nullptr);
             ctx->sample_aspect_ratio = av_guess_sample_aspect_ratio(nullptr, stream, nullptr);
+            format                   = ctx->pix_fmt;
+
+            if (!options.hwaccel.empty() && options.hwaccel != "none") {
+                hw_device = open_hw_decoder(ctx.get(), codec, options.hwaccel);
+            }
+
+            // Hardware frames are downloaded into buffers of their own, so only software decoding writes straight
+            // into the upload buffers of the mixer
+            if (!hw_device && options.frame_factory && (codec->capabilities & AV_CODEC_CAP_DR1)) {
+                allocator.tag           = options.tag;
+                allocator.frame_factory = options.frame_factory;
+                ctx->opaque             = &allocator;
+                ctx->get_buffer2        = get_frame_buffer;
+            }
         } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
 #if !(FFMPEG_NEW_CHANNEL_LAYOUT)
             if (!ctx->channel_layout && ctx->channels) {
@@ -158,15 +289,17 @@ class Decoder
 #endif
         }
 
-        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
-            ctx->thread_type = FF_THREAD_SLICE;
-        }
+        open_threads(codec, options);
 
         FF(avcodec_open2(ctx.get(), codec, nullptr));
 
-        thread = boost::thread([=]() {
+        // The CPU time of decoding is charged to the layer the producer was created for
+        thread = boost::thread([=, context = core::diagnostics::call_context::for_thread()]() {
+            core::diagnostics::call_context::for_thread() = context;
             try {
                 while (!thread.interruption_requested()) {
+                    core::diagnostics::charge_thread_cpu_time();
+
                     auto av_frame = alloc_frame();
                     auto ret      = avcodec_receive_frame(ctx.get(), av_frame.get());
 
@@ -178,6 +311,19 @@ class Decoder
                             packet = std::move(input.front());
                             input.pop();
                         }
+                        if (notify) {
+                            notify();
+                        }
+                        // The filters repeat the frames before those skipped, so playback keeps its time. Behind the
+                        // channel, frames no others refer to are decoded without the loop filter, then skipped as when
+                        // hidden, and far behind it the loop filter is left out of all frames until it catches up.
+                        if (hidden && ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                            const auto lag        = behind ? behind->load() : 0;
+                            ctx->skip_frame       = *hidden || lag >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+                            ctx->skip_loop_filter = lag >= 4   ? AVDISCARD_ALL
+                                                    : lag >= 1 ? AVDISCARD_NONREF
+                                                               : AVDISCARD_DEFAULT;
+                        }
                         FF(avcodec_send_packet(ctx.get(), packet.get()));
                     } else if (ret == AVERROR_EOF) {
                         avcodec_flush_buffers(ctx.get());
@@ -190,9 +336,16 @@ class Decoder
                             output_cond.wait(lock, [&]() { return output.size() < output_capacity; });
                             output.push(std::move(av_frame));
                         }
+                        if (notify) {
+                            notify();
+                        }
                     } else {
                         FF_RET(ret, "avcodec_receive_frame");
 
+                        if (av_frame->hw_frames_ctx) {
+                            av_frame = download(av_frame);
+                        }
+
                         // TODO: Maybe Fixed in:
                         // https://github.com/FFmpeg/FFmpeg/commit/33203a08e0a26598cb103508327a1dc184b27bc6
                         // NOTE This is a workaround for DVCPRO HD.
@@ -246,6 +399,9 @@ class Decoder
                             output_cond.wait(lock, [&]() { return output.size() < output_capacity; });
                             output.push(std::move(av_frame));
                         }
+                        if (notify) {
+                            notify();
+                        }
                     }
                 }
             } catch (boost::thread_interrupted&) {
@@ -267,6 +423,7 @@ class Decoder
         } catch (boost::thread_interrupted&) {
             // Do nothing...
         }
+        sws_freeContext(sws);
     }
 
     bool want_packet() const
@@ -318,6 +475,53 @@ class Decoder
     }
 };
 
+// The arguments of the buffer source that a decoder feeds its frames into
+std::string buffer_args(const Decoder& decoder)
+{
+    const auto st = decoder.ctx;
+
+    if (st->codec_type == AVMEDIA_TYPE_VIDEO) {
+        auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d") % st->width % st->height %
+                     decoder.format % st->pkt_timebase.num % st->pkt_timebase.den)
+                        .str();
+
+        if (st->sample_aspect_ratio.num > 0 && st->sample_aspect_ratio.den > 0) {
+            args += (boost::format(":sar=%d/%d") % st->sample_aspect_ratio.num % st->sample_aspect_ratio.den).str();
+        }
+
+        if (st->framerate.num > 0 && st->framerate.den > 0) {
+            args += (boost::format(":frame_rate=%d/%d") % st->framerate.num % st->framerate.den).str();
+        }
+
+        return args;
+    }
+
+    if (st->codec_type == AVMEDIA_TYPE_AUDIO) {
+#if FFMPEG_NEW_CHANNEL_LAYOUT
+        char channel_layout[128];
+        FF(av_channel_layout_describe(&st->ch_layout, channel_layout, sizeof(channel_layout)));
+#else
+        const auto channel_layout = st->channel_layout;
+#endif
+
+        return (boost::format("time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=%#x") %
+                st->pkt_timebase.num % st->pkt_timebase.den % st->sample_rate % av_get_sample_fmt_name(st->sample_fmt) %
+                channel_layout)
+            .str();
+    }
+
+    return {};
+}
+
+// Which frames are deinterlaced: none, interlaced or all
+std::string auto_deinterlace()
+{
+    return u8(env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.auto-deinterlace", L"interlaced"));
+}
+
+// Whether frames are deinterlaced by the mixer rather than by the filter graph, see FieldSplitter
+bool gpu_deinterlace() { return env::properties().get(L"configuration.ffmpeg.producer.gpu-deinterlace", false); }
+
 struct Filter
 {
     std::shared_ptr<AVFilterGraph>  graph;
@@ -326,6 +530,11 @@ struct Filter
     std::shared_ptr<AVFrame>        frame;
     bool                            eof = false;
 
+    // What the graph was configured for, so that a graph prepared ahead can be checked against the decoders
+    int64_t                    start_time = AV_NOPTS_VALUE;
+    AVMediaType                media_type = AVMEDIA_TYPE_UNKNOWN;
+    std::map<int, std::string> source_args;
+
     Filter() = default;
 
     Filter(std::string                    filter_spec,
@@ -333,17 +542,20 @@ struct Filter
            std::map<int, Decoder>&        streams,
            int64_t                        start_time,
            AVMediaType                    media_type,
-           const core::video_format_desc& format_desc)
+           const core::video_format_desc& format_desc,
+           const DecoderOptions&          options)
+        : start_time(start_time)
+        , media_type(media_type)
     {
         if (media_type == AVMEDIA_TYPE_VIDEO) {
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
 
-            auto deint = u8(
-                env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.auto-deinterlace", L"interlaced"));
+            auto deint = auto_deinterlace();
 
-            if (deint != "none") {
+            // Deinterlacing on the GPU leaves the fps filter to repeat every frame for each of its fields
+            if (deint != "none" && !gpu_deinterlace()) {
                 filter_spec += (boost::format(",bwdif=mode=send_field:parity=auto:deint=%s") % deint).str();
             }
 
@@ -498,46 +710,20 @@ struct Filter
 
                 auto it = streams.find(index);
                 if (it == streams.end()) {
-                    it = streams.emplace(index, input->streams[index]).first;
+                    it = streams.emplace(index, input->streams[index], options).first;
                 }
 
-                auto st = it->second.ctx;
+                const auto st   = it->second.ctx;
+                const auto args = buffer_args(it->second);
+                const auto name = (boost::format("in_%d") % index).str();
 
                 if (st->codec_type == AVMEDIA_TYPE_VIDEO) {
-                    auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d") % st->width % st->height %
-                                 st->pix_fmt % st->pkt_timebase.num % st->pkt_timebase.den)
-                                    .str();
-                    auto name = (boost::format("in_%d") % index).str();
-
-                    if (st->sample_aspect_ratio.num > 0 && st->sample_aspect_ratio.den > 0) {
-                        args +=
-                            (boost::format(":sar=%d/%d") % st->sample_aspect_ratio.num % st->sample_aspect_ratio.den)
-                                .str();
-                    }
-
-                    if (st->framerate.num > 0 && st->framerate.den > 0) {
-                        args += (boost::format(":frame_rate=%d/%d") % st->framerate.num % st->framerate.den).str();
-                    }
-
                     AVFilterContext* source = nullptr;
                     FF(avfilter_graph_create_filter(
                         &source, avfilter_get_by_name("buffer"), name.c_str(), args.c_str(), nullptr, graph.get()));
                     FF(avfilter_link(source, 0, cur->filter_ctx, cur->pad_idx));
                     sources.emplace(index, source);
                 } else if (st->codec_type == AVMEDIA_TYPE_AUDIO) {
-#if FFMPEG_NEW_CHANNEL_LAYOUT
-                    char channel_layout[128];
-                    FF(av_channel_layout_describe(&st->ch_layout, channel_layout, sizeof(channel_layout)));
-#else
-                    const auto channel_layout = st->channel_layout;
-#endif
-
-                    auto args = (boost::format("time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=%#x") %
-                                 st->pkt_timebase.num % st->pkt_timebase.den % st->sample_rate %
-                                 av_get_sample_fmt_name(st->sample_fmt) % channel_layout)
-                                    .str();
-                    auto name = (boost::format("in_%d") % index).str();
-
                     AVFilterContext* source = nullptr;
                     FF(avfilter_graph_create_filter(
                         &source, avfilter_get_by_name("abuffer"), name.c_str(), args.c_str(), nullptr, graph.get()));
@@ -547,6 +733,7 @@ struct Filter
                     CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
                                                             << msg_info_t("invalid filter input media type"));
                 }
+                source_args.emplace(index, args);
             }
         }
 
@@ -675,6 +862,12 @@ struct AVProducer::Impl
     const std::string                          name_;
     const std::string                          path_;
 
+    // Wakes the run loop when input, decoders or controls may let it progress, so that it does not poll. Declared
+    // ahead of them, as their threads call it until destroyed
+    boost::mutex              wake_mutex_;
+    boost::condition_variable wake_cond_;
+    bool                      woken_ = false;
+
     Input                  input_;
     std::map<int, Decoder> decoders_;
     Filter                 video_filter_;
@@ -687,9 +880,20 @@ struct AVProducer::Impl
     std::atomic<int64_t> input_duration_{AV_NOPTS_VALUE};
     std::atomic<int64_t> seek_{AV_NOPTS_VALUE};
     std::atomic<bool>    loop_{false};
+    std::atomic<double>  speed_{1.0};
+    std::atomic<bool>    blend_{false};
+
+    // Whether the layer of the producer is hidden, shared with its decoders
+    std::shared_ptr<std::atomic<bool>> hidden_ = std::make_shared<std::atomic<bool>>(false);
+
+    // Ticks the channel is behind its clock by, shared with its decoders
+    std::shared_ptr<std::atomic<int>> behind_ = std::make_shared<std::atomic<int>>(0);
 
     std::string afilter_;
     std::string vfilter_;
+    std::string hwaccel_;
+    std::string thread_type_;
+    int         threads_ = 0;
 
     int                              seekable_ = 2;
     core::frame_geometry::scale_mode scale_mode_;
@@ -699,52 +903,132 @@ struct AVProducer::Impl
     int64_t                          frame_duration_ = AV_NOPTS_VALUE;
     core::draw_frame                 frame_;
 
+    const bool    gpu_deinterlace_ = gpu_deinterlace() && auto_deinterlace() != "none";
+    FieldSplitter fields_{auto_deinterlace() == "all"};
+
     std::deque<Frame>         buffer_;
     mutable boost::mutex      buffer_mutex_;
     boost::condition_variable buffer_cond_;
     std::atomic<bool>         buffer_eof_{false};
     int                       buffer_capacity_ = static_cast<int>(format_desc_.fps) / 4;
 
+    // Frames buffered after a load or seek before the first of them is handed out, at most the buffer capacity
+    const size_t preroll_ = std::clamp<size_t>(
+        env::properties().get(L"configuration.ffmpeg.producer.preroll", 4), 1, std::max(buffer_capacity_, 1));
+
     std::optional<caspar::executor> video_executor_;
     std::optional<caspar::executor> audio_executor_;
 
+    // Files without video, such as audio beds and stingers, are only filtered for audio, on the thread of the producer
+    bool audio_only_ = false;
+
+    std::shared_ptr<FrameCache> cache_;
+    bool                        cache_taken_ = false; // Frames were taken from the cache since decoding last
+
+    std::vector<Filter> spares_; // Configured ahead for the loop point
+    int64_t             spares_time_ = AV_NOPTS_VALUE;
+
+    // The first frames of the loop range, as many as a preroll. The loop hands them out again straight after the end
+    // frame, and decoding seeks to where they end, so the loop point needs neither a flush nor a preroll.
+    std::vector<Frame> loop_head_;
+    int64_t            loop_head_start_ = AV_NOPTS_VALUE; // The start of the range the frames are of
+
+    std::shared_ptr<KeyframeIndex> index_;
+    int64_t                        decoded_ = AV_NOPTS_VALUE; // The latest video frame filtered, as seeks take times
+
+    // Reverse playback decodes a segment of the clip at a time and hands out its frames last to first
+    const size_t       reverse_capacity_ = std::max<size_t>(
+        env::properties().get(L"configuration.ffmpeg.producer.reverse-frames", static_cast<int>(format_desc_.fps)), 2);
+    std::vector<Frame> reverse_;
+    int64_t            reverse_end_ = AV_NOPTS_VALUE; // Where the segment ends, nothing once the start was reached
+
+    // Playback at other speeds than 1, called with buffer_mutex_ held
+    double               speed_position_ = 0.0; // How far past the first buffered frame playback is
+    std::vector<int32_t> speed_audio_;          // Audio of the frames played, yet to be resampled
+    int                  speed_audio_channels_ = 0;
+    double               speed_audio_position_ = 0.0;
+
+    // Live inputs play a fixed delay behind the stream rather than whatever the buffers hold. Frames are dropped or
+    // repeated to keep the buffer around that delay, which takes up the drift between the sender and channel clocks.
+    const std::optional<std::chrono::milliseconds> live_;
+    const size_t                                   live_target_;       // The delay, in buffered frames
+    double                                         live_fill_   = 0.0; // The buffered frames, smoothed
+    double                                         live_jitter_ = 0.0; // Of the frame arrivals, in ms
+    int64_t                                        live_drops_      = 0;
+    int64_t                                        live_duplicates_ = 0;
+
     int latency_ = 0;
 
+    // The channel waits for each frame to be decoded rather than underflowing, as it is not paced by a clock
+    const bool offline_;
+
     boost::thread thread_;
 
-    Impl(std::shared_ptr<core::frame_factory> frame_factory,
-         core::video_format_desc              format_desc,
-         std::string                          name,
-         std::string                          path,
-         std::string                          vfilter,
-         std::string                          afilter,
-         std::optional<int64_t>               start,
-         std::optional<int64_t>               seek,
-         std::optional<int64_t>               duration,
-         bool                                 loop,
-         int                                  seekable,
-         core::frame_geometry::scale_mode     scale_mode)
+    Impl(std::shared_ptr<core::frame_factory>     frame_factory,
+         core::video_format_desc                  format_desc,
+         std::string                              name,
+         std::string                              path,
+         std::string                              vfilter,
+         std::string                              afilter,
+         std::optional<int64_t>                   start,
+         std::optional<int64_t>                   seek,
+         std::optional<int64_t>                   duration,
+         bool                                     loop,
+         int                                      seekable,
+         core::frame_geometry::scale_mode         scale_mode,
+         std::string                              hwaccel,
+         std::optional<std::chrono::milliseconds> live,
+         std::string                              thread_type,
+         int                                      threads,
+         bool                                     offline)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , format_tb_({format_desc.duration, format_desc.time_scale * format_desc.field_count})
         , name_(name)
         , path_(path)
-        , input_(path, graph_, seekable >= 0 && seekable < 2 ? std::optional<bool>(false) : std::optional<bool>())
+        , input_(path,
+                 graph_,
+                 seekable >= 0 && seekable < 2 ? std::optional<bool>(false) : std::optional<bool>(),
+                 [this] { wake(); },
+                 live.has_value())
         , start_(start ? av_rescale_q(*start, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , duration_(duration ? av_rescale_q(*duration, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , loop_(loop)
         , afilter_(afilter)
         , vfilter_(vfilter)
+        , hwaccel_(hwaccel)
+        , thread_type_(thread_type)
+        , threads_(threads)
         , seekable_(seekable)
         , scale_mode_(scale_mode)
         , video_executor_(L"video-executor")
         , audio_executor_(L"audio-executor")
+        , live_(live)
+        , live_target_(
+              live ? static_cast<size_t>(std::max(1.0, std::ceil(live->count() / (1000.0 * av_q2d(format_tb_))))) : 0)
+        , offline_(offline && !live)
     {
+        // Files played with the same settings on the same device share their decoded frames
+        if (path_.find("://") == std::string::npos && !live_) {
+            auto key = (boost::format("%s|%s|%s|%s|%d|%p") % path_ % vfilter_ % afilter_ % u8(format_desc_.name) %
+                        static_cast<int>(scale_mode_) % frame_factory_->frame_scope())
+                           .str();
+            cache_ = FrameCache::get(key, buffer_capacity_ + 2);
+
+            if (seekable_ && env::properties().get(L"configuration.ffmpeg.producer.keyframe-index", true)) {
+                index_ = KeyframeIndex::get(path_);
+            }
+        }
+
         diagnostics::register_graph(graph_);
         graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("decode-time", diagnostics::color(0.0f, 1.0f, 1.0f));
         graph_->set_color("buffer", diagnostics::color(1.0f, 1.0f, 0.0f));
+        if (live_) {
+            graph_->set_color("live-drop", diagnostics::color(0.9f, 0.3f, 0.3f));
+            graph_->set_color("live-duplicate", diagnostics::color(0.3f, 0.6f, 0.9f));
+        }
 
         state_["file/name"] = u8(name_);
         state_["file/path"] = u8(path_);
@@ -753,7 +1037,8 @@ struct AVProducer::Impl
 
         CASPAR_LOG(debug) << print() << " seekable: " << seekable_;
 
-        thread_ = boost::thread([=] {
+        thread_ = boost::thread([=, context = core::diagnostics::call_context::for_thread()] {
+            core::diagnostics::call_context::for_thread() = context;
             try {
                 run(seek);
             } catch (boost::thread_interrupted&) {
@@ -807,6 +1092,14 @@ struct AVProducer::Impl
             state_["file/streams"] = streams;
         }
 
+        // A video filter may also draw video from the audio, so only files without either are taken as audio only
+        audio_only_ = !live_ && vfilter_.empty() && !has_video();
+        if (audio_only_) {
+            video_executor_.reset();
+            audio_executor_.reset();
+            CASPAR_LOG(debug) << print() << " Audio only";
+        }
+
         if (input_duration_ == AV_NOPTS_VALUE) {
             input_duration_ = input_->duration;
         }
@@ -836,20 +1129,114 @@ struct AVProducer::Impl
         Frame frame;
         timer frame_timer;
         timer decode_timer;
+        auto  decode_start = diagnostics::trace::begin();
 
         int warning_debounce = 0;
 
+        timer live_timer;
+
+        auto push_frame = [&] {
+            graph_->set_value("decode-time", decode_timer.elapsed() * format_desc_.fps * 0.5);
+            diagnostics::trace::end("decode", decode_start);
+            decode_start = diagnostics::trace::begin();
+
+            if (live_) {
+                push_live(frame, live_timer);
+                boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+                return;
+            }
+
+            keep_loop_head(frame);
+
+            // A full buffer puts playback far enough behind to prepare for the loop
+            auto full = false;
+            {
+                boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+                full = buffer_.size() + 1 >= capacity();
+            }
+            if (full) {
+                prepare_spares();
+            }
+
+            {
+                boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
+                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < capacity(); });
+                if (seek_ == AV_NOPTS_VALUE) {
+                    buffer_.push_back(frame);
+                }
+            }
+            buffer_cond_.notify_all();
+
+            if (format_desc_.field_count != 2 || frame_count_ % 2 == 1) {
+                // Update the frame-time every other frame when interlaced
+                graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.hz * 0.5);
+                frame_timer.restart();
+            }
+
+            decode_timer.restart();
+
+            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+
+            boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+        };
+
+        // Hands out the loop head at the end of the loop range, past the capacity of the buffer rather than waiting on
+        // playback, so that the decoders are fed again at once. Returns false without a complete head.
+        auto push_loop_head = [&](int64_t start) {
+            if (speed_ < 0 || loop_head_start_ != start || loop_head_.size() < preroll_) {
+                return false;
+            }
+
+            const auto& last = loop_head_.back();
+            seek_internal(last.pts + last.duration, false);
+
+            {
+                boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+                for (auto head : loop_head_) {
+                    head.frame_count = frame_count_++;
+                    buffer_.push_back(std::move(head));
+                    boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+                }
+            }
+            buffer_cond_.notify_all();
+            return true;
+        };
+
+        // Hands out the frames of a reverse segment last to first, then starts on the segment before it
+        auto push_reverse = [&] {
+            const auto first = reverse_.empty() ? reverse_end_ - reverse_span() : reverse_.front().pts;
+            for (auto it = reverse_.rbegin(); it != reverse_.rend() && seek_ == AV_NOPTS_VALUE; ++it) {
+                frame = std::move(*it);
+                push_frame();
+            }
+            reverse_from(first, false);
+        };
+
         while (!thread_.interruption_requested()) {
+            core::diagnostics::charge_thread_cpu_time();
+
             {
                 const auto seek = seek_.exchange(AV_NOPTS_VALUE);
 
                 if (seek != AV_NOPTS_VALUE) {
-                    seek_internal(seek);
+                    if (speed_ < 0) {
+                        reverse_from(seek, true);
+                    } else {
+                        reverse_.clear();
+                        seek_internal(seek);
+                    }
                     frame = Frame{};
                     continue;
                 }
             }
 
+            if (speed_ < 0 && reverse_end_ == AV_NOPTS_VALUE) {
+                // Reverse playback reached the start, and only a seek or a change of speed or loop moves on from here
+                buffer_eof_ = true;
+                wait();
+                continue;
+            }
+
             {
                 // TODO (perf) seek as soon as input is past duration or eof.
 
@@ -863,13 +1250,46 @@ struct AVProducer::Impl
                               av_rescale_q(time, TIME_BASE_Q, format_tb_) >= av_rescale_q(end, TIME_BASE_Q, format_tb_);
 
                 if (buffer_eof_) {
-                    if (loop_ && frame_count_ > 2) {
+                    if (speed_ < 0) {
+                        buffer_eof_ = false;
+                        push_reverse();
+                    } else if (loop_ && frame_count_ > 2) {
                         frame = Frame{};
-                        seek_internal(start);
+                        if (!push_loop_head(start)) {
+                            seek_internal(start);
+                        }
                     } else {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                        // An offline channel waiting for another frame plays on without it
+                        buffer_cond_.notify_all();
+
+                        // Only a seek or a change of loop, start or duration moves on from here
+                        wait();
                     }
-                    // TODO (fix) Limit live polling due to bugs.
+                    continue;
+                }
+            }
+
+            // Another producer in lockstep with this one may have decoded the next frame already
+            if (cache_ && cache_.use_count() > 1 && speed_ >= 0 && frame.pts != AV_NOPTS_VALUE && frame.duration > 0) {
+                const auto next = frame.pts + frame.duration;
+                if (auto cached = cache_->find(next, std::chrono::microseconds(frame.duration / 2))) {
+                    frame.video       = nullptr;
+                    frame.audio       = nullptr;
+                    frame.start_time  = cached->start_time;
+                    frame.pts         = cached->pts;
+                    frame.duration    = cached->duration;
+                    frame.decoded     = cached->frame.with_tag(this);
+                    frame.frame       = core::draw_frame(frame.decoded);
+                    frame.frame_count = frame_count_++;
+                    cache_taken_      = true;
+
+                    push_frame();
+                    continue;
+                }
+
+                if (cache_taken_) {
+                    // Fell out of lockstep, so decoding picks up where the cached frames left off
+                    resync(next);
                     continue;
                 }
             }
@@ -880,11 +1300,15 @@ struct AVProducer::Impl
 
                 std::vector<std::future<bool>> futures;
 
-                if (!video_filter_.frame) {
+                if (audio_only_) {
+                    // The video filter has no graph, and only reaches its end
+                    progress |= video_filter_();
+                    progress |= audio_filter_(audio_cadence[0]);
+                } else if (!video_filter_.frame) {
                     futures.push_back(video_executor_->begin_invoke([&]() { return video_filter_(); }));
                 }
 
-                if (!audio_filter_.frame) {
+                if (!audio_only_ && !audio_filter_.frame) {
                     futures.push_back(audio_executor_->begin_invoke([&]() { return audio_filter_(audio_cadence[0]); }));
                 }
 
@@ -905,8 +1329,8 @@ struct AVProducer::Impl
                         }
                     }
 
-                    // TODO (perf): Avoid live loop.
-                    std::this_thread::sleep_for(std::chrono::milliseconds(warning_debounce > 25 ? 20 : 5));
+                    // Bounded, as filters can also wait on time rather than on input
+                    wait(std::chrono::milliseconds(warning_debounce > 25 ? 20 : 5));
                 }
                 continue;
             }
@@ -939,32 +1363,58 @@ struct AVProducer::Impl
                 frame.duration   = av_rescale_q(frame.audio->nb_samples, {1, sr}, TIME_BASE_Q);
             }
 
-            frame.frame = core::draw_frame(
-                make_frame(this, *frame_factory_, frame.video, frame.audio, get_color_space(frame.video), scale_mode_));
+            const auto        color_space = get_color_space(frame.video.get());
+            core::const_frame decoded;
+            if (gpu_deinterlace_) {
+                decoded = fields_(this, *frame_factory_, frame.video, frame.audio, color_space, scale_mode_);
+            } else {
+                decoded = core::const_frame(
+                    make_frame(this, *frame_factory_, frame.video, frame.audio, color_space, scale_mode_));
+            }
+            frame.decoded     = decoded;
+            frame.frame       = core::draw_frame(decoded);
             frame.frame_count = frame_count_++;
 
-            graph_->set_value("decode-time", decode_timer.elapsed() * format_desc_.fps * 0.5);
-
-            {
-                boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
-                if (seek_ == AV_NOPTS_VALUE) {
-                    buffer_.push_back(frame);
-                }
+            if (cache_ && cache_.use_count() > 1 && speed_ >= 0) {
+                cache_->put(CachedFrame{decoded, frame.start_time, frame.pts, frame.duration});
             }
 
-            if (format_desc_.field_count != 2 || frame_count_ % 2 == 1) {
-                // Update the frame-time every other frame when interlaced
-                graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.hz * 0.5);
-                frame_timer.restart();
+            if (speed_ < 0) {
+                // Frames are kept up to where the segment ends, and the one that reaches it hands them out
+                if (reverse_end_ != AV_NOPTS_VALUE && frame.pts < reverse_end_) {
+                    reverse_.push_back(frame);
+                    if (reverse_.size() > reverse_capacity_) {
+                        reverse_.erase(reverse_.begin());
+                    }
+                }
+                if (reverse_end_ != AV_NOPTS_VALUE && frame.pts + frame.duration >= reverse_end_) {
+                    push_reverse();
+                }
+                continue;
             }
 
-            decode_timer.restart();
+            push_frame();
+        }
+    }
 
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+    void wake()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(wake_mutex_);
+            woken_ = true;
+        }
+        wake_cond_.notify_all();
+    }
 
-            boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+    void wait(std::optional<std::chrono::milliseconds> timeout = {})
+    {
+        boost::unique_lock<boost::mutex> lock(wake_mutex_);
+        if (timeout) {
+            wake_cond_.wait_for(lock, boost::chrono::milliseconds(timeout->count()), [&] { return woken_; });
+        } else {
+            wake_cond_.wait(lock, [&] { return woken_; });
         }
+        woken_ = false;
     }
 
     void update_state()
@@ -974,6 +1424,7 @@ struct AVProducer::Impl
         state_["file/clip"] = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
         state_["file/time"] = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
         state_["loop"]      = loop_;
+        state_["speed"]     = speed_.load();
     }
 
     core::draw_frame prev_frame(const core::video_field field)
@@ -997,19 +1448,109 @@ struct AVProducer::Impl
         return core::draw_frame::still(frame_);
     }
 
+    // Reverse playback buffers a whole segment, so that it plays while the one before it is decoded. Live inputs
+    // leave room for the arrivals to jitter around the delay.
+    size_t capacity() const
+    {
+        if (live_) {
+            return std::max(live_target_ * 2, live_target_ + 2);
+        }
+        return buffer_capacity_ + (speed_ < 0 ? reverse_capacity_ : 0);
+    }
+
+    // Whether playback can start without an underflow, called with buffer_mutex_ held
+    bool prerolled() const
+    {
+        return buffer_.size() >= (live_ ? live_target_ : preroll_) || (buffer_eof_ && !buffer_.empty());
+    }
+
+    // The input runs on the sender's clock and cannot be held up, so the oldest frames make room when the buffer is
+    // full rather than the decoding waiting for it
+    void push_live(const Frame& frame, timer& arrivals)
+    {
+        const auto interval = arrivals.elapsed() * 1000.0;
+        arrivals.restart();
+
+        {
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+
+            // Decoded frames arrive in bursts when the decoders catch up, which the smoothing evens out
+            if (frame.duration > 0) {
+                live_jitter_ += (std::abs(interval - frame.duration / 1000.0) - live_jitter_) * 0.05;
+            }
+
+            if (seek_ != AV_NOPTS_VALUE) {
+                return;
+            }
+            while (!buffer_.empty() && buffer_.size() >= capacity()) {
+                buffer_.pop_front();
+                live_drops_ += 1;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "live-drop");
+            }
+            buffer_.push_back(frame);
+        }
+        buffer_cond_.notify_all();
+
+        graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(capacity()));
+    }
+
     bool is_ready()
     {
         boost::lock_guard<boost::mutex> lock(buffer_mutex_);
-        return !buffer_.empty() || frame_;
+        return prerolled() || frame_;
+    }
+
+    bool preroll(std::chrono::milliseconds timeout)
+    {
+        boost::unique_lock<boost::mutex> lock(buffer_mutex_);
+        return buffer_cond_.wait_for(lock, boost::chrono::milliseconds(timeout.count()), [&] { return prerolled(); });
     }
 
-    core::draw_frame next_frame(const core::video_field field)
+    core::draw_frame next_frame(const core::video_field field, int nb_samples)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
-        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        boost::unique_lock<boost::mutex> lock(buffer_mutex_);
 
-        if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4)) {
+        const auto speed = speed_.load();
+        if (speed == 0.0 && frame_) {
+            return core::draw_frame::still(frame_);
+        }
+
+        if (live_ && !frame_flush_) {
+            // Follows the fill over a couple of seconds, so that only drift and not jitter is corrected
+            live_fill_ += (static_cast<double>(buffer_.size()) - live_fill_) * 0.02;
+
+            if (buffer_.empty() && frame_) {
+                live_duplicates_ += 1;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "live-duplicate");
+                return core::draw_frame::still(frame_);
+            }
+            // Whole frames, so that interlaced playback stays on the right field
+            const auto frame_fields = static_cast<size_t>(format_desc_.field_count);
+            if (live_fill_ > static_cast<double>(live_target_) + 1.0 && buffer_.size() > frame_fields) {
+                buffer_.erase(buffer_.begin(), buffer_.begin() + frame_fields);
+                live_fill_ -= static_cast<double>(frame_fields);
+                live_drops_ += 1;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "live-drop");
+            } else if (live_fill_ < static_cast<double>(live_target_) - 1.0 && frame_) {
+                live_fill_ += 1.0;
+                live_duplicates_ += 1;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "live-duplicate");
+                return core::draw_frame::still(frame_);
+            }
+        } else if (live_) {
+            live_fill_ = static_cast<double>(live_target_);
+        }
+
+        if (offline_) {
+            // Bounded, so that a stalled input still ends up underflowing rather than holding the channel forever
+            buffer_cond_.wait_for(lock, boost::chrono::seconds(10), [&] {
+                return (!buffer_.empty() && (!frame_flush_ || prerolled())) || buffer_eof_;
+            });
+        }
+
+        if (buffer_.empty() || (frame_flush_ && !prerolled())) {
             auto start    = start_.load();
             auto duration = duration_.load();
 
@@ -1017,7 +1558,9 @@ struct AVProducer::Impl
             auto end = duration != AV_NOPTS_VALUE ? start + duration : INT64_MAX;
 
             if (buffer_eof_ && !frame_flush_) {
-                if (frame_time_ < end && frame_duration_ != AV_NOPTS_VALUE) {
+                if (speed < 0) {
+                    // Reverse playback holds at the start
+                } else if (frame_time_ < end && frame_duration_ != AV_NOPTS_VALUE) {
                     frame_time_ += frame_duration_;
                 } else if (frame_time_ < end) {
                     frame_time_ = input_duration_;
@@ -1029,6 +1572,13 @@ struct AVProducer::Impl
             return core::draw_frame{};
         }
 
+        if (speed != 1.0 && speed != 0.0) {
+            const auto samples = nb_samples > 0 ? nb_samples : format_desc_.audio_cadence.front();
+            return next_frame_at(std::abs(speed), samples);
+        }
+        speed_position_ = 0.0;
+        speed_audio_.clear();
+
         if (format_desc_.field_count == 2) {
             // Check if the next frame is the correct 'field'
             auto is_field_1 = (buffer_[0].frame_count % 2) == 0;
@@ -1057,15 +1607,139 @@ struct AVProducer::Impl
         return frame_;
     }
 
+    // Frames are repeated or skipped to play at speed, or blended when playback is between two of them. The audio of
+    // the frames played is resampled to the cadence, so its pitch follows the speed.
+    core::draw_frame next_frame_at(double speed, int nb_samples)
+    {
+        auto index = static_cast<size_t>(speed_position_);
+        if (index >= buffer_.size()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+            return core::draw_frame::still(frame_);
+        }
+
+        auto picture = core::draw_frame::still(buffer_[index].frame);
+        auto between = speed_position_ - static_cast<double>(index);
+        if (blend_ && between > 0.0 && index + 1 < buffer_.size()) {
+            auto next                                = core::draw_frame::still(buffer_[index + 1].frame);
+            next.transform().image_transform.opacity = between;
+            picture                                  = core::draw_frame::over(picture, next);
+        }
+
+        frame_          = buffer_[index].frame;
+        frame_time_     = buffer_[index].pts;
+        frame_duration_ = buffer_[index].duration;
+        frame_flush_    = false;
+
+        speed_position_ += speed;
+        while (speed_position_ >= 1.0 && !buffer_.empty()) {
+            add_speed_audio(buffer_.front().decoded);
+            buffer_.pop_front();
+            speed_position_ -= 1.0;
+        }
+        buffer_cond_.notify_all();
+
+        graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+
+        auto audio = speed_audio(speed, nb_samples);
+        return audio ? core::draw_frame::over(picture, std::move(audio)) : picture;
+    }
+
+    void add_speed_audio(const core::const_frame& frame)
+    {
+        if (!frame || frame.audio_data().empty()) {
+            return;
+        }
+
+        const auto channels = frame.audio_channels() > 0 ? frame.audio_channels() : format_desc_.audio_channels;
+        if (channels != speed_audio_channels_) {
+            speed_audio_.clear();
+            speed_audio_channels_ = channels;
+            speed_audio_position_ = 0.0;
+        }
+
+        auto data = frame.audio_data();
+        if (speed_ >= 0) {
+            speed_audio_.insert(speed_audio_.end(), data.begin(), data.end());
+        } else {
+            // Reversed sample by sample, with the channels of each sample kept in order
+            for (auto n = static_cast<int64_t>(data.size() / channels) - 1; n >= 0; --n) {
+                speed_audio_.insert(speed_audio_.end(), data.begin() + n * channels, data.begin() + (n + 1) * channels);
+            }
+        }
+
+        // Playback that falls behind drops its oldest audio rather than lag further
+        const auto limit = static_cast<size_t>(format_desc_.audio_sample_rate) * channels;
+        if (speed_audio_.size() > limit) {
+            speed_audio_.erase(speed_audio_.begin(), speed_audio_.end() - limit);
+        }
+    }
+
+    core::draw_frame speed_audio(double speed, int nb_samples)
+    {
+        const auto channels = speed_audio_channels_;
+        if (channels <= 0) {
+            return core::draw_frame{};
+        }
+
+        const auto           frames = speed_audio_.size() / channels;
+        std::vector<int32_t> samples(static_cast<size_t>(nb_samples) * channels, 0);
+        for (int n = 0; n < nb_samples; ++n) {
+            const auto position = speed_audio_position_ + n * speed;
+            const auto first    = static_cast<size_t>(position);
+            if (first + 1 >= frames) {
+                break;
+            }
+            const auto weight = position - static_cast<double>(first);
+            for (int ch = 0; ch < channels; ++ch) {
+                const auto a               = static_cast<double>(speed_audio_[first * channels + ch]);
+                const auto b               = static_cast<double>(speed_audio_[(first + 1) * channels + ch]);
+                samples[n * channels + ch] = static_cast<int32_t>(a + (b - a) * weight);
+            }
+        }
+
+        speed_audio_position_ += nb_samples * speed;
+        const auto consumed = std::min(static_cast<size_t>(speed_audio_position_), frames);
+        speed_audio_.erase(speed_audio_.begin(), speed_audio_.begin() + consumed * channels);
+        speed_audio_position_ = std::max(0.0, speed_audio_position_ - static_cast<double>(consumed));
+
+        core::pixel_format_desc desc(core::pixel_format::invalid);
+        auto                    audio = frame_factory_->create_frame(this, desc);
+        audio.audio_data()            = std::move(samples);
+        audio.audio_channels()        = channels;
+        return core::draw_frame(std::move(audio));
+    }
+
+    void speed(double speed, bool blend)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        blend_ = blend;
+
+        // Decoding turns around where playback is
+        const auto previous = speed_.exchange(speed);
+        if ((previous < 0) != (speed < 0)) {
+            seek(time());
+        }
+    }
+
+    double speed() const { return speed_; }
+
+    void visible(bool visible) { *hidden_ = !visible; }
+
+    void behind(int ticks) { *behind_ = ticks; }
+
     void seek(int64_t time)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
         seek_ = av_rescale_q(time, format_tb_, TIME_BASE_Q);
+        wake();
 
         {
             boost::lock_guard<boost::mutex> lock(buffer_mutex_);
             buffer_.clear();
+            speed_position_ = 0.0;
+            speed_audio_.clear();
             buffer_cond_.notify_all();
             graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
         }
@@ -1086,6 +1760,7 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         loop_ = loop;
+        wake();
     }
 
     bool loop() const { return loop_; }
@@ -1094,6 +1769,7 @@ struct AVProducer::Impl
     {
         CASPAR_SCOPE_EXIT { update_state(); };
         start_ = av_rescale_q(start, format_tb_, TIME_BASE_Q);
+        wake();
     }
 
     std::optional<int64_t> start() const
@@ -1107,6 +1783,7 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         duration_ = av_rescale_q(duration, format_tb_, TIME_BASE_Q);
+        wake();
     }
 
     std::optional<int64_t> duration() const
@@ -1186,6 +1863,10 @@ struct AVProducer::Impl
                 result = true;
             }
 
+            if (frame->data[0] && frame->pts != AV_NOPTS_VALUE && it->second.ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                decoded_ = std::max(decoded_, av_rescale_q(frame->pts, it->second.ctx->pkt_timebase, TIME_BASE_Q));
+            }
+
             // End Of File
             if (!frame->data[0]) {
                 eof.push_back(p.first);
@@ -1199,28 +1880,197 @@ struct AVProducer::Impl
         return result;
     }
 
-    void seek_internal(int64_t time)
+    void seek_internal(int64_t time, bool flush = true)
     {
         time = time != AV_NOPTS_VALUE ? time : 0;
         time = time + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
 
-        // TODO (fix) Dont seek if time is close future.
+        // A later time before the next keyframe is reached sooner by decoding on than by seeking back to the keyframe
+        // before it, and otherwise the seek goes straight to that keyframe
+        const auto keyframe = index_ ? index_->find(time) : std::nullopt;
+        const auto forward  = keyframe && decoded_ != AV_NOPTS_VALUE && *keyframe <= decoded_ && time > decoded_ &&
+                             !input_.eof();
+
+        if (!forward) {
+            if (seekable_) {
+                input_.seek(keyframe.value_or(time));
+            }
+            decoders_.clear();
+            decoded_ = AV_NOPTS_VALUE;
+        }
+        if (flush) {
+            frame_flush_ = true;
+            frame_count_ = 0;
+        }
+        buffer_eof_  = false;
+        cache_taken_ = false;
+
+        reset(time);
+    }
+
+    // The length of a reverse segment
+    int64_t reverse_span() const
+    {
+        return av_rescale_q(static_cast<int64_t>(reverse_capacity_), format_tb_, TIME_BASE_Q);
+    }
+
+    // Starts decoding the reverse segment that ends at time, or stops at the start of the clip unless looping
+    void reverse_from(int64_t time, bool flush)
+    {
+        auto start    = start_.load();
+        auto duration = duration_.load();
+
+        start    = start != AV_NOPTS_VALUE ? start : 0;
+        auto end = duration != AV_NOPTS_VALUE ? start + duration : input_duration_.load();
+
+        reverse_.clear();
+
+        if (time <= start && loop_) {
+            time = end;
+        }
+        if (end != AV_NOPTS_VALUE) {
+            time = std::min(time, end);
+        }
+        if (time == AV_NOPTS_VALUE || time <= start) {
+            reverse_end_ = AV_NOPTS_VALUE;
+            return;
+        }
+
+        reverse_end_ = time;
+        seek_internal(std::max(start, time - reverse_span()), flush);
+    }
+
+    // Restarts decoding at time, without the flush of a seek, after frames up to it were taken from the cache
+    void resync(int64_t time)
+    {
+        time         = time + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+        cache_taken_ = false;
+
         if (seekable_) {
             input_.seek(time);
         }
-        frame_flush_ = true;
-        frame_count_ = 0;
-        buffer_eof_  = false;
 
         decoders_.clear();
+        decoded_ = AV_NOPTS_VALUE;
 
         reset(time);
     }
 
+    DecoderOptions decoder_options()
+    {
+        DecoderOptions options;
+        options.hwaccel       = hwaccel_;
+        options.thread_type   = thread_type_;
+        options.threads       = threads_;
+        options.low_latency   = live_.has_value();
+        options.notify        = [this] { wake(); };
+        options.frame_factory = frame_factory_;
+        options.tag           = this;
+        options.hidden        = hidden_;
+        options.behind        = behind_;
+        return options;
+    }
+
+    // Keeps the frames handed out from the start of the loop range, up to a preroll of them in a row
+    void keep_loop_head(const Frame& frame)
+    {
+        if (!loop_ || speed_ < 0 || frame.pts == AV_NOPTS_VALUE) {
+            return;
+        }
+
+        auto start = start_.load();
+        start      = start != AV_NOPTS_VALUE ? start : 0;
+        if (loop_head_start_ != start) {
+            loop_head_.clear();
+            loop_head_start_ = start;
+        }
+        if (loop_head_.size() >= preroll_) {
+            return;
+        }
+
+        const auto expected = loop_head_.empty() ? start : loop_head_.back().pts + loop_head_.back().duration;
+        if (std::abs(frame.pts - expected) <= frame.duration / 2) {
+            loop_head_.push_back(frame);
+        } else {
+            loop_head_.clear();
+        }
+    }
+
+    // Where decoding starts again at the loop point, in input time
+    int64_t loop_resume_time() const
+    {
+        auto start = start_.load();
+        start      = start != AV_NOPTS_VALUE ? start : 0;
+        if (loop_head_start_ == start && loop_head_.size() >= preroll_) {
+            start = loop_head_.back().pts + loop_head_.back().duration;
+        }
+        return start + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+    }
+
+    // Filters for the loop point are configured ahead while the buffer is full, which the loop then only has to check
+    // against its new decoders instead of building them. libavfilter has no way to rewind a graph that was drained or
+    // saw frames, so each graph is only ever used once.
+    void prepare_spares()
+    {
+        if (!loop_ || speed_ < 0) {
+            return;
+        }
+
+        const auto start = loop_resume_time();
+        if (start == spares_time_) {
+            return;
+        }
+
+        spares_.clear();
+        spares_time_ = start;
+
+        try {
+            const auto options = decoder_options();
+            if (!audio_only_) {
+                spares_.emplace_back(vfilter_, input_, decoders_, start, AVMEDIA_TYPE_VIDEO, format_desc_, options);
+            }
+            spares_.emplace_back(afilter_, input_, decoders_, start, AVMEDIA_TYPE_AUDIO, format_desc_, options);
+        } catch (...) {
+            // The loop builds its own filters and reports what went wrong then
+            spares_.clear();
+        }
+    }
+
+    Filter
+    make_filter(const std::string& spec, int64_t start_time, AVMediaType media_type, const DecoderOptions& options)
+    {
+        auto it = std::find_if(spares_.begin(), spares_.end(), [&](const Filter& filter) {
+            return filter.start_time == start_time && filter.media_type == media_type;
+        });
+        if (it != spares_.end()) {
+            auto filter = std::move(*it);
+            spares_.erase(it);
+
+            // The decoders of the loop are new, but read the same streams, so they normally have the same parameters
+            auto same = true;
+            for (auto& p : filter.source_args) {
+                auto decoder = decoders_.find(p.first);
+                if (decoder == decoders_.end()) {
+                    decoder = decoders_.emplace(p.first, input_->streams[p.first], options).first;
+                }
+                same = same && buffer_args(decoder->second) == p.second;
+            }
+            if (same) {
+                return filter;
+            }
+        }
+        return Filter(spec, input_, decoders_, start_time, media_type, format_desc_, options);
+    }
+
     void reset(int64_t start_time)
     {
-        video_filter_ = Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_);
-        audio_filter_ = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+        const auto options = decoder_options();
+
+        video_filter_ = audio_only_ ? Filter() : make_filter(vfilter_, start_time, AVMEDIA_TYPE_VIDEO, options);
+        audio_filter_ = make_filter(afilter_, start_time, AVMEDIA_TYPE_AUDIO, options);
+        if (spares_.empty()) {
+            spares_time_ = AV_NOPTS_VALUE;
+        }
 
         sources_.clear();
         for (auto& p : video_filter_.sources) {
@@ -1243,6 +2093,20 @@ struct AVProducer::Impl
         }
     }
 
+    // Whether any of the streams a video filter would read from is video, which leaves out attached pictures
+    bool has_video() const
+    {
+        for (auto n = 0U; n < input_->nb_streams; ++n) {
+            const auto st          = input_->streams[n];
+            const auto disposition = st->disposition;
+            if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+                (!disposition || disposition == AV_DISPOSITION_DEFAULT)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     std::string print() const
     {
         const int          position = std::max(static_cast<int>(time() - start().value_or(0)), 0);
@@ -1254,18 +2118,23 @@ struct AVProducer::Impl
     }
 };
 
-AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
-                       core::video_format_desc              format_desc,
-                       std::string                          name,
-                       std::string                          path,
-                       std::optional<std::string>           vfilter,
-                       std::optional<std::string>           afilter,
-                       std::optional<int64_t>               start,
-                       std::optional<int64_t>               seek,
-                       std::optional<int64_t>               duration,
-                       std::optional<bool>                  loop,
-                       int                                  seekable,
-                       core::frame_geometry::scale_mode     scale_mode)
+AVProducer::AVProducer(std::shared_ptr<core::frame_factory>     frame_factory,
+                       core::video_format_desc                  format_desc,
+                       std::string                              name,
+                       std::string                              path,
+                       std::optional<std::string>               vfilter,
+                       std::optional<std::string>               afilter,
+                       std::optional<int64_t>                   start,
+                       std::optional<int64_t>                   seek,
+                       std::optional<int64_t>                   duration,
+                       std::optional<bool>                      loop,
+                       int                                      seekable,
+                       core::frame_geometry::scale_mode         scale_mode,
+                       std::string                              hwaccel,
+                       std::optional<std::chrono::milliseconds> live,
+                       std::string                              thread_type,
+                       int                                      threads,
+                       bool                                     offline)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -1277,16 +2146,26 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(duration),
                      std::move(loop.value_or(false)),
                      seekable,
-                     scale_mode))
+                     scale_mode,
+                     std::move(hwaccel),
+                     live,
+                     std::move(thread_type),
+                     threads,
+                     offline))
 {
 }
 
-core::draw_frame AVProducer::next_frame(const core::video_field field) { return impl_->next_frame(field); }
+core::draw_frame AVProducer::next_frame(const core::video_field field, int nb_samples)
+{
+    return impl_->next_frame(field, nb_samples);
+}
 
 core::draw_frame AVProducer::prev_frame(const core::video_field field) { return impl_->prev_frame(field); }
 
 bool AVProducer::is_ready() { return impl_->is_ready(); }
 
+bool AVProducer::preroll(std::chrono::milliseconds timeout) { return impl_->preroll(timeout); }
+
 AVProducer& AVProducer::seek(int64_t time)
 {
     impl_->seek(time);
@@ -1301,6 +2180,26 @@ AVProducer& AVProducer::loop(bool loop)
 
 bool AVProducer::loop() const { return impl_->loop(); }
 
+AVProducer& AVProducer::speed(double speed, bool blend)
+{
+    impl_->speed(speed, blend);
+    return *this;
+}
+
+double AVProducer::speed() const { return impl_->speed(); }
+
+AVProducer& AVProducer::visible(bool visible)
+{
+    impl_->visible(visible);
+    return *this;
+}
+
+AVProducer& AVProducer::behind(int ticks)
+{
+    impl_->behind(ticks);
+    return *this;
+}
+
 AVProducer& AVProducer::start(int64_t start)
 {
     impl_->start(start);
@@ -1321,8 +2220,24 @@ int64_t AVProducer::duration() const { return impl_->duration().value_or(std::nu
 
 core::monitor::state AVProducer::state() const
 {
-    boost::lock_guard<boost::mutex> lock(impl_->state_mutex_);
-    return impl_->state_;
+    core::monitor::state state;
+    {
+        boost::lock_guard<boost::mutex> lock(impl_->state_mutex_);
+        state = impl_->state_;
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(impl_->buffer_mutex_);
+        state["preroll/frames"] = static_cast<int>(impl_->buffer_.size());
+        state["preroll/ready"]  = impl_->prerolled();
+        if (impl_->live_) {
+            state["live/target"]     = static_cast<int>(impl_->live_->count());
+            state["live/latency"]    = impl_->live_fill_ * av_q2d(impl_->format_tb_) * 1000.0;
+            state["live/jitter"]     = impl_->live_jitter_;
+            state["live/drops"]      = impl_->live_drops_;
+            state["live/duplicates"] = impl_->live_duplicates_;
+        }
+    }
+    return state;
 }
 
 }} // namespace caspar::ffmpeg
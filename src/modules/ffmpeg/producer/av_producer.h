@@ -6,6 +6,7 @@
 #include <core/monitor/monitor.h>
 #include <core/video_format.h>
 
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <string>
@@ -15,29 +16,49 @@ namespace caspar { namespace ffmpeg {
 class AVProducer
 {
   public:
-    AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
-               core::video_format_desc              format_desc,
-               std::string                          name,
-               std::string                          path,
-               std::optional<std::string>           vfilter,
-               std::optional<std::string>           afilter,
-               std::optional<int64_t>               start,
-               std::optional<int64_t>               seek,
-               std::optional<int64_t>               duration,
-               std::optional<bool>                  loop,
-               int                                  seekable,
-               core::frame_geometry::scale_mode     scale_mode);
+    AVProducer(std::shared_ptr<core::frame_factory>     frame_factory,
+               core::video_format_desc                  format_desc,
+               std::string                              name,
+               std::string                              path,
+               std::optional<std::string>               vfilter,
+               std::optional<std::string>               afilter,
+               std::optional<int64_t>                   start,
+               std::optional<int64_t>                   seek,
+               std::optional<int64_t>                   duration,
+               std::optional<bool>                      loop,
+               int                                      seekable,
+               core::frame_geometry::scale_mode         scale_mode,
+               std::string                              hwaccel     = "none",
+               std::optional<std::chrono::milliseconds> live        = {},
+               std::string                              thread_type = "auto",
+               int                                      threads     = 0,
+               bool                                     offline     = false);
 
     core::draw_frame prev_frame(const core::video_field field);
-    core::draw_frame next_frame(const core::video_field field);
+    // nb_samples is the audio cadence of the frame, which playback at other speeds than 1 resamples to
+    core::draw_frame next_frame(const core::video_field field, int nb_samples = -1);
     bool             is_ready();
 
+    // Waits up to timeout for the frames to start playback on to be decoded, returns whether they are
+    bool preroll(std::chrono::milliseconds timeout);
+
     AVProducer& seek(int64_t time);
     int64_t     time() const;
 
     AVProducer& loop(bool loop);
     bool        loop() const;
 
+    // Negative speeds play in reverse, and 0 holds the current frame. Frames are repeated or skipped at other speeds
+    // than 1, or blended with blend.
+    AVProducer& speed(double speed, bool blend = false);
+    double      speed() const;
+
+    // Hidden producers skip decoding the video frames that no others refer to, and repeat those before them instead
+    AVProducer& visible(bool visible);
+
+    // While the channel is behind by ticks, video is decoded more cheaply, at a lower quality or with frames skipped
+    AVProducer& behind(int ticks);
+
     AVProducer& start(int64_t start);
     int64_t     start() const;
 
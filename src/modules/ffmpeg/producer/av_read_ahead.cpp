@@ -0,0 +1,352 @@
+#include "av_read_ahead.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/memory_governor.h>
+#include <common/os/thread.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int64_t MIN_BLOCK_SIZE = 256 * 1024;
+const int64_t MAX_BLOCK_SIZE = 8 * 1024 * 1024;
+const int     IO_BUFFER_SIZE = 64 * 1024;
+
+int64_t read_ahead_size()
+{
+    static const auto size =
+        std::max(env::properties().get(L"configuration.ffmpeg.producer.read-ahead", 64), 0) * 1024LL * 1024LL;
+    return size;
+}
+
+int read_ahead_threads()
+{
+    static const auto threads = std::max(env::properties().get(L"configuration.ffmpeg.producer.read-threads", 4), 1);
+    return threads;
+}
+
+// Of the blocks of every file, which is accounted to the memory governor
+std::atomic<int64_t>& read_ahead_bytes()
+{
+    static std::atomic<int64_t> bytes{0};
+    static memory_account       account("ffmpeg-read-ahead", memory_reclaim::none, [] { return bytes.load(); });
+    return bytes;
+}
+
+} // namespace
+
+struct ReadAhead::Impl
+{
+    struct Block
+    {
+        int64_t              offset = 0;
+        std::vector<uint8_t> data;
+        bool                 ready  = false;
+        bool                 failed = false;
+
+        ~Block() { read_ahead_bytes() -= static_cast<int64_t>(data.size()); }
+    };
+
+    const boost::filesystem::path             path_;
+    const std::shared_ptr<diagnostics::graph> graph_;
+    const std::function<bool()>               interrupted_;
+    int64_t                                   size_; // Grows along with files that are still being written
+    const int64_t                             window_ = std::max(read_ahead_size(), MAX_BLOCK_SIZE);
+
+    std::mutex                                mutex_;
+    std::condition_variable                   cond_;
+    std::map<int64_t, std::shared_ptr<Block>> blocks_;         // By offset, from the one read from on
+    int64_t                                   position_   = 0; // Where the demuxer reads next
+    int64_t                                   next_       = 0; // Where the next block to be read starts
+    int64_t                                   block_size_ = MIN_BLOCK_SIZE;
+    double                                    rate_       = 0.0; // Bytes per second, smoothed
+    bool                                      abort_      = false;
+
+    int64_t stalls_ = 0;
+
+    std::vector<std::thread> threads_;
+    AVIOContext*             io_ = nullptr;
+
+    Impl(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::function<bool()> interrupted)
+        : path_(u16(filename))
+        , graph_(std::move(graph))
+        , interrupted_(std::move(interrupted))
+        , size_(static_cast<int64_t>(boost::filesystem::file_size(path_)))
+    {
+        graph_->set_color("read-ahead", diagnostics::color(0.4f, 0.6f, 0.4f));
+        graph_->set_color("read-time", diagnostics::color(0.6f, 0.6f, 0.2f));
+        graph_->set_color("read-stall", diagnostics::color(0.9f, 0.5f, 0.2f));
+
+        auto buffer = static_cast<unsigned char*>(av_malloc(IO_BUFFER_SIZE));
+        io_         = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, this, &Impl::read_packet, nullptr, &Impl::seek);
+        if (!io_) {
+            av_free(buffer);
+            throw std::bad_alloc();
+        }
+
+        for (int n = 0; n < read_ahead_threads(); ++n) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~Impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+
+        if (io_) {
+            av_freep(&io_->buffer);
+            avio_context_free(&io_);
+        }
+
+        CASPAR_LOG(debug) << L"read_ahead[" << path_.wstring() << L"] Read at " << static_cast<int64_t>(rate_ / 1e6)
+                          << L" MB/s, stalled " << stalls_ << L" times";
+    }
+
+    // Shrinks under memory pressure, down to a block ahead when over the hard limit
+    int64_t window() const
+    {
+        switch (current_memory_pressure()) {
+            case memory_pressure::soft:
+                return std::max(window_ / 4, MAX_BLOCK_SIZE);
+            case memory_pressure::hard:
+                return MAX_BLOCK_SIZE;
+            default:
+                return window_;
+        }
+    }
+
+    // Called with mutex_ held
+    bool wants_block() const { return next_ < size_ && next_ < position_ + window(); }
+
+    void run()
+    {
+        set_thread_name(L"[ffmpeg::av_producer::ReadAhead]");
+
+        // Each thread reads with a handle of its own, so that their reads are in flight at the same time
+        boost::filesystem::ifstream file(path_, std::ios::in | std::ios::binary);
+
+        while (true) {
+            auto block = std::make_shared<Block>();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_ || wants_block(); });
+                if (abort_) {
+                    return;
+                }
+                block->offset = next_;
+                block->data.resize(static_cast<size_t>(std::min(block_size_, size_ - next_)));
+                read_ahead_bytes() += static_cast<int64_t>(block->data.size());
+                next_ += static_cast<int64_t>(block->data.size());
+                blocks_.emplace(block->offset, block);
+            }
+
+            timer read_timer;
+            file.clear();
+            file.seekg(block->offset);
+            file.read(reinterpret_cast<char*>(block->data.data()), static_cast<std::streamsize>(block->data.size()));
+            const auto failed  = file.gcount() != static_cast<std::streamsize>(block->data.size());
+            const auto elapsed = std::max(read_timer.elapsed(), 0.001);
+
+            graph_->set_value("read-time", elapsed);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                block->ready  = true;
+                block->failed = failed;
+
+                // Blocks that take about a tenth of a second at the rate of the storage, so that latency is only a
+                // small part of each read
+                const auto rate = static_cast<double>(block->data.size()) / elapsed;
+                rate_           = rate_ > 0.0 ? rate_ * 0.8 + rate * 0.2 : rate;
+                block_size_     = std::clamp(static_cast<int64_t>(rate_ * 0.1), MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+            }
+            cond_.notify_all();
+        }
+    }
+
+    // Starts over at offset, unless it is within a block that is read or being read
+    std::map<int64_t, std::shared_ptr<Block>>::iterator find(int64_t offset)
+    {
+        auto it = blocks_.upper_bound(offset);
+        if (it != blocks_.begin()) {
+            --it;
+            if (offset < it->first + static_cast<int64_t>(it->second->data.size())) {
+                return it;
+            }
+        }
+
+        blocks_.clear();
+        next_ = offset;
+        cond_.notify_all();
+        return blocks_.end();
+    }
+
+    int read(uint8_t* buf, int buf_size)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (position_ >= size_) {
+            boost::system::error_code ec;
+            const auto                size = static_cast<int64_t>(boost::filesystem::file_size(path_, ec));
+            if (ec || size <= size_) {
+                return AVERROR_EOF;
+            }
+            size_ = size;
+            cond_.notify_all();
+        }
+
+        auto it = find(position_);
+        if (it == blocks_.end() || !it->second->ready) {
+            stalls_ += 1;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "read-stall");
+
+            // Polled, so that an abort of the input is not held up by slow storage
+            while (true) {
+                it = find(position_);
+                if (it != blocks_.end() && it->second->ready) {
+                    break;
+                }
+                if (interrupted_ && interrupted_()) {
+                    return AVERROR_EXIT;
+                }
+                cond_.wait_for(lock, std::chrono::milliseconds(10));
+            }
+        }
+
+        auto block = it->second;
+        if (block->failed) {
+            blocks_.erase(it);
+            return AVERROR(EIO);
+        }
+
+        const auto offset = position_ - block->offset;
+        const auto count  = static_cast<int>(
+            std::min<int64_t>(buf_size, static_cast<int64_t>(block->data.size()) - offset));
+        std::memcpy(buf, block->data.data() + offset, count);
+        position_ += count;
+
+        // Blocks read to their end are let go, which makes room for more ahead
+        while (!blocks_.empty() &&
+               blocks_.begin()->first + static_cast<int64_t>(blocks_.begin()->second->data.size()) <= position_) {
+            blocks_.erase(blocks_.begin());
+        }
+
+        int64_t buffered = 0;
+        for (auto& p : blocks_) {
+            buffered += p.second->ready ? static_cast<int64_t>(p.second->data.size()) : 0;
+        }
+        graph_->set_value("read-ahead", static_cast<double>(buffered) / static_cast<double>(window_));
+
+        lock.unlock();
+        cond_.notify_all();
+
+        return count;
+    }
+
+    int64_t seek(int64_t offset, int whence)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        switch (whence & ~AVSEEK_FORCE) {
+            case AVSEEK_SIZE:
+                return size_;
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += position_;
+                break;
+            case SEEK_END:
+                offset += size_;
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+        if (offset < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        position_ = offset;
+        find(position_);
+        return position_;
+    }
+
+    static int read_packet(void* opaque, uint8_t* buf, int buf_size)
+    {
+        return static_cast<Impl*>(opaque)->read(buf, buf_size);
+    }
+
+    static int64_t seek(void* opaque, int64_t offset, int whence)
+    {
+        return static_cast<Impl*>(opaque)->seek(offset, whence);
+    }
+};
+
+std::shared_ptr<ReadAhead> ReadAhead::open(const std::string&                  filename,
+                                           std::shared_ptr<diagnostics::graph> graph,
+                                           std::function<bool()>               interrupted)
+{
+    if (read_ahead_size() == 0) {
+        return nullptr;
+    }
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_regular_file(u16(filename), ec)) {
+        return nullptr;
+    }
+
+    try {
+        return std::make_shared<ReadAhead>(filename, std::move(graph), std::move(interrupted));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return nullptr;
+    }
+}
+
+ReadAhead::ReadAhead(const std::string&                  filename,
+                     std::shared_ptr<diagnostics::graph> graph,
+                     std::function<bool()>               interrupted)
+    : impl_(std::make_unique<Impl>(filename, std::move(graph), std::move(interrupted)))
+{
+}
+
+ReadAhead::~ReadAhead() = default;
+
+AVIOContext* ReadAhead::io_context() { return impl_->io_; }
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <common/diagnostics/graph.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Reads a file ahead of the demuxer on threads of its own, several blocks at once, so that the latency of network
+// storage is spent while earlier blocks are demuxed rather than on every read. Blocks grow with the rate the file is
+// read at, so that each read takes about a tenth of a second.
+class ReadAhead
+{
+  public:
+    // Nothing for files that are not on a file system, or when read-ahead is turned off. interrupted is polled while
+    // reads wait for a block.
+    static std::shared_ptr<ReadAhead> open(const std::string&                  filename,
+                                           std::shared_ptr<diagnostics::graph> graph,
+                                           std::function<bool()>               interrupted);
+
+    ReadAhead(const std::string&                  filename,
+              std::shared_ptr<diagnostics::graph> graph,
+              std::function<bool()>               interrupted);
+    ~ReadAhead();
+
+    ReadAhead(const ReadAhead&)            = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+
+    // An I/O context of avformat that reads from this, freed along with it. Set as pb of the format context before
+    // opening it, with AVFMT_FLAG_CUSTOM_IO.
+    AVIOContext* io_context();
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
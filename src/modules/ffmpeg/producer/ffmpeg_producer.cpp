@@ -23,6 +23,7 @@
 
 #include "ffmpeg_producer.h"
 
+#include "av_probe.h"
 #include "av_producer.h"
 
 #include <common/env.h>
@@ -35,6 +36,7 @@
 #include <core/producer/frame_producer.h>
 #include <core/video_format.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -42,6 +44,7 @@
 #include <common/filesystem.h>
 
 #include <chrono>
+#include <future>
 
 #pragma warning(push, 1)
 
@@ -66,18 +69,23 @@ struct ffmpeg_producer : public core::frame_producer
     std::shared_ptr<AVProducer> producer_;
 
   public:
-    explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory> frame_factory,
-                             core::video_format_desc              format_desc,
-                             std::wstring                         path,
-                             std::wstring                         filename,
-                             std::wstring                         vfilter,
-                             std::wstring                         afilter,
-                             std::optional<int64_t>               start,
-                             std::optional<int64_t>               seek,
-                             std::optional<int64_t>               duration,
-                             std::optional<bool>                  loop,
-                             int                                  seekable,
-                             core::frame_geometry::scale_mode     scale_mode)
+    explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory>     frame_factory,
+                             core::video_format_desc                  format_desc,
+                             std::wstring                             path,
+                             std::wstring                             filename,
+                             std::wstring                             vfilter,
+                             std::wstring                             afilter,
+                             std::optional<int64_t>                   start,
+                             std::optional<int64_t>                   seek,
+                             std::optional<int64_t>                   duration,
+                             std::optional<bool>                      loop,
+                             int                                      seekable,
+                             core::frame_geometry::scale_mode         scale_mode,
+                             std::wstring                             hwaccel,
+                             std::optional<std::chrono::milliseconds> live,
+                             std::wstring                             thread_type,
+                             int                                      threads,
+                             bool                                     offline)
         : filename_(filename)
         , frame_factory_(frame_factory)
         , format_desc_(format_desc)
@@ -92,7 +100,12 @@ struct ffmpeg_producer : public core::frame_producer
                                    duration,
                                    loop,
                                    seekable,
-                                   scale_mode))
+                                   scale_mode,
+                                   u8(hwaccel),
+                                   live,
+                                   u8(thread_type),
+                                   threads,
+                                   offline))
     {
     }
 
@@ -113,7 +126,7 @@ struct ffmpeg_producer : public core::frame_producer
 
     core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
     {
-        return producer_->next_frame(field);
+        return producer_->next_frame(field, nb_samples);
     }
 
     std::uint32_t frame_number() const override
@@ -129,6 +142,10 @@ struct ffmpeg_producer : public core::frame_producer
 
     bool is_ready() override { return producer_->is_ready(); }
 
+    void set_visible(bool visible) override { producer_->visible(visible); }
+
+    void set_budget(const core::frame_budget& budget) override { producer_->behind(budget.behind); }
+
     std::future<std::wstring> call(const std::vector<std::wstring>& params) override
     {
         std::wstring result;
@@ -145,6 +162,13 @@ struct ffmpeg_producer : public core::frame_producer
             }
 
             result = std::to_wstring(producer_->loop());
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                auto blend = params.size() > 2 && boost::iequals(params.at(2), L"blend");
+                producer_->speed(boost::lexical_cast<double>(value), blend);
+            }
+
+            result = std::to_wstring(producer_->speed());
         } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
             if (!value.empty()) {
                 producer_->start(boost::lexical_cast<int64_t>(value));
@@ -184,6 +208,15 @@ struct ffmpeg_producer : public core::frame_producer
             producer_->seek(seek);
 
             result = std::to_wstring(seek);
+        } else if (boost::iequals(cmd, L"preload")) {
+            if (!value.empty()) {
+                producer_->seek(boost::lexical_cast<int64_t>(value));
+            }
+
+            // Replies once the frames to start on are decoded, so that PLAY shows the first of them on the next tick
+            return std::async(std::launch::async, [producer = producer_] {
+                return std::to_wstring(producer->preroll(std::chrono::seconds(10)));
+            });
         } else {
             CASPAR_THROW_EXCEPTION(invalid_argument());
         }
@@ -284,7 +317,14 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto path = name;
 
     if (!boost::contains(path, L"://")) {
-        auto fullMediaPath = find_file_within_dir_or_absolute(env::media_folder(), path, is_valid_file);
+        // Clips the media cache has seen are found without searching their folder
+        std::optional<boost::filesystem::path> fullMediaPath;
+        if (auto cache = MediaCache::get()) {
+            fullMediaPath = cache->find(path, is_valid_file);
+        }
+        if (!fullMediaPath) {
+            fullMediaPath = find_file_within_dir_or_absolute(env::media_folder(), path, is_valid_file);
+        }
         if (fullMediaPath) {
             path = fullMediaPath->wstring();
         } else {
@@ -343,6 +383,26 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto vfilter = get_param(L"VF", params, filter_str);
     auto afilter = get_param(L"AF", params, get_param(L"FILTER", params, L""));
 
+    // none, auto or an ffmpeg device type such as vaapi, cuda, qsv, d3d11va or videotoolbox
+    auto hwaccel = boost::to_lower_copy(get_param(
+        L"HWACCEL", params, env::properties().get(L"configuration.ffmpeg.producer.hwaccel", std::wstring(L"none"))));
+
+    // Network feeds played a fixed delay behind the sender, in milliseconds
+    std::optional<std::chrono::milliseconds> live;
+    if (contains_param(L"LIVE", params)) {
+        live = std::chrono::milliseconds(std::max(
+            get_param(L"LATENCY", params, env::properties().get(L"configuration.ffmpeg.producer.live-latency", 100)),
+            1));
+    }
+
+    // auto, frame, slice or none, and the threads of each decoder, 0 picking them from the picture size
+    auto thread_type = boost::to_lower_copy(
+        get_param(L"THREAD_TYPE",
+                  params,
+                  env::properties().get(L"configuration.ffmpeg.producer.thread-type", std::wstring(L"auto"))));
+    auto threads =
+        get_param(L"THREADS", params, env::properties().get(L"configuration.ffmpeg.producer.threads", 0));
+
     try {
         return spl::make_shared<ffmpeg_producer>(dependencies.frame_factory,
                                                  dependencies.format_desc,
@@ -355,7 +415,12 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
                                                  duration,
                                                  loop,
                                                  seekable,
-                                                 scale_mode);
+                                                 scale_mode,
+                                                 hwaccel,
+                                                 live,
+                                                 thread_type,
+                                                 threads,
+                                                 dependencies.offline);
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
     }
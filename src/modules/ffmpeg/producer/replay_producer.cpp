@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "replay_producer.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+#include "../util/replay_buffer.h"
+
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <mutex>
+
+namespace caspar { namespace ffmpeg {
+
+struct replay_producer : public core::frame_producer
+{
+    const std::wstring                   name_;
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::shared_ptr<ReplayBuffer>  buffer_;
+
+    std::shared_ptr<AVCodecContext> dec_;
+
+    mutable std::mutex mutex_;
+    double             position_; // The frame to show next, in between frames while not played at speed 1
+    double             speed_;
+    int64_t            number_ = -1; // Of frame_
+    core::draw_frame   frame_;
+
+  public:
+    replay_producer(spl::shared_ptr<core::frame_factory> frame_factory,
+                    std::wstring                         name,
+                    std::shared_ptr<ReplayBuffer>        buffer,
+                    int64_t                              position,
+                    double                               speed)
+        : name_(std::move(name))
+        , frame_factory_(std::move(frame_factory))
+        , buffer_(std::move(buffer))
+        , position_(static_cast<double>(position))
+        , speed_(speed)
+    {
+        const auto& codecpar = buffer_->codecpar();
+
+        const auto codec = avcodec_find_decoder(codecpar.codec_id);
+        if (!codec) {
+            FF_RET(AVERROR_DECODER_NOT_FOUND, "avcodec_find_decoder");
+        }
+
+        dec_ = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+        if (!dec_) {
+            FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+        }
+
+        FF(avcodec_parameters_to_context(dec_.get(), &codecpar));
+
+        // Frames are decoded as they are shown, so they must come out of the decoder as they go in
+        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
+            dec_->thread_type = FF_THREAD_SLICE;
+        } else {
+            dec_->thread_count = 1;
+        }
+
+        FF(avcodec_open2(dec_.get(), codec, nullptr));
+    }
+
+    std::shared_ptr<AVFrame> decode(const ReplayBuffer::Frame& replay)
+    {
+        FF(avcodec_send_packet(dec_.get(), replay.video.get()));
+
+        auto video = alloc_frame();
+        auto ret   = avcodec_receive_frame(dec_.get(), video.get());
+        if (ret == AVERROR(EAGAIN)) {
+            return nullptr;
+        }
+        FF_RET(ret, "avcodec_receive_frame");
+        return video;
+    }
+
+    std::shared_ptr<AVFrame> make_audio(const ReplayBuffer::Frame& replay) const
+    {
+        const auto& format_desc = buffer_->format_desc();
+        if (replay.audio.empty()) {
+            return nullptr;
+        }
+
+        auto audio = alloc_frame();
+#if FFMPEG_NEW_CHANNEL_LAYOUT
+        av_channel_layout_default(&audio->ch_layout, format_desc.audio_channels);
+#else
+        audio->channels       = format_desc.audio_channels;
+        audio->channel_layout = av_get_default_channel_layout(audio->channels);
+#endif
+        audio->sample_rate = format_desc.audio_sample_rate;
+        audio->format      = AV_SAMPLE_FMT_S32;
+        audio->nb_samples  = static_cast<int>(replay.audio.size() / format_desc.audio_channels);
+        FF(av_frame_get_buffer(audio.get(), 32));
+        std::memcpy(audio->data[0], replay.audio.data(), replay.audio.size() * sizeof(int32_t));
+        return audio;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto first = buffer_->first();
+        const auto last  = buffer_->last();
+        if (last < first) {
+            return core::draw_frame{};
+        }
+
+        // Frames played past have been dropped, and the ones ahead of the live edge are yet to be recorded
+        position_         = std::clamp(position_, static_cast<double>(first), static_cast<double>(last) + 1.0);
+        const auto number = std::min(static_cast<int64_t>(std::floor(position_)), last);
+        position_         = std::clamp(position_ + speed_, static_cast<double>(first), static_cast<double>(last) + 1.0);
+
+        if (number == number_ && frame_) {
+            return core::draw_frame::still(frame_);
+        }
+
+        const auto replay = buffer_->get(number);
+        if (!replay) {
+            return core::draw_frame::still(frame_);
+        }
+
+        auto video = decode(*replay);
+        if (!video) {
+            return core::draw_frame::still(frame_);
+        }
+
+        // Audio is only played along at speed, anything else would be heard in bits
+        const auto audio = speed_ == 1.0 && (number_ < 0 || number == number_ + 1) ? make_audio(*replay) : nullptr;
+
+        frame_  = core::draw_frame(make_frame(this, *frame_factory_, std::move(video), audio));
+        number_ = number;
+        return frame_;
+    }
+
+    core::draw_frame last_frame(const core::video_field field) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(frame_);
+    }
+
+    bool is_ready() override { return buffer_->last() >= buffer_->first(); }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::wstring cmd = params.at(0);
+        std::wstring value;
+        if (params.size() > 1) {
+            value = params.at(1);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+        if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                speed_ = boost::lexical_cast<double>(value);
+            }
+
+            result = std::to_wstring(speed_);
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            position_ = static_cast<double>(boost::lexical_cast<int64_t>(value));
+
+            result = std::to_wstring(static_cast<int64_t>(position_));
+        } else if (boost::iequals(cmd, L"back")) {
+            const auto back = value.empty() ? INT64_C(0) : boost::lexical_cast<int64_t>(value);
+            position_       = static_cast<double>(buffer_->last() - back);
+
+            result = std::to_wstring(static_cast<int64_t>(position_));
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    std::wstring print() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return L"replay[" + name_ + L"|" + std::to_wstring(number_) + L"]";
+    }
+
+    std::wstring name() const override { return L"replay"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        core::monitor::state state;
+        state["replay/name"]   = u8(name_);
+        state["replay/frame"]  = number_;
+        state["replay/behind"] = buffer_->last() - number_;
+        state["replay/speed"]  = speed_;
+        return state;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_replay_producer(const core::frame_producer_dependencies& dependencies,
+                                                             const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"REPLAY")) {
+        return core::frame_producer::empty();
+    }
+
+    auto buffer = ReplayBuffer::find(params.at(1));
+    if (!buffer) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No replay is recorded as " + params.at(1)));
+    }
+
+    // The live edge unless told otherwise
+    auto position = buffer->last() - get_param(L"BACK", params, INT64_C(0));
+    if (contains_param(L"SEEK", params)) {
+        position = get_param(L"SEEK", params, INT64_C(0));
+    }
+
+    return spl::make_shared<replay_producer>(
+        dependencies.frame_factory, params.at(1), buffer, position, get_param(L"SPEED", params, 1.0));
+}
+
+}} // namespace caspar::ffmpeg
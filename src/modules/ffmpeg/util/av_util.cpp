@@ -2,6 +2,8 @@
 #include "av_assert.h"
 
 #include <common/bit_depth.h>
+#include <common/log.h>
+#include <common/task_arena.h>
 
 #if defined(_MSC_VER)
 #pragma warning(push)
@@ -10,8 +12,10 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavfilter/avfilter.h>
+#include <libavutil/buffer.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/pixfmt.h>
 }
@@ -23,6 +27,10 @@ extern "C" {
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <tuple>
 
 namespace caspar { namespace ffmpeg {
@@ -43,6 +51,292 @@ std::shared_ptr<AVPacket> alloc_packet()
     return packet;
 }
 
+core::color_space get_color_space(const AVFrame* video)
+{
+    auto result = core::color_space::bt709;
+    if (video) {
+        switch (video->colorspace) {
+            case AVColorSpace::AVCOL_SPC_BT2020_NCL:
+                result = core::color_space::bt2020;
+                break;
+            case AVColorSpace::AVCOL_SPC_BT470BG:
+            case AVColorSpace::AVCOL_SPC_SMPTE170M:
+            case AVColorSpace::AVCOL_SPC_SMPTE240M:
+                result = core::color_space::bt601;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return result;
+}
+
+core::color_transfer get_color_transfer(const AVFrame* video)
+{
+    auto result = core::color_transfer::bt709;
+    if (video) {
+        switch (video->color_trc) {
+            case AVColorTransferCharacteristic::AVCOL_TRC_SMPTE2084:
+                result = core::color_transfer::pq;
+                break;
+            case AVColorTransferCharacteristic::AVCOL_TRC_ARIB_STD_B67:
+                result = core::color_transfer::hlg;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return result;
+}
+
+namespace {
+
+// A frame factory frame that a decoder wrote video into, until make_frame hands it on
+struct DecodedFrame
+{
+    std::optional<core::mutable_frame> frame;
+
+    // Keeps the buffers alive for as long as the decoder references them, which can be longer than the frame lives
+    std::vector<array<const uint8_t>> planes;
+};
+
+// The buffer opaques of the frames allocated by get_frame_buffer, which tells them apart from those of ffmpeg
+std::mutex      decoded_mutex;
+std::set<void*> decoded_opaques;
+
+void free_frame_buffer(void* opaque, uint8_t* data)
+{
+    {
+        std::lock_guard<std::mutex> lock(decoded_mutex);
+        decoded_opaques.erase(opaque);
+    }
+    delete static_cast<std::shared_ptr<DecodedFrame>*>(opaque);
+}
+
+bool same_layout(const core::pixel_format_desc& lhs, const core::pixel_format_desc& rhs)
+{
+    if (lhs.format != rhs.format || lhs.color_space != rhs.color_space || lhs.transfer != rhs.transfer ||
+        lhs.is_straight_alpha != rhs.is_straight_alpha || lhs.planes.size() != rhs.planes.size()) {
+        return false;
+    }
+    for (size_t n = 0; n < lhs.planes.size(); ++n) {
+        auto& a = lhs.planes[n];
+        auto& b = rhs.planes[n];
+        if (a.linesize != b.linesize || a.width != b.width || a.height != b.height || a.stride != b.stride ||
+            a.depth != b.depth) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool allocate_frame_buffer(const FrameAllocator& allocator, AVCodecContext* ctx, AVFrame* frame)
+{
+    std::vector<int> data_map;
+
+    auto desc = pixel_format_desc(
+        static_cast<AVPixelFormat>(frame->format), frame->width, frame->height, data_map, get_color_space(frame));
+    if (desc.format == core::pixel_format::invalid || desc.planes.empty() || !data_map.empty()) {
+        return false;
+    }
+    desc.transfer = get_color_transfer(frame);
+
+    // Decoders write whole blocks, so the tightly packed rows of the frame must already be as wide and as aligned as
+    // they need them, and each plane needs room for the rows the height is padded with
+    int width  = frame->width;
+    int height = frame->height;
+    int align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &width, &height, align);
+    if (width != frame->width || height < frame->height) {
+        return false;
+    }
+    for (size_t n = 0; n < desc.planes.size(); ++n) {
+        if (align[n] > 0 && desc.planes[n].linesize % align[n] != 0) {
+            return false;
+        }
+    }
+
+    auto padded = desc;
+    for (auto& plane : padded.planes) {
+        auto rows  = (plane.height * height + frame->height - 1) / frame->height;
+        plane.size = plane.linesize * rows + AV_INPUT_BUFFER_PADDING_SIZE;
+    }
+
+    auto decoded = std::make_shared<DecodedFrame>();
+    auto buffers = allocator.frame_factory->create_frame(allocator.tag, padded);
+    decoded->planes.reserve(padded.planes.size());
+    for (size_t n = 0; n < padded.planes.size(); ++n) {
+        auto& data = buffers.image_data(n);
+        if (align[n] > 0 && reinterpret_cast<uintptr_t>(data.data()) % align[n] != 0) {
+            return false;
+        }
+
+        // The frame gets a view through which the device still finds the upload buffer
+        decoded->planes.emplace_back(std::move(data));
+        auto& plane = decoded->planes.back();
+        data        = array<uint8_t>(const_cast<uint8_t*>(plane.data()), plane.size(), plane);
+    }
+    decoded->frame = std::move(buffers);
+
+    for (size_t n = 0; n < decoded->planes.size(); ++n) {
+        auto& plane  = decoded->planes[n];
+        auto  opaque = new std::shared_ptr<DecodedFrame>(decoded);
+
+        frame->buf[n] = av_buffer_create(
+            const_cast<uint8_t*>(plane.data()), static_cast<int>(plane.size()), free_frame_buffer, opaque, 0);
+        if (!frame->buf[n]) {
+            delete opaque;
+            for (size_t k = 0; k < n; ++k) {
+                av_buffer_unref(&frame->buf[k]);
+                frame->data[k] = nullptr;
+            }
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(decoded_mutex);
+            decoded_opaques.insert(opaque);
+        }
+
+        frame->data[n]     = frame->buf[n]->data;
+        frame->linesize[n] = desc.planes[n].linesize;
+    }
+    frame->extended_data = frame->data;
+
+    return true;
+}
+
+// Takes the frame factory frame that video was decoded into, if it was passed through as it was decoded
+std::optional<core::mutable_frame> take_decoded_frame(const void*                    tag,
+                                                      const AVFrame&                 video,
+                                                      const core::pixel_format_desc& desc,
+                                                      const std::vector<int>&        data_map)
+{
+    if (!video.buf[0]) {
+        return std::nullopt;
+    }
+
+    std::lock_guard<std::mutex> lock(decoded_mutex);
+
+    auto opaque = av_buffer_get_opaque(video.buf[0]);
+    if (decoded_opaques.find(opaque) == decoded_opaques.end()) {
+        return std::nullopt;
+    }
+
+    auto& decoded = **static_cast<std::shared_ptr<DecodedFrame>*>(opaque);
+    if (!decoded.frame || decoded.frame->stream_tag() != tag ||
+        !same_layout(decoded.frame->pixel_format_desc(), desc) || decoded.planes.size() != desc.planes.size()) {
+        return std::nullopt;
+    }
+    for (size_t n = 0; n < desc.planes.size(); ++n) {
+        auto index = data_map.empty() ? n : data_map.at(n);
+        if (video.data[index] != decoded.planes[n].data() || video.linesize[index] != desc.planes[n].linesize) {
+            return std::nullopt;
+        }
+    }
+
+    // Filters that pass frames on more than once get the copy for all but the first
+    auto frame = std::move(decoded.frame);
+    decoded.frame.reset();
+    return frame;
+}
+
+// The samples of audio, interleaved at channel_count channels. Frames of the filter graph that nothing else references
+// are kept rather than copied, and their buffers go back to the pool of the graph once the frame was mixed.
+array<int32_t> audio_samples(const std::shared_ptr<AVFrame>& audio, int source_channel_count, int channel_count)
+{
+    const auto size = static_cast<std::size_t>(audio->nb_samples) * channel_count;
+    const auto src  = reinterpret_cast<int32_t*>(audio->data[0]);
+
+    if (source_channel_count == channel_count && av_frame_is_writable(audio.get())) {
+        return array<int32_t>(src, size, audio);
+    }
+
+    std::vector<int32_t> samples(size, 0);
+    if (source_channel_count == channel_count) {
+        std::memcpy(samples.data(), src, sizeof(int32_t) * size);
+    } else {
+        auto dst = samples.data();
+        for (auto i = 0; i < audio->nb_samples; i++) {
+            for (auto j = 0; j < channel_count; ++j) {
+                dst[i * channel_count + j] = src[i * source_channel_count + j];
+            }
+        }
+    }
+    return array<int32_t>(std::move(samples));
+}
+
+} // namespace
+
+bool wrap_frame_buffer(const FrameAllocator&       allocator,
+                       AVFrame*                    frame,
+                       const array<const uint8_t>& buffer,
+                       core::color_space           color_space)
+{
+    if (!allocator.frame_factory || !buffer || frame->buf[0]) {
+        return false;
+    }
+
+    std::vector<int> data_map;
+
+    auto desc = pixel_format_desc(
+        static_cast<AVPixelFormat>(frame->format), frame->width, frame->height, data_map, color_space);
+    if (desc.format == core::pixel_format::invalid || desc.planes.empty()) {
+        return false;
+    }
+
+    auto decoded = std::make_shared<DecodedFrame>();
+    auto buffers = allocator.frame_factory->create_frame(allocator.tag, desc);
+    decoded->planes.reserve(desc.planes.size());
+    for (size_t n = 0; n < desc.planes.size(); ++n) {
+        auto  index = data_map.empty() ? n : data_map.at(n);
+        auto& plane = desc.planes[n];
+        auto  data  = frame->data[index];
+        if (frame->linesize[index] != plane.linesize || data < buffer.begin() || data + plane.size > buffer.end()) {
+            return false;
+        }
+
+        // Planes that start where the buffer does are uploaded straight from it, the others through a staging copy
+        decoded->planes.emplace_back(data, plane.size, buffer);
+        buffers.image_data(n) = array<uint8_t>(data, plane.size, buffer);
+    }
+    decoded->frame = std::move(buffers);
+
+    auto opaque = new std::shared_ptr<DecodedFrame>(decoded);
+
+    frame->buf[0] = av_buffer_create(const_cast<uint8_t*>(buffer.data()),
+                                     static_cast<int>(buffer.size()),
+                                     free_frame_buffer,
+                                     opaque,
+                                     AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0]) {
+        delete opaque;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(decoded_mutex);
+        decoded_opaques.insert(opaque);
+    }
+
+    return true;
+}
+
+int get_frame_buffer(AVCodecContext* ctx, AVFrame* frame, int flags)
+{
+    auto allocator = static_cast<const FrameAllocator*>(ctx->opaque);
+    try {
+        if (allocator && allocator->frame_factory && allocate_frame_buffer(*allocator, ctx, frame)) {
+            return 0;
+        }
+    } catch (...) {
+        // Exceptions must not unwind through ffmpeg, which still gets its buffers from the default allocator
+    }
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+}
+
 core::mutable_frame make_frame(void*                            tag,
                                core::frame_factory&             frame_factory,
                                std::shared_ptr<AVFrame>         video,
@@ -58,58 +352,92 @@ core::mutable_frame make_frame(void*                            tag,
                     static_cast<AVPixelFormat>(video->format), video->width, video->height, data_map, color_space)
               : core::pixel_format_desc(core::pixel_format::invalid);
     pix_desc.is_straight_alpha = is_straight_alpha;
+    pix_desc.transfer          = get_color_transfer(video.get());
 
-    auto frame = frame_factory.create_frame(tag, pix_desc);
+    auto decoded = video ? take_decoded_frame(tag, *video, pix_desc, data_map) : std::nullopt;
+    auto frame   = decoded ? std::move(*decoded) : frame_factory.create_frame(tag, pix_desc);
     if (scale_mode != core::frame_geometry::scale_mode::stretch) {
         frame.geometry() = core::frame_geometry::get_default(scale_mode);
     }
 
-    tbb::parallel_invoke(
-        [&]() {
-            if (video) {
-                for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
-                    auto frame_plan_index = data_map.empty() ? n : data_map.at(n);
-
-                    tbb::parallel_for(0, pix_desc.planes[n].height, [&](int y) {
-                        std::memcpy(frame.image_data(n).begin() + y * pix_desc.planes[n].linesize,
-                                    video->data[frame_plan_index] + y * video->linesize[frame_plan_index],
-                                    pix_desc.planes[n].linesize);
-                    });
-                }
-            }
-        },
-        [&]() {
-            if (audio) {
-                const int channel_count = 16;
-                frame.audio_data()      = std::vector<int32_t>(audio->nb_samples * channel_count, 0);
+    auto copy_video = [&]() {
+        for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
+            auto frame_plan_index = data_map.empty() ? n : data_map.at(n);
+
+            run_in_arena(task_kind::decode, [&] {
+                tbb::parallel_for(0, pix_desc.planes[n].height, [&](int y) {
+                    std::memcpy(frame.image_data(n).begin() + y * pix_desc.planes[n].linesize,
+                                video->data[frame_plan_index] + y * video->linesize[frame_plan_index],
+                                pix_desc.planes[n].linesize);
+                });
+            });
+        }
+    };
 
+    auto copy_audio = [&]() {
+        if (audio) {
 #if FFMPEG_NEW_CHANNEL_LAYOUT
-                auto source_channel_count = audio->ch_layout.nb_channels;
+            auto source_channel_count = audio->ch_layout.nb_channels;
 #else
-                auto source_channel_count = audio->channels;
+            auto source_channel_count = audio->channels;
 #endif
 
-                if (source_channel_count == channel_count) {
-                    std::memcpy(frame.audio_data().data(),
-                                reinterpret_cast<int32_t*>(audio->data[0]),
-                                sizeof(int32_t) * channel_count * audio->nb_samples);
-                } else {
-                    // This isn't pretty, but some callers may not provide 16 channels
-
-                    auto dst = frame.audio_data().data();
-                    auto src = reinterpret_cast<int32_t*>(audio->data[0]);
-                    for (auto i = 0; i < audio->nb_samples; i++) {
-                        for (auto j = 0; j < std::min(channel_count, source_channel_count); ++j) {
-                            dst[i * channel_count + j] = src[i * source_channel_count + j];
-                        }
-                    }
-                }
-            }
-        });
+            // Audio keeps its own channel count, the mixer lays it out at the width of the channel playing it
+            const int channel_count = std::min(source_channel_count, 16);
+            frame.audio_data()      = audio_samples(audio, source_channel_count, channel_count);
+            frame.audio_channels()  = channel_count;
+        }
+    };
+
+    // Audio alone, as of files without video, is not worth handing to another thread
+    if (video && !decoded) {
+        tbb::parallel_invoke(copy_video, copy_audio);
+    } else {
+        copy_audio();
+    }
 
     return frame;
 }
 
+FieldSplitter::FieldSplitter(bool all)
+    : all_(all)
+{
+}
+
+core::const_frame FieldSplitter::operator()(void*                            tag,
+                                            core::frame_factory&             frame_factory,
+                                            std::shared_ptr<AVFrame>         video,
+                                            std::shared_ptr<AVFrame>         audio,
+                                            core::color_space                color_space,
+                                            core::frame_geometry::scale_mode scale_mode)
+{
+    if (!video) {
+        video_.reset();
+        frame_ = core::const_frame();
+        return core::const_frame(make_frame(tag, frame_factory, video, audio, color_space, scale_mode));
+    }
+
+#if LIBAVCODEC_VERSION_MAJOR < 61
+    const auto interlaced      = all_ || video->interlaced_frame;
+    const auto top_field_first = video->top_field_first != 0;
+#else
+    const auto interlaced      = all_ || (video->flags & AV_FRAME_FLAG_INTERLACED);
+    const auto top_field_first = (video->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) != 0;
+#endif
+    const auto first  = top_field_first ? core::video_field::a : core::video_field::b;
+    const auto second = top_field_first ? core::video_field::b : core::video_field::a;
+
+    if (interlaced && frame_ && video_ && video->data[0] == video_->data[0]) {
+        auto sound = core::const_frame(make_frame(tag, frame_factory, nullptr, audio));
+        video_     = std::move(video);
+        return frame_.with_field(second).with_audio(sound.audio_data(), sound.audio_channels());
+    }
+
+    frame_ = core::const_frame(make_frame(tag, frame_factory, video, audio, color_space, scale_mode));
+    video_ = std::move(video);
+    return interlaced ? frame_.with_field(first) : frame_;
+}
+
 std::tuple<core::pixel_format, common::bit_depth> get_pixel_format(AVPixelFormat pix_fmt)
 {
     switch (pix_fmt) {
@@ -333,6 +661,8 @@ std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, con
         case core::pixel_format::gbrap:
             // TODO
             break;
+        case core::pixel_format::bc1:
+        case core::pixel_format::bc3:
         case core::pixel_format::count:
         case core::pixel_format::invalid:
             break;
@@ -402,6 +732,28 @@ std::map<std::string, std::string> to_map(AVDictionary** dict)
     return map;
 }
 
+std::optional<yuv_format> to_yuv_format(AVPixelFormat pix_fmt)
+{
+    switch (pix_fmt) {
+        case AV_PIX_FMT_YUV420P:
+            return yuv_format::yuv420p;
+        case AV_PIX_FMT_YUV422P:
+            return yuv_format::yuv422p;
+        case AV_PIX_FMT_YUVA422P:
+            return yuv_format::yuva422p;
+        case AV_PIX_FMT_YUV422P10LE:
+            return yuv_format::yuv422p10;
+        case AV_PIX_FMT_YUVA422P10LE:
+            return yuv_format::yuva422p10;
+        case AV_PIX_FMT_NV12:
+            return yuv_format::nv12;
+        case AV_PIX_FMT_UYVY422:
+            return yuv_format::uyvy422;
+        default:
+            return {};
+    }
+}
+
 uint64_t get_channel_layout_mask_for_channels(int channel_count)
 {
 #if FFMPEG_NEW_CHANNEL_LAYOUT
@@ -416,4 +768,73 @@ uint64_t get_channel_layout_mask_for_channels(int channel_count)
 #endif
 }
 
+// Hardware device contexts are shared by the decoders and encoders of a type, and released with the last of them
+std::shared_ptr<AVBufferRef> get_hw_device(AVHWDeviceType type)
+{
+    static std::mutex                                           mutex;
+    static std::map<AVHWDeviceType, std::weak_ptr<AVBufferRef>> devices;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto device = devices[type].lock();
+    if (!device) {
+        AVBufferRef* ref = nullptr;
+        if (av_hwdevice_ctx_create(&ref, type, nullptr, nullptr, 0) < 0) {
+            return nullptr;
+        }
+        device        = std::shared_ptr<AVBufferRef>(ref, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+        devices[type] = device;
+    }
+    return device;
+}
+
+namespace {
+
+// Picks the hardware format stored in opaque, or lets ffmpeg fall back to a software one when the stream is not
+// supported by the device, e.g. for a profile it cannot decode
+AVPixelFormat get_hw_format(AVCodecContext* ctx, const AVPixelFormat* formats)
+{
+    auto hw_format = static_cast<AVPixelFormat>(reinterpret_cast<intptr_t>(ctx->opaque));
+    for (auto format = formats; *format != AV_PIX_FMT_NONE; ++format) {
+        if (*format == hw_format) {
+            return *format;
+        }
+    }
+    return avcodec_default_get_format(ctx, formats);
+}
+
+} // namespace
+
+std::shared_ptr<AVBufferRef> open_hw_decoder(AVCodecContext* ctx, const AVCodec* codec, const std::string& hwaccel)
+{
+    auto type = hwaccel == "auto" ? AV_HWDEVICE_TYPE_NONE : av_hwdevice_find_type_by_name(hwaccel.c_str());
+    if (hwaccel != "auto" && type == AV_HWDEVICE_TYPE_NONE) {
+        CASPAR_LOG(warning) << "[ffmpeg] unknown hwaccel " << hwaccel << ", decoding in software";
+        return nullptr;
+    }
+
+    for (int n = 0; auto config = avcodec_get_hw_config(codec, n); ++n) {
+        if (!(config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) ||
+            (type != AV_HWDEVICE_TYPE_NONE && config->device_type != type)) {
+            continue;
+        }
+
+        auto device = get_hw_device(config->device_type);
+        if (!device) {
+            continue;
+        }
+
+        ctx->hw_device_ctx = av_buffer_ref(device.get());
+        ctx->opaque        = reinterpret_cast<void*>(static_cast<intptr_t>(config->pix_fmt));
+        ctx->get_format    = get_hw_format;
+
+        CASPAR_LOG(debug) << "[ffmpeg] decoding " << codec->name << " with "
+                          << av_hwdevice_get_type_name(config->device_type);
+        return device;
+    }
+
+    CASPAR_LOG(warning) << "[ffmpeg] no " << hwaccel << " hwaccel for " << codec->name << ", decoding in software";
+    return nullptr;
+}
+
 }} // namespace caspar::ffmpeg
@@ -1,9 +1,12 @@
 #pragma once
 
 extern "C" {
+#include <libavutil/hwcontext.h>
 #include <libavutil/pixfmt.h>
 }
 
+#include <common/yuv.h>
+
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/frame/geometry.h>
@@ -12,6 +15,8 @@ extern "C" {
 
 #include <map>
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "../defines.h"
@@ -19,8 +24,10 @@ extern "C" {
 struct AVFrame;
 struct AVPacket;
 struct AVFilterContext;
+struct AVCodec;
 struct AVCodecContext;
 struct AVDictionary;
+struct AVBufferRef;
 
 namespace caspar { namespace ffmpeg {
 
@@ -32,6 +39,28 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat     pix_fmt,
                                           int               height,
                                           std::vector<int>& data_map,
                                           core::color_space color_space = core::color_space::bt709);
+core::color_space    get_color_space(const AVFrame* video);
+core::color_transfer get_color_transfer(const AVFrame* video);
+
+// Lets a decoder write video straight into frames of the frame factory, which make_frame then hands on without a copy
+// as long as the filter graph passes the video through untouched. Set get_frame_buffer as the get_buffer2 callback of
+// the codec context, with opaque pointing to the allocator.
+struct FrameAllocator
+{
+    const void*                          tag = nullptr;
+    std::shared_ptr<core::frame_factory> frame_factory;
+};
+
+int get_frame_buffer(AVCodecContext* ctx, AVFrame* frame, int flags);
+
+// Does the same for video that was captured straight into buffer, an array of the frame factory, by making frame
+// reference it. The format, size, data and linesize of frame must already be set. Returns false, leaving frame as it
+// was, when its planes do not lie within buffer.
+bool wrap_frame_buffer(const FrameAllocator&       allocator,
+                       AVFrame*                    frame,
+                       const array<const uint8_t>& buffer,
+                       core::color_space           color_space = core::color_space::bt709);
+
 core::mutable_frame     make_frame(void*                    tag,
                                    core::frame_factory&     frame_factory,
                                    std::shared_ptr<AVFrame> video,
@@ -40,6 +69,30 @@ core::mutable_frame     make_frame(void*                    tag,
                                    core::frame_geometry::scale_mode     = core::frame_geometry::scale_mode::stretch,
                                    bool is_straight_alpha               = false);
 
+// Deinterlaces on the GPU instead of in the filter graph. A graph without a deinterlacer that repeats interlaced frames
+// at the field rate, as fps does, passes each of them on once per field. The first of them shows the field that comes
+// first and the repeats the other one, drawn from the image that was uploaded for the first. Progressive frames are
+// passed through as make_frame makes them.
+class FieldSplitter
+{
+    bool                     all_ = false;
+    std::shared_ptr<AVFrame> video_; // Held so that a later frame can not reuse its buffers and pass for a repeat
+    core::const_frame        frame_;
+
+  public:
+    FieldSplitter() = default;
+
+    // With all, frames are taken as interlaced whether they are flagged so or not
+    explicit FieldSplitter(bool all);
+
+    core::const_frame operator()(void*                    tag,
+                                 core::frame_factory&     frame_factory,
+                                 std::shared_ptr<AVFrame> video,
+                                 std::shared_ptr<AVFrame> audio,
+                                 core::color_space        color_space = core::color_space::bt709,
+                                 core::frame_geometry::scale_mode     = core::frame_geometry::scale_mode::stretch);
+};
+
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 
@@ -48,4 +101,15 @@ std::map<std::string, std::string> to_map(AVDictionary** dict);
 
 uint64_t get_channel_layout_mask_for_channels(int channel_count);
 
+// The layout bgra_to_yuv puts pix_fmt in, if it can
+std::optional<yuv_format> to_yuv_format(AVPixelFormat pix_fmt);
+
+// The device context of type, shared by all its users. Nothing when the device can not be opened.
+std::shared_ptr<AVBufferRef> get_hw_device(AVHWDeviceType type);
+
+// Sets up ctx, before it is opened, to decode on a device of hwaccel, or of the first type the codec can use for
+// "auto". Frames decoded on the device have hw_frames_ctx set and need av_hwframe_transfer_data. Returns the device, or
+// nothing when the codec is decoded in software.
+std::shared_ptr<AVBufferRef> open_hw_decoder(AVCodecContext* ctx, const AVCodec* codec, const std::string& hwaccel);
+
 }} // namespace caspar::ffmpeg
@@ -0,0 +1,135 @@
+#include "replay_buffer.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace caspar { namespace ffmpeg {
+
+struct ReplayBuffer::Impl
+{
+    const std::shared_ptr<AVCodecParameters> codecpar_;
+    const core::video_format_desc            format_desc_;
+    const int64_t                            max_frames_;
+    const std::size_t                        max_bytes_;
+
+    mutable std::mutex                       mutex_;
+    std::deque<std::shared_ptr<const Frame>> frames_;
+    int64_t                                  first_ = 0; // The number of frames_.front()
+    std::size_t                              bytes_ = 0;
+
+    Impl(std::shared_ptr<AVCodecParameters> codecpar,
+         core::video_format_desc            format_desc,
+         int64_t                            max_frames,
+         std::size_t                        max_bytes)
+        : codecpar_(std::move(codecpar))
+        , format_desc_(std::move(format_desc))
+        , max_frames_(std::max<int64_t>(max_frames, 1))
+        , max_bytes_(max_bytes)
+    {
+    }
+
+    static std::size_t size_of(const Frame& frame)
+    {
+        return (frame.video ? frame.video->size : 0) + frame.audio.size() * sizeof(int32_t);
+    }
+
+    void push(Frame frame)
+    {
+        auto frame2 = std::make_shared<const Frame>(std::move(frame));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        bytes_ += size_of(*frame2);
+        frames_.push_back(std::move(frame2));
+
+        // The newest frame is kept even when it alone is larger than allowed
+        while (frames_.size() > 1 &&
+               (static_cast<int64_t>(frames_.size()) > max_frames_ || bytes_ > max_bytes_)) {
+            bytes_ -= size_of(*frames_.front());
+            frames_.pop_front();
+            first_ += 1;
+        }
+    }
+
+    std::shared_ptr<const Frame> get(int64_t number) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (number < first_ || number >= first_ + static_cast<int64_t>(frames_.size())) {
+            return nullptr;
+        }
+        return frames_[static_cast<std::size_t>(number - first_)];
+    }
+};
+
+namespace {
+
+std::mutex                                          registry_mutex;
+std::map<std::wstring, std::weak_ptr<ReplayBuffer>> registry;
+
+} // namespace
+
+std::shared_ptr<ReplayBuffer> ReplayBuffer::find(const std::wstring& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    auto it = registry.find(name);
+    return it != registry.end() ? it->second.lock() : nullptr;
+}
+
+void ReplayBuffer::publish(const std::wstring& name, const std::shared_ptr<ReplayBuffer>& buffer)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    // Drop the entries of buffers no longer recorded or played
+    for (auto it = registry.begin(); it != registry.end();) {
+        it = it->second.expired() ? registry.erase(it) : std::next(it);
+    }
+
+    registry[name] = buffer;
+}
+
+ReplayBuffer::ReplayBuffer(std::shared_ptr<AVCodecParameters> codecpar,
+                           core::video_format_desc            format_desc,
+                           int64_t                            max_frames,
+                           std::size_t                        max_bytes)
+    : impl_(new Impl(std::move(codecpar), std::move(format_desc), max_frames, max_bytes))
+{
+}
+ReplayBuffer::~ReplayBuffer() {}
+const AVCodecParameters&       ReplayBuffer::codecpar() const { return *impl_->codecpar_; }
+const core::video_format_desc& ReplayBuffer::format_desc() const { return impl_->format_desc_; }
+void                           ReplayBuffer::push(Frame frame) { impl_->push(std::move(frame)); }
+std::shared_ptr<const ReplayBuffer::Frame> ReplayBuffer::get(int64_t number) const { return impl_->get(number); }
+
+int64_t ReplayBuffer::first() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->first_;
+}
+
+int64_t ReplayBuffer::last() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->first_ + static_cast<int64_t>(impl_->frames_.size()) - 1;
+}
+
+std::size_t ReplayBuffer::size() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->bytes_;
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <core/video_format.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct AVCodecParameters;
+struct AVPacket;
+
+namespace caspar { namespace ffmpeg {
+
+// The recent history of a channel, compressed a frame at a time so that every frame decodes on its own. Recorded by a
+// replay consumer and played by replay producers, which find it by name. The oldest frames are dropped once the
+// history is longer or larger than allowed.
+class ReplayBuffer
+{
+  public:
+    struct Frame
+    {
+        std::shared_ptr<AVPacket> video;
+        std::vector<int32_t>      audio; // Interleaved, as the channel mixed it
+    };
+
+    // The buffer recorded as name, or nothing while no one records or plays it
+    static std::shared_ptr<ReplayBuffer> find(const std::wstring& name);
+
+    // Makes buffer the one found as name, in place of any recorded before
+    static void publish(const std::wstring& name, const std::shared_ptr<ReplayBuffer>& buffer);
+
+    ReplayBuffer(std::shared_ptr<AVCodecParameters> codecpar,
+                 core::video_format_desc            format_desc,
+                 int64_t                            max_frames,
+                 std::size_t                        max_bytes);
+    ~ReplayBuffer();
+
+    ReplayBuffer(const ReplayBuffer&)            = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+    const AVCodecParameters&       codecpar() const;
+    const core::video_format_desc& format_desc() const;
+
+    void push(Frame frame);
+
+    // Frames are numbered from the start of the recording. first() is the oldest held and last() the newest, which is
+    // below first() while nothing has been recorded.
+    int64_t first() const;
+    int64_t last() const;
+
+    // Frame number, or nothing when it is not held
+    std::shared_ptr<const Frame> get(int64_t number) const;
+
+    // The memory the frames held take
+    std::size_t size() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -45,6 +45,7 @@ FlashAxContainer::FlashAxContainer()
     , bReadyToRender_(false)
     , bIsEmpty_(true)
     , bHasNewTiming_(false)
+    , bDirtyWhole_(true)
     , m_lpDD4(nullptr)
     , timerCount_(0)
     , bInPlaceActive_(FALSE)
@@ -330,14 +331,14 @@ HRESULT STDMETHODCALLTYPE FlashAxContainer::InvalidateRect(LPCRECT pRect, BOOL f
 
     bInvalidRect_ = true;
 
-    /*	//Keep a list of dirty rectangles in order to be able to redraw only them
-        if(pRect != NULL) {
-            bDirtyRects_.push_back(DirtyRect(*pRect, fErase != 0));
-        }
-        else {
-            bDirtyRects_.push_back(DirtyRect(true));
-        }
-    */
+    // Kept so that only the dirty areas are cleared, drawn and uploaded, until there are too many to be worth it
+    if (pRect == nullptr || dirtyRects_.size() >= 16) {
+        bDirtyWhole_ = true;
+        dirtyRects_.clear();
+    } else if (!bDirtyWhole_) {
+        dirtyRects_.push_back(*pRect);
+    }
+
     return S_OK;
 }
 
@@ -818,6 +819,8 @@ void FlashAxContainer::SetSize(size_t width, size_t height)
 
         m_spInPlaceObjectWindowless->SetObjectRects(&m_rcPos, &m_rcPos);
         bInvalidRect_ = true;
+        bDirtyWhole_  = true;
+        dirtyRects_.clear();
     }
 }
 
@@ -831,32 +834,52 @@ FlashAxContainer::QueryControl(REFIID iid, void** ppUnk)
     return hr;
 }
 
+std::vector<RECT> FlashAxContainer::DirtyRects() const
+{
+    std::vector<RECT> rects;
+    if (bDirtyWhole_) {
+        return rects;
+    }
+    for (auto& dirty : dirtyRects_) {
+        RECT rect;
+        if (IntersectRect(&rect, &dirty, &m_rcPos)) {
+            rects.push_back(rect);
+        }
+    }
+    if (rects.empty()) {
+        // Nothing within the control, but a draw was asked for
+        rects.push_back(RECT{0, 0, 0, 0});
+    }
+    return rects;
+}
+
 bool FlashAxContainer::DrawControl(HDC targetDC)
 {
     //	ATLTRACE(_T("FlashAxContainer::DrawControl\n"));
+
+    // Flash draws all of the control, but GDI only lets it touch the dirty areas. Drawing only the dirty rectangles as
+    // object rects doesn't work when the movie uses filters, such as glow or drop shadow.
+    if (!bDirtyWhole_) {
+        HRGN region = CreateRectRgn(0, 0, 0, 0);
+        for (auto& rect : dirtyRects_) {
+            HRGN dirty = CreateRectRgnIndirect(&rect);
+            CombineRgn(region, region, dirty, RGN_OR);
+            DeleteObject(dirty);
+        }
+        SelectClipRgn(targetDC, region);
+        DeleteObject(region);
+    }
+
     DVASPECTINFO aspectInfo = {sizeof(DVASPECTINFO), DVASPECTINFOFLAG_CANOPTIMIZE};
     HRESULT      hr         = m_spViewObject->Draw(
         DVASPECT_CONTENT, -1, &aspectInfo, nullptr, nullptr, targetDC, nullptr, nullptr, nullptr, NULL);
+
+    SelectClipRgn(targetDC, nullptr);
+    GdiFlush();
+
     bInvalidRect_ = false;
-    /*	const video_format_desc& fmtDesc = video_format_desc::FormatDescriptions[format_];
-
-        //Trying to redraw just the dirty rectangles. Doesn't seem to work when the movie uses "filters", such as glow,
-       dropshadow etc. std::vector<flash::DirtyRect>::iterator it = bDirtyRects_.begin();
-        std::vector<flash::DirtyRect>::iterator end = bDirtyRects_.end();
-        for(; it != end; ++it) {
-            flash::DirtyRect& dirtyRect = (*it);
-            if(dirtyRect.bWhole || dirtyRect.rect.right >= fmtDesc.width || dirtyRect.rect.bottom >= fmtDesc.height) {
-                m_spInPlaceObjectWindowless->SetObjectRects(&m_rcPos, &m_rcPos);
-                hr = m_spViewObject->Draw(DVASPECT_OPAQUE, -1, NULL, NULL, NULL, targetDC, NULL, NULL, NULL, NULL);
-                break;
-            }
-            else {
-                m_spInPlaceObjectWindowless->SetObjectRects(&m_rcPos, &(dirtyRect.rect));
-                hr = m_spViewObject->Draw(DVASPECT_OPAQUE, -1, NULL, NULL, NULL, targetDC, NULL, NULL, NULL, NULL);
-            }
-        }
-        bDirtyRects_.clear();
-    */
+    bDirtyWhole_  = false;
+    dirtyRects_.clear();
 
     return hr == S_OK;
 }
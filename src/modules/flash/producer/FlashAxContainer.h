@@ -30,6 +30,7 @@
 #include <ocmm.h>
 
 #include <functional>
+#include <vector>
 
 #include "../interop/axflash.h"
 #include <core/video_format.h>
@@ -50,26 +51,6 @@ _COM_SMARTPTR_TYPEDEF(IDirectDraw4, IID_IDirectDraw4);
 namespace caspar { namespace flash {
 
 class TimerHelper;
-/*struct DirtyRect {
-    DirtyRect(LONG l, LONG t, LONG r, LONG b, bool e) : bErase(e), bWhole(false) {
-        rect.left = l;
-        rect.top = t;
-        rect.right = r;
-        rect.bottom = b;
-    }
-    DirtyRect(const RECT& rc, bool e) : bErase(e), bWhole(false)  {
-        rect.left = rc.left;
-        rect.top = rc.top;
-        rect.right = rc.right;
-        rect.bottom = rc.bottom;
-    }
-    explicit DirtyRect(bool b) : bWhole(b) {}
-
-    RECT	rect;
-    bool	bErase;
-    bool	bWhole;
-};*/
-
 extern _ATL_FUNC_INFO fnInfoFlashCallEvent;
 extern _ATL_FUNC_INFO fnInfoReadyStateChangeEvent;
 
@@ -261,6 +242,8 @@ class ATL_NO_VTABLE FlashAxContainer
     bool FlashCall(const std::wstring& str, std::wstring& result);
     bool DrawControl(HDC targetDC);
     bool InvalidRect() const { return bInvalidRect_; }
+    // The areas invalidated since the last draw, within the control. Empty when all of it was.
+    std::vector<RECT> DirtyRects() const;
     bool IsEmpty() const { return bIsEmpty_; }
 
     void SetSize(size_t width, size_t height);
@@ -279,7 +262,8 @@ class ATL_NO_VTABLE FlashAxContainer
     volatile bool                 bReadyToRender_;
     volatile bool                 bIsEmpty_;
     volatile bool                 bHasNewTiming_;
-    // std::vector<DirtyRect> bDirtyRects_;
+    bool                          bDirtyWhole_;
+    std::vector<RECT>             dirtyRects_;
 
     IDirectDraw4Ptr* m_lpDD4;
     static CComBSTR  flashGUID_;
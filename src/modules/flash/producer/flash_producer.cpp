@@ -199,6 +199,7 @@ class flash_renderer
 
     CComObject<caspar::flash::FlashAxContainer>* ax_ = nullptr;
     core::draw_frame                             head_;
+    core::const_frame                            last_paint_;
     bitmap                                       bmp_{width_, height_};
     prec_timer                                   timer_;
     caspar::timer                                tick_timer_;
@@ -305,16 +306,39 @@ class flash_renderer
         caspar::timer frame_timer;
         ax_->Tick();
 
+        // Nothing is drawn or uploaded until flash invalidates some of the control, and then only those areas. The
+        // bitmap keeps what was drawn before, and is uploaded from on top of a GPU copy of the previous frame.
         if (ax_->InvalidRect()) {
-            core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
-            desc.planes.push_back(core::pixel_format_desc::plane(width_, height_, 4));
-            auto frame = frame_factory_->create_frame(this, desc);
+            auto rects = ax_->DirtyRects();
+
+            std::vector<core::damage_rect> damage;
+            for (auto& rect : rects) {
+                if (rect.right > rect.left && rect.bottom > rect.top) {
+                    damage.push_back(core::damage_rect{static_cast<int>(rect.left),
+                                                       static_cast<int>(rect.top),
+                                                       static_cast<int>(rect.right - rect.left),
+                                                       static_cast<int>(rect.bottom - rect.top)});
+                }
+            }
 
-            std::memset(bmp_.data(), 0, width_ * height_ * 4);
+            if (rects.empty()) {
+                std::memset(bmp_.data(), 0, width_ * height_ * 4);
+            }
+            for (auto& rect : damage) {
+                for (int y = rect.y; y < rect.y + rect.height; ++y) {
+                    std::memset(bmp_.data() + (y * width_ + rect.x) * 4, 0, rect.width * 4);
+                }
+            }
             ax_->DrawControl(bmp_);
 
-            std::memcpy(frame.image_data(0).begin(), bmp_.data(), width_ * height_ * 4);
-            head_ = core::draw_frame(std::move(frame));
+            if (rects.empty() || !damage.empty()) {
+                core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
+                desc.planes.push_back(core::pixel_format_desc::plane(width_, height_, 4));
+
+                auto image  = array<const std::uint8_t>(bmp_.data(), width_ * height_ * 4, nullptr);
+                last_paint_ = core::const_frame(frame_factory_->update_frame(this, last_paint_, desc, image, damage));
+                head_       = core::draw_frame(last_paint_);
+            }
         }
 
         MSG msg;
@@ -505,14 +529,12 @@ struct flash_producer : public core::frame_producer
                 ++rendered;
             } else {
                 if (nothing_rendered++ < MAX_NOTHING_RENDERED_RETRIES) {
-                    // Flash player not ready with first frame, sleep to not busy-loop;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    std::this_thread::yield();
+                    // Flash player not ready with first frame. It gets ready by the messages dispatched by the next
+                    // render, so wait for one of them to arrive rather than sleeping for a fixed time.
+                    MsgWaitForMultipleObjects(0, nullptr, FALSE, 10, QS_ALLINPUT);
                 } else
                     return;
             }
-
-            // TODO yield
         }
     }
 
@@ -252,7 +252,8 @@ void init(const core::module_dependencies& dependencies)
         [](const core::frame_producer_dependencies& dependencies, const std::wstring& filename) {
             return html::create_cg_producer(dependencies, {filename});
         },
-        false);
+        false,
+        html::preload_cg_producer);
 
     auto cef_version_major = std::to_wstring(cef_version_info(0));
     auto cef_revision      = std::to_wstring(cef_version_info(1));
@@ -267,6 +268,7 @@ void uninit()
     if (!g_cef_executor)
         return;
 
+    close_pooled_browsers();
     invoke([] { CefQuitMessageLoop(); });
     g_cef_executor->begin_invoke([&] { CefShutdown(); });
     g_cef_executor.reset();
@@ -36,7 +36,9 @@
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/future.h>
+#include <common/log.h>
 #include <common/os/filesystem.h>
+#include <common/param.h>
 #include <common/timer.h>
 
 #include <boost/algorithm/string/predicate.hpp>
@@ -45,9 +47,7 @@
 #include <boost/property_tree/ptree.hpp>
 #include <boost/regex.hpp>
 
-#include <tbb/concurrent_queue.h>
-#include <tbb/parallel_for.h>
-
+#include <atomic>
 #include <mutex>
 
 #pragma warning(push)
@@ -55,16 +55,48 @@
 #include <include/cef_app.h>
 #include <include/cef_client.h>
 #include <include/cef_render_handler.h>
+#include <include/cef_task.h>
 #pragma warning(pop)
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <optional>
-#include <queue>
 #include <utility>
+#include <vector>
 
 #include "../util.h"
 
 namespace caspar { namespace html {
 
+// Accumulates damage, merging it into one rectangle once there is too much of it to track separately
+void add_damage(std::vector<core::damage_rect>& damage, const std::vector<core::damage_rect>& rects)
+{
+    damage.insert(damage.end(), rects.begin(), rects.end());
+
+    if (damage.size() > 16) {
+        auto left   = damage[0].x;
+        auto top    = damage[0].y;
+        auto right  = damage[0].x + damage[0].width;
+        auto bottom = damage[0].y + damage[0].height;
+        for (auto& rect : damage) {
+            left   = std::min(left, rect.x);
+            top    = std::min(top, rect.y);
+            right  = std::max(right, rect.x + rect.width);
+            bottom = std::max(bottom, rect.y + rect.height);
+        }
+        damage = {core::damage_rect{left, top, right - left, bottom - top}};
+    }
+}
+
+const std::wstring BLANK_URL = L"about:blank";
+
+struct painted_frame
+{
+    core::const_frame              frame;  // Empty for the frame that clears the producer when it is removed
+    std::vector<core::damage_rect> damage; // Relative to the frame received before it
+};
+
 class html_client
     : public CefClient
     , public CefRenderHandler
@@ -81,51 +113,130 @@ class html_client
     caspar::timer                       paint_timer_;
     caspar::timer                       test_timer_;
 
-    spl::shared_ptr<core::frame_factory>                        frame_factory_;
-    core::video_format_desc                                     format_desc_;
-    bool                                                        gpu_enabled_;
-    tbb::concurrent_queue<std::wstring>                         javascript_before_load_;
-    std::atomic<bool>                                           loaded_;
-    std::queue<std::pair<std::int_least64_t, core::draw_frame>> frames_;
-    mutable std::mutex                                          frames_mutex_;
-    const size_t                                                frames_max_size_ = 4;
-    std::atomic<bool>                                           closing_;
-
-    core::draw_frame   last_frame_;
-    std::int_least64_t last_frame_time_;
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc              format_desc_;
+    std::vector<std::wstring>            javascript_; // Waiting for the page to load or for the next tick
+    std::mutex                           javascript_mutex_;
+    std::atomic<bool>                    loaded_;
+    std::atomic<int64_t>                 received_at_{0}; // Of the last tick, in steady clock nanoseconds
+    std::optional<painted_frame>         painted_;
+    mutable std::mutex                   painted_mutex_;
+    std::atomic<bool>                    closing_;
+    bool                                 hidden_         = false;
+    int                                  ticks_          = 0; // Since the last frame begun
+    int                                  frame_interval_ = 1; // Ticks per frame begun
+    int                                  idle_interval_  = 0; // Ticks per frame begun while idle, 0 to never idle
+    std::atomic<int>                     idle_ticks_{0};      // Since the last paint or call
+    int                                  behind_ = 0;         // Ticks the channel is behind by
+
+    core::draw_frame last_frame_;
 
     CefRefPtr<CefBrowser> browser_;
+    std::wstring          pending_url_; // Loaded once the browser has been created
+
+    // The frame of the last paint, which the next one is an update of. Only used from the CEF UI thread.
+    core::const_frame last_paint_;
 
   public:
-    html_client(spl::shared_ptr<core::frame_factory>       frame_factory,
-                const spl::shared_ptr<diagnostics::graph>& graph,
-                core::video_format_desc                    format_desc,
-                bool                                       gpu_enabled,
-                std::wstring                               url)
+    html_client(spl::shared_ptr<core::frame_factory> frame_factory,
+                core::video_format_desc              format_desc,
+                std::wstring                         url)
         : url_(std::move(url))
-        , graph_(graph)
         , frame_factory_(std::move(frame_factory))
         , format_desc_(std::move(format_desc))
-        , gpu_enabled_(gpu_enabled)
     {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["file/path"] = u8(url_);
+        }
+
+        loaded_  = false;
+        closing_ = false;
+    }
+
+    // Hands the browser to a producer, which may not be the one it was created or preloaded for. Called on the CEF UI
+    // thread.
+    void attach(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                const spl::shared_ptr<diagnostics::graph>&  graph,
+                const core::video_format_desc&              format_desc)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        frame_factory_ = frame_factory;
+        format_desc_   = format_desc;
+        graph_         = graph;
+        ticks_         = 0;
+        idle_ticks_    = 0;
+
         graph_->set_color("browser-tick-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
-        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.1f, 0.1f));
         graph_->set_color("overload", diagnostics::color(0.6f, 0.6f, 0.3f));
-        graph_->set_color("buffered-frames", diagnostics::color(0.2f, 0.9f, 0.9f));
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
+    }
+
+    // Navigates the browser to another page, dropping everything of the current one. Called on the CEF UI thread.
+    void load(const std::wstring& url)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
 
+        {
+            std::lock_guard<std::mutex> lock(painted_mutex_);
+            painted_.reset();
+        }
         {
             std::lock_guard<std::mutex> lock(state_mutex_);
-            state_["file/path"] = u8(url_);
+            state_              = {};
+            state_["file/path"] = u8(url);
         }
 
-        loaded_  = false;
-        closing_ = false;
+        {
+            std::lock_guard<std::mutex> lock(javascript_mutex_);
+            javascript_.clear();
+        }
+
+        url_        = url;
+        loaded_     = false;
+        last_frame_ = core::draw_frame::empty();
+        last_paint_ = core::const_frame{};
+
+        if (browser_ != nullptr) {
+            browser_->GetMainFrame()->LoadURL(url);
+        } else {
+            pending_url_ = url;
+        }
     }
 
+    // Parks the browser on a blank page, without the graph of the producer it was attached to. Called on the CEF UI
+    // thread.
+    void detach()
+    {
+        graph_ = spl::make_shared<diagnostics::graph>();
+        load(BLANK_URL);
+    }
+
+    // The rates the browser renders at, in frames per second, while it paints and once it has not painted for a second.
+    // A rate of 0 is that of the channel, and an idle rate of 0 never idles. Frames in between repeat the last paint,
+    // which is not uploaded again. Called on the CEF UI thread.
+    void set_frame_rates(double fps, double idle_fps)
+    {
+        auto interval = [&](double rate) {
+            return rate > 0.0 ? std::max(1, static_cast<int>(std::lround(format_desc_.fps / rate))) : 0;
+        };
+        frame_interval_ = std::max(1, interval(fps));
+        idle_interval_  = idle_fps > 0.0 ? std::max(frame_interval_, interval(idle_fps)) : 0;
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["html/interval"]      = frame_interval_;
+        state_["html/idle-interval"] = idle_interval_;
+    }
+
+    const std::wstring& url() const { return url_; }
+    int                 width() const { return format_desc_.square_width; }
+    int                 height() const { return format_desc_.square_height; }
+    bool                is_closing() const { return closing_; }
+
     void reload()
     {
         html::begin_invoke([=] {
@@ -145,52 +256,39 @@ class html_client
         });
     }
 
-    bool try_pop(const core::video_field field)
+    // The browser is driven by external begin frames, one for each field the channel receives, so that it renders
+    // exactly one frame per field, in step with the channel
+    core::draw_frame receive(const core::video_field field)
     {
-        std::lock_guard<std::mutex> lock(frames_mutex_);
-
-        if (!frames_.empty()) {
-            /*
-             * CEF in gpu-enabled mode only sends frames when something changes, and interlaced channels
-             * consume two frames in a short time span.
-             * This can interact poorly and cause the second
-             * field of an animation repeat the first.
-             * If there is a single field in the buffer, it may
-             * want delaying to avoid this stutter.
-             * The hazard here is that sometimes animations will
-             * start a field later than intended.
-             */
-            if (field == core::video_field::a && frames_.size() == 1) {
-                auto now_time = now();
+        received_at_ = std::chrono::steady_clock::now().time_since_epoch().count();
+        flush_javascript();
 
-                // Make sure there has been a gap before this pop, of at least a couple of frames
-                auto follows_gap_in_frames = (now_time - last_frame_time_) > 100;
-
-                // Check if the sole buffered frame is too young to have a partner field generated (with a tolerance)
-                auto time_per_frame           = (1000 * 1.5) / format_desc_.fps;
-                auto front_frame_is_too_young = (now_time - frames_.front().first) < time_per_frame;
-
-                if (follows_gap_in_frames && front_frame_is_too_young) {
-                    return false;
-                }
+        {
+            std::lock_guard<std::mutex> lock(painted_mutex_);
+
+            if (painted_) {
+                auto& painted = *painted_;
+                last_frame_   = painted.frame ? core::draw_frame(painted.frame.with_damage(std::move(painted.damage)))
+                                              : core::draw_frame::empty();
+                painted_.reset();
+                idle_ticks_ = 0;
             }
-
-            last_frame_time_ = frames_.front().first;
-            last_frame_      = std::move(frames_.front().second);
-            frames_.pop();
-
-            graph_->set_value("buffered-frames", (double)frames_.size() / frames_max_size_);
-
-            return true;
         }
 
-        return false;
-    }
-
-    core::draw_frame receive(const core::video_field field)
-    {
-        if (!try_pop(field)) {
-            graph_->set_tag(diagnostics::tag_severity::SILENT, "late-frame");
+        // Frames are begun at the rate of the page, or about once a second when it is hidden, which keeps its
+        // animations running in time at a fraction of the cost. Browsers only paint what changed, so a page that has
+        // not painted for a second is idle, and is rendered at its idle rate until it paints or is called again.
+        // While the channel is behind, frames are begun less often, so that it catches up rather than stalls.
+        const auto tick_rate = static_cast<int>(format_desc_.fps);
+        const auto idle      = idle_interval_ > 0 && idle_ticks_ >= tick_rate;
+        const auto base      = idle ? idle_interval_ : frame_interval_;
+        const auto interval  = hidden_ ? tick_rate : std::max(base, std::min(tick_rate, base * (1 + behind_)));
+        if (idle_ticks_ < tick_rate) {
+            ++idle_ticks_;
+        }
+        if (++ticks_ >= interval) {
+            ticks_ = 0;
+            begin_frame();
         }
 
         return last_frame_;
@@ -198,19 +296,35 @@ class html_client
 
     core::draw_frame last_frame() const { return last_frame_; }
 
+    void set_visible(bool visible) { hidden_ = !visible; }
+
+    void set_behind(int ticks) { behind_ = ticks; }
+
     bool is_ready() const
     {
-        std::lock_guard<std::mutex> lock(frames_mutex_);
-        return !frames_.empty() || last_frame_;
+        std::lock_guard<std::mutex> lock(painted_mutex_);
+        return painted_ || last_frame_;
     }
 
+    // Queued until the next tick, which hands everything called since the one before to the browser in a single task.
+    // An update replaces one queued right before it, as only the data of the last would ever be shown.
     void execute_javascript(const std::wstring& javascript)
     {
-        if (!loaded_) {
-            javascript_before_load_.push(javascript);
-        } else {
-            execute_queued_javascript();
-            do_execute_javascript(javascript);
+        {
+            std::lock_guard<std::mutex> lock(javascript_mutex_);
+            if (is_update(javascript) && !javascript_.empty() && is_update(javascript_.back())) {
+                javascript_.back() = javascript;
+            } else {
+                javascript_.push_back(javascript);
+            }
+        }
+
+        // Calls usually change the page, which is rendered at its full rate again from the next tick
+        idle_ticks_ = 0;
+
+        // Nothing ticks a producer that is not on a layer of a running channel, which must not hold its calls back
+        if (!is_ticking()) {
+            flush_javascript();
         }
     }
 
@@ -247,11 +361,12 @@ class html_client
     }
 
   private:
-    std::int_least64_t now()
+    void begin_frame()
     {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(
-                   std::chrono::high_resolution_clock::now().time_since_epoch())
-            .count();
+        html::begin_invoke([=] {
+            if (browser_ != nullptr && !closing_)
+                browser_->GetHost()->SendExternalBeginFrame();
+        });
     }
 
     void GetViewRect(CefRefPtr<CefBrowser> browser, CefRect& rect) override
@@ -281,36 +396,82 @@ class html_client
         core::pixel_format_desc pixel_desc(core::pixel_format::bgra);
         pixel_desc.planes.emplace_back(width, height, 4);
 
-        core::mutable_frame frame = frame_factory_->create_frame(this, pixel_desc);
-        char*               src   = (char*)buffer;
-        char*               dst   = reinterpret_cast<char*>(frame.image_data(0).begin());
+        // buffer always holds the whole view, but only the dirty areas of it are uploaded on top of a GPU copy of the
+        // previous paint
+        auto image  = array<const std::uint8_t>(static_cast<const std::uint8_t*>(buffer), width * height * 4, nullptr);
+        auto damage = to_damage(dirtyRects);
         test_timer_.restart();
+        last_paint_ = core::const_frame(frame_factory_->update_frame(this, last_paint_, pixel_desc, image, damage));
+        graph_->set_value("memcpy", test_timer_.elapsed() * format_desc_.fps * 0.5 * 5);
+
+        push_frame(last_paint_, std::move(damage));
+    }
+
+    void OnAcceleratedPaint(CefRefPtr<CefBrowser>          browser,
+                            PaintElementType               type,
+                            const RectList&                dirtyRects,
+                            const CefAcceleratedPaintInfo& info) override
+    {
+        if (closing_)
+            return;
 
+        graph_->set_value("browser-tick-time", paint_timer_.elapsed() * format_desc_.fps * 0.5);
+        paint_timer_.restart();
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        if (type != PET_VIEW || info.format != CEF_COLOR_TYPE_BGRA_8888)
+            return;
+
+        core::shared_texture texture;
+        texture.width  = format_desc_.square_width;
+        texture.height = format_desc_.square_height;
 #ifdef WIN32
-        if (gpu_enabled_) {
-            int chunksize = height * width;
-            tbb::parallel_for(0, 4, [&](int y) { std::memcpy(dst + y * chunksize, src + y * chunksize, chunksize); });
-        } else {
-            std::memcpy(dst, src, width * height * 4);
-        }
+        texture.handle = info.shared_texture_handle;
 #else
-        // On my one test linux machine, doing a single memcpy doesn't have the same cost as windows,
-        // making using tbb excessive
-        std::memcpy(dst, src, width * height * 4);
+        for (int n = 0; n < info.plane_count; ++n) {
+            texture.planes.push_back(core::shared_texture::plane{info.planes[n].fd,
+                                                                 static_cast<std::uint32_t>(info.planes[n].stride),
+                                                                 static_cast<std::uint64_t>(info.planes[n].offset)});
+        }
+        texture.modifier = info.modifier;
 #endif
 
+        // The texture is copied on the GPU before import_frame returns, as CEF reuses it once this returns
+        test_timer_.restart();
+        try {
+            last_paint_ = core::const_frame(frame_factory_->import_frame(this, texture));
+            push_frame(last_paint_, to_damage(dirtyRects));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
         graph_->set_value("memcpy", test_timer_.elapsed() * format_desc_.fps * 0.5 * 5);
+    }
 
-        {
-            std::lock_guard<std::mutex> lock(frames_mutex_);
+    static std::vector<core::damage_rect> to_damage(const RectList& dirtyRects)
+    {
+        std::vector<core::damage_rect> damage;
+        for (auto& rect : dirtyRects) {
+            damage.push_back(core::damage_rect{rect.x, rect.y, rect.width, rect.height});
+        }
+        return damage;
+    }
 
-            frames_.push(std::make_pair(now(), core::draw_frame(std::move(frame))));
-            while (frames_.size() > 4) {
-                frames_.pop();
-                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+    void push_frame(const core::const_frame& frame, std::vector<core::damage_rect> damage)
+    {
+        std::lock_guard<std::mutex> lock(painted_mutex_);
+
+        if (painted_) {
+            // Browsers paint once per begin frame, unless a paint is forced by e.g. a resize or invalidation. The
+            // damage of the paint that was never received has to be covered as well.
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            if (painted_->damage.empty() || damage.empty()) {
+                damage.clear();
+            } else {
+                add_damage(damage, painted_->damage);
             }
-            graph_->set_value("buffered-frames", (double)frames_.size() / frames_max_size_);
         }
+        painted_ = painted_frame{frame, std::move(damage)};
     }
 
     void OnAfterCreated(CefRefPtr<CefBrowser> browser) override
@@ -318,6 +479,11 @@ class html_client
         CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
 
         browser_ = std::move(browser);
+
+        if (!pending_url_.empty()) {
+            browser_->GetMainFrame()->LoadURL(pending_url_);
+            pending_url_.clear();
+        }
     }
 
     void OnBeforeClose(CefRefPtr<CefBrowser> browser) override
@@ -363,8 +529,18 @@ class html_client
 
     void OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, int httpStatusCode) override
     {
+        // Pooled browsers are parked on a blank page, which may finish loading after the browser was handed out
+        if (frame->IsMain() && frame->GetURL().ToWString() == BLANK_URL && url_ != BLANK_URL) {
+            return;
+        }
+
         loaded_ = true;
-        execute_queued_javascript();
+        flush_javascript();
+
+        // Paints the loaded page, so that the producer is ready before the channel has begun any frames
+        if (frame->IsMain()) {
+            begin_frame();
+        }
     }
 
     bool OnProcessMessageReceived(CefRefPtr<CefBrowser>        browser,
@@ -379,8 +555,8 @@ class html_client
             this->close();
 
             {
-                std::lock_guard<std::mutex> lock(frames_mutex_);
-                frames_.push(std::make_pair(now(), core::draw_frame::empty()));
+                std::lock_guard<std::mutex> lock(painted_mutex_);
+                painted_ = painted_frame{};
             }
 
             {
@@ -401,21 +577,39 @@ class html_client
         return false;
     }
 
-    void do_execute_javascript(const std::wstring& javascript)
+    static bool is_update(const std::wstring& javascript) { return boost::starts_with(javascript, L"update("); }
+
+    bool is_ticking() const
     {
-        html::begin_invoke([=] {
-            if (browser_ != nullptr)
-                browser_->GetMainFrame()->ExecuteJavaScript(
-                    u8(javascript).c_str(), browser_->GetMainFrame()->GetURL(), 0);
-        });
+        auto since = std::chrono::steady_clock::now().time_since_epoch().count() - received_at_;
+        return since < static_cast<int64_t>(2.0 / format_desc_.fps * 1e9);
     }
 
-    void execute_queued_javascript()
+    // Each call is executed on its own, so that one that throws does not stop the ones after it
+    void flush_javascript()
     {
-        std::wstring javascript;
+        if (!loaded_) {
+            return;
+        }
 
-        while (javascript_before_load_.try_pop(javascript))
-            do_execute_javascript(javascript);
+        std::vector<std::wstring> javascript;
+        {
+            std::lock_guard<std::mutex> lock(javascript_mutex_);
+            javascript.swap(javascript_);
+        }
+        if (javascript.empty()) {
+            return;
+        }
+
+        html::begin_invoke([=] {
+            if (browser_ == nullptr)
+                return;
+
+            auto frame = browser_->GetMainFrame();
+            for (auto& call : javascript) {
+                frame->ExecuteJavaScript(u8(call).c_str(), frame->GetURL(), 0);
+            }
+        });
     }
 
     std::wstring print() const
@@ -427,6 +621,192 @@ class html_client
     IMPLEMENT_REFCOUNTING(html_client);
 };
 
+// Creates a client with a browser that paints off screen at the size of the format
+CefRefPtr<html_client> create_client(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                     const core::video_format_desc&              format_desc,
+                                     const std::wstring&                         url)
+{
+    CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+    const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+
+    CefRefPtr<html_client> client = new html_client(frame_factory, format_desc, url);
+
+    CefWindowInfo window_info;
+    window_info.bounds.width                 = format_desc.square_width;
+    window_info.bounds.height                = format_desc.square_height;
+    window_info.windowless_rendering_enabled = true;
+    window_info.external_begin_frame_enabled = true;
+    // Paint to a texture shared with the accelerator rather than to host memory when it can import them
+    window_info.shared_texture_enabled = enable_gpu &&
+                                         env::properties().get(L"configuration.html.shared-texture", true) &&
+                                         frame_factory->supports_shared_textures();
+
+    CefBrowserSettings browser_settings;
+    browser_settings.webgl = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
+    CefBrowserHost::CreateBrowser(window_info, client.get(), url, browser_settings, nullptr, nullptr);
+
+    return client;
+}
+
+// Browsers that are kept open between producers, so that a producer does not have to wait for a browser to be
+// created. They are either parked on a blank page, or have a template loaded by CG PRELOAD. Idle browsers get no begin
+// frames, so they only cost memory, which is capped by the number of them. Only used from the CEF UI thread.
+class browser_pool
+{
+    struct entry
+    {
+        CefRefPtr<html_client>                client;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    class eviction_task : public CefTask
+    {
+      public:
+        void Execute() override { browser_pool::instance().evict(); }
+
+        IMPLEMENT_REFCOUNTING(eviction_task);
+    };
+
+    std::vector<entry>         entries_;
+    const size_t               blank_browsers_ = env::properties().get(L"configuration.html.pool.blank-browsers", 0);
+    const size_t               max_browsers_   = env::properties().get(L"configuration.html.pool.max-browsers", 4);
+    const std::chrono::seconds idle_timeout_{env::properties().get(L"configuration.html.pool.idle-timeout", 300)};
+    bool                       eviction_scheduled_ = false;
+
+  public:
+    static browser_pool& instance()
+    {
+        static browser_pool pool;
+        return pool;
+    }
+
+    // A browser of the size of the format with url loaded, or loading it, or nullptr when there is none
+    CefRefPtr<html_client> take(const std::wstring& url, const core::video_format_desc& format_desc)
+    {
+        auto it = find(url, format_desc);
+        if (it == entries_.end()) {
+            it = find(BLANK_URL, format_desc);
+        }
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+
+        auto client = it->client;
+        entries_.erase(it);
+
+        if (client->url() != url) {
+            client->load(url);
+        }
+        return client;
+    }
+
+    // Loads url into a browser of the pool in the background
+    void preload(const std::wstring&                         url,
+                 const spl::shared_ptr<core::frame_factory>& frame_factory,
+                 const core::video_format_desc&              format_desc)
+    {
+        auto it = find(url, format_desc);
+        if (it != entries_.end()) {
+            it->since = std::chrono::steady_clock::now();
+            return;
+        }
+
+        auto client = take(url, format_desc);
+        if (client == nullptr) {
+            client = create_client(frame_factory, format_desc, url);
+        }
+        add(std::move(client));
+    }
+
+    // Keeps the browser of a producer that is gone, when the pool wants another blank browser of its size
+    void put(CefRefPtr<html_client> client)
+    {
+        if (client->is_closing() || blank_browsers(client->width(), client->height()) >= blank_browsers_ ||
+            entries_.size() >= max_browsers_) {
+            client->close();
+            return;
+        }
+
+        client->detach();
+        add(std::move(client));
+    }
+
+    // Creates blank browsers of the size of the format, up to the number the pool keeps ready of each size
+    void fill(const spl::shared_ptr<core::frame_factory>& frame_factory, const core::video_format_desc& format_desc)
+    {
+        auto blank = blank_browsers(format_desc.square_width, format_desc.square_height);
+        for (; blank < blank_browsers_ && entries_.size() < max_browsers_; ++blank) {
+            add(create_client(frame_factory, format_desc, BLANK_URL));
+        }
+    }
+
+    void evict()
+    {
+        eviction_scheduled_ = false;
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (idle_timeout_.count() > 0 && now - it->since > idle_timeout_) {
+                it->client->close();
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        schedule_eviction();
+    }
+
+    void clear()
+    {
+        for (auto& entry : entries_) {
+            entry.client->close();
+        }
+        entries_.clear();
+    }
+
+  private:
+    void add(CefRefPtr<html_client> client)
+    {
+        entries_.push_back(entry{std::move(client), std::chrono::steady_clock::now()});
+
+        // The least recently used browsers are closed beyond the cap
+        while (entries_.size() > max_browsers_) {
+            entries_.front().client->close();
+            entries_.erase(entries_.begin());
+        }
+
+        schedule_eviction();
+    }
+
+    std::vector<entry>::iterator find(const std::wstring& url, const core::video_format_desc& format_desc)
+    {
+        return std::find_if(entries_.begin(), entries_.end(), [&](const entry& entry) {
+            return entry.client->url() == url && entry.client->width() == format_desc.square_width &&
+                   entry.client->height() == format_desc.square_height;
+        });
+    }
+
+    size_t blank_browsers(int width, int height) const
+    {
+        return std::count_if(entries_.begin(), entries_.end(), [&](const entry& entry) {
+            return entry.client->url() == BLANK_URL && entry.client->width() == width &&
+                   entry.client->height() == height;
+        });
+    }
+
+    void schedule_eviction()
+    {
+        if (eviction_scheduled_ || entries_.empty() || idle_timeout_.count() == 0) {
+            return;
+        }
+
+        eviction_scheduled_ = true;
+        CefPostDelayedTask(TID_UI, new eviction_task(), 1000);
+    }
+};
+
 class html_producer : public core::frame_producer
 {
     core::video_format_desc             format_desc_;
@@ -438,32 +818,31 @@ class html_producer : public core::frame_producer
   public:
     html_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
                   const core::video_format_desc&              format_desc,
-                  const std::wstring&                         url)
+                  const std::wstring&                         url,
+                  double                                      fps      = 0.0,
+                  double                                      idle_fps = 0.0)
         : format_desc_(format_desc)
         , url_(url)
     {
         html::invoke([&] {
-            const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+            auto& pool = browser_pool::instance();
 
-            client_ = new html_client(frame_factory, graph_, format_desc, enable_gpu, url_);
-
-            CefWindowInfo window_info;
-            window_info.bounds.width                 = format_desc.square_width;
-            window_info.bounds.height                = format_desc.square_height;
-            window_info.windowless_rendering_enabled = true;
+            client_ = pool.take(url_, format_desc);
+            if (client_ == nullptr) {
+                client_ = create_client(frame_factory, format_desc, url_);
+            }
+            client_->attach(frame_factory, graph_, format_desc);
+            client_->set_frame_rates(fps, idle_fps);
 
-            CefBrowserSettings browser_settings;
-            browser_settings.webgl = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
-            double fps             = format_desc.fps;
-            browser_settings.windowless_frame_rate = int(ceil(fps));
-            CefBrowserHost::CreateBrowser(window_info, client_.get(), url, browser_settings, nullptr, nullptr);
+            // Get a browser ready for the next producer of this size
+            pool.fill(frame_factory, format_desc);
         });
     }
 
     ~html_producer() override
     {
         if (client_ != nullptr)
-            client_->close();
+            html::invoke([&] { browser_pool::instance().put(client_); });
     }
 
     // frame_producer
@@ -489,6 +868,20 @@ class html_producer : public core::frame_producer
         return false;
     }
 
+    void set_visible(bool visible) override
+    {
+        if (client_ != nullptr) {
+            client_->set_visible(visible);
+        }
+    }
+
+    void set_budget(const core::frame_budget& budget) override
+    {
+        if (client_ != nullptr) {
+            client_->set_behind(budget.behind);
+        }
+    }
+
     core::draw_frame last_frame(const core::video_field field) override
     {
         if (client_ != nullptr) {
@@ -527,8 +920,10 @@ class html_producer : public core::frame_producer
     }
 };
 
-spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_producer_dependencies& dependencies,
-                                                         const std::vector<std::wstring>&         params)
+// The url of the page that the parameters of a producer refer to and the format it is rendered at, or nothing when they
+// do not refer to one
+std::optional<std::pair<std::wstring, core::video_format_desc>>
+find_page(const core::frame_producer_dependencies& dependencies, const std::vector<std::wstring>& params)
 {
     const auto html_prefix    = boost::iequals(params.at(0), L"[HTML]");
     const auto param_url      = html_prefix ? params.at(1) : params.at(0);
@@ -538,7 +933,7 @@ spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_produ
         boost::algorithm::istarts_with(param_url, L"http:") || boost::algorithm::istarts_with(param_url, L"https:");
 
     if (!found_filename && !http_prefix && !html_prefix)
-        return core::frame_producer::empty();
+        return {};
 
     const auto url = found_filename ? L"file://" + *found_filename : param_url;
 
@@ -565,7 +960,36 @@ spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_produ
         format_desc.square_height = *height;
     }
 
-    return spl::make_shared<html_producer>(dependencies.frame_factory, format_desc, url);
+    return std::make_pair(url, format_desc);
+}
+
+spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_producer_dependencies& dependencies,
+                                                         const std::vector<std::wstring>&         params)
+{
+    auto page = find_page(dependencies, params);
+    if (!page)
+        return core::frame_producer::empty();
+
+    // For templates that animate at a lower rate than the channel, or are still most of the time
+    auto fps      = get_param(L"FPS", params, 0.0);
+    auto idle_fps = get_param(L"IDLE_FPS", params, 0.0);
+
+    return spl::make_shared<html_producer>(dependencies.frame_factory, page->second, page->first, fps, idle_fps);
+}
+
+bool preload_cg_producer(const core::frame_producer_dependencies& dependencies, const std::wstring& filename)
+{
+    auto page = find_page(dependencies, {filename});
+    if (!page)
+        return false;
+
+    html::invoke([&] { browser_pool::instance().preload(page->first, dependencies.frame_factory, page->second); });
+    return true;
+}
+
+void close_pooled_browsers()
+{
+    html::invoke([] { browser_pool::instance().clear(); });
 }
 
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
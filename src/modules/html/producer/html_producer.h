@@ -34,5 +34,9 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
                                                       const std::vector<std::wstring>&         params);
 spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_producer_dependencies& dependencies,
                                                          const std::vector<std::wstring>&         params);
+// Loads a template into a pooled browser in the background, so that a producer of it is ready at once. False when the
+// filename does not refer to a page.
+bool preload_cg_producer(const core::frame_producer_dependencies& dependencies, const std::wstring& filename);
+void close_pooled_browsers();
 
 }} // namespace caspar::html
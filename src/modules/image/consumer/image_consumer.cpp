@@ -25,15 +25,26 @@
 #include <common/array.h>
 #include <common/env.h>
 #include <common/except.h>
+#include <common/executor.h>
 #include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/scope_exit.h>
 
 #include <core/consumer/channel_info.h>
 #include <core/frame/frame.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -55,6 +66,7 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
 }
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -62,12 +74,232 @@ extern "C" {
 
 namespace caspar::image {
 
+std::optional<AVCodecID> codec_from_extension(const std::wstring& filename)
+{
+    auto extension = boost::to_lower_copy(boost::filesystem::path(filename).extension().wstring());
+    if (extension == L".png")
+        return AV_CODEC_ID_PNG;
+    if (extension == L".jpg" || extension == L".jpeg")
+        return AV_CODEC_ID_MJPEG;
+    if (extension == L".webp")
+        return AV_CODEC_ID_WEBP;
+    return {};
+}
+
+struct encode_options
+{
+    std::string filename;
+    AVCodecID   codec_id = AV_CODEC_ID_PNG;
+    int         width    = 0;
+    int         height   = 0;
+};
+
+// Encodes snapshots on a fixed number of workers, each reusing its codec and scaling contexts. A snapshot arriving
+// while every worker is busy is dropped rather than queued, so that periodic thumbnailing cannot build up a backlog.
+// Thumbnails of clips are queued instead, see encode_image.
+class encoder_pool
+{
+    struct worker
+    {
+        // Only used on the executor thread
+        std::map<std::tuple<AVCodecID, int, int>, std::shared_ptr<AVCodecContext>> contexts;
+        std::unique_ptr<SwsContext, void (*)(SwsContext*)>                       sws{nullptr, sws_freeContext};
+
+        std::atomic<int>  pending{0}; // Frames queued or being encoded
+        caspar::executor  executor{L"image_encoder"};
+    };
+
+    std::vector<std::unique_ptr<worker>> workers_;
+
+    encoder_pool()
+    {
+        auto count = std::max(1, env::properties().get(L"configuration.image.encoder-threads", 2));
+        for (int n = 0; n < count; ++n) {
+            workers_.push_back(std::make_unique<worker>());
+        }
+    }
+
+    static std::shared_ptr<AVCodecContext>
+    open_context(AVCodecID codec_id, int width, int height, AVPixelFormat pix_fmt)
+    {
+        const AVCodec* codec = avcodec_find_encoder(codec_id);
+        if (!codec)
+            FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
+
+        auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                                   [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+
+        ctx->width     = width;
+        ctx->height    = height;
+        ctx->pix_fmt   = pix_fmt;
+        ctx->time_base = {1, 1};
+        ctx->framerate = {0, 1};
+
+        if (codec_id == AV_CODEC_ID_MJPEG) {
+            ctx->color_range    = AVCOL_RANGE_JPEG;
+            ctx->global_quality = FF_QP2LAMBDA * 3;
+            ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        }
+
+        FF(avcodec_open2(ctx.get(), codec, nullptr));
+
+        return ctx;
+    }
+
+    static void encode(worker& worker, const core::const_frame& frame, const encode_options& options)
+    {
+        if (frame.pixel_format_desc().format != core::pixel_format::bgra)
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("image_consumer received frame with wrong format"));
+
+        auto src_width  = static_cast<int>(frame.width());
+        auto src_height = static_cast<int>(frame.height());
+
+        auto width  = options.width;
+        auto height = options.height;
+        if (width <= 0 && height <= 0) {
+            width  = src_width;
+            height = src_height;
+        } else if (width <= 0) {
+            width = std::max(1, src_width * height / src_height);
+        } else if (height <= 0) {
+            height = std::max(1, src_height * width / src_width);
+        }
+
+        // Jpeg has no alpha, which drops it as if the premultiplied frame was composited on black. The other encoders
+        // require RGB ordering, where the mixer produces BGR.
+        auto pix_fmt = options.codec_id == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_RGBA;
+
+        auto key = std::make_tuple(options.codec_id, width, height);
+        auto it  = worker.contexts.find(key);
+        if (it == worker.contexts.end()) {
+            it = worker.contexts.emplace(key, open_context(options.codec_id, width, height, pix_fmt)).first;
+        }
+        auto ctx = it->second;
+
+        // Scaling down to the requested size is done here as well, off the channel
+        worker.sws.reset(sws_getCachedContext(worker.sws.release(),
+                                              src_width,
+                                              src_height,
+                                              AV_PIX_FMT_BGRA,
+                                              width,
+                                              height,
+                                              pix_fmt,
+                                              SWS_BILINEAR,
+                                              nullptr,
+                                              nullptr,
+                                              nullptr));
+        if (!worker.sws) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to create SwsContext"));
+        }
+
+        auto av_frame    = ffmpeg::alloc_frame();
+        av_frame->width  = width;
+        av_frame->height = height;
+        av_frame->format = pix_fmt;
+        av_frame->pts    = 0;
+        FF(av_frame_get_buffer(av_frame.get(), 64));
+
+        const uint8_t* src_data[]     = {frame.image_data(0).data()};
+        const int      src_linesize[] = {src_width * 4};
+        sws_scale(worker.sws.get(), src_data, src_linesize, 0, src_height, av_frame->data, av_frame->linesize);
+
+        if (pix_fmt == AV_PIX_FMT_RGBA) {
+            // Also straighten the alpha, as png and webp are always straight, and the mixer produces premultiplied
+            for (int y = 0; y < height; ++y) {
+                image_view<bgra_pixel> row(av_frame->data[0] + y * av_frame->linesize[0], width, 1);
+                unmultiply(row);
+            }
+        }
+
+        std::fstream file_stream(options.filename, std::fstream::out | std::fstream::trunc | std::fstream::binary);
+        if (!file_stream)
+            FF_RET(AVERROR(EINVAL), "fstream_open");
+
+        auto pkt = std::shared_ptr<AVPacket>(av_packet_alloc(), [](AVPacket* ptr) { av_packet_free(&ptr); });
+        auto receive = [&] {
+            int packets = 0;
+            while (true) {
+                int ret = avcodec_receive_packet(ctx.get(), pkt.get());
+                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                    break;
+                FF_RET(ret, "avcodec_receive_packet");
+
+                file_stream.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
+                av_packet_unref(pkt.get());
+                ++packets;
+            }
+            return packets;
+        };
+
+        // Still image encoders have no delay, so the context is left open for the next snapshot. Should one hold the
+        // packet back anyway, it is drained and not reused.
+        FF(avcodec_send_frame(ctx.get(), av_frame.get()));
+        if (receive() == 0) {
+            worker.contexts.erase(key);
+            FF(avcodec_send_frame(ctx.get(), nullptr));
+            receive();
+        }
+    }
+
+  public:
+    static encoder_pool& instance()
+    {
+        static encoder_pool pool;
+        return pool;
+    }
+
+    bool try_encode(core::const_frame frame, encode_options options)
+    {
+        for (auto& worker : workers_) {
+            int idle = 0;
+            if (!worker->pending.compare_exchange_strong(idle, 1)) {
+                continue;
+            }
+
+            auto w = worker.get();
+            w->executor.begin_invoke([w, frame = std::move(frame), options = std::move(options)] {
+                try {
+                    encode(*w, frame, options);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+                w->pending -= 1;
+            });
+            return true;
+        }
+        return false;
+    }
+
+    // Queues the frame on the worker with the fewest frames pending, which then rejects snapshots until it is done
+    std::future<void> encode(core::const_frame frame, encode_options options)
+    {
+        auto w = std::min_element(workers_.begin(), workers_.end(), [](auto& lhs, auto& rhs) {
+                     return lhs->pending < rhs->pending;
+                 })->get();
+
+        w->pending += 1;
+        return w->executor.begin_invoke([w, frame = std::move(frame), options = std::move(options)] {
+            CASPAR_SCOPE_EXIT
+            {
+                w->pending -= 1;
+            };
+            encode(*w, frame, options);
+        });
+    }
+};
+
 struct image_consumer : public core::frame_consumer
 {
     const std::wstring filename_;
+    const AVCodecID    codec_id_;
+    const int          width_;
+    const int          height_;
 
-    explicit image_consumer(std::wstring filename)
+    explicit image_consumer(std::wstring filename, AVCodecID codec_id, int width, int height)
         : filename_(std::move(filename))
+        , codec_id_(codec_id)
+        , width_(width)
+        , height_(height)
     {
     }
 
@@ -75,81 +307,25 @@ struct image_consumer : public core::frame_consumer
 
     std::future<bool> send(core::video_field field, core::const_frame frame) override
     {
-        auto filename = filename_;
+        encode_options options;
+        options.codec_id = codec_id_;
+        options.width    = width_;
+        options.height   = height_;
 
-        std::thread async([frame, filename] {
-            try {
-                std::string filename2;
-
-                if (frame.pixel_format_desc().format != core::pixel_format::bgra)
-                    CASPAR_THROW_EXCEPTION(caspar_exception()
-                                           << msg_info("image_consumer received frame with wrong format"));
-
-                if (filename.empty())
-                    filename2 =
-                        u8(env::media_folder() +
-                           boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) + L".png");
-                else
-                    filename2 = u8(env::media_folder() + filename + L".png");
-
-                std::fstream file_stream(filename2, std::fstream::out | std::fstream::trunc | std::fstream::binary);
-                if (!file_stream)
-                    FF_RET(AVERROR(EINVAL), "fstream_open");
-
-                const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
-                if (!codec)
-                    FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
-
-                auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
-                                                           [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
-
-                ctx->width     = static_cast<int>(frame.width());
-                ctx->height    = static_cast<int>(frame.height());
-                ctx->pix_fmt   = AV_PIX_FMT_RGBA;
-                ctx->time_base = {1, 1};
-                ctx->framerate = {0, 1};
-
-                FF(avcodec_open2(ctx.get(), codec, nullptr));
-
-                auto av_frame         = ffmpeg::alloc_frame();
-                av_frame->width       = static_cast<int>(frame.width());
-                av_frame->height      = static_cast<int>(frame.height());
-                av_frame->format      = AV_PIX_FMT_BGRA;
-                av_frame->pts         = 0;
-                av_frame->linesize[0] = static_cast<int>(frame.width()) * 4;
-                av_frame->data[0]     = const_cast<uint8_t*>(frame.image_data(0).data());
-
-                // The png encoder requires RGB ordering, the mixer producers BGR.
-                auto av_frame2 = convert_image_frame(av_frame, AV_PIX_FMT_RGBA);
-                // Also straighten the alpha, as png is always straight, and the mixer produces premultiplied
-                image_view<bgra_pixel> original_view(av_frame2->data[0], av_frame2->width, av_frame2->height);
-                unmultiply(original_view);
-
-                FF(avcodec_send_frame(ctx.get(), av_frame2.get()));
-                FF(avcodec_send_frame(ctx.get(), nullptr));
-
-                auto pkt = std::shared_ptr<AVPacket>(av_packet_alloc(), [](AVPacket* ptr) { av_packet_free(&ptr); });
-                int  ret = 0;
-                while (ret >= 0) {
-                    ret = avcodec_receive_packet(ctx.get(), pkt.get());
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                        break;
-                    FF_RET(ret, "avcodec_receive_packet");
-
-                    file_stream.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
-                    av_packet_unref(pkt.get());
-                }
+        auto filename = filename_;
+        if (filename.empty())
+            filename = boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time());
+        if (!codec_from_extension(filename))
+            filename += L".png";
+        options.filename = u8(env::media_folder() + filename);
 
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION()
-            }
-        });
-        async.detach();
+        if (!encoder_pool::instance().try_encode(std::move(frame), std::move(options)))
+            CASPAR_LOG(warning) << print() << L" All encoders are busy, dropped snapshot.";
 
         return make_ready_future(false);
     }
 
-    std::wstring print() const override { return L"image[]"; }
+    std::wstring print() const override { return L"image[" + filename_ + L"]"; }
 
     std::wstring name() const override { return L"image"; }
 
@@ -163,6 +339,14 @@ struct image_consumer : public core::frame_consumer
     }
 };
 
+std::future<void> encode_image(core::const_frame frame, const std::wstring& filename)
+{
+    encode_options options;
+    options.filename = u8(filename);
+    options.codec_id = codec_from_extension(filename).value_or(AV_CODEC_ID_PNG);
+    return encoder_pool::instance().encode(std::move(frame), std::move(options));
+}
+
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
                                                       const core::video_format_repository& format_repository,
                                                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
@@ -176,10 +360,14 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     std::wstring filename;
 
-    if (params.size() > 1)
+    if (params.size() > 1 && !boost::iequals(params.at(1), L"WIDTH") && !boost::iequals(params.at(1), L"HEIGHT"))
         filename = params.at(1);
 
-    return spl::make_shared<image_consumer>(filename);
+    auto codec_id = codec_from_extension(filename).value_or(AV_CODEC_ID_PNG);
+    auto width  = get_param(L"WIDTH", params, 0);
+    auto height = get_param(L"HEIGHT", params, 0);
+
+    return spl::make_shared<image_consumer>(filename, codec_id, width, height);
 }
 
 } // namespace caspar::image
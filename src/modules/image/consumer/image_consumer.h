@@ -26,12 +26,18 @@
 
 #include <boost/property_tree/ptree_fwd.hpp>
 #include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
 
+#include <future>
 #include <string>
 #include <vector>
 
 namespace caspar { namespace image {
 
+// Encodes a bgra frame to filename, as png, jpeg or webp by its extension, on the encoders of the image consumer.
+// Unlike a snapshot, it waits for an encoder rather than being dropped when all of them are busy.
+std::future<void> encode_image(core::const_frame frame, const std::wstring& filename);
+
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
                                                       const core::video_format_repository& format_repository,
                                                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
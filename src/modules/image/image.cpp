@@ -24,16 +24,101 @@
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
 #include "producer/image_scroll_producer.h"
+#include "producer/image_sequence_producer.h"
+#include "util/thumbnail_generator.h"
 
+#include <common/base64.h>
+#include <common/env.h>
+#include <common/log.h>
 #include <common/utf.h>
 
+#include <protocol/amcp/amcp_command_repository_wrapper.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <ctime>
+#include <future>
+#include <iomanip>
+#include <sstream>
+
 namespace caspar { namespace image {
 
+namespace {
+
+// Held until the module is uninitialized, before the accelerator its mixer was created by goes
+std::shared_ptr<thumbnail_generator> thumbnails;
+
+std::wstring thumbnail_list_command(protocol::amcp::command_context& ctx)
+{
+    std::wstringstream reply;
+    reply << L"200 THUMBNAIL LIST OK\r\n";
+    for (auto& info : thumbnails->list()) {
+        std::tm tm = {};
+#ifdef _MSC_VER
+        localtime_s(&tm, &info.mtime);
+#else
+        localtime_r(&info.mtime, &tm);
+#endif
+        reply << L"\"" << boost::to_upper_copy(info.clip) << L"\" " << std::put_time(&tm, L"%Y%m%dT%H%M%S") << L" "
+              << info.size << L"\r\n";
+    }
+    reply << L"\r\n";
+    return reply.str();
+}
+
+std::wstring thumbnail_retrieve_command(protocol::amcp::command_context& ctx)
+{
+    auto png = thumbnails->retrieve(ctx.parameters.at(0));
+    if (png.empty()) {
+        return L"404 THUMBNAIL RETRIEVE ERROR\r\n";
+    }
+    return L"201 THUMBNAIL RETRIEVE OK\r\n" + u16(to_base64(png.data(), png.size())) + L"\r\n";
+}
+
+std::future<std::wstring> thumbnail_generate_command(protocol::amcp::command_context& ctx)
+{
+    // Completes once the thumbnail is there, so that the queue of the client goes on with its next command meanwhile
+    auto generated = thumbnails->generate(ctx.parameters.at(0)).share();
+    return std::async(std::launch::deferred, [generated]() -> std::wstring {
+        try {
+            if (generated.get()) {
+                return L"202 THUMBNAIL GENERATE OK\r\n";
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        return L"404 THUMBNAIL GENERATE ERROR\r\n";
+    });
+}
+
+std::wstring thumbnail_generateall_command(protocol::amcp::command_context& ctx)
+{
+    thumbnails->generate_all();
+    return L"202 THUMBNAIL GENERATE_ALL OK\r\n";
+}
+
+} // namespace
+
 void init(const core::module_dependencies& dependencies)
 {
     dependencies.producer_registry->register_producer_factory(L"Image Scroll Producer", create_scroll_producer);
+    dependencies.producer_registry->register_producer_factory(L"Image Sequence Producer", create_sequence_producer);
     dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer);
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
+
+    if (env::properties().get(L"configuration.image.thumbnails", false)) {
+        thumbnails = std::make_shared<thumbnail_generator>(
+            dependencies.create_image_mixer, dependencies.producer_registry, dependencies.cg_registry);
+
+        auto& repo = dependencies.command_repository;
+        repo->register_command(L"Thumbnail Commands", L"THUMBNAIL LIST", thumbnail_list_command, 0);
+        repo->register_command(L"Thumbnail Commands", L"THUMBNAIL RETRIEVE", thumbnail_retrieve_command, 1);
+        repo->register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE", thumbnail_generate_command, 1);
+        repo->register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE_ALL", thumbnail_generateall_command, 0);
+    }
 }
 
+void uninit() { thumbnails.reset(); }
+
 }} // namespace caspar::image
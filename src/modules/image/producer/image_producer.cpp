@@ -22,16 +22,22 @@
 
 #include "image_producer.h"
 
+#include "../util/image_cache.h"
 #include "../util/image_converter.h"
 #include "../util/image_loader.h"
 
 #include <common/base64.h>
 #include <common/env.h>
 #include <common/filesystem.h>
+#include <common/log.h>
 #include <common/param.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <chrono>
+#include <future>
+#include <mutex>
 #include <utility>
 
 namespace caspar { namespace image {
@@ -42,27 +48,21 @@ struct image_producer : public core::frame_producer
     const std::wstring                         description_;
     const spl::shared_ptr<core::frame_factory> frame_factory_;
     const uint32_t                             length_ = 0;
+    std::mutex                                 mutex_;
+    std::shared_future<core::const_frame>      loading_; // Valid until the frame has been loaded
     core::draw_frame                           frame_;
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
                    std::wstring                                description,
                    uint32_t                                    length,
-                   core::frame_geometry::scale_mode            scale_mode)
+                   core::frame_geometry::scale_mode            scale_mode,
+                   bool                                        compress)
         : description_(std::move(description))
         , frame_factory_(frame_factory)
         , length_(length)
+        , loading_(load_frame(description_, frame_factory, scale_mode, compress))
     {
-        auto av_frame = load_image(description_);
-        if (!is_frame_compatible_with_mixer(av_frame))
-            av_frame = convert_image_frame(av_frame, AV_PIX_FMT_BGRA);
-
-        auto frame =
-            ffmpeg::make_frame(this, *frame_factory, av_frame, nullptr, core::color_space::bt709, scale_mode, true);
-        frame_ = core::draw_frame(std::move(frame));
-
         state_["file/path"] = description_;
-
-        CASPAR_LOG(info) << print() << L" Initialized";
     }
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
@@ -86,13 +86,37 @@ struct image_producer : public core::frame_producer
 
     // frame_producer
 
-    core::draw_frame last_frame(const core::video_field field) override { return frame_; }
+    // Empty until the image has been loaded in the background
+    core::draw_frame frame()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (loading_.valid() && loading_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            try {
+                frame_ = core::draw_frame(loading_.get().with_tag(this));
+                CASPAR_LOG(info) << print() << L" Initialized";
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(error) << print() << L" Failed to load";
+            }
+            loading_ = {};
+        }
+        return frame_;
+    }
+
+    core::draw_frame last_frame(const core::video_field field) override { return frame(); }
 
-    core::draw_frame first_frame(const core::video_field field) override { return frame_; }
+    core::draw_frame first_frame(const core::video_field field) override { return frame(); }
 
-    bool is_ready() override { return true; }
+    bool is_ready() override
+    {
+        frame();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !loading_.valid();
+    }
 
-    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override { return frame_; }
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override { return frame(); }
 
     uint32_t nb_frames() const override { return length_; }
 
@@ -113,6 +137,10 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto length     = get_param(L"LENGTH", params, std::numeric_limits<uint32_t>::max());
     auto scale_mode = core::scale_mode_from_string(get_param(L"SCALE_MODE", params, L"STRETCH"));
 
+    // Block compressed on the GPU, for stills that are drawn for long
+    auto compress = contains_param(L"COMPRESS", params) ||
+                    env::properties().get(L"configuration.image.compress", false);
+
     //    if (boost::iequals(params.at(0), L"[PNG_BASE64]")) {
     //        if (params.size() < 2)
     //            return core::frame_producer::empty();
@@ -128,7 +156,8 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
         return core::frame_producer::empty();
     }
 
-    return spl::make_shared<image_producer>(dependencies.frame_factory, filename->wstring(), length, scale_mode);
+    return spl::make_shared<image_producer>(
+        dependencies.frame_factory, filename->wstring(), length, scale_mode, compress);
 }
 
 }} // namespace caspar::image
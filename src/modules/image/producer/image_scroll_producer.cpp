@@ -38,11 +38,14 @@
 #include <boost/date_time.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/scoped_array.hpp>
 
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
 #include <optional>
 #include <utility>
 
@@ -105,11 +108,19 @@ struct image_scroll_producer : public core::frame_producer
 {
     core::monitor::state state_;
 
-    const std::wstring            filename_;
-    std::vector<core::draw_frame> frames_;
-    core::video_format_desc       format_desc_;
-    int                           width_;
-    int                           height_;
+    const std::wstring                         filename_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc                    format_desc_;
+    int                                        width_;
+    int                                        height_;
+
+    // The whole image stays decoded in host memory, but only the tiles around the visible ones are made into frames
+    // and uploaded. Tiles are numbered by their position from 1, in screens from the end the scroll starts at.
+    std::shared_ptr<AVFrame>         av_frame_;
+    std::unique_ptr<uint8_t[]>       blurred_;
+    const uint8_t*                   bytes_      = nullptr;
+    int                              tile_count_ = 0;
+    std::map<int, core::draw_frame> tiles_;
 
     double                                  delta_ = 0.0;
     speed_tweener                           speed_;
@@ -128,6 +139,7 @@ struct image_scroll_producer : public core::frame_producer
                                    int                                         motion_blur_px         = 0,
                                    bool                                        premultiply_with_alpha = false)
         : filename_(std::move(filename))
+        , frame_factory_(frame_factory)
         , format_desc_(std::move(format_desc))
         , end_time_(std::move(end_time))
     {
@@ -172,8 +184,6 @@ struct image_scroll_producer : public core::frame_producer
         if (premultiply_with_alpha)
             premultiply(original_view);
 
-        boost::scoped_array<uint8_t> blurred_copy;
-
         if (motion_blur_px > 0) {
             double angle = 3.14159265 / 2; // Up
 
@@ -184,74 +194,20 @@ struct image_scroll_producer : public core::frame_producer
             else if (horizontal && speed > 0)
                 angle = 0.0; // Right
 
-            blurred_copy.reset(new uint8_t[count]);
-            image_view<bgra_pixel> blurred_view(blurred_copy.get(), width_, height_);
+            blurred_.reset(new uint8_t[count]);
+            image_view<bgra_pixel> blurred_view(blurred_.get(), width_, height_);
             caspar::tweener        blur_tweener(L"easeInQuad");
             blur(original_view, blurred_view, angle, motion_blur_px, blur_tweener);
-            bytes = blurred_copy.get();
+            bytes = blurred_.get();
+        } else {
+            av_frame_ = av_frame;
         }
+        bytes_ = bytes;
 
         if (vertical) {
-            int n = 1;
-
-            while (count > 0) {
-                core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
-                desc.planes.emplace_back(width_, format_desc_.height, 4);
-                auto frame = frame_factory->create_frame(this, desc);
-
-                if (count >= frame.image_data(0).size()) {
-                    std::copy_n(bytes + count - frame.image_data(0).size(),
-                                frame.image_data(0).size(),
-                                frame.image_data(0).begin());
-                    count -= static_cast<int>(frame.image_data(0).size());
-                } else {
-                    memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
-                    std::copy_n(bytes, count, frame.image_data(0).begin() + format_desc_.size - count);
-                    count = 0;
-                }
-
-                core::draw_frame draw_frame(std::move(frame));
-
-                // Set the relative position to the other image fragments
-                draw_frame.transform().image_transform.fill_translation[1] = -n++;
-
-                frames_.push_back(draw_frame);
-            }
-        } else if (horizontal) {
-            int i = 0;
-            while (count > 0) {
-                core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
-                desc.planes.emplace_back(format_desc_.width, height_, 4);
-                auto frame = frame_factory->create_frame(this, desc);
-                if (count >= frame.image_data(0).size()) {
-                    for (int y = 0; y < height_; ++y)
-                        std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
-                                    format_desc_.width * 4,
-                                    frame.image_data(0).begin() + y * format_desc_.width * 4);
-
-                    ++i;
-                    count -= static_cast<int>(frame.image_data(0).size());
-                } else {
-                    memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
-                    auto width2 = width_ % format_desc_.width;
-                    for (int y = 0; y < height_; ++y)
-                        std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
-                                    width2 * 4,
-                                    frame.image_data(0).begin() + y * format_desc_.width * 4);
-
-                    count = 0;
-                }
-
-                frames_.emplace_back(std::move(frame));
-            }
-
-            std::reverse(frames_.begin(), frames_.end());
-
-            // Set the relative positions of the image fragments.
-            for (size_t n = 0; n < frames_.size(); ++n) {
-                double translation                                         = -(static_cast<double>(n) + 1.0);
-                frames_[n].transform().image_transform.fill_translation[0] = translation;
-            }
+            tile_count_ = (height_ + format_desc_.height - 1) / format_desc_.height;
+        } else {
+            tile_count_ = (width_ + format_desc_.width - 1) / format_desc_.width;
         }
 
         CASPAR_LOG(info) << print() << L" Initialized";
@@ -289,42 +245,93 @@ struct image_scroll_producer : public core::frame_producer
         return make_ready_future<std::wstring>(L"");
     }
 
+    core::draw_frame make_tile(int position)
+    {
+        core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
+
+        if (width_ == format_desc_.width) {
+            // Tiles are cut from the bottom up, so the one at the top is padded at its top
+            desc.planes.emplace_back(width_, format_desc_.height, 4);
+            auto frame = frame_factory_->create_frame(this, desc);
+            auto dst   = frame.image_data(0).begin();
+
+            auto end   = height_ - (position - 1) * format_desc_.height;
+            auto begin = std::max(0, end - format_desc_.height);
+            auto rows  = end - begin;
+            if (rows < format_desc_.height) {
+                std::memset(dst, 0, frame.image_data(0).size());
+            }
+            std::copy_n(bytes_ + static_cast<size_t>(begin) * width_ * 4,
+                        static_cast<size_t>(rows) * width_ * 4,
+                        dst + static_cast<size_t>(format_desc_.height - rows) * width_ * 4);
+
+            core::draw_frame draw_frame(std::move(frame));
+
+            // Set the relative position to the other image fragments
+            draw_frame.transform().image_transform.fill_translation[1] = -position;
+            return draw_frame;
+        }
+
+        // Tiles are cut from the left, so the one at the right is padded at its right
+        desc.planes.emplace_back(format_desc_.width, height_, 4);
+        auto frame = frame_factory_->create_frame(this, desc);
+        auto dst   = frame.image_data(0).begin();
+
+        auto begin   = (tile_count_ - position) * format_desc_.width;
+        auto columns = std::min(format_desc_.width, width_ - begin);
+        if (columns < format_desc_.width) {
+            std::memset(dst, 0, frame.image_data(0).size());
+        }
+        for (int y = 0; y < height_; ++y)
+            std::copy_n(bytes_ + (static_cast<size_t>(y) * width_ + begin) * 4,
+                        columns * 4,
+                        dst + static_cast<size_t>(y) * format_desc_.width * 4);
+
+        core::draw_frame draw_frame(std::move(frame));
+
+        // Set the relative position to the other image fragments
+        draw_frame.transform().image_transform.fill_translation[0] = -position;
+        return draw_frame;
+    }
+
     std::vector<core::draw_frame> get_visible()
     {
+        // A tile is visible while the scroll is within a screen of its position
+        double offset_in_screens;
+        if (width_ == format_desc_.width) {
+            offset_in_screens =
+                (static_cast<double>(start_offset_y_) + delta_) / static_cast<double>(format_desc_.height);
+        } else {
+            offset_in_screens =
+                (static_cast<double>(start_offset_x_) + delta_) / static_cast<double>(format_desc_.width);
+        }
+        auto first = static_cast<int>(std::ceil(offset_in_screens - 1.0));
+        auto last  = static_cast<int>(std::floor(offset_in_screens + 1.0));
+
+        // The tiles next to the visible ones are made ahead, so that they have been uploaded by the time they scroll
+        // into view, in either direction. All others are released.
+        for (auto it = tiles_.begin(); it != tiles_.end();) {
+            it = it->first < first - 1 || it->first > last + 1 ? tiles_.erase(it) : std::next(it);
+        }
+
         std::vector<core::draw_frame> result;
-        result.reserve(frames_.size());
-
-        for (auto& frame : frames_) {
-            auto& fill_translation = frame.transform().image_transform.fill_translation;
-
-            if (width_ == format_desc_.width) {
-                auto motion_offset_in_screens =
-                    (static_cast<double>(start_offset_y_) + delta_) / static_cast<double>(format_desc_.height);
-                auto vertical_offset = fill_translation[1] + motion_offset_in_screens;
-
-                if (vertical_offset < -1.0 || vertical_offset > 1.0) {
-                    continue;
-                }
-            } else {
-                auto motion_offset_in_screens =
-                    (static_cast<double>(start_offset_x_) + delta_) / static_cast<double>(format_desc_.width);
-                auto horizontal_offset = fill_translation[0] + motion_offset_in_screens;
-
-                if (horizontal_offset < -1.0 || horizontal_offset > 1.0) {
-                    continue;
-                }
+        for (int position = std::max(1, first - 1); position <= std::min(tile_count_, last + 1); ++position) {
+            auto& tile = tiles_[position];
+            if (!tile) {
+                tile = make_tile(position);
+            }
+            if (position >= first && position <= last) {
+                result.push_back(tile);
             }
-
-            result.push_back(frame);
         }
 
-        return std::move(result);
+        return result;
     }
 
     // frame_producer
     core::draw_frame render_frame(bool allow_eof)
     {
-        if (frames_.empty())
+        if (tile_count_ == 0)
             return core::draw_frame::empty();
 
         core::draw_frame result(get_visible());
@@ -397,7 +404,7 @@ struct image_scroll_producer : public core::frame_producer
 
     core::monitor::state state() const override { return state_; }
 
-    bool is_ready() override { return !frames_.empty(); }
+    bool is_ready() override { return tile_count_ > 0; }
 };
 
 spl::shared_ptr<core::frame_producer> create_scroll_producer(const core::frame_producer_dependencies& dependencies,
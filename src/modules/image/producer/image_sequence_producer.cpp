@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_sequence_producer.h"
+
+#include "../util/image_converter.h"
+#include "../util/image_loader.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/filesystem.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/param.h>
+#include <common/task_arena.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cwctype>
+#include <future>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+
+namespace caspar { namespace image {
+
+namespace {
+
+// Stills are read whole by ffmpeg, which also decodes those that are not valid for the image producer
+bool is_sequence_file(const boost::filesystem::path& filename)
+{
+    auto ext = boost::to_lower_copy(filename.extension().wstring());
+    return is_valid_file(filename) || ext == L".exr" || ext == L".dpx";
+}
+
+// The name of a numbered still without its number, and the number
+std::optional<std::pair<std::wstring, int64_t>> split_number(const boost::filesystem::path& filename)
+{
+    auto stem   = filename.stem().wstring();
+    auto digits = std::find_if(stem.rbegin(), stem.rend(), [](wchar_t c) { return !std::iswdigit(c); });
+    auto count  = static_cast<size_t>(std::distance(stem.rbegin(), digits));
+    if (count == 0 || count > 18) {
+        return {};
+    }
+    auto prefix = stem.substr(0, stem.size() - count);
+    return std::make_pair(prefix, boost::lexical_cast<int64_t>(stem.substr(stem.size() - count)));
+}
+
+// The stills of the folder that are numbered after prefix and have the extension, in the order of their numbers. Any
+// numbered stills of the folder when prefix is not given, of whichever name has the most of them.
+std::vector<boost::filesystem::path> find_sequence(const boost::filesystem::path&     folder,
+                                                   const std::optional<std::wstring>& prefix,
+                                                   const std::wstring&                extension)
+{
+    std::map<std::pair<std::wstring, std::wstring>, std::map<int64_t, boost::filesystem::path>> sequences;
+    for (auto it = boost::filesystem::directory_iterator(folder); it != boost::filesystem::directory_iterator(); ++it) {
+        auto& path = it->path();
+        if (!boost::filesystem::is_regular_file(path) || !is_sequence_file(path)) {
+            continue;
+        }
+        auto number = split_number(path);
+        if (!number) {
+            continue;
+        }
+        auto ext = boost::to_lower_copy(path.extension().wstring());
+        if ((prefix && !boost::iequals(number->first, *prefix)) || (!extension.empty() && ext != extension)) {
+            continue;
+        }
+        sequences[std::make_pair(number->first, ext)].emplace(number->second, path);
+    }
+
+    auto longest = std::max_element(sequences.begin(), sequences.end(), [](const auto& a, const auto& b) {
+        return a.second.size() < b.second.size();
+    });
+
+    std::vector<boost::filesystem::path> files;
+    if (longest != sequences.end()) {
+        for (auto& file : longest->second) {
+            files.push_back(file.second);
+        }
+    }
+    return files;
+}
+
+} // namespace
+
+class image_sequence_producer : public core::frame_producer
+{
+    core::monitor::state                       state_;
+    const std::wstring                         description_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::vector<boost::filesystem::path> files_;
+    const core::frame_geometry::scale_mode     scale_mode_;
+    const bool                                 offline_;
+    const int64_t                              read_ahead_ =
+        std::max(env::properties().get(L"configuration.image.sequence-read-ahead", 8), 1);
+
+    bool    loop_;
+    int64_t position_   = 0; // The next frame handed out
+    int64_t underflows_ = 0;
+
+    // The frames from the position on, which are read or decoded in the background until they are ready
+    std::map<int64_t, std::shared_future<core::const_frame>> ahead_;
+    core::draw_frame                                         frame_;
+
+  public:
+    image_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                            std::wstring                             description,
+                            std::vector<boost::filesystem::path>     files,
+                            core::frame_geometry::scale_mode         scale_mode,
+                            bool                                     loop,
+                            int64_t                                  seek)
+        : description_(std::move(description))
+        , frame_factory_(dependencies.frame_factory)
+        , files_(std::move(files))
+        , scale_mode_(scale_mode)
+        , offline_(dependencies.offline)
+        , loop_(loop)
+        , position_(std::clamp<int64_t>(seek, 0, static_cast<int64_t>(files_.size()) - 1))
+    {
+        read_ahead();
+        update_state();
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        // A still covers both fields of a frame
+        if (field == core::video_field::b) {
+            return frame_;
+        }
+
+        if (position_ >= count()) {
+            return core::draw_frame::still(frame_);
+        }
+
+        read_ahead();
+
+        auto it = ahead_.find(position_);
+        if (offline_) {
+            it->second.wait();
+        } else if (!is_ready(it->second)) {
+            // Played on from the same frame on the next tick, the layer holds the last one meanwhile
+            underflows_ += 1;
+            update_state();
+            return core::draw_frame{};
+        }
+
+        try {
+            frame_ = core::draw_frame(it->second.get().with_tag(this));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << print() << L" Failed to load " << files_.at(position_).wstring();
+        }
+        ahead_.erase(it);
+
+        position_ += 1;
+        if (loop_ && position_ >= count()) {
+            position_ = 0;
+        }
+
+        read_ahead();
+        update_state();
+
+        return frame_;
+    }
+
+    core::draw_frame first_frame(const core::video_field field) override
+    {
+        if (!frame_ && position_ < count()) {
+            auto it = ahead_.find(position_);
+            if (it != ahead_.end() && is_ready(it->second)) {
+                try {
+                    return core::draw_frame::still(core::draw_frame(it->second.get().with_tag(this)));
+                } catch (...) {
+                }
+            }
+        }
+        return core::draw_frame::still(frame_);
+    }
+
+    core::draw_frame last_frame(const core::video_field field) override { return core::draw_frame::still(frame_); }
+
+    bool is_ready() override
+    {
+        if (frame_ || position_ >= count()) {
+            return true;
+        }
+        auto it = ahead_.find(position_);
+        return it != ahead_.end() && is_ready(it->second);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        if (params.size() >= 2 && boost::iequals(params.at(0), L"SEEK")) {
+            // Stills have nothing like keyframes to decode from, so any frame is decoded by itself
+            position_ = std::clamp<int64_t>(boost::lexical_cast<int64_t>(params.at(1)), 0, count() - 1);
+            read_ahead();
+            update_state();
+            return make_ready_future(std::wstring());
+        }
+
+        if (!params.empty() && boost::iequals(params.at(0), L"LOOP")) {
+            if (params.size() >= 2) {
+                loop_ = boost::lexical_cast<bool>(params.at(1));
+                read_ahead();
+                update_state();
+            }
+            return make_ready_future(std::to_wstring(loop_));
+        }
+
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected SEEK <frame> or LOOP [0|1]"));
+    }
+
+    uint32_t frame_number() const override { return static_cast<uint32_t>(position_); }
+
+    uint32_t nb_frames() const override
+    {
+        return loop_ ? std::numeric_limits<uint32_t>::max() : static_cast<uint32_t>(count());
+    }
+
+    std::wstring print() const override
+    {
+        return L"image_sequence_producer[" + description_ + L"|" + std::to_wstring(position_) + L"/" +
+               std::to_wstring(count()) + L"]";
+    }
+
+    std::wstring name() const override { return L"image-sequence"; }
+
+    core::monitor::state state() const override { return state_; }
+
+  private:
+    int64_t count() const { return static_cast<int64_t>(files_.size()); }
+
+    static bool is_ready(const std::shared_future<core::const_frame>& future)
+    {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // Reads and decodes a still on the workers for decoding, which take as many of them at once as there are cpus
+    std::shared_future<core::const_frame> load(int64_t index) const
+    {
+        auto promise = std::make_shared<std::promise<core::const_frame>>();
+        auto future  = promise->get_future().share();
+
+        get_task_arena(task_kind::decode)
+            .enqueue([promise, path = files_.at(index), frame_factory = frame_factory_, scale_mode = scale_mode_] {
+                try {
+                    auto av_frame = load_image(path.wstring());
+                    if (!is_frame_compatible_with_mixer(av_frame)) {
+                        av_frame = convert_image_frame(av_frame, AV_PIX_FMT_BGRA);
+                    }
+                    promise->set_value(core::const_frame(ffmpeg::make_frame(
+                        nullptr, *frame_factory, av_frame, nullptr, core::color_space::bt709, scale_mode, true)));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+
+        return future;
+    }
+
+    // Starts loading the frames from the position on that are not loading yet, and lets go of those before it
+    void read_ahead()
+    {
+        std::set<int64_t> window;
+        for (int64_t n = 0; n < read_ahead_; ++n) {
+            auto index = position_ + n;
+            if (index >= count()) {
+                if (!loop_) {
+                    break;
+                }
+                index %= count();
+            }
+            window.insert(index);
+        }
+
+        for (auto it = ahead_.begin(); it != ahead_.end();) {
+            it = window.count(it->first) > 0 ? std::next(it) : ahead_.erase(it);
+        }
+        for (auto index : window) {
+            if (ahead_.find(index) == ahead_.end()) {
+                ahead_.emplace(index, load(index));
+            }
+        }
+    }
+
+    void update_state()
+    {
+        const auto ready = std::count_if(
+            ahead_.begin(), ahead_.end(), [](const auto& frame) { return is_ready(frame.second); });
+
+        state_["file/path"]           = description_;
+        state_["file/frame"]          = {position_, count()};
+        state_["loop"]                = loop_;
+        state_["sequence/ahead"]      = static_cast<int64_t>(ready);
+        state_["sequence/underflows"] = underflows_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (boost::contains(params.at(0), L"://")) {
+        return core::frame_producer::empty();
+    }
+
+    std::vector<boost::filesystem::path> files;
+
+    auto folder = find_case_insensitive((boost::filesystem::path(env::media_folder()) / params.at(0)).wstring());
+    if (folder && boost::filesystem::is_directory(*folder)) {
+        files = find_sequence(*folder, {}, L"");
+    } else if (contains_param(L"SEQUENCE", params)) {
+        auto filename = find_file_within_dir_or_absolute(env::media_folder(), params.at(0), is_sequence_file);
+        auto number   = filename ? split_number(*filename) : std::nullopt;
+        if (!number) {
+            return core::frame_producer::empty();
+        }
+        files = find_sequence(
+            filename->parent_path(), number->first, boost::to_lower_copy(filename->extension().wstring()));
+    }
+
+    if (files.size() < 2) {
+        return core::frame_producer::empty();
+    }
+
+    auto scale_mode = core::scale_mode_from_string(get_param(L"SCALE_MODE", params, L"STRETCH"));
+    auto loop       = contains_param(L"LOOP", params);
+    auto seek       = get_param(L"SEEK", params, static_cast<int64_t>(0));
+
+    return spl::make_shared<image_sequence_producer>(
+        dependencies, params.at(0), std::move(files), scale_mode, loop, seek);
+}
+
+}} // namespace caspar::image
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#include "image_cache.h"
+
+#include "image_compressor.h"
+#include "image_converter.h"
+#include "image_loader.h"
+
+#include <common/env.h>
+#include <common/memory_governor.h>
+
+#include <core/frame/frame_factory.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+namespace caspar { namespace image {
+
+namespace {
+
+struct cached_image
+{
+    std::shared_future<std::shared_ptr<AVFrame>>          decoded;    // Once uncompressed frames are asked for
+    std::shared_future<std::shared_ptr<compressed_image>> compressed; // Once compressed frames are asked for
+    // By frame scope, scale mode and whether compressed
+    std::map<std::tuple<const void*, int, bool>, std::shared_future<core::const_frame>> frames;
+    std::chrono::steady_clock::time_point                                               last_used;
+};
+
+class image_cache
+{
+    std::mutex                                                   mutex_;
+    std::map<std::pair<std::wstring, std::time_t>, cached_image> images_; // By path and modification time
+    const std::int64_t budget_ = env::properties().get(L"configuration.image.cache-size", 512) * 1024LL * 1024LL;
+
+    // Given back to the memory governor from the least recently used image on
+    memory_account account_{"image-cache",
+                            memory_reclaim::cache,
+                            [this] {
+                                std::lock_guard<std::mutex> lock(mutex_);
+                                return trim(std::numeric_limits<std::int64_t>::max());
+                            },
+                            [this](std::int64_t bytes) {
+                                std::lock_guard<std::mutex> lock(mutex_);
+                                trim(trim(std::numeric_limits<std::int64_t>::max()) - bytes);
+                            }};
+
+  public:
+    static image_cache& instance()
+    {
+        static image_cache cache;
+        return cache;
+    }
+
+    std::shared_future<core::const_frame> load_frame(const std::wstring&                         filename,
+                                                     const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                     core::frame_geometry::scale_mode            scale_mode,
+                                                     bool                                        compress)
+    {
+        auto modified = boost::filesystem::last_write_time(filename);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& image     = images_[std::make_pair(filename, modified)];
+        image.last_used = std::chrono::steady_clock::now();
+
+        if (compress && !image.compressed.valid()) {
+            image.compressed =
+                std::async(std::launch::async, [filename] { return load_compressed_image(filename); }).share();
+        }
+        if (!compress && !image.decoded.valid()) {
+            image.decoded = std::async(std::launch::async, [filename] {
+                                auto av_frame = load_image(filename);
+                                if (!is_frame_compatible_with_mixer(av_frame))
+                                    av_frame = convert_image_frame(av_frame, AV_PIX_FMT_BGRA);
+                                return av_frame;
+                            }).share();
+        }
+
+        auto& frame =
+            image.frames[std::make_tuple(frame_factory->frame_scope(), static_cast<int>(scale_mode), compress)];
+        if (!frame.valid() && compress) {
+            frame = std::async(std::launch::async, [compressed = image.compressed, frame_factory, scale_mode] {
+                        return core::const_frame(make_compressed_frame(*frame_factory, *compressed.get(), scale_mode));
+                    }).share();
+        } else if (!frame.valid()) {
+            frame = std::async(std::launch::async, [decoded = image.decoded, frame_factory, scale_mode] {
+                        return core::const_frame(ffmpeg::make_frame(nullptr,
+                                                                    *frame_factory,
+                                                                    decoded.get(),
+                                                                    nullptr,
+                                                                    core::color_space::bt709,
+                                                                    scale_mode,
+                                                                    true));
+                    }).share();
+        }
+        auto result = frame;
+
+        trim(budget_);
+
+        return result;
+    }
+
+  private:
+    // Futures that were never started count as ready
+    template <typename T>
+    static bool is_ready(const std::shared_future<T>& future)
+    {
+        return !future.valid() || future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // Images that are still loading are never released, as that would wait for them
+    static bool is_ready(const cached_image& image)
+    {
+        return is_ready(image.decoded) && is_ready(image.compressed) &&
+               std::all_of(image.frames.begin(), image.frames.end(), [](const auto& frame) {
+                   return is_ready(frame.second);
+               });
+    }
+
+    // The host memory of an image, which is held once decoded or compressed and once more by each frame made of that.
+    // Nothing for an image that failed to load.
+    static std::int64_t size(const cached_image& image)
+    {
+        std::int64_t decoded_size    = 0;
+        std::int64_t compressed_size = 0;
+        try {
+            if (image.decoded.valid()) {
+                for (auto buf : image.decoded.get()->buf) {
+                    if (buf != nullptr) {
+                        decoded_size += buf->size;
+                    }
+                }
+            }
+            if (image.compressed.valid()) {
+                compressed_size = static_cast<std::int64_t>(image.compressed.get()->data.size());
+            }
+        } catch (...) {
+            return 0;
+        }
+
+        std::int64_t compressed_frames = 0;
+        for (auto& frame : image.frames) {
+            compressed_frames += std::get<2>(frame.first) ? 1 : 0;
+        }
+        const auto decoded_frames = static_cast<std::int64_t>(image.frames.size()) - compressed_frames;
+        return decoded_size * (1 + decoded_frames) + compressed_size * (1 + compressed_frames);
+    }
+
+    // Releases the least recently used images while over budget, and returns the size of those that are left. Called
+    // with mutex_ held.
+    std::int64_t trim(std::int64_t budget)
+    {
+        std::vector<std::pair<std::chrono::steady_clock::time_point, decltype(images_)::iterator>> lru;
+        std::int64_t                                                                           total = 0;
+        for (auto it = images_.begin(); it != images_.end();) {
+            if (!is_ready(it->second)) {
+                ++it;
+                continue;
+            }
+            auto image_size = size(it->second);
+            if (image_size == 0) {
+                // Loaded again by the next producer of it, in case the file was fixed without being modified
+                it = images_.erase(it);
+                continue;
+            }
+            total += image_size;
+            lru.emplace_back(it->second.last_used, it);
+            ++it;
+        }
+
+        std::sort(lru.begin(), lru.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (auto& entry : lru) {
+            if (total <= budget) {
+                break;
+            }
+            total -= size(entry.second->second);
+            images_.erase(entry.second);
+        }
+        return total;
+    }
+};
+
+} // namespace
+
+std::shared_future<core::const_frame> load_frame(const std::wstring&                         filename,
+                                                 const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                 core::frame_geometry::scale_mode            scale_mode,
+                                                 bool                                        compress)
+{
+    return image_cache::instance().load_frame(filename, frame_factory, scale_mode, compress);
+}
+
+}} // namespace caspar::image
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/geometry.h>
+
+#include <future>
+#include <string>
+
+namespace caspar { namespace core {
+class frame_factory;
+}} // namespace caspar::core
+
+namespace caspar { namespace image {
+
+// Loads an image file into a frame on a background thread. Files are decoded once for every modification of them, and
+// uploaded once for every frame scope and scale mode they are used with, as long as they stay in the cache. The cache
+// is shared by every producer and keeps the least recently used images up to image/cache-size MB. Compressed frames
+// are block compressed, see load_compressed_image.
+std::shared_future<core::const_frame> load_frame(const std::wstring&                         filename,
+                                                 const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                 core::frame_geometry::scale_mode            scale_mode,
+                                                 bool                                        compress = false);
+
+}} // namespace caspar::image
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_compressor.h"
+
+#include "image_converter.h"
+#include "image_loader.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/task_arena.h>
+#include <common/utf.h>
+
+#include <core/frame/frame_factory.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <utility>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+namespace caspar { namespace image {
+
+namespace {
+
+using pixel = std::array<std::uint8_t, 4>; // b, g, r, a
+
+// Transcoded images are kept on disk so that files are only transcoded once. An empty path disables the files.
+const boost::filesystem::path& compressed_folder()
+{
+    static const auto folder = [] {
+        boost::filesystem::path path =
+            env::properties().get(L"configuration.image.compressed-path", std::wstring(L"compressed-images/"));
+        if (!path.empty() && path.is_relative()) {
+            path = boost::filesystem::path(env::data_folder()) / path;
+        }
+        return path;
+    }();
+    return folder;
+}
+
+boost::filesystem::path compressed_file(const std::string& key)
+{
+    if (compressed_folder().empty()) {
+        return {};
+    }
+
+    // FNV-1a, which unlike std::hash is stable between builds
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (auto c : key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bc";
+    return compressed_folder() / name.str();
+}
+
+std::shared_ptr<compressed_image> load(const boost::filesystem::path& file, const std::string& key)
+{
+    if (file.empty() || !boost::filesystem::exists(file)) {
+        return nullptr;
+    }
+
+    boost::filesystem::ifstream stream(file, std::ios::binary);
+    std::string                 line;
+    if (!std::getline(stream, line) || line != key) {
+        return nullptr;
+    }
+
+    auto         image = std::make_shared<compressed_image>();
+    std::int32_t header[3];
+    if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        !core::is_block_compressed(static_cast<core::pixel_format>(header[0])) || header[1] <= 0 || header[2] <= 0) {
+        return nullptr;
+    }
+    image->format = static_cast<core::pixel_format>(header[0]);
+    image->width  = header[1];
+    image->height = header[2];
+    image->data.resize(core::block_compressed_size(image->format, image->width, image->height));
+    if (!stream.read(reinterpret_cast<char*>(image->data.data()), static_cast<std::streamsize>(image->data.size()))) {
+        return nullptr;
+    }
+    return image;
+}
+
+void store(const boost::filesystem::path& file, const std::string& key, const compressed_image& image)
+{
+    if (file.empty()) {
+        return;
+    }
+
+    try {
+        boost::filesystem::create_directories(file.parent_path());
+
+        // Producers may store the same file at once, so each writes its own file and renames it into place
+        auto tmp = file.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp");
+        {
+            boost::filesystem::ofstream stream(tmp, std::ios::binary | std::ios::trunc);
+            std::int32_t header[3] = {static_cast<std::int32_t>(image.format), image.width, image.height};
+            stream << key << "\n";
+            stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+            stream.write(reinterpret_cast<const char*>(image.data.data()),
+                         static_cast<std::streamsize>(image.data.size()));
+            if (!stream) {
+                CASPAR_LOG(warning) << L"[image] Failed to write compressed image " << tmp.wstring();
+                stream.close();
+                boost::filesystem::remove(tmp);
+                return;
+            }
+        }
+        boost::filesystem::rename(tmp, file);
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+}
+
+std::uint16_t pack565(const int (&rgb)[3])
+{
+    return static_cast<std::uint16_t>((rgb[0] >> 3) << 11 | (rgb[1] >> 2) << 5 | rgb[2] >> 3);
+}
+
+void unpack565(std::uint16_t color, int (&rgb)[3])
+{
+    const auto r = color >> 11 & 31;
+    const auto g = color >> 5 & 63;
+    const auto b = color & 31;
+    rgb[0]       = r << 3 | r >> 2;
+    rgb[1]       = g << 2 | g >> 4;
+    rgb[2]       = b << 3 | b >> 2;
+}
+
+// The endpoints span the bounding box of the colours, inset by a sixteenth of it as the extremes are often lone
+// pixels, and each pixel takes the nearest of the four colours between them (J.M.P. van Waveren, Real-Time DXT
+// Compression). The block is always in its four colour mode, which bc3 assumes.
+void encode_color(const pixel (&block)[16], std::uint8_t* out)
+{
+    int lo[3] = {255, 255, 255};
+    int hi[3] = {0, 0, 0};
+    for (auto& p : block) {
+        const int rgb[3] = {p[2], p[1], p[0]};
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], rgb[c]);
+            hi[c] = std::max(hi[c], rgb[c]);
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        const auto inset = (hi[c] - lo[c]) >> 4;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    auto c0 = pack565(hi);
+    auto c1 = pack565(lo);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    int palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    std::uint32_t indices = 0;
+    if (c0 != c1) {
+        for (int n = 0; n < 16; ++n) {
+            const int rgb[3] = {block[n][2], block[n][1], block[n][0]};
+
+            auto best          = 0;
+            auto best_distance = std::numeric_limits<int>::max();
+            for (int i = 0; i < 4; ++i) {
+                auto distance = 0;
+                for (int c = 0; c < 3; ++c) {
+                    distance += (rgb[c] - palette[i][c]) * (rgb[c] - palette[i][c]);
+                }
+                if (distance < best_distance) {
+                    best          = i;
+                    best_distance = distance;
+                }
+            }
+            indices |= static_cast<std::uint32_t>(best) << (2 * n);
+        }
+    }
+
+    out[0] = static_cast<std::uint8_t>(c0);
+    out[1] = static_cast<std::uint8_t>(c0 >> 8);
+    out[2] = static_cast<std::uint8_t>(c1);
+    out[3] = static_cast<std::uint8_t>(c1 >> 8);
+    for (int n = 0; n < 4; ++n) {
+        out[4 + n] = static_cast<std::uint8_t>(indices >> (8 * n));
+    }
+}
+
+// The endpoints are the extremes of the alphas, with the six values between them in their eight value mode
+void encode_alpha(const pixel (&block)[16], std::uint8_t* out)
+{
+    int lo = 255;
+    int hi = 0;
+    for (auto& p : block) {
+        lo = std::min<int>(lo, p[3]);
+        hi = std::max<int>(hi, p[3]);
+    }
+
+    std::uint64_t indices = 0;
+    if (hi > lo) {
+        int palette[8] = {hi, lo};
+        for (int i = 2; i < 8; ++i) {
+            palette[i] = ((8 - i) * hi + (i - 1) * lo) / 7;
+        }
+
+        for (int n = 0; n < 16; ++n) {
+            auto best = 0;
+            for (int i = 1; i < 8; ++i) {
+                if (std::abs(block[n][3] - palette[i]) < std::abs(block[n][3] - palette[best])) {
+                    best = i;
+                }
+            }
+            indices |= static_cast<std::uint64_t>(best) << (3 * n);
+        }
+    }
+
+    out[0] = static_cast<std::uint8_t>(hi);
+    out[1] = static_cast<std::uint8_t>(lo);
+    for (int n = 0; n < 6; ++n) {
+        out[2 + n] = static_cast<std::uint8_t>(indices >> (8 * n));
+    }
+}
+
+// Returns the bytes written. Blocks over the right and bottom edges repeat the last column and row.
+std::size_t
+encode_level(const std::vector<pixel>& level, int width, int height, core::pixel_format format, std::uint8_t* out)
+{
+    const auto block_bytes = format == core::pixel_format::bc1 ? 8 : 16;
+    const auto columns     = (width + 3) / 4;
+    const auto rows        = (height + 3) / 4;
+
+    tbb::parallel_for(0, rows, [&](int row) {
+        for (int column = 0; column < columns; ++column) {
+            pixel block[16];
+            for (int n = 0; n < 16; ++n) {
+                const auto x = std::min(column * 4 + n % 4, width - 1);
+                const auto y = std::min(row * 4 + n / 4, height - 1);
+                block[n]     = level[static_cast<std::size_t>(y) * width + x];
+            }
+
+            auto dest = out + (static_cast<std::size_t>(row) * columns + column) * block_bytes;
+            if (format == core::pixel_format::bc3) {
+                encode_alpha(block, dest);
+                dest += 8;
+            }
+            encode_color(block, dest);
+        }
+    });
+
+    return static_cast<std::size_t>(columns) * rows * block_bytes;
+}
+
+// Halves the level with a box filter, weighting the colours by their alpha as they are straight
+std::vector<pixel> downscale(const std::vector<pixel>& level, int width, int height)
+{
+    const auto half_width  = std::max(1, width / 2);
+    const auto half_height = std::max(1, height / 2);
+
+    std::vector<pixel> result(static_cast<std::size_t>(half_width) * half_height);
+    tbb::parallel_for(0, half_height, [&](int y) {
+        const int ys[2] = {std::min(y * 2, height - 1), std::min(y * 2 + 1, height - 1)};
+        for (int x = 0; x < half_width; ++x) {
+            const int xs[2] = {std::min(x * 2, width - 1), std::min(x * 2 + 1, width - 1)};
+
+            int alpha       = 0;
+            int sums[3]     = {};
+            int weighted[3] = {};
+            for (auto sy : ys) {
+                for (auto sx : xs) {
+                    const auto& p = level[static_cast<std::size_t>(sy) * width + sx];
+                    alpha += p[3];
+                    for (int c = 0; c < 3; ++c) {
+                        sums[c] += p[c];
+                        weighted[c] += p[c] * p[3];
+                    }
+                }
+            }
+
+            auto& p = result[static_cast<std::size_t>(y) * half_width + x];
+            for (int c = 0; c < 3; ++c) {
+                p[c] = static_cast<std::uint8_t>(alpha > 0 ? (weighted[c] + alpha / 2) / alpha : (sums[c] + 2) / 4);
+            }
+            p[3] = static_cast<std::uint8_t>((alpha + 2) / 4);
+        }
+    });
+    return result;
+}
+
+std::shared_ptr<compressed_image> compress(const std::shared_ptr<AVFrame>& decoded)
+{
+    auto frame = convert_image_frame(decoded, AV_PIX_FMT_BGRA);
+
+    auto image    = std::make_shared<compressed_image>();
+    image->width  = frame->width;
+    image->height = frame->height;
+
+    std::vector<pixel> level(static_cast<std::size_t>(image->width) * image->height);
+    for (int y = 0; y < image->height; ++y) {
+        std::memcpy(&level[static_cast<std::size_t>(y) * image->width],
+                    frame->data[0] + static_cast<std::ptrdiff_t>(y) * frame->linesize[0],
+                    static_cast<std::size_t>(image->width) * sizeof(pixel));
+    }
+
+    const auto opaque = std::all_of(level.begin(), level.end(), [](const pixel& p) { return p[3] == 255; });
+    image->format     = opaque ? core::pixel_format::bc1 : core::pixel_format::bc3;
+    image->data.resize(core::block_compressed_size(image->format, image->width, image->height));
+
+    run_in_arena(task_kind::background, [&] {
+        auto width  = image->width;
+        auto height = image->height;
+        auto out    = image->data.data();
+        while (true) {
+            out += encode_level(level, width, height, image->format, out);
+            if (width == 1 && height == 1) {
+                break;
+            }
+            level  = downscale(level, width, height);
+            width  = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+    });
+
+    return image;
+}
+
+} // namespace
+
+std::shared_ptr<compressed_image> load_compressed_image(const std::wstring& filename)
+{
+    // The file is part of the key, so that a file that was replaced is transcoded again
+    const auto        path = boost::filesystem::path(filename);
+    std::stringstream key;
+    key << u8(filename) << "|" << boost::filesystem::file_size(path) << "|" << boost::filesystem::last_write_time(path);
+
+    const auto file  = compressed_file(key.str());
+    auto       image = load(file, key.str());
+    if (!image) {
+        image = compress(load_image(filename));
+        store(file, key.str(), *image);
+    }
+    return image;
+}
+
+core::mutable_frame make_compressed_frame(core::frame_factory&             frame_factory,
+                                          const compressed_image&          image,
+                                          core::frame_geometry::scale_mode scale_mode)
+{
+    const auto block_bytes = image.format == core::pixel_format::bc1 ? 8 : 16;
+
+    core::pixel_format_desc::plane plane(image.width, image.height, 4);
+    plane.linesize = (image.width + 3) / 4 * block_bytes;
+    plane.size     = static_cast<int>(image.data.size());
+
+    core::pixel_format_desc desc(image.format);
+    desc.is_straight_alpha = true;
+    desc.planes.push_back(plane);
+
+    auto frame = frame_factory.create_frame(nullptr, desc);
+    std::memcpy(frame.image_data(0).data(), image.data.data(), image.data.size());
+    if (scale_mode != core::frame_geometry::scale_mode::stretch) {
+        frame.geometry() = core::frame_geometry::get_default(scale_mode);
+    }
+    return frame;
+}
+
+}} // namespace caspar::image
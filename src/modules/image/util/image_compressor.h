@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/frame/frame.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+class frame_factory;
+}} // namespace caspar::core
+
+namespace caspar { namespace image {
+
+// A still as blocks of a block compressed format with all its mip levels, see core::is_block_compressed
+struct compressed_image
+{
+    core::pixel_format        format = core::pixel_format::invalid;
+    int                       width  = 0;
+    int                       height = 0;
+    std::vector<std::uint8_t> data;
+};
+
+// Loads an image file as bc1, or as bc3 if it is not opaque. Files are transcoded once for every modification of them,
+// and kept in image/compressed-path.
+std::shared_ptr<compressed_image> load_compressed_image(const std::wstring& filename);
+
+core::mutable_frame make_compressed_frame(core::frame_factory&             frame_factory,
+                                          const compressed_image&          image,
+                                          core::frame_geometry::scale_mode scale_mode);
+
+}} // namespace caspar::image
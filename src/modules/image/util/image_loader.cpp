@@ -23,7 +23,10 @@
 #include "image_loader.h"
 #include "image_algorithms.h"
 
+#include <common/env.h>
 #include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
 
 #if defined(_MSC_VER)
 #pragma warning(disable : 4714) // marked as __forceinline not inlined
@@ -32,6 +35,7 @@
 #include "common/scope_exit.h"
 
 #include <ffmpeg/util/av_assert.h>
+#include <ffmpeg/util/av_util.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/exception/errinfo_file_name.hpp>
@@ -49,6 +53,7 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/dict.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 }
@@ -58,6 +63,17 @@ extern "C" {
 
 namespace caspar { namespace image {
 
+namespace {
+
+// Stills are decoded in software unless image/hwaccel names a device type, or is auto
+const std::string& image_hwaccel()
+{
+    static const auto hwaccel = u8(env::properties().get(L"configuration.image.hwaccel", std::wstring(L"none")));
+    return hwaccel;
+}
+
+} // namespace
+
 // Based on: https://github.com/FFmpeg/FFmpeg/blob/master/libavfilter/lavfutils.c
 std::shared_ptr<AVFrame> ff_load_image(const char* filename, AVFormatContext* format_ctx)
 {
@@ -87,30 +103,61 @@ std::shared_ptr<AVFrame> ff_load_image(const char* filename, AVFormatContext* fo
         FF_RET(AVERROR(EINVAL), "avcodec_find_decoder");
     }
 
-    auto codec_ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
-                                                     [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
-    if (!codec_ctx) {
-        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
-    }
-
-    FF(avcodec_parameters_to_context(codec_ctx.get(), par));
-
-    AVDictionary* opt = nullptr;
-    CASPAR_SCOPE_EXIT { av_dict_free(&opt); };
-
-    av_dict_set(&opt, "thread_type", "slice", 0);
-    FF(avcodec_open2(codec_ctx.get(), codec, &opt));
-
     AVPacket pkt;
     FF(av_read_frame(format_ctx, &pkt));
+    CASPAR_SCOPE_EXIT { av_packet_unref(&pkt); };
+
+    // Decodes the packet on a device when hw is set, returning nothing when the codec has no decoder on one
+    auto decode = [&](bool hw) -> std::shared_ptr<AVFrame> {
+        auto codec_ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                                         [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+        if (!codec_ctx) {
+            FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+        }
+
+        FF(avcodec_parameters_to_context(codec_ctx.get(), par));
+
+        std::shared_ptr<AVBufferRef> hw_device;
+        if (hw) {
+            hw_device = ffmpeg::open_hw_decoder(codec_ctx.get(), codec, image_hwaccel());
+            if (!hw_device) {
+                return nullptr;
+            }
+        }
+
+        AVDictionary* opt = nullptr;
+        CASPAR_SCOPE_EXIT { av_dict_free(&opt); };
+
+        av_dict_set(&opt, "thread_type", "slice", 0);
+        FF(avcodec_open2(codec_ctx.get(), codec, &opt));
+
+        FF(avcodec_send_packet(codec_ctx.get(), &pkt));
+        FF(avcodec_receive_frame(codec_ctx.get(), frame.get()));
+
+        if (!frame->hw_frames_ctx) {
+            return frame;
+        }
+
+        // Downloaded as the device decoded it, which is mostly NV12, and converted to BGRA by the callers as before
+        auto download = ffmpeg::alloc_frame();
+        FF(av_hwframe_transfer_data(download.get(), frame.get(), 0));
+        FF(av_frame_copy_props(download.get(), frame.get()));
+        return download;
+    };
 
-    const int ret = avcodec_send_packet(codec_ctx.get(), &pkt);
-    av_packet_unref(&pkt);
-    FF_RET(ret, "avcodec_send_packet");
-
-    FF(avcodec_receive_frame(codec_ctx.get(), frame.get()));
+    if (image_hwaccel() != "none") {
+        try {
+            if (auto result = decode(true)) {
+                return result;
+            }
+        } catch (...) {
+            // Such as a JPEG with a chroma subsampling the device can not decode
+            CASPAR_LOG(debug) << L"[image_loader] Decoding on the device failed, decoding in software.";
+            av_frame_unref(frame.get());
+        }
+    }
 
-    return frame;
+    return decode(false);
 }
 
 std::shared_ptr<AVFrame> load_image(const std::wstring& filename)
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnail_generator.h"
+
+#include "../consumer/image_consumer.h"
+
+#include <common/array.h>
+#include <common/env.h>
+#include <common/executor.h>
+#include <common/filesystem.h>
+#include <common/log.h>
+#include <common/task_arena.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/frame_producer_registry.h>
+#include <core/video_format.h>
+
+#include <ffmpeg/producer/av_probe.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <optional>
+
+namespace caspar { namespace image {
+
+namespace {
+
+const boost::filesystem::path& thumbnail_folder()
+{
+    static const auto folder = [] {
+        boost::filesystem::path path =
+            env::properties().get(L"configuration.image.thumbnail-path", std::wstring(L"thumbnails/"));
+        if (path.is_relative()) {
+            path = boost::filesystem::path(env::data_folder()) / path;
+        }
+        return path;
+    }();
+    return folder;
+}
+
+bool is_thumbnail(const boost::filesystem::path& path)
+{
+    return boost::iequals(path.extension().wstring(), L".png");
+}
+
+// Files that were being written when the server stopped
+bool is_partial(const boost::filesystem::path& path)
+{
+    return boost::iequals(path.stem().extension().wstring(), L".tmp");
+}
+
+core::video_format_desc thumbnail_format()
+{
+    auto width  = std::max(1, env::properties().get(L"configuration.image.thumbnail-width", 256));
+    auto height = std::max(1, env::properties().get(L"configuration.image.thumbnail-height", 144));
+    return core::video_format_desc(
+        core::video_format::custom, 1, width, height, width, height, 25000, 1000, L"thumbnail", {1920});
+}
+
+} // namespace
+
+struct thumbnail_generator::impl
+{
+    const std::function<std::unique_ptr<core::image_mixer>()> create_mixer_;
+    const spl::shared_ptr<const core::frame_producer_registry> producer_registry_;
+    const spl::shared_ptr<const core::cg_producer_registry>    cg_registry_;
+    const core::video_format_desc                              format_desc_ = thumbnail_format();
+
+    // Created for the first thumbnail, and only used on the executor
+    std::shared_ptr<core::image_mixer> mixer_;
+
+    std::atomic<bool> generating_all_{false};
+    std::atomic<bool> aborted_{false};
+    caspar::executor  executor_{L"thumbnail_generator"};
+
+    impl(std::function<std::unique_ptr<core::image_mixer>()>   create_mixer,
+         spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+         spl::shared_ptr<const core::cg_producer_registry>    cg_registry)
+        : create_mixer_(std::move(create_mixer))
+        , producer_registry_(std::move(producer_registry))
+        , cg_registry_(std::move(cg_registry))
+    {
+    }
+
+    ~impl()
+    {
+        aborted_ = true;
+        executor_.clear();
+    }
+
+    static std::optional<boost::filesystem::path> find_clip(const std::wstring& clip)
+    {
+        auto cache = ffmpeg::MediaCache::get();
+        auto file  = cache ? cache->find(clip, [](const boost::filesystem::path&) { return true; })
+                           : std::optional<boost::filesystem::path>();
+        if (!file) {
+            file = find_file_within_dir_or_absolute(
+                env::media_folder(), clip, [](const boost::filesystem::path&) { return true; });
+        }
+        return file;
+    }
+
+    static boost::filesystem::path thumbnail_file(const boost::filesystem::path& file)
+    {
+        auto relative = get_relative_without_extension(file, env::media_folder());
+        return thumbnail_folder() / (relative.wstring() + L".png");
+    }
+
+    // Must be called on the executor
+    bool generate_file(const boost::filesystem::path& file)
+    {
+        auto thumbnail = thumbnail_file(file);
+        auto mtime     = boost::filesystem::last_write_time(file);
+
+        // The thumbnail takes the modification time of its clip, so that a clip that is replaced, even by an older
+        // file, gets a new thumbnail
+        boost::system::error_code ec;
+        if (boost::filesystem::exists(thumbnail, ec) && boost::filesystem::last_write_time(thumbnail, ec) == mtime) {
+            return true;
+        }
+
+        // At background priority, along with the loops of the producer that run on the calling thread
+        auto frame = run_in_arena(task_kind::background, [&] { return render(file); });
+        if (!frame) {
+            return false;
+        }
+
+        boost::filesystem::create_directories(thumbnail.parent_path());
+
+        // Written under a name of its own and renamed into place, so that RETRIEVE never reads a partial png
+        auto tmp = thumbnail.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp.png");
+        try {
+            encode_image(std::move(frame), tmp.wstring()).get();
+            boost::filesystem::last_write_time(tmp, mtime);
+            boost::filesystem::rename(tmp, thumbnail);
+        } catch (...) {
+            boost::filesystem::remove(tmp, ec);
+            throw;
+        }
+
+        CASPAR_LOG(debug) << L"[thumbnail_generator] Generated " << thumbnail.wstring();
+        return true;
+    }
+
+    // The first frame of file, drawn at the size of the thumbnails by the GPU
+    core::const_frame render(const boost::filesystem::path& file)
+    {
+        if (!mixer_) {
+            mixer_ = create_mixer_();
+        }
+
+        core::frame_producer_dependencies dependencies(spl::make_shared_ptr(mixer_),
+                                                       {},
+                                                       core::video_format_repository(),
+                                                       format_desc_,
+                                                       producer_registry_,
+                                                       cg_registry_);
+        // Waits for the first frame to be decoded rather than giving up on it
+        dependencies.offline = true;
+
+        // Letterboxed in the thumbnail, and decoded on the GPU where the codec allows it
+        auto params   = std::vector<std::wstring>{file.wstring(), L"SCALE_MODE", L"FIT", L"HWACCEL", L"AUTO"};
+        auto producer = producer_registry_->create_producer(dependencies, params);
+
+        core::draw_frame frame;
+        for (int n = 0; n < 3 && !frame; ++n) {
+            frame = producer->receive(core::video_field::progressive, format_desc_.audio_cadence.at(0));
+        }
+        if (!frame) {
+            CASPAR_LOG(warning) << L"[thumbnail_generator] " << producer->print() << L" produced no frame for "
+                                << file.wstring();
+            return {};
+        }
+
+        mixer_->update_aspect_ratio(static_cast<double>(format_desc_.square_width) /
+                                    static_cast<double>(format_desc_.square_height));
+        frame.transform().image_transform.layer_depth = 1;
+        frame.accept(*mixer_);
+
+        auto buffers = mixer_->render(format_desc_, core::output_request{}, core::video_field::progressive).get();
+
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.emplace_back(format_desc_.width, format_desc_.height, 4);
+
+        std::vector<array<const std::uint8_t>> image_data;
+        image_data.push_back(std::move(buffers.at(0)));
+        return core::const_frame(this, std::move(image_data), array<const std::int32_t>(), desc);
+    }
+
+    std::vector<boost::filesystem::path> media_files() const
+    {
+        std::vector<boost::filesystem::path> files;
+
+        // The media cache knows which files are media, without opening any that are not again every time
+        if (auto cache = ffmpeg::MediaCache::get()) {
+            for (auto& info : cache->list(env::media_folder())) {
+                files.push_back(info.path);
+            }
+            return files;
+        }
+
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::recursive_directory_iterator(env::media_folder(), ec);
+             it != boost::filesystem::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (ec) {
+                break;
+            }
+            if (boost::filesystem::is_regular_file(it->path(), ec)) {
+                files.push_back(it->path());
+            }
+        }
+        return files;
+    }
+
+    void generate_all()
+    {
+        if (generating_all_.exchange(true)) {
+            return;
+        }
+
+        executor_.begin_invoke([this] {
+            int generated = 0;
+            int failed    = 0;
+            for (auto& file : media_files()) {
+                if (aborted_) {
+                    break;
+                }
+                try {
+                    if (generate_file(file)) {
+                        generated += 1;
+                    } else {
+                        failed += 1;
+                    }
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    failed += 1;
+                }
+            }
+            CASPAR_LOG(info) << L"[thumbnail_generator] " << generated << L" thumbnails up to date, " << failed
+                             << L" failed.";
+            generating_all_ = false;
+        });
+    }
+
+    std::future<bool> generate(const std::wstring& clip)
+    {
+        return executor_.begin_invoke([this, clip] {
+            auto file = find_clip(clip);
+            if (!file) {
+                return false;
+            }
+            try {
+                return generate_file(*file);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                return false;
+            }
+        });
+    }
+
+    std::vector<thumbnail_info> list() const
+    {
+        std::vector<thumbnail_info> thumbnails;
+
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::recursive_directory_iterator(thumbnail_folder(), ec);
+             it != boost::filesystem::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (ec) {
+                break;
+            }
+            auto& path = it->path();
+            if (!is_thumbnail(path) || is_partial(path) || !boost::filesystem::is_regular_file(path, ec)) {
+                continue;
+            }
+
+            thumbnail_info info;
+            info.clip  = get_relative_without_extension(path, thumbnail_folder()).generic_wstring();
+            info.mtime = boost::filesystem::last_write_time(path, ec);
+            info.size  = static_cast<std::int64_t>(boost::filesystem::file_size(path, ec));
+            thumbnails.push_back(std::move(info));
+        }
+
+        std::sort(thumbnails.begin(), thumbnails.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.clip < rhs.clip;
+        });
+        return thumbnails;
+    }
+
+    std::vector<char> retrieve(const std::wstring& clip) const
+    {
+        auto file = find_file_within_dir_or_absolute(thumbnail_folder().wstring(), clip, [](const auto& path) {
+            return is_thumbnail(path) && !is_partial(path);
+        });
+        if (!file) {
+            return {};
+        }
+
+        boost::filesystem::ifstream stream(*file, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+};
+
+thumbnail_generator::thumbnail_generator(std::function<std::unique_ptr<core::image_mixer>()>   create_mixer,
+                                         spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+                                         spl::shared_ptr<const core::cg_producer_registry>    cg_registry)
+    : impl_(new impl(std::move(create_mixer), std::move(producer_registry), std::move(cg_registry)))
+{
+}
+
+thumbnail_generator::~thumbnail_generator() {}
+
+std::future<bool> thumbnail_generator::generate(const std::wstring& clip) { return impl_->generate(clip); }
+
+void thumbnail_generator::generate_all() { impl_->generate_all(); }
+
+std::vector<thumbnail_info> thumbnail_generator::list() const { return impl_->list(); }
+
+std::vector<char> thumbnail_generator::retrieve(const std::wstring& clip) const { return impl_->retrieve(clip); }
+
+}} // namespace caspar::image
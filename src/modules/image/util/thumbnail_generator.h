@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace image {
+
+struct thumbnail_info
+{
+    std::wstring clip; // Relative to the media folder, without extension
+    std::time_t  mtime = 0;
+    std::int64_t size  = 0;
+};
+
+// Generates the thumbnails of clips in the server rather than in the media scanner. Each clip is opened by the producer
+// that would play it, its first frame drawn at the thumbnail size by a mixer of the generator and encoded as png by the
+// encoders of the image consumer. One clip is generated at a time, at background priority. Thumbnails are kept in
+// image/thumbnail-path with the modification time of their clip, and generated again only when that changes.
+class thumbnail_generator
+{
+  public:
+    thumbnail_generator(std::function<std::unique_ptr<core::image_mixer>()>   create_mixer,
+                        spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+                        spl::shared_ptr<const core::cg_producer_registry>    cg_registry);
+    ~thumbnail_generator();
+
+    thumbnail_generator(const thumbnail_generator&)            = delete;
+    thumbnail_generator& operator=(const thumbnail_generator&) = delete;
+
+    // Completes with whether clip has an up to date thumbnail, once it has been generated if it had none
+    std::future<bool> generate(const std::wstring& clip);
+
+    // Generates the thumbnails of the media folder that are missing or out of date, in the background
+    void generate_all();
+
+    std::vector<thumbnail_info> list() const;
+
+    // The png of the thumbnail of clip, empty when there is none
+    std::vector<char> retrieve(const std::wstring& clip) const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::image
@@ -30,6 +30,7 @@
 #include <core/consumer/channel_info.h>
 #include <core/consumer/frame_consumer.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/mixer/audio/audio_util.h>
 #include <core/video_format.h>
 
@@ -44,6 +45,8 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdint>
 #include <ratio>
 #include <thread>
 
@@ -51,40 +54,52 @@
 
 namespace caspar { namespace newtek {
 
+using ndi_time = std::chrono::duration<std::int64_t, std::ratio<1, 10000000>>;
+
 struct newtek_ndi_consumer : public core::frame_consumer
 {
+    struct queued_frame
+    {
+        std::int64_t      number = 0; // Of the channel frame, counted from when the consumer was added
+        core::video_field field  = core::video_field::progressive;
+        core::const_frame frame;
+    };
+
     static std::atomic<int> instances_;
     const int               instance_no_;
     const std::wstring      name_;
     const bool              allow_fields_;
+    const bool              alpha_;
+    const int               buffer_depth_; // Frames buffered against stalls of the channel, 0 for the lowest latency
 
     core::video_format_desc              format_desc_;
     int                                  channel_index_;
     NDIlib_v5*                           ndi_lib_;
     NDIlib_video_frame_v2_t              ndi_video_frame_;
     NDIlib_audio_frame_interleaved_32s_t ndi_audio_frame_;
-    std::shared_ptr<uint8_t>             field_data_;
+    core::const_frame                    sending_; // Read by NDI until the next frame is sent
     spl::shared_ptr<diagnostics::graph>  graph_;
     caspar::timer                        tick_timer_;
     caspar::timer                        frame_timer_;
     caspar::timer                        ndi_timer_;
-    int                                  frame_no_;
+    std::int64_t                         frames_received_ = 0;
     std::mutex                           buffer_mutex_;
     std::condition_variable              buffer_cond_;
     std::condition_variable              worker_cond_;
     bool                                 ready_for_frame_;
-    std::queue<core::const_frame>        buffer_;
+    std::queue<queued_frame>             buffer_;
     boost::thread                        send_thread;
     executor                             executor_;
 
     std::unique_ptr<NDIlib_send_instance_t, std::function<void(NDIlib_send_instance_t*)>> ndi_send_instance_;
 
   public:
-    newtek_ndi_consumer(std::wstring name, bool allow_fields)
+    newtek_ndi_consumer(std::wstring name, bool allow_fields, bool alpha, int buffer_depth)
         : name_(!name.empty() ? name : default_ndi_name())
         , instance_no_(instances_++)
-        , frame_no_(0)
         , allow_fields_(allow_fields)
+        , alpha_(alpha)
+        , buffer_depth_(std::max(0, buffer_depth))
         , channel_index_(0)
         , executor_(L"ndi_consumer[" + std::to_wstring(instance_no_) + L"]")
     {
@@ -94,6 +109,7 @@ struct newtek_ndi_consumer : public core::frame_consumer
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("buffered-frames", diagnostics::color(0.5f, 0.0f, 0.2f));
         graph_->set_color("ndi-tick", diagnostics::color(1.0f, 1.0f, 0.1f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         diagnostics::register_graph(graph_);
     }
 
@@ -127,22 +143,20 @@ struct newtek_ndi_consumer : public core::frame_consumer
         ndi_video_frame_.yres                 = format_desc.height;
         ndi_video_frame_.frame_rate_N         = format_desc.framerate.numerator() * format_desc.field_count;
         ndi_video_frame_.frame_rate_D         = format_desc.framerate.denominator();
-        ndi_video_frame_.FourCC               = NDIlib_FourCC_type_BGRA;
-        ndi_video_frame_.line_stride_in_bytes = format_desc.width * 4;
+        ndi_video_frame_.FourCC               = alpha_ ? NDIlib_FourCC_type_BGRA : NDIlib_FourCC_type_UYVY;
+        ndi_video_frame_.line_stride_in_bytes = row_bytes();
         ndi_video_frame_.frame_format_type    = NDIlib_frame_format_type_progressive;
 
         if (format_desc.field_count == 2 && allow_fields_) {
+            // A field is every other line of the frame, which NDI reads in place by skipping a line per line
             ndi_video_frame_.yres /= 2;
             ndi_video_frame_.frame_rate_N /= 2;
             ndi_video_frame_.picture_aspect_ratio = format_desc.width * 1.0f / format_desc.height;
-            field_data_.reset(new uint8_t[ndi_video_frame_.line_stride_in_bytes * ndi_video_frame_.yres],
-                              std::default_delete<uint8_t[]>());
-            ndi_video_frame_.p_data = field_data_.get();
+            ndi_video_frame_.line_stride_in_bytes *= 2;
         }
 
         ndi_audio_frame_.sample_rate = format_desc_.audio_sample_rate;
         ndi_audio_frame_.no_channels = format_desc_.audio_channels;
-        ndi_audio_frame_.timecode    = NDIlib_send_timecode_synthesize;
 
         graph_->set_text(print());
         // CASPAR_VERIFY(ndi_send_instance_);
@@ -152,58 +166,70 @@ struct newtek_ndi_consumer : public core::frame_consumer
             set_thread_name(L"NDI-SEND: " + name_);
             CASPAR_LOG(info) << L"Starting ndi-send thread for ndi output: " << name_;
             try {
-                auto buffer_size = buffer_.size();
-                // Buffer a few frames to keep NDI going when caspar is slow on a few frames
-                // This can be removed when CasparCG doesn't periodally slows down on frames
+                // Frames are sent at the channel's pace, each a fixed time after the one that set the clock. Whenever
+                // the buffer runs dry, because the channel stalled, or fills up beyond the configured depth, because
+                // it caught up, the clock is set again by the frame at hand, which keeps the buffer at its depth.
+                auto         clock_time   = std::chrono::steady_clock::now();
+                std::int64_t clock_number = 0;
+                auto         clock_set    = false;
                 while (!send_thread.interruption_requested()) {
+                    queued_frame next;
+                    auto         surplus = false;
                     {
                         std::unique_lock<std::mutex> lock(buffer_mutex_);
-                        worker_cond_.wait(lock, [&] { return buffer_.size() > buffer_size; });
-                        graph_->set_value("buffered-frames", static_cast<double>(buffer_.size() + 0.001) / 8);
-                        buffer_size = buffer_.size();
-                        if (buffer_.size() >= 8) {
-                            break;
-                        }
+                        worker_cond_.wait(lock, [&] {
+                            return clock_set ? !buffer_.empty() : static_cast<int>(buffer_.size()) > buffer_depth_;
+                        });
+                        graph_->set_value("buffered-frames",
+                                          static_cast<double>(buffer_.size() + 0.001) / (2 * buffer_depth_ + 2));
+                        next = std::move(buffer_.front());
+                        buffer_.pop();
+                        surplus = static_cast<int>(buffer_.size()) > buffer_depth_;
                     }
-                }
 
-                // Use steady clock to generate a near perfect NDI tick time.
-                auto frametimeUs = static_cast<int>(1000000 / format_desc_.fps);
-                auto time_point  = std::chrono::steady_clock::now();
-                time_point += std::chrono::microseconds(frametimeUs);
-                while (!send_thread.interruption_requested()) {
-                    core::const_frame frame;
-                    {
-                        std::unique_lock<std::mutex> lock(buffer_mutex_);
-                        worker_cond_.wait(lock, [&] { return !buffer_.empty(); });
-                        graph_->set_value("buffered-frames", static_cast<double>(buffer_.size() + 0.001) / 8);
-                        frame = std::move(buffer_.front());
-                        buffer_.pop();
+                    auto now = std::chrono::steady_clock::now();
+                    auto due = clock_time + frame_time(next.number - clock_number);
+                    if (clock_set && now > due + frame_time(1)) {
+                        graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                        clock_set = false;
+                    }
+                    if (!clock_set || surplus) {
+                        clock_time   = now;
+                        clock_number = next.number;
+                        clock_set    = true;
+                    } else {
+                        std::this_thread::sleep_until(due);
                     }
+
                     graph_->set_value("ndi-tick", ndi_timer_.elapsed() * format_desc_.fps * 0.5);
                     ndi_timer_.restart();
                     frame_timer_.restart();
-                    auto audio_data             = frame.audio_data();
-                    int  audio_data_size        = static_cast<int>(audio_data.size());
+
+                    // Timecodes count channel frames, so that receivers see the channel's timing rather than ours
+                    const auto timecode = frame_time(next.number).count();
+
+                    auto& frame                 = next.frame;
+                    auto  audio_data            = frame.audio_data();
+                    int   audio_data_size       = static_cast<int>(audio_data.size());
                     ndi_audio_frame_.no_samples = audio_data_size / format_desc_.audio_channels;
                     ndi_audio_frame_.p_data     = const_cast<int*>(audio_data.data());
+                    ndi_audio_frame_.timecode   = timecode;
                     ndi_lib_->util_send_send_audio_interleaved_32s(*ndi_send_instance_, &ndi_audio_frame_);
+                    auto image = const_cast<uint8_t*>(alpha_ ? frame.image_data(0).begin()
+                                                             : frame.packed_data(core::output_packing::uyvy).begin());
                     if (format_desc_.field_count == 2 && allow_fields_) {
+                        auto second = next.field == core::video_field::b;
                         ndi_video_frame_.frame_format_type =
-                            (frame_no_ % 2 ? NDIlib_frame_format_type_field_1 : NDIlib_frame_format_type_field_0);
-                        for (auto y = 0; y < ndi_video_frame_.yres; ++y) {
-                            std::memcpy(reinterpret_cast<char*>(ndi_video_frame_.p_data) + y * format_desc_.width * 4,
-                                        frame.image_data(0).data() + (y * 2 + frame_no_ % 2) * format_desc_.width * 4,
-                                        format_desc_.width * 4);
-                        }
-                    } else {
-                        ndi_video_frame_.p_data = const_cast<uint8_t*>(frame.image_data(0).begin());
+                            (second ? NDIlib_frame_format_type_field_1 : NDIlib_frame_format_type_field_0);
+                        image += (second ? 1 : 0) * row_bytes();
                     }
-                    ndi_lib_->send_send_video_v2(*ndi_send_instance_, &ndi_video_frame_);
-                    frame_no_++;
+                    ndi_video_frame_.p_data   = image;
+                    ndi_video_frame_.timecode = timecode;
+
+                    // NDI converts and sends the frame on its own threads, reading it until the next one is sent
+                    ndi_lib_->send_send_video_async_v2(*ndi_send_instance_, &ndi_video_frame_);
+                    sending_ = std::move(frame);
                     graph_->set_value("frame-time", frame_timer_.elapsed() * format_desc_.fps * 0.5);
-                    std::this_thread::sleep_until(time_point);
-                    time_point += std::chrono::microseconds(frametimeUs);
                 }
             } catch (boost::thread_interrupted) {
                 // NOTHING
@@ -218,13 +244,37 @@ struct newtek_ndi_consumer : public core::frame_consumer
             tick_timer_.restart();
             {
                 std::unique_lock<std::mutex> lock(buffer_mutex_);
-                buffer_.push(std::move(frame));
+                buffer_.push({frames_received_++, field, std::move(frame)});
             }
             worker_cond_.notify_all();
             return true;
         });
     }
 
+    // The time from the start of the channel frame with the given number, exact at fractional rates such as 59.94,
+    // in the 100ns units of NDI timecodes
+    ndi_time frame_time(std::int64_t number) const
+    {
+        return ndi_time(number * format_desc_.duration * 10000000LL /
+                        (static_cast<std::int64_t>(format_desc_.time_scale) * format_desc_.field_count));
+    }
+
+    std::vector<core::output_packing> packings() const override
+    {
+        // The packed frame has no alpha, so a key is sent as BGRA
+        if (alpha_)
+            return {};
+        return {core::output_packing::uyvy};
+    }
+
+    // Otherwise the frame of each field is sent whole, at the field rate
+    bool shows_fields() const override { return allow_fields_; }
+
+    int row_bytes() const
+    {
+        return alpha_ ? format_desc_.width * 4 : core::packed_row_bytes(core::output_packing::uyvy, format_desc_.width);
+    }
+
     std::wstring print() const override
     {
         if (channel_index_) {
@@ -250,6 +300,8 @@ struct newtek_ndi_consumer : public core::frame_consumer
         core::monitor::state state;
         state["ndi/name"]         = name_;
         state["ndi/allow_fields"] = allow_fields_;
+        state["ndi/alpha"]        = alpha_;
+        state["ndi/buffer_depth"] = buffer_depth_;
         return state;
     }
 };
@@ -270,7 +322,9 @@ create_ndi_consumer(const std::vector<std::wstring>&                         par
 
     std::wstring name         = get_param(L"NAME", params, L"");
     bool         allow_fields = contains_param(L"ALLOW_FIELDS", params);
-    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields);
+    bool         alpha        = contains_param(L"ALPHA", params);
+    int          buffer_depth = get_param(L"BUFFER_DEPTH", params, 2);
+    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields, alpha, buffer_depth);
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -281,11 +335,13 @@ create_preconfigured_ndi_consumer(const boost::property_tree::wptree&
 {
     auto name         = ptree.get(L"name", L"");
     bool allow_fields = ptree.get(L"allow-fields", false);
+    bool alpha        = ptree.get(L"alpha", false);
+    int  buffer_depth = ptree.get(L"buffer-depth", 2);
 
     if (channel_info.depth != common::bit_depth::bit8)
         CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Newtek NDI consumer only supports 8-bit color depth."));
 
-    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields);
+    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields, alpha, buffer_depth);
 }
 
 }} // namespace caspar::newtek
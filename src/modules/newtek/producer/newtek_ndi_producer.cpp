@@ -39,6 +39,7 @@
 #include <common/future.h>
 #include <common/param.h>
 #include <common/scope_exit.h>
+#include <common/task_arena.h>
 #include <common/timer.h>
 #include <common/utf.h>
 
@@ -48,6 +49,12 @@
 #include <boost/regex.hpp>
 #include <boost/thread.hpp>
 
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
 #include <tbb/parallel_for.h>
 
 #include <ffmpeg/util/av_util.h>
@@ -64,9 +71,49 @@ extern "C" {
 #endif
 
 #include "../util/ndi.h"
+#include "../util/receiver.h"
 
 namespace caspar { namespace newtek {
 
+// Buffers that go back to the pool once the last frame holding them is gone, instead of being freed
+template <typename T>
+class buffer_pool
+{
+    struct shared
+    {
+        std::mutex                                   mutex;
+        std::vector<std::unique_ptr<std::vector<T>>> buffers;
+    };
+
+    std::shared_ptr<shared> shared_ = std::make_shared<shared>();
+
+  public:
+    std::shared_ptr<std::vector<T>> acquire(size_t size)
+    {
+        std::unique_ptr<std::vector<T>> buffer;
+        {
+            std::lock_guard<std::mutex> lock(shared_->mutex);
+            if (!shared_->buffers.empty()) {
+                buffer = std::move(shared_->buffers.back());
+                shared_->buffers.pop_back();
+            }
+        }
+        if (!buffer) {
+            buffer = std::make_unique<std::vector<T>>();
+        }
+        buffer->resize(size);
+
+        std::weak_ptr<shared> weak_shared = shared_;
+        return std::shared_ptr<std::vector<T>>(buffer.release(), [weak_shared](std::vector<T>* buffer) {
+            std::unique_ptr<std::vector<T>> owned(buffer);
+            if (auto shared = weak_shared.lock()) {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->buffers.push_back(std::move(owned));
+            }
+        });
+    }
+};
+
 struct newtek_ndi_producer : public core::frame_producer
 {
     static std::atomic<int> instances_;
@@ -76,13 +123,13 @@ struct newtek_ndi_producer : public core::frame_producer
 
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
-    NDIlib_v5*                           ndi_lib_;
-    NDIlib_framesync_instance_t          ndi_framesync_;
-    NDIlib_recv_instance_t               ndi_recv_instance_;
+    std::unique_ptr<ndi::receiver>       receiver_;
     spl::shared_ptr<diagnostics::graph>  graph_;
     timer                                tick_timer_;
     timer                                frame_timer_;
 
+    buffer_pool<int32_t> audio_pool_;
+
     std::queue<core::draw_frame> frames_;
     mutable std::mutex           frames_mutex_;
     core::draw_frame             last_frame_;
@@ -104,7 +151,6 @@ struct newtek_ndi_producer : public core::frame_producer
         , executor_(print())
         , cadence_counter_(0)
     {
-        ndi_lib_ = ndi::load_library();
         graph_->set_text(print());
         graph_->set_color("frame-time", diagnostics::color(0.5f, 1.0f, 0.2f));
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
@@ -112,15 +158,11 @@ struct newtek_ndi_producer : public core::frame_producer
         diagnostics::register_graph(graph_);
         executor_.set_capacity(2);
         cadence_length_ = static_cast<int>(format_desc_.audio_cadence.size());
-        initialize();
+        receiver_ = std::make_unique<ndi::receiver>(
+            u8(name_), low_bandwidth_, format_desc_.audio_sample_rate, format_desc_.audio_channels);
     }
 
-    ~newtek_ndi_producer()
-    {
-        executor_.stop();
-        ndi_lib_->framesync_destroy(ndi_framesync_);
-        ndi_lib_->recv_destroy(ndi_recv_instance_);
-    }
+    ~newtek_ndi_producer() { executor_.stop(); }
 
     std::wstring print() const override
     {
@@ -157,68 +199,17 @@ struct newtek_ndi_producer : public core::frame_producer
     {
         try {
             frame_timer_.restart();
-            NDIlib_video_frame_v2_t video_frame;
-            NDIlib_audio_frame_v2_t audio_frame;
-            ndi_lib_->framesync_capture_video(ndi_framesync_, &video_frame, NDIlib_frame_format_type_progressive);
-            ndi_lib_->framesync_capture_audio(ndi_framesync_,
-                                              &audio_frame,
-                                              format_desc_.audio_sample_rate,
-                                              format_desc_.audio_channels,
-                                              format_desc_.audio_cadence[++cadence_counter_ %= cadence_length_]);
-
-            CASPAR_SCOPE_EXIT
-            {
-                if (video_frame.p_data != nullptr)
-                    ndi_lib_->framesync_free_video(ndi_framesync_, &video_frame);
-                if (audio_frame.p_data != nullptr)
-                    ndi_lib_->framesync_free_audio(ndi_framesync_, &audio_frame);
-            };
-
-            if (video_frame.p_data != nullptr) {
-                std::shared_ptr<AVFrame> av_frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
-                std::shared_ptr<AVFrame> a_frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
-                av_frame->data[0]     = video_frame.p_data;
-                av_frame->linesize[0] = video_frame.line_stride_in_bytes;
-                switch (video_frame.FourCC) {
-                    case NDIlib_FourCC_type_BGRA:
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                    case NDIlib_FourCC_type_BGRX:
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                    case NDIlib_FourCC_type_RGBA:
-                        av_frame->format = AV_PIX_FMT_RGBA;
-                        break;
-                    case NDIlib_FourCC_type_RGBX:
-                        av_frame->format = AV_PIX_FMT_RGBA;
-                        break;
-                    case NDIlib_FourCC_type_UYVY:
-                        av_frame->format = AV_PIX_FMT_UYVY422;
-                        break;
-                    default: // should never happen because library handles the conversion for us
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                }
-                av_frame->width  = video_frame.xres;
-                av_frame->height = video_frame.yres;
-                NDIlib_audio_frame_interleaved_32s_t audio_frame_32s;
-                audio_frame_32s.p_data = new int32_t[audio_frame.no_samples * audio_frame.no_channels];
-                if (audio_frame.p_data != nullptr) {
-                    audio_frame_32s.reference_level = 0;
-                    ndi_lib_->util_audio_to_interleaved_32s_v2(&audio_frame, &audio_frame_32s);
-#if FFMPEG_NEW_CHANNEL_LAYOUT
-                    av_channel_layout_default(&a_frame->ch_layout, audio_frame_32s.no_channels);
-#else
-                    a_frame->channels = audio_frame_32s.no_channels;
-#endif
-                    a_frame->sample_rate = audio_frame_32s.sample_rate;
-                    a_frame->nb_samples  = audio_frame_32s.no_samples;
-                    a_frame->data[0]     = reinterpret_cast<uint8_t*>(audio_frame_32s.p_data);
-                }
-                auto mframe =
-                    ffmpeg::make_frame(this, *(frame_factory_.get()), std::move(av_frame), std::move(a_frame));
-                delete[] audio_frame_32s.p_data;
-                auto dframe = core::draw_frame(std::move(mframe));
+
+            auto nb_samples = format_desc_.audio_cadence[++cadence_counter_ %= cadence_length_];
+            auto audio      = audio_pool_.acquire(static_cast<size_t>(nb_samples) * receiver_->channels());
+            receiver_->capture_audio(audio->data(), nb_samples);
+
+            std::optional<core::mutable_frame> mframe;
+            receiver_->capture_video(
+                [&](const NDIlib_video_frame_v2_t& video_frame) { mframe.emplace(make_frame(video_frame, audio)); });
+
+            if (mframe) {
+                auto dframe = core::draw_frame(std::move(*mframe));
                 {
                     std::lock_guard<std::mutex> lock(frames_mutex_);
                     frames_.push(dframe);
@@ -237,32 +228,62 @@ struct newtek_ndi_producer : public core::frame_producer
         return true;
     }
 
-    // frame_producer
-
-    void initialize()
+    // Copies the image straight into the mixer's upload buffers, where the GPU reads it from, and converts UYVY there.
+    // NDI does not capture into buffers handed to it, so this copy is the one left.
+    core::mutable_frame make_frame(const NDIlib_video_frame_v2_t&               video,
+                                   const std::shared_ptr<std::vector<int32_t>>& audio)
     {
-        auto sources = ndi::get_current_sources();
+        std::vector<int> data_map;
 
-        NDIlib_recv_create_v3_t NDI_recv_create_desc;
-        NDI_recv_create_desc.allow_video_fields = false;
-        NDI_recv_create_desc.bandwidth = low_bandwidth_ ? NDIlib_recv_bandwidth_lowest : NDIlib_recv_bandwidth_highest;
-        NDI_recv_create_desc.color_format = NDIlib_recv_color_format_UYVY_BGRA;
-        std::string src_name              = u8(name_);
+        auto desc  = ffmpeg::pixel_format_desc(get_pixel_format(video.FourCC), video.xres, video.yres, data_map);
+        auto frame = frame_factory_->create_frame(this, desc);
 
-        auto found_source = sources.find(src_name);
-        if (found_source != sources.end()) {
-            NDI_recv_create_desc.source_to_connect_to = found_source->second;
+        auto& plane = desc.planes[0];
+        auto  dst   = frame.image_data(0).begin();
+        if (video.line_stride_in_bytes == plane.linesize) {
+            std::memcpy(dst, video.p_data, plane.size);
         } else {
-            CASPAR_LOG(info) << print() << " Source currently not available.";
-            NDI_recv_create_desc.source_to_connect_to.p_ndi_name = src_name.c_str();
+            run_in_arena(task_kind::decode, [&] {
+                tbb::parallel_for(0, plane.height, [&](int y) {
+                    std::memcpy(dst + y * plane.linesize,
+                                video.p_data + y * video.line_stride_in_bytes,
+                                std::min(plane.linesize, video.line_stride_in_bytes));
+                });
+            });
+        }
+
+        frame.audio_data()     = array<int32_t>(audio->data(), audio->size(), audio, array_origin::ndi);
+        frame.audio_channels() = receiver_->channels();
+
+        // The planes that read the same packed data, as both planes of UYVY do, are uploaded from the same buffer
+        if (!data_map.empty()) {
+            auto buffer = array<const uint8_t>(std::move(frame.image_data(0)));
+            for (size_t n = 0; n < desc.planes.size(); ++n) {
+                frame.image_data(n) =
+                    array<uint8_t>(const_cast<uint8_t*>(buffer.data()), desc.planes[n].size, buffer);
+            }
         }
-        std::string receiver_name = "CasparCG " + u8(env::version()) + " NDI Producer " + std::to_string(instance_no_);
-        NDI_recv_create_desc.p_ndi_recv_name = receiver_name.c_str();
-        ndi_recv_instance_                   = ndi_lib_->recv_create_v3(&NDI_recv_create_desc);
-        ndi_framesync_                       = ndi_lib_->framesync_create(ndi_recv_instance_);
-        CASPAR_VERIFY(ndi_recv_instance_);
+
+        return frame;
     }
 
+    static AVPixelFormat get_pixel_format(NDIlib_FourCC_video_type_e fourcc)
+    {
+        switch (fourcc) {
+            case NDIlib_FourCC_type_RGBA:
+            case NDIlib_FourCC_type_RGBX:
+                return AV_PIX_FMT_RGBA;
+            case NDIlib_FourCC_type_UYVY:
+                return AV_PIX_FMT_UYVY422;
+            case NDIlib_FourCC_type_BGRA:
+            case NDIlib_FourCC_type_BGRX:
+            default: // should never happen because library handles the conversion for us
+                return AV_PIX_FMT_BGRA;
+        }
+    }
+
+    // frame_producer
+
     core::draw_frame last_frame(const core::video_field field) override
     {
         if (!last_frame_) {
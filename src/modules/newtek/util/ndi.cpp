@@ -23,8 +23,10 @@
 
 #include "ndi.h"
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -47,9 +49,55 @@ const std::wstring& dll_name()
     return name;
 }
 
-static std::mutex                              find_instance_mutex;
 static std::shared_ptr<NDIlib_find_instance_t> find_instance;
 
+// Keeps a copy of the sources found, which NDI only keeps until it is asked again
+class source_discovery
+{
+    std::mutex                    mutex_;
+    std::map<std::string, source> sources_;
+    std::atomic<bool>             running_{true};
+    std::thread                   thread_;
+
+  public:
+    source_discovery(NDIlib_v5* ndi_lib, NDIlib_find_instance_t find)
+        : thread_([=] {
+            while (running_) {
+                ndi_lib->find_wait_for_sources(find, 1000);
+
+                uint32_t no_sources = 0;
+                auto     sources    = ndi_lib->find_get_current_sources(find, &no_sources);
+
+                std::map<std::string, source> found;
+                for (uint32_t i = 0; i < no_sources; i++) {
+                    found.emplace(sources[i].p_ndi_name,
+                                  source{sources[i].p_ndi_name,
+                                         sources[i].p_url_address ? sources[i].p_url_address : ""});
+                }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                sources_ = std::move(found);
+            }
+        })
+    {
+    }
+
+    ~source_discovery()
+    {
+        running_ = false;
+        thread_.join();
+    }
+
+    std::map<std::string, source> sources()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sources_;
+    }
+};
+
+// Declared after the find instance, so that it stops using it before it is destroyed
+static std::unique_ptr<source_discovery> discovery;
+
 NDIlib_v5* load_library()
 {
     static NDIlib_v5* ndi_lib = nullptr;
@@ -113,20 +161,14 @@ NDIlib_v5* load_library()
 
     find_instance.reset(new NDIlib_find_instance_t(ndi_lib->NDIlib_find_create_v2(&find_instance_options)),
                         [](NDIlib_find_instance_t* p) { ndi_lib->NDIlib_find_destroy(*p); });
+    discovery = std::make_unique<source_discovery>(ndi_lib, *find_instance);
     return ndi_lib;
 }
 
-std::map<std::string, NDIlib_source_t> get_current_sources()
+std::map<std::string, source> get_current_sources()
 {
-    auto                        sources_map = std::map<std::string, NDIlib_source_t>();
-    uint32_t                    no_sources;
-    std::lock_guard<std::mutex> guard(find_instance_mutex);
-    const NDIlib_source_t*      sources =
-        load_library()->NDIlib_find_get_current_sources(*(find_instance.get()), &no_sources);
-    for (uint32_t i = 0; i < no_sources; i++) {
-        sources_map.emplace(std::string(sources[i].p_ndi_name), sources[i]);
-    }
-    return sources_map;
+    load_library();
+    return discovery->sources();
 }
 
 void not_installed()
@@ -149,10 +191,9 @@ std::wstring list_command(protocol::amcp::command_context& ctx)
     }
     std::wstringstream replyString;
     replyString << L"200 NDI LIST OK\r\n";
-    uint32_t               no_sources;
-    const NDIlib_source_t* sources = ndi_lib->NDIlib_find_get_current_sources(*(find_instance.get()), &no_sources);
-    for (uint32_t i = 0; i < no_sources; i++) {
-        replyString << i + 1 << L" \"" << sources[i].p_ndi_name << L"\" " << sources[i].p_url_address << L"\r\n";
+    int n = 0;
+    for (auto& source : get_current_sources()) {
+        replyString << ++n << L" \"" << u16(source.second.name) << L"\" " << u16(source.second.url) << L"\r\n";
     }
     replyString << L"\r\n";
     return replyString.str();
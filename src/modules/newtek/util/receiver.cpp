@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "receiver.h"
+#include "ndi.h"
+
+#include <common/assert.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace caspar { namespace newtek { namespace ndi {
+
+class stream
+{
+    NDIlib_v5*                  ndi_lib_;
+    NDIlib_recv_instance_t      recv_;
+    NDIlib_framesync_instance_t framesync_;
+    const int                   sample_rate_;
+    const int                   channels_;
+
+    std::mutex                mutex_;
+    std::vector<receiver*>    receivers_;
+    std::vector<std::int32_t> interleaved_;
+
+  public:
+    stream(const std::string& name, bool low_bandwidth, int sample_rate, int channels)
+        : ndi_lib_(load_library())
+        , sample_rate_(sample_rate)
+        , channels_(channels)
+    {
+        static std::atomic<int> instances{0};
+
+        auto sources = get_current_sources();
+
+        NDIlib_recv_create_v3_t NDI_recv_create_desc;
+        NDI_recv_create_desc.allow_video_fields = false;
+        NDI_recv_create_desc.bandwidth = low_bandwidth ? NDIlib_recv_bandwidth_lowest : NDIlib_recv_bandwidth_highest;
+        NDI_recv_create_desc.color_format = NDIlib_recv_color_format_UYVY_BGRA;
+
+        auto found_source = sources.find(name);
+        if (found_source != sources.end()) {
+            NDI_recv_create_desc.source_to_connect_to.p_ndi_name    = found_source->second.name.c_str();
+            NDI_recv_create_desc.source_to_connect_to.p_url_address = found_source->second.url.c_str();
+        } else {
+            CASPAR_LOG(info) << L"ndi[" << u16(name) << L"] Source currently not available.";
+            NDI_recv_create_desc.source_to_connect_to.p_ndi_name = name.c_str();
+        }
+        std::string receiver_name = "CasparCG " + u8(env::version()) + " NDI Producer " + std::to_string(instances++);
+        NDI_recv_create_desc.p_ndi_recv_name = receiver_name.c_str();
+        recv_                                = ndi_lib_->recv_create_v3(&NDI_recv_create_desc);
+        CASPAR_VERIFY(recv_);
+        framesync_ = ndi_lib_->framesync_create(recv_);
+    }
+
+    ~stream()
+    {
+        ndi_lib_->framesync_destroy(framesync_);
+        ndi_lib_->recv_destroy(recv_);
+    }
+
+    void add(receiver* receiver)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        receivers_.push_back(receiver);
+    }
+
+    void remove(receiver* receiver)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        receivers_.erase(std::remove(receivers_.begin(), receivers_.end(), receiver), receivers_.end());
+    }
+
+    bool capture_video(const std::function<void(const NDIlib_video_frame_v2_t&)>& func)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        NDIlib_video_frame_v2_t video_frame;
+        ndi_lib_->framesync_capture_video(framesync_, &video_frame, NDIlib_frame_format_type_progressive);
+        if (video_frame.p_data == nullptr) {
+            return false;
+        }
+
+        try {
+            func(video_frame);
+        } catch (...) {
+            ndi_lib_->framesync_free_video(framesync_, &video_frame);
+            throw;
+        }
+        ndi_lib_->framesync_free_video(framesync_, &video_frame);
+        return true;
+    }
+
+    void capture_audio(receiver& receiver, std::int32_t* dest, int nb_samples)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& audio = receiver.audio_;
+        auto  size  = static_cast<size_t>(nb_samples) * channels_;
+
+        // The receiver that runs out first takes the samples from NDI, and hands them to all of them
+        if (audio.size() < size) {
+            auto missing = static_cast<int>((size - audio.size()) / channels_);
+
+            NDIlib_audio_frame_v2_t audio_frame;
+            ndi_lib_->framesync_capture_audio(framesync_, &audio_frame, sample_rate_, channels_, missing);
+
+            interleaved_.assign(static_cast<size_t>(audio_frame.no_samples) * audio_frame.no_channels, 0);
+            if (audio_frame.p_data != nullptr) {
+                NDIlib_audio_frame_interleaved_32s_t audio_32s;
+                audio_32s.reference_level = 0;
+                audio_32s.p_data          = interleaved_.data();
+                ndi_lib_->util_audio_to_interleaved_32s_v2(&audio_frame, &audio_32s);
+                ndi_lib_->framesync_free_audio(framesync_, &audio_frame);
+            }
+
+            // A receiver that is not taking its samples, e.g. of a paused layer, keeps no more than a second
+            const auto max_size = static_cast<size_t>(sample_rate_) * channels_;
+            for (auto other : receivers_) {
+                other->audio_.insert(other->audio_.end(), interleaved_.begin(), interleaved_.end());
+                if (other->audio_.size() > max_size) {
+                    other->audio_.erase(other->audio_.begin(),
+                                        other->audio_.begin() + (other->audio_.size() - max_size));
+                }
+            }
+        }
+
+        auto count = std::min(size, audio.size());
+        std::copy(audio.begin(), audio.begin() + count, dest);
+        std::fill(dest + count, dest + size, 0);
+        audio.erase(audio.begin(), audio.begin() + count);
+    }
+};
+
+namespace {
+
+using stream_key = std::tuple<std::string, bool, int, int>;
+
+std::mutex                                  streams_mutex;
+std::map<stream_key, std::weak_ptr<stream>> streams;
+
+std::shared_ptr<stream> open_stream(const std::string& name, bool low_bandwidth, int sample_rate, int channels)
+{
+    std::lock_guard<std::mutex> lock(streams_mutex);
+
+    const auto key = stream_key{name, low_bandwidth, sample_rate, channels};
+
+    auto found = streams[key].lock();
+    if (!found) {
+        found        = std::make_shared<stream>(name, low_bandwidth, sample_rate, channels);
+        streams[key] = found;
+    }
+
+    for (auto it = streams.begin(); it != streams.end();) {
+        it = it->second.expired() ? streams.erase(it) : std::next(it);
+    }
+
+    return found;
+}
+
+} // namespace
+
+receiver::receiver(const std::string& name, bool low_bandwidth, int sample_rate, int channels)
+    : channels_(channels)
+    , stream_(open_stream(name, low_bandwidth, sample_rate, channels))
+{
+    stream_->add(this);
+}
+
+receiver::~receiver() { stream_->remove(this); }
+
+bool receiver::capture_video(const std::function<void(const NDIlib_video_frame_v2_t&)>& func)
+{
+    return stream_->capture_video(func);
+}
+
+void receiver::capture_audio(std::int32_t* dest, int nb_samples) { stream_->capture_audio(*this, dest, nb_samples); }
+
+}}} // namespace caspar::newtek::ndi
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../interop/Processing.NDI.Lib.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace newtek { namespace ndi {
+
+class stream;
+
+// A producer's end of the receive stream of an NDI source. Producers of the same source, bandwidth and audio format
+// share one stream, e.g. when a source is on program, preview and a multiviewer, so that it is received once. Video is
+// shared as it is, as each producer takes the latest frame, while each receiver is given every audio sample.
+class receiver final
+{
+  public:
+    receiver(const std::string& name, bool low_bandwidth, int sample_rate, int channels);
+    ~receiver();
+
+    receiver(const receiver&)            = delete;
+    receiver& operator=(const receiver&) = delete;
+
+    // Calls func with the latest video frame, which is only valid during the call. Returns false when no video has
+    // been received yet.
+    bool capture_video(const std::function<void(const NDIlib_video_frame_v2_t&)>& func);
+
+    // Takes the next samples of this receiver, interleaved. NDI fills in silence where the source sent none.
+    void capture_audio(std::int32_t* dest, int nb_samples);
+
+    [[nodiscard]] int channels() const { return channels_; }
+
+  private:
+    friend class stream;
+
+    const int                     channels_;
+    std::shared_ptr<stream>       stream_;
+    std::deque<std::int32_t>      audio_; // Received by the stream, not yet taken
+};
+
+}}} // namespace caspar::newtek::ndi
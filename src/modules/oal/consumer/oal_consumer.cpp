@@ -36,30 +36,26 @@
 #include <core/frame/frame.h>
 #include <core/video_format.h>
 
-#include <modules/ffmpeg/defines.h>
-
 #include <boost/algorithm/string/erase.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
-#if defined(_MSC_VER)
-#pragma warning(push)
-#pragma warning(disable : 4244)
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse2.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <emmintrin.h>
 #endif
-extern "C" {
-#define __STDC_CONSTANT_MACROS
-#define __STDC_LIMIT_MACROS
-#include <libavutil/channel_layout.h>
-#include <libavutil/samplefmt.h>
-#include <libswresample/swresample.h>
-}
-#if defined(_MSC_VER)
-#pragma warning(pop)
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <AL/al.h>
@@ -173,6 +169,36 @@ class device
     }
 };
 
+// Converts the first two channels of interleaved 32 bit samples to 16 bit stereo by keeping their upper halves, as
+// monitoring plays the pair the mixer puts stereo sources on. Mono is played on both sides.
+void to_stereo16(const int32_t* src, int channels, int samples, int16_t* dst)
+{
+    int n = 0;
+    if (channels == 2) {
+        for (; n + 4 <= samples; n += 4) {
+            auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 2));
+            auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 2 + 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 2),
+                             _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+        }
+    } else if (channels > 2) {
+        auto pair = [&](int sample) {
+            return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + static_cast<size_t>(sample) * channels));
+        };
+        for (; n + 4 <= samples; n += 4) {
+            auto a = _mm_unpacklo_epi64(pair(n), pair(n + 1));
+            auto b = _mm_unpacklo_epi64(pair(n + 2), pair(n + 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 2),
+                             _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+        }
+    }
+    for (; n < samples; ++n) {
+        auto sample    = src + static_cast<size_t>(n) * channels;
+        dst[n * 2]     = static_cast<int16_t>(sample[0] >> 16);
+        dst[n * 2 + 1] = static_cast<int16_t>(sample[channels > 1 ? 1 : 0] >> 16);
+    }
+}
+
 void init_device()
 {
     static std::unique_ptr<device> instance;
@@ -185,47 +211,105 @@ void init_device()
     });
 }
 
+struct configuration
+{
+    int  buffer_depth     = 3;
+    int  max_buffer_depth = 8;
+    bool sync_clock       = false;
+};
+
 struct oal_consumer : public core::frame_consumer
 {
+    const configuration                 config_;
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       perf_timer_;
     int                                 channel_index_ = -1;
 
     core::video_format_desc format_desc_;
 
-    ALuint              source_ = 0;
-    std::vector<ALuint> buffers_;
-    bool                started_  = false;
-    int                 duration_ = 1920;
+    ALuint               source_ = 0;
+    std::vector<ALuint>  buffers_;
+    std::vector<ALuint>  free_buffers_;
+    std::vector<int16_t> samples_;
+    bool                 started_ = false;
 
-    std::shared_ptr<SwrContext> swr_;
+    // Frames queued ahead of the device. Underruns grow it, and it shrinks again while they stay away.
+    std::atomic<int> depth_;
+    std::atomic<int> underruns_{0};
+    int              clean_frames_ = 0;
 
     executor executor_{L"oal_consumer"};
 
   public:
-    explicit oal_consumer()
+    explicit oal_consumer(const configuration& config)
+        : config_(config)
+        , depth_(config.buffer_depth)
     {
         init_device();
 
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
+        graph_->set_color("buffered-audio", diagnostics::color(0.9f, 0.9f, 0.5f));
         diagnostics::register_graph(graph_);
     }
 
     ~oal_consumer() override
     {
-        executor_.invoke([=] {
-            if (source_ != 0u) {
-                alSourceStop(source_);
-                alDeleteSources(1, &source_);
-            }
+        executor_.invoke([=] { close(); });
+    }
+
+    void close()
+    {
+        if (source_ != 0u) {
+            alSourceStop(source_);
+            alDeleteSources(1, &source_);
+            source_ = 0;
+        }
+
+        if (!buffers_.empty()) {
+            alDeleteBuffers(static_cast<ALsizei>(buffers_.size()), buffers_.data());
+        }
+        buffers_.clear();
+        free_buffers_.clear();
+        started_ = false;
+    }
+
+    int queued() const { return static_cast<int>(buffers_.size() - free_buffers_.size()); }
 
-            for (auto& buffer : buffers_) {
-                if (buffer != 0u)
-                    alDeleteBuffers(1, &buffer);
+    // Takes back the buffers the device has played
+    void reclaim()
+    {
+        ALint processed = 0;
+        alGetSourcei(source_, AL_BUFFERS_PROCESSED, &processed);
+        for (auto n = 0; n < processed; ++n) {
+            ALuint buffer = 0;
+            alSourceUnqueueBuffers(source_, 1, &buffer);
+            if (buffer == 0u) {
+                break;
             }
-        });
+            free_buffers_.push_back(buffer);
+        }
+    }
+
+    bool playing() const
+    {
+        ALint state = AL_STOPPED;
+        alGetSourcei(source_, AL_SOURCE_STATE, &state);
+        return state == AL_PLAYING;
+    }
+
+    void queue(const int16_t* samples, int count)
+    {
+        auto buffer = free_buffers_.back();
+        free_buffers_.pop_back();
+        alBufferData(buffer,
+                     AL_FORMAT_STEREO16,
+                     samples,
+                     static_cast<ALsizei>(count * 2 * sizeof(int16_t)),
+                     format_desc_.audio_sample_rate);
+        alSourceQueueBuffers(source_, 1, &buffer);
     }
 
     // frame consumer
@@ -237,9 +321,12 @@ struct oal_consumer : public core::frame_consumer
         graph_->set_text(print());
 
         executor_.begin_invoke([=] {
-            duration_ = *std::min_element(format_desc_.audio_cadence.begin(), format_desc_.audio_cadence.end());
-            buffers_.resize(8);
+            close();
+
+            // One more than the depth, for the frame that is queued while the device plays the others
+            buffers_.resize(config_.max_buffer_depth + 1);
             alGenBuffers(static_cast<ALsizei>(buffers_.size()), buffers_.data());
+            free_buffers_ = buffers_;
             alGenSources(1, &source_);
 
             alSourcei(source_, AL_LOOPING, AL_FALSE);
@@ -248,136 +335,67 @@ struct oal_consumer : public core::frame_consumer
 
     std::future<bool> send(core::video_field field, core::const_frame frame) override
     {
-        executor_.begin_invoke([=] {
-            auto dst         = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            dst->format      = AV_SAMPLE_FMT_S16;
-            dst->sample_rate = format_desc_.audio_sample_rate;
-#if FFMPEG_NEW_CHANNEL_LAYOUT
-            av_channel_layout_default(&dst->ch_layout, 2);
-#else
-            dst->channels       = 2;
-            dst->channel_layout = av_get_default_channel_layout(dst->channels);
-#endif
-            dst->nb_samples = duration_;
-            if (av_frame_get_buffer(dst.get(), 32) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
-            std::memset(dst->extended_data[0], 0, dst->linesize[0]);
-
-            if (!started_) {
-                for (ALuint& buffer : buffers_) {
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                }
-
-                alSourcePlay(source_);
-                started_ = true;
+        auto result = executor_.begin_invoke([=] {
+            reclaim();
 
-                return;
-            }
-
-            auto src         = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            src->format      = AV_SAMPLE_FMT_S32;
-            src->sample_rate = format_desc_.audio_sample_rate;
-#if FFMPEG_NEW_CHANNEL_LAYOUT
-            av_channel_layout_default(&src->ch_layout, format_desc_.audio_channels);
-#else
-            src->channels       = format_desc_.audio_channels;
-            src->channel_layout = av_get_default_channel_layout(src->channels);
-#endif
-            src->nb_samples       = static_cast<int>(frame.audio_data().size() / format_desc_.audio_channels);
-            src->extended_data[0] = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(frame.audio_data().data()));
-            src->linesize[0]      = static_cast<int>(frame.audio_data().size() * sizeof(int32_t));
-
-            if (!swr_) {
-                swr_.reset(swr_alloc(), [](SwrContext* ptr) { swr_free(&ptr); });
-                if (!swr_) {
-                    CASPAR_THROW_EXCEPTION(bad_alloc());
-                }
-                if (swr_config_frame(swr_.get(), dst.get(), src.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-                if (swr_init(swr_.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
+            // The device paces the channel, so rather than queueing more the frame waits for it to play a buffer
+            while (config_.sync_clock && started_ && queued() >= depth_ && playing()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                reclaim();
             }
 
-            if (swr_convert_frame(swr_.get(), nullptr, src.get()) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
+            if (started_ && !playing()) {
+                // The device ran out of buffers, so queue more of them from now on and preroll again
+                ++underruns_;
+                depth_        = std::min(depth_ + 1, config_.max_buffer_depth);
+                clean_frames_ = 0;
+                started_      = false;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+            } else if (started_ && ++clean_frames_ > format_desc_.fps * 10 && depth_ > config_.buffer_depth) {
+                depth_        = depth_ - 1;
+                clean_frames_ = 0;
             }
 
-            ALint processed = 0;
-            alGetSourceiv(source_, AL_BUFFERS_PROCESSED, &processed);
-
-            auto in_duration  = swr_get_delay(swr_.get(), 48000);
-            auto out_duration = static_cast<int64_t>(processed) * duration_;
-            auto delta        = static_cast<int>(out_duration - in_duration);
-
-            ALenum state;
-            alGetSourcei(source_, AL_SOURCE_STATE, &state);
-            if (state != AL_PLAYING) {
-                while (delta > duration_) {
-                    ALuint buffer = 0;
-                    alSourceUnqueueBuffers(source_, 1, &buffer);
-                    if (buffer == 0u) {
-                        break;
-                    }
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                    delta -= duration_;
-                }
-
-                alSourcePlay(source_);
+            const auto channels = format_desc_.audio_channels;
+            auto       count    = channels > 0 ? static_cast<int>(frame.audio_data().size() / channels) : 0;
+            if (count > 0) {
+                samples_.resize(static_cast<size_t>(count) * 2);
+                to_stereo16(frame.audio_data().data(), channels, count, samples_.data());
+            } else {
+                count = format_desc_.audio_cadence.front();
+                samples_.assign(static_cast<size_t>(count) * 2, 0);
             }
 
-            // TODO (fix)
-            // if (std::abs(delta) > duration_ && swr_set_compensation(swr_.get(), delta, 2000) < 0) {
-            //    // TODO FF error
-            //    CASPAR_THROW_EXCEPTION(invalid_argument());
-            //}
-
-            for (auto n = 0; n < processed; ++n) {
-                if (swr_get_delay(swr_.get(), 48000) < dst->nb_samples) {
-                    break;
-                }
-
-                ALuint buffer = 0;
-                alSourceUnqueueBuffers(source_, 1, &buffer);
-                if (buffer == 0u) {
-                    // TODO error
-                    break;
+            if (!started_) {
+                reclaim();
+                if (queued() > 0) {
+                    alSourceStop(source_);
+                    reclaim();
                 }
 
-                if (swr_convert_frame(swr_.get(), dst.get(), nullptr) != 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
+                std::vector<int16_t> silence(samples_.size(), 0);
+                for (auto n = 1; n < depth_; ++n) {
+                    queue(silence.data(), count);
                 }
+                queue(samples_.data(), count);
 
-                alBufferData(buffer,
-                             AL_FORMAT_STEREO16,
-                             dst->extended_data[0],
-                             static_cast<ALsizei>(dst->linesize[0]),
-                             dst->sample_rate);
-                alSourceQueueBuffers(source_, 1, &buffer);
+                alSourcePlay(source_);
+                started_ = true;
+            } else if (queued() >= depth_) {
+                // The device plays slower than the channel, or the depth shrank
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            } else {
+                queue(samples_.data(), count);
             }
 
+            graph_->set_value("buffered-audio", static_cast<double>(queued()) / config_.max_buffer_depth);
             graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
             perf_timer_.restart();
+
+            return true;
         });
 
-        return make_ready_future(true);
+        return config_.sync_clock ? std::move(result) : make_ready_future(true);
     }
 
     std::wstring print() const override
@@ -387,14 +405,17 @@ struct oal_consumer : public core::frame_consumer
 
     std::wstring name() const override { return L"system-audio"; }
 
-    bool has_synchronization_clock() const override { return false; }
+    bool has_synchronization_clock() const override { return config_.sync_clock; }
 
     int index() const override { return 500; }
 
     core::monitor::state state() const override
     {
-        static const core::monitor::state empty;
-        return empty;
+        core::monitor::state state;
+        state["system-audio/buffer-depth"] = depth_.load();
+        state["system-audio/underruns"]    = underruns_.load();
+        state["system-audio/sync-clock"]   = config_.sync_clock;
+        return state;
     }
 };
 
@@ -406,7 +427,10 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     if (params.empty() || !boost::iequals(params.at(0), L"AUDIO"))
         return core::frame_consumer::empty();
 
-    return spl::make_shared<oal_consumer>();
+    configuration config;
+    config.sync_clock = contains_param(L"SYNC", params);
+
+    return spl::make_shared<oal_consumer>(config);
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -415,7 +439,18 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels,
                               const core::channel_info&                                channel_info)
 {
-    return spl::make_shared<oal_consumer>();
+    configuration config;
+    config.buffer_depth     = ptree.get(L"buffer-depth", config.buffer_depth);
+    config.max_buffer_depth = ptree.get(L"max-buffer-depth", std::max(config.max_buffer_depth, config.buffer_depth));
+    config.sync_clock       = ptree.get(L"sync-clock", config.sync_clock);
+
+    if (config.buffer_depth < 2)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"system-audio buffer-depth must be at least 2."));
+    if (config.max_buffer_depth < config.buffer_depth)
+        CASPAR_THROW_EXCEPTION(user_error()
+                               << msg_info(L"system-audio max-buffer-depth must be at least its buffer-depth."));
+
+    return spl::make_shared<oal_consumer>(config);
 }
 
 }} // namespace caspar::oal
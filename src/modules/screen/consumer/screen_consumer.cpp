@@ -31,6 +31,7 @@
 #include <common/log.h>
 #include <common/memory.h>
 #include <common/param.h>
+#include <common/ptree.h>
 #include <common/timer.h>
 #include <common/utf.h>
 
@@ -44,13 +45,15 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
 
 #if defined(_MSC_VER)
+#include <GL/wglew.h>
 #include <windows.h>
 
 #pragma warning(push)
@@ -61,6 +64,8 @@
 
 #include "consumer_screen_fragment.h"
 #include "consumer_screen_vertex.h"
+#include <accelerator/ogl/image/image_mixer.h>
+#include <accelerator/ogl/util/context.h>
 #include <accelerator/ogl/util/shader.h>
 
 namespace caspar { namespace screen {
@@ -78,6 +83,16 @@ enum class stretch
     uniform_to_fill
 };
 
+// Where a window is shown
+struct head_configuration
+{
+    int screen_index  = 0;
+    int screen_x      = 0;
+    int screen_y      = 0;
+    int screen_width  = 0;
+    int screen_height = 0;
+};
+
 struct configuration
 {
     enum class aspect_ratio
@@ -95,58 +110,84 @@ struct configuration
     };
 
     std::wstring    name          = L"Screen consumer";
-    int             screen_index  = 0;
-    int             screen_x      = 0;
-    int             screen_y      = 0;
-    int             screen_width  = 0;
-    int             screen_height = 0;
     screen::stretch stretch       = screen::stretch::fill;
     bool            windowed      = true;
     bool            key_only      = false;
     bool            sbs_key       = false;
     aspect_ratio    aspect        = aspect_ratio::aspect_invalid;
     bool            vsync         = false;
+    int             swap_interval = 1;    // Vertical blanks per frame with vsync, -1 for adaptive vsync
+    bool            draw_texture  = true; // Draws the mixed image from the GPU when the accelerator shares with windows
     bool            interactive   = true;
     bool            borderless    = false;
     bool            always_on_top = false;
     colour_spaces   colour_space  = colour_spaces::RGB;
+
+    // The same image is shown in the window of each, of which there is at least one
+    std::vector<head_configuration> heads = {head_configuration{}};
 };
 
 struct frame
 {
-    GLuint pbo   = 0;
-    GLuint tex   = 0;
-    char*  ptr   = nullptr;
-    GLsync fence = nullptr;
+    GLuint pbo      = 0;
+    GLuint tex      = 0;
+    char*  ptr      = nullptr;
+    GLsync uploaded = nullptr; // Past the upload to tex, for the contexts of the other heads
+
+    // Past the last draw that used the frame, in the context of each head
+    std::vector<GLsync> fences;
+
+    // Drawn from the texture of the mixer instead of tex, and held until the fences are passed
+    core::const_frame shared;
 };
 
+// A window that shows the image, each with a context of its own. The contexts share their objects, so the image is
+// uploaded once for all of them.
+struct head
+{
+    head_configuration config;
+    sf::Window         window;
+
+    int screen_width  = 0;
+    int screen_height = 0;
+    int screen_x      = 0;
+    int screen_y      = 0;
+
+    std::vector<core::frame_geometry::coord> draw_coords;
+
+    // Vertex arrays are not shared between contexts
+    GLuint vao = 0;
+    GLuint vbo = 0;
+};
+
+// How long waits block at most before the events of the windows are polled
+const auto poll_interval = std::chrono::milliseconds(10);
+
 struct screen_consumer
 {
     const configuration     config_;
     core::video_format_desc format_desc_;
     int                     channel_index_;
+    const bool              draws_texture_; // Of the mixer instead of the image
 
     std::vector<frame> frames_;
 
-    int screen_width_  = format_desc_.width;
-    int screen_height_ = format_desc_.height;
     int square_width_  = format_desc_.square_width;
     int square_height_ = format_desc_.square_height;
-    int screen_x_      = 0;
-    int screen_y_      = 0;
 
-    std::vector<core::frame_geometry::coord> draw_coords_;
-
-    sf::Window window_;
+    // The first head uploads the image and is the only one to wait for vertical blanks
+    std::vector<std::unique_ptr<head>> heads_;
 
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    // The next frame to show, of which there is at most one
+    std::mutex              frame_mutex_;
+    std::condition_variable frame_cond_;
+    core::const_frame       next_frame_;
 
     std::unique_ptr<accelerator::ogl::shader> shader_;
-    GLuint                                    vao_;
-    GLuint                                    vbo_;
+    GLuint                                    sampler_;
 
     std::atomic<bool> is_running_{true};
     std::thread       thread_;
@@ -159,6 +200,7 @@ struct screen_consumer
         : config_(config)
         , format_desc_(format_desc)
         , channel_index_(channel_index)
+        , draws_texture_(config.draw_texture && accelerator::ogl::device_context::shares_with_windows())
     {
         if (format_desc_.format == core::video_format::ntsc &&
             config_.aspect == configuration::aspect_ratio::aspect_4_3) {
@@ -171,105 +213,30 @@ struct screen_consumer
             }
         }
 
-        frame_buffer_.set_capacity(1);
-
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
-#if defined(_MSC_VER)
-        DISPLAY_DEVICE              d_device = {sizeof(d_device), 0};
-        std::vector<DISPLAY_DEVICE> displayDevices;
-        for (int n = 0; EnumDisplayDevices(nullptr, n, &d_device, NULL); ++n) {
-            displayDevices.push_back(d_device);
-        }
-
-        if (config_.screen_index >= displayDevices.size()) {
-            CASPAR_LOG(warning) << print() << L" Invalid screen-index: " << config_.screen_index;
-        }
-
-        DEVMODE devmode = {};
-        if (!EnumDisplaySettings(displayDevices[config_.screen_index].DeviceName, ENUM_CURRENT_SETTINGS, &devmode)) {
-            CASPAR_LOG(warning) << print() << L" Could not find display settings for screen-index: "
-                                << config_.screen_index;
-        }
-
-        screen_x_      = devmode.dmPosition.x;
-        screen_y_      = devmode.dmPosition.y;
-        screen_width_  = devmode.dmPelsWidth;
-        screen_height_ = devmode.dmPelsHeight;
-#else
-        if (config_.screen_index > 1) {
-            CASPAR_LOG(warning) << print() << L" Screen-index is not supported on linux";
-        }
-#endif
-
-        if (config.windowed) {
-            screen_x_ += config.screen_x;
-            screen_y_ += config.screen_y;
-
-            if (config.screen_width > 0 && config.screen_height > 0) {
-                screen_width_  = config.screen_width;
-                screen_height_ = config.screen_height;
-            } else if (config.screen_width > 0) {
-                screen_width_  = config.screen_width;
-                screen_height_ = square_height_ * config.screen_width / square_width_;
-            } else if (config.screen_height > 0) {
-                screen_height_ = config.screen_height;
-                screen_width_  = square_width_ * config.screen_height / square_height_;
-            } else {
-                screen_width_  = square_width_;
-                screen_height_ = square_height_;
-            }
+        for (auto& head_config : config_.heads) {
+            auto head    = std::make_unique<screen::head>();
+            head->config = head_config;
+            place(*head);
+            heads_.push_back(std::move(head));
         }
 
         thread_ = std::thread([this] {
             try {
-                const auto    window_style = config_.borderless ? sf::Style::None
-                                             : config_.windowed ? sf::Style::Resize | sf::Style::Close
-                                                                : sf::Style::Fullscreen;
-                sf::VideoMode desktop      = sf::VideoMode::getDesktopMode();
-                sf::VideoMode mode(
-                    config_.sbs_key ? screen_width_ * 2 : screen_width_, screen_height_, desktop.bitsPerPixel);
-                window_.create(mode,
-                               u8(print()),
-                               window_style,
-                               sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core));
-                window_.setPosition(sf::Vector2i(screen_x_, screen_y_));
-                window_.setMouseCursorVisible(config_.interactive);
-                window_.setActive(true);
-
-                if (config_.always_on_top) {
-#ifdef _MSC_VER
-                    HWND hwnd = window_.getSystemHandle();
-                    SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
-#else
-                    window_always_on_top(window_);
-#endif
-                }
-
-                if (glewInit() != GLEW_OK) {
-                    CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
-                }
-
-                if (!GLEW_VERSION_4_5 && (glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
-                                                          "GL_ARB_direct_state_access GL_ARB_texture_barrier") == 0u)) {
-                    CASPAR_THROW_EXCEPTION(not_supported() << msg_info(
-                                               "Your graphics card does not meet the minimum hardware requirements "
-                                               "since it does not support OpenGL 4.5 or higher."));
+                for (auto& head : heads_) {
+                    open(*head);
                 }
 
-                GL(glGenVertexArrays(1, &vao_));
-                GL(glGenBuffers(1, &vbo_));
-                GL(glBindVertexArray(vao_));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+                heads_.front()->window.setActive(true);
 
                 shader_ = get_shader();
                 shader_->use();
                 shader_->set("background", 0);
-                shader_->set("window_width", screen_width_);
 
                 for (int n = 0; n < 2; ++n) {
                     screen::frame frame;
@@ -280,36 +247,26 @@ struct screen_consumer
                         reinterpret_cast<char*>(GL2(glMapNamedBufferRange(frame.pbo, 0, format_desc_.size, flags)));
 
                     GL(glCreateTextures(GL_TEXTURE_2D, 1, &frame.tex));
-                    GL(glTextureParameteri(frame.tex,
-                                           GL_TEXTURE_MIN_FILTER,
-                                           (config_.colour_space == configuration::colour_spaces::datavideo_full ||
-                                            config_.colour_space == configuration::colour_spaces::datavideo_limited)
-                                               ? GL_NEAREST
-                                               : GL_LINEAR));
-                    GL(glTextureParameteri(frame.tex,
-                                           GL_TEXTURE_MAG_FILTER,
-                                           (config_.colour_space == configuration::colour_spaces::datavideo_full ||
-                                            config_.colour_space == configuration::colour_spaces::datavideo_limited)
-                                               ? GL_NEAREST
-                                               : GL_LINEAR));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
                     GL(glTextureStorage2D(frame.tex, 1, GL_RGBA8, format_desc_.width, format_desc_.height));
                     GL(glClearTexImage(frame.tex, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
 
+                    frame.fences.resize(heads_.size(), nullptr);
                     frames_.push_back(frame);
                 }
 
-                GL(glDisable(GL_DEPTH_TEST));
-                GL(glClearColor(0.0, 0.0, 0.0, 0.0));
-                GL(glViewport(
-                    0, 0, config_.sbs_key ? format_desc_.width * 2 : format_desc_.width, format_desc_.height));
-
-                calculate_aspect();
-
-                window_.setVerticalSyncEnabled(config_.vsync);
-                if (config_.vsync) {
-                    CASPAR_LOG(info) << print() << " Enabled vsync.";
+                // Samples the textures of the frames and of the mixer alike, without changing those of the mixer
+                auto filter = (config_.colour_space == configuration::colour_spaces::datavideo_full ||
+                               config_.colour_space == configuration::colour_spaces::datavideo_limited)
+                                  ? GL_NEAREST
+                                  : GL_LINEAR;
+                GL(glCreateSamplers(1, &sampler_));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_MIN_FILTER, filter));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_MAG_FILTER, filter));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+                if (draws_texture_) {
+                    CASPAR_LOG(info) << print() << " Drawing the mixed image from the GPU.";
                 }
 
                 shader_->set("colour_space", config_.colour_space);
@@ -323,150 +280,370 @@ struct screen_consumer
                 while (is_running_) {
                     tick();
                 }
-            } catch (tbb::user_abort&) {
-                // Do nothing
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
                 is_running_ = false;
             }
-            for (auto frame : frames_) {
-                GL(glUnmapNamedBuffer(frame.pbo));
-                glDeleteBuffers(1, &frame.pbo);
-                glDeleteTextures(1, &frame.tex);
+
+            // The mixer textures of the frames may only be released once the GPU is done with them
+            for (auto& head : heads_) {
+                if (head->window.isOpen() && head->window.setActive(true)) {
+                    GL(glFinish());
+                }
             }
 
-            shader_.reset();
-            GL(glDeleteVertexArrays(1, &vao_));
-            GL(glDeleteBuffers(1, &vbo_));
+            if (!heads_.empty() && heads_.front()->window.isOpen()) {
+                heads_.front()->window.setActive(true);
+
+                for (auto& frame : frames_) {
+                    for (auto fence : frame.fences) {
+                        if (fence != nullptr) {
+                            glDeleteSync(fence);
+                        }
+                    }
+                    if (frame.uploaded != nullptr) {
+                        glDeleteSync(frame.uploaded);
+                    }
+                    frame.shared = core::const_frame{};
+                    GL(glUnmapNamedBuffer(frame.pbo));
+                    glDeleteBuffers(1, &frame.pbo);
+                    glDeleteTextures(1, &frame.tex);
+                }
 
-            window_.close();
+                shader_.reset();
+                GL(glDeleteSamplers(1, &sampler_));
+            }
+
+            for (auto& head : heads_) {
+                if (head->window.isOpen() && head->window.setActive(true)) {
+                    GL(glDeleteVertexArrays(1, &head->vao));
+                    GL(glDeleteBuffers(1, &head->vbo));
+                }
+                head->window.close();
+            }
         });
     }
 
     ~screen_consumer()
     {
         is_running_ = false;
-        frame_buffer_.abort();
+        frame_cond_.notify_all();
         thread_.join();
     }
 
+    // Finds where the window of the head goes, on its screen
+    void place(head& head)
+    {
+        const auto& config = head.config;
+
+        head.screen_width  = format_desc_.width;
+        head.screen_height = format_desc_.height;
+
+#if defined(_MSC_VER)
+        DISPLAY_DEVICE              d_device = {sizeof(d_device), 0};
+        std::vector<DISPLAY_DEVICE> displayDevices;
+        for (int n = 0; EnumDisplayDevices(nullptr, n, &d_device, NULL); ++n) {
+            displayDevices.push_back(d_device);
+        }
+
+        if (config.screen_index >= displayDevices.size()) {
+            CASPAR_LOG(warning) << print() << L" Invalid screen-index: " << config.screen_index;
+        }
+
+        DEVMODE devmode = {};
+        if (!EnumDisplaySettings(displayDevices[config.screen_index].DeviceName, ENUM_CURRENT_SETTINGS, &devmode)) {
+            CASPAR_LOG(warning) << print() << L" Could not find display settings for screen-index: "
+                                << config.screen_index;
+        }
+
+        head.screen_x      = devmode.dmPosition.x;
+        head.screen_y      = devmode.dmPosition.y;
+        head.screen_width  = devmode.dmPelsWidth;
+        head.screen_height = devmode.dmPelsHeight;
+#else
+        if (config.screen_index > 1) {
+            CASPAR_LOG(warning) << print() << L" Screen-index is not supported on linux";
+        }
+#endif
+
+        if (config_.windowed) {
+            head.screen_x += config.screen_x;
+            head.screen_y += config.screen_y;
+
+            if (config.screen_width > 0 && config.screen_height > 0) {
+                head.screen_width  = config.screen_width;
+                head.screen_height = config.screen_height;
+            } else if (config.screen_width > 0) {
+                head.screen_width  = config.screen_width;
+                head.screen_height = square_height_ * config.screen_width / square_width_;
+            } else if (config.screen_height > 0) {
+                head.screen_height = config.screen_height;
+                head.screen_width  = square_width_ * config.screen_height / square_height_;
+            } else {
+                head.screen_width  = square_width_;
+                head.screen_height = square_height_;
+            }
+        }
+    }
+
+    // Creates the window of the head and what is drawn with in its context
+    void open(head& head)
+    {
+        const bool first = &head == heads_.front().get();
+
+        const auto    window_style = config_.borderless ? sf::Style::None
+                                     : config_.windowed ? sf::Style::Resize | sf::Style::Close
+                                                        : sf::Style::Fullscreen;
+        sf::VideoMode desktop      = sf::VideoMode::getDesktopMode();
+        sf::VideoMode mode(
+            config_.sbs_key ? head.screen_width * 2 : head.screen_width, head.screen_height, desktop.bitsPerPixel);
+        head.window.create(mode,
+                           u8(print()),
+                           window_style,
+                           sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core));
+        head.window.setPosition(sf::Vector2i(head.screen_x, head.screen_y));
+        head.window.setMouseCursorVisible(config_.interactive);
+        head.window.setActive(true);
+
+        if (config_.always_on_top) {
+#ifdef _MSC_VER
+            HWND hwnd = head.window.getSystemHandle();
+            SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
+#else
+            window_always_on_top(head.window);
+#endif
+        }
+
+        if (first) {
+            if (glewInit() != GLEW_OK) {
+                CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
+            }
+
+            if (!GLEW_VERSION_4_5 && (glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
+                                                      "GL_ARB_direct_state_access GL_ARB_texture_barrier") == 0u)) {
+                CASPAR_THROW_EXCEPTION(not_supported() << msg_info(
+                                           "Your graphics card does not meet the minimum hardware requirements "
+                                           "since it does not support OpenGL 4.5 or higher."));
+            }
+        }
+
+        GL(glGenVertexArrays(1, &head.vao));
+        GL(glGenBuffers(1, &head.vbo));
+        GL(glBindVertexArray(head.vao));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, head.vbo));
+
+        GL(glDisable(GL_DEPTH_TEST));
+        GL(glClearColor(0.0, 0.0, 0.0, 0.0));
+
+        calculate_aspect(head);
+
+        // Waiting for the blanks of every head in turn would divide the frame rate by the number of heads
+        set_swap_interval(head, config_.vsync && first ? config_.swap_interval : 0);
+    }
+
     bool poll()
     {
-        int       count = 0;
-        sf::Event e;
-        while (window_.pollEvent(e)) {
-            count++;
-            if (e.type == sf::Event::Resized) {
-                calculate_aspect();
-            } else if (e.type == sf::Event::Closed) {
-                is_running_ = false;
+        int count = 0;
+        for (auto& head : heads_) {
+            sf::Event e;
+            while (head->window.pollEvent(e)) {
+                count++;
+                if (e.type == sf::Event::Resized) {
+                    head->window.setActive(true);
+                    calculate_aspect(*head);
+                } else if (e.type == sf::Event::Closed) {
+                    is_running_ = false;
+                }
             }
         }
         return count > 0;
     }
 
-    void tick()
+    // With the context of the head active
+    void set_swap_interval(head& head, int interval)
+    {
+#ifdef _MSC_VER
+        auto supported =
+            WGLEW_EXT_swap_control && (interval >= 0 || WGLEW_EXT_swap_control_tear) && wglSwapIntervalEXT(interval);
+#else
+        auto supported = window_swap_interval(head.window, interval);
+#endif
+        if (!supported) {
+            head.window.setVerticalSyncEnabled(interval != 0);
+            if (interval > 1 || interval < 0) {
+                CASPAR_LOG(warning) << print() << " Swap interval " << interval << " is not supported, using 1.";
+            }
+        } else if (interval != 0) {
+            CASPAR_LOG(info) << print() << " Enabled vsync with swap interval " << interval << ".";
+        }
+    }
+
+    // Waits for the next frame, while handling the events of the windows
+    core::const_frame pop()
     {
-        core::const_frame in_frame;
+        while (is_running_) {
+            {
+                std::unique_lock<std::mutex> lock(frame_mutex_);
+                if (frame_cond_.wait_for(lock, poll_interval, [&] { return next_frame_ || !is_running_; })) {
+                    auto frame  = std::move(next_frame_);
+                    next_frame_ = core::const_frame{};
+                    return frame;
+                }
+            }
+            poll();
+        }
+        return core::const_frame{};
+    }
 
-        while (!frame_buffer_.try_pop(in_frame) && is_running_) {
-            // TODO (fix)
-            if (!poll()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    // Waits for the GPU to be done with what last used the frame in any of the heads, while handling the events of
+    // the windows. Sync objects are shared by the contexts, so they are waited on from that of the first head.
+    void wait(screen::frame& frame)
+    {
+        for (auto& fence : frame.fences) {
+            while (fence != nullptr && is_running_) {
+                auto wait =
+                    glClientWaitSync(fence,
+                                     GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     std::chrono::duration_cast<std::chrono::nanoseconds>(poll_interval).count());
+                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED || wait == GL_WAIT_FAILED) {
+                    glDeleteSync(fence);
+                    fence = nullptr;
+                } else {
+                    poll();
+                }
             }
         }
+        if (frame.uploaded != nullptr) {
+            glDeleteSync(frame.uploaded);
+            frame.uploaded = nullptr;
+        }
+        frame.shared = core::const_frame{};
+    }
 
+    void tick()
+    {
+        auto in_frame = pop();
         if (!in_frame) {
             return;
         }
 
-        // Upload
+        poll();
+
+        auto& first = *heads_.front();
+        first.window.setActive(true);
+
+        // Upload once for all of the heads, unless the texture of the mixer is drawn instead
         {
             auto& frame = frames_.front();
 
-            while (frame.fence != nullptr) {
-                auto wait = glClientWaitSync(frame.fence, 0, 0);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    glDeleteSync(frame.fence);
-                    frame.fence = nullptr;
-                }
-                if (!poll()) {
-                    // TODO (fix)
-                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            wait(frame);
+
+            if (draws_texture_ && in_frame.opaque().has_value()) {
+                frame.shared = in_frame;
+            } else if (in_frame.image_data(0).size() >= format_desc_.size) {
+                std::memcpy(frame.ptr, in_frame.image_data(0).begin(), format_desc_.size);
+
+                GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.pbo));
+                GL(glTextureSubImage2D(
+                    frame.tex, 0, 0, 0, format_desc_.width, format_desc_.height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
+                GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+                if (heads_.size() > 1) {
+                    frame.uploaded = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    GL(glFlush());
                 }
             }
+        }
 
-            std::memcpy(frame.ptr, in_frame.image_data(0).begin(), format_desc_.size);
+        // Display, on the first head last, as only it waits for the vertical blank
+        auto& frame = frames_.back();
+        for (auto n = heads_.size(); n-- > 0;) {
+            auto& head = *heads_[n];
+            if (n > 0) {
+                head.window.setActive(true);
+                if (frame.uploaded != nullptr) {
+                    GL(glWaitSync(frame.uploaded, 0, GL_TIMEOUT_IGNORED));
+                }
+            }
 
-            GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.pbo));
-            GL(glTextureSubImage2D(
-                frame.tex, 0, 0, 0, format_desc_.width, format_desc_.height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
-            GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+            draw(head, frame);
 
-            frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            frame.fences[n] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            head.window.display();
         }
 
-        // Display
-        {
-            auto& frame = frames_.back();
+        std::rotate(frames_.begin(), frames_.begin() + 1, frames_.end());
+
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+    }
 
-            GL(glClear(GL_COLOR_BUFFER_BIT));
+    // With the context of the head active
+    void draw(head& head, screen::frame& frame)
+    {
+        GL(glClear(GL_COLOR_BUFFER_BIT));
 
+        GL(glBindSampler(0, sampler_));
+        if (!frame.shared || !accelerator::ogl::bind_rendered_texture(frame.shared, 0)) {
             GL(glActiveTexture(GL_TEXTURE0));
             GL(glBindTexture(GL_TEXTURE_2D, frame.tex));
+        }
 
-            GL(glBufferData(GL_ARRAY_BUFFER,
-                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * draw_coords_.size(),
-                            draw_coords_.data(),
-                            GL_STATIC_DRAW));
-
-            auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+        shader_->use();
 
-            auto vtx_loc = shader_->get_attrib_location("Position");
-            auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+        GL(glBindVertexArray(head.vao));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, head.vbo));
+        GL(glBufferData(GL_ARRAY_BUFFER,
+                        static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * head.draw_coords.size(),
+                        head.draw_coords.data(),
+                        GL_STATIC_DRAW));
 
-            GL(glEnableVertexAttribArray(vtx_loc));
-            GL(glEnableVertexAttribArray(tex_loc));
+        auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
 
-            GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-            GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+        auto vtx_loc = shader_->get_attrib_location("Position");
+        auto tex_loc = shader_->get_attrib_location("TexCoordIn");
 
-            shader_->set("window_width", screen_width_);
+        GL(glEnableVertexAttribArray(vtx_loc));
+        GL(glEnableVertexAttribArray(tex_loc));
 
-            if (config_.sbs_key) {
-                auto coords_size = static_cast<GLsizei>(draw_coords_.size());
+        GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+        GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
 
-                // First half fill
-                shader_->set("key_only", false);
-                GL(glDrawArrays(GL_TRIANGLES, 0, coords_size / 2));
+        shader_->set("window_width", head.screen_width);
 
-                // Second half key
-                shader_->set("key_only", true);
-                GL(glDrawArrays(GL_TRIANGLES, coords_size / 2, coords_size / 2));
-            } else {
-                shader_->set("key_only", config_.key_only);
-                GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(draw_coords_.size())));
-            }
+        if (config_.sbs_key) {
+            auto coords_size = static_cast<GLsizei>(head.draw_coords.size());
 
-            GL(glDisableVertexAttribArray(vtx_loc));
-            GL(glDisableVertexAttribArray(tex_loc));
+            // First half fill
+            shader_->set("key_only", false);
+            GL(glDrawArrays(GL_TRIANGLES, 0, coords_size / 2));
 
-            GL(glBindTexture(GL_TEXTURE_2D, 0));
+            // Second half key
+            shader_->set("key_only", true);
+            GL(glDrawArrays(GL_TRIANGLES, coords_size / 2, coords_size / 2));
+        } else {
+            shader_->set("key_only", config_.key_only);
+            GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(head.draw_coords.size())));
         }
 
-        window_.display();
+        GL(glDisableVertexAttribArray(vtx_loc));
+        GL(glDisableVertexAttribArray(tex_loc));
 
-        std::rotate(frames_.begin(), frames_.begin() + 1, frames_.end());
-
-        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
-        tick_timer_.restart();
+        GL(glBindTexture(GL_TEXTURE_2D, 0));
+        GL(glBindSampler(0, 0));
     }
 
     std::future<bool> send(core::video_field field, const core::const_frame& frame)
     {
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        {
+            std::lock_guard<std::mutex> lock(frame_mutex_);
+            if (next_frame_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            } else {
+                next_frame_ = frame;
+            }
         }
+        frame_cond_.notify_one();
         return make_ready_future(is_running_.load());
     }
 
@@ -477,26 +654,27 @@ struct screen_consumer
 
     std::wstring print() const { return config_.name + L" " + channel_and_format(); }
 
-    void calculate_aspect()
+    // With the context of the head active
+    void calculate_aspect(head& head)
     {
         if (config_.windowed) {
-            screen_height_ = window_.getSize().y;
-            screen_width_  = window_.getSize().x;
+            head.screen_height = head.window.getSize().y;
+            head.screen_width  = head.window.getSize().x;
         }
 
-        GL(glViewport(0, 0, screen_width_, screen_height_));
+        GL(glViewport(0, 0, head.screen_width, head.screen_height));
 
-        std::pair<float, float> target_ratio = none();
+        std::pair<float, float> target_ratio = none(head);
         if (config_.stretch == screen::stretch::fill) {
             target_ratio = Fill();
         } else if (config_.stretch == screen::stretch::uniform) {
-            target_ratio = uniform();
+            target_ratio = uniform(head);
         } else if (config_.stretch == screen::stretch::uniform_to_fill) {
-            target_ratio = uniform_to_fill();
+            target_ratio = uniform_to_fill(head);
         }
 
         if (config_.sbs_key) {
-            draw_coords_ = {
+            head.draw_coords = {
                 // First half fill
                 {-target_ratio.first, target_ratio.second, 0.0, 0.0}, // upper left
                 {0, target_ratio.second, 1.0, 0.0},                   // upper right
@@ -516,7 +694,7 @@ struct screen_consumer
                 {0, -target_ratio.second, 0.0, 1.0}                   // lower left
             };
         } else {
-            draw_coords_ = {
+            head.draw_coords = {
                 //    vertex    texture
                 {-target_ratio.first, target_ratio.second, 0.0, 0.0}, // upper left
                 {target_ratio.first, target_ratio.second, 1.0, 0.0},  // upper right
@@ -529,32 +707,33 @@ struct screen_consumer
         }
     }
 
-    std::pair<float, float> none() const
+    std::pair<float, float> none(const head& head) const
     {
-        float width =
-            static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) / static_cast<float>(screen_width_);
-        float height = static_cast<float>(square_height_) / static_cast<float>(screen_height_);
+        float width  = static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) /
+                       static_cast<float>(head.screen_width);
+        float height = static_cast<float>(square_height_) / static_cast<float>(head.screen_height);
 
         return std::make_pair(width, height);
     }
 
-    std::pair<float, float> uniform() const
+    std::pair<float, float> uniform(const head& head) const
     {
         float aspect = static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) /
                        static_cast<float>(square_height_);
-        float width  = std::min(1.0f, static_cast<float>(screen_height_) * aspect / static_cast<float>(screen_width_));
-        float height = static_cast<float>(screen_width_ * width) / static_cast<float>(screen_height_ * aspect);
+        float width =
+            std::min(1.0f, static_cast<float>(head.screen_height) * aspect / static_cast<float>(head.screen_width));
+        float height = static_cast<float>(head.screen_width * width) / static_cast<float>(head.screen_height * aspect);
 
         return std::make_pair(width, height);
     }
 
     static std::pair<float, float> Fill() { return std::make_pair(1.0f, 1.0f); }
 
-    std::pair<float, float> uniform_to_fill() const
+    std::pair<float, float> uniform_to_fill(const head& head) const
     {
-        float wr =
-            static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) / static_cast<float>(screen_width_);
-        float hr    = static_cast<float>(square_height_) / static_cast<float>(screen_height_);
+        float wr    = static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) /
+                      static_cast<float>(head.screen_width);
+        float hr    = static_cast<float>(square_height_) / static_cast<float>(head.screen_height);
         float r_inv = 1.0f / std::min(wr, hr);
 
         float width  = wr * r_inv;
@@ -594,13 +773,16 @@ struct screen_consumer_proxy : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
-    int index() const override { return 600 + (config_.key_only ? 10 : 0) + config_.screen_index; }
+    bool draws_texture() const override { return consumer_ && consumer_->draws_texture_; }
+
+    int index() const override { return 600 + (config_.key_only ? 10 : 0) + config_.heads.front().screen_index; }
 
     core::monitor::state state() const override
     {
         core::monitor::state state;
         state["screen/name"]          = config_.name;
-        state["screen/index"]         = config_.screen_index;
+        state["screen/index"]         = config_.heads.front().screen_index;
+        state["screen/heads"]         = static_cast<int>(config_.heads.size());
         state["screen/key_only"]      = config_.key_only;
         state["screen/always_on_top"] = config_.always_on_top;
         return state;
@@ -623,7 +805,7 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     if (params.size() > 1) {
         try {
-            config.screen_index = std::stoi(params.at(1));
+            config.heads.front().screen_index = std::stoi(params.at(1));
         } catch (...) {
         }
     }
@@ -639,16 +821,16 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     }
 
     if (contains_param(L"X", params)) {
-        config.screen_x = get_param(L"X", params, 0);
+        config.heads.front().screen_x = get_param(L"X", params, 0);
     }
     if (contains_param(L"Y", params)) {
-        config.screen_y = get_param(L"Y", params, 0);
+        config.heads.front().screen_y = get_param(L"Y", params, 0);
     }
     if (contains_param(L"WIDTH", params)) {
-        config.screen_width = get_param(L"WIDTH", params, 0);
+        config.heads.front().screen_width = get_param(L"WIDTH", params, 0);
     }
     if (contains_param(L"HEIGHT", params)) {
-        config.screen_height = get_param(L"HEIGHT", params, 0);
+        config.heads.front().screen_height = get_param(L"HEIGHT", params, 0);
     }
 
     if (config.sbs_key && config.key_only) {
@@ -659,6 +841,17 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     return spl::make_shared<screen_consumer_proxy>(config);
 }
 
+head_configuration get_head_ptree(const boost::property_tree::wptree& ptree)
+{
+    head_configuration head;
+    head.screen_index  = ptree.get(L"device", head.screen_index + 1) - 1;
+    head.screen_x      = ptree.get(L"x", head.screen_x);
+    head.screen_y      = ptree.get(L"y", head.screen_y);
+    head.screen_width  = ptree.get(L"width", head.screen_width);
+    head.screen_height = ptree.get(L"height", head.screen_height);
+    return head;
+}
+
 spl::shared_ptr<core::frame_consumer>
 create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
                               const core::video_format_repository&                     format_repository,
@@ -670,16 +863,19 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     if (channel_info.depth != common::bit_depth::bit8)
         CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Screen consumer only supports 8-bit color depth."));
 
+    config.heads.front() = get_head_ptree(ptree);
+    for (auto& xml_head : ptree | witerate_children(L"heads") | welement_context_iteration) {
+        ptree_verify_element_name(xml_head, L"head");
+        config.heads.push_back(get_head_ptree(xml_head.second));
+    }
+
     config.name          = ptree.get(L"name", config.name);
-    config.screen_index  = ptree.get(L"device", config.screen_index + 1) - 1;
-    config.screen_x      = ptree.get(L"x", config.screen_x);
-    config.screen_y      = ptree.get(L"y", config.screen_y);
-    config.screen_width  = ptree.get(L"width", config.screen_width);
-    config.screen_height = ptree.get(L"height", config.screen_height);
     config.windowed      = ptree.get(L"windowed", config.windowed);
     config.key_only      = ptree.get(L"key-only", config.key_only);
     config.sbs_key       = ptree.get(L"sbs-key", config.sbs_key);
     config.vsync         = ptree.get(L"vsync", config.vsync);
+    config.swap_interval = ptree.get(L"swap-interval", config.swap_interval);
+    config.draw_texture  = ptree.get(L"draw-texture", config.draw_texture);
     config.interactive   = ptree.get(L"interactive", config.interactive);
     config.borderless    = ptree.get(L"borderless", config.borderless);
     config.always_on_top = ptree.get(L"always-on-top", config.always_on_top);
@@ -21,6 +21,8 @@
 
 #include "x11_util.h"
 
+#include <GL/glxew.h>
+
 #include <X11/X.h>
 #include <X11/Xlib.h>
 
@@ -57,3 +59,19 @@ bool window_always_on_top(const sf::Window& window)
     XCloseDisplay(disp);
     return true;
 }
+
+bool window_swap_interval(const sf::Window& window, int interval)
+{
+    // The GLX extensions are loaded by glewInit
+    if (GLXEW_EXT_swap_control && (interval >= 0 || GLXEW_EXT_swap_control_tear)) {
+        glXSwapIntervalEXT(glXGetCurrentDisplay(), window.getSystemHandle(), interval);
+        return true;
+    }
+    if (GLXEW_MESA_swap_control && interval >= 0) {
+        return glXSwapIntervalMESA(interval) == 0;
+    }
+    if (GLXEW_SGI_swap_control && interval > 0) {
+        return glXSwapIntervalSGI(interval) == 0;
+    }
+    return false;
+}
@@ -24,3 +24,6 @@
 #include <SFML/Window.hpp>
 
 bool window_always_on_top(const sf::Window& window);
+
+// Sets the vertical blanks between buffer swaps of the window, with its context current, -1 for adaptive vsync
+bool window_swap_interval(const sf::Window& window, int interval);
@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "st2110_consumer.h"
+
+#include "../util/rtp.h"
+#include "../util/socket.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/consumer/channel_info.h>
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+// Packets handed over at once when they leave as they are sent, which is the burst they leave in
+const int PACKETS_PER_BATCH = 32;
+
+// Lines of a frame, blanking included, of the format in SDI. ST 2110-21 spreads the packets of a frame over the time of
+// its active lines, after the time of the vertical blanking.
+int total_lines(int height)
+{
+    switch (height) {
+        case 480:
+        case 486:
+            return 525;
+        case 576:
+            return 625;
+        case 720:
+            return 750;
+        case 1080:
+            return 1125;
+        case 2160:
+            return 2250;
+        default:
+            return height * 1125 / 1080;
+    }
+}
+
+// Packets of a frame or field, built before any is sent, in buffers that are kept from one to the next
+class packet_batch
+{
+    std::vector<std::uint8_t>        data_;
+    std::vector<int>                 sizes_;
+    std::vector<std::int64_t>        times_;
+    std::vector<const std::uint8_t*> packets_;
+
+  public:
+    void clear()
+    {
+        sizes_.clear();
+        times_.clear();
+    }
+
+    // A packet of size bytes, to leave at time, valid until the next is added
+    std::uint8_t* add(int size, std::int64_t time)
+    {
+        const auto offset = sizes_.size() * MAX_PACKET_SIZE;
+        if (data_.size() < offset + MAX_PACKET_SIZE) {
+            data_.resize(offset + MAX_PACKET_SIZE);
+        }
+        sizes_.push_back(size);
+        times_.push_back(time);
+        return data_.data() + offset;
+    }
+
+    int size() const { return static_cast<int>(sizes_.size()); }
+
+    std::int64_t time(int index) const { return times_[index]; }
+
+    void send(packet_sender& sender, int first, int count)
+    {
+        packets_.clear();
+        for (int n = first; n < first + count; ++n) {
+            packets_.push_back(data_.data() + static_cast<std::size_t>(n) * MAX_PACKET_SIZE);
+        }
+        sender.send(packets_.data(), sizes_.data() + first, times_.data() + first, count);
+    }
+};
+
+std::uint32_t random_ssrc()
+{
+    static std::mutex           mutex;
+    static std::random_device   device;
+    std::lock_guard<std::mutex> lock(mutex);
+    return device();
+}
+
+} // namespace
+
+struct st2110_consumer : public core::frame_consumer
+{
+    const endpoint    video_;
+    const endpoint    audio_;
+    const std::string interface_;
+    const int         requested_audio_channels_; // 0 for those of the channel
+    const int         ttl_;
+    const int         dscp_;
+    const int         buffer_depth_;
+    const bool        launch_time_;
+
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_  = 0;
+    int                                 audio_channels_ = 0;
+    std::unique_ptr<packet_sender>      video_sender_;
+    std::unique_ptr<packet_sender>      audio_sender_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+
+    std::mutex                    buffer_mutex_;
+    std::condition_variable       buffer_cond_;
+    std::deque<core::const_frame> buffer_;
+
+    // Of the send thread
+    const std::uint32_t       video_ssrc_ = random_ssrc();
+    const std::uint32_t       audio_ssrc_ = random_ssrc();
+    std::uint32_t             video_sequence_  = 0; // Extended to 32 bits, as ST 2110-20 counts the many packets
+    std::uint16_t             audio_sequence_  = 0;
+    std::uint32_t             audio_timestamp_ = 0;
+    std::vector<std::int32_t> audio_fifo_; // Samples left over of earlier frames, of the channel's channels
+    packet_batch              video_packets_;
+    packet_batch              audio_packets_;
+
+    std::atomic<bool>         paced_{false};
+    std::atomic<std::int64_t> packets_sent_{0};
+    std::atomic<std::int64_t> late_{0};
+    std::atomic<std::int64_t> repeated_{0};
+
+    std::atomic<bool> running_{false};
+    std::thread       send_thread_;
+
+  public:
+    st2110_consumer(endpoint    video,
+                    endpoint    audio,
+                    std::string interface_address,
+                    int         audio_channels,
+                    int         ttl,
+                    int         dscp,
+                    int         buffer_depth,
+                    bool        launch_time)
+        : video_(std::move(video))
+        , audio_(std::move(audio))
+        , interface_(std::move(interface_address))
+        , requested_audio_channels_(audio_channels)
+        , ttl_(ttl)
+        , dscp_(dscp)
+        , buffer_depth_(std::max(1, buffer_depth))
+        , launch_time_(launch_time)
+    {
+        graph_->set_text(print());
+        graph_->set_color("send-time", diagnostics::color(0.5f, 1.0f, 0.2f));
+        graph_->set_color("buffered-frames", diagnostics::color(0.5f, 0.0f, 0.2f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("repeated-frame", diagnostics::color(0.6f, 0.3f, 0.9f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~st2110_consumer() { stop(); }
+
+    void stop()
+    {
+        running_ = false;
+        buffer_cond_.notify_all();
+        if (send_thread_.joinable()) {
+            send_thread_.join();
+        }
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc,
+                    const core::channel_info&      channel_info,
+                    int                            port_index) override
+    {
+        stop();
+
+        format_desc_    = format_desc;
+        channel_index_  = channel_info.index;
+        audio_channels_ = requested_audio_channels_ > 0 ? requested_audio_channels_ : format_desc_.audio_channels;
+
+        if (format_desc_.audio_sample_rate != AUDIO_CLOCK_RATE && audio_) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"ST 2110 audio is sent at 48 kHz only."));
+        }
+
+        video_sender_ = std::make_unique<packet_sender>(video_, interface_, ttl_, dscp_, launch_time_);
+        if (audio_) {
+            audio_sender_ = std::make_unique<packet_sender>(audio_, interface_, ttl_, dscp_, launch_time_);
+        }
+        paced_ = video_sender_->paces();
+
+        graph_->set_text(print());
+
+        running_     = true;
+        send_thread_ = std::thread([this] {
+            set_thread_realtime_priority();
+            set_thread_name(L"st2110-send: " + to_wstring(video_));
+            try {
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex_);
+            buffer_.push_back(std::move(frame));
+
+            // The channel runs ahead of the media clock, which sends at its own pace
+            while (static_cast<int>(buffer_.size()) > buffer_depth_ * 2 + 2) {
+                buffer_.pop_front();
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+        }
+        buffer_cond_.notify_all();
+        return make_ready_future(true);
+    }
+
+    void run()
+    {
+        // Frames, or fields, are sent at their times on the media clock, counted in units of them from its epoch, so
+        // that receivers find them aligned with those of other senders locked to the same clock
+        {
+            std::unique_lock<std::mutex> lock(buffer_mutex_);
+            buffer_cond_.wait(lock, [&] { return !running_ || static_cast<int>(buffer_.size()) >= buffer_depth_; });
+        }
+
+        const auto interlaced = format_desc_.field_count == 2;
+
+        auto unit = unit_index(media_clock_now()) + 2;
+        if (interlaced && unit % 2 != 0) {
+            ++unit; // So that the first field of a frame starts at the frame's time
+        }
+        audio_timestamp_ = media_timestamp(unit_time(unit), AUDIO_CLOCK_RATE);
+
+        core::const_frame last;
+        while (running_) {
+            const auto time     = unit_time(unit);
+            const auto duration = unit_time(unit + 1) - time;
+
+            // Built a unit ahead, so that the kernel has them in time when it launches packets at their times, and
+            // otherwise the first batch leaves on time
+            wait_for_media_clock(time - duration);
+
+            core::const_frame frame;
+            {
+                std::lock_guard<std::mutex> lock(buffer_mutex_);
+                graph_->set_value("buffered-frames",
+                                  static_cast<double>(buffer_.size() + 0.001) / (buffer_depth_ * 2 + 2));
+                if (!buffer_.empty()) {
+                    frame = std::move(buffer_.front());
+                    buffer_.pop_front();
+                }
+            }
+
+            const auto repeat = !frame;
+            if (repeat) {
+                // Receivers expect a frame every frame, so the last one is sent again, though silent
+                frame = last;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "repeated-frame");
+                ++repeated_;
+            }
+
+            const auto start = media_clock_now();
+
+            build_video(frame, interlaced && unit % 2 != 0, time, duration);
+            if (audio_sender_ && frame) {
+                build_audio(frame, repeat, time);
+            }
+            send_packets();
+
+            graph_->set_value("send-time",
+                              static_cast<double>(media_clock_now() - start) / static_cast<double>(duration) * 0.5);
+
+            last = std::move(frame);
+            ++unit;
+
+            // Units that are behind the clock are skipped, rather than all that follow being sent late
+            const auto current = unit_index(media_clock_now());
+            if (current >= unit) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                ++late_;
+                unit = current + 1;
+            }
+        }
+    }
+
+    // Packs the rows of the frame, or of the field, from the mixer's v210 into pgroups, at most a packet to 480 pixels
+    // of a row, spaced evenly over the active lines of the unit as by the narrow senders of ST 2110-21
+    void build_video(const core::const_frame& frame, bool second_field, std::int64_t time, std::int64_t duration)
+    {
+        video_packets_.clear();
+
+        const auto  width     = format_desc_.width;
+        const auto  row_bytes = core::packed_row_bytes(core::output_packing::v210, width);
+        const auto& v210      = frame ? frame.packed_data(core::output_packing::v210) : array<const std::uint8_t>();
+        if (v210.size() < static_cast<std::size_t>(row_bytes) * format_desc_.height) {
+            return;
+        }
+
+        const auto interlaced = format_desc_.field_count == 2;
+        const auto rows       = interlaced ? format_desc_.height / 2 : format_desc_.height;
+        const auto per_row    = (width + VIDEO_PAYLOAD_PIXELS - 1) / VIDEO_PAYLOAD_PIXELS;
+        const auto count      = rows * per_row;
+
+        const auto total     = total_lines(format_desc_.height);
+        const auto offset    = duration * (total - format_desc_.height) / total;
+        const auto spacing   = duration * format_desc_.height / total / count;
+        const auto timestamp = media_timestamp(time, VIDEO_CLOCK_RATE);
+
+        for (int row = 0; row < rows; ++row) {
+            const auto line = interlaced ? row * 2 + (second_field ? 1 : 0) : row;
+            const auto src  = reinterpret_cast<const std::uint32_t*>(v210.data() + line * row_bytes);
+
+            for (int first = 0; first < width; first += VIDEO_PAYLOAD_PIXELS) {
+                const auto pixels = std::min(VIDEO_PAYLOAD_PIXELS, width - first);
+                const auto length = pixels / 2 * PGROUP_SIZE;
+                const auto index  = video_packets_.size();
+                const auto dest   = video_packets_.add(VIDEO_HEADER_SIZE + length, time + offset + index * spacing);
+
+                rtp_header header;
+                header.marker       = index + 1 == count;
+                header.payload_type = VIDEO_PAYLOAD_TYPE;
+                header.sequence     = static_cast<std::uint16_t>(video_sequence_);
+                header.timestamp    = timestamp;
+                header.ssrc         = video_ssrc_;
+                write_rtp_header(dest, header);
+
+                // The high half of the extended sequence number, and the one sample row data header of the packet
+                dest[12] = static_cast<std::uint8_t>(video_sequence_ >> 24);
+                dest[13] = static_cast<std::uint8_t>(video_sequence_ >> 16);
+                dest[14] = static_cast<std::uint8_t>(length >> 8);
+                dest[15] = static_cast<std::uint8_t>(length);
+                dest[16] = static_cast<std::uint8_t>((second_field ? 0x80 : 0x00) | (row >> 8 & 0x7f));
+                dest[17] = static_cast<std::uint8_t>(row);
+                dest[18] = static_cast<std::uint8_t>(first >> 8 & 0x7f);
+                dest[19] = static_cast<std::uint8_t>(first);
+
+                pack_pgroups(src, first, pixels, dest + VIDEO_HEADER_SIZE);
+                ++video_sequence_;
+            }
+        }
+    }
+
+    // Packs the audio of the frame into packets of 1 ms, or of 125 us where more than 10 channels do not fit 1 ms in a
+    // packet. Samples that do not fill a packet are sent with the next frame.
+    void build_audio(const core::const_frame& frame, bool silent, std::int64_t time)
+    {
+        audio_packets_.clear();
+
+        const auto  src_channels = format_desc_.audio_channels;
+        const auto& audio        = frame.audio_data();
+        if (silent) {
+            audio_fifo_.resize(audio_fifo_.size() + audio.size(), 0);
+        } else {
+            audio_fifo_.insert(audio_fifo_.end(), audio.begin(), audio.end());
+        }
+
+        const auto millisecond        = AUDIO_CLOCK_RATE / 1000;
+        const auto samples_per_packet = audio_channels_ * millisecond * AUDIO_SAMPLE_SIZE <= AUDIO_MAX_PAYLOAD
+                                            ? millisecond
+                                            : millisecond / 8;
+        const auto packet_time = samples_per_packet * 1000000000LL / AUDIO_CLOCK_RATE;
+        const auto count       = static_cast<int>(audio_fifo_.size() / src_channels / samples_per_packet);
+
+        for (int n = 0; n < count; ++n) {
+            const auto dest = audio_packets_.add(
+                RTP_HEADER_SIZE + samples_per_packet * audio_channels_ * AUDIO_SAMPLE_SIZE, time + n * packet_time);
+
+            rtp_header header;
+            header.payload_type = AUDIO_PAYLOAD_TYPE;
+            header.sequence     = audio_sequence_++;
+            header.timestamp    = audio_timestamp_;
+            header.ssrc         = audio_ssrc_;
+            write_rtp_header(dest, header);
+
+            pack_l24(audio_fifo_.data() + static_cast<std::size_t>(n) * samples_per_packet * src_channels,
+                     src_channels,
+                     samples_per_packet,
+                     audio_channels_,
+                     dest + RTP_HEADER_SIZE);
+            audio_timestamp_ += samples_per_packet;
+        }
+
+        const auto sent = static_cast<std::ptrdiff_t>(count) * samples_per_packet * src_channels;
+        audio_fifo_.erase(audio_fifo_.begin(), audio_fifo_.begin() + sent);
+    }
+
+    void send_packets()
+    {
+        const auto video_count = video_packets_.size();
+        const auto audio_count = audio_packets_.size();
+
+        if (paced_) {
+            // The kernel launches each at its time
+            video_packets_.send(*video_sender_, 0, video_count);
+            if (audio_count > 0) {
+                audio_packets_.send(*audio_sender_, 0, audio_count);
+            }
+        } else {
+            // Each batch waits for the time of its first packet, so that the unit leaves in bursts of a batch rather
+            // than all at once, and audio leaves between them as it is due
+            int audio_sent = 0;
+            for (int n = 0; n < video_count; n += PACKETS_PER_BATCH) {
+                wait_for_media_clock(video_packets_.time(n));
+                video_packets_.send(*video_sender_, n, std::min(PACKETS_PER_BATCH, video_count - n));
+
+                const auto now = media_clock_now();
+                auto       due = audio_sent;
+                while (due < audio_count && audio_packets_.time(due) <= now) {
+                    ++due;
+                }
+                if (due > audio_sent) {
+                    audio_packets_.send(*audio_sender_, audio_sent, due - audio_sent);
+                    audio_sent = due;
+                }
+            }
+            for (; audio_sent < audio_count; ++audio_sent) {
+                wait_for_media_clock(audio_packets_.time(audio_sent));
+                audio_packets_.send(*audio_sender_, audio_sent, 1);
+            }
+        }
+
+        packets_sent_ += video_count + audio_count;
+    }
+
+    // The unit, frame or field, of the format that the media clock is in at time, counted from its epoch
+    std::int64_t unit_index(std::int64_t time) const
+    {
+        const auto rate     = static_cast<std::int64_t>(format_desc_.time_scale) * format_desc_.field_count;
+        const auto duration = static_cast<std::int64_t>(format_desc_.duration);
+
+        // In parts, as the product of the time since the epoch and the rate does not fit in 64 bits
+        const auto ticks = time / 1000000000LL * rate;
+        const auto rest  = time % 1000000000LL * rate;
+        return ticks / duration + (ticks % duration * 1000000000LL + rest) / (duration * 1000000000LL);
+    }
+
+    // The media clock time that the unit starts at, exact at fractional rates such as 59.94
+    std::int64_t unit_time(std::int64_t unit) const
+    {
+        const auto rate  = static_cast<std::int64_t>(format_desc_.time_scale) * format_desc_.field_count;
+        const auto ticks = unit * format_desc_.duration;
+        return ticks / rate * 1000000000LL + ticks % rate * 1000000000LL / rate;
+    }
+
+    std::vector<core::output_packing> packings() const override { return {core::output_packing::v210}; }
+
+    // Fields are sent as they are, each in its own packets
+    bool shows_fields() const override { return true; }
+
+    std::wstring print() const override
+    {
+        if (channel_index_) {
+            return L"st2110[" + boost::lexical_cast<std::wstring>(channel_index_) + L"|" + to_wstring(video_) + L"]";
+        } else {
+            return L"[st2110]";
+        }
+    }
+
+    std::wstring name() const override { return L"st2110"; }
+
+    int index() const override { return 1100 + video_.port; }
+
+    // Sent at the pace of the media clock rather than that of the channel
+    bool has_synchronization_clock() const override { return false; }
+
+    core::monitor::state state() const override
+    {
+        core::monitor::state state;
+        state["st2110/video"]          = to_wstring(video_);
+        state["st2110/audio"]          = audio_ ? to_wstring(audio_) : std::wstring();
+        state["st2110/audio_channels"] = audio_channels_;
+        state["st2110/paced"]          = paced_.load();
+        state["st2110/packets"]        = packets_sent_.load();
+        state["st2110/late"]           = late_.load();
+        state["st2110/repeated"]       = repeated_.load();
+        return state;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer>
+create_consumer(const std::vector<std::wstring>&                         params,
+                const core::video_format_repository&                     format_repository,
+                const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                const core::channel_info&                                channel_info)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"ST2110"))
+        return core::frame_consumer::empty();
+
+    auto video          = parse_endpoint(params.at(1));
+    auto audio_address  = get_param(L"AUDIO", params, L"");
+    auto audio          = audio_address.empty() ? endpoint() : parse_endpoint(audio_address);
+    auto interface_addr = u8(get_param(L"INTERFACE", params, L""));
+    int  audio_channels = get_param(L"AUDIO_CHANNELS", params, 0);
+    int  ttl            = get_param(L"TTL", params, 16);
+    int  dscp           = get_param(L"DSCP", params, 34);
+    int  buffer_depth   = get_param(L"BUFFER_DEPTH", params, 2);
+    bool launch_time    = !contains_param(L"NO_TXTIME", params);
+
+    return spl::make_shared<st2110_consumer>(
+        video, audio, interface_addr, audio_channels, ttl, dscp, buffer_depth, launch_time);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
+                              const core::video_format_repository&                     format_repository,
+                              const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                              const core::channel_info&                                channel_info)
+{
+    auto video_address = ptree.get<std::wstring>(L"video");
+    auto audio_address = ptree.get(L"audio", L"");
+
+    auto video          = parse_endpoint(video_address);
+    auto audio          = audio_address.empty() ? endpoint() : parse_endpoint(audio_address);
+    auto interface_addr = u8(ptree.get(L"interface", L""));
+    int  audio_channels = ptree.get(L"audio-channels", 0);
+    int  ttl            = ptree.get(L"ttl", 16);
+    int  dscp           = ptree.get(L"dscp", 34);
+    int  buffer_depth   = ptree.get(L"buffer-depth", 2);
+    bool launch_time    = ptree.get(L"txtime", true);
+
+    return spl::make_shared<st2110_consumer>(
+        video, audio, interface_addr, audio_channels, ttl, dscp, buffer_depth, launch_time);
+}
+
+}} // namespace caspar::st2110
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "st2110_producer.h"
+
+#include "../util/rtp.h"
+#include "../util/socket.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+const int PACKETS_PER_RECEIVE = 64;
+
+// Buffers that packets are received into, as many as are received at once
+struct receive_buffers
+{
+    std::vector<std::uint8_t>  data    = std::vector<std::uint8_t>(PACKETS_PER_RECEIVE * MAX_PACKET_SIZE);
+    std::vector<std::uint8_t*> packets = std::vector<std::uint8_t*>(PACKETS_PER_RECEIVE);
+    std::vector<int>           sizes   = std::vector<int>(PACKETS_PER_RECEIVE);
+
+    receive_buffers()
+    {
+        for (int n = 0; n < PACKETS_PER_RECEIVE; ++n) {
+            packets[n] = data.data() + n * MAX_PACKET_SIZE;
+        }
+    }
+};
+
+} // namespace
+
+struct st2110_producer : public core::frame_producer
+{
+    const endpoint    video_;
+    const endpoint    audio_;
+    const std::string interface_;
+    const int         audio_channels_;
+
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc              format_desc_;
+    core::pixel_format_desc              desc_;
+    spl::shared_ptr<diagnostics::graph>  graph_;
+    timer                                tick_timer_;
+
+    std::mutex                    frames_mutex_;
+    std::deque<core::const_frame> frames_;
+    core::const_frame             frame_; // Shown until the next frame is complete
+    core::const_frame             no_video_;
+
+    std::mutex                audio_mutex_;
+    std::vector<std::int32_t> audio_fifo_; // Of audio_channels_ channels
+    bool                      audio_started_ = false;
+
+    std::atomic<std::int64_t> packets_{0};
+    std::atomic<std::int64_t> lost_{0};
+
+    std::atomic<bool> running_{true};
+    std::thread       video_thread_;
+    std::thread       audio_thread_;
+
+  public:
+    st2110_producer(spl::shared_ptr<core::frame_factory> frame_factory,
+                    core::video_format_desc              format_desc,
+                    endpoint                             video,
+                    endpoint                             audio,
+                    std::string                          interface_address,
+                    int                                  audio_channels)
+        : video_(std::move(video))
+        , audio_(std::move(audio))
+        , interface_(std::move(interface_address))
+        , audio_channels_(audio_channels > 0 ? audio_channels : format_desc.audio_channels)
+        , frame_factory_(std::move(frame_factory))
+        , format_desc_(std::move(format_desc))
+        , desc_(core::pixel_format::ycbcr)
+    {
+        // 4:2:2 10-bit of ST 2110-20, in the planes of yuv422p10 that the mixer converts on the GPU
+        const auto width  = format_desc_.width;
+        const auto height = format_desc_.height;
+        desc_.planes.push_back(core::pixel_format_desc::plane(width, height, 1, common::bit_depth::bit10));
+        desc_.planes.push_back(core::pixel_format_desc::plane(width / 2, height, 1, common::bit_depth::bit10));
+        desc_.planes.push_back(core::pixel_format_desc::plane(width / 2, height, 1, common::bit_depth::bit10));
+
+        no_video_ = frame_factory_->create_frame(this, core::pixel_format_desc(core::pixel_format::invalid));
+
+        graph_->set_text(print());
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("lost-packet", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+
+        video_thread_ = std::thread([this] { run(L"st2110-video: ", video_, [this] { receive_video(); }); });
+        if (audio_) {
+            audio_thread_ = std::thread([this] { run(L"st2110-audio: ", audio_, [this] { receive_audio(); }); });
+        }
+    }
+
+    ~st2110_producer()
+    {
+        running_ = false;
+        if (video_thread_.joinable()) {
+            video_thread_.join();
+        }
+        if (audio_thread_.joinable()) {
+            audio_thread_.join();
+        }
+    }
+
+    template <typename Func>
+    void run(const std::wstring& name, const endpoint& source, Func&& func)
+    {
+        set_thread_realtime_priority();
+        set_thread_name(name + to_wstring(source));
+        try {
+            func();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    // Depacketizes pgroups into the planes of a frame, which is complete at the marker of its last packet, or of that
+    // of its second field
+    void receive_video()
+    {
+        packet_receiver receiver(video_, interface_);
+        receive_buffers buffers;
+
+        const auto width      = format_desc_.width;
+        const auto height     = format_desc_.height;
+        const auto interlaced = format_desc_.field_count == 2;
+
+        std::optional<core::mutable_frame> frame;
+        std::uint32_t                      timestamp    = 0;
+        std::uint32_t                      expected     = 0;
+        bool                               sequenced    = false;
+        bool                               second_field = false;
+
+        const auto complete = [&] {
+            std::lock_guard<std::mutex> lock(frames_mutex_);
+            frames_.push_back(core::const_frame(std::move(*frame)));
+            while (frames_.size() > 2) {
+                frames_.pop_front();
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+            frame.reset();
+        };
+
+        while (running_) {
+            const auto count = receiver.receive(
+                buffers.packets.data(), buffers.sizes.data(), PACKETS_PER_RECEIVE, std::chrono::milliseconds(100));
+
+            for (int n = 0; n < count; ++n) {
+                const auto src  = buffers.packets[n];
+                const auto size = buffers.sizes[n];
+
+                rtp_header header;
+                if (size < VIDEO_HEADER_SIZE || !read_rtp_header(src, size, header)) {
+                    continue;
+                }
+                ++packets_;
+
+                const auto sequence = static_cast<std::uint32_t>(src[12]) << 24 |
+                                      static_cast<std::uint32_t>(src[13]) << 16 | header.sequence;
+                if (sequenced && sequence != expected) {
+                    lost_ += static_cast<std::int32_t>(sequence - expected);
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "lost-packet");
+                }
+                expected  = sequence + 1;
+                sequenced = true;
+
+                // A frame whose marker was lost is complete at the first packet of the next
+                if (frame && header.timestamp != timestamp && (!interlaced || second_field)) {
+                    complete();
+                }
+                if (!frame) {
+                    frame.emplace(frame_factory_->create_frame(this, desc_));
+                    second_field = false;
+                }
+                timestamp = header.timestamp;
+
+                // Sample row data headers follow one another while their continuation bit is set, and the pgroups
+                // they describe follow them in the same order
+                const auto headers = src + 14;
+                auto       end     = headers + 6;
+                while (end + 6 <= src + size && (end[-2] & 0x80) != 0) {
+                    end += 6;
+                }
+
+                auto data  = end;
+                auto field = false;
+                for (auto srd = headers; srd < end; srd += 6) {
+                    const auto length = srd[0] << 8 | srd[1];
+                    const auto row    = (srd[2] & 0x7f) << 8 | srd[3];
+                    const auto offset = (srd[4] & 0x7f) << 8 | srd[5];
+                    field             = (srd[2] & 0x80) != 0;
+
+                    const auto line   = interlaced ? row * 2 + (field ? 1 : 0) : row;
+                    const auto pixels = std::min(length / PGROUP_SIZE * 2, width - offset);
+                    if (line < height && pixels > 0 && data + length <= src + size) {
+                        const auto y  = reinterpret_cast<std::uint16_t*>(frame->image_data(0).data());
+                        const auto cb = reinterpret_cast<std::uint16_t*>(frame->image_data(1).data());
+                        const auto cr = reinterpret_cast<std::uint16_t*>(frame->image_data(2).data());
+                        const auto chroma = line * (width / 2) + offset / 2;
+                        unpack_pgroups(data, pixels, y + line * width + offset, cb + chroma, cr + chroma);
+                    }
+                    data += length;
+                }
+
+                if (field) {
+                    second_field = true;
+                }
+                if (header.marker && (!interlaced || field)) {
+                    complete();
+                }
+            }
+        }
+    }
+
+    void receive_audio()
+    {
+        packet_receiver receiver(audio_, interface_);
+        receive_buffers buffers;
+
+        std::vector<std::int32_t> samples;
+        std::uint16_t             expected  = 0;
+        bool                      sequenced = false;
+
+        // Drift between the sender's clock and the channel's is taken up by dropping the oldest samples beyond this
+        const auto max_samples = static_cast<std::size_t>(format_desc_.audio_sample_rate / 5) * audio_channels_;
+
+        while (running_) {
+            const auto count = receiver.receive(
+                buffers.packets.data(), buffers.sizes.data(), PACKETS_PER_RECEIVE, std::chrono::milliseconds(100));
+
+            for (int n = 0; n < count; ++n) {
+                const auto src  = buffers.packets[n];
+                const auto size = buffers.sizes[n];
+
+                rtp_header header;
+                if (!read_rtp_header(src, size, header)) {
+                    continue;
+                }
+                ++packets_;
+
+                if (sequenced && header.sequence != expected) {
+                    lost_ += static_cast<std::uint16_t>(header.sequence - expected);
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "lost-packet");
+                }
+                expected  = static_cast<std::uint16_t>(header.sequence + 1);
+                sequenced = true;
+
+                const auto nb_samples = (size - RTP_HEADER_SIZE) / (AUDIO_SAMPLE_SIZE * audio_channels_);
+                samples.resize(static_cast<std::size_t>(nb_samples) * audio_channels_);
+                unpack_l24(src + RTP_HEADER_SIZE, nb_samples, audio_channels_, samples.data());
+
+                std::lock_guard<std::mutex> lock(audio_mutex_);
+                audio_fifo_.insert(audio_fifo_.end(), samples.begin(), samples.end());
+                if (audio_fifo_.size() > max_samples) {
+                    audio_fifo_.erase(audio_fifo_.begin(), audio_fifo_.end() - max_samples);
+                }
+            }
+        }
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+
+        // The second field is the second half of the frame the first took
+        if (field != core::video_field::b) {
+            std::lock_guard<std::mutex> lock(frames_mutex_);
+            if (!frames_.empty()) {
+                frame_ = std::move(frames_.front());
+                frames_.pop_front();
+            }
+        }
+
+        if (!audio_) {
+            return frame_ ? core::draw_frame(frame_) : core::draw_frame{};
+        }
+
+        // Silent until a couple of frames of audio are buffered against the jitter of packets, and whenever they run
+        // out
+        std::vector<std::int32_t> samples(static_cast<std::size_t>(nb_samples) * audio_channels_, 0);
+        {
+            std::lock_guard<std::mutex> lock(audio_mutex_);
+            audio_started_ = audio_started_ ? !audio_fifo_.empty() : audio_fifo_.size() >= samples.size() * 2;
+            if (audio_started_) {
+                const auto available = std::min(samples.size(), audio_fifo_.size());
+                std::copy_n(audio_fifo_.begin(), available, samples.begin());
+                audio_fifo_.erase(audio_fifo_.begin(), audio_fifo_.begin() + available);
+            }
+        }
+
+        const auto& frame = frame_ ? frame_ : no_video_;
+        return core::draw_frame(
+            frame.with_audio(array<const std::int32_t>(array<std::int32_t>(std::move(samples))), audio_channels_));
+    }
+
+    core::draw_frame last_frame(const core::video_field field) override
+    {
+        return frame_ ? core::draw_frame::still(core::draw_frame(frame_)) : core::draw_frame{};
+    }
+
+    bool is_ready() override
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex_);
+        return !frames_.empty() || frame_;
+    }
+
+    std::wstring print() const override { return L"st2110[" + to_wstring(video_) + L"]"; }
+
+    std::wstring name() const override { return L"st2110"; }
+
+    core::monitor::state state() const override
+    {
+        core::monitor::state state;
+        state["st2110/video"]   = to_wstring(video_);
+        state["st2110/audio"]   = audio_ ? to_wstring(audio_) : std::wstring();
+        state["st2110/packets"] = packets_.load();
+        state["st2110/lost"]    = lost_.load();
+        return state;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::algorithm::istarts_with(params.at(0), L"st2110://"))
+        return core::frame_producer::empty();
+
+    auto video          = parse_endpoint(params.at(0).substr(9));
+    auto audio_address  = get_param(L"AUDIO", params, L"");
+    auto audio          = audio_address.empty() ? endpoint() : parse_endpoint(audio_address);
+    auto interface_addr = u8(get_param(L"INTERFACE", params, L""));
+    int  audio_channels = get_param(L"AUDIO_CHANNELS", params, 0);
+
+    return spl::make_shared<st2110_producer>(
+        dependencies.frame_factory, dependencies.format_desc, video, audio, interface_addr, audio_channels);
+}
+
+}} // namespace caspar::st2110
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rtp.h"
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <boost/lexical_cast.hpp>
+
+#ifdef __linux__
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace caspar { namespace st2110 {
+
+endpoint parse_endpoint(const std::wstring& str, unsigned short default_port)
+{
+    endpoint result;
+
+    auto address = u8(str);
+    auto colon   = address.rfind(':');
+    if (colon != std::string::npos) {
+        try {
+            result.port = boost::lexical_cast<unsigned short>(address.substr(colon + 1));
+        } catch (boost::bad_lexical_cast&) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid port of ST 2110 address: " + str));
+        }
+        address = address.substr(0, colon);
+    } else {
+        result.port = default_port;
+    }
+    result.address = address;
+
+    return result;
+}
+
+std::wstring to_wstring(const endpoint& endpoint)
+{
+    return u16(endpoint.address) + L":" + std::to_wstring(endpoint.port);
+}
+
+namespace {
+
+std::uint32_t read_u32(const std::uint8_t* src)
+{
+    return static_cast<std::uint32_t>(src[0]) << 24 | static_cast<std::uint32_t>(src[1]) << 16 |
+           static_cast<std::uint32_t>(src[2]) << 8 | static_cast<std::uint32_t>(src[3]);
+}
+
+std::uint32_t v210_component(const std::uint32_t* v210, int n) { return (v210[n / 3] >> (n % 3 * 10)) & 0x3ff; }
+
+void write_pgroup(std::uint32_t cb, std::uint32_t y0, std::uint32_t cr, std::uint32_t y1, std::uint8_t* dest)
+{
+    dest[0] = static_cast<std::uint8_t>(cb >> 2);
+    dest[1] = static_cast<std::uint8_t>((cb & 0x03) << 6 | y0 >> 4);
+    dest[2] = static_cast<std::uint8_t>((y0 & 0x0f) << 4 | cr >> 6);
+    dest[3] = static_cast<std::uint8_t>((cr & 0x3f) << 2 | y1 >> 8);
+    dest[4] = static_cast<std::uint8_t>(y1);
+}
+
+} // namespace
+
+void write_rtp_header(std::uint8_t* dest, const rtp_header& header)
+{
+    dest[0]  = 0x80; // Version 2, without padding, extensions or contributing sources
+    dest[1]  = static_cast<std::uint8_t>((header.marker ? 0x80 : 0x00) | (header.payload_type & 0x7f));
+    dest[2]  = static_cast<std::uint8_t>(header.sequence >> 8);
+    dest[3]  = static_cast<std::uint8_t>(header.sequence);
+    dest[4]  = static_cast<std::uint8_t>(header.timestamp >> 24);
+    dest[5]  = static_cast<std::uint8_t>(header.timestamp >> 16);
+    dest[6]  = static_cast<std::uint8_t>(header.timestamp >> 8);
+    dest[7]  = static_cast<std::uint8_t>(header.timestamp);
+    dest[8]  = static_cast<std::uint8_t>(header.ssrc >> 24);
+    dest[9]  = static_cast<std::uint8_t>(header.ssrc >> 16);
+    dest[10] = static_cast<std::uint8_t>(header.ssrc >> 8);
+    dest[11] = static_cast<std::uint8_t>(header.ssrc);
+}
+
+bool read_rtp_header(const std::uint8_t* src, int size, rtp_header& header)
+{
+    if (size < RTP_HEADER_SIZE || (src[0] & 0xc0) != 0x80 || (src[0] & 0x1f) != 0) {
+        return false;
+    }
+
+    header.marker       = (src[1] & 0x80) != 0;
+    header.payload_type = src[1] & 0x7f;
+    header.sequence     = static_cast<std::uint16_t>(src[2] << 8 | src[3]);
+    header.timestamp    = read_u32(src + 4);
+    header.ssrc         = read_u32(src + 8);
+    return true;
+}
+
+std::int64_t media_clock_now()
+{
+#ifdef __linux__
+    timespec now{};
+    clock_gettime(CLOCK_TAI, &now);
+    return static_cast<std::int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+#else
+    // UTC rather than TAI, which only agrees with senders and receivers that use the same clock
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+void wait_for_media_clock(std::int64_t time)
+{
+    const auto delay = time - media_clock_now();
+    if (delay > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(delay));
+    }
+}
+
+std::uint32_t media_timestamp(std::int64_t time, int clock_rate)
+{
+    // In two parts, as the product of the time since the epoch and the rate does not fit in 64 bits
+    const auto seconds = time / 1000000000LL;
+    const auto nanos   = time % 1000000000LL;
+    return static_cast<std::uint32_t>(seconds * clock_rate + nanos * clock_rate / 1000000000LL);
+}
+
+void pack_pgroups(const std::uint32_t* v210, int first, int pixels, std::uint8_t* dest)
+{
+    auto n   = first * 2; // Components, two to a pixel
+    auto end = (first + pixels) * 2;
+
+    // Six pixels are four words of v210 and three pgroups, so that whole words are read from a multiple of six on
+    if (n % 12 == 0) {
+        for (; n + 12 <= end; n += 12, dest += 3 * PGROUP_SIZE) {
+            const auto w0 = v210[n / 3];
+            const auto w1 = v210[n / 3 + 1];
+            const auto w2 = v210[n / 3 + 2];
+            const auto w3 = v210[n / 3 + 3];
+            write_pgroup(w0 & 0x3ff, w0 >> 10 & 0x3ff, w0 >> 20 & 0x3ff, w1 & 0x3ff, dest);
+            write_pgroup(w1 >> 10 & 0x3ff, w1 >> 20 & 0x3ff, w2 & 0x3ff, w2 >> 10 & 0x3ff, dest + PGROUP_SIZE);
+            write_pgroup(w2 >> 20 & 0x3ff, w3 & 0x3ff, w3 >> 10 & 0x3ff, w3 >> 20 & 0x3ff, dest + 2 * PGROUP_SIZE);
+        }
+    }
+
+    for (; n + 4 <= end; n += 4, dest += PGROUP_SIZE) {
+        write_pgroup(v210_component(v210, n),
+                     v210_component(v210, n + 1),
+                     v210_component(v210, n + 2),
+                     v210_component(v210, n + 3),
+                     dest);
+    }
+}
+
+void unpack_pgroups(const std::uint8_t* src, int pixels, std::uint16_t* y, std::uint16_t* cb, std::uint16_t* cr)
+{
+    for (int n = 0; n + 2 <= pixels; n += 2, src += PGROUP_SIZE) {
+        cb[n / 2] = static_cast<std::uint16_t>(src[0] << 2 | src[1] >> 6);
+        y[n]      = static_cast<std::uint16_t>((src[1] & 0x3f) << 4 | src[2] >> 4);
+        cr[n / 2] = static_cast<std::uint16_t>((src[2] & 0x0f) << 6 | src[3] >> 2);
+        y[n + 1]  = static_cast<std::uint16_t>((src[3] & 0x03) << 8 | src[4]);
+    }
+}
+
+void pack_l24(const std::int32_t* src, int src_channels, int samples, int channels, std::uint8_t* dest)
+{
+    const auto common = std::min(src_channels, channels);
+    for (int n = 0; n < samples; ++n, src += src_channels) {
+        for (int c = 0; c < channels; ++c, dest += AUDIO_SAMPLE_SIZE) {
+            const auto sample = c < common ? src[c] : 0;
+            dest[0]           = static_cast<std::uint8_t>(sample >> 24);
+            dest[1]           = static_cast<std::uint8_t>(sample >> 16);
+            dest[2]           = static_cast<std::uint8_t>(sample >> 8);
+        }
+    }
+}
+
+void unpack_l24(const std::uint8_t* src, int samples, int channels, std::int32_t* dest)
+{
+    for (int n = 0; n < samples * channels; ++n, src += AUDIO_SAMPLE_SIZE) {
+        dest[n] = static_cast<std::int32_t>(static_cast<std::uint32_t>(src[0]) << 24 |
+                                            static_cast<std::uint32_t>(src[1]) << 16 |
+                                            static_cast<std::uint32_t>(src[2]) << 8);
+    }
+}
+
+}} // namespace caspar::st2110
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace st2110 {
+
+const int RTP_HEADER_SIZE = 12;
+const int MAX_PACKET_SIZE = 1500;
+
+const int VIDEO_CLOCK_RATE     = 90000;
+const int VIDEO_PAYLOAD_TYPE   = 96;
+const int VIDEO_HEADER_SIZE    = RTP_HEADER_SIZE + 8; // The extended sequence number and a sample row data header
+const int VIDEO_PAYLOAD_PIXELS = 480;                 // 240 pgroups, so that rows of 1920 pixels are 4 packets
+const int PGROUP_SIZE          = 5;                   // Bytes of 2 pixels of 4:2:2 10-bit
+
+const int AUDIO_CLOCK_RATE   = 48000;
+const int AUDIO_PAYLOAD_TYPE = 97;
+const int AUDIO_SAMPLE_SIZE  = 3; // L24
+const int AUDIO_MAX_PAYLOAD  = 1440;
+
+// A multicast group, or a unicast address, and a port
+struct endpoint
+{
+    std::string    address;
+    unsigned short port = 0;
+
+    explicit operator bool() const { return !address.empty(); }
+};
+
+// Of the form 239.0.0.1:5004, with the port optional
+endpoint parse_endpoint(const std::wstring& str, unsigned short default_port = 5004);
+
+std::wstring to_wstring(const endpoint& endpoint);
+
+struct rtp_header
+{
+    bool          marker       = false;
+    int           payload_type = 0;
+    std::uint16_t sequence     = 0;
+    std::uint32_t timestamp    = 0;
+    std::uint32_t ssrc         = 0;
+};
+
+void write_rtp_header(std::uint8_t* dest, const rtp_header& header);
+
+// False for packets that are not RTP version 2, or carry extensions or contributing sources this does not read
+bool read_rtp_header(const std::uint8_t* src, int size, rtp_header& header);
+
+// Nanoseconds of the clock that the media clocks of ST 2110 are locked to. That is PTP time, which the system clock
+// follows as TAI where it is synchronised to the grandmaster, as by ptp4l and phc2sys.
+std::int64_t media_clock_now();
+
+// Waits until the media clock reaches time
+void wait_for_media_clock(std::int64_t time);
+
+// The RTP timestamp of a media clock of clock_rate at time
+std::uint32_t media_timestamp(std::int64_t time, int clock_rate);
+
+// Packs pixels of a row of v210, as the mixer packs 4:2:2 10-bit on the GPU, into the pgroups of ST 2110-20, from the
+// even pixel first on. v210 holds the components in the order pgroups do, three to a little endian word, where pgroups
+// hold four in five bytes, big endian.
+void pack_pgroups(const std::uint32_t* v210, int first, int pixels, std::uint8_t* dest);
+
+// Unpacks pixels of pgroups into a row of each plane of planar 4:2:2, 10 bits in 16
+void unpack_pgroups(const std::uint8_t* src, int pixels, std::uint16_t* y, std::uint16_t* cb, std::uint16_t* cr);
+
+// Converts samples of interleaved 32-bit audio to L24 of ST 2110-30, at channels per sample. Channels src does not have
+// are silent.
+void pack_l24(const std::int32_t* src, int src_channels, int samples, int channels, std::uint8_t* dest);
+
+void unpack_l24(const std::uint8_t* src, int samples, int channels, std::int32_t* dest);
+
+}} // namespace caspar::st2110
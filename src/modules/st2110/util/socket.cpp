@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "socket.h"
+
+#undef NOMINMAX
+// ^^ This is needed to avoid a conflict between boost asio and other header files defining NOMINMAX
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/asio.hpp>
+
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+using namespace boost::asio;
+using namespace boost::asio::ip;
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+const int BATCH_SIZE = 64;
+
+} // namespace
+
+struct packet_sender::impl
+{
+    io_service    io_service_;
+    udp::socket   socket_{io_service_};
+    udp::endpoint destination_;
+    bool          paces_ = false;
+
+    impl(const endpoint& destination, const std::string& interface_address, int ttl, int dscp, bool launch_time)
+        : destination_(address::from_string(destination.address), destination.port)
+    {
+        socket_.open(udp::v4());
+
+        if (destination_.address().is_multicast()) {
+            socket_.set_option(multicast::hops(ttl));
+            if (!interface_address.empty()) {
+                socket_.set_option(multicast::outbound_interface(address_v4::from_string(interface_address)));
+            }
+        } else {
+            socket_.set_option(unicast::hops(ttl));
+        }
+
+#ifdef __linux__
+        // The class of service that switches queue media by, as the DSCP of the traffic class octet
+        int tos = dscp << 2;
+        if (::setsockopt(socket_.native_handle(), IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+            CASPAR_LOG(warning) << L"st2110: Could not set DSCP " << dscp << L": " << std::strerror(errno);
+        }
+
+#ifdef SO_TXTIME
+        if (launch_time) {
+            sock_txtime txtime{};
+            txtime.clockid = CLOCK_TAI;
+            txtime.flags   = 0;
+            paces_ = ::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) == 0;
+            if (!paces_) {
+                CASPAR_LOG(warning) << L"st2110: The kernel does not launch packets at their times, they are paced as "
+                                       L"they are sent: "
+                                    << std::strerror(errno);
+            }
+        }
+#endif
+#endif
+    }
+
+    void send(const std::uint8_t* const* packets, const int* sizes, const std::int64_t* times, int count)
+    {
+#ifdef __linux__
+        mmsghdr messages[BATCH_SIZE];
+        iovec   vectors[BATCH_SIZE];
+#ifdef SO_TXTIME
+        char controls[BATCH_SIZE][CMSG_SPACE(sizeof(std::uint64_t))];
+#endif
+
+        int sent = 0;
+        while (sent < count) {
+            auto batch = std::min(BATCH_SIZE, count - sent);
+            for (int n = 0; n < batch; ++n) {
+                vectors[n].iov_base = const_cast<std::uint8_t*>(packets[sent + n]);
+                vectors[n].iov_len  = sizes[sent + n];
+
+                std::memset(&messages[n], 0, sizeof(mmsghdr));
+                messages[n].msg_hdr.msg_name    = destination_.data();
+                messages[n].msg_hdr.msg_namelen = destination_.size();
+                messages[n].msg_hdr.msg_iov     = &vectors[n];
+                messages[n].msg_hdr.msg_iovlen  = 1;
+
+#ifdef SO_TXTIME
+                if (paces_) {
+                    messages[n].msg_hdr.msg_control    = controls[n];
+                    messages[n].msg_hdr.msg_controllen = sizeof(controls[n]);
+
+                    auto cmsg        = CMSG_FIRSTHDR(&messages[n].msg_hdr);
+                    cmsg->cmsg_level = SOL_SOCKET;
+                    cmsg->cmsg_type  = SCM_TXTIME;
+                    cmsg->cmsg_len   = CMSG_LEN(sizeof(std::uint64_t));
+
+                    const auto time = static_cast<std::uint64_t>(times[sent + n]);
+                    std::memcpy(CMSG_DATA(cmsg), &time, sizeof(time));
+                }
+#endif
+            }
+
+            int result = ::sendmmsg(socket_.native_handle(), messages, static_cast<unsigned int>(batch), 0);
+            if (result < 0) {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(std::strerror(errno)));
+            }
+            sent += result;
+        }
+#else
+        for (int n = 0; n < count; ++n) {
+            boost::system::error_code err;
+            socket_.send_to(boost::asio::buffer(packets[n], sizes[n]), destination_, 0, err);
+            if (err) {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(err.message()));
+            }
+        }
+#endif
+    }
+};
+
+packet_sender::packet_sender(const endpoint&    destination,
+                             const std::string& interface_address,
+                             int                ttl,
+                             int                dscp,
+                             bool               launch_time)
+    : impl_(std::make_unique<impl>(destination, interface_address, ttl, dscp, launch_time))
+{
+}
+
+packet_sender::~packet_sender() = default;
+
+bool packet_sender::paces() const { return impl_->paces_; }
+
+void packet_sender::send(const std::uint8_t* const* packets, const int* sizes, const std::int64_t* times, int count)
+{
+    impl_->send(packets, sizes, times, count);
+}
+
+struct packet_receiver::impl
+{
+    io_service  io_service_;
+    udp::socket socket_{io_service_};
+
+    impl(const endpoint& source, const std::string& interface_address)
+    {
+        auto group = address::from_string(source.address);
+
+        socket_.open(udp::v4());
+        socket_.set_option(udp::socket::reuse_address(true));
+
+        // Bursts of a frame of packets arrive faster than they may be read at times
+        socket_.set_option(socket_base::receive_buffer_size(32 * 1024 * 1024));
+
+        if (group.is_multicast()) {
+            socket_.bind(udp::endpoint(address_v4::any(), source.port));
+            if (!interface_address.empty()) {
+                socket_.set_option(
+                    multicast::join_group(group.to_v4(), address_v4::from_string(interface_address)));
+            } else {
+                socket_.set_option(multicast::join_group(group));
+            }
+        } else {
+            socket_.bind(udp::endpoint(group, source.port));
+        }
+
+#ifndef __linux__
+        // Reads time out rather than being polled for
+        DWORD timeout = 100;
+        ::setsockopt(socket_.native_handle(),
+                     SOL_SOCKET,
+                     SO_RCVTIMEO,
+                     reinterpret_cast<const char*>(&timeout),
+                     sizeof(timeout));
+#endif
+    }
+
+    int receive(std::uint8_t* const* buffers, int* sizes, int count, std::chrono::milliseconds timeout)
+    {
+#ifdef __linux__
+        pollfd fd{};
+        fd.fd     = socket_.native_handle();
+        fd.events = POLLIN;
+        if (::poll(&fd, 1, static_cast<int>(timeout.count())) <= 0) {
+            return 0;
+        }
+
+        mmsghdr messages[BATCH_SIZE];
+        iovec   vectors[BATCH_SIZE];
+
+        auto batch = std::min(BATCH_SIZE, count);
+        for (int n = 0; n < batch; ++n) {
+            vectors[n].iov_base = buffers[n];
+            vectors[n].iov_len  = MAX_PACKET_SIZE;
+
+            std::memset(&messages[n], 0, sizeof(mmsghdr));
+            messages[n].msg_hdr.msg_iov    = &vectors[n];
+            messages[n].msg_hdr.msg_iovlen = 1;
+        }
+
+        int result =
+            ::recvmmsg(socket_.native_handle(), messages, static_cast<unsigned int>(batch), MSG_DONTWAIT, nullptr);
+        if (result < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(std::strerror(errno)));
+        }
+        for (int n = 0; n < result; ++n) {
+            sizes[n] = static_cast<int>(messages[n].msg_len);
+        }
+        return result;
+#else
+        boost::system::error_code err;
+        auto size = socket_.receive(boost::asio::buffer(buffers[0], MAX_PACKET_SIZE), 0, err);
+        if (err) {
+            return 0;
+        }
+        sizes[0] = static_cast<int>(size);
+        return 1;
+#endif
+    }
+};
+
+packet_receiver::packet_receiver(const endpoint& source, const std::string& interface_address)
+    : impl_(std::make_unique<impl>(source, interface_address))
+{
+}
+
+packet_receiver::~packet_receiver() = default;
+
+int packet_receiver::receive(std::uint8_t* const* buffers, int* sizes, int count, std::chrono::milliseconds timeout)
+{
+    return impl_->receive(buffers, sizes, count, timeout);
+}
+
+}} // namespace caspar::st2110
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "rtp.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace st2110 {
+
+// Sends RTP packets to an endpoint, as many at a time as are handed over, with sendmmsg on Linux. Where the kernel can
+// launch packets at a given time, with SO_TXTIME and an etf qdisc on the interface, each packet carries the media clock
+// time it is due at, and leaves the interface then however early it was handed over.
+class packet_sender
+{
+  public:
+    packet_sender(const endpoint&    destination,
+                  const std::string& interface_address,
+                  int                ttl,
+                  int                dscp,
+                  bool               launch_time);
+    ~packet_sender();
+
+    packet_sender(const packet_sender&)            = delete;
+    packet_sender& operator=(const packet_sender&) = delete;
+
+    // Whether packets leave at the times they are sent with, rather than as they are sent
+    bool paces() const;
+
+    void send(const std::uint8_t* const* packets, const int* sizes, const std::int64_t* times, int count);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+// Receives RTP packets of an endpoint, joining it if it is a multicast group, as many at a time as have arrived, with
+// recvmmsg on Linux
+class packet_receiver
+{
+  public:
+    packet_receiver(const endpoint& source, const std::string& interface_address);
+    ~packet_receiver();
+
+    packet_receiver(const packet_receiver&)            = delete;
+    packet_receiver& operator=(const packet_receiver&) = delete;
+
+    // Waits up to timeout for packets, and receives up to count of them into buffers of MAX_PACKET_SIZE. Returns how
+    // many were received, and their sizes.
+    int receive(std::uint8_t* const* buffers, int* sizes, int count, std::chrono::milliseconds timeout);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::st2110
@@ -24,6 +24,9 @@
 #include "../util/ClientInfo.h"
 #include "amcp_shared.h"
 
+#include <cstdint>
+#include <optional>
+
 namespace caspar { namespace protocol { namespace amcp {
 
 class AMCPCommand
@@ -35,12 +38,15 @@ class AMCPCommand
     const std::wstring           request_id_;
 
   public:
-    AMCPCommand(const command_context_simple& ctx,
-                const amcp_command_func&      command,
-                const std::wstring&           name,
-                const std::wstring&           request_id)
-
-        : ctx_(ctx)
+    AMCPCommand(IO::ClientInfoPtr         client,
+                int                       channel_index,
+                int                       layer_index,
+                std::vector<std::wstring> parameters,
+                const amcp_command_func&  command,
+                const std::wstring&       name,
+                const std::wstring&       request_id)
+
+        : ctx_(std::move(client), channel_index, layer_index, std::move(parameters))
         , command_(command)
         , name_(name)
         , request_id_(request_id)
@@ -62,12 +68,20 @@ class AMCPCommand
     const std::wstring& name() const { return name_; }
 };
 
+// A frame of a channel to apply a command or batch on, rather than as soon as it is dequeued
+struct command_schedule
+{
+    int      channel_index = 0; // Zero based
+    uint64_t frame_number  = 0;
+};
+
 class AMCPGroupCommand
 {
     const std::vector<std::shared_ptr<AMCPCommand>> commands_;
     const IO::ClientInfoPtrStd                      client_;
     const std::wstring                              request_id_;
     const bool                                      is_batch_;
+    std::optional<command_schedule>                 schedule_;
 
   public:
     AMCPGroupCommand(const std::vector<std::shared_ptr<AMCPCommand>> commands,
@@ -97,6 +111,10 @@ class AMCPGroupCommand
     }
 
     bool HasClient() const { return !!client_; }
+    bool IsBatch() const { return is_batch_; }
+
+    const std::optional<command_schedule>& Schedule() const { return schedule_; }
+    void                                   SetSchedule(const command_schedule& schedule) { schedule_ = schedule; }
 
     void SendReply(const std::wstring& str) const;
 
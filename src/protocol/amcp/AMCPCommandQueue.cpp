@@ -24,20 +24,170 @@
 #include "AMCPCommandQueue.h"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
 #include <common/except.h>
 #include <common/future.h>
+#include <common/os/thread.h>
 #include <common/timer.h>
 
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <thread>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace amcp {
 
+namespace {
+
+// Worker threads shared by every queue
+class worker_pool
+{
+    tbb::concurrent_bounded_queue<std::function<void()>> tasks_;
+    std::vector<std::thread>                             threads_;
+
+  public:
+    worker_pool(const std::wstring& name, int size)
+    {
+        for (int n = 0; n < size; ++n) {
+            threads_.emplace_back([this, name, n] {
+                set_thread_name(name + L" " + std::to_wstring(n));
+
+                std::function<void()> task;
+                while (true) {
+                    tasks_.pop(task);
+                    if (!task) {
+                        return;
+                    }
+                    try {
+                        task();
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                    }
+                }
+            });
+        }
+    }
+
+    ~worker_pool()
+    {
+        for (size_t n = 0; n < threads_.size(); ++n) {
+            tasks_.push(nullptr);
+        }
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void post(std::function<void()> task) { tasks_.push(std::move(task)); }
+};
+
+// Runs the commands of the queues
+worker_pool& command_pool()
+{
+    static worker_pool pool(L"AMCPCommandQueue worker",
+                            std::max(1, env::properties().get(L"configuration.amcp.command-threads", 4)));
+    return pool;
+}
+
+// Waits for the commands of the queues to complete and sends their replies. A queue only has one worker at a time,
+// which sends its replies in order and waits on the first of them, as they commonly complete in the order they were
+// executed in.
+worker_pool& reply_pool()
+{
+    static worker_pool pool(L"AMCPCommandQueue replies", 4);
+    return pool;
+}
+
+std::mutex                   g_queues_mutex;
+std::set<AMCPCommandQueue*> g_queues;
+
+// The queued commands of a batch, until the batch is applied
+struct pending_batch
+{
+    std::shared_ptr<AMCPGroupCommand>                 command;
+    std::vector<std::shared_ptr<core::stage_delayed>> stages;
+    std::vector<std::future<bool>>                    results;
+    caspar::timer                                     timer;
+    bool                                              applied = false;
+
+    ~pending_batch()
+    {
+        // A scheduled batch whose channel went away before the frame, which must still let its executors finish
+        if (!applied) {
+            for (auto& st : stages) {
+                st->abort();
+                st->release();
+            }
+        }
+    }
+
+    void apply()
+    {
+        std::vector<std::unique_lock<std::mutex>> channel_locks;
+
+        // lock all the channels needed
+        for (auto& st : stages) {
+            if (st->count_queued() == 0) {
+                continue;
+            }
+
+            channel_locks.push_back(st->get_lock());
+        }
+
+        // execute the commands
+        applied = true;
+        for (auto& st : stages) {
+            st->release();
+        }
+
+        // wait for the commands to finish
+        for (auto& st : stages) {
+            st->wait();
+        }
+    }
+
+    bool reply()
+    {
+        int failed = 0;
+        for (auto& f : results) {
+            if (!f.get())
+                failed++;
+        }
+
+        if (command->IsBatch()) {
+            if (failed > 0)
+                command->SendReply(L"202 COMMIT PARTIAL\r\n");
+            else
+                command->SendReply(L"202 COMMIT OK\r\n");
+        }
+
+        CASPAR_LOG(debug) << "Executed batch (" << timer.elapsed() << "s): " << command->name();
+
+        return failed == 0;
+    }
+};
+
+} // namespace
+
 AMCPCommandQueue::AMCPCommandQueue(const std::wstring&                                  name,
                                    const spl::shared_ptr<std::vector<channel_context>>& channels)
-    : executor_(L"AMCPCommandQueue " + name)
+    : name_(name)
     , channels_(channels)
 {
+    std::lock_guard<std::mutex> lock(g_queues_mutex);
+    g_queues.insert(this);
 }
 
-AMCPCommandQueue::~AMCPCommandQueue() {}
+AMCPCommandQueue::~AMCPCommandQueue()
+{
+    std::lock_guard<std::mutex> lock(g_queues_mutex);
+    g_queues.erase(this);
+}
 
 std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
                            const spl::shared_ptr<std::vector<channel_context>>& channels,
@@ -50,8 +200,11 @@ std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>
             auto name = cmd->name();
             CASPAR_LOG(debug) << "Executing command: " << name;
 
-            auto res = cmd->Execute(channels).share();
-            return std::async(std::launch::async, [cmd, res, reply_without_req_id, timer, name]() -> bool {
+            // The reply is sent by whoever waits for the command, rather than on a thread of its own
+            auto start = diagnostics::trace::begin();
+            auto res   = cmd->Execute(channels).share();
+            diagnostics::trace::end("amcp", start);
+            return std::async(std::launch::deferred, [cmd, res, reply_without_req_id, timer, name]() -> bool {
                 cmd->SendReply(res.get(), reply_without_req_id);
 
                 CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << name;
@@ -90,7 +243,20 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
     if (!pCurrentCommand)
         return;
 
-    if (executor_.size() > 128) {
+    bool overflow = false;
+    bool start    = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (commands_.size() > 128) {
+            overflow = true;
+        } else {
+            commands_.push_back(pending_command{pCurrentCommand, std::chrono::steady_clock::now()});
+            start    = !running_;
+            running_ = true;
+        }
+    }
+
+    if (overflow) {
         try {
             CASPAR_LOG(error) << "AMCP Command Queue Overflow.";
             CASPAR_LOG(error) << "Failed to execute command:" << pCurrentCommand->name();
@@ -101,88 +267,153 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
         return;
     }
 
-    executor_.begin_invoke([=] {
-        try {
-            Execute(pCurrentCommand);
+    if (start) {
+        command_pool().post([self = shared_from_this()] { self->run_next(); });
+    }
+}
+
+void AMCPCommandQueue::run_next()
+{
+    pending_command next;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        next = std::move(commands_.front());
+        commands_.pop_front();
+
+        auto latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - next.added).count();
+        executed_ += 1;
+        total_latency_ += latency;
+        max_latency_ = std::max(max_latency_, latency);
+    }
+
+    std::future<bool> reply;
+    try {
+        reply = Execute(next.command);
+
+        CASPAR_LOG(trace) << "Ready for a new command";
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+
+    // The next command is executed while this one completes, and the queues of other clients and channels get their
+    // turn before it
+    bool send = false;
+    bool more = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reply.valid()) {
+            replies_.push_back(std::move(reply));
+            send      = !replying_;
+            replying_ = true;
+        }
+        more     = !commands_.empty();
+        running_ = more;
+    }
+
+    if (send) {
+        reply_pool().post([self = shared_from_this()] { self->send_replies(); });
+    }
+    if (more) {
+        command_pool().post([self = shared_from_this()] { self->run_next(); });
+    }
+}
+
+void AMCPCommandQueue::send_replies()
+{
+    while (true) {
+        std::future<bool> reply;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (replies_.empty()) {
+                replying_ = false;
+                return;
+            }
+            reply = std::move(replies_.front());
+            replies_.pop_front();
+        }
 
-            CASPAR_LOG(trace) << "Ready for a new command";
+        try {
+            reply.get();
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
         }
-    });
+    }
+}
+
+boost::property_tree::wptree AMCPCommandQueue::info()
+{
+    boost::property_tree::wptree info;
+
+    std::lock_guard<std::mutex> lock(g_queues_mutex);
+    for (auto queue : g_queues) {
+        std::lock_guard<std::mutex> queue_lock(queue->mutex_);
+
+        boost::property_tree::wptree node;
+        node.add(L"name", queue->name_);
+        node.add(L"depth", queue->commands_.size());
+        node.add(L"executed", queue->executed_);
+        node.add(L"average-latency", queue->executed_ > 0 ? queue->total_latency_ / queue->executed_ : 0.0);
+        node.add(L"max-latency", queue->max_latency_);
+        info.add_child(L"queues.queue", node);
+    }
+
+    return info;
 }
 
-void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
+std::future<bool> AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
 {
     if (cmd->Commands().empty())
-        return;
+        return make_ready_future(false);
 
     // Shortcut for commands which are either not a batch, or don't need to be
-    if (cmd->Commands().size() == 1) {
-        exec_cmd(cmd->Commands().at(0), channels_, true);
-        return;
+    if (cmd->Commands().size() == 1 && !cmd->Schedule()) {
+        return exec_cmd(cmd->Commands().at(0), channels_, true);
     }
 
-    caspar::timer timer;
     CASPAR_LOG(warning) << "Executing batch: " << cmd->name() << L"(" << cmd->Commands().size() << L" commands)";
 
-    spl::shared_ptr<std::vector<channel_context>>     delayed_channels;
-    std::vector<std::shared_ptr<core::stage_delayed>> delayed_stages;
-    std::vector<std::future<bool>>                    results;
-    std::vector<std::unique_lock<std::mutex>>         channel_locks;
+    auto                                          batch = std::make_shared<pending_batch>();
+    spl::shared_ptr<std::vector<channel_context>> delayed_channels;
 
+    batch->command = cmd;
     try {
         for (auto& ch : *channels_) {
             auto st = std::make_shared<core::stage_delayed>(ch.raw_channel->stage(), ch.raw_channel->index());
-            delayed_stages.push_back(st);
+            batch->stages.push_back(st);
             delayed_channels->emplace_back(ch.raw_channel, st, ch.lifecycle_key_);
         }
 
         // 'execute' aka queue all commands
         for (auto& cmd2 : cmd->Commands()) {
-            results.push_back(exec_cmd(cmd2, delayed_channels, cmd->HasClient()));
-        }
-
-        // lock all the channels needed
-        for (auto& st : delayed_stages) {
-            if (st->count_queued() == 0) {
-                continue;
-            }
-
-            channel_locks.push_back(st->get_lock());
-        }
-
-        // execute the commands
-        for (auto& st : delayed_stages) {
-            st->release();
+            batch->results.push_back(exec_cmd(cmd2, delayed_channels, cmd->IsBatch() ? cmd->HasClient() : true));
         }
     } catch (...) {
         // Ensure the created executors don't get leaked
-        for (auto& st : delayed_stages) {
+        for (auto& st : batch->stages) {
             st->abort();
         }
+        batch->applied = true;
 
         throw;
     }
 
-    // wait for the commands to finish
-    for (auto& st : delayed_stages) {
-        st->wait();
-    }
-    channel_locks.clear();
+    // Producers have been created by now, so only applying the commands is left for the scheduled frame. The channel
+    // thread applies them right before it produces the frame, and the reply is sent once they have completed.
+    if (auto schedule = cmd->Schedule()) {
+        auto& stage = channels_->at(schedule->channel_index).raw_channel->stage();
 
-    int failed = 0;
-    for (auto& f : results) {
-        if (!f.get())
-            failed++;
-    }
+        CASPAR_LOG(debug) << "Scheduled batch on frame " << schedule->frame_number << " of channel "
+                          << schedule->channel_index + 1 << ": " << cmd->name();
 
-    if (failed > 0)
-        cmd->SendReply(L"202 COMMIT PARTIAL\r\n");
-    else
-        cmd->SendReply(L"202 COMMIT OK\r\n");
+        stage->schedule(schedule->frame_number, [batch] {
+            batch->apply();
+            reply_pool().post([batch] { batch->reply(); });
+        });
+        return make_ready_future(true);
+    }
 
-    CASPAR_LOG(debug) << "Executed batch (" << timer.elapsed() << "s): " << cmd->name();
+    batch->apply();
+    return make_ready_future(batch->reply());
 }
 
 }}} // namespace caspar::protocol::amcp
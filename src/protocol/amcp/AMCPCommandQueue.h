@@ -23,12 +23,22 @@
 
 #include "AMCPCommand.h"
 
-#include <common/executor.h>
 #include <common/memory.h>
 
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+
 namespace caspar { namespace protocol { namespace amcp {
 
-class AMCPCommandQueue
+// Runs its commands one at a time and in the order they were added, on worker threads shared by the queues of every
+// client, so that a queue waiting for commands does not hold a thread of its own.
+class AMCPCommandQueue : public std::enable_shared_from_this<AMCPCommandQueue>
 {
   public:
     using ptr_type = spl::shared_ptr<AMCPCommandQueue>;
@@ -37,11 +47,36 @@ class AMCPCommandQueue
     ~AMCPCommandQueue();
 
     void AddCommand(std::shared_ptr<AMCPGroupCommand> command);
-    void Execute(std::shared_ptr<AMCPGroupCommand> cmd) const;
+
+    // Starts a command, and returns its completion, which sends its reply when waited for
+    std::future<bool> Execute(std::shared_ptr<AMCPGroupCommand> cmd) const;
+
+    // The depth and latency of every queue, for INFO QUEUES
+    static boost::property_tree::wptree info();
 
   private:
-    executor                                            executor_;
+    struct pending_command
+    {
+        std::shared_ptr<AMCPGroupCommand>     command;
+        std::chrono::steady_clock::time_point added;
+    };
+
+    void run_next();
+    void send_replies();
+
+    const std::wstring                                  name_;
     const spl::shared_ptr<std::vector<channel_context>> channels_;
+
+    mutable std::mutex            mutex_;
+    std::deque<pending_command>   commands_;
+    bool                          running_ = false; // Whether a worker has the queue, which is then not posted again
+    std::deque<std::future<bool>> replies_;         // Completions of executed commands, in the order they were executed
+    bool                          replying_ = false; // Whether a reply worker has the queue
+
+    // The time from a command being added until it starts, over the commands run so far
+    std::uint64_t executed_      = 0;
+    double        total_latency_ = 0.0;
+    double        max_latency_   = 0.0;
 };
 
 }}} // namespace caspar::protocol::amcp
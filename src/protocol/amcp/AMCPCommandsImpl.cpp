@@ -28,15 +28,19 @@
 #include "AMCPCommandsImpl.h"
 
 #include "../util/http_request.h"
+#include "../util/xml_writer.h"
 #include "AMCPCommandQueue.h"
 #include "amcp_args.h"
 
 #include <common/env.h>
 
 #include <common/base64.h>
+#include <common/diagnostics/trace.h>
 #include <common/filesystem.h>
 #include <common/future.h>
+#include <common/host_buffer.h>
 #include <common/log.h>
+#include <common/memory_governor.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
 
@@ -61,24 +65,18 @@
 #include <algorithm>
 #include <fstream>
 #include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/regex.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/insert_linebreaks.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/locale.hpp>
 #include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
-#include <boost/range/adaptor/transformed.hpp>
-#include <boost/range/algorithm/copy.hpp>
-#include <boost/regex.hpp>
-
-#include <tbb/concurrent_unordered_map.h>
 
 /* Return codes
 
@@ -107,73 +105,6 @@
 namespace caspar { namespace protocol { namespace amcp {
 
 using namespace core;
-namespace pt = boost::property_tree;
-
-std::wstring read_utf8_file(const boost::filesystem::path& file)
-{
-    std::wstringstream           result;
-    boost::filesystem::wifstream filestream(file);
-
-    if (filestream) {
-        // Consume BOM first
-        filestream.get();
-        // read all data
-        result << filestream.rdbuf();
-    }
-
-    return result.str();
-}
-
-std::wstring read_latin1_file(const boost::filesystem::path& file)
-{
-    boost::locale::generator gen;
-    gen.locale_cache_enabled(true);
-#if BOOST_VERSION >= 108100
-    gen.categories(boost::locale::category_t::codepage);
-#else
-    gen.categories(boost::locale::codepage_facet);
-#endif
-
-    std::stringstream           result_stream;
-    boost::filesystem::ifstream filestream(file);
-    filestream.imbue(gen("en_US.ISO8859-1"));
-
-    if (filestream) {
-        // read all data
-        result_stream << filestream.rdbuf();
-    }
-
-    std::string  result = result_stream.str();
-    std::wstring widened_result;
-
-    // The first 255 codepoints in unicode is the same as in latin1
-    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
-                std::back_inserter(widened_result));
-
-    return widened_result;
-}
-
-std::wstring read_file(const boost::filesystem::path& file)
-{
-    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
-
-    if (!boost::filesystem::exists(file)) {
-        return L"";
-    }
-
-    if (boost::filesystem::file_size(file) >= 3) {
-        boost::filesystem::ifstream bom_stream(file);
-
-        char header[3];
-        bom_stream.read(header, 3);
-        bom_stream.close();
-
-        if (std::memcmp(BOM, header, 3) == 0)
-            return read_utf8_file(file);
-    }
-
-    return read_latin1_file(file);
-}
 
 std::wstring get_sub_directory(const std::wstring& base_folder, const std::wstring& sub_directory)
 {
@@ -200,12 +131,15 @@ std::vector<spl::shared_ptr<core::video_channel>> get_channels(const command_con
 core::frame_producer_dependencies get_producer_dependencies(const std::shared_ptr<core::video_channel>& channel,
                                                             const command_context&                      ctx)
 {
-    return core::frame_producer_dependencies(channel->frame_factory(),
-                                             get_channels(ctx),
-                                             ctx.static_context->format_repository,
-                                             channel->stage()->video_format_desc(),
-                                             ctx.static_context->producer_registry,
-                                             ctx.static_context->cg_registry);
+    auto dependencies = core::frame_producer_dependencies(channel->frame_factory(),
+                                                          get_channels(ctx),
+                                                          ctx.static_context->format_repository,
+                                                          channel->stage()->video_format_desc(),
+                                                          ctx.static_context->producer_registry,
+                                                          ctx.static_context->cg_registry);
+
+    dependencies.offline = channel->get_consumer_channel_info().offline;
+    return dependencies;
 }
 
 bool try_match_sting(const std::vector<std::wstring>& params, sting_info& stingInfo)
@@ -255,6 +189,12 @@ bool try_match_sting(const std::vector<std::wstring>& params, sting_info& stingI
                 stingInfo.audio_fade_duration = val2;
             }
         }
+        if (get_arg_value(args, L"preroll", val)) {
+            int val2 = boost::lexical_cast<int>(val);
+            if (val2 >= 0) {
+                stingInfo.preroll = val2;
+            }
+        }
 
     } else {
         stingInfo.mask_filename = params.at(start_ind + 1);
@@ -451,10 +391,20 @@ std::future<std::wstring> call_command(command_context& ctx)
     });
 }
 
-std::wstring swap_command(command_context& ctx)
+// The producers that are swapped keep rendering at the format of the channel they were created for
+void warn_if_formats_differ(command_context& ctx, const channel_context& other)
+{
+    if (ctx.channel.raw_channel->stage()->video_format_desc() != other.raw_channel->stage()->video_format_desc()) {
+        CASPAR_LOG(warning) << L"Swapping layers between channels " << ctx.channel.raw_channel->index() << L" and "
+                            << other.raw_channel->index() << L" of different video formats.";
+    }
+}
+
+std::future<std::wstring> swap_command(command_context& ctx)
 {
     bool swap_transforms = ctx.parameters.size() > 1 && boost::iequals(ctx.parameters.at(1), L"TRANSFORMS");
 
+    std::future<void> swapped;
     if (ctx.layer_index(-1) != -1) {
         std::vector<std::wstring> strs;
         boost::split(strs, ctx.parameters[0], boost::is_any_of(L"-"));
@@ -464,13 +414,20 @@ std::wstring swap_command(command_context& ctx)
         int l1 = ctx.layer_index();
         int l2 = std::stoi(strs.at(1));
 
-        ctx.channel.stage->swap_layer(l1, l2, ch2.stage, swap_transforms);
+        warn_if_formats_differ(ctx, ch2);
+        swapped = ctx.channel.stage->swap_layer(l1, l2, ch2.stage, swap_transforms);
     } else {
         auto ch2 = ctx.channels->at(std::stoi(ctx.parameters[0]) - 1);
-        ctx.channel.stage->swap_layers(ch2.stage, swap_transforms);
+
+        warn_if_formats_differ(ctx, ch2);
+        swapped = ctx.channel.stage->swap_layers(ch2.stage, swap_transforms);
     }
 
-    return L"202 SWAP OK\r\n";
+    // Replied once the layers have been swapped, so that commands sent after it find them where they were moved to
+    return std::async(std::launch::deferred, [swapped = swapped.share()]() -> std::wstring {
+        swapped.get();
+        return L"202 SWAP OK\r\n";
+    });
 }
 
 std::wstring add_command(command_context& ctx)
@@ -480,12 +437,17 @@ std::wstring add_command(command_context& ctx)
     core::diagnostics::scoped_call_context save;
     core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
 
+    // ADD 1 DECKLINK 1 VIDEO-DELAY 2 AUDIO-DELAY 40ms
+    core::consumer_delay delay;
+    delay.video = core::parse_consumer_delay(get_param(L"VIDEO-DELAY", ctx.parameters, std::wstring(L"0")));
+    delay.audio = core::parse_consumer_delay(get_param(L"AUDIO-DELAY", ctx.parameters, std::wstring(L"0")));
+
     auto consumer =
         ctx.static_context->consumer_registry->create_consumer(ctx.parameters,
                                                                ctx.static_context->format_repository,
                                                                get_channels(ctx),
                                                                ctx.channel.raw_channel->get_consumer_channel_info());
-    ctx.channel.raw_channel->output().add(ctx.layer_index(consumer->index()), consumer);
+    ctx.channel.raw_channel->output().add(ctx.layer_index(consumer->index()), consumer, delay);
 
     return L"202 ADD OK\r\n";
 }
@@ -569,55 +531,22 @@ std::wstring set_command(command_context& ctx)
 
 std::wstring data_store_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
-    auto found_data_path = find_case_insensitive(data_path);
-
-    if (found_data_path)
-        data_path = *found_data_path;
-
-    if (!boost::filesystem::exists(data_path))
-        boost::filesystem::create_directories(data_path);
-
-    auto found_filename = find_case_insensitive(filename);
-
-    if (found_filename)
-        filename = *found_filename; // Overwrite case insensitive.
-
-    boost::filesystem::wofstream datafile(filename);
-    if (!datafile)
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
-
-    datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
-    datafile << ctx.parameters[1] << std::flush;
-    datafile.close();
+    ctx.static_context->data->store(ctx.parameters[0], ctx.parameters[1]);
 
     return L"202 DATA STORE OK\r\n";
 }
 
 std::wstring data_retrieve_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    std::wstring file_contents;
-
-    auto found_file = find_case_insensitive(filename);
+    auto file_contents = ctx.static_context->data->retrieve(ctx.parameters[0]);
 
-    if (found_file)
-        file_contents = read_file(boost::filesystem::path(*found_file));
-
-    if (file_contents.empty())
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
+    if (!file_contents)
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters[0] + L" not found"));
 
     std::wstringstream reply;
     reply << L"201 DATA RETRIEVE OK\r\n";
 
-    std::wstringstream file_contents_stream(file_contents);
+    std::wstringstream file_contents_stream(*file_contents);
     std::wstring       line;
 
     bool firstLine = true;
@@ -641,6 +570,9 @@ std::wstring data_list_command(command_context& ctx)
     if (!ctx.parameters.empty())
         sub_directory = ctx.parameters.at(0);
 
+    // With the datasets that were only stored in memory so far
+    ctx.static_context->data->flush();
+
     std::wstringstream replyString;
     replyString << L"200 DATA LIST OK\r\n";
 
@@ -668,22 +600,15 @@ std::wstring data_list_command(command_context& ctx)
 
 std::wstring data_remove_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    if (!boost::filesystem::exists(filename))
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
-
-    if (!boost::filesystem::remove(filename))
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(filename + L" could not be removed"));
+    if (!ctx.static_context->data->remove(ctx.parameters[0]))
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters[0] + L" not found"));
 
     return L"202 DATA REMOVE OK\r\n";
 }
 
 // Template Graphics Commands
 
-std::wstring cg_add_command(command_context& ctx)
+std::future<std::wstring> cg_add_command(command_context& ctx)
 {
     // CG 1 ADD 0 "template_folder/templatename" [STARTLABEL] 0/1 [DATA]
 
@@ -702,25 +627,19 @@ std::wstring cg_add_command(command_context& ctx)
         bDoStart = ctx.parameters.at(2).at(0) == L'1' ? true : false;
     }
 
-    const wchar_t* pDataString = nullptr;
-    std::wstring   dataFromFile;
+    const wchar_t*                      pDataString = nullptr;
+    std::shared_ptr<const std::wstring> dataFromFile;
     if (ctx.parameters.size() > dataIndex) { // read data
         const std::wstring& dataString = ctx.parameters.at(dataIndex);
 
         if (dataString.at(0) == L'<' || dataString.at(0) == L'{') // the data is XML or Json
             pDataString = dataString.c_str();
         else {
-            // The data is not an XML-string, it must be a filename
-            std::wstring filename = env::data_folder();
-            filename.append(dataString);
-            filename.append(L".ftd");
-
-            auto found_file = find_case_insensitive(filename);
+            // The data is not an XML-string, it must be the name of a dataset
+            dataFromFile = ctx.static_context->data->retrieve(dataString);
 
-            if (found_file) {
-                dataFromFile = read_file(boost::filesystem::path(*found_file));
-                pDataString  = dataFromFile.c_str();
-            }
+            if (dataFromFile)
+                pDataString = dataFromFile->c_str();
         }
     }
 
@@ -733,55 +652,85 @@ std::wstring cg_add_command(command_context& ctx)
 
     if (proxy == core::cg_proxy::empty())
         CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Could not find template " + filename));
-    else
-        proxy->add(layer, filename, bDoStart, label, pDataString != nullptr ? pDataString : L"");
 
-    return L"202 CG OK\r\n";
+    // Along with the other template commands of the queue, so that it reaches the template in the order they were sent
+    auto data = std::wstring(pDataString != nullptr ? pDataString : L"");
+    return std::async(std::launch::deferred, [=]() -> std::wstring {
+        proxy->add(layer, filename, bDoStart, label, data);
+        return L"202 CG OK\r\n";
+    });
 }
 
-std::wstring cg_play_command(command_context& ctx)
+std::wstring cg_preload_command(command_context& ctx)
 {
-    int layer = std::stoi(ctx.parameters.at(0));
-    ctx.static_context->cg_registry
-        ->get_proxy(spl::make_shared_ptr(ctx.channel.raw_channel), ctx.layer_index(core::cg_proxy::DEFAULT_LAYER))
-        ->play(layer);
+    // CG 1 PRELOAD "template_folder/templatename"
+
+    auto filename = ctx.parameters.at(0);
+    if (!ctx.static_context->cg_registry->preload(get_producer_dependencies(ctx.channel.raw_channel, ctx), filename))
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Could not preload template " + filename));
 
     return L"202 CG OK\r\n";
 }
 
-spl::shared_ptr<core::cg_proxy> get_expected_cg_proxy(command_context& ctx)
+// Calls the proxy of the template on the layer once the stage has got to the command, rather than having the queue wait
+// on the channel for it. The template commands of a queue are completed in the order they were sent, so they still
+// reach the template in that order.
+template <typename Func>
+std::future<std::wstring> with_cg_proxy(command_context& ctx, const std::wstring& name, bool expected, Func func)
 {
-    auto proxy = ctx.static_context->cg_registry->get_proxy(spl::make_shared_ptr(ctx.channel.raw_channel),
-                                                            ctx.layer_index(core::cg_proxy::DEFAULT_LAYER));
+    auto producer = ctx.channel.stage->foreground(ctx.layer_index(core::cg_proxy::DEFAULT_LAYER)).share();
+    auto registry = ctx.static_context->cg_registry;
 
-    if (proxy == cg_proxy::empty())
-        CASPAR_THROW_EXCEPTION(expected_user_error() << msg_info(L"No CG proxy running on layer"));
+    return std::async(std::launch::deferred, [=]() -> std::wstring {
+        auto proxy = registry->get_proxy(spl::make_shared_ptr(producer.get()));
+
+        if (expected && proxy == cg_proxy::empty()) {
+            CASPAR_LOG(error) << L"No CG proxy running on layer";
+            return L"403 " + name + L" FAILED\r\n";
+        }
 
-    return proxy;
+        return func(proxy);
+    });
 }
 
-std::wstring cg_stop_command(command_context& ctx)
+std::future<std::wstring> cg_play_command(command_context& ctx)
 {
     int layer = std::stoi(ctx.parameters.at(0));
-    get_expected_cg_proxy(ctx)->stop(layer);
 
-    return L"202 CG OK\r\n";
+    return with_cg_proxy(ctx, L"CG PLAY", false, [=](const spl::shared_ptr<cg_proxy>& proxy) {
+        proxy->play(layer);
+        return std::wstring(L"202 CG OK\r\n");
+    });
 }
 
-std::wstring cg_next_command(command_context& ctx)
+std::future<std::wstring> cg_stop_command(command_context& ctx)
 {
     int layer = std::stoi(ctx.parameters.at(0));
-    get_expected_cg_proxy(ctx)->next(layer);
 
-    return L"202 CG OK\r\n";
+    return with_cg_proxy(ctx, L"CG STOP", true, [=](const spl::shared_ptr<cg_proxy>& proxy) {
+        proxy->stop(layer);
+        return std::wstring(L"202 CG OK\r\n");
+    });
 }
 
-std::wstring cg_remove_command(command_context& ctx)
+std::future<std::wstring> cg_next_command(command_context& ctx)
 {
     int layer = std::stoi(ctx.parameters.at(0));
-    get_expected_cg_proxy(ctx)->remove(layer);
 
-    return L"202 CG OK\r\n";
+    return with_cg_proxy(ctx, L"CG NEXT", true, [=](const spl::shared_ptr<cg_proxy>& proxy) {
+        proxy->next(layer);
+        return std::wstring(L"202 CG OK\r\n");
+    });
+}
+
+std::future<std::wstring> cg_remove_command(command_context& ctx)
+{
+    int layer = std::stoi(ctx.parameters.at(0));
+
+    return with_cg_proxy(ctx, L"CG REMOVE", true, [=](const spl::shared_ptr<cg_proxy>& proxy) {
+        proxy->remove(layer);
+        return std::wstring(L"202 CG OK\r\n");
+    });
 }
 
 std::wstring cg_clear_command(command_context& ctx)
@@ -791,34 +740,35 @@ std::wstring cg_clear_command(command_context& ctx)
     return L"202 CG OK\r\n";
 }
 
-std::wstring cg_update_command(command_context& ctx)
+std::future<std::wstring> cg_update_command(command_context& ctx)
 {
     int layer = std::stoi(ctx.parameters.at(0));
 
     std::wstring dataString = ctx.parameters.at(1);
     if (dataString.at(0) != L'<' && dataString.at(0) != L'{') {
-        // The data is not XML or Json, it must be a filename
-        std::wstring filename = env::data_folder();
-        filename.append(dataString);
-        filename.append(L".ftd");
-
-        dataString = read_file(boost::filesystem::path(filename));
+        // The data is not XML or Json, it must be the name of a dataset
+        auto data  = ctx.static_context->data->retrieve(dataString);
+        dataString = data ? *data : L"";
     }
 
-    get_expected_cg_proxy(ctx)->update(layer, dataString);
-
-    return L"202 CG OK\r\n";
+    return with_cg_proxy(ctx, L"CG UPDATE", true, [=](const spl::shared_ptr<cg_proxy>& proxy) {
+        proxy->update(layer, dataString);
+        return std::wstring(L"202 CG OK\r\n");
+    });
 }
 
-std::wstring cg_invoke_command(command_context& ctx)
+std::future<std::wstring> cg_invoke_command(command_context& ctx)
 {
-    std::wstringstream replyString;
-    replyString << L"201 CG OK\r\n";
-    int  layer  = std::stoi(ctx.parameters.at(0));
-    auto result = get_expected_cg_proxy(ctx)->invoke(layer, ctx.parameters.at(1));
-    replyString << result << L"\r\n";
+    int  layer = std::stoi(ctx.parameters.at(0));
+    auto label = ctx.parameters.at(1);
 
-    return replyString.str();
+    return with_cg_proxy(ctx, L"CG INVOKE", true, [=](const spl::shared_ptr<cg_proxy>& proxy) {
+        std::wstringstream replyString;
+        replyString << L"201 CG OK\r\n";
+        replyString << proxy->invoke(layer, label) << L"\r\n";
+
+        return replyString.str();
+    });
 }
 
 // Mixer Commands
@@ -841,7 +791,8 @@ std::future<std::wstring> reply_value(command_context& ctx, const Func& extracto
 
 class transforms_applier
 {
-    static tbb::concurrent_unordered_map<int, std::vector<stage::transform_tuple_t>> deferred_transforms_;
+    static std::mutex                                           deferred_mutex_;
+    static std::map<int, std::vector<stage::transform_tuple_t>> deferred_transforms_;
 
     std::vector<stage::transform_tuple_t> transforms_;
     command_context&                      ctx_;
@@ -861,25 +812,28 @@ class transforms_applier
 
     std::future<void> commit_deferred()
     {
-        const int  channel_index = ctx_.channel_index;
-        const auto f             = ctx_.channel.stage->apply_transforms(deferred_transforms_[channel_index]).share();
+        // Take the whole batch in one swap, so transforms deferred while this commit is applied go to the next one
+        std::vector<stage::transform_tuple_t> transforms;
+        {
+            std::lock_guard<std::mutex> lock(deferred_mutex_);
+            std::swap(transforms, deferred_transforms_[ctx_.channel_index]);
+        }
 
-        return std::async(std::launch::deferred, [=]() {
-            f.get();
-            deferred_transforms_[channel_index].clear();
-        });
+        return ctx_.channel.stage->apply_transforms(transforms);
     }
 
     void apply()
     {
         if (defer_) {
-            auto& defer_tranforms = deferred_transforms_[ctx_.channel_index];
+            std::lock_guard<std::mutex> lock(deferred_mutex_);
+            auto&                       defer_tranforms = deferred_transforms_[ctx_.channel_index];
             defer_tranforms.insert(defer_tranforms.end(), transforms_.begin(), transforms_.end());
         } else
             ctx_.channel.stage->apply_transforms(transforms_);
     }
 };
-tbb::concurrent_unordered_map<int, std::vector<stage::transform_tuple_t>> transforms_applier::deferred_transforms_;
+std::mutex                                           transforms_applier::deferred_mutex_;
+std::map<int, std::vector<stage::transform_tuple_t>> transforms_applier::deferred_transforms_;
 
 std::future<std::wstring> mixer_keyer_command(command_context& ctx)
 {
@@ -1016,6 +970,45 @@ std::future<std::wstring> mixer_blend_command(command_context& ctx)
     return make_ready_future<std::wstring>(L"202 MIXER OK\r\n");
 }
 
+std::future<std::wstring> mixer_cache_command(command_context& ctx)
+{
+    if (ctx.parameters.empty()) {
+        return reply_value(ctx, [](const frame_transform& t) -> std::wstring {
+            switch (t.image_transform.layer_cache) {
+                case core::layer_cache::enabled:
+                    return L"ON";
+                case core::layer_cache::disabled:
+                    return L"OFF";
+                default:
+                    return L"AUTO";
+            }
+        });
+    }
+
+    auto mode  = core::layer_cache::automatic;
+    auto value = boost::to_upper_copy(ctx.parameters.at(0));
+    if (value == L"ON" || value == L"1") {
+        mode = core::layer_cache::enabled;
+    } else if (value == L"OFF" || value == L"0") {
+        mode = core::layer_cache::disabled;
+    } else if (value != L"AUTO") {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected AUTO, ON or OFF"));
+    }
+
+    transforms_applier transforms(ctx);
+    transforms.add(stage::transform_tuple_t(
+        ctx.layer_index(),
+        [=](frame_transform transform) -> frame_transform {
+            transform.image_transform.layer_cache = mode;
+            return transform;
+        },
+        0,
+        tweener(L"linear")));
+    transforms.apply();
+
+    return make_ready_future<std::wstring>(L"202 MIXER OK\r\n");
+}
+
 template <typename Getter, typename Setter>
 std::future<std::wstring>
 single_double_animatable_mixer_command(command_context& ctx, const Getter& getter, const Setter& setter)
@@ -1313,6 +1306,42 @@ std::future<std::wstring> mixer_volume_command(command_context& ctx)
         [](frame_transform& t, double value) { t.audio_transform.volume = value; });
 }
 
+std::future<std::wstring> mixer_channel_map_command(command_context& ctx)
+{
+    if (ctx.parameters.empty()) {
+        return reply_value(ctx, [](const frame_transform& t) {
+            std::vector<std::wstring> channels;
+            for (auto channel : t.audio_transform.channel_map) {
+                channels.push_back(boost::lexical_cast<std::wstring>(channel));
+            }
+            return boost::join(channels, L",");
+        });
+    }
+
+    // A comma separated list of the source channel played on each output channel, -1 for silence, or DEFAULT
+    std::vector<int> value;
+    if (!boost::iequals(ctx.parameters.at(0), L"DEFAULT")) {
+        std::vector<std::wstring> channels;
+        boost::split(channels, ctx.parameters.at(0), boost::is_any_of(L","));
+        for (auto& channel : channels) {
+            value.push_back(std::max(-1, boost::lexical_cast<int>(channel)));
+        }
+    }
+
+    transforms_applier transforms(ctx);
+    transforms.add(stage::transform_tuple_t(
+        ctx.layer_index(),
+        [=](frame_transform transform) -> frame_transform {
+            transform.audio_transform.channel_map = value;
+            return transform;
+        },
+        0,
+        tweener(L"linear")));
+    transforms.apply();
+
+    return make_ready_future<std::wstring>(L"202 MIXER OK\r\n");
+}
+
 std::wstring mixer_mastervolume_command(command_context& ctx)
 {
     if (ctx.parameters.empty()) {
@@ -1382,8 +1411,7 @@ std::wstring mixer_clear_command(command_context& ctx)
 
 std::wstring channel_grid_command(command_context& ctx)
 {
-    int   index = 1;
-    auto& self  = ctx.channels->back();
+    auto& self = ctx.channels->back();
 
     core::diagnostics::scoped_call_context save;
     core::diagnostics::call_context::for_thread().video_channel = ctx.channels->size();
@@ -1401,137 +1429,162 @@ std::wstring channel_grid_command(command_context& ctx)
 
     self.raw_channel->output().add(screen);
 
+    // Every other channel in one layer, which draws their mixed output rather than mixing their layers again
+    std::vector<std::wstring> multiview_params;
+    multiview_params.emplace_back(L"MULTIVIEW");
     for (auto& ch : *ctx.channels) {
         if (ch.raw_channel != self.raw_channel) {
-            core::diagnostics::call_context::for_thread().layer = index;
-            auto producer = ctx.static_context->producer_registry->create_producer(
-                get_producer_dependencies(self.raw_channel, ctx),
-                L"route://" + std::to_wstring(ch.raw_channel->index()));
-            self.stage->load(index, producer, false);
-            self.stage->play(index);
-            index++;
+            multiview_params.push_back(std::to_wstring(ch.raw_channel->index()));
         }
     }
+    multiview_params.emplace_back(L"METERS");
+    multiview_params.emplace_back(L"0");
 
-    auto num_channels       = ctx.channels->size() - 1;
-    int  square_side_length = std::ceil(std::sqrt(num_channels));
+    core::diagnostics::call_context::for_thread().layer = 1;
 
-    auto ctx2 =
-        command_context(ctx.static_context, ctx.channels, ctx.client, self, self.raw_channel->index(), ctx.layer_id);
-    ctx2.parameters.push_back(std::to_wstring(square_side_length));
-    mixer_grid_command(ctx2);
+    auto producer = ctx.static_context->producer_registry->create_producer(
+        get_producer_dependencies(self.raw_channel, ctx), multiview_params);
+    self.stage->load(1, producer, false);
+    self.stage->play(1);
 
     return L"202 CHANNEL_GRID OK\r\n";
 }
 
 // Thumbnail Commands
 
-std::wstring make_request(command_context& ctx, const std::string& path, const std::wstring& default_response)
+// The last listing of each path, which the media scanner only sends again when its ETag has changed
+struct cached_listing
 {
-    auto res = http::request(ctx.static_context->proxy_host, ctx.static_context->proxy_port, path);
-    if (res.status_code >= 500 || res.body.size() == 0) {
-        CASPAR_LOG(error) << "Failed to connect to media-scanner. Is it running? \nReason: " << res.status_message;
-        return default_response;
+    std::string                           etag;
+    std::wstring                          body;
+    std::chrono::steady_clock::time_point validated; // When the media scanner last responded with it
+};
+
+std::mutex                            listings_mutex;
+std::map<std::string, cached_listing> listings;
+
+// Requests path from the media scanner and completes once it has responded, so that the queue of the client can go on
+// with its next command meanwhile
+std::future<std::wstring> make_request(command_context&    ctx,
+                                       const std::string&  path,
+                                       const std::wstring& default_response,
+                                       bool                cached = false)
+{
+    std::map<std::string, std::string> headers;
+    if (cached) {
+        // Clients that poll a listing get it without asking the media scanner again for max-age after it was validated
+        auto max_age = std::chrono::duration<double>(
+            env::properties().get(L"configuration.amcp.media-server.max-age", 0.0));
+
+        std::lock_guard<std::mutex> lock(listings_mutex);
+        auto                        it = listings.find(path);
+        if (it != listings.end()) {
+            if (std::chrono::steady_clock::now() - it->second.validated < max_age) {
+                return make_ready_future(std::wstring(it->second.body));
+            }
+            headers["If-None-Match"] = it->second.etag;
+        }
     }
-    return u16(res.body);
+
+    auto& server  = *ctx.static_context;
+    auto  timeout = std::chrono::seconds(env::properties().get(L"configuration.amcp.media-server.timeout", 10));
+    auto  res     = http::request_async(server.proxy_host, server.proxy_port, path, headers, timeout).share();
+
+    return std::async(std::launch::deferred, [res, path, default_response, cached]() -> std::wstring {
+        try {
+            auto& response = res.get();
+
+            if (cached && response.status_code == 304) {
+                std::lock_guard<std::mutex> lock(listings_mutex);
+                auto                        it = listings.find(path);
+                if (it != listings.end()) {
+                    it->second.validated = std::chrono::steady_clock::now();
+                    return it->second.body;
+                }
+            }
+
+            if (response.status_code >= 500 || response.body.size() == 0) {
+                CASPAR_LOG(error) << "Failed to connect to media-scanner. Is it running? \nReason: "
+                                  << response.status_message;
+                return default_response;
+            }
+
+            if (response.status_code < 200 || response.status_code >= 300) {
+                CASPAR_LOG(error) << "Media-scanner responded to " << path << " with " << response.status_code << " "
+                                  << response.status_message;
+                return default_response;
+            }
+
+            auto body = u16(response.body);
+
+            auto etag = response.headers.find("etag");
+            if (cached && etag != response.headers.end()) {
+                std::lock_guard<std::mutex> lock(listings_mutex);
+                listings[path] = cached_listing{etag->second, body, std::chrono::steady_clock::now()};
+            }
+
+            return body;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return default_response;
+        }
+    });
 }
 
-std::wstring thumbnail_list_command(command_context& ctx)
+std::future<std::wstring> thumbnail_list_command(command_context& ctx)
 {
     return make_request(ctx, "/thumbnail", L"501 THUMBNAIL LIST FAILED\r\n");
 }
 
-std::wstring thumbnail_retrieve_command(command_context& ctx)
+std::future<std::wstring> thumbnail_retrieve_command(command_context& ctx)
 {
     return make_request(
         ctx, "/thumbnail/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL RETRIEVE FAILED\r\n");
 }
 
-std::wstring thumbnail_generate_command(command_context& ctx)
+std::future<std::wstring> thumbnail_generate_command(command_context& ctx)
 {
     return make_request(
         ctx, "/thumbnail/generate/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL GENERATE FAILED\r\n");
 }
 
-std::wstring thumbnail_generateall_command(command_context& ctx)
+std::future<std::wstring> thumbnail_generateall_command(command_context& ctx)
 {
     return make_request(ctx, "/thumbnail/generate", L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
 }
 
 // Query Commands
 
-std::wstring cinf_command(command_context& ctx)
+std::future<std::wstring> cinf_command(command_context& ctx)
 {
     return make_request(ctx, "/cinf/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 CINF FAILED\r\n");
 }
 
-std::wstring cls_command(command_context& ctx) { return make_request(ctx, "/cls", L"501 CLS FAILED\r\n"); }
-
-std::wstring fls_command(command_context& ctx) { return make_request(ctx, "/fls", L"501 FLS FAILED\r\n"); }
-
-std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls", L"501 TLS FAILED\r\n"); }
-
-std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
-
-struct param_visitor : public boost::static_visitor<void>
+std::future<std::wstring> cls_command(command_context& ctx)
 {
-    std::wstring path;
-    pt::wptree&  o;
-
-    template <typename T>
-    param_visitor(std::string path, T& o)
-        : path(u16(path))
-        , o(o)
-    {
-    }
-
-    void operator()(const bool value) { o.add(path, value); }
-
-    void operator()(const int32_t value) { o.add(path, value); }
-
-    void operator()(const uint32_t value) { o.add(path, value); }
-
-    void operator()(const int64_t value) { o.add(path, value); }
-
-    void operator()(const uint64_t value) { o.add(path, value); }
-
-    void operator()(const float value) { o.add(path, value); }
+    return make_request(ctx, "/cls", L"501 CLS FAILED\r\n", true);
+}
 
-    void operator()(const double value) { o.add(path, value); }
+std::future<std::wstring> fls_command(command_context& ctx)
+{
+    return make_request(ctx, "/fls", L"501 FLS FAILED\r\n", true);
+}
 
-    void operator()(const std::string& value) { o.add(path, u16(value)); }
+std::future<std::wstring> tls_command(command_context& ctx)
+{
+    return make_request(ctx, "/tls", L"501 TLS FAILED\r\n", true);
+}
 
-    void operator()(const std::wstring& value) { o.add(path, value); }
-};
+std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
 
 std::wstring info_channel_command(command_context& ctx)
 {
-    pt::wptree info;
-    pt::wptree channel_info;
-
-    auto state = ctx.channel.raw_channel->state();
-    for (const auto& p : state) {
-        const auto replaced = boost::algorithm::replace_all_copy(p.first, "/", ".");
-        // avoid digit-only nodes in XML
-        const auto path = boost::algorithm::replace_all_regex_copy(
-            replaced, boost::regex("\\.(.*?)\\.([0-9]*?)\\."), std::string(".$1.$1_$2."));
-        param_visitor param_visitor(path, channel_info);
-        for (const auto& element : p.second) {
-            boost::apply_visitor(param_visitor, element);
-        }
+    // INFO <channel> SINCE <generation>
+    if (ctx.parameters.size() >= 2 && boost::iequals(ctx.parameters.at(0), L"SINCE")) {
+        return ctx.static_context->info->info_since(*ctx.channel.raw_channel, std::stoull(ctx.parameters.at(1)));
     }
 
-    info.add_child(L"channel", channel_info);
-
-    std::wstringstream replyString;
-    // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO OK\r\n";
-
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(replyString, info, w);
-
-    replyString << L"\r\n";
-    return replyString.str();
+    return ctx.static_context->info->info(*ctx.channel.raw_channel);
 }
 
 std::wstring info_command(command_context& ctx)
@@ -1550,15 +1603,13 @@ std::wstring info_command(command_context& ctx)
 
 std::wstring info_config_command(command_context& ctx)
 {
-    std::wstringstream replyString;
     // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO CONFIG OK\r\n";
+    std::wstring reply = L"201 INFO CONFIG OK\r\n";
 
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(replyString, caspar::env::properties(), w);
+    IO::write_xml(reply, caspar::env::properties());
 
-    replyString << L"\r\n";
-    return replyString.str();
+    reply += L"\r\n";
+    return reply;
 }
 
 std::wstring info_paths_command(command_context& ctx)
@@ -1571,15 +1622,70 @@ std::wstring info_paths_command(command_context& ctx)
     info.add(L"paths.template-path", caspar::env::template_folder());
     info.add(L"paths.initial-path", caspar::env::initial_folder() + L"/");
 
-    std::wstringstream replyString;
     // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO PATHS OK\r\n";
+    std::wstring reply = L"201 INFO PATHS OK\r\n";
 
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(replyString, info, w);
+    IO::write_xml(reply, info);
 
-    replyString << L"\r\n";
-    return replyString.str();
+    reply += L"\r\n";
+    return reply;
+}
+
+std::wstring info_queues_command(command_context& ctx)
+{
+    std::wstring reply = L"201 INFO QUEUES OK\r\n";
+
+    IO::write_xml(reply, AMCPCommandQueue::info());
+
+    reply += L"\r\n";
+    return reply;
+}
+
+std::wstring info_memory_command(command_context& ctx)
+{
+    static const wchar_t* modes[] = {L"none", L"transparent", L"reserved"};
+
+    boost::property_tree::wptree info;
+    info.add(L"memory.host-buffers.huge-pages", modes[static_cast<int>(host_buffer_huge_pages())]);
+    for (auto& slab : host_buffer_statistics()) {
+        auto& xml = info.add(L"memory.host-buffers.slab", L"");
+        xml.add(L"size", slab.size);
+        xml.add(L"allocated", slab.allocated);
+        xml.add(L"reused", slab.reused);
+        xml.add(L"in-use", slab.in_use);
+        xml.add(L"free", slab.free);
+    }
+
+    auto destroyer = core::producer_destroyer_statistics();
+    info.add(L"memory.producer-destroyer.threads", destroyer.threads);
+    info.add(L"memory.producer-destroyer.destroyed", destroyer.destroyed);
+    info.add(L"memory.producer-destroyer.still-referenced", destroyer.still_referenced);
+    for (auto& destruction : destroyer.pending) {
+        auto& xml = info.add(L"memory.producer-destroyer.pending", L"");
+        xml.add(L"name", destruction.name);
+        xml.add(L"age", destruction.age.count());
+        xml.add(L"destroying", destruction.destroying);
+    }
+
+    auto governor = memory_governor_statistics();
+    info.add(L"memory.governor.soft-limit", governor.limits.soft);
+    info.add(L"memory.governor.hard-limit", governor.limits.hard);
+    info.add(L"memory.governor.pressure", to_string(governor.pressure));
+    info.add(L"memory.governor.total", governor.total);
+    info.add(L"memory.governor.trims", governor.trims);
+    for (auto& subsystem : governor.subsystems) {
+        auto& xml = info.add(L"memory.governor.subsystem", L"");
+        xml.add(L"name", u16(subsystem.subsystem));
+        xml.add(L"bytes", subsystem.bytes);
+        xml.add(L"accounts", subsystem.accounts);
+    }
+
+    std::wstring reply = L"201 INFO MEMORY OK\r\n";
+
+    IO::write_xml(reply, info);
+
+    reply += L"\r\n";
+    return reply;
 }
 
 std::wstring diag_command(command_context& ctx)
@@ -1589,6 +1695,44 @@ std::wstring diag_command(command_context& ctx)
     return L"202 DIAG OK\r\n";
 }
 
+std::wstring trace_start_command(command_context& ctx)
+{
+    caspar::diagnostics::trace::start();
+
+    return L"202 TRACE START OK\r\n";
+}
+
+// TRACE STOP [name] writes the trace to the log folder, by default as trace-<time>.json
+std::wstring trace_stop_command(command_context& ctx)
+{
+    if (!caspar::diagnostics::trace::running()) {
+        return L"403 TRACE STOP NOT RUNNING\r\n";
+    }
+
+    auto trace = caspar::diagnostics::trace::stop();
+
+    auto name = ctx.parameters.empty()
+                    ? L"trace-" + boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time())
+                    : boost::filesystem::path(ctx.parameters.at(0)).filename().wstring();
+    if (name.empty() || name == L"." || name == L"..") {
+        return L"403 TRACE STOP BAD NAME\r\n";
+    }
+    if (boost::filesystem::path(name).extension().empty()) {
+        name += L".json";
+    }
+
+    auto filename = (boost::filesystem::path(env::log_folder()) / name).wstring();
+
+    boost::filesystem::ofstream file(filename, std::ios::binary);
+    if (!file)
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
+
+    file << trace << std::flush;
+    file.close();
+
+    return L"201 TRACE STOP OK\r\n" + filename + L"\r\n";
+}
+
 std::wstring bye_command(command_context& ctx)
 {
     ctx.client->disconnect();
@@ -1607,6 +1751,19 @@ std::wstring restart_command(command_context& ctx)
     return L"202 RESTART OK\r\n";
 }
 
+std::wstring reload_command(command_context& ctx)
+{
+    auto changes = ctx.static_context->reload_configuration();
+
+    std::wstringstream replyString;
+    replyString << L"200 RELOAD OK\r\n";
+    for (auto& change : changes) {
+        replyString << change << L"\r\n";
+    }
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
 std::wstring lock_command(command_context& ctx)
 {
     int  channel_index = std::stoi(ctx.parameters.at(0)) - 1;
@@ -1653,14 +1810,12 @@ std::wstring gl_info_command(command_context& ctx)
     if (!device)
         CASPAR_THROW_EXCEPTION(not_supported() << msg_info("GL command only supported with OpenGL accelerator."));
 
-    std::wstringstream result;
-    result << L"201 GL INFO OK\r\n";
+    std::wstring reply = L"201 GL INFO OK\r\n";
 
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(result, device->info(), w);
-    result << L"\r\n";
+    IO::write_xml(reply, device->info());
 
-    return result.str();
+    reply += L"\r\n";
+    return reply;
 }
 
 std::wstring gl_gc_command(command_context& ctx)
@@ -1692,8 +1847,20 @@ std::wstring osc_subscribe_command(command_context& ctx)
         return L"403 OSC SUBSCRIBE BAD PORT\r\n";
     }
 
+    // OSC SUBSCRIBE <port> [FILTER <pattern>]... [RATE <sends per second>]
+    osc::subscription_options options;
+    for (size_t n = 1; n + 1 < ctx.parameters.size(); n += 2) {
+        if (boost::iequals(ctx.parameters.at(n), L"FILTER")) {
+            options.patterns.push_back(u8(ctx.parameters.at(n + 1)));
+        } else if (boost::iequals(ctx.parameters.at(n), L"RATE")) {
+            options.max_rate = boost::lexical_cast<double>(ctx.parameters.at(n + 1));
+        } else {
+            return L"403 OSC SUBSCRIBE BAD PARAMETER\r\n";
+        }
+    }
+
     auto subscription = ctx.static_context->osc_client->get_subscription_token(
-        udp::endpoint(address_v4::from_string(u8(ctx.client->address())), port));
+        udp::endpoint(address_v4::from_string(u8(ctx.client->address())), port), options);
 
     ctx.client->add_lifecycle_bound_object(get_osc_subscription_token(port), subscription);
 
@@ -1740,6 +1907,7 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_command(L"Data Commands", L"DATA REMOVE", data_remove_command, 1);
 
     repo->register_channel_command(L"Template Commands", L"CG ADD", cg_add_command, 3);
+    repo->register_channel_command(L"Template Commands", L"CG PRELOAD", cg_preload_command, 1);
     repo->register_channel_command(L"Template Commands", L"CG PLAY", cg_play_command, 1);
     repo->register_channel_command(L"Template Commands", L"CG STOP", cg_stop_command, 1);
     repo->register_channel_command(L"Template Commands", L"CG NEXT", cg_next_command, 1);
@@ -1752,6 +1920,7 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_channel_command(L"Mixer Commands", L"MIXER INVERT", mixer_invert_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER CHROMA", mixer_chroma_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER BLEND", mixer_blend_command, 0);
+    repo->register_channel_command(L"Mixer Commands", L"MIXER CACHE", mixer_cache_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER OPACITY", mixer_opacity_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER BRIGHTNESS", mixer_brightness_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER SATURATION", mixer_saturation_command, 0);
@@ -1764,6 +1933,7 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_channel_command(L"Mixer Commands", L"MIXER ROTATION", mixer_rotation_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER PERSPECTIVE", mixer_perspective_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER VOLUME", mixer_volume_command, 0);
+    repo->register_channel_command(L"Mixer Commands", L"MIXER CHANNEL_MAP", mixer_channel_map_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER MASTERVOLUME", mixer_mastervolume_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER GRID", mixer_grid_command, 1);
     repo->register_channel_command(L"Mixer Commands", L"MIXER COMMIT", mixer_commit_command, 0);
@@ -1781,13 +1951,18 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_command(L"Query Commands", L"TLS", tls_command, 0);
     repo->register_command(L"Query Commands", L"VERSION", version_command, 0);
     repo->register_command(L"Query Commands", L"DIAG", diag_command, 0);
+    repo->register_command(L"Query Commands", L"TRACE START", trace_start_command, 0);
+    repo->register_command(L"Query Commands", L"TRACE STOP", trace_stop_command, 0);
     repo->register_command(L"Query Commands", L"BYE", bye_command, 0);
     repo->register_command(L"Query Commands", L"KILL", kill_command, 0);
     repo->register_command(L"Query Commands", L"RESTART", restart_command, 0);
+    repo->register_command(L"Query Commands", L"RELOAD", reload_command, 0);
     repo->register_channel_command(L"Query Commands", L"INFO", info_channel_command, 0);
     repo->register_command(L"Query Commands", L"INFO", info_command, 0);
     repo->register_command(L"Query Commands", L"INFO CONFIG", info_config_command, 0);
     repo->register_command(L"Query Commands", L"INFO PATHS", info_paths_command, 0);
+    repo->register_command(L"Query Commands", L"INFO QUEUES", info_queues_command, 0);
+    repo->register_command(L"Query Commands", L"INFO MEMORY", info_memory_command, 0);
     repo->register_command(L"Query Commands", L"GL INFO", gl_info_command, 0);
     repo->register_command(L"Query Commands", L"GL GC", gl_gc_command, 0);
 
@@ -26,6 +26,7 @@
 #include "AMCPProtocolStrategy.h"
 #include "amcp_command_context.h"
 #include "amcp_command_repository.h"
+#include "amcp_recorder.h"
 #include "amcp_shared.h"
 #include "protocol/util/strategy_adapters.h"
 #include "protocol/util/tokenize.h"
@@ -33,11 +34,19 @@
 #include "../util/tokenize.h"
 
 #include <algorithm>
+#include <cmath>
+#include <optional>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/log/keywords/delimiter.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
+
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
 
 #if defined(_MSC_VER)
 #pragma warning(push, 1) // TODO: Legacy code, just disable warnings
@@ -92,10 +101,12 @@ class AMCPProtocolStrategy
   private:
     std::vector<AMCPCommandQueue::ptr_type>  commandQueues_;
     spl::shared_ptr<amcp_command_repository> repo_;
+    const double                             schedule_window_; // Seconds
 
   public:
     AMCPProtocolStrategy(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo)
         : repo_(repo)
+        , schedule_window_(env::properties().get(L"configuration.amcp.schedule-window", 3600.0))
     {
         commandQueues_.push_back(spl::make_shared<AMCPCommandQueue>(L"General Queue for " + name, repo_->channels()));
 
@@ -141,10 +152,11 @@ class AMCPProtocolStrategy
         }
 
         CASPAR_LOG(info) << L"Received message from " << client->address() << ": " << message << L"\\r\\n";
+        record_amcp_command(client->address(), message, tokens);
 
         std::wstring request_id;
         std::wstring command_name;
-        error_state  err = parse_command_string(client, batch, tokens, request_id, command_name);
+        error_state  err = parse_command_string(client, batch, std::move(tokens), request_id, command_name);
         if (err != error_state::no_error) {
             std::wstringstream answer;
 
@@ -192,17 +204,24 @@ class AMCPProtocolStrategy
                 return error;
             }
 
+            std::optional<command_schedule> schedule;
+            command_name = L"AT";
+            error        = parse_schedule_token(tokens, schedule);
+            if (error != error_state::no_error) {
+                return error;
+            }
+
             // Fail if no more tokens.
             if (tokens.empty()) {
                 return error_state::command_error;
             }
 
-            if (parse_batch_commands(batch, tokens, request_id, error)) {
+            if (parse_batch_commands(batch, tokens, request_id, schedule, error)) {
                 return error;
             }
 
             command_name                               = boost::to_upper_copy(tokens.front());
-            const std::shared_ptr<AMCPCommand> command = repo_->parse_command(client, tokens, request_id);
+            const std::shared_ptr<AMCPCommand> command = repo_->parse_command(client, std::move(tokens), request_id);
             if (!command) {
                 return error_state::command_error;
             }
@@ -213,11 +232,19 @@ class AMCPProtocolStrategy
             }
 
             if (batch->in_progress()) {
+                // A batch is scheduled as a whole by its COMMIT
+                if (schedule) {
+                    return error_state::command_error;
+                }
+
                 batch->add_command(command);
                 return error_state::no_error;
             }
 
             auto wrapped = std::make_shared<AMCPGroupCommand>(command);
+            if (schedule) {
+                wrapped->SetSchedule(*schedule);
+            }
             commandQueues_.at(channel_index + 1)->AddCommand(std::move(wrapped));
             return error_state::no_error;
 
@@ -248,9 +275,75 @@ class AMCPProtocolStrategy
         return error_state::no_error;
     }
 
+    // AT <channel> <frame>|+<frames>|<hh:mm:ss:ff> applies the command that follows on a frame of the channel. The
+    // timecode counts the running time of the channel from its first frame.
+    error_state parse_schedule_token(std::list<std::wstring>& tokens, std::optional<command_schedule>& schedule) const
+    {
+        if (tokens.empty() || !boost::iequals(tokens.front(), L"AT")) {
+            return error_state::no_error;
+        }
+
+        tokens.pop_front();
+
+        if (tokens.size() < 2) {
+            return error_state::parameters_error;
+        }
+
+        int channel;
+        if (!boost::conversion::try_lexical_convert(tokens.front(), channel)) {
+            return error_state::parameters_error;
+        }
+        tokens.pop_front();
+
+        auto  at          = std::move(tokens.front());
+        auto& stage       = repo_->channels()->at(channel - 1).raw_channel->stage();
+        auto  format_desc = stage->video_format_desc();
+        auto  now         = stage->frame_number();
+        tokens.pop_front();
+
+        uint64_t frame_number;
+        if (!at.empty() && at.front() == L'+') {
+            uint32_t frames;
+            if (!boost::conversion::try_lexical_convert(at.substr(1), frames)) {
+                return error_state::parameters_error;
+            }
+            frame_number = now + frames;
+        } else if (at.find_first_of(L":;") != std::wstring::npos) {
+            std::vector<std::wstring> parts;
+            boost::split(parts, at, boost::is_any_of(L":;"));
+
+            uint32_t values[4];
+            if (parts.size() != 4) {
+                return error_state::parameters_error;
+            }
+            for (int n = 0; n < 4; ++n) {
+                if (!boost::conversion::try_lexical_convert(parts[n], values[n])) {
+                    return error_state::parameters_error;
+                }
+            }
+
+            // Timecode counts whole frames per second, e.g. 30 for 29.97
+            auto frames_per_second = static_cast<uint64_t>(std::round(format_desc.hz));
+            frame_number =
+                ((values[0] * 60ull + values[1]) * 60ull + values[2]) * frames_per_second + values[3] + 1;
+        } else if (!boost::conversion::try_lexical_convert(at, frame_number)) {
+            return error_state::parameters_error;
+        }
+
+        if (frame_number > now + static_cast<uint64_t>(schedule_window_ * format_desc.hz)) {
+            CASPAR_LOG(error) << L"Frame " << frame_number << L" is beyond the schedule window of channel " << channel
+                              << L".";
+            return error_state::parameters_error;
+        }
+
+        schedule = command_schedule{channel - 1, frame_number};
+        return error_state::no_error;
+    }
+
     bool parse_batch_commands(const std::shared_ptr<AMCPClientBatchInfo>& batch,
                               std::list<std::wstring>&                    tokens,
                               std::wstring&                               request_id,
+                              const std::optional<command_schedule>&      schedule,
                               error_state&                                error)
     {
         if (boost::iequals(tokens.front(), L"COMMIT")) {
@@ -259,10 +352,21 @@ class AMCPProtocolStrategy
                 return true;
             }
 
-            commandQueues_.at(0)->AddCommand(std::move(batch->finish()));
+            auto cmd = batch->finish();
+            if (schedule) {
+                cmd->SetSchedule(*schedule);
+            }
+            commandQueues_.at(0)->AddCommand(std::move(cmd));
             error = error_state::no_error;
             return true;
         }
+
+        // Only the COMMIT of a batch can be scheduled
+        if (schedule && (boost::iequals(tokens.front(), L"BEGIN") || boost::iequals(tokens.front(), L"DISCARD"))) {
+            error = error_state::command_error;
+            return true;
+        }
+
         if (boost::iequals(tokens.front(), L"BEGIN")) {
             if (batch->in_progress()) {
                 error = error_state::command_error;
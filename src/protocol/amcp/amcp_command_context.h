@@ -24,9 +24,12 @@
 #include "../util/ClientInfo.h"
 #include "amcp_command_repository.h"
 #include "amcp_shared.h"
+#include "data_store.h"
+#include "info_cache.h"
 #include <accelerator/accelerator.h>
 #include <future>
 #include <utility>
+#include <vector>
 
 namespace caspar::protocol::osc {
 class client;
@@ -42,10 +45,13 @@ struct amcp_command_static_context
     const spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
     const std::shared_ptr<amcp_command_repository>             parser;
     std::function<void(bool)>                                  shutdown_server_now;
+    std::function<std::vector<std::wstring>()>                 reload_configuration; // Returns what was changed
     const std::string                                          proxy_host;
     const std::string                                          proxy_port;
     std::weak_ptr<accelerator::accelerator_device>             ogl_device;
     const spl::shared_ptr<osc::client>                         osc_client;
+    const spl::shared_ptr<data_store>                          data = spl::make_shared<data_store>();
+    const spl::shared_ptr<info_cache>                          info = spl::make_shared<info_cache>();
 
     amcp_command_static_context(core::video_format_repository                               format_repository,
                                 const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
@@ -53,6 +59,7 @@ struct amcp_command_static_context
                                 const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
                                 std::shared_ptr<amcp_command_repository>                    parser,
                                 std::function<void(bool)>                                   shutdown_server_now,
+                                std::function<std::vector<std::wstring>()>                  reload_configuration,
                                 std::string                                                 proxy_host,
                                 std::string                                                 proxy_port,
                                 std::weak_ptr<accelerator::accelerator_device>              ogl_device,
@@ -63,6 +70,7 @@ struct amcp_command_static_context
         , consumer_registry(consumer_registry)
         , parser(std::move(parser))
         , shutdown_server_now(std::move(shutdown_server_now))
+        , reload_configuration(std::move(reload_configuration))
         , proxy_host(std::move(proxy_host))
         , proxy_port(std::move(proxy_port))
         , ogl_device(std::move(ogl_device))
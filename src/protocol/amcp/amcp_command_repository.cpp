@@ -25,105 +25,160 @@
 
 #include <common/env.h>
 
-#include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
+#include <cwctype>
+#include <iterator>
 #include <map>
+#include <optional>
+#include <string_view>
 
 namespace caspar { namespace protocol { namespace amcp {
 
-AMCPCommand::ptr_type make_cmd(amcp_command_func        func,
-                               const std::wstring&      name,
+namespace {
+
+// Orders command names regardless of their case, and finds them from a view of a token without copying it. The names
+// are ASCII, so folding them doesn't need the locale that boost::iequals would consult.
+struct command_name_less
+{
+    using is_transparent = void;
+
+    static wchar_t fold(wchar_t c) { return c >= L'a' && c <= L'z' ? static_cast<wchar_t>(c - L'a' + L'A') : c; }
+
+    bool operator()(std::wstring_view lhs, std::wstring_view rhs) const
+    {
+        return std::lexicographical_compare(
+            lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](wchar_t a, wchar_t b) { return fold(a) < fold(b); });
+    }
+};
+
+struct command_entry
+{
+    std::wstring      name;
+    amcp_command_func func;
+    int               min_num_params;
+};
+
+// Commands by their first word, with the subcommands of that word, e.g. MIXER and MIXER FILL
+struct command_group
+{
+    std::optional<command_entry>                                command;
+    std::map<std::wstring, command_entry, command_name_less> subcommands;
+};
+
+using command_map = std::map<std::wstring, command_group, command_name_less>;
+
+void add_command(command_map& commands, const std::wstring& name, amcp_command_func func, int min_num_params)
+{
+    auto space = name.find(L' ');
+    auto entry = command_entry{name, std::move(func), min_num_params};
+
+    auto& group = commands[name.substr(0, space)];
+    if (space == std::wstring::npos) {
+        group.command = std::move(entry);
+    } else {
+        group.subcommands[name.substr(space + 1)] = std::move(entry);
+    }
+}
+
+AMCPCommand::ptr_type make_cmd(const command_entry&     entry,
                                const std::wstring&      id,
                                IO::ClientInfoPtr        client,
                                unsigned int             channel_index,
                                int                      layer_index,
                                std::list<std::wstring>& tokens)
 {
-    const std::vector<std::wstring> parameters(tokens.begin(), tokens.end());
-    const command_context_simple    ctx(std::move(client), channel_index, layer_index, std::move(parameters));
+    // The tokens are not used after this, so the parameters take them over
+    std::vector<std::wstring> parameters(std::make_move_iterator(tokens.begin()),
+                                         std::make_move_iterator(tokens.end()));
 
-    return std::make_shared<AMCPCommand>(ctx, func, name, id);
+    return std::make_shared<AMCPCommand>(
+        std::move(client), channel_index, layer_index, std::move(parameters), entry.func, entry.name, id);
 }
 
-AMCPCommand::ptr_type find_command(const std::map<std::wstring, std::pair<amcp_command_func, int>>& commands,
-                                   const std::wstring&                                              name,
-                                   const std::wstring&                                              request_id,
-                                   IO::ClientInfoPtr                                                client,
-                                   int                                                              channel_index,
-                                   int                                                              layer_index,
-                                   std::list<std::wstring>&                                         tokens)
+AMCPCommand::ptr_type find_command(const command_map&       commands,
+                                   const std::wstring&      name,
+                                   const std::wstring&      request_id,
+                                   IO::ClientInfoPtr        client,
+                                   int                      channel_index,
+                                   int                      layer_index,
+                                   std::list<std::wstring>& tokens)
 {
-    std::wstring subcommand;
-
-    if (!tokens.empty())
-        subcommand = boost::to_upper_copy(tokens.front());
+    const auto group = commands.find(std::wstring_view(name));
+    if (group == commands.end())
+        return nullptr;
 
     // Start with subcommand syntax like MIXER CLEAR etc
-    if (!subcommand.empty()) {
-        const auto fullname = name + L" " + subcommand;
-        const auto subcmd   = commands.find(fullname);
+    if (!tokens.empty()) {
+        const auto subcmd = group->second.subcommands.find(std::wstring_view(tokens.front()));
 
-        if (subcmd != commands.end()) {
+        if (subcmd != group->second.subcommands.end()) {
             tokens.pop_front();
 
-            if (tokens.size() >= subcmd->second.second) {
-                return make_cmd(
-                    subcmd->second.first, fullname, request_id, std::move(client), channel_index, layer_index, tokens);
+            if (tokens.size() >= subcmd->second.min_num_params) {
+                return make_cmd(subcmd->second, request_id, std::move(client), channel_index, layer_index, tokens);
             }
         }
     }
 
     // Resort to ordinary command
-    const auto command = commands.find(name);
+    const auto& command = group->second.command;
 
-    if (command != commands.end() && tokens.size() >= command->second.second) {
-        return make_cmd(command->second.first, name, request_id, std::move(client), channel_index, layer_index, tokens);
+    if (command && tokens.size() >= command->min_num_params) {
+        return make_cmd(*command, request_id, std::move(client), channel_index, layer_index, tokens);
     }
 
     return nullptr;
 }
 
-template <typename Out, typename In>
-bool try_lexical_cast(const In& input, Out& result)
+bool parse_index(const wchar_t* first, const wchar_t* last, int& result)
 {
-    Out        saved   = result;
-    const bool success = boost::conversion::detail::try_lexical_convert(input, result);
-
-    if (!success)
-        result = saved; // Needed because of how try_lexical_convert is implemented.
+    int value;
+    if (first == last || !boost::conversion::try_lexical_convert(first, last - first, value))
+        return false;
 
-    return success;
+    result = value;
+    return true;
 }
 
-static void
-parse_channel_id(std::list<std::wstring>& tokens, std::wstring& channel_spec, int& channel_index, int& layer_index)
+// Parses a channel spec like 1 or 1-10 in place, as most commands start with one
+void parse_channel_id(std::list<std::wstring>& tokens, std::wstring& channel_spec, int& channel_index, int& layer_index)
 {
     if (!tokens.empty()) {
-        channel_spec                            = tokens.front();
-        std::wstring              channelid_str = boost::trim_copy(channel_spec);
-        std::vector<std::wstring> split;
-        boost::split(split, channelid_str, boost::is_any_of("-"));
+        const auto& token = tokens.front();
+
+        auto first = token.data();
+        auto last  = token.data() + token.size();
+        while (first != last && std::iswspace(*first))
+            ++first;
+        while (first != last && std::iswspace(*(last - 1)))
+            --last;
+
+        auto dash = std::find(first, last, L'-');
 
         // Use non_throwing lexical cast to not hit exception break point all the time.
-        if (try_lexical_cast(split[0], channel_index)) {
+        if (parse_index(first, dash, channel_index)) {
             --channel_index;
 
-            if (split.size() > 1)
-                try_lexical_cast(split[1], layer_index);
+            if (dash != last)
+                parse_index(dash + 1, std::find(dash + 1, last, L'-'), layer_index);
 
             // Consume channel-spec
+            channel_spec = std::move(tokens.front());
             tokens.pop_front();
         }
     }
 }
 
+} // namespace
+
 struct amcp_command_repository::impl
 {
     const spl::shared_ptr<std::vector<channel_context>> channels_;
 
-    std::map<std::wstring, std::pair<amcp_command_func, int>> commands{};
-    std::map<std::wstring, std::pair<amcp_command_func, int>> channel_commands{};
+    command_map commands{};
+    command_map channel_commands{};
 
     impl(const spl::shared_ptr<std::vector<channel_context>>& channels)
         : channels_(channels)
@@ -164,8 +219,8 @@ struct amcp_command_repository::impl
     std::shared_ptr<AMCPCommand>
     parse_command(IO::ClientInfoPtr client, std::list<std::wstring> tokens, const std::wstring& request_id) const
     {
-        // Consume command name
-        const std::basic_string<wchar_t> command_name = boost::to_upper_copy(tokens.front());
+        // Consume command name, which is looked up regardless of its case
+        const std::wstring command_name = std::move(tokens.front());
         tokens.pop_front();
 
         // Determine whether the next parameter is a channel spec or not
@@ -182,7 +237,7 @@ struct amcp_command_repository::impl
             if (!command) // Might be a non channel command, although the first argument is numeric
             {
                 // Restore backed up channel spec string.
-                tokens.push_front(channel_spec);
+                tokens.push_front(std::move(channel_spec));
             }
         }
 
@@ -218,7 +273,7 @@ std::shared_ptr<AMCPCommand> amcp_command_repository::parse_command(IO::ClientIn
                                                                     std::list<std::wstring> tokens,
                                                                     const std::wstring&     request_id) const
 {
-    return impl_->parse_command(client, tokens, request_id);
+    return impl_->parse_command(client, std::move(tokens), request_id);
 }
 
 bool amcp_command_repository::check_channel_lock(IO::ClientInfoPtr client, int channel_index) const
@@ -231,7 +286,8 @@ void amcp_command_repository::register_command(std::wstring      category,
                                                amcp_command_func command,
                                                int               min_num_params)
 {
-    impl_->commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    // Modules are initialized after the built in commands are registered, and may take them over
+    add_command(impl_->commands, name, std::move(command), min_num_params);
 }
 
 void amcp_command_repository::register_channel_command(std::wstring      category,
@@ -239,7 +295,7 @@ void amcp_command_repository::register_channel_command(std::wstring      categor
                                                        amcp_command_func command,
                                                        int               min_num_params)
 {
-    impl_->channel_commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    add_command(impl_->channel_commands, name, std::move(command), min_num_params);
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "amcp_recorder.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+const wchar_t* const replay_client_address = L"Replay";
+
+namespace {
+
+class recorder
+{
+    std::mutex                                           mutex_;
+    boost::filesystem::ofstream                          file_;
+    std::optional<std::chrono::steady_clock::time_point> start_;
+
+  public:
+    recorder()
+    {
+        boost::filesystem::path folder = env::properties().get(L"configuration.amcp.record-path", std::wstring());
+        if (folder.empty()) {
+            return;
+        }
+        if (folder.is_relative()) {
+            folder = boost::filesystem::path(env::data_folder()) / folder;
+        }
+
+        try {
+            boost::filesystem::create_directories(folder);
+
+            auto name = boost::posix_time::to_iso_string(boost::posix_time::second_clock::local_time());
+            auto path = folder / (L"amcp-" + u16(name) + L".rec");
+            file_.open(path, std::ios::out | std::ios::trunc);
+            if (!file_) {
+                CASPAR_LOG(error) << L"[amcp_recorder] Could not open " << path.wstring();
+                return;
+            }
+
+            file_ << "# CasparCG " << u8(env::version()) << " AMCP recording\n"
+                  << "# <milliseconds since the first command>\\t<command>\n";
+            file_.flush();
+            CASPAR_LOG(info) << L"[amcp_recorder] Recording AMCP commands to " << path.wstring();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    static recorder& instance()
+    {
+        static recorder instance;
+        return instance;
+    }
+
+    bool enabled() const { return file_.is_open(); }
+
+    void record(const std::wstring& message, const std::list<std::wstring>& tokens)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto now = std::chrono::steady_clock::now();
+        if (!start_) {
+            start_ = now;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - *start_).count();
+
+        for (auto& line : notes(tokens)) {
+            file_ << line << '\n';
+        }
+        file_ << ms << '\t' << u8(message) << '\n';
+
+        // A recording ends when the server does, often without a clean shutdown
+        file_.flush();
+    }
+
+  private:
+    // The clips and templates that the command refers to
+    static std::vector<std::string> notes(const std::list<std::wstring>& list)
+    {
+        std::vector<std::wstring> tokens(list.begin(), list.end());
+
+        // Without the prefixes that parse_command_string strips
+        auto it = tokens.begin();
+        if (it != tokens.end() && !it->empty() && it->at(0) == L'/') {
+            ++it;
+        }
+        if (it != tokens.end() && boost::iequals(*it, L"REQ")) {
+            it = tokens.end() - it > 1 ? it + 2 : tokens.end();
+        }
+        if (it != tokens.end() && boost::iequals(*it, L"AT")) {
+            it = tokens.end() - it > 2 ? it + 3 : tokens.end();
+        }
+        tokens.erase(tokens.begin(), it);
+
+        std::vector<std::string> notes;
+        if (tokens.size() > 2 && (boost::iequals(tokens[0], L"LOAD") || boost::iequals(tokens[0], L"LOADBG") ||
+                                  boost::iequals(tokens[0], L"PLAY"))) {
+            // Not routes, colours and the like, which are not files
+            auto& clip = tokens[2];
+            if (clip.find(L"://") == std::wstring::npos && clip.at(0) != L'#' && !boost::iequals(clip, L"EMPTY")) {
+                notes.push_back("#media\t" + u8(clip));
+            }
+        } else if (tokens.size() > 4 && boost::iequals(tokens[0], L"CG") && boost::iequals(tokens[2], L"ADD")) {
+            notes.push_back("#template\t" + u8(tokens[4]));
+        }
+        return notes;
+    }
+};
+
+} // namespace
+
+void record_amcp_command(const std::wstring&            client_address,
+                         const std::wstring&            message,
+                         const std::list<std::wstring>& tokens)
+{
+    auto& recorder = recorder::instance();
+    if (!recorder.enabled() || client_address == replay_client_address) {
+        return;
+    }
+
+    try {
+        recorder.record(message, tokens);
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+}
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// The client address of the commands of a replay, which are not recorded again
+extern const wchar_t* const replay_client_address;
+
+// Records the commands of all clients to a file in amcp/record-path, when that is set, so that a workload seen in
+// production can be replayed against another build with casparcg --replay. Each line is the milliseconds since the
+// first command and the command, separated by a tab. The clips and templates a command refers to are noted on lines
+// of their own starting with #, so that a replay can tell up front which media it needs.
+void record_amcp_command(const std::wstring&            client_address,
+                         const std::wstring&            message,
+                         const std::list<std::wstring>& tokens);
+
+}}} // namespace caspar::protocol::amcp
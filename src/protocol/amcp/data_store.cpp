@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "data_store.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/memory_governor.h>
+#include <common/os/filesystem.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/locale.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/copy.hpp>
+
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <unordered_map>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+std::wstring read_utf8_file(const boost::filesystem::path& file)
+{
+    std::wstringstream           result;
+    boost::filesystem::wifstream filestream(file);
+
+    if (filestream) {
+        // Consume BOM first
+        filestream.get();
+        // read all data
+        result << filestream.rdbuf();
+    }
+
+    return result.str();
+}
+
+std::wstring read_latin1_file(const boost::filesystem::path& file)
+{
+    boost::locale::generator gen;
+    gen.locale_cache_enabled(true);
+#if BOOST_VERSION >= 108100
+    gen.categories(boost::locale::category_t::codepage);
+#else
+    gen.categories(boost::locale::codepage_facet);
+#endif
+
+    std::stringstream           result_stream;
+    boost::filesystem::ifstream filestream(file);
+    filestream.imbue(gen("en_US.ISO8859-1"));
+
+    if (filestream) {
+        // read all data
+        result_stream << filestream.rdbuf();
+    }
+
+    std::string  result = result_stream.str();
+    std::wstring widened_result;
+
+    // The first 255 codepoints in unicode is the same as in latin1
+    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
+                std::back_inserter(widened_result));
+
+    return widened_result;
+}
+
+std::wstring read_file(const boost::filesystem::path& file)
+{
+    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
+
+    if (!boost::filesystem::exists(file)) {
+        return L"";
+    }
+
+    if (boost::filesystem::file_size(file) >= 3) {
+        boost::filesystem::ifstream bom_stream(file);
+
+        char header[3];
+        bom_stream.read(header, 3);
+        bom_stream.close();
+
+        if (std::memcmp(BOM, header, 3) == 0)
+            return read_utf8_file(file);
+    }
+
+    return read_latin1_file(file);
+}
+
+std::wstring data_file(const std::wstring& name) { return env::data_folder() + name + L".ftd"; }
+
+std::wstring data_key(const std::wstring& name)
+{
+    return boost::to_upper_copy(boost::replace_all_copy(name, L"\\", L"/"));
+}
+
+// What is on disk for a dataset, to tell when it was changed by someone else
+struct file_stamp
+{
+    std::time_t mtime = 0;
+    uintmax_t   size  = 0;
+
+    bool operator==(const file_stamp& other) const { return mtime == other.mtime && size == other.size; }
+    bool operator!=(const file_stamp& other) const { return !(*this == other); }
+};
+
+std::optional<file_stamp> stamp(const std::wstring& file)
+{
+    boost::system::error_code ec;
+    file_stamp                result;
+    result.mtime = boost::filesystem::last_write_time(file, ec);
+    if (ec) {
+        return {};
+    }
+    result.size = boost::filesystem::file_size(file, ec);
+    if (ec) {
+        return {};
+    }
+    return result;
+}
+
+} // namespace
+
+struct data_store::impl
+{
+    struct entry
+    {
+        std::wstring                        name; // As last stored, which names the file if there is none yet
+        std::shared_ptr<const std::wstring> contents;
+        std::wstring                        file; // Empty until it has been read or written
+        file_stamp                          stamp;
+        std::uint64_t                       generation = 0; // Of the contents
+        std::uint64_t                       written    = 0; // The generation on disk
+        bool                                queued     = false;
+
+        bool pending() const { return written != generation; }
+    };
+
+    std::mutex                              mutex_;
+    std::unordered_map<std::wstring, entry> entries_;
+    std::int64_t                            bytes_ = 0;
+
+    // Held while a file is written or removed, so that a remove is never overtaken by a write already under way
+    std::mutex file_mutex_;
+
+    caspar::executor executor_{L"data_store"};
+
+    // Declared last, so that the governor stops calling it before the rest is destroyed
+    memory_account account_{"amcp-data",
+                            memory_reclaim::cache,
+                            [this] {
+                                std::lock_guard<std::mutex> lock(mutex_);
+                                return bytes_;
+                            },
+                            [this](std::int64_t bytes) { trim(bytes); }};
+
+    ~impl() { executor_.stop_and_wait(); }
+
+    static std::int64_t size_of(const entry& entry)
+    {
+        return entry.contents ? static_cast<std::int64_t>(entry.contents->size() * sizeof(wchar_t)) : 0;
+    }
+
+    std::shared_ptr<const std::wstring> retrieve(const std::wstring& name)
+    {
+        auto key = data_key(name);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = entries_.find(key);
+            if (it != entries_.end()) {
+                auto& entry = it->second;
+                // What is not written yet is newer than the file, otherwise the file may have been changed since
+                if (entry.pending() || stamp(entry.file) == entry.stamp) {
+                    return entry.contents;
+                }
+                bytes_ -= size_of(entry);
+                entries_.erase(it);
+            }
+        }
+
+        auto file = find_case_insensitive(data_file(name));
+        if (!file) {
+            return nullptr;
+        }
+
+        // Stamped before it is read, so that a change while reading is caught by the next retrieve
+        auto on_disk  = stamp(*file);
+        auto contents = read_file(boost::filesystem::path(*file));
+        if (!on_disk || contents.empty()) {
+            return nullptr;
+        }
+
+        auto result = std::make_shared<const std::wstring>(std::move(contents));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Unless it was stored while it was read
+        if (entries_.find(key) == entries_.end()) {
+            entry entry;
+            entry.name     = name;
+            entry.contents = result;
+            entry.file     = *file;
+            entry.stamp    = *on_disk;
+            bytes_ += size_of(entry);
+            entries_.emplace(std::move(key), std::move(entry));
+        }
+        return result;
+    }
+
+    void store(const std::wstring& name, std::wstring contents)
+    {
+        auto key = data_key(name);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto&                       entry = entries_[key];
+        bytes_ -= size_of(entry);
+        entry.name     = name;
+        entry.contents = std::make_shared<const std::wstring>(std::move(contents));
+        entry.generation += 1;
+        bytes_ += size_of(entry);
+
+        // A write that is queued writes the latest contents
+        if (!entry.queued) {
+            entry.queued = true;
+            executor_.begin_invoke([this, key] { write(key); });
+        }
+    }
+
+    void write(const std::wstring& key)
+    {
+        std::wstring                        name;
+        std::shared_ptr<const std::wstring> contents;
+        std::uint64_t                       generation;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = entries_.find(key);
+            if (it == entries_.end()) {
+                return; // Removed
+            }
+            it->second.queued = false;
+            name              = it->second.name;
+            contents          = it->second.contents;
+            generation        = it->second.generation;
+        }
+
+        std::lock_guard<std::mutex> file_lock(file_mutex_);
+
+        std::wstring filename = data_file(name);
+        try {
+            auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
+            auto found_data_path = find_case_insensitive(data_path);
+
+            if (found_data_path)
+                data_path = *found_data_path;
+
+            if (!boost::filesystem::exists(data_path))
+                boost::filesystem::create_directories(data_path);
+
+            auto found_filename = find_case_insensitive(filename);
+
+            if (found_filename)
+                filename = *found_filename; // Overwrite case insensitive.
+
+            boost::filesystem::wofstream datafile(filename);
+            if (!datafile)
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
+
+            datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
+            datafile << *contents << std::flush;
+            datafile.close();
+        } catch (...) {
+            // Kept in memory, and written again by the next store
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return;
+        }
+
+        auto on_disk = stamp(filename);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = entries_.find(key);
+        if (it != entries_.end() && on_disk) {
+            it->second.file    = filename;
+            it->second.stamp   = *on_disk;
+            it->second.written = generation;
+        }
+    }
+
+    bool remove(const std::wstring& name)
+    {
+        bool pending = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = entries_.find(data_key(name));
+            if (it != entries_.end()) {
+                pending = it->second.pending();
+                bytes_ -= size_of(it->second);
+                entries_.erase(it);
+            }
+        }
+
+        std::lock_guard<std::mutex> file_lock(file_mutex_);
+
+        auto file = find_case_insensitive(data_file(name));
+        if (!file) {
+            return pending;
+        }
+
+        if (!boost::filesystem::remove(*file))
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(*file + L" could not be removed"));
+
+        return true;
+    }
+
+    void flush() { executor_.wait(); }
+
+    // Drops datasets that are on disk, to be read again when they are retrieved
+    void trim(std::int64_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end() && bytes > 0;) {
+            if (it->second.pending() || it->second.queued) {
+                ++it;
+                continue;
+            }
+            auto size = size_of(it->second);
+            bytes -= size;
+            bytes_ -= size;
+            it = entries_.erase(it);
+        }
+    }
+};
+
+data_store::data_store()
+    : impl_(new impl())
+{
+}
+
+data_store::~data_store() {}
+
+std::shared_ptr<const std::wstring> data_store::retrieve(const std::wstring& name) { return impl_->retrieve(name); }
+
+void data_store::store(const std::wstring& name, std::wstring contents) { impl_->store(name, std::move(contents)); }
+
+bool data_store::remove(const std::wstring& name) { return impl_->remove(name); }
+
+void data_store::flush() { impl_->flush(); }
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// The datasets of DATA STORE and DATA RETRIEVE, kept in memory and written to the data folder in the background. A
+// dataset that was read is read again when its file changes on disk, and the governor may drop those that are written
+// under memory pressure. Names are case insensitive, as the files are found case insensitively.
+class data_store
+{
+  public:
+    data_store();
+    ~data_store(); // Writes what has not been written yet
+
+    data_store(const data_store&)            = delete;
+    data_store& operator=(const data_store&) = delete;
+
+    // The contents of the dataset, null when there is none
+    std::shared_ptr<const std::wstring> retrieve(const std::wstring& name);
+
+    // Replaces the contents at once, the file is written later
+    void store(const std::wstring& name, std::wstring contents);
+
+    // False when there was no such dataset
+    bool remove(const std::wstring& name);
+
+    // Waits for the datasets stored so far to be written, such as before listing the data folder
+    void flush();
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
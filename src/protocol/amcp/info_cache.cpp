@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "info_cache.h"
+
+#include "../util/xml_writer.h"
+
+#include <core/monitor/monitor.h>
+#include <core/video_channel.h>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+// Generations of a channel that SINCE can be answered from
+const size_t max_generations = 16;
+
+// Generations start from the time the channel was first asked for, so that a generation from before a restart does
+// not match one of this run
+std::uint64_t first_generation()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+} // namespace
+
+struct info_cache::impl
+{
+    struct channel_entry
+    {
+        std::mutex                       mutex;
+        std::uint64_t                    generation = first_generation();
+        std::deque<core::monitor::state> states; // Of the last generations, the current one last
+        std::wstring                     reply;  // Of the current generation, empty until it is asked for
+    };
+
+    std::mutex                                    mutex_;
+    std::map<int, std::shared_ptr<channel_entry>> channels_;
+
+    std::shared_ptr<channel_entry> entry(int index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto&                       entry = channels_[index];
+        if (!entry) {
+            entry = std::make_shared<channel_entry>();
+        }
+        return entry;
+    }
+
+    // Called with the mutex of the entry held
+    static void update(channel_entry& entry, core::monitor::state state)
+    {
+        if (!entry.states.empty() && entry.states.back() == state) {
+            return;
+        }
+        if (!entry.states.empty()) {
+            entry.generation += 1;
+        }
+        entry.states.push_back(std::move(state));
+        if (entry.states.size() > max_generations) {
+            entry.states.pop_front();
+        }
+        entry.reply.clear();
+    }
+
+    std::wstring info(const core::video_channel& channel)
+    {
+        auto entry = this->entry(channel.index());
+        // A snapshot that shares the entries of the channel, taken before locking
+        auto state = channel.state();
+
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        update(*entry, std::move(state));
+
+        if (entry->reply.empty()) {
+            // This is needed for backwards compatibility with old clients
+            entry->reply = L"201 INFO OK\r\n";
+
+            // Written straight from the state, which for a busy channel is far quicker than building a tree of it
+            IO::write_xml(entry->reply, L"channel", entry->states.back());
+
+            entry->reply += L"\r\n";
+        }
+        return entry->reply;
+    }
+
+    std::wstring info_since(const core::video_channel& channel, std::uint64_t generation)
+    {
+        auto entry = this->entry(channel.index());
+        auto state = channel.state();
+
+        core::monitor::state changes;
+        {
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            update(*entry, std::move(state));
+
+            auto  oldest  = entry->generation + 1 - entry->states.size();
+            auto& current = entry->states.back();
+
+            changes["generation"] = entry->generation;
+            if (generation < oldest || generation > entry->generation) {
+                changes["full"]  = true;
+                changes["state"] = current;
+            } else {
+                changes["full"] = false;
+                diff(entry->states.at(generation - oldest), current, changes);
+            }
+        }
+
+        std::wstring reply = L"201 INFO OK\r\n";
+        IO::write_xml(reply, L"changes", changes);
+        reply += L"\r\n";
+        return reply;
+    }
+
+    // Adds the paths of to that are new or changed since from under state, and those that are gone under removed
+    static void diff(const core::monitor::state& from, const core::monitor::state& to, core::monitor::state& changes)
+    {
+        if (from == to) {
+            return;
+        }
+
+        core::monitor::vector_t removed;
+
+        // Both are sorted by path
+        auto lhs = from.begin();
+        auto rhs = to.begin();
+        while (lhs != from.end() || rhs != to.end()) {
+            if (rhs == to.end() || (lhs != from.end() && lhs->first < rhs->first)) {
+                removed.push_back(lhs->first);
+                ++lhs;
+            } else if (lhs == from.end() || rhs->first < lhs->first) {
+                changes["state"][rhs->first] = rhs->second;
+                ++rhs;
+            } else {
+                if (lhs->second != rhs->second) {
+                    changes["state"][rhs->first] = rhs->second;
+                }
+                ++lhs;
+                ++rhs;
+            }
+        }
+
+        if (!removed.empty()) {
+            changes["removed"] = std::move(removed);
+        }
+    }
+};
+
+info_cache::info_cache()
+    : impl_(new impl())
+{
+}
+
+info_cache::~info_cache() {}
+
+std::wstring info_cache::info(const core::video_channel& channel) { return impl_->info(channel); }
+
+std::wstring info_cache::info_since(const core::video_channel& channel, std::uint64_t generation)
+{
+    return impl_->info_since(channel, generation);
+}
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/fwd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// The replies of INFO <channel> for clients that poll it. A reply is only written again once the state of the channel
+// has changed since it was last asked for, which is counted as a new generation of the channel. The last generations
+// are kept, so that INFO <channel> SINCE <generation> can reply with what changed since one of them.
+class info_cache
+{
+  public:
+    info_cache();
+    ~info_cache();
+
+    info_cache(const info_cache&)            = delete;
+    info_cache& operator=(const info_cache&) = delete;
+
+    // The whole state, as INFO <channel> always replied
+    std::wstring info(const core::video_channel& channel);
+
+    // The generation and the paths that were changed or removed since generation, or the whole state when that is no
+    // longer kept
+    std::wstring info_since(const core::video_channel& channel, std::uint64_t generation);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
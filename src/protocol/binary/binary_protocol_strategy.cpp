@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "binary_protocol_strategy.h"
+
+#include "../amcp/AMCPProtocolStrategy.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/trim.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace binary {
+
+namespace {
+
+const std::uint32_t max_frame_size = 16 * 1024 * 1024;
+
+// The type byte and request id that follow the length of a frame
+const std::uint32_t frame_header_size = 5;
+
+std::uint32_t read_uint32(const char* data)
+{
+    auto bytes = reinterpret_cast<const unsigned char*>(data);
+    return (static_cast<std::uint32_t>(bytes[0]) << 24) | (static_cast<std::uint32_t>(bytes[1]) << 16) |
+           (static_cast<std::uint32_t>(bytes[2]) << 8) | static_cast<std::uint32_t>(bytes[3]);
+}
+
+void append_uint32(std::string& out, std::uint32_t value)
+{
+    out += static_cast<char>((value >> 24) & 0xFF);
+    out += static_cast<char>((value >> 16) & 0xFF);
+    out += static_cast<char>((value >> 8) & 0xFF);
+    out += static_cast<char>(value & 0xFF);
+}
+
+std::string make_frame(char type, std::uint32_t request_id, const std::string& payload)
+{
+    std::string frame;
+    frame.reserve(4 + frame_header_size + payload.size());
+    append_uint32(frame, static_cast<std::uint32_t>(frame_header_size + payload.size()));
+    frame += type;
+    append_uint32(frame, request_id);
+    frame += payload;
+    return frame;
+}
+
+// Sends the replies of the AMCP strategy as frames, with the request id that was given to it by REQ
+class reply_connection : public IO::client_connection<wchar_t>
+{
+    IO::client_connection<char>::ptr client_;
+
+  public:
+    explicit reply_connection(const IO::client_connection<char>::ptr& client)
+        : client_(client)
+    {
+    }
+
+    void send(std::basic_string<wchar_t>&& data, bool skip_log) override
+    {
+        std::uint32_t request_id = 0;
+        size_t        start      = 0;
+        if (data.compare(0, 4, L"RES ") == 0) {
+            auto end = data.find(L' ', 4);
+            if (end != std::wstring::npos) {
+                request_id = static_cast<std::uint32_t>(std::wcstoul(data.c_str() + 4, nullptr, 10));
+                start      = end + 1;
+            }
+        }
+
+        client_->send(make_frame('R', request_id, u8(data.substr(start))), true);
+
+        if (!skip_log) {
+            CASPAR_LOG(debug) << L"Sent reply " << request_id << L" to " << client_->address();
+        }
+    }
+
+    void disconnect() override { client_->disconnect(); }
+
+    std::wstring address() const override { return client_->address(); }
+
+    void add_lifecycle_bound_object(const std::wstring& key, const std::shared_ptr<void>& lifecycle_bound) override
+    {
+        client_->add_lifecycle_bound_object(key, lifecycle_bound);
+    }
+
+    std::shared_ptr<void> remove_lifecycle_bound_object(const std::wstring& key) override
+    {
+        return client_->remove_lifecycle_bound_object(key);
+    }
+};
+
+class binary_strategy : public IO::protocol_strategy<char>
+{
+    IO::client_connection<char>::ptr    client_;
+    IO::protocol_strategy<wchar_t>::ptr amcp_;
+    std::shared_ptr<monitor_publisher>  monitor_;
+    std::shared_ptr<void>               subscription_;
+    std::string                         input_;
+
+  public:
+    binary_strategy(const IO::client_connection<char>::ptr&    client,
+                    const IO::protocol_strategy<wchar_t>::ptr& amcp,
+                    std::shared_ptr<monitor_publisher>         monitor)
+        : client_(client)
+        , amcp_(amcp)
+        , monitor_(std::move(monitor))
+    {
+    }
+
+    void parse(const std::string& data) override
+    {
+        input_ += data;
+
+        // Every complete frame is handled before the consumed input is erased once
+        size_t pos = 0;
+        while (input_.size() - pos >= 4) {
+            auto length = read_uint32(input_.data() + pos);
+            if (length < frame_header_size || length > max_frame_size) {
+                CASPAR_LOG(error) << L"Invalid frame of " << length << L" bytes from " << client_->address();
+                input_.clear();
+                client_->disconnect();
+                return;
+            }
+
+            if (input_.size() - pos - 4 < length) {
+                break;
+            }
+
+            auto frame = input_.data() + pos + 4;
+            handle(frame[0], read_uint32(frame + 1), std::string(frame + 5, length - frame_header_size));
+            pos += 4 + length;
+        }
+
+        input_.erase(0, pos);
+    }
+
+  private:
+    void handle(char type, std::uint32_t request_id, const std::string& payload)
+    {
+        switch (type) {
+            case 'C':
+                execute(request_id, payload);
+                break;
+            case 'S':
+                subscribe();
+                client_->send(make_frame('R', request_id, "202 SUBSCRIBE OK\r\n"), true);
+                break;
+            case 'U':
+                subscription_.reset();
+                client_->send(make_frame('R', request_id, "202 UNSUBSCRIBE OK\r\n"), true);
+                break;
+            default:
+                client_->send(make_frame('R', request_id, "400 ERROR\r\n"), true);
+                break;
+        }
+    }
+
+    void execute(std::uint32_t request_id, const std::string& payload)
+    {
+        std::vector<std::wstring> commands;
+
+        auto text = u16(payload);
+        for (size_t pos = 0; pos < text.size();) {
+            auto end = text.find(L'\n', pos);
+            if (end == std::wstring::npos) {
+                end = text.size();
+            }
+
+            auto command = boost::trim_copy(text.substr(pos, end - pos));
+            if (!command.empty()) {
+                commands.push_back(std::move(command));
+            }
+            pos = end + 1;
+        }
+
+        if (commands.empty()) {
+            client_->send(make_frame('R', request_id, "400 ERROR\r\n"), true);
+            return;
+        }
+
+        // The commands go through the AMCP strategy with the request id, which its replies are framed by
+        auto req = L"REQ " + std::to_wstring(request_id) + L" ";
+
+        std::wstring message;
+        if (commands.size() == 1) {
+            message = req + commands.front() + L"\r\n";
+        } else {
+            message = req + L"BEGIN\r\n";
+            for (auto& command : commands) {
+                message += req + command + L"\r\n";
+            }
+            message += req + L"COMMIT\r\n";
+        }
+
+        amcp_->parse(message);
+    }
+
+    void subscribe()
+    {
+        if (subscription_ || !monitor_) {
+            return;
+        }
+
+        auto client   = client_;
+        subscription_ = monitor_->subscribe(
+            [client](const std::string& delta) { client->send(make_frame('M', 0, delta), true); });
+    }
+};
+
+class binary_strategy_factory : public IO::protocol_strategy_factory<char>
+{
+    IO::protocol_strategy_factory<wchar_t>::ptr amcp_factory_;
+    std::shared_ptr<monitor_publisher>          monitor_;
+
+  public:
+    binary_strategy_factory(const IO::protocol_strategy_factory<wchar_t>::ptr& amcp_factory,
+                            std::shared_ptr<monitor_publisher>                 monitor)
+        : amcp_factory_(amcp_factory)
+        , monitor_(std::move(monitor))
+    {
+    }
+
+    IO::protocol_strategy<char>::ptr create(const IO::client_connection<char>::ptr& client_connection) override
+    {
+        auto amcp = amcp_factory_->create(spl::make_shared<reply_connection>(client_connection));
+        return spl::make_shared<binary_strategy>(client_connection, amcp, monitor_);
+    }
+};
+
+} // namespace
+
+IO::protocol_strategy_factory<char>::ptr
+create_binary_strategy_factory(const std::wstring&                                   name,
+                               const spl::shared_ptr<amcp::amcp_command_repository>& repo,
+                               const std::shared_ptr<monitor_publisher>&             monitor)
+{
+    return spl::make_shared<binary_strategy_factory>(amcp::create_wchar_amcp_strategy_factory(name, repo), monitor);
+}
+
+}}} // namespace caspar::protocol::binary
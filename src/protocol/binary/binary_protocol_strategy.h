@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../amcp/amcp_command_repository.h"
+#include "../util/protocol_strategy.h"
+#include "monitor_publisher.h"
+
+#include <common/memory.h>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace binary {
+
+/**
+ * Creates the strategy of the BINARY protocol, which carries AMCP commands in length prefixed frames so that a client
+ * can pipeline them, batch them, and receive monitor state without parsing lines.
+ *
+ * Each frame is a 32 bit big endian length of what follows it, a type byte, a 32 bit big endian request id and a UTF-8
+ * payload. A client sends:
+ *
+ *   'C' One or more AMCP commands, separated by line breaks and without REQ. A single command runs as it would over
+ *       AMCP. Several commands run as a batch, as between BEGIN and COMMIT, so that e.g. the MIXER transforms of many
+ *       layers apply on the same frame.
+ *   'S' Starts sending monitor state.
+ *   'U' Stops sending monitor state.
+ *
+ * The server sends:
+ *
+ *   'R' A reply, with the request id of the frame it replies to. A batch gets the replies of its commands followed by
+ *       that of its COMMIT.
+ *   'M' The paths of the monitor state that changed since the previous frame of a channel, with a request id of 0.
+ *       Each line is a path followed by its values, or a removed path as -<path>.
+ */
+IO::protocol_strategy_factory<char>::ptr
+create_binary_strategy_factory(const std::wstring&                                   name,
+                               const spl::shared_ptr<amcp::amcp_command_repository>& repo,
+                               const std::shared_ptr<monitor_publisher>&             monitor);
+
+}}} // namespace caspar::protocol::binary
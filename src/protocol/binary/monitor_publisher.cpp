@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "monitor_publisher.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace binary {
+
+namespace {
+
+void append_quoted(std::string& out, const std::string& value)
+{
+    out += '"';
+    for (auto c : value) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            default:
+                out += c;
+                break;
+        }
+    }
+    out += '"';
+}
+
+struct value_writer : public boost::static_visitor<void>
+{
+    std::string& out;
+
+    explicit value_writer(std::string& out)
+        : out(out)
+    {
+    }
+
+    void operator()(bool value) const { out += value ? "true" : "false"; }
+    void operator()(const std::string& value) const { append_quoted(out, value); }
+    void operator()(const std::wstring& value) const { append_quoted(out, u8(value)); }
+
+    template <typename T>
+    void operator()(T value) const
+    {
+        out += boost::lexical_cast<std::string>(value);
+    }
+};
+
+void append_entry(std::string& out, const core::monitor::data_map_t::value_type& entry)
+{
+    out += entry.first;
+    for (auto& value : entry.second) {
+        out += ' ';
+        boost::apply_visitor(value_writer(out), value);
+    }
+    out += '\n';
+}
+
+// Both states are sorted by path, so they are compared in a single pass
+std::string make_delta(const core::monitor::state& previous, const core::monitor::state& state)
+{
+    std::string delta;
+
+    auto prev = previous.begin();
+    auto next = state.begin();
+    while (prev != previous.end() || next != state.end()) {
+        if (next == state.end() || (prev != previous.end() && prev->first < next->first)) {
+            delta += '-';
+            delta += prev->first;
+            delta += '\n';
+            ++prev;
+        } else if (prev == previous.end() || next->first < prev->first) {
+            append_entry(delta, *next);
+            ++next;
+        } else {
+            if (prev->second != next->second) {
+                append_entry(delta, *next);
+            }
+            ++prev;
+            ++next;
+        }
+    }
+
+    return delta;
+}
+
+struct subscriber
+{
+    std::function<void(const std::string&)> sink;
+    std::set<int>                            channels; // Those whose whole state has been sent
+};
+
+} // namespace
+
+struct monitor_publisher::impl
+{
+    std::mutex                               mutex_;
+    std::map<int, core::monitor::state>      previous_;
+    std::vector<std::shared_ptr<subscriber>> subscribers_;
+};
+
+monitor_publisher::monitor_publisher()
+    : impl_(std::make_shared<impl>())
+{
+}
+
+monitor_publisher::~monitor_publisher() {}
+
+void monitor_publisher::send(int channel, const core::monitor::state& state)
+{
+    core::monitor::state                     previous;
+    std::vector<std::shared_ptr<subscriber>> synced;
+    std::vector<std::shared_ptr<subscriber>> fresh;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        if (impl_->subscribers_.empty()) {
+            impl_->previous_.clear();
+            return;
+        }
+
+        previous                  = std::move(impl_->previous_[channel]);
+        impl_->previous_[channel] = state;
+
+        for (auto& sub : impl_->subscribers_) {
+            if (sub->channels.insert(channel).second) {
+                fresh.push_back(sub);
+            } else {
+                synced.push_back(sub);
+            }
+        }
+    }
+
+    try {
+        if (!synced.empty()) {
+            auto delta = make_delta(previous, state);
+            if (!delta.empty()) {
+                for (auto& sub : synced) {
+                    sub->sink(delta);
+                }
+            }
+        }
+
+        if (!fresh.empty()) {
+            auto whole = make_delta(core::monitor::state(), state);
+            for (auto& sub : fresh) {
+                sub->sink(whole);
+            }
+        }
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+}
+
+std::shared_ptr<void> monitor_publisher::subscribe(std::function<void(const std::string& delta)> sink)
+{
+    auto sub  = std::make_shared<subscriber>();
+    sub->sink = std::move(sink);
+
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex_);
+        impl_->subscribers_.push_back(sub);
+    }
+
+    std::weak_ptr<impl> weak_impl = impl_;
+    return std::shared_ptr<void>(nullptr, [weak_impl, sub](void*) {
+        auto impl = weak_impl.lock();
+        if (!impl) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(impl->mutex_);
+        impl->subscribers_.erase(std::remove(impl->subscribers_.begin(), impl->subscribers_.end(), sub),
+                                 impl->subscribers_.end());
+    });
+}
+
+}}} // namespace caspar::protocol::binary
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace binary {
+
+// Sends what changed in the monitor state of each channel since its previous frame to the subscribers. The state is
+// only kept and compared while there are subscribers.
+class monitor_publisher
+{
+  public:
+    monitor_publisher();
+    ~monitor_publisher();
+
+    monitor_publisher(const monitor_publisher&)            = delete;
+    monitor_publisher& operator=(const monitor_publisher&) = delete;
+
+    // Called with the state of a channel on each of its frames. Paths are those of the OSC messages, e.g.
+    // /channel/1/stage/layer/10/foreground/file/time.
+    void send(int channel, const core::monitor::state& state);
+
+    // Calls sink with a line for each changed path: the path followed by its values, or a removed path as -<path>. The
+    // first call after subscribing has the whole state of a channel. The subscription lasts as long as the token.
+    std::shared_ptr<void> subscribe(std::function<void(const std::string& delta)> sink);
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::binary
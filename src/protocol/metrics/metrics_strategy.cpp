@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "metrics_strategy.h"
+
+#include <core/diagnostics/metrics.h>
+
+#include <common/log.h>
+
+#include <sstream>
+#include <string>
+
+namespace caspar { namespace protocol { namespace metrics {
+
+namespace {
+
+// Requests larger than this are not from a scraper
+const size_t max_request_size = 64 * 1024;
+
+std::string make_response(const std::string& status, const std::string& content_type, const std::string& body)
+{
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n";
+    response << "Content-Type: " << content_type << "\r\n";
+    response << "Content-Length: " << body.size() << "\r\n";
+    response << "\r\n";
+    response << body;
+    return response.str();
+}
+
+class metrics_strategy : public IO::protocol_strategy<char>
+{
+    IO::client_connection<char>::ptr client_;
+    std::string                      input_;
+
+  public:
+    explicit metrics_strategy(const IO::client_connection<char>::ptr& client)
+        : client_(client)
+    {
+    }
+
+    void parse(const std::string& data) override
+    {
+        input_ += data;
+
+        // Scrapers send GET requests, so a request ends with its header
+        for (auto end = input_.find("\r\n\r\n"); end != std::string::npos; end = input_.find("\r\n\r\n")) {
+            auto request_line = input_.substr(0, input_.find("\r\n"));
+            input_.erase(0, end + 4);
+            handle(request_line);
+        }
+
+        if (input_.size() > max_request_size) {
+            CASPAR_LOG(warning) << L"Invalid metrics request from " << client_->address();
+            input_.clear();
+            client_->disconnect();
+        }
+    }
+
+  private:
+    void handle(const std::string& request_line)
+    {
+        std::istringstream stream(request_line);
+        std::string        method;
+        std::string        target;
+        stream >> method >> target;
+
+        auto path = target.substr(0, target.find('?'));
+
+        if (method != "GET" && method != "HEAD") {
+            client_->send(make_response("405 Method Not Allowed", "text/plain", "Method Not Allowed\n"), true);
+        } else if (path != "/metrics") {
+            client_->send(make_response("404 Not Found", "text/plain", "Not Found\n"), true);
+        } else {
+            auto response = make_response(
+                "200 OK", "text/plain; version=0.0.4; charset=utf-8", core::diagnostics::metrics::scrape());
+            if (method == "HEAD") {
+                response.erase(response.find("\r\n\r\n") + 4);
+            }
+            client_->send(std::move(response), true);
+        }
+    }
+};
+
+class metrics_strategy_factory : public IO::protocol_strategy_factory<char>
+{
+    std::shared_ptr<void> recording_ = core::diagnostics::metrics::start();
+
+  public:
+    IO::protocol_strategy<char>::ptr create(const IO::client_connection<char>::ptr& client_connection) override
+    {
+        return spl::make_shared<metrics_strategy>(client_connection);
+    }
+};
+
+} // namespace
+
+IO::protocol_strategy_factory<char>::ptr create_metrics_strategy_factory()
+{
+    return spl::make_shared<metrics_strategy_factory>();
+}
+
+}}} // namespace caspar::protocol::metrics
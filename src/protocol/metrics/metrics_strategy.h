@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../util/protocol_strategy.h"
+
+namespace caspar { namespace protocol { namespace metrics {
+
+// Creates the strategy of the METRICS protocol, which answers HTTP GET /metrics with the metrics of the diagnostics
+// graphs in the Prometheus text format. Connections are kept alive between requests.
+IO::protocol_strategy_factory<char>::ptr create_metrics_strategy_factory();
+
+}}} // namespace caspar::protocol::metrics
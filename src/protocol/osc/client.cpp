@@ -27,17 +27,30 @@
 #include "oscpack/OscOutboundPacketStream.h"
 
 #include <common/endian.h>
+#include <common/env.h>
+#include <common/timer.h>
 #include <common/utf.h>
 
 #include <core/monitor/monitor.h>
 
 #include <boost/asio.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
+#include <cerrno>
 #include <condition_variable>
+#include <map>
 #include <mutex>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
 using namespace boost::asio::ip;
 
 namespace caspar { namespace protocol { namespace osc {
@@ -63,110 +76,422 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o << u8(value).c_str(); }
 };
 
+// Matches * and ? within a single segment of a path
+bool match_segment(std::string_view pattern, std::string_view text)
+{
+    size_t p = 0, t = 0, star = std::string_view::npos, resume = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star   = p++;
+            resume = t;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            t = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+std::vector<std::string_view> split_path(std::string_view path)
+{
+    std::vector<std::string_view> segments;
+    for (size_t pos = 0;;) {
+        auto end = path.find('/', pos);
+        segments.push_back(path.substr(pos, end == std::string_view::npos ? end : end - pos));
+        if (end == std::string_view::npos) {
+            return segments;
+        }
+        pos = end + 1;
+    }
+}
+
+// OSC address patterns that are split into their segments once. As the same paths come with every frame, whether a
+// path matches is only worked out the first time it is seen.
+class address_filter
+{
+    struct pattern
+    {
+        std::string                   text;
+        std::vector<std::string_view> segments;
+        std::vector<bool>             literal;
+    };
+
+    std::vector<pattern>                  patterns_;
+    std::unordered_map<std::string, bool> matches_;
+
+  public:
+    explicit address_filter(const std::vector<std::string>& patterns)
+        : patterns_(patterns.size())
+    {
+        for (size_t n = 0; n < patterns.size(); ++n) {
+            // The segments view the text, which therefore must not move again
+            patterns_[n].text     = patterns[n];
+            patterns_[n].segments = split_path(patterns_[n].text);
+            for (auto segment : patterns_[n].segments) {
+                patterns_[n].literal.push_back(segment.find_first_of("*?") == std::string_view::npos);
+            }
+        }
+    }
+
+    address_filter(const address_filter&)            = delete;
+    address_filter& operator=(const address_filter&) = delete;
+
+    bool empty() const { return patterns_.empty(); }
+
+    bool matches(const std::string& path)
+    {
+        if (patterns_.empty()) {
+            return true;
+        }
+
+        auto it = matches_.find(path);
+        if (it != matches_.end()) {
+            return it->second;
+        }
+
+        // The state of producers that come and go may name many paths over time
+        if (matches_.size() > 100000) {
+            matches_.clear();
+        }
+
+        auto segments = split_path(path);
+        auto result   = std::any_of(patterns_.begin(), patterns_.end(), [&](const pattern& p) {
+            if (p.segments.size() != segments.size()) {
+                return false;
+            }
+            for (size_t n = 0; n < segments.size(); ++n) {
+                if (p.literal[n] ? p.segments[n] != segments[n] : !match_segment(p.segments[n], segments[n])) {
+                    return false;
+                }
+            }
+            return true;
+        });
+
+        matches_.emplace(path, result);
+        return result;
+    }
+};
+
+using entry_t = std::pair<const std::string*, const core::monitor::vector_t*>;
+
 struct client::impl : public spl::enable_shared_from_this<client::impl>
 {
+    // The subscribers with the same options, which are sent the same messages
+    struct stream
+    {
+        const subscription_options   options;
+        std::map<udp::endpoint, int> reference_counts_by_endpoint; // Guarded by mutex_
+        bool                         snapshot = true;              // Guarded by mutex_
+
+        // Only used on thread_
+        address_filter                                 filter;
+        std::map<std::string, core::monitor::vector_t> sent;    // The values last sent for each path
+        std::map<std::string, core::monitor::vector_t> pending; // The latest values while the rate is limited
+        caspar::timer                                  snapshot_timer;
+        caspar::timer                                  send_timer;
+
+        explicit stream(subscription_options opts)
+            : options(std::move(opts))
+            , filter(options.patterns)
+        {
+        }
+    };
+
     std::shared_ptr<boost::asio::io_context> service_;
     udp::socket                              socket_;
-    std::map<udp::endpoint, int>             reference_counts_by_endpoint_;
     std::vector<char>                        buffer_;
 
-    std::mutex              mutex_;
-    std::condition_variable cond_;
-    core::monitor::state    bundle_;
-    uint64_t                bundle_time_ = 0;
+    // The bundles of a send, as offset and size in packet_data_, only used on thread_
+    const size_t                           max_packet_size_;
+    std::vector<char>                      packet_data_;
+    std::vector<std::pair<size_t, size_t>> packets_;
+#ifdef __linux__
+    std::vector<iovec>   iovecs_;
+    std::vector<mmsghdr> headers_;
+#endif
+
+    // Seconds between sending the whole state, for endpoints that missed a change. Only changed paths are sent
+    // in between.
+    const double snapshot_interval_;
+
+    std::mutex                           mutex_;
+    std::condition_variable              cond_;
+    std::vector<core::monitor::state>    bundles_;
+    std::vector<std::shared_ptr<stream>> streams_;
+    bool                                 snapshot_ = false;
 
     uint64_t time_ = 0;
 
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
 
+    // States that are queued beyond this are dropped, and the whole state is sent once the thread has caught up
+    static const size_t max_bundles = 64;
+
   public:
     impl(std::shared_ptr<boost::asio::io_service> service)
         : service_(std::move(service))
         , socket_(*service_, udp::v4())
         , buffer_(1000000)
+        // Without the IPv4 and UDP headers
+        , max_packet_size_(std::max(576, env::properties().get(L"configuration.osc.mtu", 1500)) - 28)
+        , snapshot_interval_(env::properties().get(L"configuration.osc.snapshot-interval", 1.0))
     {
         thread_ = std::thread([=] {
             try {
                 while (!abort_request_) {
-                    core::monitor::state       bundle;
-                    uint64_t                   bundle_time;
-                    std::vector<udp::endpoint> endpoints;
+                    struct stream_endpoints
+                    {
+                        std::shared_ptr<stream>    target;
+                        std::vector<udp::endpoint> endpoints;
+                        bool                       snapshot;
+                    };
+
+                    std::vector<core::monitor::state> bundles;
+                    uint64_t                          bundle_time;
+                    std::vector<stream_endpoints>     streams;
 
                     {
                         std::unique_lock<std::mutex> lock(mutex_);
-                        cond_.wait(lock, [&] { return bundle_time_ > 0 || abort_request_; });
+                        cond_.wait(lock, [&] { return !bundles_.empty() || abort_request_; });
 
                         if (abort_request_) {
                             return;
                         }
 
-                        bundle       = std::move(bundle_);
-                        bundle_time  = bundle_time_;
-                        bundle_time_ = 0;
+                        bundles     = std::move(bundles_);
+                        bundle_time = time_;
+                        bundles_.clear();
 
-                        for (auto& p : reference_counts_by_endpoint_) {
-                            endpoints.push_back(p.first);
+                        for (auto& s : streams_) {
+                            stream_endpoints entry{s, {}, s->snapshot || snapshot_};
+                            for (auto& p : s->reference_counts_by_endpoint) {
+                                entry.endpoints.push_back(p.first);
+                            }
+                            s->snapshot = false;
+                            streams.push_back(std::move(entry));
                         }
+                        snapshot_ = false;
                     }
 
-                    if (endpoints.empty()) {
-                        continue;
+                    for (auto& s : streams) {
+                        send_stream(*s.target, bundles, bundle_time, s.endpoints, s.snapshot);
+                    }
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        abort_request_ = true;
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void send_stream(stream&                                  s,
+                     const std::vector<core::monitor::state>& bundles,
+                     uint64_t                                 bundle_time,
+                     const std::vector<udp::endpoint>&        endpoints,
+                     bool                                     snapshot)
+    {
+        if (snapshot || snapshot_interval_ <= 0.0 || s.snapshot_timer.elapsed() >= snapshot_interval_) {
+            s.sent.clear();
+            s.snapshot_timer.restart();
+        }
+
+        std::vector<entry_t> changed;
+
+        if (s.options.max_rate <= 0.0) {
+            for (auto& bundle : bundles) {
+                changed.clear();
+                for (auto& entry : bundle) {
+                    if (s.filter.matches(entry.first) && update(s.sent, entry.first, entry.second)) {
+                        changed.emplace_back(&entry.first, &entry.second);
                     }
+                }
+                send_entries(changed, bundle_time, endpoints);
+            }
+            return;
+        }
+
+        for (auto& bundle : bundles) {
+            for (auto& entry : bundle) {
+                if (s.filter.matches(entry.first)) {
+                    s.pending[entry.first] = entry.second;
+                }
+            }
+        }
+
+        if (s.send_timer.elapsed() < 1.0 / s.options.max_rate) {
+            return;
+        }
+        s.send_timer.restart();
+
+        for (auto& entry : s.pending) {
+            if (update(s.sent, entry.first, entry.second)) {
+                changed.emplace_back(&entry.first, &entry.second);
+            }
+        }
+        send_entries(changed, bundle_time, endpoints);
+        s.pending.clear();
+    }
 
-                    auto it = std::begin(bundle);
+    // Records the value that is sent for a path, and whether it differs from the one sent before
+    static bool update(std::map<std::string, core::monitor::vector_t>& sent,
+                       const std::string&                              path,
+                       const core::monitor::vector_t&                  value)
+    {
+        auto it = sent.lower_bound(path);
+        if (it == sent.end() || it->first != path) {
+            sent.emplace_hint(it, path, value);
+            return true;
+        }
+        if (it->second != value) {
+            it->second = value;
+            return true;
+        }
+        return false;
+    }
 
-                    while (it != std::end(bundle)) {
-                        ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
-                                                      static_cast<unsigned long>(buffer_.size()));
+    // Serializes each message once, packs them into bundles that fit in a datagram of the MTU without being fragmented,
+    // and sends every bundle to every endpoint.
+    void send_entries(const std::vector<entry_t>&       entries,
+                      uint64_t                          bundle_time,
+                      const std::vector<udp::endpoint>& endpoints)
+    {
+        if (entries.empty() || endpoints.empty()) {
+            return;
+        }
 
-                        o << ::osc::BeginBundle(bundle_time);
+        packet_data_.clear();
+        packets_.clear();
 
-                        // TODO (fix): < 2048 is a hack. Properly calculate if messages will fit.
-                        while (it != std::end(bundle) && o.Size() < 2048) {
-                            o << ::osc::BeginMessage(it->first.c_str());
+        size_t packet_start = 0;
+        bool   packet_open  = false;
 
-                            param_visitor<decltype(o)> param_visitor(o);
-                            for (const auto& element : it->second) {
-                                boost::apply_visitor(param_visitor, element);
-                            }
+        for (auto& entry : entries) {
+            ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
+                                          static_cast<unsigned long>(buffer_.size()));
 
-                            o << ::osc::EndMessage;
+            o << ::osc::BeginMessage(entry.first->c_str());
 
-                            ++it;
-                        }
+            param_visitor<decltype(o)> param_visitor(o);
+            for (const auto& element : *entry.second) {
+                boost::apply_visitor(param_visitor, element);
+            }
 
-                        o << ::osc::EndBundle;
+            o << ::osc::EndMessage;
 
-                        boost::system::error_code ec;
-                        for (const auto& endpoint : endpoints) {
-                            socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
-                        }
-                    }
-                }
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+            // A message that doesn't fit with others is sent in a bundle of its own
+            auto element_size = 4 + static_cast<size_t>(o.Size());
+            if (packet_open && packet_data_.size() - packet_start + element_size > max_packet_size_) {
+                packets_.emplace_back(packet_start, packet_data_.size() - packet_start);
+                packet_open = false;
             }
-        });
+
+            if (!packet_open) {
+                packet_start = packet_data_.size();
+                packet_open  = true;
+                packet_data_.insert(packet_data_.end(), "#bundle", "#bundle" + 8);
+                append_big_endian(packet_data_, bundle_time, 8);
+            }
+
+            append_big_endian(packet_data_, o.Size(), 4);
+            packet_data_.insert(packet_data_.end(), o.Data(), o.Data() + o.Size());
+        }
+
+        if (packet_open) {
+            packets_.emplace_back(packet_start, packet_data_.size() - packet_start);
+        }
+
+        send_packets(endpoints);
     }
 
-    ~impl()
+    static void append_big_endian(std::vector<char>& out, uint64_t value, int size)
     {
-        abort_request_ = true;
-        cond_.notify_all();
-        thread_.join();
+        for (int shift = (size - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>((value >> shift) & 0xFF));
+        }
+    }
+
+    void send_packets(const std::vector<udp::endpoint>& endpoints)
+    {
+#ifdef __linux__
+        // A single system call sends every packet to every endpoint
+        iovecs_.resize(packets_.size());
+        for (size_t n = 0; n < packets_.size(); ++n) {
+            iovecs_[n].iov_base = packet_data_.data() + packets_[n].first;
+            iovecs_[n].iov_len  = packets_[n].second;
+        }
+
+        headers_.clear();
+        for (auto& endpoint : endpoints) {
+            for (auto& iov : iovecs_) {
+                mmsghdr header{};
+                header.msg_hdr.msg_name    = const_cast<sockaddr*>(endpoint.data());
+                header.msg_hdr.msg_namelen = static_cast<socklen_t>(endpoint.size());
+                header.msg_hdr.msg_iov     = &iov;
+                header.msg_hdr.msg_iovlen  = 1;
+                headers_.push_back(header);
+            }
+        }
+
+        size_t sent = 0;
+        while (sent < headers_.size()) {
+            auto count = ::sendmmsg(socket_.native_handle(),
+                                    headers_.data() + sent,
+                                    static_cast<unsigned int>(headers_.size() - sent),
+                                    0);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // As with send_to, a failed datagram is dropped rather than retried
+                ++sent;
+                continue;
+            }
+            sent += count;
+        }
+#else
+        boost::system::error_code ec;
+        for (const auto& endpoint : endpoints) {
+            for (auto& packet : packets_) {
+                socket_.send_to(
+                    boost::asio::buffer(packet_data_.data() + packet.first, packet.second), endpoint, 0, ec);
+            }
+        }
+#endif
     }
 
     // TODO (refactor) This is weird...
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription_options&           options)
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
-        ++reference_counts_by_endpoint_[endpoint];
+        auto it = std::find_if(
+            streams_.begin(), streams_.end(), [&](const std::shared_ptr<stream>& s) { return s->options == options; });
+        auto s = it != streams_.end() ? *it : streams_.emplace_back(std::make_shared<stream>(options));
+
+        // A new endpoint has none of the state, so the whole of it is sent next
+        if (++s->reference_counts_by_endpoint[endpoint] == 1) {
+            s->snapshot = true;
+        }
 
         std::weak_ptr<impl> weak_self = shared_from_this();
 
-        return std::shared_ptr<void>(nullptr, [weak_self, endpoint](void*) {
+        return std::shared_ptr<void>(nullptr, [weak_self, endpoint, s](void*) {
             auto strong = weak_self.lock();
 
             if (!strong)
@@ -176,10 +501,14 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
 
             std::lock_guard<std::mutex> lock(self.mutex_);
 
-            int reference_count_after = --self.reference_counts_by_endpoint_[endpoint];
+            int reference_count_after = --s->reference_counts_by_endpoint[endpoint];
 
             if (reference_count_after == 0) {
-                self.reference_counts_by_endpoint_.erase(endpoint);
+                s->reference_counts_by_endpoint.erase(endpoint);
+            }
+
+            if (s->reference_counts_by_endpoint.empty()) {
+                self.streams_.erase(std::remove(self.streams_.begin(), self.streams_.end(), s), self.streams_.end());
             }
         });
     }
@@ -190,8 +519,13 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
             std::lock_guard<std::mutex> lock(mutex_);
 
             // TODO: time_++ is a hack. Use proper channel time.
-            bundle_time_ = time_++;
-            bundle_      = state;
+            time_++;
+
+            if (bundles_.size() >= max_bundles) {
+                bundles_.clear();
+                snapshot_ = true;
+            }
+            bundles_.push_back(state);
         }
         cond_.notify_all();
     }
@@ -215,9 +549,10 @@ client& client::operator=(client&& other)
 
 client::~client() {}
 
-std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                     const subscription_options&           options)
 {
-    return impl_->get_subscription_token(endpoint);
+    return impl_->get_subscription_token(endpoint, options);
 }
 
 void client::send(const core::monitor::state& state) { impl_->send(state); }
@@ -27,8 +27,28 @@
 #include <common/memory.h>
 #include <core/monitor/monitor.h>
 
+#include <string>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace osc {
 
+// What a subscriber is sent, and how often
+struct subscription_options
+{
+    // OSC address patterns of the paths to send, e.g. /channel/*/stage/layer/*/foreground/producer, where * and ? match
+    // within a segment. Every path is sent when empty.
+    std::vector<std::string> patterns;
+
+    // Sends per second, where the changes in between are sent together with their latest values. 0 sends on every
+    // frame.
+    double max_rate = 0.0;
+
+    bool operator==(const subscription_options& other) const
+    {
+        return patterns == other.patterns && max_rate == other.max_rate;
+    }
+};
+
 class client
 {
     client(const client&);
@@ -46,10 +66,13 @@ class client
      * previously been checked out.
      *
      * @param endpoint The UDP endpoint to send OSC messages to.
+     * @param options  The paths to send and how often. Subscribers with the
+     *                 same options share the filtering of the state.
      *
      * @return The token. It is ok for the token to outlive the client
      */
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint);
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription_options&           options = {});
 
     ~client();
 
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "control_server.h"
+
+#include "oscpack/OscReceivedElements.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <core/producer/stage.h>
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+using namespace boost::asio::ip;
+
+namespace caspar { namespace protocol { namespace osc {
+
+namespace {
+
+// Parses the leading number of path, moving path past it
+bool take_number(std::string_view& path, int& number)
+{
+    if (path.empty() || path.front() < '0' || path.front() > '9') {
+        return false;
+    }
+    number = 0;
+    while (!path.empty() && path.front() >= '0' && path.front() <= '9') {
+        number = number * 10 + (path.front() - '0');
+        path.remove_prefix(1);
+    }
+    return true;
+}
+
+bool take_prefix(std::string_view& path, std::string_view prefix)
+{
+    if (path.substr(0, prefix.size()) != prefix) {
+        return false;
+    }
+    path.remove_prefix(prefix.size());
+    return true;
+}
+
+// The number of values and the property of an address such as /channel/1/layer/10/fill
+bool parse_address(std::string_view path, int& channel, int& layer, core::layer_control& property, size_t& count)
+{
+    if (!take_prefix(path, "/channel/") || !take_number(path, channel) || !take_prefix(path, "/layer/") ||
+        !take_number(path, layer) || !take_prefix(path, "/")) {
+        return false;
+    }
+
+    if (path == "fill") {
+        property = core::layer_control::fill;
+        count    = 4;
+    } else if (path == "anchor") {
+        property = core::layer_control::anchor;
+        count    = 2;
+    } else if (path == "rotation") {
+        property = core::layer_control::rotation;
+        count    = 1;
+    } else if (path == "opacity") {
+        property = core::layer_control::opacity;
+        count    = 1;
+    } else if (path == "volume") {
+        property = core::layer_control::volume;
+        count    = 1;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+struct control_server::impl
+{
+    const std::vector<std::shared_ptr<core::stage>> stages_;
+
+    boost::asio::io_service service_;
+    udp::socket             socket_;
+    udp::endpoint           sender_;
+    std::array<char, 65536> buffer_;
+    std::thread             thread_;
+
+    impl(unsigned short port, std::vector<std::shared_ptr<core::stage>> stages)
+        : stages_(std::move(stages))
+        , socket_(service_, udp::endpoint(udp::v4(), port))
+    {
+        receive();
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[osc::control_server]");
+            service_.run();
+        });
+
+        CASPAR_LOG(info) << L"[osc::control_server] Listening on UDP port " << port << L".";
+    }
+
+    ~impl()
+    {
+        boost::asio::post(service_, [this] {
+            boost::system::error_code ec;
+            socket_.close(ec);
+        });
+        service_.stop();
+        thread_.join();
+    }
+
+    // The handler of each datagram is allocated once and then recycled by asio, and the datagram is parsed in place
+    void receive()
+    {
+        socket_.async_receive_from(
+            boost::asio::buffer(buffer_), sender_, [this](const boost::system::error_code& ec, std::size_t size) {
+                if (ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!ec) {
+                    try {
+                        dispatch(::osc::ReceivedPacket(buffer_.data(), static_cast<::osc::int32>(size)));
+                    } catch (...) {
+                        CASPAR_LOG(debug) << L"[osc::control_server] Ignored a malformed packet.";
+                    }
+                }
+                receive();
+            });
+    }
+
+    template <typename T>
+    void dispatch(const T& element)
+    {
+        if (element.IsBundle()) {
+            ::osc::ReceivedBundle bundle(element);
+            for (auto it = bundle.ElementsBegin(); it != bundle.ElementsEnd(); ++it) {
+                dispatch(*it);
+            }
+        } else {
+            dispatch_message(::osc::ReceivedMessage(element));
+        }
+    }
+
+    void dispatch_message(const ::osc::ReceivedMessage& message)
+    {
+        int                 channel  = 0;
+        int                 layer    = 0;
+        core::layer_control property = core::layer_control::fill;
+        size_t              count    = 0;
+        if (!parse_address(message.AddressPattern(), channel, layer, property, count)) {
+            return;
+        }
+        if (channel < 1 || channel > static_cast<int>(stages_.size()) || message.ArgumentCount() != count) {
+            return;
+        }
+
+        std::array<double, 4> values{};
+        size_t                n = 0;
+        for (auto it = message.ArgumentsBegin(); it != message.ArgumentsEnd(); ++it, ++n) {
+            if (it->IsFloat()) {
+                values[n] = it->AsFloat();
+            } else if (it->IsDouble()) {
+                values[n] = it->AsDouble();
+            } else if (it->IsInt32()) {
+                values[n] = it->AsInt32();
+            } else if (it->IsInt64()) {
+                values[n] = static_cast<double>(it->AsInt64());
+            } else {
+                return;
+            }
+        }
+
+        stages_[channel - 1]->control(layer, property, values);
+    }
+};
+
+control_server::control_server(unsigned short port, std::vector<std::shared_ptr<core::stage>> stages)
+    : impl_(new impl(port, std::move(stages)))
+{
+}
+
+control_server::~control_server() {}
+
+}}} // namespace caspar::protocol::osc
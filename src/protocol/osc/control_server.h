@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/fwd.h>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace osc {
+
+// Receives OSC messages that set a property of a layer, such as /channel/1/layer/10/fill 0.25 0.25 0.5 0.5, and hands
+// them to the stage without going through the command queue, to be applied from the next frame on, see
+// core::stage::control. The properties are fill (x, y, x-scale, y-scale), anchor (x, y), rotation (degrees), opacity
+// and volume. Bundles are applied message by message, ignoring their time tags.
+class control_server
+{
+  public:
+    // stages holds the stage of each channel, that of channel 1 first
+    control_server(unsigned short port, std::vector<std::shared_ptr<core::stage>> stages);
+    ~control_server();
+
+    control_server(const control_server&)            = delete;
+    control_server& operator=(const control_server&) = delete;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::osc
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "monitor_export.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace protocol { namespace shm {
+
+namespace {
+
+using sequence_t = std::atomic<std::uint64_t>;
+
+static_assert(sequence_t::is_always_lock_free, "The sequences must be lock free to be shared between processes");
+
+const std::uint32_t layout_version = 1;
+const std::uint32_t slot_count     = 4;
+
+const size_t header_size      = 64;
+const size_t ring_header_size = 64;
+const size_t slot_header_size = 32;
+
+const std::uint32_t truncated_flag = 1;
+
+template <typename T>
+void store(char* dest, T value)
+{
+    std::memcpy(dest, &value, sizeof(T));
+}
+
+// Writes entries to a slot, leaving out those that would not fit
+class slot_writer
+{
+    char*       pos_;
+    char* const end_;
+    bool        full_ = false;
+
+  public:
+    slot_writer(char* begin, char* end)
+        : pos_(begin)
+        , end_(end)
+    {
+    }
+
+    bool  full() const { return full_; }
+    char* pos() const { return pos_; }
+
+    bool put(const void* data, size_t size)
+    {
+        if (static_cast<size_t>(end_ - pos_) < size) {
+            full_ = true;
+            return false;
+        }
+        std::memcpy(pos_, data, size);
+        pos_ += size;
+        return true;
+    }
+
+    template <typename T>
+    bool put(char type, T value)
+    {
+        return put(&type, 1) && put(&value, sizeof(T));
+    }
+
+    bool put(const std::string& value)
+    {
+        auto size = static_cast<std::uint32_t>(value.size());
+        return put('s', size) && put(value.data(), value.size());
+    }
+
+    bool operator()(bool value)
+    {
+        char type = value ? 'T' : 'F';
+        return put(&type, 1);
+    }
+    bool operator()(std::int32_t value) { return put('i', value); }
+    bool operator()(std::int64_t value) { return put('h', value); }
+    bool operator()(std::uint32_t value) { return put('u', value); }
+    bool operator()(std::uint64_t value) { return put('U', value); }
+    bool operator()(float value) { return put('f', value); }
+    bool operator()(double value) { return put('d', value); }
+    bool operator()(const std::string& value) { return put(value); }
+    bool operator()(const std::wstring& value) { return put(u8(value)); }
+
+    bool entry(const std::string& path, const core::monitor::vector_t& values)
+    {
+        if (full_ || path.size() > 0xFFFF || values.size() > 0xFFFF) {
+            full_ = true;
+            return false;
+        }
+
+        auto start       = pos_;
+        auto path_size   = static_cast<std::uint16_t>(path.size());
+        auto value_count = static_cast<std::uint16_t>(values.size());
+        auto ok          = put(&path_size, 2) && put(&value_count, 2) && put(path.data(), path.size());
+        for (auto it = values.begin(); ok && it != values.end(); ++it) {
+            ok = boost::apply_visitor(*this, *it);
+        }
+
+        // An entry is either whole or left out
+        if (!ok) {
+            pos_ = start;
+        }
+        return ok;
+    }
+
+    using result_type = bool;
+};
+
+} // namespace
+
+struct monitor_export::impl
+{
+    const std::string name_;
+    const int         channel_count_;
+    const size_t      slot_size_;
+    const size_t      ring_size_;
+    const size_t      size_;
+    char*             data_ = nullptr;
+
+#ifdef _WIN32
+    HANDLE mapping_ = nullptr;
+#endif
+
+    impl(const std::wstring& name, int channel_count, size_t slot_size)
+        : name_(u8(name))
+        , channel_count_(channel_count)
+        , slot_size_((std::max(slot_size, slot_header_size + 64) + 63) / 64 * 64)
+        , ring_size_(ring_header_size + slot_count * slot_size_)
+        , size_(header_size + channel_count * ring_size_)
+    {
+#ifdef _WIN32
+        mapping_ = CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                      nullptr,
+                                      PAGE_READWRITE,
+                                      static_cast<DWORD>(static_cast<std::uint64_t>(size_) >> 32),
+                                      static_cast<DWORD>(size_ & 0xFFFFFFFF),
+                                      (L"Local\\" + name).c_str());
+        if (!mapping_) {
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info("Failed to create shared memory " + name_));
+        }
+        data_ = static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size_));
+        if (!data_) {
+            CloseHandle(mapping_);
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info("Failed to map shared memory " + name_));
+        }
+#else
+        // Whatever a previous instance left behind is replaced, so that readers never see a stale layout
+        auto path = "/" + name_;
+        shm_unlink(path.c_str());
+        auto fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info("Failed to create shared memory " + path));
+        }
+        if (ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+            close(fd);
+            shm_unlink(path.c_str());
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info("Failed to size shared memory " + path));
+        }
+        auto data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            shm_unlink(path.c_str());
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info("Failed to map shared memory " + path));
+        }
+        data_ = static_cast<char*>(data);
+#endif
+
+        std::memset(data_, 0, size_);
+        for (int n = 0; n < channel_count_; ++n) {
+            auto ring = data_ + header_size + n * ring_size_;
+            new (ring) sequence_t(0);
+            for (std::uint32_t slot = 0; slot < slot_count; ++slot) {
+                new (ring + ring_header_size + slot * slot_size_) sequence_t(0);
+            }
+        }
+
+        // The magic is written last, so that a reader which finds it sees the rest of the header
+        store(data_ + 8, layout_version);
+        store(data_ + 12, static_cast<std::uint32_t>(channel_count_));
+        store(data_ + 16, slot_count);
+        store(data_ + 20, static_cast<std::uint32_t>(slot_size_));
+#ifdef _WIN32
+        store(data_ + 24, static_cast<std::uint64_t>(GetCurrentProcessId()));
+#else
+        store(data_ + 24, static_cast<std::uint64_t>(getpid()));
+#endif
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(data_, "CCGMON\0\0", 8);
+
+        CASPAR_LOG(info) << L"Exporting the monitor state of " << channel_count_ << L" channels to shared memory "
+                         << name << L" (" << size_ << L" bytes)";
+    }
+
+    ~impl()
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle(mapping_);
+#else
+        munmap(data_, size_);
+        shm_unlink(("/" + name_).c_str());
+#endif
+    }
+
+    void send(int channel, const core::monitor::state& state)
+    {
+        if (channel < 1 || channel > channel_count_) {
+            return;
+        }
+
+        auto  ring  = data_ + header_size + (channel - 1) * ring_size_;
+        auto& count = *reinterpret_cast<sequence_t*>(ring);
+        auto  n     = count.load(std::memory_order_relaxed);
+
+        auto  slot     = ring + ring_header_size + (n % slot_count) * slot_size_;
+        auto& sequence = *reinterpret_cast<sequence_t*>(slot);
+        auto  seq      = sequence.load(std::memory_order_relaxed);
+
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot_writer   writer(slot + slot_header_size, slot + slot_size_);
+        std::uint32_t entries = 0;
+        for (auto& entry : state) {
+            if (!writer.entry(entry.first, entry.second)) {
+                break;
+            }
+            ++entries;
+        }
+
+        store(slot + 8, n);
+        store(slot + 16, static_cast<std::uint32_t>(channel));
+        store(slot + 20, entries);
+        store(slot + 24, static_cast<std::uint32_t>(writer.pos() - (slot + slot_header_size)));
+        store(slot + 28, writer.full() ? truncated_flag : 0);
+
+        sequence.store(seq + 2, std::memory_order_release);
+        count.store(n + 1, std::memory_order_release);
+    }
+};
+
+monitor_export::monitor_export(const std::wstring& name, int channel_count, size_t slot_size)
+    : impl_(new impl(name, channel_count, slot_size))
+{
+}
+
+monitor_export::~monitor_export() {}
+
+void monitor_export::send(int channel, const core::monitor::state& state) { impl_->send(channel, state); }
+
+}}} // namespace caspar::protocol::shm
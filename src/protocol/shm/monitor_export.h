@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace shm {
+
+/**
+ * Writes the monitor state of each channel to a named shared memory object on every frame, so that processes on the
+ * same machine can read it without a socket or a system call. The object is /<name> on POSIX (shm_open) and
+ * Local\<name> on Windows. All fields are in host byte order and unaligned values are to be read with memcpy.
+ *
+ * The object starts with a header of 64 bytes:
+ *
+ *   0  char[8]  magic "CCGMON\0\0"
+ *   8  uint32   layout version, 1
+ *   12 uint32   channel count
+ *   16 uint32   slots per channel
+ *   20 uint32   bytes per slot, including its header
+ *   24 uint64   process id of the server
+ *
+ * It is followed by the rings of the channels, in order. A ring starts with 64 bytes of which the first is a uint64
+ * count of the states written to it, followed by its slots. State n of a channel is written to slot n % slots. A slot
+ * has a header of 32 bytes followed by the entries:
+ *
+ *   0  uint64   sequence, odd while the slot is being written
+ *   8  uint64   n, the number of the state in the slot
+ *   16 uint32   channel, from 1
+ *   20 uint32   entry count
+ *   24 uint32   bytes of the entries
+ *   28 uint32   flags, 1 if entries did not fit in the slot and were left out
+ *
+ * Each entry is a uint16 size of the path, a uint16 value count, the path in UTF-8 without a terminator, e.g.
+ * /channel/1/stage/layer/10/foreground/file/time, and the values. Each value is a type byte followed by its data:
+ * 'T' and 'F' for true and false with no data, 'i' int32, 'h' int64, 'u' uint32, 'U' uint64, 'f' float, 'd' double, and
+ * 's' a uint32 size followed by a UTF-8 string.
+ *
+ * A reader loads the count of a ring with acquire semantics and reads slot (count - 1) % slots: it loads the sequence
+ * with acquire semantics, retries if it is odd, copies the slot, issues an acquire fence and retries if the sequence
+ * has since changed.
+ */
+class monitor_export
+{
+  public:
+    monitor_export(const std::wstring& name, int channel_count, size_t slot_size);
+    ~monitor_export();
+
+    monitor_export(const monitor_export&)            = delete;
+    monitor_export& operator=(const monitor_export&) = delete;
+
+    // Called from the thread of a channel on each of its frames, with the paths of the OSC messages
+    void send(int channel, const core::monitor::state& state);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::shm
@@ -25,10 +25,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 
@@ -41,8 +44,40 @@ namespace caspar { namespace IO {
 
 class connection;
 
-using connection_set = std::set<spl::shared_ptr<connection>>;
+// The connections of a server, which are accepted and stopped on different threads of the service
+class connection_set
+{
+    mutable std::mutex                    mutex_;
+    std::set<spl::shared_ptr<connection>> connections_;
+
+  public:
+    void insert(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.insert(conn);
+    }
+
+    void erase(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(conn);
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_.size();
+    }
 
+    std::set<spl::shared_ptr<connection>> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_;
+    }
+};
+
+// The service may run on several threads. The handlers of a connection run on its strand, so that they don't overlap
+// and the replies to a client keep their order.
 class connection : public spl::enable_shared_from_this<connection>
 {
     using lifecycle_map_type = tbb::concurrent_hash_map<std::wstring, std::shared_ptr<void>>;
@@ -50,7 +85,9 @@ class connection : public spl::enable_shared_from_this<connection>
 
     const spl::shared_ptr<tcp::socket>       socket_;
     std::shared_ptr<boost::asio::io_service> service_;
+    boost::asio::io_service::strand          strand_;
     const std::wstring                       listen_port_;
+    const std::wstring                       ipv4_address_;
     const spl::shared_ptr<connection_set>    connection_set_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
     std::shared_ptr<protocol_strategy<char>> protocol_;
@@ -60,6 +97,15 @@ class connection : public spl::enable_shared_from_this<connection>
     send_queue              send_queue_;
     bool                    is_writing_;
 
+    // Replies that are queued or being written, which a client that doesn't read them may not grow beyond the limit
+    const size_t        max_send_buffer_;
+    std::atomic<size_t> send_buffer_{0};
+    std::atomic<bool>   overflowed_{false};
+
+    // The replies of the write in progress, which are gathered into a single write
+    std::vector<std::string>              writing_;
+    std::vector<boost::asio::const_buffer> buffers_;
+
     class connection_holder : public client_connection<char>
     {
         std::weak_ptr<connection> connection_;
@@ -117,12 +163,13 @@ class connection : public spl::enable_shared_from_this<connection>
     static spl::shared_ptr<connection> create(std::shared_ptr<boost::asio::io_service>    service,
                                               spl::shared_ptr<tcp::socket>                socket,
                                               const protocol_strategy_factory<char>::ptr& protocol,
-                                              spl::shared_ptr<connection_set>             connection_set)
+                                              spl::shared_ptr<connection_set>             connection_set,
+                                              size_t                                      max_send_buffer)
     {
-        spl::shared_ptr<connection> con(
-            new connection(std::move(service), std::move(socket), std::move(protocol), std::move(connection_set)));
+        spl::shared_ptr<connection> con(new connection(
+            std::move(service), std::move(socket), std::move(protocol), std::move(connection_set), max_send_buffer));
         con->init();
-        con->read_some();
+        con->strand_.dispatch([con] { con->read_some(); });
         return con;
     }
 
@@ -134,22 +181,34 @@ class connection : public spl::enable_shared_from_this<connection>
 
     std::wstring address() const { return u16(socket_->local_endpoint().address().to_string()); }
 
-    std::wstring ipv4_address() const
-    {
-        return socket_->is_open() ? u16(socket_->remote_endpoint().address().to_string()) : L"no-address";
-    }
+    std::wstring ipv4_address() const { return ipv4_address_; }
 
     void send(std::string&& data)
     {
+        if (overflowed_) {
+            return;
+        }
+
+        auto size = data.size();
+        if (max_send_buffer_ > 0 && send_buffer_.fetch_add(size) + size > max_send_buffer_) {
+            // The client has stopped reading, and would otherwise grow the queue without bound
+            if (!overflowed_.exchange(true)) {
+                CASPAR_LOG(warning) << print() << L" Client " << ipv4_address() << L" has more than "
+                                    << max_send_buffer_ << L" bytes of replies pending, disconnecting.";
+                disconnect();
+            }
+            return;
+        }
+
         send_queue_.push(std::move(data));
         auto self = shared_from_this();
-        service_->dispatch([=] { self->do_write(); });
+        strand_.dispatch([=] { self->do_write(); });
     }
 
     void disconnect()
     {
         std::weak_ptr<connection> self = shared_from_this();
-        service_->dispatch([=] {
+        strand_.dispatch([=] {
             auto strong = self.lock();
 
             if (strong)
@@ -175,17 +234,24 @@ class connection : public spl::enable_shared_from_this<connection>
     }
 
   private:
-    void do_write() // always called from the asio-service-thread
+    void do_write() // always called from the strand
     {
-        if (!is_writing_) {
-            std::string data;
-            if (send_queue_.try_pop(data)) {
-                write_some(std::move(data));
-            }
+        if (is_writing_) {
+            return;
+        }
+
+        // Every reply queued by now goes out in the same write
+        std::string data;
+        while (send_queue_.try_pop(data)) {
+            writing_.push_back(std::move(data));
+        }
+
+        if (!writing_.empty()) {
+            write_some();
         }
     }
 
-    void stop() // always called from the asio-service-thread
+    void stop() // always called from the strand
     {
         connection_set_->erase(shared_from_this());
 
@@ -200,20 +266,31 @@ class connection : public spl::enable_shared_from_this<connection>
     connection(const std::shared_ptr<boost::asio::io_service>& service,
                const spl::shared_ptr<tcp::socket>&             socket,
                const protocol_strategy_factory<char>::ptr&     protocol_factory,
-               const spl::shared_ptr<connection_set>&          connection_set)
+               const spl::shared_ptr<connection_set>&          connection_set,
+               size_t                                          max_send_buffer)
         : socket_(socket)
         , service_(service)
+        , strand_(*service)
         , listen_port_(socket_->is_open() ? std::to_wstring(socket_->local_endpoint().port()) : L"no-port")
+        , ipv4_address_(remote_address(*socket))
         , connection_set_(connection_set)
         , protocol_factory_(protocol_factory)
         , is_writing_(false)
+        , max_send_buffer_(max_send_buffer)
     {
         CASPAR_LOG(info) << print() << L" Accepted connection from " << ipv4_address() << L" ("
                          << connection_set_->size() + 1 << L" connections).";
     }
 
+    static std::wstring remote_address(const tcp::socket& socket)
+    {
+        boost::system::error_code ec;
+        auto                      endpoint = socket.remote_endpoint(ec);
+        return ec ? L"no-address" : u16(endpoint.address().to_string());
+    }
+
     void handle_read(const boost::system::error_code& error,
-                     size_t                           bytes_transferred) // always called from the asio-service-thread
+                     size_t                           bytes_transferred) // always called from the strand
     {
         if (!error) {
             try {
@@ -229,42 +306,47 @@ class connection : public spl::enable_shared_from_this<connection>
             stop();
     }
 
-    void handle_write(const spl::shared_ptr<std::string>& str,
-                      const boost::system::error_code&    error,
-                      size_t bytes_transferred) // always called from the asio-service-thread
+    void handle_write(const boost::system::error_code& error,
+                      size_t /*bytes_transferred*/) // always called from the strand
     {
+        size_t written = 0;
+        for (auto& str : writing_) {
+            written += str.size();
+        }
+        send_buffer_ -= written;
+        writing_.clear();
+        buffers_.clear();
+
         if (!error) {
-            if (bytes_transferred != str->size()) {
-                str->assign(str->substr(bytes_transferred));
-                socket_->async_write_some(boost::asio::buffer(str->data(), str->size()),
-                                          std::bind(&connection::handle_write,
-                                                    shared_from_this(),
-                                                    str,
-                                                    std::placeholders::_1,
-                                                    std::placeholders::_2));
-            } else {
-                is_writing_ = false;
-                do_write();
-            }
+            is_writing_ = false;
+            do_write();
         } else if (error != boost::asio::error::operation_aborted && socket_->is_open())
             stop();
     }
 
-    void read_some() // always called from the asio-service-thread
+    void read_some() // always called from the strand
     {
-        socket_->async_read_some(
-            boost::asio::buffer(data_.data(), data_.size()),
-            std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+        socket_->async_read_some(boost::asio::buffer(data_.data(), data_.size()),
+                                 strand_.wrap(std::bind(&connection::handle_read,
+                                                        shared_from_this(),
+                                                        std::placeholders::_1,
+                                                        std::placeholders::_2)));
     }
 
-    void write_some(std::string&& data) // always called from the asio-service-thread
+    void write_some() // always called from the strand
     {
         is_writing_ = true;
-        auto str    = spl::make_shared<std::string>(std::move(data));
-        socket_->async_write_some(
-            boost::asio::buffer(str->data(), str->size()),
-            std::bind(
-                &connection::handle_write, shared_from_this(), str, std::placeholders::_1, std::placeholders::_2));
+        for (auto& str : writing_) {
+            buffers_.push_back(boost::asio::buffer(str.data(), str.size()));
+        }
+
+        // async_write completes once every buffer has been written, so partial writes need no handling here
+        boost::asio::async_write(*socket_,
+                                 buffers_,
+                                 strand_.wrap(std::bind(&connection::handle_write,
+                                                        shared_from_this(),
+                                                        std::placeholders::_1,
+                                                        std::placeholders::_2)));
     }
 
     friend struct AsyncEventServer::implementation;
@@ -277,13 +359,18 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     protocol_strategy_factory<char>::ptr     protocol_factory_;
     spl::shared_ptr<connection_set>          connection_set_;
     std::vector<lifecycle_factory_t>         lifecycle_factories_;
+    boost::asio::io_service::strand          strand_; // Accepts, and adds lifecycle factories
+    const size_t                             max_send_buffer_;
 
     implementation(std::shared_ptr<boost::asio::io_service>    service,
                    const protocol_strategy_factory<char>::ptr& protocol,
-                   unsigned short                              port)
+                   unsigned short                              port,
+                   size_t                                      max_send_buffer)
         : service_(std::move(service))
         , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
         , protocol_factory_(protocol)
+        , strand_(*service_)
+        , max_send_buffer_(max_send_buffer)
     {
     }
 
@@ -302,9 +389,8 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
         auto conns_set = connection_set_;
 
         service_->post([conns_set] {
-            auto connections = *conns_set;
-            for (auto& connection : connections)
-                connection->stop();
+            for (auto& connection : conns_set->snapshot())
+                connection->disconnect();
         });
     }
 
@@ -312,7 +398,8 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     {
         spl::shared_ptr<tcp::socket> socket(new tcp::socket(*service_));
         acceptor_.async_accept(
-            *socket, std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1));
+            *socket,
+            strand_.wrap(std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1)));
     }
 
     void handle_accept(const spl::shared_ptr<tcp::socket>& socket, const boost::system::error_code& error)
@@ -327,7 +414,7 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
             if (ec)
                 CASPAR_LOG(warning) << print() << L" Failed to enable TCP keep-alive on socket";
 
-            auto conn = connection::create(service_, socket, protocol_factory_, connection_set_);
+            auto conn = connection::create(service_, socket, protocol_factory_, connection_set_, max_send_buffer_);
             connection_set_->insert(conn);
 
             for (auto& lifecycle_factory : lifecycle_factories_) {
@@ -346,14 +433,15 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& factory)
     {
         auto self = shared_from_this();
-        service_->post([=] { self->lifecycle_factories_.push_back(factory); });
+        strand_.post([=] { self->lifecycle_factories_.push_back(factory); });
     }
 };
 
 AsyncEventServer::AsyncEventServer(std::shared_ptr<boost::asio::io_service>    service,
                                    const protocol_strategy_factory<char>::ptr& protocol,
-                                   unsigned short                              port)
-    : impl_(new implementation(std::move(service), protocol, port))
+                                   unsigned short                              port,
+                                   size_t                                      max_send_buffer)
+    : impl_(new implementation(std::move(service), protocol, port, max_send_buffer))
 {
     impl_->start_accept();
 }
@@ -36,9 +36,11 @@ using lifecycle_factory_t =
 class AsyncEventServer
 {
   public:
+    // A client with more than max_send_buffer bytes of replies pending is disconnected, unless it is 0
     explicit AsyncEventServer(std::shared_ptr<boost::asio::io_service>    service,
                               const protocol_strategy_factory<char>::ptr& protocol,
-                              unsigned short                              port);
+                              unsigned short                              port,
+                              size_t                                      max_send_buffer = 16 * 1024 * 1024);
     ~AsyncEventServer();
 
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& lifecycle_factory);
@@ -1,103 +1,450 @@
 #include "http_request.h"
 
 #include <common/except.h>
+#include <common/os/thread.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <cstdlib>
+#include <functional>
 #include <iomanip>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace caspar { namespace http {
 
-HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+namespace {
+
+using boost::asio::ip::tcp;
+
+// Connections kept alive for each server between requests
+const size_t max_idle_connections = 4;
+
+// Runs the requests on a thread of its own, so that a waiting request doesn't hold up anything but its reply
+class client
 {
-    using boost::asio::ip::tcp;
-    using namespace boost;
+    boost::asio::io_service                                          service_;
+    boost::asio::io_service::work                                    work_;
+    std::map<std::string, std::vector<std::shared_ptr<tcp::socket>>> idle_; // Only used on thread_
+    std::thread                                                      thread_;
+
+  public:
+    client()
+        : work_(service_)
+        , thread_([this] {
+            set_thread_name(L"http client");
+            service_.run();
+        })
+    {
+    }
 
-    HTTPResponse res;
+    ~client()
+    {
+        service_.stop();
+        thread_.join();
+    }
 
-    asio::io_service io_service;
+    boost::asio::io_service& service() { return service_; }
 
-    // Get a list of endpoints corresponding to the server name.
-    tcp::resolver           resolver(io_service);
-    tcp::resolver::query    query(host, port, boost::asio::ip::resolver_query_base::numeric_service);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+    std::shared_ptr<tcp::socket> take_idle(const std::string& server)
+    {
+        auto it = idle_.find(server);
+        if (it == idle_.end() || it->second.empty()) {
+            return nullptr;
+        }
 
-    // Try each endpoint until we successfully establish a connection.
-    tcp::socket               socket(io_service);
-    boost::system::error_code error;
-    asio::connect(socket, endpoint_iterator, error);
-    if (error == asio::error::connection_refused) {
-        res.status_code    = 503;
-        res.status_message = "Connection refused";
-        return res;
+        auto socket = std::move(it->second.back());
+        it->second.pop_back();
+        return socket;
     }
-    if (error) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
-    }
-
-    // Form the request. We specify the "Connection: close" header so that the
-    // server will close the socket after transmitting the response. This will
-    // allow us to treat all data up until the EOF as the content.
-    asio::streambuf request;
-    std::ostream    request_stream(&request);
-    request_stream << "GET " << path << " HTTP/1.0\r\n";
-    request_stream << "Host: " << host << ":" << port << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    request_stream << "Connection: close\r\n\r\n";
-
-    // Send the request.
-    asio::write(socket, request);
-
-    // Read the response status line. The response streambuf will automatically
-    // grow to accommodate the entire line. The growth may be limited by passing
-    // a maximum size to the streambuf constructor.
-    asio::streambuf response;
-    asio::read_until(socket, response, "\r\n");
-
-    // Check that response is OK.
-    std::istream response_stream(&response);
-    std::string  http_version;
-    response_stream >> http_version;
-    response_stream >> res.status_code;
-    std::getline(response_stream, res.status_message);
-
-    if (!response_stream || http_version.substr(0, 5) != "HTTP/") {
-        // TODO
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+
+    void put_idle(const std::string& server, std::shared_ptr<tcp::socket> socket)
+    {
+        auto& sockets = idle_[server];
+        if (sockets.size() < max_idle_connections) {
+            sockets.push_back(std::move(socket));
+        }
     }
+};
 
-    if (res.status_code < 200 || res.status_code >= 300) {
-        // TODO
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+client& get_client()
+{
+    static client instance;
+    return instance;
+}
+
+// A request and its response, which runs on the thread of the client
+class exchange : public std::enable_shared_from_this<exchange>
+{
+    client&                         client_;
+    const std::string               host_;
+    const std::string               port_;
+    const std::string               request_;
+    const std::chrono::milliseconds timeout_;
+
+    tcp::resolver                resolver_;
+    boost::asio::steady_timer    timer_;
+    std::shared_ptr<tcp::socket> socket_;
+    bool                         reused_     = false;
+    bool                         keep_alive_ = false;
+    bool                         done_       = false;
+
+    boost::asio::streambuf     buffer_;
+    HTTPResponse               response_{};
+    std::promise<HTTPResponse> promise_;
+
+  public:
+    exchange(client& client, std::string host, std::string port, std::string request, std::chrono::milliseconds timeout)
+        : client_(client)
+        , host_(std::move(host))
+        , port_(std::move(port))
+        , request_(std::move(request))
+        , timeout_(timeout)
+        , resolver_(client.service())
+        , timer_(client.service())
+    {
     }
 
-    // Read the response headers, which are terminated by a blank line.
-    asio::read_until(socket, response, "\r\n\r\n");
+    std::future<HTTPResponse> get_future() { return promise_.get_future(); }
 
-    // Process the response headers.
-    std::string header;
-    while (std::getline(response_stream, header) && header != "\r") {
-        // TODO
+    void start()
+    {
+        timer_.expires_after(timeout_);
+        timer_.async_wait([self = shared_from_this()](const boost::system::error_code& ec) {
+            if (!ec && !self->done_) {
+                self->fail("Request to " + self->host_ + ":" + self->port_ + " timed out");
+            }
+        });
+
+        socket_ = client_.take_idle(server());
+        reused_ = !!socket_;
+        if (socket_) {
+            write();
+        } else {
+            resolve();
+        }
+    }
+
+  private:
+    std::string server() const { return host_ + ":" + port_; }
+
+    void resolve()
+    {
+        tcp::resolver::query query(host_, port_, boost::asio::ip::resolver_query_base::numeric_service);
+        resolver_.async_resolve(
+            query,
+            [self = shared_from_this()](const boost::system::error_code& ec, tcp::resolver::results_type results) {
+                if (self->done_) {
+                    return;
+                }
+                if (ec) {
+                    self->fail(ec.message());
+                    return;
+                }
+
+                self->socket_ = std::make_shared<tcp::socket>(self->client_.service());
+                boost::asio::async_connect(
+                    *self->socket_, results, [self](const boost::system::error_code& ec, const tcp::endpoint&) {
+                        if (self->done_) {
+                            return;
+                        }
+                        if (ec == boost::asio::error::connection_refused) {
+                            self->response_.status_code    = 503;
+                            self->response_.status_message = "Connection refused";
+                            self->finish();
+                            return;
+                        }
+                        if (ec) {
+                            self->fail(ec.message());
+                            return;
+                        }
+                        self->write();
+                    });
+            });
+    }
+
+    void write()
+    {
+        boost::asio::async_write(*socket_,
+                                 boost::asio::buffer(request_),
+                                 [self = shared_from_this()](const boost::system::error_code& ec, std::size_t) {
+                                     if (self->done_) {
+                                         return;
+                                     }
+                                     if (ec) {
+                                         self->retry_or_fail(ec);
+                                         return;
+                                     }
+                                     self->read_header();
+                                 });
     }
 
-    std::stringstream body;
+    // A kept alive connection may have been closed by the server since it was last used, so a request which got no
+    // response on it is sent again on a new one
+    void retry_or_fail(const boost::system::error_code& ec)
+    {
+        if (reused_ && buffer_.size() == 0) {
+            reused_ = false;
+            socket_.reset();
+            resolve();
+            return;
+        }
+        fail(ec.message());
+    }
+
+    void read_header()
+    {
+        boost::asio::async_read_until(
+            *socket_,
+            buffer_,
+            "\r\n\r\n",
+            [self = shared_from_this()](const boost::system::error_code& ec, std::size_t size) {
+                if (self->done_) {
+                    return;
+                }
+                if (ec) {
+                    self->retry_or_fail(ec);
+                    return;
+                }
 
-    // Write whatever content we already have to output.
-    if (response.size() > 0) {
-        body << &response;
+                std::string header(boost::asio::buffers_begin(self->buffer_.data()),
+                                   boost::asio::buffers_begin(self->buffer_.data()) + size);
+                self->buffer_.consume(size);
+
+                if (!self->parse_header(header)) {
+                    self->fail("Invalid Response");
+                    return;
+                }
+                self->read_body();
+            });
     }
 
-    // Read until EOF, writing data to output as we go.
-    while (asio::read(socket, response, asio::transfer_at_least(1), error)) {
-        body << &response;
+    bool parse_header(const std::string& header)
+    {
+        std::istringstream stream(header);
+
+        std::string http_version;
+        stream >> http_version >> response_.status_code;
+        std::getline(stream, response_.status_message);
+        boost::trim(response_.status_message);
+
+        if (!stream || http_version.substr(0, 5) != "HTTP/") {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(stream, line) && line != "\r") {
+            auto colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            auto name  = boost::to_lower_copy(line.substr(0, colon));
+            auto value = boost::trim_copy(line.substr(colon + 1));
+            response_.headers[name] = value;
+        }
+
+        auto connection = boost::to_lower_copy(header_value("connection"));
+        keep_alive_     = http_version == "HTTP/1.0" ? connection == "keep-alive" : connection != "close";
+
+        return true;
     }
 
-    if (error != asio::error::eof) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+    std::string header_value(const std::string& name) const
+    {
+        auto it = response_.headers.find(name);
+        return it != response_.headers.end() ? it->second : std::string();
     }
 
-    res.body = body.str();
+    void read_body()
+    {
+        if (response_.status_code == 204 || response_.status_code == 304) {
+            finish();
+        } else if (boost::icontains(header_value("transfer-encoding"), "chunked")) {
+            read_chunk();
+        } else if (!header_value("content-length").empty()) {
+            auto length = std::strtoull(header_value("content-length").c_str(), nullptr, 10);
+            fill(length, [self = shared_from_this(), length] {
+                self->take(length);
+                self->finish();
+            });
+        } else {
+            // The body is delimited by the server closing the connection
+            keep_alive_ = false;
+            boost::asio::async_read(*socket_,
+                                    buffer_,
+                                    boost::asio::transfer_all(),
+                                    [self = shared_from_this()](const boost::system::error_code& ec, std::size_t) {
+                                        if (self->done_) {
+                                            return;
+                                        }
+                                        if (ec != boost::asio::error::eof) {
+                                            self->fail(ec.message());
+                                            return;
+                                        }
+                                        self->take(self->buffer_.size());
+                                        self->finish();
+                                    });
+        }
+    }
+
+    void read_chunk()
+    {
+        boost::asio::async_read_until(
+            *socket_,
+            buffer_,
+            "\r\n",
+            [self = shared_from_this()](const boost::system::error_code& ec, std::size_t size) {
+                if (self->done_) {
+                    return;
+                }
+                if (ec) {
+                    self->fail(ec.message());
+                    return;
+                }
+
+                std::string line(boost::asio::buffers_begin(self->buffer_.data()),
+                                 boost::asio::buffers_begin(self->buffer_.data()) + size);
+                self->buffer_.consume(size);
+
+                auto length = std::strtoull(line.c_str(), nullptr, 16);
+                if (length == 0) {
+                    self->read_trailer();
+                    return;
+                }
+
+                // The data of a chunk is followed by a line break
+                self->fill(length + 2, [self, length] {
+                    self->take(length);
+                    self->buffer_.consume(2);
+                    self->read_chunk();
+                });
+            });
+    }
+
+    void read_trailer()
+    {
+        boost::asio::async_read_until(
+            *socket_,
+            buffer_,
+            "\r\n",
+            [self = shared_from_this()](const boost::system::error_code& ec, std::size_t size) {
+                if (self->done_) {
+                    return;
+                }
+                if (ec) {
+                    self->fail(ec.message());
+                    return;
+                }
+
+                self->buffer_.consume(size);
+                if (size == 2) {
+                    self->finish();
+                } else {
+                    self->read_trailer();
+                }
+            });
+    }
+
+    // Calls handler once at least size bytes are buffered
+    void fill(std::size_t size, std::function<void()> handler)
+    {
+        if (buffer_.size() >= size) {
+            handler();
+            return;
+        }
+
+        boost::asio::async_read(
+            *socket_,
+            buffer_,
+            boost::asio::transfer_exactly(size - buffer_.size()),
+            [self = shared_from_this(), handler = std::move(handler)](const boost::system::error_code& ec,
+                                                                      std::size_t) {
+                if (self->done_) {
+                    return;
+                }
+                if (ec) {
+                    self->fail(ec.message());
+                    return;
+                }
+                handler();
+            });
+    }
+
+    void take(std::size_t size)
+    {
+        auto begin = boost::asio::buffers_begin(buffer_.data());
+        response_.body.append(begin, begin + size);
+        buffer_.consume(size);
+    }
+
+    void finish()
+    {
+        done_ = true;
+        timer_.cancel();
+
+        if (keep_alive_ && socket_ && buffer_.size() == 0) {
+            client_.put_idle(server(), std::move(socket_));
+        }
+
+        promise_.set_value(std::move(response_));
+    }
+
+    void fail(const std::string& message)
+    {
+        done_ = true;
+        timer_.cancel();
+        resolver_.cancel();
+
+        if (socket_) {
+            boost::system::error_code ec;
+            socket_->close(ec);
+        }
+
+        promise_.set_exception(std::make_exception_ptr(io_error() << msg_info(message)));
+    }
+};
+
+} // namespace
+
+std::future<HTTPResponse> request_async(const std::string&                        host,
+                                        const std::string&                        port,
+                                        const std::string&                        path,
+                                        const std::map<std::string, std::string>& headers,
+                                        std::chrono::milliseconds                 timeout)
+{
+    std::ostringstream request;
+    request << "GET " << path << " HTTP/1.1\r\n";
+    request << "Host: " << host << ":" << port << "\r\n";
+    request << "Accept: */*\r\n";
+    for (auto& header : headers) {
+        request << header.first << ": " << header.second << "\r\n";
+    }
+    request << "\r\n";
+
+    auto& client = get_client();
+    auto  ex     = std::make_shared<exchange>(client, host, port, request.str(), timeout);
+    auto  result = ex->get_future();
+    client.service().post([ex] { ex->start(); });
+    return result;
+}
+
+HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+{
+    auto res = request_async(host, port, path).get();
+
+    if (res.status_code == 503 && res.status_message == "Connection refused") {
+        return res;
+    }
+
+    if (res.status_code < 200 || res.status_code >= 300) {
+        // TODO
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+    }
 
     return res;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+#include <future>
 #include <map>
 #include <string>
 
@@ -9,10 +11,20 @@ struct HTTPResponse
 {
     unsigned int                       status_code;
     std::string                        status_message;
-    std::map<std::string, std::string> headers;
+    std::map<std::string, std::string> headers; // By lower case name
     std::string                        body;
 };
 
+// Sends a GET request over HTTP/1.1 without waiting for the response. Connections are kept alive and reused by later
+// requests to the same host and port. The future holds a response of any status, or an io_error if none arrived
+// within timeout. A refused connection is a 503 response.
+std::future<HTTPResponse> request_async(const std::string&                        host,
+                                        const std::string&                        port,
+                                        const std::string&                        path,
+                                        const std::map<std::string, std::string>& headers = {},
+                                        std::chrono::milliseconds timeout = std::chrono::seconds(10));
+
+// Sends a GET request and waits for the response, which throws an io_error unless its status is 2xx
 HTTPResponse request(const std::string& host, const std::string& port, const std::string& path);
 
 std::string url_encode(const std::string& str);
@@ -38,13 +38,13 @@ std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pToke
             // insert code-handling here
             switch (message[charIndex]) {
                 case L'\\':
-                    currentToken += L"\\";
+                    currentToken += L'\\';
                     break;
                 case L'\"':
-                    currentToken += L"\"";
+                    currentToken += L'\"';
                     break;
                 case L'n':
-                    currentToken += L"\n";
+                    currentToken += L'\n';
                     break;
                 default:
                     break;
@@ -60,7 +60,7 @@ std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pToke
 
         if (message[charIndex] == L' ' && inQuote == false && inParamList == 0) {
             if (!currentToken.empty()) {
-                pTokenVector.push_back(currentToken);
+                pTokenVector.push_back(std::move(currentToken));
                 currentToken.clear();
             }
             continue;
@@ -71,7 +71,7 @@ std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pToke
             inParamList--;
             if (inParamList == 0) {
                 currentToken += message[charIndex];
-                pTokenVector.push_back(currentToken);
+                pTokenVector.push_back(std::move(currentToken));
                 currentToken.clear();
                 continue;
             }
@@ -81,18 +81,24 @@ std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pToke
 
             if (inParamList == 0) {
                 if (!inQuote) {
-                    pTokenVector.push_back(currentToken);
+                    pTokenVector.push_back(std::move(currentToken));
                     currentToken.clear();
                 }
                 continue;
             }
         }
 
-        currentToken += message[charIndex];
+        // Append the run of characters up to the next one that needs handling at once
+        auto end = message.find_first_of(L"\\ ()\"", charIndex + 1);
+        if (end == std::wstring::npos) {
+            end = message.size();
+        }
+        currentToken.append(message, charIndex, end - charIndex);
+        charIndex = static_cast<unsigned int>(end - 1);
     }
 
     if (!currentToken.empty()) {
-        pTokenVector.push_back(currentToken);
+        pTokenVector.push_back(std::move(currentToken));
         currentToken.clear();
     }
 
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xml_writer.h"
+
+#include <common/utf.h>
+
+#include <boost/container/small_vector.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+namespace caspar { namespace IO {
+
+namespace {
+
+const int indent_size = 3;
+
+void indent(std::wstring& out, int level) { out.append(static_cast<size_t>(level) * indent_size, L' '); }
+
+void append_escaped(std::wstring& out, std::wstring_view text)
+{
+    if (text.empty()) {
+        return;
+    }
+
+    // Text of only spaces keeps its first one, as write_xml does, so that it survives being read back
+    if (text.find_first_not_of(L' ') == std::wstring_view::npos) {
+        out += L"&#32;";
+        out.append(text.size() - 1, L' ');
+        return;
+    }
+
+    for (auto c : text) {
+        switch (c) {
+            case L'<':
+                out += L"&lt;";
+                break;
+            case L'>':
+                out += L"&gt;";
+                break;
+            case L'&':
+                out += L"&amp;";
+                break;
+            case L'"':
+                out += L"&quot;";
+                break;
+            case L'\'':
+                out += L"&apos;";
+                break;
+            default:
+                out += c;
+                break;
+        }
+    }
+}
+
+void write_text(std::wstring& out, std::wstring_view text, int level, bool separate_line)
+{
+    if (separate_line) {
+        indent(out, level);
+    }
+    append_escaped(out, text);
+    if (separate_line) {
+        out += L'\n';
+    }
+}
+
+// Mirrors write_xml_element of boost::property_tree
+void write_element(std::wstring& out, const std::wstring& key, const boost::property_tree::wptree& tree, int level)
+{
+    namespace xml = boost::property_tree::xml_parser;
+
+    static const auto attr    = xml::xmlattr<std::wstring>();
+    static const auto comment = xml::xmlcomment<std::wstring>();
+    static const auto text    = xml::xmltext<std::wstring>();
+
+    bool has_elements   = false;
+    bool has_attrs_only = tree.data().empty();
+    for (auto& child : tree) {
+        if (child.first != attr) {
+            has_attrs_only = false;
+            if (child.first != text) {
+                has_elements = true;
+                break;
+            }
+        }
+    }
+
+    if (tree.data().empty() && tree.empty()) {
+        if (level >= 0) {
+            indent(out, level);
+            out += L'<';
+            out += key;
+            out += L"/>\n";
+        }
+        return;
+    }
+
+    if (level >= 0) {
+        indent(out, level);
+        out += L'<';
+        out += key;
+
+        if (auto attribs = tree.get_child_optional(attr)) {
+            for (auto& attrib : *attribs) {
+                out += L' ';
+                out += attrib.first;
+                out += L"=\"";
+                append_escaped(out, attrib.second.data());
+                out += L'"';
+            }
+        }
+
+        if (has_attrs_only) {
+            out += L"/>\n";
+        } else {
+            out += L'>';
+            if (has_elements) {
+                out += L'\n';
+            }
+        }
+    }
+
+    if (!tree.data().empty()) {
+        write_text(out, tree.data(), level + 1, has_elements);
+    }
+
+    for (auto& child : tree) {
+        if (child.first == attr) {
+            continue;
+        }
+
+        if (child.first == comment) {
+            indent(out, level + 1);
+            out += L"<!--";
+            out += child.second.data();
+            out += L"-->\n";
+        } else if (child.first == text) {
+            write_text(out, child.second.data(), level + 1, has_elements);
+        } else {
+            write_element(out, child.first, child.second, level + 1);
+        }
+    }
+
+    if (level >= 0 && !has_attrs_only) {
+        if (has_elements) {
+            indent(out, level);
+        }
+        out += L"</";
+        out += key;
+        out += L">\n";
+    }
+}
+
+// Formats values the way the stream translator of a tree does
+struct value_writer : public boost::static_visitor<void>
+{
+    std::wstring& out;
+
+    explicit value_writer(std::wstring& out)
+        : out(out)
+    {
+    }
+
+    void operator()(bool value) const { out += value ? L"true" : L"false"; }
+    void operator()(std::int32_t value) const { out += std::to_wstring(value); }
+    void operator()(std::int64_t value) const { out += std::to_wstring(value); }
+    void operator()(std::uint32_t value) const { out += std::to_wstring(value); }
+    void operator()(std::uint64_t value) const { out += std::to_wstring(value); }
+    void operator()(float value) const { append_number(value, std::numeric_limits<float>::max_digits10); }
+    void operator()(double value) const { append_number(value, std::numeric_limits<double>::max_digits10); }
+    void operator()(const std::string& value) const { append_escaped(out, u16(value)); }
+    void operator()(const std::wstring& value) const { append_escaped(out, value); }
+
+    void append_number(double value, int precision) const
+    {
+        char buffer[32];
+        auto size = std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        out.append(buffer, buffer + std::max(0, std::min(size, static_cast<int>(sizeof(buffer)) - 1)));
+    }
+};
+
+using state_path = boost::container::small_vector<std::string_view, 8>;
+
+struct state_entry
+{
+    state_path                     path;
+    const core::monitor::vector_t* values;
+};
+
+void append_name(std::wstring& out, const state_path& path, size_t index)
+{
+    auto segment = path[index];
+
+    auto numeric = !segment.empty() && std::all_of(segment.begin(), segment.end(), [](char c) {
+        return c >= '0' && c <= '9';
+    });
+    if (numeric && index > 0) {
+        out.append(path[index - 1].begin(), path[index - 1].end());
+        out += L'_';
+    }
+    out.append(segment.begin(), segment.end());
+}
+
+void write_value(std::wstring&                out,
+                 const core::monitor::data_t& value,
+                 const state_path&            path,
+                 size_t                       index,
+                 int                          level)
+{
+    auto start = out.size();
+    indent(out, level);
+    out += L'<';
+    append_name(out, path, index);
+    out += L'>';
+
+    auto text = out.size();
+    boost::apply_visitor(value_writer(out), value);
+
+    if (out.size() == text) {
+        // Empty text makes an empty element
+        out.resize(start);
+        indent(out, level);
+        out += L'<';
+        append_name(out, path, index);
+        out += L"/>\n";
+        return;
+    }
+
+    out += L"</";
+    append_name(out, path, index);
+    out += L">\n";
+}
+
+} // namespace
+
+void write_xml(std::wstring& out, const boost::property_tree::wptree& tree)
+{
+    out += L"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    write_element(out, std::wstring(), tree, -1);
+}
+
+void write_xml(std::wstring& out, const std::wstring& root, const core::monitor::state& state)
+{
+    out += L"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+
+    // Paths sorted by their segments, so that the descendants of an element directly follow it
+    std::vector<state_entry> entries;
+    for (const auto& p : state) {
+        if (p.second.empty()) {
+            continue;
+        }
+
+        state_entry entry{{}, &p.second};
+        std::string_view key(p.first);
+        for (size_t pos = 0;;) {
+            auto end = key.find('/', pos);
+            entry.path.push_back(key.substr(pos, end == std::string_view::npos ? end : end - pos));
+            if (end == std::string_view::npos) {
+                break;
+            }
+            pos = end + 1;
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const state_entry& lhs, const state_entry& rhs) {
+        return std::lexicographical_compare(lhs.path.begin(), lhs.path.end(), rhs.path.begin(), rhs.path.end());
+    });
+
+    if (entries.empty()) {
+        out += L'<';
+        out += root;
+        out += L"/>\n";
+        return;
+    }
+
+    out += L'<';
+    out += root;
+    out += L">\n";
+
+    // The open elements below the root. A value of a path with descendants is written inside the element of its
+    // first value, and any further values follow as elements of their own once it is closed.
+    struct open_element
+    {
+        const state_entry* entry;
+        size_t             index;
+        bool               with_values;
+    };
+    std::vector<open_element> open;
+
+    auto close_to = [&](size_t depth) {
+        while (open.size() > depth) {
+            auto element = open.back();
+            open.pop_back();
+
+            auto level = static_cast<int>(open.size()) + 1;
+            indent(out, level);
+            out += L"</";
+            append_name(out, element.entry->path, element.index);
+            out += L">\n";
+
+            if (element.with_values) {
+                auto& values = *element.entry->values;
+                for (size_t n = 1; n < values.size(); ++n) {
+                    write_value(out, values[n], element.entry->path, element.index, level);
+                }
+            }
+        }
+    };
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& entry = entries[i];
+        const auto& path  = entry.path;
+
+        size_t common = 0;
+        while (common < open.size() && common < path.size() &&
+               open[common].entry->path[open[common].index] == path[common]) {
+            ++common;
+        }
+        close_to(common);
+
+        for (size_t k = common; k < path.size(); ++k) {
+            auto level = static_cast<int>(k) + 1;
+
+            if (k + 1 < path.size()) {
+                indent(out, level);
+                out += L'<';
+                append_name(out, path, k);
+                out += L">\n";
+                open.push_back(open_element{&entry, k, false});
+                continue;
+            }
+
+            auto has_elements = i + 1 < entries.size() && entries[i + 1].path.size() > path.size() &&
+                                std::equal(path.begin(), path.end(), entries[i + 1].path.begin());
+
+            if (!has_elements) {
+                for (auto& value : *entry.values) {
+                    write_value(out, value, path, k, level);
+                }
+                continue;
+            }
+
+            indent(out, level);
+            out += L'<';
+            append_name(out, path, k);
+            out += L">\n";
+
+            auto text = out.size();
+            indent(out, level + 1);
+            auto value = out.size();
+            boost::apply_visitor(value_writer(out), entry.values->front());
+            if (out.size() == value) {
+                out.resize(text);
+            } else {
+                out += L'\n';
+            }
+
+            open.push_back(open_element{&entry, k, true});
+        }
+    }
+
+    close_to(0);
+
+    out += L"</";
+    out += root;
+    out += L">\n";
+}
+
+}} // namespace caspar::IO
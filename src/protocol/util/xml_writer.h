@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <string>
+
+namespace caspar { namespace IO {
+
+// Appends a tree to out as XML, laid out like boost::property_tree::write_xml with an indent of 3 spaces, without the
+// stream it writes through.
+void write_xml(std::wstring& out, const boost::property_tree::wptree& tree);
+
+// Appends a monitor state to out as XML, as if each of its paths had been added to a tree under root, without building
+// the tree. Digit-only path segments are named after their parent, e.g. layer/10 becomes layer/layer_10, as XML names
+// can't be numeric. Siblings are written in the order of their names.
+void write_xml(std::wstring& out, const std::wstring& root, const core::monitor::state& state);
+
+}} // namespace caspar::IO
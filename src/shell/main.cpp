@@ -34,6 +34,7 @@
 
 #include "included_modules.h"
 #include "platform_specific.h"
+#include "replay.h"
 #include "server.h"
 
 #include <protocol/amcp/AMCPProtocolStrategy.h>
@@ -41,12 +42,18 @@
 
 #include <common/env.h>
 #include <common/except.h>
+#include <common/host_buffer.h>
 #include <common/log.h>
+#include <common/media_index.h>
+#include <common/memory_governor.h>
+#include <common/os/thread.h>
 #include <common/ptree.h>
+#include <common/task_arena.h>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/locale.hpp>
 #include <boost/property_tree/detail/file_parser_error.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -87,7 +94,135 @@ void print_info()
     CASPAR_LOG(info) << L"Starting CasparCG Video and Graphics Playout Server " << env::version();
 }
 
-auto run(const std::wstring& config_file_name, std::atomic<bool>& should_wait_for_keypress)
+void configure_thread_placements()
+{
+    std::vector<thread_placement> placements;
+    for (auto& xml_thread :
+         env::properties() | witerate_children(L"configuration.threads") | welement_context_iteration) {
+        ptree_verify_element_name(xml_thread, L"thread");
+
+        thread_placement placement;
+        placement.name      = ptree_get<std::wstring>(xml_thread.second, L"name");
+        placement.cpus      = parse_cpu_list(xml_thread.second.get(L"cpus", L""));
+        placement.numa_node = xml_thread.second.get(L"numa-node", -1);
+
+        auto priority = xml_thread.second.get(L"priority", L"normal");
+        if (priority != L"normal" && priority != L"realtime")
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid thread priority: " + priority));
+        placement.realtime = priority == L"realtime";
+
+        CASPAR_LOG(info) << L"Placing threads " << placement.name << L" on cpus ["
+                         << xml_thread.second.get(L"cpus", L"any") << L"] numa node [" << placement.numa_node
+                         << L"] with " << priority << L" priority";
+        placements.push_back(std::move(placement));
+    }
+    set_thread_placements(std::move(placements));
+}
+
+void configure_host_buffer_pool()
+{
+    auto mode = env::properties().get(L"configuration.host-buffers.huge-pages", L"none");
+    auto size = env::properties().get(L"configuration.host-buffers.max-free-mb", 1024);
+    if (mode != L"none" && mode != L"transparent" && mode != L"reserved")
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid huge-pages: " + mode));
+    if (size < 0)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid max-free-mb: " + std::to_wstring(size)));
+
+    auto pages = mode == L"transparent" ? huge_pages::transparent
+                 : mode == L"reserved"  ? huge_pages::reserved
+                                        : huge_pages::none;
+    configure_host_buffers(pages, static_cast<std::size_t>(size) * 1024 * 1024);
+}
+
+void configure_memory_limits()
+{
+    auto soft = env::properties().get(L"configuration.memory.soft-limit-mb", 0);
+    auto hard = env::properties().get(L"configuration.memory.hard-limit-mb", 0);
+    if (soft < 0)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid soft-limit-mb: " + std::to_wstring(soft)));
+    if (hard < 0)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid hard-limit-mb: " + std::to_wstring(hard)));
+
+    memory_limits limits;
+    limits.soft = static_cast<std::int64_t>(soft) * 1024 * 1024;
+    limits.hard = static_cast<std::int64_t>(hard) * 1024 * 1024;
+    configure_memory_governor(limits);
+}
+
+void configure_task_arenas()
+{
+    const struct
+    {
+        task_kind      kind;
+        const wchar_t* name;
+        const wchar_t* priority;
+    } arenas[] = {{task_kind::realtime, L"realtime", L"high"},
+                  {task_kind::decode, L"decode", L"normal"},
+                  {task_kind::background, L"background", L"low"}};
+
+    for (auto& arena : arenas) {
+        auto path = std::wstring(L"configuration.task-arenas.") + arena.name;
+
+        task_arena_config config;
+        config.concurrency = env::properties().get(path + L".concurrency", 0);
+        if (config.concurrency < 0)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid task arena concurrency: " +
+                                                            std::to_wstring(config.concurrency)));
+
+        auto priority = env::properties().get(path + L".priority", std::wstring(arena.priority));
+        if (priority == L"low")
+            config.priority = tbb::task_arena::priority::low;
+        else if (priority == L"normal")
+            config.priority = tbb::task_arena::priority::normal;
+        else if (priority == L"high")
+            config.priority = tbb::task_arena::priority::high;
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid task arena priority: " + priority));
+
+        configure_task_arena(arena.kind, config);
+    }
+}
+
+// casparcg [config] [--replay <recording> [--report <file>] [--max-gap <seconds>] [--tail <seconds>] [--max-late <n>]]
+std::wstring parse_command_line(int argc, char** argv, replay_options& replay)
+{
+    std::wstring config_file_name(L"casparcg.config");
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+        if (arg.rfind("--", 0) != 0) {
+            config_file_name = u16(arg);
+            continue;
+        }
+        if (n + 1 >= argc)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Missing value of " + u16(arg)));
+
+        std::string value = argv[++n];
+        try {
+            if (arg == "--replay")
+                replay.recording = u16(value);
+            else if (arg == "--report")
+                replay.report = u16(value);
+            else if (arg == "--max-gap")
+                replay.max_gap = boost::lexical_cast<double>(value);
+            else if (arg == "--tail")
+                replay.tail = boost::lexical_cast<double>(value);
+            else if (arg == "--max-late")
+                replay.max_late = boost::lexical_cast<int>(value);
+            else
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown option " + u16(arg)));
+        } catch (boost::bad_lexical_cast&) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid value of " + u16(arg) + L": " + u16(value)));
+        }
+    }
+
+    return config_file_name;
+}
+
+auto run(const std::wstring&  config_file_name,
+         const replay_options& replay_opts,
+         std::atomic<bool>&    should_wait_for_keypress,
+         std::atomic<bool>&    replay_failed)
 {
     auto promise  = std::make_shared<std::promise<bool>>();
     auto future   = promise->get_future();
@@ -95,6 +230,10 @@ auto run(const std::wstring& config_file_name, std::atomic<bool>& should_wait_fo
 
     print_info();
 
+    // Before the server, which resolves clips from it as soon as it starts
+    auto media_index =
+        env::properties().get(L"configuration.media-index", true) ? start_media_index(env::media_folder()) : nullptr;
+
     // Create server object which initializes channels, protocols and controllers.
     std::unique_ptr<server> caspar_server(new server(shutdown));
 
@@ -117,6 +256,25 @@ auto run(const std::wstring& config_file_name, std::atomic<bool>& should_wait_fo
         protocol::amcp::create_wchar_amcp_strategy_factory(L"Console", caspar_server->get_amcp_command_repository())
             ->create(console_client);
 
+    // Replays a recording alongside the console, and shuts the server down once done
+    std::atomic<bool> replay_aborted{false};
+    std::thread       replay_thread;
+    if (!replay_opts.recording.empty()) {
+        replay_thread = std::thread([&] {
+            try {
+                replay_failed = !replay(replay_opts, caspar_server->get_amcp_command_repository(), replay_aborted);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                replay_failed = true;
+            }
+            try {
+                shutdown(false);
+            } catch (std::future_error&) {
+                // The server was already shut down, from the console or by a command of the recording
+            }
+        });
+    }
+
     // Use separate thread for the blocking console input, will be terminated
     // anyway when the main thread terminates.
 
@@ -159,6 +317,10 @@ auto run(const std::wstring& config_file_name, std::atomic<bool>& should_wait_fo
     }).detach();
     future.wait();
 
+    replay_aborted = true;
+    if (replay_thread.joinable())
+        replay_thread.join();
+
     caspar_server.reset();
 
     return future.get();
@@ -217,14 +379,14 @@ int main(int argc, char** argv)
     // Increase process priority.
     increase_process_priority();
 
-    std::wstring config_file_name(L"casparcg.config");
+    std::wstring   config_file_name(L"casparcg.config");
+    replay_options replay_opts;
 
     try {
-        // Configure environment properties from configuration.
-        if (argc >= 2)
-            config_file_name = caspar::u16(argv[1]);
-
         log::add_cout_sink();
+
+        // Configure environment properties from configuration.
+        config_file_name = parse_command_line(argc, argv, replay_opts);
         env::configure(config_file_name);
 
         log::set_log_column_alignment(env::properties().get(L"configuration.log-align-columns", true));
@@ -254,13 +416,21 @@ int main(int argc, char** argv)
         // Once logging to file, log configuration warnings.
         env::log_configuration_warnings();
 
+        // Before any threads of the server are started, as they are placed when they are named.
+        configure_thread_placements();
+        configure_host_buffer_pool();
+        configure_memory_limits();
+        configure_task_arenas();
+
         // Setup console window.
         setup_console_window();
 
         std::atomic<bool> should_wait_for_keypress;
+        std::atomic<bool> replay_failed;
         should_wait_for_keypress = false;
-        auto should_restart      = run(config_file_name, should_wait_for_keypress);
-        return_code              = should_restart ? 5 : 0;
+        replay_failed            = false;
+        auto should_restart      = run(config_file_name, replay_opts, should_wait_for_keypress, replay_failed);
+        return_code              = should_restart ? 5 : replay_failed ? 1 : 0;
 
         CASPAR_LOG(info) << "Successfully shutdown CasparCG Server.";
 
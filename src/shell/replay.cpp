@@ -0,0 +1,428 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay.h"
+
+#include <protocol/amcp/AMCPProtocolStrategy.h>
+#include <protocol/amcp/amcp_recorder.h>
+#include <protocol/amcp/amcp_shared.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/filesystem.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/memory_governor.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/diagnostics/frame_history.h>
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace caspar {
+
+namespace {
+
+struct recorded_command
+{
+    std::int64_t time = 0; // Milliseconds since the first command
+    std::wstring command;
+};
+
+struct recording
+{
+    std::vector<recorded_command> commands;
+    std::set<std::wstring>        media;
+    std::set<std::wstring>        templates;
+};
+
+recording read_recording(const std::wstring& filename)
+{
+    boost::filesystem::ifstream file(boost::filesystem::path(filename), std::ios::binary);
+    if (!file) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not open recording " + filename));
+    }
+
+    recording result;
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        auto tab = line.find('\t');
+        if (line.front() == '#') {
+            if (tab != std::string::npos && line.compare(0, tab, "#media") == 0) {
+                result.media.insert(u16(line.substr(tab + 1)));
+            } else if (tab != std::string::npos && line.compare(0, tab, "#template") == 0) {
+                result.templates.insert(u16(line.substr(tab + 1)));
+            }
+            continue;
+        }
+
+        recorded_command command;
+        try {
+            command.time    = std::stoll(line.substr(0, tab));
+            command.command = u16(line.substr(tab + 1));
+        } catch (...) {
+            tab = std::string::npos;
+        }
+        if (tab == std::string::npos || command.command.empty()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid line " + std::to_wstring(number) + L" in " +
+                                                            filename));
+        }
+        result.commands.push_back(std::move(command));
+    }
+    return result;
+}
+
+// Counts the commands that the server failed, of which a recording of production usually has a few
+class replay_client : public IO::client_connection<wchar_t>
+{
+    std::atomic<int> errors_{0};
+
+  public:
+    void send(std::wstring&& data, bool skip_log) override
+    {
+        // Without the RES <request id> of commands sent with REQ
+        auto code = data;
+        if (boost::starts_with(code, L"RES ")) {
+            auto space = code.find(L' ', 4);
+            code       = space == std::wstring::npos ? std::wstring() : code.substr(space + 1);
+        }
+        if (!code.empty() && (code.front() == L'4' || code.front() == L'5')) {
+            errors_ += 1;
+            CASPAR_LOG(warning) << L"[replay] " << log::replace_nonprintable_copy(data, L'?');
+        }
+    }
+    void         disconnect() override {}
+    std::wstring address() const override { return protocol::amcp::replay_client_address; }
+    void add_lifecycle_bound_object(const std::wstring& key, const std::shared_ptr<void>& lifecycle_bound) override {}
+    std::shared_ptr<void> remove_lifecycle_bound_object(const std::wstring& key) override
+    {
+        return std::shared_ptr<void>();
+    }
+
+    int errors() const { return errors_; }
+};
+
+// Reads back the mixed image like the consumers of production would and throws it away. Unlike the one of
+// casparcg-bench it claims no clock, so that the channels tick in real time as the recording expects them to.
+class null_consumer : public core::frame_consumer
+{
+    std::uint8_t checksum_ = 0;
+
+  public:
+    std::future<bool> send(const core::video_field field, core::const_frame frame) override
+    {
+        auto& image = frame.image_data(0);
+        if (image.size() > 0) {
+            checksum_ ^= image.data()[image.size() / 2];
+        }
+        return make_ready_future(true);
+    }
+
+    void initialize(const core::video_format_desc& format_desc,
+                    const core::channel_info&      channel_info,
+                    int                            port_index) override
+    {
+    }
+
+    core::monitor::state state() const override { return {}; }
+    std::wstring         print() const override { return L"null[]"; }
+    std::wstring         name() const override { return L"null"; }
+    bool                 has_synchronization_clock() const override { return false; }
+    int                  index() const override { return 900; }
+};
+
+// In milliseconds
+struct channel_timings
+{
+    std::vector<double> produce;
+    std::vector<double> mix;
+    std::vector<double> gpu;
+    std::vector<double> consume;
+    std::vector<double> total;
+    std::int64_t        late = 0;
+};
+
+struct timings
+{
+    std::mutex                     mutex;
+    std::map<int, channel_timings> channels;
+
+    void push(int channel, const core::diagnostics::frame_timing& timing, double frame_duration)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto&                       result = channels[channel];
+        result.produce.push_back(timing.produce * 1000.0);
+        result.mix.push_back(timing.mix * 1000.0);
+        result.gpu.push_back(timing.gpu);
+        result.consume.push_back(timing.consume * 1000.0);
+        result.total.push_back(timing.total * 1000.0);
+        if (timing.total > frame_duration) {
+            result.late += 1;
+        }
+    }
+};
+
+struct memory_high_water
+{
+    std::int64_t                        total = 0;
+    std::map<std::string, std::int64_t> subsystems;
+
+    void sample()
+    {
+        auto statistics = memory_governor_statistics();
+        total           = std::max(total, statistics.total);
+        for (auto& usage : statistics.subsystems) {
+            auto& bytes = subsystems[usage.subsystem];
+            bytes       = std::max(bytes, usage.bytes);
+        }
+    }
+};
+
+struct percentiles
+{
+    size_t count = 0;
+    double mean  = 0.0;
+    double p50   = 0.0;
+    double p90   = 0.0;
+    double p99   = 0.0;
+    double max   = 0.0;
+};
+
+percentiles summarise(std::vector<double> values)
+{
+    percentiles result;
+    if (values.empty()) {
+        return result;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    // Nearest rank, so that every reported value is one that was measured
+    auto rank = [&](double p) {
+        auto index = static_cast<size_t>(std::ceil(p * values.size()));
+        return values[std::min(values.size() - 1, index > 0 ? index - 1 : 0)];
+    };
+
+    double sum = 0.0;
+    for (auto value : values) {
+        sum += value;
+    }
+
+    result.count = values.size();
+    result.mean  = sum / values.size();
+    result.p50   = rank(0.50);
+    result.p90   = rank(0.90);
+    result.p99   = rank(0.99);
+    result.max   = values.back();
+    return result;
+}
+
+void print_row(std::ostream& out, const std::string& name, const percentiles& p)
+{
+    out << std::left << std::setw(16) << name << std::right << std::setw(10) << p.count << std::fixed
+        << std::setprecision(3) << std::setw(10) << p.mean << std::setw(10) << p.p50 << std::setw(10) << p.p90
+        << std::setw(10) << p.p99 << std::setw(10) << p.max << "\n";
+}
+
+std::vector<std::wstring> find_missing(const std::set<std::wstring>& files, const std::wstring& folder)
+{
+    std::vector<std::wstring> missing;
+    for (auto& file : files) {
+        if (!find_file_within_dir_or_absolute(folder, file, [](const boost::filesystem::path&) { return true; })) {
+            missing.push_back(file);
+        }
+    }
+    return missing;
+}
+
+} // namespace
+
+bool replay(const replay_options&                                           options,
+            const spl::shared_ptr<protocol::amcp::amcp_command_repository>& repo,
+            const std::atomic<bool>&                                        aborted)
+{
+    set_thread_name(L"Replay");
+
+    auto recording = read_recording(options.recording);
+
+    // Missing media fails rather than being replayed, as the producers that stand in for it do less work
+    auto missing_media     = find_missing(recording.media, env::media_folder());
+    auto missing_templates = find_missing(recording.templates, env::template_folder());
+    for (auto& clip : missing_media) {
+        CASPAR_LOG(error) << L"[replay] Missing media " << clip;
+    }
+    for (auto& name : missing_templates) {
+        CASPAR_LOG(error) << L"[replay] Missing template " << name;
+    }
+
+    auto consumer = spl::make_shared<null_consumer>();
+    for (auto& channel : *repo->channels()) {
+        channel.raw_channel->output().add(consumer);
+    }
+
+    // Shared with the channels, which may still be calling the listener as it is reset
+    auto frames = std::make_shared<timings>();
+    core::diagnostics::set_frame_timing_listener(
+        [frames](int channel, const core::diagnostics::frame_timing& timing, double frame_duration) {
+            frames->push(channel, timing, frame_duration);
+        });
+
+    auto client = spl::make_shared<replay_client>();
+    auto amcp   = protocol::amcp::create_wchar_amcp_strategy_factory(protocol::amcp::replay_client_address, repo)
+                    ->create(client);
+
+    memory_high_water memory;
+
+    CASPAR_LOG(info) << L"[replay] Replaying " << recording.commands.size() << L" commands from " << options.recording;
+
+    // Sleeps until time, sampling the memory on the way. False when the server is shutting down.
+    auto wait_until = [&](std::chrono::steady_clock::time_point time) {
+        while (true) {
+            memory.sample();
+            auto now = std::chrono::steady_clock::now();
+            if (aborted) {
+                return false;
+            }
+            if (now >= time) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(time - now,
+                                                                                       std::chrono::milliseconds(500)));
+        }
+    };
+
+    auto         start     = std::chrono::steady_clock::now();
+    std::int64_t scheduled = 0; // Milliseconds since start
+    std::int64_t previous  = 0;
+    for (auto& command : recording.commands) {
+        auto gap = std::max<std::int64_t>(0, command.time - previous);
+        if (options.max_gap > 0.0) {
+            gap = std::min(gap, static_cast<std::int64_t>(options.max_gap * 1000.0));
+        }
+        previous = command.time;
+        scheduled += gap;
+
+        if (!wait_until(start + std::chrono::milliseconds(scheduled))) {
+            break;
+        }
+        amcp->parse(command.command + L"\r\n");
+    }
+    wait_until(std::chrono::steady_clock::now() +
+               std::chrono::milliseconds(static_cast<std::int64_t>(options.tail * 1000.0)));
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    core::diagnostics::set_frame_timing_listener(nullptr);
+    for (auto& channel : *repo->channels()) {
+        channel.raw_channel->output().remove(consumer);
+    }
+
+    std::ostringstream report;
+    report << "casparcg --replay " << u8(env::version()) << "\n";
+    report << u8(options.recording) << ", " << recording.commands.size() << " commands in " << std::fixed
+           << std::setprecision(2) << elapsed << " s, " << client->errors() << " failed, "
+           << missing_media.size() + missing_templates.size() << " media missing\n";
+
+    std::int64_t late = 0;
+    {
+        std::lock_guard<std::mutex> lock(frames->mutex);
+        for (auto& channel : frames->channels) {
+            auto& result = channel.second;
+            late += result.late;
+
+            std::wstring format;
+            for (auto& context : *repo->channels()) {
+                if (context.raw_channel->index() == channel.first) {
+                    format = context.raw_channel->stage()->video_format_desc().name;
+                }
+            }
+
+            report << "\nchannel " << channel.first << " " << u8(format) << ", " << result.total.size()
+                   << " frames, " << result.late << " late\n";
+            report << std::left << std::setw(16) << "ms" << std::right << std::setw(10) << "count" << std::setw(10)
+                   << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+                   << std::setw(10) << "max" << "\n";
+            print_row(report, "produce", summarise(result.produce));
+            print_row(report, "mix", summarise(result.mix));
+            print_row(report, "gpu", summarise(result.gpu));
+            print_row(report, "consume", summarise(result.consume));
+            print_row(report, "total", summarise(result.total));
+        }
+    }
+
+    report << "\n" << std::left << std::setw(16) << "memory MB" << std::right << std::setw(10) << "peak" << "\n";
+    report << std::left << std::setw(16) << "total" << std::right << std::setw(10) << memory.total / (1024 * 1024)
+           << "\n";
+    for (auto& subsystem : memory.subsystems) {
+        report << std::left << std::setw(16) << subsystem.first << std::right << std::setw(10)
+               << subsystem.second / (1024 * 1024) << "\n";
+    }
+
+    auto passed = !aborted && missing_media.empty() && missing_templates.empty() &&
+                  (options.max_late < 0 || late <= options.max_late);
+    report << "\n" << (aborted ? "aborted" : passed ? "passed" : "failed") << ", " << late << " frames late";
+    if (options.max_late >= 0) {
+        report << " of at most " << options.max_late;
+    }
+    report << "\n";
+
+    std::cout << report.str() << std::flush;
+    if (!options.report.empty()) {
+        std::ofstream file(u8(options.report), std::ios::binary);
+        file << report.str();
+        if (!file) {
+            CASPAR_LOG(error) << L"[replay] Could not write the report to " << options.report;
+        }
+    }
+
+    return passed;
+}
+
+} // namespace caspar
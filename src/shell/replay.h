@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <protocol/amcp/amcp_command_repository.h>
+
+#include <common/memory.h>
+
+#include <atomic>
+#include <string>
+
+namespace caspar {
+
+struct replay_options
+{
+    std::wstring recording; // Written by amcp/record-path, empty when not replaying
+    std::wstring report;    // A file the report is also written to
+    double       max_gap  = 0.0; // Seconds that longer pauses between commands are cut to, 0 replays them as recorded
+    double       tail     = 5.0; // Seconds the channels keep running after the last command
+    int          max_late = -1;  // Late frames that fail the replay, -1 never fails it for them
+};
+
+// Sends the commands of a recording to the server at the times they were recorded, with a consumer on every channel
+// that reads back the mixed frames and throws them away, and reports the time each stage of every channel took along
+// with the late frames and the memory high-water marks. Run with the configuration of production, minus the consumers
+// of its hardware, two builds given the same recording and media do the same work. Returns whether the replay passed,
+// which is when it was not aborted, no media was missing and at most max_late frames were late.
+bool replay(const replay_options&                                           options,
+            const spl::shared_ptr<protocol::amcp::amcp_command_repository>& repo,
+            const std::atomic<bool>&                                        aborted);
+
+} // namespace caspar
@@ -28,11 +28,15 @@
 #include <common/env.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/memory_governor.h>
+#include <common/os/thread.h>
 #include <common/ptree.h>
+#include <common/timer.h>
 #include <common/utf.h>
 
 #include <core/consumer/output.h>
 #include <core/diagnostics/call_context.h>
+#include <core/diagnostics/metrics.h>
 #include <core/diagnostics/osd_graph.h>
 #include <core/frame/pixel_format.h>
 #include <core/mixer/image/image_mixer.h>
@@ -48,7 +52,12 @@
 #include <protocol/amcp/AMCPProtocolStrategy.h>
 #include <protocol/amcp/amcp_command_repository.h>
 #include <protocol/amcp/amcp_shared.h>
+#include <protocol/binary/binary_protocol_strategy.h>
+#include <protocol/binary/monitor_publisher.h>
+#include <protocol/metrics/metrics_strategy.h>
 #include <protocol/osc/client.h>
+#include <protocol/osc/control_server.h>
+#include <protocol/shm/monitor_export.h>
 #include <protocol/util/AsyncEventServer.h>
 #include <protocol/util/strategy_adapters.h>
 #include <protocol/util/tokenize.h>
@@ -58,13 +67,21 @@
 #include <boost/format.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <mutex>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace caspar {
 using namespace core;
 using namespace protocol;
 
+// Runs the io_service on a pool of threads, so that a slow client can't hold up the others. Connections keep their
+// handlers in order on a strand of their own.
 std::shared_ptr<boost::asio::io_service> create_running_io_service()
 {
     auto service = std::make_shared<boost::asio::io_service>();
@@ -72,26 +89,35 @@ std::shared_ptr<boost::asio::io_service> create_running_io_service()
     // operations are posted.
     auto work      = std::make_shared<boost::asio::io_service::work>(*service);
     auto weak_work = std::weak_ptr<boost::asio::io_service::work>(work);
-    auto thread    = std::make_shared<std::thread>([service, weak_work] {
-        while (auto strong = weak_work.lock()) {
-            try {
-                service->run();
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+
+    auto nb_threads = std::max(1, env::properties().get(L"configuration.amcp.io-threads", 2));
+    auto threads    = std::make_shared<std::vector<std::thread>>();
+    for (int n = 0; n < nb_threads; ++n) {
+        threads->emplace_back([service, weak_work, n] {
+            set_thread_name(L"asio " + std::to_wstring(n));
+
+            while (auto strong = weak_work.lock()) {
+                try {
+                    service->run();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
             }
-        }
 
-        CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
-    });
+            CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
+        });
+    }
 
-    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, thread](void*) mutable {
+    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, threads](void*) mutable {
         CASPAR_LOG(info) << "[asio] Shutting down global io_service.";
         work.reset();
         service->stop();
-        if (thread->get_id() != std::this_thread::get_id())
-            thread->join();
-        else
-            thread->detach();
+        for (auto& thread : *threads) {
+            if (thread.get_id() != std::this_thread::get_id())
+                thread.join();
+            else
+                thread.detach();
+        }
     });
 }
 
@@ -107,12 +133,29 @@ struct server::impl
     std::shared_ptr<IO::AsyncEventServer>                  primary_amcp_server_;
     std::shared_ptr<osc::client>                           osc_client_ = std::make_shared<osc::client>(io_service_);
     std::vector<std::shared_ptr<void>>                     predefined_osc_subscriptions_;
+    std::unique_ptr<osc::control_server>                   osc_control_server_;
+    std::shared_ptr<binary::monitor_publisher>             monitor_publisher_ =
+        std::make_shared<binary::monitor_publisher>();
+    std::shared_ptr<shm::monitor_export>                   monitor_export_;
     spl::shared_ptr<std::vector<protocol::amcp::channel_context>> channels_;
     spl::shared_ptr<core::cg_producer_registry>                   cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>                producer_registry_;
     spl::shared_ptr<core::frame_consumer_registry>                consumer_registry_;
     std::function<void(bool)>                                     shutdown_server_now_;
 
+    struct configured_consumer
+    {
+        std::wstring                          name;
+        boost::property_tree::wptree          config;
+        spl::shared_ptr<core::frame_consumer> consumer;
+    };
+
+    // As last applied from the configuration file, so that a reload only touches what changed in it
+    std::mutex                                    reload_mutex_;
+    std::atomic<bool>                             started_{false};
+    std::vector<boost::property_tree::wptree>     xml_channels_;
+    std::vector<std::vector<configured_consumer>> configured_consumers_; // By channel
+
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
@@ -124,36 +167,57 @@ struct server::impl
         , shutdown_server_now_(std::move(shutdown_server_now))
     {
         caspar::core::diagnostics::osd::register_sink();
+        caspar::core::diagnostics::metrics::register_sink();
     }
 
     void start()
     {
+        caspar::timer startup_timer;
+        caspar::timer phase_timer;
+        auto          initialized = [&](const wchar_t* phase) {
+            CASPAR_LOG(info) << L"Initialized " << phase << L" in " << static_cast<int>(phase_timer.elapsed() * 1000)
+                             << L" ms.";
+            phase_timer.restart();
+        };
+
         setup_video_modes(env::properties());
-        CASPAR_LOG(info) << L"Initialized video modes.";
+        initialized(L"video modes");
 
-        auto xml_channels = setup_channels(env::properties());
-        CASPAR_LOG(info) << L"Initialized channels.";
+        xml_channels_ = setup_channels(env::properties());
+        configured_consumers_.resize(xml_channels_.size());
+        initialized(L"channels");
 
         setup_amcp_command_repo();
-        CASPAR_LOG(info) << L"Initialized command repository.";
+        initialized(L"command repository");
 
         module_dependencies dependencies(
-            cg_registry_, producer_registry_, consumer_registry_, amcp_command_repo_wrapper_);
+            cg_registry_, producer_registry_, consumer_registry_, amcp_command_repo_wrapper_, [this] {
+                return accelerator_.create_image_mixer(0, common::bit_depth::bit8);
+            });
         initialize_modules(dependencies);
-        CASPAR_LOG(info) << L"Initialized modules.";
-
-        setup_channel_producers_and_consumers(xml_channels);
-        CASPAR_LOG(info) << L"Initialized startup producers.";
+        initialized(L"modules");
 
+        // Before the consumers and producers, so that clients can connect while the channels report initialising
         setup_controllers(env::properties());
-        CASPAR_LOG(info) << L"Initialized controllers.";
+        initialized(L"controllers");
 
         setup_osc(env::properties());
-        CASPAR_LOG(info) << L"Initialized osc.";
+        initialized(L"osc");
+
+        setup_memory_monitor();
+
+        setup_channel_producers_and_consumers(xml_channels_);
+        initialized(L"startup consumers and producers");
+
+        started_ = true;
+        CASPAR_LOG(info) << L"Started in " << static_cast<int>(startup_timer.elapsed() * 1000) << L" ms.";
     }
 
     ~impl()
     {
+        set_memory_governor_listener(nullptr);
+        osc_control_server_.reset();
+
         std::weak_ptr<boost::asio::io_service> weak_io_service = io_service_;
         io_service_.reset();
         predefined_osc_subscriptions_.clear();
@@ -259,6 +323,17 @@ struct server::impl
 
         std::vector<wptree> xml_channels;
 
+        // The channels are built in parallel, as each starts its threads and sets up its mixer on the device
+        std::vector<std::future<spl::shared_ptr<video_channel>>> pending;
+
+        auto export_name = pt.get(L"configuration.shared-memory.name", L"");
+        if (!export_name.empty()) {
+            auto channel_count = pt.get_child(L"configuration.channels", wptree()).size();
+            auto slot_size     = pt.get<size_t>(L"configuration.shared-memory.slot-size", 262144);
+            monitor_export_ =
+                std::make_shared<shm::monitor_export>(export_name, static_cast<int>(channel_count), slot_size);
+        }
+
         for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
             xml_channels.push_back(xml_channel.second);
             ptree_verify_element_name(xml_channel, L"channel");
@@ -274,35 +349,144 @@ struct server::impl
             if (color_space_str != L"bt709" && color_space_str != L"bt2020")
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid color-space, must be bt709 or bt2020"));
 
+            // Channels of an HDR transfer are mixed in linear light, which needs the range of 16 bits to encode to
+            auto color_transfer_str = boost::to_lower_copy(xml_channel.second.get(L"color-transfer", L"bt709"));
+            if (color_transfer_str != L"bt709" && color_transfer_str != L"pq" && color_transfer_str != L"hlg")
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid color-transfer, must be bt709, pq or hlg"));
+            if (color_transfer_str != L"bt709" && color_depth != 16)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"color-transfer " + color_transfer_str +
+                                                                L" needs a color-depth of 16"));
+
             if (format_desc.format == video_format::invalid)
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
 
-            auto weak_client = std::weak_ptr<osc::client>(osc_client_);
-            auto channel_id  = static_cast<int>(channels_->size() + 1);
-            auto depth       = color_depth == 16 ? common::bit_depth::bit16 : common::bit_depth::bit8;
+            core::video_channel_options channel_options;
+            channel_options.pipeline_depth = xml_channel.second.get(L"pipeline-depth", 0);
+            if (channel_options.pipeline_depth < 0 || channel_options.pipeline_depth > 4)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid pipeline-depth: " +
+                                                                std::to_wstring(channel_options.pipeline_depth)));
+            channel_options.mixer_depth = xml_channel.second.get(L"mixer-depth", 1);
+            if (channel_options.mixer_depth < 1 || channel_options.mixer_depth > 4)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid mixer-depth: " +
+                                                                std::to_wstring(channel_options.mixer_depth)));
+            channel_options.route_only       = xml_channel.second.get(L"route-only", false);
+            channel_options.damage_tracking  = xml_channel.second.get(L"damage-tracking", false);
+            channel_options.render_scale     = xml_channel.second.get(L"render-scale", 1.0);
+            if (channel_options.render_scale < 0.1 || channel_options.render_scale > 1.0)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid render-scale, must be 0.1 to 1.0"));
+            channel_options.audio_meter_rate = xml_channel.second.get(L"audio-meter-rate", 0.0);
+            if (channel_options.audio_meter_rate < 0.0)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid audio-meter-rate, must be 0 or more"));
+            channel_options.frame_history = xml_channel.second.get(L"frame-history", 0.0);
+            if (channel_options.frame_history < 0.0 || channel_options.frame_history > 60.0)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid frame-history, must be 0 to 60 seconds"));
+
+            auto late_consumer_str = boost::to_lower_copy(xml_channel.second.get(L"late-consumer", L"wait"));
+            if (late_consumer_str != L"wait" && late_consumer_str != L"drop")
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid late-consumer, must be wait or drop"));
+            channel_options.drop_late_consumers = late_consumer_str == L"drop";
+            channel_options.consumer_budget     = xml_channel.second.get(L"consumer-budget", 1.0);
+            if (channel_options.consumer_budget <= 0.0)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid consumer-budget, must be positive"));
+
+            auto clock_str = boost::to_lower_copy(xml_channel.second.get(L"clock", L"realtime"));
+            if (clock_str != L"realtime" && clock_str != L"offline")
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid clock, must be realtime or offline"));
+            channel_options.offline = clock_str == L"offline";
+
+            auto accelerator_device = xml_channel.second.get(L"accelerator-device", -1);
+
+            auto                      tiles_str = boost::to_lower_copy(xml_channel.second.get(L"tiles", L"1x1"));
+            std::vector<std::wstring> tiles;
+            boost::split(tiles, tiles_str, boost::is_any_of(L"x"));
+            int tile_columns = 0;
+            int tile_rows    = 0;
+            try {
+                if (tiles.size() == 2) {
+                    tile_columns = std::stoi(tiles[0]);
+                    tile_rows    = std::stoi(tiles[1]);
+                }
+            } catch (std::exception&) {
+            }
+            if (tile_columns < 1 || tile_columns > 8 || tile_rows < 1 || tile_rows > 8)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid tiles: " + tiles_str +
+                                                                L", must be columns x rows of 1 to 8, e.g. 2x2"));
+
+            auto weak_client    = std::weak_ptr<osc::client>(osc_client_);
+            auto weak_publisher = std::weak_ptr<binary::monitor_publisher>(monitor_publisher_);
+            auto weak_export    = std::weak_ptr<shm::monitor_export>(monitor_export_);
+            auto channel_id     = static_cast<int>(pending.size() + 1);
+            auto depth          = color_depth == 16 ? common::bit_depth::bit16 : common::bit_depth::bit8;
             auto default_color_space =
                 color_space_str == L"bt2020" ? core::color_space::bt2020 : core::color_space::bt709;
-            auto channel =
-                spl::make_shared<video_channel>(channel_id,
-                                                format_desc,
-                                                default_color_space,
-                                                accelerator_.create_image_mixer(channel_id, depth),
-                                                [channel_id, weak_client](core::monitor::state channel_state) {
-                                                    monitor::state state;
-                                                    state[""]["channel"][channel_id] = channel_state;
-                                                    auto client                      = weak_client.lock();
-                                                    if (client) {
-                                                        client->send(std::move(state));
-                                                    }
-                                                });
-
-            const std::wstring lifecycle_key = L"lock" + std::to_wstring(channel_id);
+            auto transfer = color_transfer_str == L"pq"    ? core::color_transfer::pq
+                            : color_transfer_str == L"hlg" ? core::color_transfer::hlg
+                                                           : core::color_transfer::bt709;
+
+            // In order, so that the channels are assigned to accelerator devices the same way on every start
+            auto image_mixer = accelerator_.create_image_mixer(
+                channel_id, depth, transfer, accelerator_device, tile_columns, tile_rows);
+
+            pending.push_back(std::async(
+                std::launch::async,
+                [=, image_mixer = std::move(image_mixer)]() mutable {
+                    return spl::make_shared<video_channel>(
+                        channel_id,
+                        format_desc,
+                        default_color_space,
+                        std::move(image_mixer),
+                        [channel_id, weak_client, weak_publisher, weak_export](core::monitor::state channel_state) {
+                            monitor::state state;
+                            state[""]["channel"][channel_id] = channel_state;
+                            if (auto exp = weak_export.lock()) {
+                                exp->send(channel_id, state);
+                            }
+                            if (auto publisher = weak_publisher.lock()) {
+                                publisher->send(channel_id, state);
+                            }
+                            auto client = weak_client.lock();
+                            if (client) {
+                                client->send(std::move(state));
+                            }
+                        },
+                        channel_options);
+                }));
+        }
+
+        for (auto& channel_future : pending) {
+            auto channel = channel_future.get();
+            channel->set_initialising(true);
+
+            const std::wstring lifecycle_key = L"lock" + std::to_wstring(channel->index());
             channels_->emplace_back(channel, channel->stage(), lifecycle_key);
         }
 
         return xml_channels;
     }
 
+    // The usage of the memory governor, as /memory on OSC and as channel 0 of the monitor publisher
+    void setup_memory_monitor()
+    {
+        auto weak_client    = std::weak_ptr<osc::client>(osc_client_);
+        auto weak_publisher = std::weak_ptr<binary::monitor_publisher>(monitor_publisher_);
+
+        set_memory_governor_listener([weak_client, weak_publisher](const memory_statistics& statistics) {
+            monitor::state state;
+            state[""]["memory"]["total"]    = statistics.total;
+            state[""]["memory"]["pressure"] = std::wstring(to_string(statistics.pressure));
+            for (auto& subsystem : statistics.subsystems) {
+                state[""]["memory"]["subsystem"][subsystem.subsystem] = subsystem.bytes;
+            }
+            if (auto publisher = weak_publisher.lock()) {
+                publisher->send(0, state);
+            }
+            if (auto client = weak_client.lock()) {
+                client->send(std::move(state));
+            }
+        });
+    }
+
     void setup_osc(const boost::property_tree::wptree& pt)
     {
         using boost::property_tree::wptree;
@@ -320,16 +504,32 @@ struct server::impl
                 const auto address = ptree_get<std::wstring>(predefined_client.second, L"address");
                 const auto port    = ptree_get<unsigned short>(predefined_client.second, L"port");
 
+                osc::subscription_options options;
+                options.max_rate = predefined_client.second.get(L"max-rate", 0.0);
+                if (auto filters = predefined_client.second.get_child_optional(L"filters")) {
+                    for (auto& filter : *filters) {
+                        options.patterns.push_back(u8(filter.second.get_value<std::wstring>()));
+                    }
+                }
+
                 boost::system::error_code ec;
                 auto                      ipaddr = address_v4::from_string(u8(address), ec);
                 if (!ec)
                     predefined_osc_subscriptions_.push_back(
-                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port)));
+                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port), options));
                 else
                     CASPAR_LOG(warning) << "Invalid OSC client. Must be valid ipv4 address: " << address;
             }
         }
 
+        if (auto control_port = pt.get<unsigned short>(L"configuration.osc.control-port", 0)) {
+            std::vector<std::shared_ptr<core::stage>> stages;
+            for (auto& channel : *channels_) {
+                stages.push_back(channel.raw_channel->stage());
+            }
+            osc_control_server_ = std::make_unique<osc::control_server>(control_port, std::move(stages));
+        }
+
         if (!disable_send_to_amcp_clients && primary_amcp_server_)
             primary_amcp_server_->add_client_lifecycle_object_factory(
                 [=](const std::string& ipv4_address) -> std::pair<std::wstring, std::shared_ptr<void>> {
@@ -345,61 +545,213 @@ struct server::impl
     {
         auto console_client = spl::make_shared<IO::ConsoleClientInfo>();
 
+        // Each channel on a thread of its own, as consumers such as DeckLink take a while to open their devices. The
+        // consumers and producers of a channel are still set up in the order they are configured.
+        std::vector<std::future<void>> pending;
+        for (auto& channel : *channels_) {
+            pending.push_back(std::async(std::launch::async, [&, channel] {
+                caspar::timer timer;
+                setup_channel(channel, xml_channels.at(channel.raw_channel->index() - 1), console_client);
+                channel.raw_channel->set_initialising(false);
+                CASPAR_LOG(info) << L"Initialized channel " << channel.raw_channel->index() << L" in "
+                                 << static_cast<int>(timer.elapsed() * 1000) << L" ms.";
+            }));
+        }
+
+        // Every channel is waited for before the first error is thrown, as they refer to this frame
+        std::exception_ptr error;
+        for (auto& channel_future : pending) {
+            try {
+                channel_future.get();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void setup_channel(const protocol::amcp::channel_context&        channel,
+                       const boost::property_tree::wptree&           xml_channel,
+                       const spl::shared_ptr<IO::ConsoleClientInfo>& console_client)
+    {
+        core::diagnostics::scoped_call_context save;
+        core::diagnostics::call_context::for_thread().video_channel = channel.raw_channel->index();
+
+        // Consumers
+        if (xml_channel.get_child_optional(L"consumers")) {
+            for (auto& xml_consumer : xml_channel | witerate_children(L"consumers") | welement_context_iteration) {
+                auto name = xml_consumer.first;
+
+                try {
+                    if (name != L"<xmlcomment>")
+                        add_consumer(channel.raw_channel, name, xml_consumer.second);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        }
+
+        // Producers
+        if (xml_channel.get_child_optional(L"producers")) {
+            for (auto& xml_producer : xml_channel | witerate_children(L"producers") | welement_context_iteration) {
+                ptree_verify_element_name(xml_producer, L"producer");
+
+                const std::wstring command = xml_producer.second.get_value(L"");
+                const auto         attrs   = xml_producer.second.get_child(L"<xmlattr>");
+                const int          id      = attrs.get(L"id", -1);
+
+                try {
+                    std::list<std::wstring> tokens{
+                        L"PLAY", (boost::wformat(L"%i-%i") % channel.raw_channel->index() % id).str()};
+                    IO::tokenize(command, tokens);
+                    auto cmd = amcp_command_repo_->parse_command(console_client, tokens, L"");
+
+                    if (cmd) {
+                        std::wstring res = cmd->Execute(channels_).get();
+                        console_client->send(std::move(res), false);
+                    }
+                } catch (const user_error&) {
+                    CASPAR_LOG(error) << "Failed to parse command: " << command;
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        }
+    }
+
+    // Each channel only ever adds its own consumers, so this needs no lock while they are set up in parallel
+    void add_consumer(const std::shared_ptr<core::video_channel>& channel,
+                      const std::wstring&                         name,
+                      const boost::property_tree::wptree&         config)
+    {
         std::vector<spl::shared_ptr<core::video_channel>> channels_vec;
         for (auto& cc : *channels_) {
             channels_vec.emplace_back(cc.raw_channel);
         }
 
-        for (auto& channel : *channels_) {
-            core::diagnostics::scoped_call_context save;
-            core::diagnostics::call_context::for_thread().video_channel = channel.raw_channel->index();
-
-            auto xml_channel = xml_channels.at(channel.raw_channel->index() - 1);
-
-            // Consumers
-            if (xml_channel.get_child_optional(L"consumers")) {
-                for (auto& xml_consumer : xml_channel | witerate_children(L"consumers") | welement_context_iteration) {
-                    auto name = xml_consumer.first;
-
-                    try {
-                        if (name != L"<xmlcomment>")
-                            channel.raw_channel->output().add(
-                                consumer_registry_->create_consumer(name,
-                                                                    xml_consumer.second,
-                                                                    video_format_repository_,
-                                                                    channels_vec,
-                                                                    channel.raw_channel->get_consumer_channel_info()));
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
-                    }
-                }
+        core::consumer_delay delay;
+        delay.video = core::parse_consumer_delay(config.get(L"video-delay", std::wstring(L"0")));
+        delay.audio = core::parse_consumer_delay(config.get(L"audio-delay", std::wstring(L"0")));
+
+        auto consumer = consumer_registry_->create_consumer(
+            name, config, video_format_repository_, channels_vec, channel->get_consumer_channel_info());
+        channel->output().add(consumer, delay);
+        configured_consumers_.at(channel->index() - 1).push_back(configured_consumer{name, config, consumer});
+    }
+
+    std::vector<std::wstring> reload_configuration()
+    {
+        if (!started_) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"The server is still starting"));
+        }
+
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+
+        auto pt = env::read_properties();
+
+        std::vector<boost::property_tree::wptree> xml_channels;
+        for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
+            ptree_verify_element_name(xml_channel, L"channel");
+            xml_channels.push_back(xml_channel.second);
+        }
+
+        std::vector<std::wstring> changes;
+        if (xml_channels.size() != xml_channels_.size()) {
+            changes.push_back(L"channels: " + std::to_wstring(xml_channels.size()) + L" configured, " +
+                              std::to_wstring(xml_channels_.size()) + L" running, RESTART to change");
+        }
+        for (size_t n = 0; n < std::min(xml_channels.size(), xml_channels_.size()); ++n) {
+            if (xml_channels[n] != xml_channels_[n]) {
+                reload_channel(channels_->at(n).raw_channel, xml_channels_[n], xml_channels[n], changes);
+                xml_channels_[n] = xml_channels[n];
             }
+        }
 
-            // Producers
-            if (xml_channel.get_child_optional(L"producers")) {
-                for (auto& xml_producer : xml_channel | witerate_children(L"producers") | welement_context_iteration) {
-                    ptree_verify_element_name(xml_producer, L"producer");
-
-                    const std::wstring command = xml_producer.second.get_value(L"");
-                    const auto         attrs   = xml_producer.second.get_child(L"<xmlattr>");
-                    const int          id      = attrs.get(L"id", -1);
-
-                    try {
-                        std::list<std::wstring> tokens{
-                            L"PLAY", (boost::wformat(L"%i-%i") % channel.raw_channel->index() % id).str()};
-                        IO::tokenize(command, tokens);
-                        auto cmd = amcp_command_repo_->parse_command(console_client, tokens, L"");
-
-                        if (cmd) {
-                            std::wstring res = cmd->Execute(channels_).get();
-                            console_client->send(std::move(res), false);
-                        }
-                    } catch (const user_error&) {
-                        CASPAR_LOG(error) << "Failed to parse command: " << command;
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
+        for (auto& change : changes) {
+            CASPAR_LOG(info) << L"[reload] " << change;
+        }
+        return changes;
+    }
+
+    void reload_channel(const std::shared_ptr<core::video_channel>& channel,
+                        const boost::property_tree::wptree&         old_config,
+                        const boost::property_tree::wptree&         new_config,
+                        std::vector<std::wstring>&                  changes)
+    {
+        auto prefix = L"channel " + std::to_wstring(channel->index()) + L": ";
+
+        // The other settings of a channel are fixed when it is created, and startup producers only play on start
+        auto fixed = [](boost::property_tree::wptree config) {
+            config.erase(L"video-mode");
+            config.erase(L"consumers");
+            config.erase(L"producers");
+            return config;
+        };
+        if (fixed(old_config) != fixed(new_config)) {
+            changes.push_back(prefix + L"settings other than video-mode and consumers changed, RESTART to apply them");
+        }
+
+        auto video_mode = new_config.get(L"video-mode", L"PAL");
+        if (video_mode != old_config.get(L"video-mode", L"PAL")) {
+            auto format_desc = video_format_repository_.find(video_mode);
+            if (format_desc.format == video_format::invalid) {
+                changes.push_back(prefix + L"invalid video-mode " + video_mode);
+            } else {
+                channel->stage()->video_format_desc(format_desc);
+                changes.push_back(prefix + L"video-mode " + video_mode);
+            }
+        }
+
+        // Consumers that are configured as they were keep running, the others are replaced
+        auto& configured = configured_consumers_.at(channel->index() - 1);
+
+        std::vector<bool>                                                  kept(configured.size(), false);
+        std::vector<std::pair<std::wstring, boost::property_tree::wptree>> added;
+        if (new_config.get_child_optional(L"consumers")) {
+            for (auto& xml_consumer : new_config | witerate_children(L"consumers") | welement_context_iteration) {
+                if (xml_consumer.first == L"<xmlcomment>") {
+                    continue;
+                }
+
+                auto match = configured.size();
+                for (size_t n = 0; n < configured.size() && match == configured.size(); ++n) {
+                    if (!kept[n] && configured[n].name == xml_consumer.first &&
+                        configured[n].config == xml_consumer.second) {
+                        match = n;
                     }
                 }
+
+                if (match < configured.size()) {
+                    kept[match] = true;
+                } else {
+                    added.emplace_back(xml_consumer.first, xml_consumer.second);
+                }
+            }
+        }
+
+        // Before any is added, so that a device is released before it is opened again
+        std::vector<configured_consumer> remaining;
+        for (size_t n = 0; n < configured.size(); ++n) {
+            if (kept[n]) {
+                remaining.push_back(std::move(configured[n]));
+            } else {
+                channel->output().remove(configured[n].consumer);
+                changes.push_back(prefix + L"removed " + configured[n].name);
+            }
+        }
+        configured = std::move(remaining);
+
+        for (auto& consumer : added) {
+            try {
+                add_consumer(channel, consumer.first, consumer.second);
+                changes.push_back(prefix + L"added " + consumer.first);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                changes.push_back(prefix + L"failed to add " + consumer.first);
             }
         }
     }
@@ -416,6 +768,7 @@ struct server::impl
             consumer_registry_,
             amcp_command_repo_,
             shutdown_server_now_,
+            [this] { return reload_configuration(); },
             u8(caspar::env::properties().get(L"configuration.amcp.media-server.host", L"127.0.0.1")),
             u8(caspar::env::properties().get(L"configuration.amcp.media-server.port", L"8000")),
             ogl_device,
@@ -437,13 +790,15 @@ struct server::impl
             auto protocol = ptree_get<std::wstring>(xml_controller.second, L"protocol");
 
             if (name == L"tcp") {
-                auto port = ptree_get<unsigned int>(xml_controller.second, L"port");
+                auto port            = ptree_get<unsigned int>(xml_controller.second, L"port");
+                auto max_send_buffer = xml_controller.second.get(L"max-send-buffer", 16 * 1024 * 1024);
 
                 try {
                     auto asyncbootstrapper = spl::make_shared<IO::AsyncEventServer>(
                         io_service_,
                         create_protocol(protocol, L"TCP Port " + std::to_wstring(port)),
-                        static_cast<short>(port));
+                        static_cast<short>(port),
+                        static_cast<size_t>(std::max(0, max_send_buffer)));
                     async_servers_.push_back(asyncbootstrapper);
 
                     if (!primary_amcp_server_ && boost::iequals(protocol, L"AMCP"))
@@ -467,6 +822,13 @@ struct server::impl
         if (boost::iequals(name, L"AMCP"))
             return amcp::create_char_amcp_strategy_factory(port_description, spl::make_shared_ptr(amcp_command_repo_));
 
+        if (boost::iequals(name, L"BINARY"))
+            return binary::create_binary_strategy_factory(
+                port_description, spl::make_shared_ptr(amcp_command_repo_), monitor_publisher_);
+
+        if (boost::iequals(name, L"METRICS"))
+            return metrics::create_metrics_strategy_factory();
+
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid protocol: " + name));
     }
 };